@@ -0,0 +1,57 @@
+#
+# Build-time compilation of GLSL shaders to SPIR-V.
+#
+# Shaders are compiled with `glslc` (from the Vulkan SDK, or shaderc) into C
+# initializer lists of SPIR-V words, which are then `#include`d straight into
+# an array in the consuming source file:
+#
+#   static uint32_t const spirv[] =
+#     #include "shaders/device_probe.comp.inc"
+#   ;
+#
+# so that no shader files have to be found at run time.
+#
+
+if( NOT Vulkan_GLSLC_EXECUTABLE )
+  # Only provided by FindVulkan as of CMake 3.19.
+  find_program( Vulkan_GLSLC_EXECUTABLE
+    NAMES glslc
+    HINTS "$ENV{VULKAN_SDK}/bin" "$ENV{VULKAN_SDK}/Bin"
+    )
+endif()
+if( NOT Vulkan_GLSLC_EXECUTABLE )
+  message( FATAL_ERROR "glslc not found. Install the Vulkan SDK or shaderc, or set Vulkan_GLSLC_EXECUTABLE." )
+endif()
+
+#
+# Compile shaders for a target.
+#
+#   myengine_add_shaders( <target> <source>... )
+#
+# Each source is a GLSL file whose extension names the stage, e.g. `foo.comp`.
+# (`#include`s in shaders are not tracked as dependencies.)
+# It is compiled to `${CMAKE_CURRENT_BINARY_DIR}/shaders/<file name>.inc`, and
+# `${CMAKE_CURRENT_BINARY_DIR}` is added to the target's private include
+# directories.
+#
+function( myengine_add_shaders target )
+  set( outputs )
+  foreach( source ${ARGN} )
+    get_filename_component( source_abs "${source}" ABSOLUTE )
+    get_filename_component( source_name "${source}" NAME )
+    set( output "${CMAKE_CURRENT_BINARY_DIR}/shaders/${source_name}.inc" )
+    add_custom_command(
+      OUTPUT "${output}"
+      COMMAND "${CMAKE_COMMAND}" -E make_directory "${CMAKE_CURRENT_BINARY_DIR}/shaders"
+      COMMAND "${Vulkan_GLSLC_EXECUTABLE}" -O -mfmt=c
+              --target-env=vulkan1.0
+              -o "${output}" "${source_abs}"
+      MAIN_DEPENDENCY "${source_abs}"
+      COMMENT "Compiling shader ${source_name}"
+      VERBATIM
+      )
+    list( APPEND outputs "${output}" )
+  endforeach()
+  target_sources( ${target} PRIVATE ${outputs} )
+  target_include_directories( ${target} PRIVATE "${CMAKE_CURRENT_BINARY_DIR}" )
+endfunction()
@@ -0,0 +1,711 @@
+#define MYENGINE_LOG_MODULE "vulkan"
+#include "capabilities.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vulkan/vulkan.hpp>
+
+#ifndef _WIN32
+# include <dirent.h>
+# include <sys/stat.h>
+#endif
+
+#include <myengine/logging.h>
+#include <myengine/mapped_file.h>
+
+namespace myengine::vulkan {
+
+////////////////////////////////////////////////////////////////////////////////
+// name_set
+
+name_set::name_set()
+  : m_arena(),
+    m_offsets(),
+    m_table( 16, 0 )
+{}
+
+uint32_t
+name_set::hash( std::string_view name )
+{
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  for( char c : name )
+  {
+    h = ( h ^ static_cast< uint8_t >( c ) ) * 16777619u;
+  }
+  return h;
+}
+
+void
+name_set::rehash( std::size_t table_size )
+{
+  m_table.assign( table_size, 0 );
+  std::size_t const mask = table_size - 1;
+  for( uint32_t i = 0; i < m_offsets.size(); ++i )
+  {
+    std::size_t slot = hash( ( *this )[ i ] ) & mask;
+    while( m_table[ slot ] != 0 )
+    {
+      slot = ( slot + 1 ) & mask;
+    }
+    m_table[ slot ] = i + 1;
+  }
+}
+
+void
+name_set::insert( std::string_view name )
+{
+  if( contains( name ) )
+  {
+    return;
+  }
+  // Keep the load factor at or below one half.
+  if( ( m_offsets.size() + 1 ) * 2 > m_table.size() )
+  {
+    rehash( m_table.size() * 2 );
+  }
+  auto const offset = static_cast< uint32_t >( m_arena.size() );
+  m_arena.insert( m_arena.end(), name.begin(), name.end() );
+  m_arena.push_back( '\0' );
+  m_offsets.push_back( offset );
+
+  std::size_t const mask = m_table.size() - 1;
+  std::size_t slot = hash( name ) & mask;
+  while( m_table[ slot ] != 0 )
+  {
+    slot = ( slot + 1 ) & mask;
+  }
+  m_table[ slot ] = static_cast< uint32_t >( m_offsets.size() );
+}
+
+bool
+name_set::contains( std::string_view name ) const
+{
+  std::size_t const mask = m_table.size() - 1;
+  std::size_t slot = hash( name ) & mask;
+  while( uint32_t const entry = m_table[ slot ] )
+  {
+    if( name == ( *this )[ entry - 1 ] )
+    {
+      return true;
+    }
+    slot = ( slot + 1 ) & mask;
+  }
+  return false;
+}
+
+bool
+name_set::contains_all( std::vector< char const* > const& names,
+                        char const** first_missing ) const
+{
+  for( auto const& name : names )
+  {
+    if( !contains( name ) )
+    {
+      if( first_missing )
+      {
+        *first_missing = name;
+      }
+      return false;
+    }
+  }
+  if( first_missing )
+  {
+    *first_missing = nullptr;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Registry
+
+namespace {
+
+/// Throw if a Vulkan query failed.
+void
+check_result( VkResult res, char const* what )
+{
+  if( res != VK_SUCCESS && res != VK_INCOMPLETE )
+  {
+    std::stringstream ss;
+    ss  << "Failed to " << what << ": "
+        << vk::to_string( static_cast< vk::Result >( res ) );
+    throw std::runtime_error( ss.str() );
+  }
+}
+
+/// API version supported by the loader.
+uint32_t
+query_loader_version()
+{
+  // Only exported by 1.1+ loaders.
+  auto enumerate_version = (PFN_vkEnumerateInstanceVersion)
+                           vkGetInstanceProcAddr( nullptr,
+                                                  "vkEnumerateInstanceVersion" );
+  uint32_t version = VK_API_VERSION_1_0;
+  if( enumerate_version )
+  {
+    enumerate_version( &version );
+  }
+  return version;
+}
+
+instance_capabilities
+query_instance_capabilities()
+{
+  LOG_DEBUG( "Querying instance capabilities" );
+  instance_capabilities caps = {};
+
+  caps.api_version = query_loader_version();
+
+  uint32_t count = 0;
+  check_result( vkEnumerateInstanceExtensionProperties( nullptr, &count,
+                                                        nullptr ),
+                "enumerate instance extensions" );
+  caps.extension_properties.resize( count );
+  check_result( vkEnumerateInstanceExtensionProperties(
+                  nullptr, &count, caps.extension_properties.data() ),
+                "enumerate instance extensions" );
+  caps.extension_properties.resize( count );
+  for( auto const& p : caps.extension_properties )
+  {
+    caps.extensions.insert( p.extensionName );
+  }
+
+  count = 0;
+  check_result( vkEnumerateInstanceLayerProperties( &count, nullptr ),
+                "enumerate instance layers" );
+  caps.layer_properties.resize( count );
+  check_result( vkEnumerateInstanceLayerProperties(
+                  &count, caps.layer_properties.data() ),
+                "enumerate instance layers" );
+  caps.layer_properties.resize( count );
+  for( auto const& p : caps.layer_properties )
+  {
+    caps.layers.insert( p.layerName );
+  }
+  return caps;
+}
+
+/// Everything but the properties, which the caller already has.
+void
+query_device_details( device_capabilities& caps )
+{
+  VkPhysicalDevice const device = caps.device;
+  LOG_DEBUG( "Querying capabilities of device (" << caps.properties.deviceID
+                                                 << ") '"
+                                                 << caps.properties.deviceName
+                                                 << "'" );
+  vkGetPhysicalDeviceFeatures( device, &caps.features );
+  vkGetPhysicalDeviceMemoryProperties( device, &caps.memory_properties );
+
+  uint32_t count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties( device, &count, nullptr );
+  caps.queue_families.resize( count );
+  vkGetPhysicalDeviceQueueFamilyProperties( device, &count,
+                                            caps.queue_families.data() );
+
+  count = 0;
+  check_result( vkEnumerateDeviceExtensionProperties( device, nullptr, &count,
+                                                      nullptr ),
+                "enumerate device extensions" );
+  caps.extension_properties.resize( count );
+  check_result( vkEnumerateDeviceExtensionProperties(
+                  device, nullptr, &count,
+                  caps.extension_properties.data() ),
+                "enumerate device extensions" );
+  caps.extension_properties.resize( count );
+  for( auto const& p : caps.extension_properties )
+  {
+    caps.extensions.insert( p.extensionName );
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Snapshot file
+//
+// A `snapshot_header`, then the body:
+//   - `VkExtensionProperties[ instance_extension_count ]`
+//   - `VkLayerProperties[ instance_layer_count ]`
+//   - `device_count` times: a `snapshot_device`, then
+//     `VkQueueFamilyProperties[ queue_family_count ]` and
+//     `VkExtensionProperties[ extension_count ]`.
+// Vulkan structs are stored as-is, which is why the Vulkan header version is
+// part of the key. Nothing is aligned; everything is copied out with `memcpy`.
+
+constexpr char SNAPSHOT_MAGIC[ 8 ] = { 'M', 'Y', 'E', 'C', 'A', 'P', 'S', 0 };
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+struct snapshot_header
+{
+  char magic[ 8 ];
+  uint32_t version;
+  uint32_t vk_header_version;
+  uint32_t loader_version;
+  uint32_t instance_extension_count;
+  uint64_t system_fingerprint;
+  uint32_t instance_layer_count;
+  uint32_t device_count;
+  uint64_t body_size;
+  uint64_t body_hash;
+};
+
+struct snapshot_device
+{
+  VkPhysicalDeviceProperties properties;
+  VkPhysicalDeviceFeatures features;
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  uint32_t queue_family_count;
+  uint32_t extension_count;
+};
+
+/// FNV-1a, 64 bit.
+uint64_t
+hash64( void const* data, std::size_t size,
+        uint64_t h = 14695981039346656037ull )
+{
+  auto const* p = static_cast< uint8_t const* >( data );
+  for( std::size_t i = 0; i < size; ++i )
+  {
+    h = ( h ^ p[ i ] ) * 1099511628211ull;
+  }
+  return h;
+}
+
+uint64_t
+hash_string( std::string const& s, uint64_t h )
+{
+  // Include the terminator so that "ab","c" and "a","bc" differ.
+  return hash64( s.c_str(), s.size() + 1, h );
+}
+
+/**
+ * Fingerprint of everything outside the snapshot that decides what the loader
+ * reports: loader environment variables and the installed driver (ICD) and
+ * layer manifests.
+ *
+ * @return False if the system cannot be fingerprinted cheaply, in which case
+ * the instance section of a snapshot is never trusted.
+ */
+bool
+system_fingerprint( uint64_t& h )
+{
+  h = hash64( nullptr, 0 );
+  static char const* const env_vars[] = {
+    "VK_ICD_FILENAMES", "VK_DRIVER_FILES", "VK_ADD_DRIVER_FILES",
+    "VK_LAYER_PATH", "VK_ADD_LAYER_PATH", "VK_INSTANCE_LAYERS",
+    "VK_LOADER_LAYERS_ENABLE", "VK_LOADER_LAYERS_DISABLE",
+    "VK_LOADER_DRIVERS_SELECT", "VK_LOADER_DRIVERS_DISABLE",
+  };
+  for( char const* name : env_vars )
+  {
+    char const* value = std::getenv( name );
+    h = hash_string( name, h );
+    h = hash_string( value ? value : "", h );
+  }
+#ifdef _WIN32
+  // Drivers and layers are registered in the registry; not worth walking.
+  return false;
+#else
+  // Manifest search directories, see the loader's "LoaderInterfaceArchitecture"
+  // documentation.
+  auto env_or = []( char const* name, std::string fallback ) {
+    char const* v = std::getenv( name );
+    return ( v && *v ) ? std::string( v ) : fallback;
+  };
+  std::string const home = env_or( "HOME", "" );
+  std::string const roots =
+    env_or( "XDG_CONFIG_HOME", home + "/.config" ) + ":" +
+    env_or( "XDG_CONFIG_DIRS", "/etc/xdg" ) + ":/etc:" +
+    env_or( "XDG_DATA_HOME", home + "/.local/share" ) + ":" +
+    env_or( "XDG_DATA_DIRS", "/usr/local/share:/usr/share" );
+
+  std::vector< std::string > files;
+  std::size_t begin = 0;
+  while( begin <= roots.size() )
+  {
+    std::size_t end = roots.find( ':', begin );
+    if( end == std::string::npos )
+    {
+      end = roots.size();
+    }
+    std::string const root = roots.substr( begin, end - begin );
+    begin = end + 1;
+    if( root.empty() )
+    {
+      continue;
+    }
+    for( char const* sub : { "/vulkan/icd.d", "/vulkan/implicit_layer.d",
+                             "/vulkan/explicit_layer.d" } )
+    {
+      std::string const dir = root + sub;
+      if( DIR* d = opendir( dir.c_str() ) )
+      {
+        while( dirent const* e = readdir( d ) )
+        {
+          if( e->d_name[ 0 ] != '.' )
+          {
+            files.push_back( dir + "/" + e->d_name );
+          }
+        }
+        closedir( d );
+      }
+    }
+  }
+  std::sort( files.begin(), files.end() );
+  for( auto const& f : files )
+  {
+    struct stat st = {};
+    h = hash_string( f, h );
+    if( stat( f.c_str(), &st ) == 0 )
+    {
+      int64_t const fields[] = { static_cast< int64_t >( st.st_ino ),
+                                 static_cast< int64_t >( st.st_size ),
+                                 static_cast< int64_t >( st.st_mtime ) };
+      h = hash64( fields, sizeof( fields ), h );
+    }
+  }
+  return true;
+#endif
+}
+
+/// Bounds-checked sequential reads from a snapshot body.
+class snapshot_reader
+{
+public:
+  snapshot_reader( uint8_t const* data, std::size_t size )
+    : m_data( data ),
+      m_size( size ),
+      m_pos( 0 )
+  {}
+
+  template< typename T >
+  bool
+  read( T& out )
+  {
+    return read_array( &out, 1 );
+  }
+
+  template< typename T >
+  bool
+  read_array( T* out, std::size_t n )
+  {
+    std::size_t const bytes = sizeof( T ) * n;
+    if( bytes > m_size - m_pos )
+    {
+      return false;
+    }
+    if( bytes )
+    {
+      memcpy( out, m_data + m_pos, bytes );
+    }
+    m_pos += bytes;
+    return true;
+  }
+
+  template< typename T >
+  bool
+  read_vector( std::vector< T >& out, std::size_t n )
+  {
+    // Guard the resize against garbage counts.
+    if( n > ( m_size - m_pos ) / sizeof( T ) )
+    {
+      return false;
+    }
+    out.resize( n );
+    return read_array( out.data(), n );
+  }
+
+private:
+  uint8_t const* m_data;
+  std::size_t m_size;
+  std::size_t m_pos;
+};
+
+template< typename T >
+void
+append_bytes( std::vector< uint8_t >& buf, T const* p, std::size_t n = 1 )
+{
+  auto const* b = reinterpret_cast< uint8_t const* >( p );
+  buf.insert( buf.end(), b, b + sizeof( T ) * n );
+}
+
+/// If two sets of properties describe the same device and driver build.
+bool
+same_device( VkPhysicalDeviceProperties const& a,
+             VkPhysicalDeviceProperties const& b )
+{
+  return a.vendorID == b.vendorID && a.deviceID == b.deviceID &&
+         a.driverVersion == b.driverVersion && a.apiVersion == b.apiVersion &&
+         memcmp( a.pipelineCacheUUID, b.pipelineCacheUUID, VK_UUID_SIZE ) == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Registry state
+
+struct registry
+{
+  std::mutex mutex;
+  std::unordered_map< VkPhysicalDevice,
+                      std::unique_ptr< device_capabilities > > devices;
+
+  /// Loaded snapshot, if valid. Device entries have a null `device`.
+  bool have_snapshot = false;
+  instance_capabilities snapshot_instance = {};
+  std::vector< device_capabilities > snapshot_devices;
+
+  /// Something was queried from the driver instead of the snapshot.
+  std::atomic< bool > stale{ false };
+};
+
+registry&
+state()
+{
+  static registry r;
+  return r;
+}
+
+/// Parse and validate a snapshot file into the registry.
+bool
+load_snapshot_locked( registry& r, std::string const& path )
+{
+  mapped_file file;
+  try
+  {
+    file = mapped_file::open_read( path );
+  }
+  catch( std::exception const& ex )
+  {
+    LOG_DEBUG( "No capability snapshot loaded: " << ex.what() );
+    return false;
+  }
+
+  snapshot_header hdr;
+  if( file.size() < sizeof( hdr ) )
+  {
+    LOG_DEBUG( "Capability snapshot '" << path << "' is truncated" );
+    return false;
+  }
+  memcpy( &hdr, file.data(), sizeof( hdr ) );
+  uint64_t fingerprint = 0;
+  bool const fingerprinted = system_fingerprint( fingerprint );
+  if( memcmp( hdr.magic, SNAPSHOT_MAGIC, sizeof( SNAPSHOT_MAGIC ) ) != 0 ||
+      hdr.version != SNAPSHOT_VERSION ||
+      hdr.vk_header_version != VK_HEADER_VERSION )
+  {
+    LOG_DEBUG( "Capability snapshot '" << path << "' has a different format" );
+    return false;
+  }
+  if( !fingerprinted || hdr.system_fingerprint != fingerprint ||
+      hdr.loader_version != query_loader_version() )
+  {
+    LOG_DEBUG( "Capability snapshot '" << path << "' is stale: Vulkan loader, "
+               "driver or layer configuration changed" );
+    return false;
+  }
+  uint8_t const* body = file.data() + sizeof( hdr );
+  if( hdr.body_size != file.size() - sizeof( hdr ) ||
+      hdr.body_hash != hash64( body, hdr.body_size ) )
+  {
+    LOG_DEBUG( "Capability snapshot '" << path << "' is corrupt" );
+    return false;
+  }
+
+  snapshot_reader in( body, hdr.body_size );
+  instance_capabilities inst = {};
+  inst.api_version = hdr.loader_version;
+  std::vector< device_capabilities > devices;
+  bool ok =
+    in.read_vector( inst.extension_properties,
+                    hdr.instance_extension_count ) &&
+    in.read_vector( inst.layer_properties, hdr.instance_layer_count );
+  for( uint32_t i = 0; ok && i < hdr.device_count; ++i )
+  {
+    snapshot_device rec;
+    device_capabilities caps = {};
+    ok = in.read( rec ) &&
+         in.read_vector( caps.queue_families, rec.queue_family_count ) &&
+         in.read_vector( caps.extension_properties, rec.extension_count );
+    caps.device = VK_NULL_HANDLE;
+    caps.properties = rec.properties;
+    caps.features = rec.features;
+    caps.memory_properties = rec.memory_properties;
+    devices.push_back( std::move( caps ) );
+  }
+  if( !ok )
+  {
+    LOG_DEBUG( "Capability snapshot '" << path << "' is corrupt" );
+    return false;
+  }
+
+  // Extension names are fixed size arrays; make sure they are terminated
+  // before interning them.
+  auto intern = []( auto& props, name_set& names, auto member ) {
+    for( auto& p : props )
+    {
+      ( p.*member )[ sizeof( p.*member ) - 1 ] = '\0';
+      names.insert( p.*member );
+    }
+  };
+  intern( inst.extension_properties, inst.extensions,
+          &VkExtensionProperties::extensionName );
+  intern( inst.layer_properties, inst.layers, &VkLayerProperties::layerName );
+  for( auto& d : devices )
+  {
+    intern( d.extension_properties, d.extensions,
+            &VkExtensionProperties::extensionName );
+  }
+
+  r.snapshot_instance = std::move( inst );
+  r.snapshot_devices = std::move( devices );
+  r.have_snapshot = true;
+  LOG_DEBUG( "Loaded capability snapshot '" << path << "' with "
+                                            << r.snapshot_devices.size()
+                                            << " device(s)" );
+  return true;
+}
+
+} // namespace
+
+instance_capabilities const&
+get_instance_capabilities()
+{
+  static instance_capabilities const caps = [] {
+    registry& r = state();
+    {
+      std::lock_guard< std::mutex > lock( r.mutex );
+      if( r.have_snapshot )
+      {
+        return r.snapshot_instance;
+      }
+    }
+    r.stale.store( true, std::memory_order_relaxed );
+    return query_instance_capabilities();
+  }();
+  return caps;
+}
+
+device_capabilities const&
+get_device_capabilities( VkPhysicalDevice device )
+{
+  registry& r = state();
+  std::lock_guard< std::mutex > lock( r.mutex );
+  auto& entry = r.devices[ device ];
+  if( entry )
+  {
+    return *entry;
+  }
+
+  auto caps = std::make_unique< device_capabilities >();
+  caps->device = device;
+  // Always asked from the driver: it is the key to the snapshot entry.
+  vkGetPhysicalDeviceProperties( device, &caps->properties );
+  auto const snap = std::find_if(
+    r.snapshot_devices.begin(), r.snapshot_devices.end(),
+    [ & ]( device_capabilities const& d ) {
+      return same_device( d.properties, caps->properties );
+    } );
+  if( snap != r.snapshot_devices.end() )
+  {
+    *caps = *snap;
+    caps->device = device;
+  }
+  else
+  {
+    query_device_details( *caps );
+    r.stale.store( true, std::memory_order_relaxed );
+  }
+  entry = std::move( caps );
+  return *entry;
+}
+
+void
+forget_device_capabilities()
+{
+  registry& r = state();
+  std::lock_guard< std::mutex > lock( r.mutex );
+  r.devices.clear();
+}
+
+bool
+load_capability_snapshot( std::string const& path )
+{
+  registry& r = state();
+  std::lock_guard< std::mutex > lock( r.mutex );
+  r.have_snapshot = false;
+  r.snapshot_devices.clear();
+  return load_snapshot_locked( r, path );
+}
+
+bool
+capability_snapshot_stale()
+{
+  registry& r = state();
+  std::lock_guard< std::mutex > lock( r.mutex );
+  return !r.have_snapshot || r.stale.load( std::memory_order_relaxed );
+}
+
+void
+save_capability_snapshot( std::string const& path )
+{
+  instance_capabilities const& inst = get_instance_capabilities();
+  registry& r = state();
+
+  snapshot_header hdr = {};
+  memcpy( hdr.magic, SNAPSHOT_MAGIC, sizeof( SNAPSHOT_MAGIC ) );
+  hdr.version = SNAPSHOT_VERSION;
+  hdr.vk_header_version = VK_HEADER_VERSION;
+  hdr.loader_version = inst.api_version;
+  if( !system_fingerprint( hdr.system_fingerprint ) )
+  {
+    LOG_DEBUG( "Capability snapshot not saved: system cannot be fingerprinted "
+               "on this platform" );
+    return;
+  }
+  hdr.instance_extension_count =
+    static_cast< uint32_t >( inst.extension_properties.size() );
+  hdr.instance_layer_count =
+    static_cast< uint32_t >( inst.layer_properties.size() );
+
+  std::vector< uint8_t > body;
+  append_bytes( body, inst.extension_properties.data(),
+                inst.extension_properties.size() );
+  append_bytes( body, inst.layer_properties.data(),
+                inst.layer_properties.size() );
+  {
+    std::lock_guard< std::mutex > lock( r.mutex );
+    for( auto const& kv : r.devices )
+    {
+      device_capabilities const& d = *kv.second;
+      snapshot_device rec = {};
+      rec.properties = d.properties;
+      rec.features = d.features;
+      rec.memory_properties = d.memory_properties;
+      rec.queue_family_count = static_cast< uint32_t >( d.queue_families.size() );
+      rec.extension_count =
+        static_cast< uint32_t >( d.extension_properties.size() );
+      append_bytes( body, &rec );
+      append_bytes( body, d.queue_families.data(), d.queue_families.size() );
+      append_bytes( body, d.extension_properties.data(),
+                    d.extension_properties.size() );
+      ++hdr.device_count;
+    }
+  }
+  hdr.body_size = body.size();
+  hdr.body_hash = hash64( body.data(), body.size() );
+
+  write_file_atomic( path, { { &hdr, sizeof( hdr ) },
+                             { body.data(), body.size() } } );
+  LOG_DEBUG( "Saved capability snapshot '" << path << "' with "
+                                           << hdr.device_count
+                                           << " device(s)" );
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,192 @@
+/**
+ * Cached Vulkan capability registry.
+ *
+ * Instance level extensions and layers, and per physical device properties
+ * (including limits), features, memory properties, queue families and
+ * extensions are queried from the driver once and then kept for the life of
+ * the process (or, for devices, until `forget_device_capabilities`).
+ *
+ * Extension and layer names are interned into a `name_set`, so support queries
+ * are a hash and a probe or two, and do not allocate.
+ *
+ * The results can also be persisted across runs in a snapshot file, see
+ * `load_capability_snapshot`.
+ */
+
+#ifndef MYENGINE_CAPABILITIES_H
+#define MYENGINE_CAPABILITIES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine::vulkan {
+
+/**
+ * Immutable-after-construction set of interned, NUL-terminated names with
+ * constant time lookup.
+ *
+ * Names are copied into one contiguous arena and indexed by an open
+ * addressing hash table.
+ */
+class MYENGINE_EXPORT name_set
+{
+public:
+  name_set();
+
+  /**
+   * Add a name. Duplicates are ignored.
+   *
+   * Not for use once the set is shared between threads.
+   */
+  void insert( std::string_view name );
+
+  /// If the set contains `name`. Does not allocate.
+  [[nodiscard]] bool contains( std::string_view name ) const;
+
+  /**
+   * If the set contains every name given.
+   *
+   * @param [out] first_missing If not null, set to the first name that is not
+   * in the set, or null if all of them are.
+   */
+  [[nodiscard]] bool
+  contains_all( std::vector< char const* > const& names,
+                char const** first_missing = nullptr ) const;
+
+  /// Number of unique names.
+  [[nodiscard]] std::size_t
+  size() const
+  {
+    return m_offsets.size();
+  }
+
+  /// The `i`th name inserted.
+  [[nodiscard]] char const*
+  operator[]( std::size_t i ) const
+  {
+    return m_arena.data() + m_offsets[ i ];
+  }
+
+private:
+  // Names, each NUL-terminated, back to back.
+  std::vector< char > m_arena;
+  // Offset of each name in the arena, in insertion order.
+  std::vector< uint32_t > m_offsets;
+  // Hash table of (name index + 1), 0 for empty; power of two sized.
+  std::vector< uint32_t > m_table;
+
+  [[nodiscard]] static uint32_t hash( std::string_view name );
+  void rehash( std::size_t table_size );
+};
+
+/// What the Vulkan loader offers for instance creation.
+struct instance_capabilities
+{
+  /// Loader supported API version (`vkEnumerateInstanceVersion`).
+  uint32_t api_version;
+  std::vector< VkExtensionProperties > extension_properties;
+  std::vector< VkLayerProperties > layer_properties;
+  name_set extensions;
+  name_set layers;
+};
+
+/// Everything about a physical device that cannot change while it exists.
+struct device_capabilities
+{
+  VkPhysicalDevice device;
+  /// Also holds `limits` and `sparseProperties`.
+  VkPhysicalDeviceProperties properties;
+  VkPhysicalDeviceFeatures features;
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  std::vector< VkQueueFamilyProperties > queue_families;
+  std::vector< VkExtensionProperties > extension_properties;
+  name_set extensions;
+};
+
+/**
+ * Instance level capabilities, queried from the loader on first use.
+ *
+ * Thread-safe.
+ */
+instance_capabilities const&
+MYENGINE_EXPORT
+get_instance_capabilities();
+
+/**
+ * Capabilities of the given physical device, queried on first use for that
+ * device.
+ *
+ * The returned reference stays valid until `forget_device_capabilities`.
+ * Thread-safe.
+ */
+device_capabilities const&
+MYENGINE_EXPORT
+get_device_capabilities( VkPhysicalDevice device );
+
+/**
+ * Drop all cached device capabilities.
+ *
+ * Physical device handles are only valid for the life of the instance they
+ * were enumerated from, so call this when destroying that instance. Any
+ * references returned by `get_device_capabilities` become invalid.
+ */
+void
+MYENGINE_EXPORT
+forget_device_capabilities();
+
+/**
+ * Load a snapshot of capabilities saved by an earlier run.
+ *
+ * The snapshot is only used if it was written by the same format version and
+ * Vulkan header version, against the same loader version and the same set of
+ * installed ICD and layer manifests. Then `get_instance_capabilities` is served
+ * from it without enumerating anything, and `get_device_capabilities` only
+ * has to call `vkGetPhysicalDeviceProperties` to match a device to its
+ * snapshot entry by vendor, device, driver version and `pipelineCacheUUID`.
+ * Devices without a match are queried from the driver as usual.
+ *
+ * A missing, corrupt or stale snapshot is ignored (and reported at debug
+ * level); this never fails hard.
+ *
+ * Must be called before the first `get_instance_capabilities` to have any
+ * effect on the instance level capabilities.
+ *
+ * @param path Snapshot file, e.g. `user_cache_path( "capabilities.bin" )`.
+ *
+ * @return True if the snapshot was loaded and is valid for this system.
+ */
+bool
+MYENGINE_EXPORT
+load_capability_snapshot( std::string const& path );
+
+/**
+ * If any capabilities queried so far were not served from a loaded snapshot,
+ * i.e. saving a new snapshot would speed up the next run.
+ */
+[[nodiscard]] bool
+MYENGINE_EXPORT
+capability_snapshot_stale();
+
+/**
+ * Save the instance capabilities and all currently cached device capabilities
+ * to a snapshot file.
+ *
+ * The file is written next to `path` and then renamed over it, so a reader
+ * never sees a partial snapshot.
+ *
+ * @throws std::runtime_error Failed to write the file.
+ */
+void
+MYENGINE_EXPORT
+save_capability_snapshot( std::string const& path );
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_CAPABILITIES_H
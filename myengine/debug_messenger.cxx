@@ -0,0 +1,378 @@
+#define MYENGINE_LOG_MODULE "vulkan.debug"
+#include "debug_messenger.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <myengine/log_binary.h>
+#include <myengine/logging.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+/// Hash table size, power of two.
+constexpr std::size_t TABLE_SIZE = 256;
+
+/// Probes before a message ID goes to the overflow bucket. Bounds the work
+/// done in the callback.
+constexpr std::size_t MAX_PROBES = 16;
+
+/// Bytes kept of the first message text and ID name per message ID.
+constexpr std::size_t MESSAGE_SIZE = 256;
+constexpr std::size_t ID_NAME_SIZE = 64;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+int64_t
+now_ticks()
+{
+  return steady_clock_t::now().time_since_epoch().count();
+}
+
+steady_clock_t::rep
+to_ticks( std::chrono::milliseconds d )
+{
+  return std::chrono::duration_cast< steady_clock_t::duration >( d ).count();
+}
+
+/// FNV-1a over at most `ID_NAME_SIZE` characters.
+uint32_t
+hash_name( char const* s )
+{
+  uint32_t h = 2166136261u;
+  for( std::size_t i = 0; s && s[ i ] && i < ID_NAME_SIZE; ++i )
+  {
+    h = ( h ^ static_cast< uint8_t >( s[ i ] ) ) * 16777619u;
+  }
+  return h;
+}
+
+/// Copy a string into a fixed buffer, always terminating.
+template< std::size_t N >
+void
+copy_truncated( char ( &dst )[ N ], char const* src )
+{
+  if( src == nullptr )
+  {
+    dst[ 0 ] = '\0';
+    return;
+  }
+  std::size_t n = strnlen( src, N - 1 );
+  memcpy( dst, src, n );
+  dst[ n ] = '\0';
+}
+
+char const*
+severity_name( VkDebugUtilsMessageSeverityFlagBitsEXT s )
+{
+  if( s & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT ) return "Error";
+  if( s & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT ) return "Warning";
+  if( s & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT ) return "Info";
+  if( s & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT ) return "Verbose";
+  return "?";
+}
+
+/// Static names for each combination of the three message type bits, so
+/// nothing is allocated in the callback (unlike `vk::to_string`).
+char const*
+type_name( VkDebugUtilsMessageTypeFlagsEXT t )
+{
+  static char const* const names[ 8 ] = {
+    "None",
+    "General",
+    "Validation",
+    "General | Validation",
+    "Performance",
+    "General | Performance",
+    "Validation | Performance",
+    "General | Validation | Performance",
+  };
+  return names[ t & 0x7 ];
+}
+
+/// Elapsed time since the logging epoch as "HHHH:MM:SS.DDDDDD".
+std::string
+elapsed_str( steady_clock_t::time_point t )
+{
+  char buf[ 32 ];
+  logging::format_elapsed(
+    std::chrono::duration_cast< std::chrono::nanoseconds >(
+      t - logging::epoch() ).count(), buf, sizeof( buf ) );
+  return buf;
+}
+
+} // namespace
+
+/// Statistics for one message ID. All counters are updated with relaxed
+/// atomics from whatever thread the driver calls back on.
+struct debug_message_sink::slot_t
+{
+  /// Message key, 0 while the slot is free.
+  std::atomic< uint64_t > key{ 0 };
+  /// Set once the fields below `ready` were written by the claiming thread.
+  std::atomic< bool > ready{ false };
+  std::atomic< uint64_t > count{ 0 };
+  std::atomic< uint64_t > suppressed{ 0 };
+  std::atomic< int64_t > first_seen{ 0 };
+  std::atomic< int64_t > last_seen{ 0 };
+  std::atomic< int64_t > window_start{ 0 };
+  std::atomic< uint32_t > window_count{ 0 };
+
+  int32_t id_number = 0;
+  VkDebugUtilsMessageSeverityFlagBitsEXT severity =
+    VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+  char id_name[ ID_NAME_SIZE ] = {};
+  char message[ MESSAGE_SIZE ] = {};
+};
+
+debug_message_sink::debug_message_sink( std::string name, config const& cfg )
+  : m_name( std::move( name ) ),
+    m_config( cfg ),
+    // One extra slot at the end is the overflow bucket.
+    m_slots( new slot_t[ TABLE_SIZE + 1 ] ),
+    m_total( 0 ),
+    m_suppressed( 0 ),
+    m_next_summary( now_ticks() + to_ticks( cfg.summary_period ) ),
+    m_total_at_last_summary( 0 )
+{
+  slot_t& overflow = m_slots[ TABLE_SIZE ];
+  overflow.id_number = -1;
+  copy_truncated( overflow.id_name, "(other)" );
+  copy_truncated( overflow.message, "Message table full; IDs not tracked "
+                                    "individually." );
+  overflow.key.store( ~0ull, std::memory_order_relaxed );
+}
+
+debug_message_sink::debug_message_sink( std::string name )
+  : debug_message_sink( std::move( name ), config() )
+{}
+
+debug_message_sink::~debug_message_sink()
+{
+  if( m_suppressed.load( std::memory_order_relaxed ) > 0 )
+  {
+    log_summary();
+  }
+}
+
+void
+debug_message_sink::fill_create_info(
+  VkDebugUtilsMessengerCreateInfoEXT& create_info )
+{
+  create_info.pfnUserCallback = &debug_message_sink::callback;
+  create_info.pUserData = this;
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL
+debug_message_sink::callback(
+  VkDebugUtilsMessageSeverityFlagBitsEXT msg_severity,
+  VkDebugUtilsMessageTypeFlagsEXT msg_type,
+  VkDebugUtilsMessengerCallbackDataEXT const* p_callback_data,
+  void* p_user_data )
+{
+  // ``[Verbose][type::General]`` messages look like they are extraneous.
+  // Ignoring those messages for now until informed otherwise?
+  if( ( msg_severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT ) &&
+      ( msg_type & VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT ) )
+  {
+    return VK_FALSE;
+  }
+  if( p_user_data && p_callback_data )
+  {
+    static_cast< debug_message_sink* >( p_user_data )->receive(
+      msg_severity, msg_type, *p_callback_data );
+  }
+  // The application should always return false, per the spec.
+  return VK_FALSE;
+}
+
+debug_message_sink::slot_t&
+debug_message_sink::find_slot( uint64_t key )
+{
+  std::size_t idx = static_cast< std::size_t >( key ^ ( key >> 32 ) );
+  for( std::size_t probe = 0; probe < MAX_PROBES; ++probe )
+  {
+    slot_t& slot = m_slots[ ( idx + probe ) & ( TABLE_SIZE - 1 ) ];
+    uint64_t k = slot.key.load( std::memory_order_acquire );
+    if( k == key )
+    {
+      return slot;
+    }
+    if( k == 0 &&
+        slot.key.compare_exchange_strong( k, key, std::memory_order_acq_rel ) )
+    {
+      return slot;
+    }
+    if( k == key )  // someone else claimed it for the same key
+    {
+      return slot;
+    }
+  }
+  return m_slots[ TABLE_SIZE ];
+}
+
+void
+debug_message_sink::receive(
+  VkDebugUtilsMessageSeverityFlagBitsEXT msg_severity,
+  VkDebugUtilsMessageTypeFlagsEXT msg_type,
+  VkDebugUtilsMessengerCallbackDataEXT const& data )
+{
+  int64_t const now = now_ticks();
+  uint64_t key = ( static_cast< uint64_t >(
+                     static_cast< uint32_t >( data.messageIdNumber ) ) << 32 ) |
+                 hash_name( data.pMessageIdName );
+  if( key == 0 || key == ~0ull )
+  {
+    key = 1;  // reserved for "free" and the overflow bucket
+  }
+
+  m_total.fetch_add( 1, std::memory_order_relaxed );
+  slot_t& slot = find_slot( key );
+  if( slot.count.fetch_add( 1, std::memory_order_relaxed ) == 0 &&
+      &slot != &m_slots[ TABLE_SIZE ] )
+  {
+    // First occurrence: this thread owns the descriptive fields.
+    slot.id_number = data.messageIdNumber;
+    slot.severity = msg_severity;
+    copy_truncated( slot.id_name, data.pMessageIdName );
+    copy_truncated( slot.message, data.pMessage );
+    slot.first_seen.store( now, std::memory_order_relaxed );
+    slot.window_start.store( now, std::memory_order_relaxed );
+    slot.ready.store( true, std::memory_order_release );
+  }
+  else if( slot.first_seen.load( std::memory_order_relaxed ) == 0 )
+  {
+    int64_t zero = 0;
+    slot.first_seen.compare_exchange_strong( zero, now,
+                                             std::memory_order_relaxed );
+  }
+  slot.last_seen.store( now, std::memory_order_relaxed );
+
+  // Rate limit. Racing resets of the window are benign: at worst a few extra
+  // messages get through.
+  int64_t window_start = slot.window_start.load( std::memory_order_relaxed );
+  if( now - window_start >= to_ticks( m_config.interval ) &&
+      slot.window_start.compare_exchange_strong( window_start, now,
+                                                 std::memory_order_relaxed ) )
+  {
+    slot.window_count.store( 0, std::memory_order_relaxed );
+  }
+  uint32_t n = slot.window_count.fetch_add( 1, std::memory_order_relaxed );
+  if( n >= m_config.max_per_interval )
+  {
+    slot.suppressed.fetch_add( 1, std::memory_order_relaxed );
+    m_suppressed.fetch_add( 1, std::memory_order_relaxed );
+    return;
+  }
+
+  // Ahead of the message, which can be long, so it stands out.
+  char const* note = ( n + 1 == m_config.max_per_interval )
+                     ? "(further repeats suppressed for this interval) " : "";
+  char const* s_severity = severity_name( msg_severity );
+  char const* s_type = type_name( msg_type );
+  char const* message = data.pMessage ? data.pMessage : "";
+#define SINK_LOG( LVL )                                        \
+  LOG_##LVL( "Khronos"                                         \
+             << "[" << s_severity << "]"                       \
+             << "[type::" << s_type << "]"                     \
+             << "[from::" << m_name << "]"                     \
+             << " " << note << message )
+  if( msg_severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT )
+  {
+    SINK_LOG( ERROR );
+  }
+  else if( msg_severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT )
+  {
+    SINK_LOG( WARN );
+  }
+  else if( msg_severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT )
+  {
+    SINK_LOG( INFO );
+  }
+  else
+  {
+    SINK_LOG( DEBUG );
+  }
+#undef SINK_LOG
+}
+
+void
+debug_message_sink::poll()
+{
+  int64_t const now = now_ticks();
+  int64_t next = m_next_summary.load( std::memory_order_relaxed );
+  if( now < next ||
+      !m_next_summary.compare_exchange_strong(
+        next, now + to_ticks( m_config.summary_period ),
+        std::memory_order_relaxed ) )
+  {
+    return;
+  }
+  uint64_t total = m_total.load( std::memory_order_relaxed );
+  if( total != m_total_at_last_summary )
+  {
+    log_summary();
+  }
+}
+
+void
+debug_message_sink::log_summary()
+{
+  m_total_at_last_summary = m_total.load( std::memory_order_relaxed );
+  auto entries = top( m_config.summary_top_n );
+  LOG_INFO( "Debug message summary [from::" << m_name << "]: "
+                                            << m_total_at_last_summary
+                                            << " received, "
+                                            << suppressed_count()
+                                            << " suppressed by rate limit" );
+  int rank = 1;
+  for( auto const& e : entries )
+  {
+    LOG_INFO( "  #" << rank++ << " " << e.id_name << " (" << e.id_number
+                    << ") x" << e.count << ", suppressed " << e.suppressed
+                    << ", first " << elapsed_str( e.first_seen )
+                    << ", last " << elapsed_str( e.last_seen ) << ": "
+                    << e.first_message );
+  }
+}
+
+std::vector< debug_message_sink::stats >
+debug_message_sink::top( std::size_t n ) const
+{
+  std::vector< stats > out;
+  for( std::size_t i = 0; i <= TABLE_SIZE; ++i )
+  {
+    slot_t const& slot = m_slots[ i ];
+    uint64_t count = slot.count.load( std::memory_order_relaxed );
+    // The overflow bucket is never "ready" but is always reportable.
+    if( count == 0 ||
+        ( i < TABLE_SIZE && !slot.ready.load( std::memory_order_acquire ) ) )
+    {
+      continue;
+    }
+    stats s;
+    s.id_number = slot.id_number;
+    s.id_name = slot.id_name;
+    s.first_message = slot.message;
+    s.severity = slot.severity;
+    s.count = count;
+    s.suppressed = slot.suppressed.load( std::memory_order_relaxed );
+    s.first_seen = steady_clock_t::time_point( steady_clock_t::duration(
+                                          slot.first_seen.load(
+                                            std::memory_order_relaxed ) ) );
+    s.last_seen = steady_clock_t::time_point( steady_clock_t::duration(
+                                         slot.last_seen.load(
+                                           std::memory_order_relaxed ) ) );
+    out.push_back( std::move( s ) );
+  }
+  n = std::min( n, out.size() );
+  std::partial_sort( out.begin(), out.begin() + n, out.end(),
+                     []( stats const& a, stats const& b ) {
+                       return a.count > b.count;
+                     } );
+  out.resize( n );
+  return out;
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,144 @@
+#ifndef MYENGINE_DEBUG_MESSENGER_H
+#define MYENGINE_DEBUG_MESSENGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine::vulkan {
+
+/**
+ * Deduplicating, rate-limited destination for `VK_EXT_debug_utils` messages.
+ *
+ * Messages are keyed by `messageIdNumber` (combined with a hash of
+ * `pMessageIdName`, since e.g. loader messages all use ID 0). For every key
+ * the sink counts occurrences, and only the first `max_per_interval` messages
+ * of each `interval` are forwarded to the logging macros. The rest are just
+ * counted. `poll()` periodically logs a summary of the most frequent message
+ * IDs with their counts and first/last seen times.
+ *
+ * The Vulkan callback does a bounded number of probes into a fixed size hash
+ * table with atomics. When the table is full, new IDs are counted together in
+ * a single overflow bucket. Forwarded messages go through the log queue like
+ * any other record: ones longer than a queue cell, common for validation
+ * errors quoting the spec, take several cells, and only past
+ * `logging::MAX_MESSAGE_SIZE` are they cut, with a marker (see `logging.h`).
+ * The calling thread never drains the queue or writes output itself.
+ * Summaries only show the start of each message.
+ *
+ * Use `fill_create_info` to point a messenger at an instance of this. The sink
+ * must outlive any messenger created with it.
+ */
+class MYENGINE_EXPORT debug_message_sink
+{
+public:
+  /// Tuning knobs.
+  struct config
+  {
+    /// Messages per ID forwarded to the log within one `interval`.
+    uint32_t max_per_interval = 3;
+    /// Rate limiting window.
+    std::chrono::milliseconds interval{ 1000 };
+    /// Minimum time between summaries logged by `poll`.
+    std::chrono::milliseconds summary_period{ 5000 };
+    /// Number of message IDs listed in a summary.
+    std::size_t summary_top_n = 5;
+  };
+
+  /// Snapshot of the statistics for one message ID.
+  struct stats
+  {
+    int32_t id_number;
+    std::string id_name;
+    /// First message received with this ID.
+    std::string first_message;
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+    uint64_t count;
+    uint64_t suppressed;
+    std::chrono::steady_clock::time_point first_seen;
+    std::chrono::steady_clock::time_point last_seen;
+  };
+
+  /**
+   * @param name Name included with every forwarded message, to tell sinks for
+   * different messengers apart.
+   * @param cfg Rate limiting and summary settings.
+   */
+  explicit debug_message_sink( std::string name, config const& cfg );
+  explicit debug_message_sink( std::string name );
+
+  debug_message_sink( debug_message_sink const& ) = delete;
+  debug_message_sink& operator=( debug_message_sink const& ) = delete;
+
+  /// Logs a final summary if anything was suppressed.
+  ~debug_message_sink();
+
+  /**
+   * Fill in the callback-related fields of a messenger create-info struct:
+   * `pfnUserCallback` and `pUserData`. Severity and type masks are left for
+   * the caller.
+   */
+  void fill_create_info( VkDebugUtilsMessengerCreateInfoEXT& create_info );
+
+  /**
+   * Log a summary if `summary_period` has passed since the last one and there
+   * were new messages. Cheap when there's nothing to do; intended to be
+   * called once per frame or so.
+   */
+  void poll();
+
+  /// Log a summary of the `summary_top_n` most frequent message IDs now.
+  void log_summary();
+
+  /// Statistics for the `n` most frequent message IDs, most frequent first.
+  [[nodiscard]] std::vector< stats > top( std::size_t n ) const;
+
+  /// Total messages received.
+  [[nodiscard]] uint64_t
+  total_count() const
+  {
+    return m_total.load( std::memory_order_relaxed );
+  }
+
+  /// Total messages not forwarded to the log due to rate limiting.
+  [[nodiscard]] uint64_t
+  suppressed_count() const
+  {
+    return m_suppressed.load( std::memory_order_relaxed );
+  }
+
+  /// The `PFN_vkDebugUtilsMessengerCallbackEXT`; `p_user_data` is the sink.
+  static VKAPI_ATTR VkBool32 VKAPI_CALL
+  callback( VkDebugUtilsMessageSeverityFlagBitsEXT msg_severity,
+            VkDebugUtilsMessageTypeFlagsEXT msg_type,
+            VkDebugUtilsMessengerCallbackDataEXT const* p_callback_data,
+            void* p_user_data );
+
+private:
+  struct slot_t;
+
+  std::string m_name;
+  config m_config;
+  std::unique_ptr< slot_t[] > m_slots;
+  std::atomic< uint64_t > m_total;
+  std::atomic< uint64_t > m_suppressed;
+  std::atomic< int64_t > m_next_summary;
+  uint64_t m_total_at_last_summary;
+
+  void receive( VkDebugUtilsMessageSeverityFlagBitsEXT msg_severity,
+                VkDebugUtilsMessageTypeFlagsEXT msg_type,
+                VkDebugUtilsMessengerCallbackDataEXT const& data );
+  slot_t& find_slot( uint64_t key );
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_DEBUG_MESSENGER_H
@@ -0,0 +1,556 @@
+#define MYENGINE_LOG_MODULE "vulkan.descriptor_heap"
+#include "descriptor_heap.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+/// Descriptors of each type one set, and each shader stage, may hold.
+struct descriptor_limits
+{
+  uint32_t textures;
+  uint32_t buffers;
+  /// Of all types, per stage.
+  uint32_t resources;
+};
+
+descriptor_limits
+get_descriptor_limits( VkPhysicalDevice physical_device,
+                       bool descriptor_indexing )
+{
+  if( descriptor_indexing )
+  {
+    VkPhysicalDeviceDescriptorIndexingProperties indexing = {};
+    indexing.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexing;
+    vkGetPhysicalDeviceProperties2( physical_device, &properties );
+    auto const& i = indexing;
+    uint32_t const textures = std::min(
+      { i.maxDescriptorSetUpdateAfterBindSamplers,
+        i.maxDescriptorSetUpdateAfterBindSampledImages,
+        i.maxPerStageDescriptorUpdateAfterBindSamplers,
+        i.maxPerStageDescriptorUpdateAfterBindSampledImages } );
+    return { textures,
+             std::min( i.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                       i.maxPerStageDescriptorUpdateAfterBindStorageBuffers ),
+             i.maxPerStageUpdateAfterBindResources };
+  }
+  auto const& limits =
+    get_device_capabilities( physical_device ).properties.limits;
+  return { std::min( { limits.maxDescriptorSetSamplers,
+                       limits.maxDescriptorSetSampledImages,
+                       limits.maxPerStageDescriptorSamplers,
+                       limits.maxPerStageDescriptorSampledImages } ),
+           std::min( limits.maxDescriptorSetStorageBuffers,
+                     limits.maxPerStageDescriptorStorageBuffers ),
+           limits.maxPerStageResources };
+}
+
+} // namespace
+
+bool
+descriptor_indexing_supported( VkPhysicalDevice device )
+{
+  if( get_device_capabilities( device ).properties.apiVersion <
+      VK_API_VERSION_1_2 )
+  {
+    return false;
+  }
+  VkPhysicalDeviceDescriptorIndexingFeatures indexing = {};
+  indexing.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  VkPhysicalDeviceFeatures2 features = {};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &indexing;
+  vkGetPhysicalDeviceFeatures2( device, &features );
+  return indexing.runtimeDescriptorArray == VK_TRUE &&
+         indexing.descriptorBindingPartiallyBound == VK_TRUE &&
+         indexing.descriptorBindingUpdateUnusedWhilePending == VK_TRUE &&
+         indexing.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+         indexing.descriptorBindingStorageBufferUpdateAfterBind == VK_TRUE;
+}
+
+VkPhysicalDeviceDescriptorIndexingFeatures
+descriptor_indexing_features()
+{
+  VkPhysicalDeviceDescriptorIndexingFeatures indexing = {};
+  indexing.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  indexing.runtimeDescriptorArray = VK_TRUE;
+  indexing.descriptorBindingPartiallyBound = VK_TRUE;
+  indexing.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  indexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  indexing.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+  return indexing;
+}
+
+descriptor_heap::descriptor_heap( VkPhysicalDevice physical_device,
+                                  VkDevice device,
+                                  descriptor_heap_config const& config )
+  : m_device( device ),
+    m_config( config ),
+    m_set_layout( VK_NULL_HANDLE ),
+    m_pipeline_layout( VK_NULL_HANDLE ),
+    m_pool( VK_NULL_HANDLE ),
+    m_sets(),
+    m_textures(),
+    m_buffers(),
+    m_frame( 0 ),
+    m_current( 0 ),
+    m_bound( false ),
+    m_descriptor_writes( 0 ),
+    m_write_ranges( 0 ),
+    m_writes()
+{
+  PROFILE_FUNCTION();
+  if( m_config.frames_in_flight == 0 )
+  {
+    throw std::invalid_argument( "Frames in flight must not be 0" );
+  }
+  bool const indexing = m_config.descriptor_indexing;
+  uint32_t const set_count = indexing ? 1 : m_config.frames_in_flight;
+
+  // Both arrays count against the per stage limit of all resources, with
+  // room left for the pipelines' other descriptors.
+  descriptor_limits const limits =
+    get_descriptor_limits( physical_device, indexing );
+  uint32_t textures = std::min( m_config.textures, limits.textures );
+  uint32_t buffers = std::min( m_config.buffers, limits.buffers );
+  uint32_t const resources = limits.resources - limits.resources / 4;
+  if( textures + buffers > resources )
+  {
+    textures = static_cast< uint32_t >(
+      uint64_t( resources ) * textures / ( textures + buffers ) );
+    buffers = resources - textures;
+  }
+  if( textures < m_config.textures || buffers < m_config.buffers )
+  {
+    LOGF_WARN( "Descriptor heap clamped to the device's limits: {} of {} "
+               "texture(s), {} of {} buffer(s)",
+               textures, m_config.textures, buffers, m_config.buffers );
+  }
+  init_table( m_textures, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+              TEXTURE_BINDING, textures );
+  init_table( m_buffers, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BUFFER_BINDING,
+              buffers );
+  m_textures.dirty.resize( set_count );
+  m_buffers.dirty.resize( set_count );
+
+  try
+  {
+    VkDescriptorSetLayoutBinding bindings[ 2 ] = {};
+    bindings[ 0 ].binding = TEXTURE_BINDING;
+    bindings[ 0 ].descriptorType = m_textures.type;
+    bindings[ 0 ].descriptorCount = m_textures.capacity;
+    bindings[ 0 ].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[ 1 ].binding = BUFFER_BINDING;
+    bindings[ 1 ].descriptorType = m_buffers.type;
+    bindings[ 1 ].descriptorCount = m_buffers.capacity;
+    bindings[ 1 ].stageFlags = VK_SHADER_STAGE_ALL;
+    VkDescriptorBindingFlags const binding_flags[ 2 ] = {
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT };
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {};
+    flags_info.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flags_info.bindingCount = 2;
+    flags_info.pBindingFlags = binding_flags;
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 2;
+    layout_info.pBindings = bindings;
+    if( indexing )
+    {
+      layout_info.pNext = &flags_info;
+      layout_info.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    }
+    check_result( vkCreateDescriptorSetLayout( m_device, &layout_info, nullptr,
+                                               &m_set_layout ),
+                  "create descriptor set layout" );
+
+    VkPushConstantRange push_constants = {};
+    push_constants.stageFlags = VK_SHADER_STAGE_ALL;
+    push_constants.size = m_config.push_constant_size;
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &m_set_layout;
+    if( m_config.push_constant_size > 0 )
+    {
+      pipeline_layout_info.pushConstantRangeCount = 1;
+      pipeline_layout_info.pPushConstantRanges = &push_constants;
+    }
+    check_result( vkCreatePipelineLayout( m_device, &pipeline_layout_info,
+                                          nullptr, &m_pipeline_layout ),
+                  "create pipeline layout" );
+
+    VkDescriptorPoolSize const pool_sizes[ 2 ] = {
+      { m_textures.type, m_textures.capacity * set_count },
+      { m_buffers.type, m_buffers.capacity * set_count } };
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    if( indexing )
+    {
+      pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    }
+    pool_info.maxSets = set_count;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes = pool_sizes;
+    check_result( vkCreateDescriptorPool( m_device, &pool_info, nullptr,
+                                          &m_pool ),
+                  "create descriptor pool" );
+
+    std::vector< VkDescriptorSetLayout > const layouts( set_count,
+                                                        m_set_layout );
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = m_pool;
+    alloc_info.descriptorSetCount = set_count;
+    alloc_info.pSetLayouts = layouts.data();
+    m_sets.resize( set_count );
+    check_result( vkAllocateDescriptorSets( m_device, &alloc_info,
+                                            m_sets.data() ),
+                  "allocate descriptor sets" );
+  }
+  catch( ... )
+  {
+    destroy();
+    throw;
+  }
+  LOGF_INFO( "Descriptor heap: {} texture(s), {} buffer(s), {}",
+             m_textures.capacity, m_buffers.capacity,
+             indexing ? "update after bind"
+                      : "one set per frame slot (no descriptor indexing)" );
+}
+
+descriptor_heap::~descriptor_heap()
+{
+  destroy();
+}
+
+void
+descriptor_heap::destroy()
+{
+  // Sets are freed with their pool.
+  if( m_pool != VK_NULL_HANDLE )
+  {
+    vkDestroyDescriptorPool( m_device, m_pool, nullptr );
+    m_pool = VK_NULL_HANDLE;
+  }
+  m_sets.clear();
+  if( m_pipeline_layout != VK_NULL_HANDLE )
+  {
+    vkDestroyPipelineLayout( m_device, m_pipeline_layout, nullptr );
+    m_pipeline_layout = VK_NULL_HANDLE;
+  }
+  if( m_set_layout != VK_NULL_HANDLE )
+  {
+    vkDestroyDescriptorSetLayout( m_device, m_set_layout, nullptr );
+    m_set_layout = VK_NULL_HANDLE;
+  }
+}
+
+void
+descriptor_heap::init_table( table& t, VkDescriptorType type,
+                             uint32_t binding, uint32_t capacity )
+{
+  t.type = type;
+  t.binding = binding;
+  t.capacity = capacity;
+  if( type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER )
+  {
+    t.buffers.resize( capacity, VkDescriptorBufferInfo() );
+  }
+  else
+  {
+    t.images.resize( capacity, VkDescriptorImageInfo() );
+  }
+  t.next = 0;
+  t.used.resize( capacity, false );
+  t.has_placeholder = false;
+  t.image_placeholder = {};
+  t.buffer_placeholder = {};
+}
+
+uint32_t
+descriptor_heap::allocate( table& t )
+{
+  uint32_t index;
+  if( !t.free.empty() )
+  {
+    index = t.free.back();
+    t.free.pop_back();
+  }
+  else if( t.next < t.capacity )
+  {
+    index = t.next++;
+  }
+  else
+  {
+    std::stringstream ss;
+    ss  << "Descriptor heap full: all " << t.capacity << " "
+        << ( t.binding == TEXTURE_BINDING ? "texture" : "buffer" )
+        << " indices in use";
+    throw std::runtime_error( ss.str() );
+  }
+  t.used[ index ] = true;
+  return index;
+}
+
+uint32_t
+descriptor_heap::add_texture( VkImageView view, VkSampler sampler,
+                              VkImageLayout layout )
+{
+  uint32_t const index = allocate( m_textures );
+  m_textures.images[ index ] = { sampler, view, layout };
+  mark_dirty( m_textures, index );
+  return index;
+}
+
+uint32_t
+descriptor_heap::add_buffer( VkBuffer buffer, VkDeviceSize offset,
+                             VkDeviceSize range )
+{
+  uint32_t const index = allocate( m_buffers );
+  m_buffers.buffers[ index ] = { buffer, offset, range };
+  mark_dirty( m_buffers, index );
+  return index;
+}
+
+void
+descriptor_heap::remove( table& t, uint32_t index )
+{
+  if( index >= t.next || !t.used[ index ] )
+  {
+    std::stringstream ss;
+    ss  << "Descriptor heap " << ( t.binding == TEXTURE_BINDING ? "texture"
+                                                                : "buffer" )
+        << " index " << index << " is not in use";
+    throw std::invalid_argument( ss.str() );
+  }
+  // Frames up to the current one may access it until they complete.
+  t.used[ index ] = false;
+  t.removed.push_back( { index, m_frame } );
+}
+
+void
+descriptor_heap::remove_texture( uint32_t index )
+{
+  remove( m_textures, index );
+}
+
+void
+descriptor_heap::remove_buffer( uint32_t index )
+{
+  remove( m_buffers, index );
+}
+
+void
+descriptor_heap::set_placeholder_texture( VkImageView view, VkSampler sampler,
+                                          VkImageLayout layout )
+{
+  m_textures.has_placeholder = true;
+  m_textures.image_placeholder = { sampler, view, layout };
+  fill_free( m_textures );
+}
+
+void
+descriptor_heap::set_placeholder_buffer( VkBuffer buffer, VkDeviceSize offset,
+                                         VkDeviceSize range )
+{
+  m_buffers.has_placeholder = true;
+  m_buffers.buffer_placeholder = { buffer, offset, range };
+  fill_free( m_buffers );
+}
+
+void
+descriptor_heap::fill_free( table& t )
+{
+  // Removed indices pending reuse may still be accessed by frames in flight;
+  // they get the placeholder when reclaimed.
+  std::vector< bool > pending( t.capacity, false );
+  for( auto const& r : t.removed )
+  {
+    pending[ r.index ] = true;
+  }
+  for( uint32_t i = 0; i < t.capacity; ++i )
+  {
+    if( !t.used[ i ] && !pending[ i ] )
+    {
+      clear_entry( t, i );
+    }
+  }
+}
+
+void
+descriptor_heap::clear_entry( table& t, uint32_t index )
+{
+  // Without a placeholder the index is left empty: not accessed, as the set
+  // is partially bound, or still holding its last descriptor otherwise.
+  if( t.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER )
+  {
+    t.buffers[ index ] = t.has_placeholder ? t.buffer_placeholder
+                                           : VkDescriptorBufferInfo();
+  }
+  else
+  {
+    t.images[ index ] = t.has_placeholder ? t.image_placeholder
+                                          : VkDescriptorImageInfo();
+  }
+  if( t.has_placeholder )
+  {
+    mark_dirty( t, index );
+  }
+}
+
+void
+descriptor_heap::mark_dirty( table& t, uint32_t index )
+{
+  for( auto& dirty : t.dirty )
+  {
+    dirty.push_back( index );
+  }
+}
+
+void
+descriptor_heap::reclaim( table& t )
+{
+  while( !t.removed.empty() &&
+         t.removed.front().frame + m_config.frames_in_flight <= m_frame )
+  {
+    uint32_t const index = t.removed.front().index;
+    t.removed.pop_front();
+    clear_entry( t, index );
+    t.free.push_back( index );
+  }
+}
+
+void
+descriptor_heap::begin_frame( uint32_t slot )
+{
+  if( slot >= m_config.frames_in_flight )
+  {
+    throw std::invalid_argument( "Frame slot out of range" );
+  }
+  ++m_frame;
+  m_current = m_config.descriptor_indexing ? 0 : slot;
+  m_bound = false;
+  reclaim( m_textures );
+  reclaim( m_buffers );
+}
+
+void
+descriptor_heap::write_dirty( table& t, uint32_t set )
+{
+  auto& dirty = t.dirty[ set ];
+  if( dirty.empty() )
+  {
+    return;
+  }
+  std::sort( dirty.begin(), dirty.end() );
+  dirty.erase( std::unique( dirty.begin(), dirty.end() ), dirty.end() );
+
+  bool const is_buffer = t.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  auto const empty = [ & ]( uint32_t i ) {
+    return is_buffer ? t.buffers[ i ].buffer == VK_NULL_HANDLE
+                     : t.images[ i ].imageView == VK_NULL_HANDLE;
+  };
+  // One write per run of neighbouring indices holding a descriptor.
+  std::size_t i = 0;
+  while( i < dirty.size() )
+  {
+    uint32_t const first = dirty[ i ];
+    if( empty( first ) )
+    {
+      ++i;
+      continue;
+    }
+    uint32_t count = 1;
+    while( i + count < dirty.size() && dirty[ i + count ] == first + count &&
+           !empty( first + count ) )
+    {
+      ++count;
+    }
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = m_sets[ set ];
+    write.dstBinding = t.binding;
+    write.dstArrayElement = first;
+    write.descriptorCount = count;
+    write.descriptorType = t.type;
+    if( is_buffer )
+    {
+      write.pBufferInfo = &t.buffers[ first ];
+    }
+    else
+    {
+      write.pImageInfo = &t.images[ first ];
+    }
+    m_writes.push_back( write );
+    m_descriptor_writes += count;
+    i += count;
+  }
+  dirty.clear();
+}
+
+void
+descriptor_heap::flush()
+{
+  // Without descriptor indexing, a bound set must not change until the
+  // command buffer completes; the writes wait for the slot to come around.
+  if( m_bound && !m_config.descriptor_indexing )
+  {
+    return;
+  }
+  m_writes.clear();
+  write_dirty( m_textures, m_current );
+  write_dirty( m_buffers, m_current );
+  if( m_writes.empty() )
+  {
+    return;
+  }
+  PROFILE_FUNCTION();
+  vkUpdateDescriptorSets( m_device, static_cast< uint32_t >( m_writes.size() ),
+                          m_writes.data(), 0, nullptr );
+  m_write_ranges += m_writes.size();
+}
+
+void
+descriptor_heap::bind( VkCommandBuffer cmd, VkPipelineBindPoint bind_point )
+{
+  flush();
+  vkCmdBindDescriptorSets( cmd, bind_point, m_pipeline_layout, 0, 1,
+                           &m_sets[ m_current ], 0, nullptr );
+  m_bound = true;
+}
+
+descriptor_heap_stats
+descriptor_heap::stats() const
+{
+  descriptor_heap_stats s = {};
+  s.textures =
+    m_textures.next - static_cast< uint32_t >( m_textures.free.size() );
+  s.buffers = m_buffers.next - static_cast< uint32_t >( m_buffers.free.size() );
+  s.descriptor_writes = m_descriptor_writes;
+  s.write_ranges = m_write_ranges;
+  return s;
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,265 @@
+#ifndef MYENGINE_DESCRIPTOR_HEAP_H
+#define MYENGINE_DESCRIPTOR_HEAP_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine::vulkan {
+
+struct descriptor_heap_config
+{
+  /// Combined image samplers, at binding `descriptor_heap::TEXTURE_BINDING`.
+  uint32_t textures = 16384;
+  /// Storage buffers, at binding `descriptor_heap::BUFFER_BINDING`.
+  uint32_t buffers = 16384;
+  /// Frames the CPU may get ahead of the GPU; removed indices are reused once
+  /// the frames that may use them completed.
+  uint32_t frames_in_flight = 2;
+  /// Bytes of push constants, visible to all stages, in the pipeline layout.
+  uint32_t push_constant_size = 128;
+  /// Use one update-after-bind set. The device must have been created with
+  /// the features from `descriptor_indexing_features`, see
+  /// `descriptor_indexing_supported`. Otherwise the heap falls back to one set
+  /// per frame slot.
+  bool descriptor_indexing = false;
+};
+
+/// Totals since construction.
+struct descriptor_heap_stats
+{
+  /// Indices in use, including removed ones not yet reusable.
+  uint32_t textures;
+  uint32_t buffers;
+  /// Descriptors written, and the `VkWriteDescriptorSet`s they were coalesced
+  /// into.
+  uint64_t descriptor_writes;
+  uint64_t write_ranges;
+};
+
+/**
+ * If the device supports the descriptor indexing features the heap needs, as
+ * Vulkan 1.2 core features. The instance must have been created for Vulkan
+ * 1.2 or later.
+ */
+[[nodiscard]] bool
+MYENGINE_EXPORT
+descriptor_indexing_supported( VkPhysicalDevice device );
+
+/**
+ * The descriptor indexing features the heap needs, to chain into
+ * `VkDeviceCreateInfo::pNext` when `descriptor_indexing_supported`: update
+ * after bind and partially bound sampled images and storage buffers, and
+ * runtime descriptor arrays.
+ */
+[[nodiscard]] VkPhysicalDeviceDescriptorIndexingFeatures
+MYENGINE_EXPORT
+descriptor_indexing_features();
+
+/**
+ * Bindless descriptors: one descriptor set holding large arrays of all
+ * textures and buffers, bound once per command buffer. Draws select their
+ * resources by index, passed as push constants, instead of binding sets of
+ * their own.
+ *
+ * Shaders declare the set as
+ *
+ *   layout( set = 0, binding = 0 ) uniform sampler2D textures[];
+ *   layout( set = 0, binding = 1 ) buffer buffers_t { ... } buffers[];
+ *
+ * with pipelines created with `pipeline_layout`.
+ *
+ * Indices are handed out from free lists. Descriptors are written in batches,
+ * by `flush`, coalescing neighbouring indices into one write. A removed index
+ * is reused, and rewritten, only once the frames that may still access it
+ * completed, `frames_in_flight` calls of `begin_frame` later.
+ *
+ * With descriptor indexing, the set is created update-after-bind and
+ * partially bound: descriptors not accessed by pending command buffers can be
+ * written while it is bound, and indices holding no descriptor are fine as
+ * long as shaders do not access them. Entries added during a frame are usable
+ * by command buffers submitted after the next `flush`.
+ *
+ * Without it, each frame slot has its own copy of the set, sized within the
+ * device's (much lower) per stage limits. A copy is written when its slot
+ * comes around, as its previous frame completed, so entries added after
+ * `bind` are only usable from the next frame. Every index must then hold a
+ * descriptor: set placeholders, which fill free indices.
+ *
+ * Not thread-safe. Must be destroyed before the `VkDevice`, once the device is
+ * done with the sets.
+ */
+class MYENGINE_EXPORT descriptor_heap
+{
+public:
+  static constexpr uint32_t TEXTURE_BINDING = 0;
+  static constexpr uint32_t BUFFER_BINDING = 1;
+
+  /**
+   * @throws std::runtime_error Failed to create the layouts or the sets.
+   */
+  descriptor_heap( VkPhysicalDevice physical_device, VkDevice device,
+                   descriptor_heap_config const& config =
+                     descriptor_heap_config() );
+
+  descriptor_heap( descriptor_heap const& ) = delete;
+  descriptor_heap& operator=( descriptor_heap const& ) = delete;
+
+  ~descriptor_heap();
+
+  /**
+   * Add a texture, written by the next `flush`.
+   *
+   * @return Its index into the textures array.
+   *
+   * @throws std::runtime_error The textures array is full.
+   */
+  [[nodiscard]] uint32_t add_texture(
+    VkImageView view, VkSampler sampler,
+    VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+
+  /// Add a storage buffer range. Throws as `add_texture`.
+  [[nodiscard]] uint32_t add_buffer( VkBuffer buffer, VkDeviceSize offset = 0,
+                                     VkDeviceSize range = VK_WHOLE_SIZE );
+
+  /**
+   * Remove a texture. Frames recorded so far may still access it, so the
+   * view and sampler must live until `frames_in_flight` more `begin_frame`s.
+   *
+   * @throws std::invalid_argument `index` is not in use.
+   */
+  void remove_texture( uint32_t index );
+
+  /// Remove a buffer, see `remove_texture`.
+  void remove_buffer( uint32_t index );
+
+  /// Descriptor for free texture indices; must outlive the heap, or the next
+  /// placeholder.
+  void set_placeholder_texture(
+    VkImageView view, VkSampler sampler,
+    VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+
+  /// Descriptor for free buffer indices, see `set_placeholder_texture`.
+  void set_placeholder_buffer( VkBuffer buffer, VkDeviceSize offset = 0,
+                               VkDeviceSize range = VK_WHOLE_SIZE );
+
+  /**
+   * Start a frame in slot `slot`: reclaim the indices no frame in flight can
+   * access anymore. The slot's previous frame must have completed.
+   *
+   * @throws std::invalid_argument `slot` is not below `frames_in_flight`.
+   */
+  void begin_frame( uint32_t slot );
+
+  /// Write the descriptors added or reclaimed since the last flush, to the
+  /// set of the current frame.
+  void flush();
+
+  /// `flush`, and bind the current frame's set as set 0 of
+  /// `pipeline_layout`.
+  void bind( VkCommandBuffer cmd, VkPipelineBindPoint bind_point );
+
+  [[nodiscard]] VkDescriptorSetLayout
+  set_layout() const
+  {
+    return m_set_layout;
+  }
+
+  /// The heap's set, then push constants of `push_constant_size` bytes.
+  [[nodiscard]] VkPipelineLayout
+  pipeline_layout() const
+  {
+    return m_pipeline_layout;
+  }
+
+  [[nodiscard]] bool
+  descriptor_indexing() const
+  {
+    return m_config.descriptor_indexing;
+  }
+
+  /// Size of the arrays, possibly clamped to the device's limits.
+  [[nodiscard]] uint32_t
+  texture_capacity() const
+  {
+    return m_textures.capacity;
+  }
+
+  [[nodiscard]] uint32_t
+  buffer_capacity() const
+  {
+    return m_buffers.capacity;
+  }
+
+  [[nodiscard]] descriptor_heap_stats stats() const;
+
+private:
+  /// An index removed while the frame with number `frame` was current.
+  struct removal
+  {
+    uint32_t index;
+    uint64_t frame;
+  };
+
+  /// One binding's array, and which indices are in use.
+  struct table
+  {
+    VkDescriptorType type;
+    uint32_t binding;
+    uint32_t capacity;
+    /// Descriptor of every index; only one of the two is used.
+    std::vector< VkDescriptorImageInfo > images;
+    std::vector< VkDescriptorBufferInfo > buffers;
+    /// Indices never handed out are [next, capacity).
+    uint32_t next;
+    std::vector< uint32_t > free;
+    std::vector< bool > used;
+    std::deque< removal > removed;
+    bool has_placeholder;
+    VkDescriptorImageInfo image_placeholder;
+    VkDescriptorBufferInfo buffer_placeholder;
+    /// Indices to write, per set.
+    std::vector< std::vector< uint32_t > > dirty;
+  };
+
+  VkDevice m_device;
+  descriptor_heap_config m_config;
+  VkDescriptorSetLayout m_set_layout;
+  VkPipelineLayout m_pipeline_layout;
+  VkDescriptorPool m_pool;
+  /// One set with descriptor indexing, else one per frame slot.
+  std::vector< VkDescriptorSet > m_sets;
+  table m_textures;
+  table m_buffers;
+  /// `begin_frame` calls so far.
+  uint64_t m_frame;
+  /// Set of the current frame, and if it was bound since `begin_frame`.
+  uint32_t m_current;
+  bool m_bound;
+  uint64_t m_descriptor_writes;
+  uint64_t m_write_ranges;
+
+  // Reused by `flush`.
+  std::vector< VkWriteDescriptorSet > m_writes;
+
+  void init_table( table& t, VkDescriptorType type, uint32_t binding,
+                   uint32_t capacity );
+  uint32_t allocate( table& t );
+  void remove( table& t, uint32_t index );
+  /// Clear every free index not pending reuse, for a new placeholder.
+  void fill_free( table& t );
+  /// Set a free index to the placeholder, if any.
+  void clear_entry( table& t, uint32_t index );
+  void mark_dirty( table& t, uint32_t index );
+  void reclaim( table& t );
+  void write_dirty( table& t, uint32_t set );
+  void destroy();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_DESCRIPTOR_HEAP_H
@@ -0,0 +1,514 @@
+#define MYENGINE_LOG_MODULE "vulkan.device_probe"
+#include "device_probe.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/mapped_file.h>
+#include <myengine/profiling.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Bump when the probe workload changes, so cached results are discarded.
+constexpr int CACHE_VERSION = 1;
+constexpr char const CACHE_MAGIC[] = "myengine-device-probe";
+
+/// Invocations per workgroup, `local_size_x` in `device_probe.comp`.
+constexpr uint32_t WORKGROUP_SIZE = 64;
+
+/// Upper bound on timed submissions per workload, budget permitting.
+constexpr int MAX_ROUNDS = 8;
+
+/// Give up on a submission that takes this long; the device is not worth it.
+constexpr uint64_t FENCE_TIMEOUT_NS = 5000000000ull;
+
+uint32_t const probe_spirv[] =
+#include "shaders/device_probe.comp.inc"
+;
+
+/**
+ * Vulkan objects of one probe run, destroyed in reverse order of creation.
+ *
+ * Every `vkDestroy*` / `vkFree*` accepts null handles, so a partially set up
+ * probe is cleaned up the same way as a complete one.
+ */
+struct probe_objects
+{
+  VkDevice device = VK_NULL_HANDLE;
+  VkBuffer storage_buffer = VK_NULL_HANDLE;
+  VkBuffer staging_buffer = VK_NULL_HANDLE;
+  VkBuffer device_buffer = VK_NULL_HANDLE;
+  VkDeviceMemory storage_memory = VK_NULL_HANDLE;
+  VkDeviceMemory staging_memory = VK_NULL_HANDLE;
+  VkDeviceMemory device_memory = VK_NULL_HANDLE;
+  VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+  VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+  VkShaderModule shader = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+  VkFence fence = VK_NULL_HANDLE;
+
+  probe_objects() = default;
+  probe_objects( probe_objects const& ) = delete;
+  probe_objects& operator=( probe_objects const& ) = delete;
+
+  ~probe_objects()
+  {
+    if( !device )
+    {
+      return;
+    }
+    // A timed out submission may still be running.
+    vkDeviceWaitIdle( device );
+    vkDestroyFence( device, fence, nullptr );
+    vkDestroyCommandPool( device, command_pool, nullptr );
+    vkDestroyPipeline( device, pipeline, nullptr );
+    vkDestroyShaderModule( device, shader, nullptr );
+    vkDestroyPipelineLayout( device, pipeline_layout, nullptr );
+    vkDestroyDescriptorPool( device, descriptor_pool, nullptr );
+    vkDestroyDescriptorSetLayout( device, set_layout, nullptr );
+    vkDestroyBuffer( device, device_buffer, nullptr );
+    vkDestroyBuffer( device, staging_buffer, nullptr );
+    vkDestroyBuffer( device, storage_buffer, nullptr );
+    vkFreeMemory( device, device_memory, nullptr );
+    vkFreeMemory( device, staging_memory, nullptr );
+    vkFreeMemory( device, storage_memory, nullptr );
+    vkDestroyDevice( device, nullptr );
+  }
+};
+
+/// Create a buffer with its own, bound memory allocation.
+void
+create_buffer( VkDevice device, VkPhysicalDeviceMemoryProperties const& mem,
+               VkDeviceSize size, VkBufferUsageFlags usage,
+               VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+               VkBuffer& buffer, VkDeviceMemory& memory )
+{
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  check_result( vkCreateBuffer( device, &buffer_info, nullptr, &buffer ),
+                "create buffer" );
+
+  VkMemoryRequirements reqs;
+  vkGetBufferMemoryRequirements( device, buffer, &reqs );
+  VkMemoryAllocateInfo alloc_info = {};
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.allocationSize = reqs.size;
+  alloc_info.memoryTypeIndex =
+    find_memory_type( mem, reqs.memoryTypeBits, required, preferred );
+  check_result( vkAllocateMemory( device, &alloc_info, nullptr, &memory ),
+                "allocate buffer memory" );
+  check_result( vkBindBufferMemory( device, buffer, memory, 0 ),
+                "bind buffer memory" );
+}
+
+/// Submit a recorded command buffer and wait for it, returning the wall time.
+steady_clock_t::duration
+run_timed( VkDevice device, VkQueue queue, VkFence fence, VkCommandBuffer cmd )
+{
+  check_result( vkResetFences( device, 1, &fence ), "reset fence" );
+  VkSubmitInfo submit_info = {};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &cmd;
+  auto start = steady_clock_t::now();
+  check_result( vkQueueSubmit( queue, 1, &submit_info, fence ), "submit" );
+  check_result( vkWaitForFences( device, 1, &fence, VK_TRUE, FENCE_TIMEOUT_NS ),
+                "wait for probe submission" );
+  return steady_clock_t::now() - start;
+}
+
+double
+to_seconds( steady_clock_t::duration d )
+{
+  return std::chrono::duration< double >( d ).count();
+}
+
+/// Key identifying a device and driver build in the results cache.
+std::string
+cache_key( VkPhysicalDeviceProperties const& props )
+{
+  std::stringstream ss;
+  ss << std::hex << std::setfill( '0' ) << std::setw( 4 ) << props.vendorID
+     << ':' << std::setw( 4 ) << props.deviceID << ':' << std::setw( 8 )
+     << props.driverVersion << ':';
+  for( uint8_t b : props.pipelineCacheUUID )
+  {
+    ss << std::setw( 2 ) << static_cast< unsigned >( b );
+  }
+  return ss.str();
+}
+
+/// First line of a results cache, fixing the workload the results are for.
+std::string
+cache_header( device_probe_config const& config )
+{
+  std::stringstream ss;
+  ss  << CACHE_MAGIC << ' ' << CACHE_VERSION << ' ' << config.dispatch_groups
+      << ' ' << config.dispatch_iterations << ' '
+      << config.dispatches_per_submit << ' ' << config.transfer_bytes;
+  return ss.str();
+}
+
+} // namespace
+
+device_probe_result
+probe_device( VkPhysicalDevice physical_device,
+              device_probe_config const& config )
+{
+  PROFILE_FUNCTION();
+  device_probe_result result;
+  try
+  {
+    device_capabilities const& caps = get_device_capabilities( physical_device );
+    VkPhysicalDeviceLimits const& limits = caps.properties.limits;
+
+    // Any compute family can also do transfers. Prefer one with graphics, as
+    // that is the queue an application would mostly be using.
+    uint32_t family = VK_QUEUE_FAMILY_IGNORED;
+    for( uint32_t i = 0; i < caps.queue_families.size(); ++i )
+    {
+      VkQueueFlags flags = caps.queue_families[ i ].queueFlags;
+      if( ( flags & VK_QUEUE_COMPUTE_BIT ) &&
+          ( family == VK_QUEUE_FAMILY_IGNORED ||
+            ( flags & VK_QUEUE_GRAPHICS_BIT ) ) )
+      {
+        family = i;
+      }
+    }
+    if( family == VK_QUEUE_FAMILY_IGNORED )
+    {
+      throw std::runtime_error( "No compute queue family" );
+    }
+
+    uint32_t const groups = std::max( 1u, std::min(
+      config.dispatch_groups, limits.maxComputeWorkGroupCount[ 0 ] ) );
+    VkDeviceSize const storage_size =
+      VkDeviceSize( groups ) * WORKGROUP_SIZE * sizeof( float );
+    VkDeviceSize const transfer_size =
+      std::max< VkDeviceSize >( config.transfer_bytes, 4 ) & ~VkDeviceSize( 3 );
+
+    probe_objects o;
+
+    float const priority = 1.f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    check_result( vkCreateDevice( physical_device, &device_info, nullptr,
+                                  &o.device ),
+                  "create probe device" );
+    VkQueue queue;
+    vkGetDeviceQueue( o.device, family, 0, &queue );
+
+    create_buffer( o.device, caps.memory_properties, storage_size,
+                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                   0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                   o.storage_buffer, o.storage_memory );
+    // The staging contents do not matter, so it is never mapped.
+    create_buffer( o.device, caps.memory_properties, transfer_size,
+                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                   o.staging_buffer, o.staging_memory );
+    create_buffer( o.device, caps.memory_properties, transfer_size,
+                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                   0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                   o.device_buffer, o.device_memory );
+
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo set_layout_info = {};
+    set_layout_info.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.bindingCount = 1;
+    set_layout_info.pBindings = &binding;
+    check_result( vkCreateDescriptorSetLayout( o.device, &set_layout_info,
+                                               nullptr, &o.set_layout ),
+                  "create descriptor set layout" );
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = 1;
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    check_result( vkCreateDescriptorPool( o.device, &pool_info, nullptr,
+                                          &o.descriptor_pool ),
+                  "create descriptor pool" );
+
+    VkDescriptorSet set;
+    VkDescriptorSetAllocateInfo set_info = {};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.descriptorPool = o.descriptor_pool;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &o.set_layout;
+    check_result( vkAllocateDescriptorSets( o.device, &set_info, &set ),
+                  "allocate descriptor set" );
+    VkDescriptorBufferInfo buffer_info = {};
+    buffer_info.buffer = o.storage_buffer;
+    buffer_info.offset = 0;
+    buffer_info.range = VK_WHOLE_SIZE;
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets( o.device, 1, &write, 0, nullptr );
+
+    VkPushConstantRange push_range = {};
+    push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_range.offset = 0;
+    push_range.size = sizeof( uint32_t );
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &o.set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_range;
+    check_result( vkCreatePipelineLayout( o.device, &layout_info, nullptr,
+                                          &o.pipeline_layout ),
+                  "create pipeline layout" );
+
+    VkShaderModuleCreateInfo shader_info = {};
+    shader_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_info.codeSize = sizeof( probe_spirv );
+    shader_info.pCode = probe_spirv;
+    check_result( vkCreateShaderModule( o.device, &shader_info, nullptr,
+                                        &o.shader ),
+                  "create shader module" );
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = o.shader;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = o.pipeline_layout;
+    check_result( vkCreateComputePipelines( o.device, VK_NULL_HANDLE, 1,
+                                            &pipeline_info, nullptr,
+                                            &o.pipeline ),
+                  "create compute pipeline" );
+
+    VkCommandPoolCreateInfo cmd_pool_info = {};
+    cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cmd_pool_info.queueFamilyIndex = family;
+    check_result( vkCreateCommandPool( o.device, &cmd_pool_info, nullptr,
+                                       &o.command_pool ),
+                  "create command pool" );
+    VkCommandBuffer cmds[ 2 ];
+    VkCommandBufferAllocateInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = o.command_pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 2;
+    check_result( vkAllocateCommandBuffers( o.device, &cmd_info, cmds ),
+                  "allocate command buffers" );
+    VkCommandBuffer const compute_cmd = cmds[ 0 ];
+    VkCommandBuffer const transfer_cmd = cmds[ 1 ];
+
+    // Recorded once and resubmitted; each submission is waited on before the
+    // next, so no simultaneous use.
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    check_result( vkBeginCommandBuffer( compute_cmd, &begin_info ),
+                  "begin command buffer" );
+    vkCmdBindPipeline( compute_cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                       o.pipeline );
+    vkCmdBindDescriptorSets( compute_cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                             o.pipeline_layout, 0, 1, &set, 0, nullptr );
+    vkCmdPushConstants( compute_cmd, o.pipeline_layout,
+                        VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof( uint32_t ),
+                        &config.dispatch_iterations );
+    // No barriers between dispatches: they are free to overlap, which is what
+    // the device would do with independent work. They all write the same
+    // values, so the write-after-write hazard is harmless.
+    for( uint32_t i = 0; i < config.dispatches_per_submit; ++i )
+    {
+      vkCmdDispatch( compute_cmd, groups, 1, 1 );
+    }
+    check_result( vkEndCommandBuffer( compute_cmd ), "end command buffer" );
+
+    check_result( vkBeginCommandBuffer( transfer_cmd, &begin_info ),
+                  "begin command buffer" );
+    VkBufferCopy region = {};
+    region.size = transfer_size;
+    vkCmdCopyBuffer( transfer_cmd, o.staging_buffer, o.device_buffer, 1,
+                     &region );
+    check_result( vkEndCommandBuffer( transfer_cmd ), "end command buffer" );
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    check_result( vkCreateFence( o.device, &fence_info, nullptr, &o.fence ),
+                  "create fence" );
+
+    // Warm up: first submissions pay for lazy pipeline compilation, memory
+    // residency and clocking up.
+    run_timed( o.device, queue, o.fence, compute_cmd );
+    run_timed( o.device, queue, o.fence, transfer_cmd );
+
+    auto best_compute = steady_clock_t::duration::max();
+    auto best_transfer = steady_clock_t::duration::max();
+    auto const deadline = steady_clock_t::now() + config.budget;
+    for( int round = 0;
+         round < MAX_ROUNDS &&
+         ( round == 0 || steady_clock_t::now() < deadline );
+         ++round )
+    {
+      best_compute = std::min(
+        best_compute, run_timed( o.device, queue, o.fence, compute_cmd ) );
+      best_transfer = std::min(
+        best_transfer, run_timed( o.device, queue, o.fence, transfer_cmd ) );
+    }
+
+    double const fmas = double( groups ) * WORKGROUP_SIZE *
+                        config.dispatch_iterations *
+                        config.dispatches_per_submit;
+    result.compute_gflops = 2. * fmas / to_seconds( best_compute ) / 1e9;
+    result.upload_gib_per_s = double( transfer_size ) /
+                              to_seconds( best_transfer ) / double( 1 << 30 );
+    result.ok = true;
+    LOGF_INFO( "Probed '{}': {} GFLOP/s compute, {} GiB/s upload",
+               caps.properties.deviceName, result.compute_gflops,
+               result.upload_gib_per_s );
+  }
+  catch( std::exception const& ex )
+  {
+    result = device_probe_result();
+    result.error = ex.what();
+    LOG_WARN( "Device probe failed: " << ex.what() );
+  }
+  return result;
+}
+
+std::vector< device_probe_result >
+probe_devices( std::vector< VkPhysicalDevice > const& devices,
+               device_probe_config const& config,
+               std::string const& cache_path )
+{
+  PROFILE_FUNCTION();
+  std::vector< device_probe_result > results( devices.size() );
+  std::vector< std::string > keys;
+  keys.reserve( devices.size() );
+  for( VkPhysicalDevice device : devices )
+  {
+    keys.push_back( cache_key( get_device_capabilities( device ).properties ) );
+  }
+
+  // Cache: a header line, then one "<key> <gflops> <GiB/s>" line per device.
+  std::string const header = cache_header( config );
+  std::vector< std::string > cache_lines;
+  if( !cache_path.empty() )
+  {
+    std::ifstream in( cache_path );
+    std::string line;
+    if( std::getline( in, line ) && line == header )
+    {
+      while( std::getline( in, line ) )
+      {
+        std::istringstream ss( line );
+        std::string key;
+        device_probe_result r;
+        if( !( ss >> key >> r.compute_gflops >> r.upload_gib_per_s ) )
+        {
+          continue;
+        }
+        cache_lines.push_back( line );
+        for( std::size_t i = 0; i < devices.size(); ++i )
+        {
+          if( keys[ i ] == key )
+          {
+            r.ok = true;
+            r.cached = true;
+            results[ i ] = r;
+          }
+        }
+      }
+    }
+    else if( in.is_open() )
+    {
+      LOGF_DEBUG( "Ignoring device probe cache '{}' for another workload",
+                  cache_path.c_str() );
+    }
+  }
+
+  std::vector< std::thread > threads;
+  for( std::size_t i = 0; i < devices.size(); ++i )
+  {
+    if( results[ i ].cached )
+    {
+      LOGF_DEBUG( "Using cached probe result for '{}'",
+                  get_device_capabilities( devices[ i ] ).properties.deviceName );
+      continue;
+    }
+    threads.emplace_back( [ &, i ]() {
+      profiling::set_thread_name( "device_probe " + std::to_string( i ) );
+      results[ i ] = probe_device( devices[ i ], config );
+    } );
+  }
+  for( std::thread& t : threads )
+  {
+    t.join();
+  }
+  if( threads.empty() || cache_path.empty() )
+  {
+    return results;
+  }
+
+  // Failures are not cached, so they get retried next time.
+  std::stringstream out;
+  out << header << '\n';
+  for( std::string const& line : cache_lines )
+  {
+    out << line << '\n';
+  }
+  for( std::size_t i = 0; i < devices.size(); ++i )
+  {
+    if( results[ i ].ok && !results[ i ].cached )
+    {
+      out << keys[ i ] << ' ' << results[ i ].compute_gflops << ' '
+          << results[ i ].upload_gib_per_s << '\n';
+    }
+  }
+  try
+  {
+    std::string const data = out.str();
+    write_file_atomic( cache_path, { { data.data(), data.size() } } );
+  }
+  catch( std::exception const& ex )
+  {
+    LOG_WARN( "Failed to save device probe cache: " << ex.what() );
+  }
+  return results;
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,89 @@
+#ifndef MYENGINE_DEVICE_PROBE_H
+#define MYENGINE_DEVICE_PROBE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine::vulkan {
+
+/// Size and time limits of a device probe.
+struct device_probe_config
+{
+  /// Soft limit on the time spent measuring one device, not counting setup.
+  std::chrono::milliseconds budget{ 250 };
+  /// Workgroups (of 64 invocations) per compute dispatch.
+  uint32_t dispatch_groups = 4096;
+  /// Dependent FMAs per invocation.
+  uint32_t dispatch_iterations = 256;
+  /// Dispatches recorded into one timed submission.
+  uint32_t dispatches_per_submit = 16;
+  /// Bytes copied from host-visible to device-local memory per timed
+  /// submission.
+  uint64_t transfer_bytes = 32ull << 20;
+};
+
+/// Measured performance of one physical device.
+struct device_probe_result
+{
+  /// If the probe ran; otherwise `error` says why not and the rates are 0.
+  bool ok = false;
+  std::string error;
+  /// Compute throughput in GFLOP/s, counting an FMA as two operations.
+  double compute_gflops = 0.;
+  /// Host-to-device copy bandwidth in GiB/s.
+  double upload_gib_per_s = 0.;
+  /// If this result came from the on-disk cache instead of a probe run.
+  bool cached = false;
+};
+
+/**
+ * Run a short compute and transfer micro-benchmark on a physical device.
+ *
+ * A temporary logical device is created on a compute-capable queue family,
+ * with a storage buffer, a staging buffer and a trivial compute pipeline. The
+ * fastest of a few timed submissions within `config.budget` is reported for
+ * each of:
+ *   - compute: `dispatches_per_submit` dispatches of an FMA loop,
+ *   - transfer: one `vkCmdCopyBuffer` of `transfer_bytes` from host-visible to
+ *     device-local memory.
+ *
+ * Times are wall clock from submit to fence, so small per-submit overheads are
+ * included; that is part of what is being measured.
+ *
+ * Thread-safe for distinct devices. Never throws; failures are reported in the
+ * result.
+ */
+device_probe_result
+MYENGINE_EXPORT
+probe_device( VkPhysicalDevice device,
+              device_probe_config const& config = device_probe_config() );
+
+/**
+ * Probe several devices in parallel, one thread per device, using and
+ * updating a cache of results.
+ *
+ * Cached results are keyed by vendor ID, device ID, driver version and
+ * `pipelineCacheUUID`, so a driver update re-probes the device.
+ *
+ * @param devices Devices to probe.
+ * @param config Probe settings.
+ * @param cache_path Results cache file, e.g.
+ * `user_cache_path( "device_probe.txt" )`. Empty to always probe.
+ *
+ * @return One result per input device, in the same order.
+ */
+std::vector< device_probe_result >
+MYENGINE_EXPORT
+probe_devices( std::vector< VkPhysicalDevice > const& devices,
+               device_probe_config const& config,
+               std::string const& cache_path );
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_DEVICE_PROBE_H
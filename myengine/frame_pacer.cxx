@@ -0,0 +1,239 @@
+#define MYENGINE_LOG_MODULE "frame_pacer"
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+
+namespace myengine {
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Weight of a new observation in the overshoot model once it has warmed up.
+/// Slow enough to ride out an occasional very late wake-up.
+constexpr double OVERSHOOT_MODEL_ALPHA = 1. / 64.;
+
+/// Sleeps observed before outliers are clamped.
+constexpr uint64_t OVERSHOOT_MODEL_WARMUP = 16;
+
+/// Slack of the outlier clamp, in nanoseconds, so a model with little variance
+/// can still adapt upwards.
+constexpr double OVERSHOOT_CLAMP_SLACK = 50000.;
+
+/// Sleep margin before any sleep was observed; generous for most systems.
+constexpr std::chrono::nanoseconds INITIAL_SLEEP_MARGIN{ 1000000 };
+
+int64_t
+to_us( std::chrono::nanoseconds d )
+{
+  return std::chrono::duration_cast< std::chrono::microseconds >( d ).count();
+}
+
+} // namespace
+
+frame_pacer::frame_pacer( frame_pacer_config const& config )
+  : m_config( config ),
+    m_interval( 0 ),
+    m_next(),
+    m_last_wake(),
+    m_overshoot_mean( 0. ),
+    m_overshoot_var( 0. ),
+    m_sleep_count( 0 ),
+    m_intervals( std::max< std::size_t >( config.history, 1 ), 0 ),
+    m_interval_pos( 0 ),
+    m_interval_count( 0 ),
+    m_missed( 0 ),
+    m_asleep( 0 ),
+    m_busy( 0 )
+{
+  set_target_fps( config.target_fps );
+}
+
+void
+frame_pacer::set_target_fps( double fps )
+{
+  m_config.target_fps = fps;
+  m_interval = std::chrono::nanoseconds(
+    fps > 0. ? static_cast< int64_t >( 1e9 / fps ) : 0 );
+  restart();
+}
+
+frame_pacer::steady_clock_t::time_point
+frame_pacer::wait()
+{
+  PROFILE_FUNCTION();
+  auto now = steady_clock_t::now();
+  if( m_interval.count() > 0 && m_next != steady_clock_t::time_point() )
+  {
+    if( now > m_next + m_interval )
+    {
+      // Too late to catch up without a burst of short frames; start over.
+      ++m_missed;
+      m_next = now;
+    }
+    else
+    {
+      // Sleep as long as even a late wake-up would still be in time.
+      auto const sleep_start = now;
+      for( auto left = m_next - now - sleep_margin(); left.count() > 0;
+           left = m_next - now - sleep_margin() )
+      {
+        sleep_for( left );
+        now = steady_clock_t::now();
+      }
+      auto const busy_start = now;
+      m_asleep += busy_start - sleep_start;
+
+      while( m_next - now > m_config.spin_threshold )
+      {
+        std::this_thread::yield();
+        now = steady_clock_t::now();
+      }
+      while( now < m_next )
+      {
+        now = steady_clock_t::now();
+      }
+      m_busy += now - busy_start;
+    }
+  }
+  else
+  {
+    m_next = now;
+  }
+
+  if( m_last_wake != steady_clock_t::time_point() )
+  {
+    m_intervals[ m_interval_pos ] = ( now - m_last_wake ).count();
+    m_interval_pos = ( m_interval_pos + 1 ) % m_intervals.size();
+    m_interval_count = std::min( m_interval_count + 1, m_intervals.size() );
+  }
+  m_last_wake = now;
+  m_next += m_interval;
+  return now;
+}
+
+frame_pacer_stats
+frame_pacer::stats() const
+{
+  frame_pacer_stats st = {};
+  st.target = m_interval;
+  st.missed = m_missed;
+  auto const waited = m_asleep + m_busy;
+  st.busy_fraction =
+    waited.count() > 0
+    ? static_cast< double >( m_busy.count() ) / waited.count() : 0.;
+  st.sleep_margin = sleep_margin();
+  st.frames = m_interval_count;
+  if( m_interval_count == 0 )
+  {
+    return st;
+  }
+
+  std::vector< int64_t > intervals( m_intervals.begin(),
+                                    m_intervals.begin() + m_interval_count );
+  int64_t sum = 0;
+  for( int64_t v : intervals )
+  {
+    sum += v;
+  }
+  int64_t const mean = sum / static_cast< int64_t >( intervals.size() );
+  st.mean_interval = std::chrono::nanoseconds( mean );
+
+  int64_t const reference = m_interval.count() > 0 ? m_interval.count() : mean;
+  for( int64_t& v : intervals )
+  {
+    v = std::abs( v - reference );
+  }
+  std::sort( intervals.begin(), intervals.end() );
+  // Nearest-rank percentile.
+  std::size_t const rank = static_cast< std::size_t >(
+    std::ceil( 0.99 * intervals.size() ) );
+  st.p99_deviation = std::chrono::nanoseconds(
+    intervals[ std::max< std::size_t >( rank, 1 ) - 1 ] );
+  st.max_deviation = std::chrono::nanoseconds( intervals.back() );
+  return st;
+}
+
+void
+frame_pacer::reset_stats()
+{
+  m_interval_pos = 0;
+  m_interval_count = 0;
+  m_missed = 0;
+  m_asleep = steady_clock_t::duration( 0 );
+  m_busy = steady_clock_t::duration( 0 );
+}
+
+void
+frame_pacer::log_summary()
+{
+  frame_pacer_stats const st = stats();
+  if( st.frames == 0 )
+  {
+    return;
+  }
+  LOGF_INFO( "{} frame(s): target {} us, mean interval {} us, deviation p99 {} "
+             "us max {} us, {} missed, {}% of waiting busy, sleep margin {} "
+             "us", st.frames, to_us( st.target ), to_us( st.mean_interval ),
+             to_us( st.p99_deviation ), to_us( st.max_deviation ), st.missed,
+             static_cast< int >( 100. * st.busy_fraction ),
+             to_us( st.sleep_margin ) );
+  reset_stats();
+}
+
+void
+frame_pacer::restart()
+{
+  m_next = steady_clock_t::time_point();
+  m_last_wake = steady_clock_t::time_point();
+}
+
+std::chrono::nanoseconds
+frame_pacer::sleep_margin() const
+{
+  if( m_sleep_count == 0 )
+  {
+    return INITIAL_SLEEP_MARGIN;
+  }
+  double const margin =
+    m_overshoot_mean + 2. * std::sqrt( std::max( m_overshoot_var, 0. ) );
+  return std::chrono::nanoseconds(
+    static_cast< int64_t >( std::max( margin, 0. ) ) );
+}
+
+void
+frame_pacer::sleep_for( std::chrono::nanoseconds d )
+{
+  auto const start = steady_clock_t::now();
+  std::this_thread::sleep_for( d );
+  double overshoot =
+    std::chrono::duration< double, std::nano >(
+      steady_clock_t::now() - start - d ).count();
+
+  // Plain running mean and variance at first, then exponential moving
+  // averages so the model follows changes in system load. Once warmed up,
+  // outliers (e.g. the thread being descheduled) are clamped so a single one
+  // does not make every later frame spin for milliseconds.
+  if( m_sleep_count >= OVERSHOOT_MODEL_WARMUP )
+  {
+    overshoot = std::min(
+      overshoot,
+      m_overshoot_mean + 4. * std::sqrt( std::max( m_overshoot_var, 0. ) ) +
+        OVERSHOOT_CLAMP_SLACK );
+  }
+  ++m_sleep_count;
+  double const alpha = std::max( 1. / static_cast< double >( m_sleep_count ),
+                                 OVERSHOOT_MODEL_ALPHA );
+  double const delta = overshoot - m_overshoot_mean;
+  m_overshoot_mean += alpha * delta;
+  m_overshoot_var =
+    ( 1. - alpha ) * ( m_overshoot_var + alpha * delta * delta );
+}
+
+} // namespace myengine
@@ -0,0 +1,129 @@
+#ifndef MYENGINE_FRAME_PACER_H
+#define MYENGINE_FRAME_PACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine {
+
+struct frame_pacer_config
+{
+  /// Frames per second to pace to; zero or less for no pacing.
+  double target_fps = 0.;
+  /// Time before the deadline below which the pacer spins instead of yielding.
+  std::chrono::microseconds spin_threshold{ 50 };
+  /// Frame intervals kept for the jitter statistics.
+  std::size_t history = 1024;
+};
+
+/// Frame interval statistics, over the most recent frames.
+struct frame_pacer_stats
+{
+  /// Intervals measured.
+  std::size_t frames;
+  /// Target interval, zero when not pacing.
+  std::chrono::nanoseconds target;
+  std::chrono::nanoseconds mean_interval;
+  /// 99th percentile and maximum of the absolute deviation of an interval from
+  /// the target (from the mean when not pacing).
+  std::chrono::nanoseconds p99_deviation;
+  std::chrono::nanoseconds max_deviation;
+  /// Frames that started more than one interval late, after which the pacer
+  /// started a new schedule instead of trying to catch up.
+  uint64_t missed;
+  /// Share of the waiting time spent yielding and spinning rather than asleep,
+  /// i.e. burning a core.
+  double busy_fraction;
+  /// Current margin for the OS oversleeping a requested duration.
+  std::chrono::nanoseconds sleep_margin;
+};
+
+/**
+ * Paces a loop to a fixed frame rate.
+ *
+ * `wait` blocks until the next deadline, one interval after the previous one,
+ * so the schedule does not drift with the time the loop body takes. Waiting is
+ * hybrid: sleep until a margin before the deadline, then yield the thread,
+ * then spin for the last `spin_threshold`.
+ *
+ * The margin is learned online from how much each sleep overshoots the
+ * requested duration: the mean plus two standard deviations of the overshoot,
+ * kept as exponential moving averages. This follows whatever the OS timer
+ * slack and scheduling latency are instead of assuming a fixed margin.
+ *
+ * Locking to the display's refresh rate is a `target_fps` of the refresh rate
+ * (e.g. `glfw::glfw_get_refresh_rate`). This matters with present modes that do
+ * not block on vertical blank (mailbox, immediate); FIFO presentation already
+ * limits the frame rate.
+ *
+ * Not thread-safe.
+ */
+class MYENGINE_EXPORT frame_pacer
+{
+public:
+  typedef std::chrono::steady_clock steady_clock_t;
+
+  explicit frame_pacer( frame_pacer_config const& config =
+                          frame_pacer_config() );
+
+  /**
+   * Change the target frame rate, starting a new schedule from now.
+   *
+   * @param fps Frames per second; zero or less to stop pacing.
+   */
+  void set_target_fps( double fps );
+
+  [[nodiscard]] std::chrono::nanoseconds
+  target_interval() const
+  {
+    return m_interval;
+  }
+
+  /**
+   * Wait for the start of the next frame and record the interval since the
+   * previous one. Returns immediately when not pacing.
+   *
+   * @return Time the wait ended.
+   */
+  steady_clock_t::time_point wait();
+
+  /// Statistics of the intervals recorded since construction or the last
+  /// `reset_stats`.
+  [[nodiscard]] frame_pacer_stats stats() const;
+
+  void reset_stats();
+
+  /// Log `stats()` and reset them.
+  void log_summary();
+
+private:
+  frame_pacer_config m_config;
+  std::chrono::nanoseconds m_interval;
+  /// Deadline of the next frame; unset before the first `wait`.
+  steady_clock_t::time_point m_next;
+  steady_clock_t::time_point m_last_wake;
+
+  // Sleep overshoot model, in nanoseconds.
+  double m_overshoot_mean;
+  double m_overshoot_var;
+  uint64_t m_sleep_count;
+
+  // Interval statistics.
+  std::vector< int64_t > m_intervals;
+  std::size_t m_interval_pos;
+  std::size_t m_interval_count;
+  uint64_t m_missed;
+  steady_clock_t::duration m_asleep;
+  steady_clock_t::duration m_busy;
+
+  void restart();
+  [[nodiscard]] std::chrono::nanoseconds sleep_margin() const;
+  void sleep_for( std::chrono::nanoseconds d );
+};
+
+} // namespace myengine
+
+#endif //MYENGINE_FRAME_PACER_H
@@ -0,0 +1,491 @@
+#define MYENGINE_LOG_MODULE "vulkan.frame_scheduler"
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <vulkan/vulkan.hpp>
+
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Completed frame timings kept for `recent_timings`.
+constexpr std::size_t TIMING_HISTORY = 256;
+
+std::chrono::nanoseconds
+to_ns( steady_clock_t::duration d )
+{
+  return std::chrono::duration_cast< std::chrono::nanoseconds >( d );
+}
+
+int64_t
+avg_us( std::chrono::nanoseconds total, uint64_t count )
+{
+  return static_cast< int64_t >( total.count() / 1000 /
+                                 static_cast< int64_t >( count ) );
+}
+
+} // namespace
+
+frame_scheduler::frame_scheduler( VkPhysicalDevice physical_device,
+                                  VkDevice device, VkSurfaceKHR surface,
+                                  uint32_t graphics_family,
+                                  VkQueue graphics_queue,
+                                  uint32_t present_family,
+                                  VkQueue present_queue, VkExtent2D extent,
+                                  frame_scheduler_config const& config )
+  : m_device( device ),
+    m_graphics_queue( graphics_queue ),
+    m_present_queue( present_queue ),
+    m_config( config ),
+    m_swapchain( physical_device, device, surface,
+                 { graphics_family, present_family }, extent,
+                 config.present_mode, config.image_usage ),
+    m_extent( extent ),
+    m_needs_recreate( false ),
+    m_command_pools(),
+    m_command_buffers(),
+    m_fences(),
+    m_image_available(),
+    m_render_finished(),
+    m_image_frame(),
+    m_submitted( 0 ),
+    m_current(),
+    m_last_report( steady_clock_t::now() ),
+    m_mutex(),
+    m_cv(),
+    m_pending(),
+    m_completed( 0 ),
+    m_error(),
+    m_stop( false ),
+    m_prev_submit(),
+    m_prev_complete(),
+    m_timings(),
+    m_sum(),
+    m_sum_count( 0 ),
+    m_watcher()
+{
+  m_config.frames_in_flight = std::max( 1u, m_config.frames_in_flight );
+  uint32_t const n = m_config.frames_in_flight;
+  m_command_pools.resize( n, VK_NULL_HANDLE );
+  m_command_buffers.resize( n, VK_NULL_HANDLE );
+  m_fences.resize( n, VK_NULL_HANDLE );
+  m_image_available.resize( n, VK_NULL_HANDLE );
+  m_timings.reserve( TIMING_HISTORY );
+
+  try
+  {
+    for( uint32_t i = 0; i < n; ++i )
+    {
+      // Transient: the whole pool is reset every time the slot comes around.
+      VkCommandPoolCreateInfo pool_info = {};
+      pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+      pool_info.queueFamilyIndex = graphics_family;
+      check_result( vkCreateCommandPool( m_device, &pool_info, nullptr,
+                                         &m_command_pools[ i ] ),
+                    "create frame command pool" );
+
+      VkCommandBufferAllocateInfo cmd_info = {};
+      cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      cmd_info.commandPool = m_command_pools[ i ];
+      cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      cmd_info.commandBufferCount = 1;
+      check_result( vkAllocateCommandBuffers( m_device, &cmd_info,
+                                              &m_command_buffers[ i ] ),
+                    "allocate frame command buffer" );
+
+      VkFenceCreateInfo fence_info = {};
+      fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+      check_result( vkCreateFence( m_device, &fence_info, nullptr,
+                                   &m_fences[ i ] ),
+                    "create frame fence" );
+
+      VkSemaphoreCreateInfo sem_info = {};
+      sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      check_result( vkCreateSemaphore( m_device, &sem_info, nullptr,
+                                       &m_image_available[ i ] ),
+                    "create image available semaphore" );
+    }
+    create_render_finished();
+  }
+  catch( ... )
+  {
+    destroy_render_finished();
+    for( uint32_t i = 0; i < n; ++i )
+    {
+      vkDestroySemaphore( m_device, m_image_available[ i ], nullptr );
+      vkDestroyFence( m_device, m_fences[ i ], nullptr );
+      vkDestroyCommandPool( m_device, m_command_pools[ i ], nullptr );
+    }
+    throw;
+  }
+
+  m_watcher = std::thread( &frame_scheduler::watch, this );
+  LOGF_INFO( "Frame scheduler with {} frame(s) in flight", n );
+}
+
+frame_scheduler::~frame_scheduler()
+{
+  try
+  {
+    wait_idle();
+  }
+  catch( std::exception const& ex )
+  {
+    LOG_WARN( "Frames did not complete: " << ex.what() );
+  }
+  // Also covers presentation, which is not fenced.
+  vkDeviceWaitIdle( m_device );
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    m_stop = true;
+  }
+  m_cv.notify_all();
+  m_watcher.join();
+
+  destroy_render_finished();
+  for( uint32_t i = 0; i < m_config.frames_in_flight; ++i )
+  {
+    vkDestroySemaphore( m_device, m_image_available[ i ], nullptr );
+    vkDestroyFence( m_device, m_fences[ i ], nullptr );
+    vkDestroyCommandPool( m_device, m_command_pools[ i ], nullptr );
+  }
+}
+
+bool
+frame_scheduler::begin_frame( frame& f )
+{
+  PROFILE_FUNCTION();
+  if( m_needs_recreate )
+  {
+    if( m_extent.width == 0 || m_extent.height == 0 )
+    {
+      return false;  // Minimized
+    }
+    recreate_swapchain();
+  }
+
+  uint64_t const number = m_submitted;
+  uint32_t const slot =
+    static_cast< uint32_t >( number % m_config.frames_in_flight );
+
+  // The slot's previous frame must be done with its command buffer and fence.
+  auto const t0 = steady_clock_t::now();
+  if( number >= m_config.frames_in_flight )
+  {
+    wait_completed( number - m_config.frames_in_flight + 1 );
+  }
+
+  auto const t1 = steady_clock_t::now();
+  uint32_t image_index = 0;
+  VkResult res = vkAcquireNextImageKHR( m_device, m_swapchain.handle(),
+                                        UINT64_MAX, m_image_available[ slot ],
+                                        VK_NULL_HANDLE, &image_index );
+  if( res == VK_ERROR_OUT_OF_DATE_KHR )
+  {
+    m_needs_recreate = true;
+    return false;
+  }
+  if( res == VK_SUBOPTIMAL_KHR )
+  {
+    // Still usable; replace it after this frame.
+    m_needs_recreate = true;
+  }
+  else
+  {
+    check_result( res, "acquire swapchain image" );
+  }
+
+  // With more images than frame slots, an image can still be in use by a
+  // frame from another slot.
+  auto const t2 = steady_clock_t::now();
+  wait_completed( m_image_frame[ image_index ] );
+  m_image_frame[ image_index ] = number + 1;
+
+  auto const t3 = steady_clock_t::now();
+  check_result( vkResetFences( m_device, 1, &m_fences[ slot ] ),
+                "reset frame fence" );
+  check_result( vkResetCommandPool( m_device, m_command_pools[ slot ], 0 ),
+                "reset frame command pool" );
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  check_result( vkBeginCommandBuffer( m_command_buffers[ slot ], &begin_info ),
+                "begin frame command buffer" );
+
+  f.number = number;
+  f.slot = slot;
+  f.image_index = image_index;
+  f.image = m_swapchain.image( image_index );
+  f.view = m_swapchain.view( image_index );
+  f.cmd = m_command_buffers[ slot ];
+
+  m_current.number = number;
+  m_current.fence = m_fences[ slot ];
+  m_current.cpu_wait = to_ns( ( t1 - t0 ) + ( t3 - t2 ) );
+  m_current.acquire = to_ns( t2 - t1 );
+  m_current.record_begin = steady_clock_t::now();
+  return true;
+}
+
+void
+frame_scheduler::end_frame( frame const& f,
+                            std::vector< timeline_wait > const& waits )
+{
+  PROFILE_FUNCTION();
+  check_result( vkEndCommandBuffer( f.cmd ), "end frame command buffer" );
+
+  // The image-available semaphore first; its value is ignored, being binary.
+  std::vector< VkSemaphore > wait_semaphores = { m_image_available[ f.slot ] };
+  std::vector< uint64_t > wait_values = { 0 };
+  std::vector< VkPipelineStageFlags > wait_stages = {
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+    VK_PIPELINE_STAGE_TRANSFER_BIT };
+  for( auto const& w : waits )
+  {
+    wait_semaphores.push_back( w.point.semaphore );
+    wait_values.push_back( w.point.value );
+    wait_stages.push_back( w.stages );
+  }
+  VkTimelineSemaphoreSubmitInfo timeline_info = {};
+  timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_info.waitSemaphoreValueCount =
+    static_cast< uint32_t >( wait_values.size() );
+  timeline_info.pWaitSemaphoreValues = wait_values.data();
+  VkSubmitInfo submit_info = {};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  // Only with timeline waits, so that devices without timeline semaphores
+  // work as before.
+  submit_info.pNext = waits.empty() ? nullptr : &timeline_info;
+  submit_info.waitSemaphoreCount =
+    static_cast< uint32_t >( wait_semaphores.size() );
+  submit_info.pWaitSemaphores = wait_semaphores.data();
+  submit_info.pWaitDstStageMask = wait_stages.data();
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &f.cmd;
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores = &m_render_finished[ f.image_index ];
+  m_current.submit = steady_clock_t::now();
+  check_result( vkQueueSubmit( m_graphics_queue, 1, &submit_info,
+                               m_fences[ f.slot ] ),
+                "submit frame" );
+  ++m_submitted;
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    m_pending.push_back( m_current );
+  }
+  m_cv.notify_all();
+
+  VkSwapchainKHR sc = m_swapchain.handle();
+  VkPresentInfoKHR present_info = {};
+  present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  present_info.waitSemaphoreCount = 1;
+  present_info.pWaitSemaphores = &m_render_finished[ f.image_index ];
+  present_info.swapchainCount = 1;
+  present_info.pSwapchains = &sc;
+  present_info.pImageIndices = &f.image_index;
+  VkResult res = vkQueuePresentKHR( m_present_queue, &present_info );
+  if( res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR )
+  {
+    m_needs_recreate = true;
+  }
+  else
+  {
+    check_result( res, "present" );
+  }
+
+  if( m_config.report_interval.count() > 0 &&
+      steady_clock_t::now() - m_last_report >= m_config.report_interval )
+  {
+    log_summary();
+  }
+}
+
+void
+frame_scheduler::resize( VkExtent2D extent )
+{
+  m_extent = extent;
+  m_needs_recreate = true;
+}
+
+void
+frame_scheduler::wait_idle()
+{
+  wait_completed( m_submitted );
+}
+
+std::vector< frame_timing >
+frame_scheduler::recent_timings() const
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  if( m_timings.size() < TIMING_HISTORY )
+  {
+    return m_timings;
+  }
+  // Full ring; the oldest entry is the one to be overwritten next.
+  std::size_t const oldest = m_completed % TIMING_HISTORY;
+  std::vector< frame_timing > out( m_timings.begin() + oldest,
+                                   m_timings.end() );
+  out.insert( out.end(), m_timings.begin(), m_timings.begin() + oldest );
+  return out;
+}
+
+void
+frame_scheduler::log_summary()
+{
+  m_last_report = steady_clock_t::now();
+  frame_timing sum;
+  uint64_t count;
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    sum = m_sum;
+    count = m_sum_count;
+    m_sum = frame_timing();
+    m_sum_count = 0;
+  }
+  if( count == 0 )
+  {
+    return;
+  }
+  int64_t const overlap_pct =
+    sum.cpu_record.count() > 0
+    ? 100 * sum.overlap.count() / sum.cpu_record.count() : 0;
+  LOGF_INFO( "{} frame(s): avg record {} us, wait {} us, acquire {} us, GPU "
+             "latency {} us, overlap {} us ({}% of recording)", count,
+             avg_us( sum.cpu_record, count ), avg_us( sum.cpu_wait, count ),
+             avg_us( sum.acquire, count ), avg_us( sum.gpu_latency, count ),
+             avg_us( sum.overlap, count ), overlap_pct );
+}
+
+void
+frame_scheduler::wait_completed( uint64_t count )
+{
+  std::unique_lock< std::mutex > lock( m_mutex );
+  m_cv.wait( lock, [ & ]() {
+    return m_completed >= count || !m_error.empty();
+  } );
+  if( !m_error.empty() )
+  {
+    throw std::runtime_error( m_error );
+  }
+}
+
+void
+frame_scheduler::recreate_swapchain()
+{
+  PROFILE_FUNCTION();
+  // Presentation is not fenced, so only a device wait covers every use of the
+  // old images and semaphores.
+  wait_idle();
+  check_result( vkDeviceWaitIdle( m_device ), "wait for device idle" );
+  destroy_render_finished();
+  m_swapchain.recreate( m_extent );
+  create_render_finished();
+  m_needs_recreate = false;
+}
+
+void
+frame_scheduler::create_render_finished()
+{
+  uint32_t const count = m_swapchain.image_count();
+  m_render_finished.resize( count, VK_NULL_HANDLE );
+  for( uint32_t i = 0; i < count; ++i )
+  {
+    VkSemaphoreCreateInfo sem_info = {};
+    sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    check_result( vkCreateSemaphore( m_device, &sem_info, nullptr,
+                                     &m_render_finished[ i ] ),
+                  "create render finished semaphore" );
+  }
+  // Everything that used the old images has completed.
+  m_image_frame.assign( count, 0 );
+}
+
+void
+frame_scheduler::destroy_render_finished()
+{
+  for( VkSemaphore s : m_render_finished )
+  {
+    vkDestroySemaphore( m_device, s, nullptr );
+  }
+  m_render_finished.clear();
+}
+
+void
+frame_scheduler::watch()
+{
+  profiling::set_thread_name( "frame_watcher" );
+  std::unique_lock< std::mutex > lock( m_mutex );
+  while( true )
+  {
+    m_cv.wait( lock, [ & ]() { return m_stop || !m_pending.empty(); } );
+    if( m_pending.empty() )
+    {
+      return;  // Stopping, and nothing left to wait for.
+    }
+    pending_frame p = m_pending.front();
+    m_pending.pop_front();
+
+    // The main thread only resets the fence after seeing `m_completed` pass
+    // this frame, so waiting here unlocked does not race with that.
+    lock.unlock();
+    VkResult res = vkWaitForFences( m_device, 1, &p.fence, VK_TRUE,
+                                    UINT64_MAX );
+    auto const complete = steady_clock_t::now();
+    lock.lock();
+
+    if( res != VK_SUCCESS )
+    {
+      std::stringstream ss;
+      ss  << "Failed to wait for frame " << p.number << ": "
+          << vk::to_string( static_cast< vk::Result >( res ) );
+      m_error = ss.str();
+      m_cv.notify_all();
+      return;
+    }
+
+    frame_timing t;
+    t.frame = p.number;
+    t.cpu_wait = p.cpu_wait;
+    t.acquire = p.acquire;
+    t.cpu_record = to_ns( p.submit - p.record_begin );
+    t.gpu_latency = to_ns( complete - p.submit );
+    // Frames complete in submission order on one queue, so the previous
+    // completion is the previous frame's.
+    auto const overlap_begin = std::max( p.record_begin, m_prev_submit );
+    auto const overlap_end = std::min( p.submit, m_prev_complete );
+    t.overlap = p.number > 0 && overlap_end > overlap_begin
+                ? to_ns( overlap_end - overlap_begin )
+                : std::chrono::nanoseconds( 0 );
+    m_prev_submit = p.submit;
+    m_prev_complete = complete;
+
+    if( m_timings.size() < TIMING_HISTORY )
+    {
+      m_timings.push_back( t );
+    }
+    else
+    {
+      m_timings[ p.number % TIMING_HISTORY ] = t;
+    }
+    m_sum.cpu_wait += t.cpu_wait;
+    m_sum.acquire += t.acquire;
+    m_sum.cpu_record += t.cpu_record;
+    m_sum.gpu_latency += t.gpu_latency;
+    m_sum.overlap += t.overlap;
+    ++m_sum_count;
+
+    m_completed = p.number + 1;
+    m_cv.notify_all();
+  }
+}
+
+} // namespace myengine::vulkan
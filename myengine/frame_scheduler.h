@@ -0,0 +1,232 @@
+#ifndef MYENGINE_FRAME_SCHEDULER_H
+#define MYENGINE_FRAME_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+#include <myengine/queues.h>
+#include <myengine/swapchain.h>
+
+namespace myengine::vulkan {
+
+/// How one frame went, as seen from the host.
+struct frame_timing
+{
+  uint64_t frame;
+  /// Blocked in `begin_frame` until the frame slot and the acquired image were
+  /// no longer in use by earlier frames.
+  std::chrono::nanoseconds cpu_wait;
+  /// Spent in `vkAcquireNextImageKHR`.
+  std::chrono::nanoseconds acquire;
+  /// From `begin_frame` returning to `end_frame` submitting, i.e. the
+  /// application's recording.
+  std::chrono::nanoseconds cpu_record;
+  /// From submission until the host saw the frame's fence signaled.
+  std::chrono::nanoseconds gpu_latency;
+  /// Part of `cpu_record` during which the previous frame was still
+  /// executing: the achieved CPU/GPU overlap.
+  std::chrono::nanoseconds overlap;
+};
+
+struct frame_scheduler_config
+{
+  /// Frames the CPU may get ahead of the GPU, usually 2 or 3. 1 serializes
+  /// CPU and GPU work.
+  uint32_t frames_in_flight = 2;
+  VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+  /// Swapchain image usage, see `swapchain`.
+  VkImageUsageFlags image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  /// Interval of timing summaries in the log; zero for none.
+  std::chrono::seconds report_interval{ 5 };
+};
+
+/**
+ * Paces rendering to a swapchain with several frames in flight.
+ *
+ * Each frame slot (frame number modulo `frames_in_flight`) has its own command
+ * pool and primary command buffer, a fence signaled when its submission
+ * completes, and an image-available semaphore for `vkAcquireNextImageKHR`.
+ * Render-finished semaphores, waited on by presentation, are kept per
+ * swapchain image instead of per slot: a slot can come around again while
+ * the presentation of its previous image still holds that semaphore.
+ *
+ * `begin_frame` only waits for the submission that last used the same slot,
+ * and for the one that last rendered to the acquired image (which may belong
+ * to a different slot), so the application records frame N+1 while the GPU is
+ * still executing frame N.
+ *
+ * Fences are waited on by a watcher thread, which timestamps each completion.
+ * From those, per-frame `frame_timing` is derived, including how much of each
+ * frame's recording overlapped with the previous frame's execution.
+ *
+ * The swapchain is recreated when it goes out of date or suboptimal, or after
+ * `resize`.
+ *
+ * Not thread-safe; `begin_frame`/`end_frame` are for one thread. Must be
+ * destroyed before the `VkDevice` and surface.
+ */
+class MYENGINE_EXPORT frame_scheduler
+{
+public:
+  /// A frame being recorded, from `begin_frame`.
+  struct frame
+  {
+    /// Sequence number, from 0.
+    uint64_t number;
+    /// Frame slot, in [0, frames_in_flight).
+    uint32_t slot;
+    /// Acquired swapchain image.
+    uint32_t image_index;
+    VkImage image;
+    VkImageView view;
+    /// Primary command buffer for the frame, already begun.
+    VkCommandBuffer cmd;
+  };
+
+  /**
+   * @param graphics_family Queue family of `graphics_queue`, for the command
+   * pools.
+   * @param present_family Queue family of `present_queue`.
+   * @param extent Swapchain size if the surface leaves it up to us.
+   *
+   * @throws std::runtime_error Failed to create the swapchain or per frame
+   * objects.
+   */
+  frame_scheduler( VkPhysicalDevice physical_device, VkDevice device,
+                   VkSurfaceKHR surface, uint32_t graphics_family,
+                   VkQueue graphics_queue, uint32_t present_family,
+                   VkQueue present_queue, VkExtent2D extent,
+                   frame_scheduler_config const& config =
+                     frame_scheduler_config() );
+
+  frame_scheduler( frame_scheduler const& ) = delete;
+  frame_scheduler& operator=( frame_scheduler const& ) = delete;
+
+  /// Waits for all frames to finish.
+  ~frame_scheduler();
+
+  /**
+   * Wait for a free frame slot, acquire the next swapchain image, and begin
+   * the slot's command buffer.
+   *
+   * @param [out] f The frame to record, if true is returned.
+   *
+   * @return False if no image could be acquired (the swapchain was out of date,
+   * or the surface has zero size); skip rendering this time around.
+   *
+   * @throws std::runtime_error A Vulkan call failed or an earlier frame could
+   * not be waited on.
+   */
+  bool begin_frame( frame& f );
+
+  /**
+   * End the frame's command buffer, submit it to the graphics queue and
+   * present its image.
+   *
+   * The command buffer must leave the image in
+   * `VK_IMAGE_LAYOUT_PRESENT_SRC_KHR`. Its commands wait for the image to be
+   * acquired at the color attachment output and transfer stages.
+   *
+   * @param waits Points of other queues' timelines to wait for as well, e.g.
+   * uploads and compute work the frame consumes, see `timeline_queue`.
+   *
+   * @throws std::runtime_error Submission or presentation failed.
+   */
+  void end_frame( frame const& f,
+                  std::vector< timeline_wait > const& waits = {} );
+
+  /// Recreate the swapchain at this size before the next frame.
+  void resize( VkExtent2D extent );
+
+  /// Wait for every submitted frame to complete.
+  void wait_idle();
+
+  [[nodiscard]] myengine::vulkan::swapchain const&
+  get_swapchain() const
+  {
+    return m_swapchain;
+  }
+
+  [[nodiscard]] uint32_t
+  frames_in_flight() const
+  {
+    return m_config.frames_in_flight;
+  }
+
+  /// Timings of the most recently completed frames, oldest first.
+  [[nodiscard]] std::vector< frame_timing > recent_timings() const;
+
+  /// Log averages of the timings of frames completed since the last summary.
+  void log_summary();
+
+private:
+  /// A submission the watcher waits on.
+  struct pending_frame
+  {
+    uint64_t number;
+    VkFence fence;
+    std::chrono::nanoseconds cpu_wait;
+    std::chrono::nanoseconds acquire;
+    std::chrono::steady_clock::time_point record_begin;
+    std::chrono::steady_clock::time_point submit;
+  };
+
+  VkDevice m_device;
+  VkQueue m_graphics_queue;
+  VkQueue m_present_queue;
+  frame_scheduler_config m_config;
+  myengine::vulkan::swapchain m_swapchain;
+  VkExtent2D m_extent;
+  bool m_needs_recreate;
+
+  // Per frame slot.
+  std::vector< VkCommandPool > m_command_pools;
+  std::vector< VkCommandBuffer > m_command_buffers;
+  std::vector< VkFence > m_fences;
+  std::vector< VkSemaphore > m_image_available;
+  // Per swapchain image.
+  std::vector< VkSemaphore > m_render_finished;
+  /// Number + 1 of the frame that last rendered to each image, 0 for none.
+  std::vector< uint64_t > m_image_frame;
+
+  /// Frames submitted so far; also the number of the next frame.
+  uint64_t m_submitted;
+  /// Timing of the frame between `begin_frame` and `end_frame`.
+  pending_frame m_current;
+  std::chrono::steady_clock::time_point m_last_report;
+
+  // Shared with the watcher thread.
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::deque< pending_frame > m_pending;
+  /// Frames completed so far.
+  uint64_t m_completed;
+  std::string m_error;
+  bool m_stop;
+  std::chrono::steady_clock::time_point m_prev_submit;
+  std::chrono::steady_clock::time_point m_prev_complete;
+  std::vector< frame_timing > m_timings;
+  frame_timing m_sum;
+  uint64_t m_sum_count;
+  std::thread m_watcher;
+
+  /// Block until at least `count` frames have completed.
+  void wait_completed( uint64_t count );
+  void recreate_swapchain();
+  void create_render_finished();
+  void destroy_render_finished();
+  void watch();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_FRAME_SCHEDULER_H
@@ -13,4 +13,16 @@ glfw_get_required_vulkan_extensions()
   return { name_array, name_array + count };
 }
 
+int
+glfw_get_refresh_rate( GLFWwindow* window )
+{
+  GLFWmonitor* monitor = glfwGetWindowMonitor( window );
+  if( !monitor )
+  {
+    monitor = glfwGetPrimaryMonitor();
+  }
+  GLFWvidmode const* mode = monitor ? glfwGetVideoMode( monitor ) : nullptr;
+  return mode ? mode->refreshRate : 0;
+}
+
 } // namespace myengine::glfw
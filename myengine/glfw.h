@@ -5,6 +5,8 @@
 
 #include <myengine/myengine_export.h>
 
+struct GLFWwindow;
+
 namespace myengine::glfw {
 
 /**
@@ -16,6 +18,17 @@ namespace myengine::glfw {
 MYENGINE_EXPORT
 glfw_get_required_vulkan_extensions();
 
+/**
+ * Get the refresh rate of the monitor a window is shown on: its full screen
+ * monitor, or the primary monitor for windowed mode.
+ *
+ * @param window Window to get the refresh rate for.
+ * @return Refresh rate in Hz, or 0 if unknown.
+ */
+[[nodiscard]] int
+MYENGINE_EXPORT
+glfw_get_refresh_rate( GLFWwindow* window );
+
 } // namespace myengine::glfw
 
 #endif //GLFW_H
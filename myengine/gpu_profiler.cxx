@@ -0,0 +1,358 @@
+#define MYENGINE_LOG_MODULE "vulkan.gpu_profiler"
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+/// Site of the zone covering a whole frame.
+profiling::zone_site_t const FRAME_SITE = {
+  "frame", __FILENAME__, __LINE__, "gpu_profiler::begin_frame" };
+
+double
+to_ms( int64_t ns )
+{
+  return ns / 1e6;
+}
+
+} // namespace
+
+gpu_profiler::gpu_profiler( VkPhysicalDevice physical_device, VkDevice device,
+                            uint32_t queue_family, VkQueue queue,
+                            std::string name,
+                            gpu_profiler_config const& config )
+  : m_device( device ),
+    m_queue_family( queue_family ),
+    m_queue( queue ),
+    m_config( config ),
+    m_period( 1. ),
+    m_valid_bits( 0 ),
+    m_mask( 0 ),
+    m_base_ticks( 0 ),
+    m_base_ns( 0 ),
+    m_track( 0 ),
+    m_slots(),
+    m_current( UINT32_MAX ),
+    m_stack(),
+    m_last_frame(),
+    m_results(),
+    m_totals(),
+    m_summary_frames( 0 ),
+    m_lost_frames( 0 )
+{
+  if( m_config.frames_in_flight == 0 || m_config.max_zones == 0 )
+  {
+    throw std::invalid_argument(
+      "Frames in flight and zones per frame must not be 0" );
+  }
+  auto const& caps = get_device_capabilities( physical_device );
+  m_period = caps.properties.limits.timestampPeriod;
+  m_valid_bits = caps.queue_families.at( queue_family ).timestampValidBits;
+  if( !enabled() )
+  {
+    LOGF_INFO( "Queue family {} has no timestamps; GPU profiling disabled",
+               queue_family );
+    return;
+  }
+  m_mask = m_valid_bits >= 64 ? ~uint64_t( 0 )
+                              : ( uint64_t( 1 ) << m_valid_bits ) - 1;
+  m_results.resize( 2 * m_config.max_zones );
+  try
+  {
+    VkQueryPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = 2 * m_config.max_zones;
+    m_slots.resize( m_config.frames_in_flight, frame_slot() );
+    for( auto& slot : m_slots )
+    {
+      check_result( vkCreateQueryPool( m_device, &pool_info, nullptr,
+                                       &slot.pool ),
+                    "create timestamp query pool" );
+    }
+    calibrate();
+  }
+  catch( ... )
+  {
+    destroy();
+    throw;
+  }
+  m_track = profiling::create_track( std::move( name ) );
+}
+
+gpu_profiler::~gpu_profiler()
+{
+  destroy();
+}
+
+void
+gpu_profiler::destroy()
+{
+  for( auto const& slot : m_slots )
+  {
+    if( slot.pool != VK_NULL_HANDLE )
+    {
+      vkDestroyQueryPool( m_device, slot.pool, nullptr );
+    }
+  }
+  m_slots.clear();
+}
+
+void
+gpu_profiler::calibrate()
+{
+  if( !enabled() )
+  {
+    return;
+  }
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+  VkQueryPool query_pool = VK_NULL_HANDLE;
+  VkFence fence = VK_NULL_HANDLE;
+  auto const cleanup = [ & ]() {
+    vkDestroyFence( m_device, fence, nullptr );
+    vkDestroyQueryPool( m_device, query_pool, nullptr );
+    vkDestroyCommandPool( m_device, command_pool, nullptr );
+  };
+  try
+  {
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = m_queue_family;
+    check_result( vkCreateCommandPool( m_device, &pool_info, nullptr,
+                                       &command_pool ),
+                  "create command pool" );
+    VkQueryPoolCreateInfo query_info = {};
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = 1;
+    check_result( vkCreateQueryPool( m_device, &query_info, nullptr,
+                                     &query_pool ),
+                  "create timestamp query pool" );
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    check_result( vkCreateFence( m_device, &fence_info, nullptr, &fence ),
+                  "create fence" );
+
+    VkCommandBufferAllocateInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = command_pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    check_result( vkAllocateCommandBuffers( m_device, &cmd_info, &cmd ),
+                  "allocate command buffer" );
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    check_result( vkBeginCommandBuffer( cmd, &begin_info ),
+                  "begin command buffer" );
+    vkCmdResetQueryPool( cmd, query_pool, 0, 1 );
+    vkCmdWriteTimestamp( cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool,
+                         0 );
+    check_result( vkEndCommandBuffer( cmd ), "end command buffer" );
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd;
+    // The timestamp is taken somewhere in between.
+    int64_t const before = profiling::detail::now_ns();
+    check_result( vkQueueSubmit( m_queue, 1, &submit_info, fence ),
+                  "submit calibration" );
+    check_result( vkWaitForFences( m_device, 1, &fence, VK_TRUE, UINT64_MAX ),
+                  "wait for calibration" );
+    int64_t const after = profiling::detail::now_ns();
+    uint64_t ticks = 0;
+    check_result( vkGetQueryPoolResults( m_device, query_pool, 0, 1,
+                                         sizeof( ticks ), &ticks,
+                                         sizeof( ticks ),
+                                         VK_QUERY_RESULT_64_BIT |
+                                         VK_QUERY_RESULT_WAIT_BIT ),
+                  "get calibration timestamp" );
+    m_base_ticks = ticks & m_mask;
+    m_base_ns = before + ( after - before ) / 2;
+    LOGF_DEBUG( "GPU clock calibrated to within {} us",
+                ( after - before ) / 2000. );
+  }
+  catch( ... )
+  {
+    cleanup();
+    throw;
+  }
+  cleanup();
+}
+
+int64_t
+gpu_profiler::to_ns( uint64_t ticks ) const
+{
+  // Signed distance from the base, modulo the valid bits.
+  uint64_t const ahead = ( ticks - m_base_ticks ) & m_mask;
+  if( ahead <= m_mask / 2 )
+  {
+    return m_base_ns + static_cast< int64_t >( ahead * m_period );
+  }
+  uint64_t const behind = ( m_base_ticks - ticks ) & m_mask;
+  return m_base_ns - static_cast< int64_t >( behind * m_period );
+}
+
+void
+gpu_profiler::begin_frame( VkCommandBuffer cmd, uint32_t slot )
+{
+  if( slot >= m_config.frames_in_flight )
+  {
+    throw std::invalid_argument( "Frame slot out of range" );
+  }
+  if( !enabled() )
+  {
+    return;
+  }
+  read_back( slot );
+  m_slots[ slot ].zones.clear();
+  vkCmdResetQueryPool( cmd, m_slots[ slot ].pool, 0,
+                       2 * m_config.max_zones );
+  m_current = slot;
+  m_stack.clear();
+  begin_zone( cmd, FRAME_SITE );
+}
+
+void
+gpu_profiler::end_frame( VkCommandBuffer cmd )
+{
+  while( !m_stack.empty() )
+  {
+    end_zone( cmd, m_stack.back() );
+  }
+  m_current = UINT32_MAX;
+}
+
+gpu_profiler::zone_t
+gpu_profiler::begin_zone( VkCommandBuffer cmd,
+                          profiling::zone_site_t const& site )
+{
+  if( m_current == UINT32_MAX )
+  {
+    return INVALID_ZONE;
+  }
+  frame_slot& slot = m_slots[ m_current ];
+  if( slot.zones.size() >= m_config.max_zones )
+  {
+    return INVALID_ZONE;
+  }
+  zone_t const zone = static_cast< zone_t >( slot.zones.size() );
+  slot.zones.push_back(
+    { &site, static_cast< uint32_t >( m_stack.size() ), false } );
+  vkCmdWriteTimestamp( cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.pool,
+                       2 * zone );
+  m_stack.push_back( zone );
+  return zone;
+}
+
+void
+gpu_profiler::end_zone( VkCommandBuffer cmd, zone_t zone )
+{
+  if( zone == INVALID_ZONE || m_current == UINT32_MAX )
+  {
+    return;
+  }
+  frame_slot& slot = m_slots[ m_current ];
+  vkCmdWriteTimestamp( cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot.pool,
+                       2 * zone + 1 );
+  slot.zones[ zone ].ended = true;
+  auto const it = std::find( m_stack.begin(), m_stack.end(), zone );
+  if( it != m_stack.end() )
+  {
+    m_stack.erase( it );
+  }
+}
+
+void
+gpu_profiler::read_back( uint32_t slot )
+{
+  auto const& zones = m_slots[ slot ].zones;
+  if( zones.empty() )
+  {
+    return;
+  }
+  uint32_t const count = static_cast< uint32_t >( 2 * zones.size() );
+  VkResult const res = vkGetQueryPoolResults(
+    m_device, m_slots[ slot ].pool, 0, count, count * sizeof( uint64_t ),
+    m_results.data(), sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT );
+  if( res == VK_NOT_READY )
+  {
+    ++m_lost_frames;
+    return;
+  }
+  check_result( res, "get timestamps" );
+
+  // Unwrap from the frame's begin: frames are read back well within a wrap.
+  uint64_t const frame_ticks = m_results[ 0 ] & m_mask;
+  m_base_ns = to_ns( frame_ticks );
+  m_base_ticks = frame_ticks;
+
+  bool const capturing =
+    profiling::detail::g_capturing.load( std::memory_order_relaxed );
+  m_last_frame.clear();
+  for( std::size_t i = 0; i < zones.size(); ++i )
+  {
+    if( !zones[ i ].ended )
+    {
+      continue;
+    }
+    gpu_zone const z = { zones[ i ].site, zones[ i ].depth,
+                         to_ns( m_results[ 2 * i ] & m_mask ),
+                         to_ns( m_results[ 2 * i + 1 ] & m_mask ) };
+    m_last_frame.push_back( z );
+    if( capturing )
+    {
+      profiling::detail::record_on( m_track, *z.site, z.begin_ns, z.end_ns );
+    }
+    auto total = std::find_if(
+      m_totals.begin(), m_totals.end(),
+      [ & ]( zone_total const& t ) { return t.site == z.site; } );
+    if( total == m_totals.end() )
+    {
+      m_totals.push_back( { z.site, 0 } );
+      total = m_totals.end() - 1;
+    }
+    total->ns += std::max< int64_t >( z.end_ns - z.begin_ns, 0 );
+  }
+  ++m_summary_frames;
+  if( !m_last_frame.empty() )
+  {
+    PROFILE_COUNTER( "gpu frame ms",
+                     to_ms( m_last_frame.front().end_ns -
+                            m_last_frame.front().begin_ns ) );
+  }
+}
+
+void
+gpu_profiler::log_summary()
+{
+  if( m_summary_frames == 0 )
+  {
+    return;
+  }
+  std::stringstream ss;
+  for( auto const& t : m_totals )
+  {
+    ss  << ( &t == &m_totals.front() ? "" : ", " ) << t.site->name << ' '
+        << to_ms( t.ns / static_cast< int64_t >( m_summary_frames ) )
+        << " ms";
+  }
+  LOGF_INFO( "GPU: {} frame(s), {} not ready in time; avg {}",
+             m_summary_frames, m_lost_frames, ss.str() );
+  m_totals.clear();
+  m_summary_frames = 0;
+  m_lost_frames = 0;
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,230 @@
+#ifndef MYENGINE_GPU_PROFILER_H
+#define MYENGINE_GPU_PROFILER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+#include <myengine/profiling.h>
+
+namespace myengine::vulkan {
+
+struct gpu_profiler_config
+{
+  /// Frames the CPU may get ahead of the GPU: each frame slot has its own
+  /// query pool, read back when the slot comes around.
+  uint32_t frames_in_flight = 2;
+  /// Zones per frame, including the frame itself; further ones are dropped.
+  uint32_t max_zones = 256;
+};
+
+/// A zone of a frame, in nanoseconds of the profiling clock.
+struct gpu_zone
+{
+  profiling::zone_site_t const* site;
+  /// Zones it is nested in.
+  uint32_t depth;
+  int64_t begin_ns;
+  int64_t end_ns;
+};
+
+/**
+ * Times regions of command buffers on the GPU with timestamp queries.
+ *
+ *     profiler.begin_frame( cmd, slot );
+ *     {
+ *       GPU_PROFILE_ZONE( profiler, cmd, "shadows" );
+ *       ...
+ *     }
+ *     profiler.end_frame( cmd );
+ *
+ * Each frame slot has a query pool, reset at `begin_frame`, with a pair of
+ * timestamps per zone: at the top of the pipe when it begins, at the bottom
+ * when it ends. The results are read back when the slot comes around, once
+ * the caller waited for the slot's previous frame, so reading them never
+ * blocks; results not yet available are skipped.
+ *
+ * Timestamps are masked to the queue family's `timestampValidBits` and
+ * converted with `timestampPeriod`, then shifted onto the profiling clock
+ * (`profiling::detail::now_ns`) by an offset measured at construction and by
+ * `calibrate`. While a capture runs, zones are recorded on a track of their
+ * own, next to the CPU zones of the same frames in the trace. The frame's GPU
+ * time also goes to the "gpu frame ms" counter.
+ *
+ * Zones must nest, and begin and end in the same command buffer, submitted
+ * to the profiler's queue in the order of the frames. On queue families
+ * without timestamps everything is a no-op.
+ *
+ * Not thread-safe; for the thread recording the frames. Must be destroyed
+ * before the `VkDevice`, once the device is done with the frames.
+ */
+class MYENGINE_EXPORT gpu_profiler
+{
+public:
+  /// Identifies a zone between `begin_zone` and `end_zone`.
+  typedef uint32_t zone_t;
+  static constexpr zone_t INVALID_ZONE = 0xFFFFFFFF;
+
+  /// Ends a zone when it goes out of scope; use through `GPU_PROFILE_ZONE`.
+  class scope
+  {
+  public:
+    scope( gpu_profiler& profiler, VkCommandBuffer cmd,
+           profiling::zone_site_t const& site )
+      : m_profiler( profiler ),
+        m_cmd( cmd ),
+        m_zone( profiler.begin_zone( cmd, site ) )
+    {}
+
+    scope( scope const& ) = delete;
+    scope& operator=( scope const& ) = delete;
+
+    ~scope()
+    {
+      m_profiler.end_zone( m_cmd, m_zone );
+    }
+
+  private:
+    gpu_profiler& m_profiler;
+    VkCommandBuffer m_cmd;
+    zone_t m_zone;
+  };
+
+  /**
+   * @param queue_family Family of `queue`, whose `timestampValidBits` apply.
+   * @param queue Queue the frames are submitted to, also used by `calibrate`.
+   * @param name Name of the track in profiling traces, e.g. "GPU graphics".
+   *
+   * @throws std::runtime_error Failed to create the query pools, or to
+   * calibrate.
+   */
+  gpu_profiler( VkPhysicalDevice physical_device, VkDevice device,
+                uint32_t queue_family, VkQueue queue, std::string name = "GPU",
+                gpu_profiler_config const& config = gpu_profiler_config() );
+
+  gpu_profiler( gpu_profiler const& ) = delete;
+  gpu_profiler& operator=( gpu_profiler const& ) = delete;
+
+  ~gpu_profiler();
+
+  /**
+   * Read back the results of the slot's previous frame, then reset its
+   * queries in `cmd` and begin the frame's zone. The slot's previous frame
+   * must have completed.
+   *
+   * @throws std::invalid_argument `slot` is not below `frames_in_flight`.
+   */
+  void begin_frame( VkCommandBuffer cmd, uint32_t slot );
+
+  /// End the frame's zone, and any zones left open.
+  void end_frame( VkCommandBuffer cmd );
+
+  /// @return `INVALID_ZONE` if the frame has no zones left.
+  zone_t begin_zone( VkCommandBuffer cmd, profiling::zone_site_t const& site );
+
+  void end_zone( VkCommandBuffer cmd, zone_t zone );
+
+  /**
+   * Measure the offset of the GPU clock to the profiling clock again, by
+   * submitting a timestamp and waiting for it. The error is at most half the
+   * round trip, which is logged. Blocks, and must not be called while the
+   * queue is used by another thread.
+   *
+   * @throws std::runtime_error Submission or waiting failed.
+   */
+  void calibrate();
+
+  /// If the queue family supports timestamps at all.
+  [[nodiscard]] bool
+  enabled() const
+  {
+    return m_valid_bits > 0;
+  }
+
+  /// Zones of the most recently read back frame, in order of beginning; the
+  /// first is the frame.
+  [[nodiscard]] std::vector< gpu_zone > const&
+  last_frame() const
+  {
+    return m_last_frame;
+  }
+
+  /// Log the average GPU time of every zone since the last summary, per
+  /// frame, and reset them.
+  void log_summary();
+
+private:
+  /// A zone of the frame being recorded.
+  struct open_zone
+  {
+    profiling::zone_site_t const* site;
+    uint32_t depth;
+    bool ended;
+  };
+
+  struct frame_slot
+  {
+    VkQueryPool pool;
+    /// Zones written into the pool, by query pair.
+    std::vector< open_zone > zones;
+  };
+
+  /// Sums for `log_summary`.
+  struct zone_total
+  {
+    profiling::zone_site_t const* site;
+    int64_t ns;
+  };
+
+  VkDevice m_device;
+  uint32_t m_queue_family;
+  VkQueue m_queue;
+  gpu_profiler_config m_config;
+  /// Nanoseconds per tick.
+  double m_period;
+  uint32_t m_valid_bits;
+  /// `timestampValidBits` ones.
+  uint64_t m_mask;
+  /// A timestamp, and its time on the profiling clock. Advanced with every
+  /// frame read back, so timestamps wrapping around are unwrapped.
+  uint64_t m_base_ticks;
+  int64_t m_base_ns;
+  uint32_t m_track;
+  std::vector< frame_slot > m_slots;
+  /// Slot being recorded, or `UINT32_MAX` outside a frame.
+  uint32_t m_current;
+  /// Zones begun and not ended, innermost last.
+  std::vector< zone_t > m_stack;
+  std::vector< gpu_zone > m_last_frame;
+  std::vector< uint64_t > m_results;
+  std::vector< zone_total > m_totals;
+  uint64_t m_summary_frames;
+  uint64_t m_lost_frames;
+
+  /// Read back the zones of `slot`'s last frame, if any.
+  void read_back( uint32_t slot );
+  /// A timestamp on the profiling clock.
+  [[nodiscard]] int64_t to_ns( uint64_t ticks ) const;
+  void destroy();
+};
+
+} // namespace myengine::vulkan
+
+#if MYENGINE_PROFILING
+/// Time the rest of the enclosing scope of `cmd` on the GPU as a zone named
+/// `name` (a string literal).
+# define GPU_PROFILE_ZONE( profiler, cmd, name )                              \
+  static myengine::profiling::zone_site_t const                               \
+    _PROFILE_CONCAT( _gpu_profile_site_, __LINE__ ) =                         \
+    { name, __FILENAME__, __LINE__, __func__ };                               \
+  myengine::vulkan::gpu_profiler::scope                                       \
+    _PROFILE_CONCAT( _gpu_profile_zone_, __LINE__ )(                          \
+      profiler, cmd, _PROFILE_CONCAT( _gpu_profile_site_, __LINE__ ) )
+#else
+# define GPU_PROFILE_ZONE( profiler, cmd, name ) do {} while( false )
+#endif
+
+#endif //MYENGINE_GPU_PROFILER_H
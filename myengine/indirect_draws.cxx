@@ -0,0 +1,463 @@
+#define MYENGINE_LOG_MODULE "vulkan.indirect_draws"
+#include "indirect_draws.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+constexpr uint32_t WORKGROUP_SIZE = 64;
+
+/// Workgroups per dimension of a dispatch, the minimum every device supports.
+constexpr uint32_t MAX_GROUPS = 65535;
+
+/// The objects are uploaded as they are, see `shaders/cull.comp`.
+static_assert( sizeof( draw_object ) == 32,
+               "draw_object must match the std430 layout of the shader" );
+
+uint32_t const cull_spirv[] =
+#include "shaders/cull.comp.inc"
+;
+
+/// Push constants, see `shaders/cull.comp`.
+struct cull_params
+{
+  float planes[ 6 ][ 4 ];
+  uint32_t object_count;
+};
+
+VkBuffer
+create_buffer( VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage )
+{
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  check_result( vkCreateBuffer( device, &buffer_info, nullptr, &buffer ),
+                "create indirect draw buffer" );
+  return buffer;
+}
+
+} // namespace
+
+bool
+draw_indirect_count_supported( VkPhysicalDevice device )
+{
+  if( get_device_capabilities( device ).properties.apiVersion <
+      VK_API_VERSION_1_2 )
+  {
+    return false;
+  }
+  VkPhysicalDeviceVulkan12Features features_12 = {};
+  features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 features = {};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &features_12;
+  vkGetPhysicalDeviceFeatures2( device, &features );
+  return features_12.drawIndirectCount == VK_TRUE;
+}
+
+indirect_draw_list::indirect_draw_list( VkPhysicalDevice physical_device,
+                                        VkDevice device,
+                                        device_memory_allocator& allocator,
+                                        indirect_draw_config const& config )
+  : m_device( device ),
+    m_allocator( allocator ),
+    m_config( config ),
+    m_max_draw_count( 1 ),
+    m_set_layout( VK_NULL_HANDLE ),
+    m_pool( VK_NULL_HANDLE ),
+    m_layout( VK_NULL_HANDLE ),
+    m_pipeline( VK_NULL_HANDLE ),
+    m_slots(),
+    m_objects( VK_NULL_HANDLE ),
+    m_objects_memory(),
+    m_object_count( 0 )
+{
+  if( m_config.frames_in_flight == 0 )
+  {
+    throw std::invalid_argument( "Frames in flight must not be 0" );
+  }
+  if( m_config.multi_draw_indirect )
+  {
+    m_max_draw_count = std::max(
+      1u, get_device_capabilities( physical_device )
+            .properties.limits.maxDrawIndirectCount );
+  }
+  VkShaderModule shader = VK_NULL_HANDLE;
+  try
+  {
+    VkDescriptorSetLayoutBinding bindings[ 3 ] = {};
+    for( uint32_t i = 0; i < 3; ++i )
+    {
+      bindings[ i ].binding = i;
+      bindings[ i ].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[ i ].descriptorCount = 1;
+      bindings[ i ].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo set_layout_info = {};
+    set_layout_info.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.bindingCount = 3;
+    set_layout_info.pBindings = bindings;
+    check_result( vkCreateDescriptorSetLayout( m_device, &set_layout_info,
+                                               nullptr, &m_set_layout ),
+                  "create descriptor set layout" );
+
+    uint32_t const slot_count = m_config.frames_in_flight;
+    VkDescriptorPoolSize const pool_size = {
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * slot_count };
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = slot_count;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    check_result( vkCreateDescriptorPool( m_device, &pool_info, nullptr,
+                                          &m_pool ),
+                  "create descriptor pool" );
+
+    std::vector< VkDescriptorSetLayout > const layouts( slot_count,
+                                                        m_set_layout );
+    std::vector< VkDescriptorSet > sets( slot_count );
+    VkDescriptorSetAllocateInfo set_info = {};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.descriptorPool = m_pool;
+    set_info.descriptorSetCount = slot_count;
+    set_info.pSetLayouts = layouts.data();
+    check_result( vkAllocateDescriptorSets( m_device, &set_info, sets.data() ),
+                  "allocate descriptor sets" );
+    m_slots.resize( slot_count, frame_slot() );
+    for( uint32_t i = 0; i < slot_count; ++i )
+    {
+      m_slots[ i ].commands = VK_NULL_HANDLE;
+      m_slots[ i ].count = VK_NULL_HANDLE;
+      m_slots[ i ].set = sets[ i ];
+    }
+
+    VkPushConstantRange push_range = {};
+    push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_range.offset = 0;
+    push_range.size = sizeof( cull_params );
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &m_set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_range;
+    check_result( vkCreatePipelineLayout( m_device, &layout_info, nullptr,
+                                          &m_layout ),
+                  "create pipeline layout" );
+
+    VkShaderModuleCreateInfo shader_info = {};
+    shader_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_info.codeSize = sizeof( cull_spirv );
+    shader_info.pCode = cull_spirv;
+    check_result( vkCreateShaderModule( m_device, &shader_info, nullptr,
+                                        &shader ),
+                  "create shader module" );
+
+    VkBool32 const compact = m_config.draw_indirect_count ? VK_TRUE
+                                                          : VK_FALSE;
+    VkSpecializationMapEntry const compact_entry = { 0, 0,
+                                                     sizeof( VkBool32 ) };
+    VkSpecializationInfo specialization = {};
+    specialization.mapEntryCount = 1;
+    specialization.pMapEntries = &compact_entry;
+    specialization.dataSize = sizeof( VkBool32 );
+    specialization.pData = &compact;
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.stage.pSpecializationInfo = &specialization;
+    pipeline_info.layout = m_layout;
+    check_result( vkCreateComputePipelines( m_device, VK_NULL_HANDLE, 1,
+                                            &pipeline_info, nullptr,
+                                            &m_pipeline ),
+                  "create culling pipeline" );
+    vkDestroyShaderModule( m_device, shader, nullptr );
+  }
+  catch( ... )
+  {
+    vkDestroyShaderModule( m_device, shader, nullptr );
+    destroy();
+    throw;
+  }
+  LOGF_INFO( "Indirect draws: {}",
+             m_config.draw_indirect_count
+               ? "compacted, drawn with a count"
+               : m_max_draw_count > 1 ? "multi-draw without a count"
+                                      : "one indirect draw per object" );
+}
+
+indirect_draw_list::~indirect_draw_list()
+{
+  destroy();
+}
+
+void
+indirect_draw_list::destroy_buffers()
+{
+  for( auto& slot : m_slots )
+  {
+    vkDestroyBuffer( m_device, slot.commands, nullptr );
+    m_allocator.free( slot.commands_memory );
+    vkDestroyBuffer( m_device, slot.count, nullptr );
+    m_allocator.free( slot.count_memory );
+    slot.commands = VK_NULL_HANDLE;
+    slot.commands_memory = memory_allocation();
+    slot.count = VK_NULL_HANDLE;
+    slot.count_memory = memory_allocation();
+  }
+  vkDestroyBuffer( m_device, m_objects, nullptr );
+  m_allocator.free( m_objects_memory );
+  m_objects = VK_NULL_HANDLE;
+  m_objects_memory = memory_allocation();
+  m_object_count = 0;
+}
+
+void
+indirect_draw_list::destroy()
+{
+  destroy_buffers();
+  // Sets are freed with their pool.
+  m_slots.clear();
+  if( m_pipeline != VK_NULL_HANDLE )
+  {
+    vkDestroyPipeline( m_device, m_pipeline, nullptr );
+    m_pipeline = VK_NULL_HANDLE;
+  }
+  if( m_layout != VK_NULL_HANDLE )
+  {
+    vkDestroyPipelineLayout( m_device, m_layout, nullptr );
+    m_layout = VK_NULL_HANDLE;
+  }
+  if( m_pool != VK_NULL_HANDLE )
+  {
+    vkDestroyDescriptorPool( m_device, m_pool, nullptr );
+    m_pool = VK_NULL_HANDLE;
+  }
+  if( m_set_layout != VK_NULL_HANDLE )
+  {
+    vkDestroyDescriptorSetLayout( m_device, m_set_layout, nullptr );
+    m_set_layout = VK_NULL_HANDLE;
+  }
+}
+
+void
+indirect_draw_list::upload( upload_ring& ring,
+                            std::vector< draw_object > const& objects )
+{
+  destroy_buffers();
+  if( objects.empty() )
+  {
+    return;
+  }
+  try
+  {
+    VkDeviceSize const objects_size =
+      objects.size() * sizeof( draw_object );
+    m_objects = create_buffer( m_device, objects_size,
+                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT );
+    m_objects_memory = m_allocator.allocate_buffer(
+      m_objects, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+
+    VkDeviceSize const commands_size =
+      objects.size() * sizeof( VkDrawIndexedIndirectCommand );
+    for( auto& slot : m_slots )
+    {
+      slot.commands = create_buffer( m_device, commands_size,
+                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                       VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT );
+      slot.commands_memory = m_allocator.allocate_buffer(
+        slot.commands, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+      // Read by the host for `visible_count`; a single word, so where it
+      // lives does not matter to the GPU.
+      slot.count = create_buffer( m_device, sizeof( uint32_t ),
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_TRANSFER_DST_BIT );
+      slot.count_memory = m_allocator.allocate_buffer(
+        slot.count, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+      *static_cast< uint32_t* >( slot.count_memory.mapped ) = 0;
+
+      VkDescriptorBufferInfo const buffer_infos[ 3 ] = {
+        { m_objects, 0, VK_WHOLE_SIZE },
+        { slot.commands, 0, VK_WHOLE_SIZE },
+        { slot.count, 0, VK_WHOLE_SIZE } };
+      VkWriteDescriptorSet writes[ 3 ] = {};
+      for( uint32_t i = 0; i < 3; ++i )
+      {
+        writes[ i ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[ i ].dstSet = slot.set;
+        writes[ i ].dstBinding = i;
+        writes[ i ].descriptorCount = 1;
+        writes[ i ].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[ i ].pBufferInfo = &buffer_infos[ i ];
+      }
+      vkUpdateDescriptorSets( m_device, 3, writes, 0, nullptr );
+    }
+
+    // In pieces of at most half the ring, so a large scene streams through
+    // it instead of not fitting.
+    std::size_t const chunk = std::max< std::size_t >(
+      1, ring.capacity() / 2 / sizeof( draw_object ) );
+    for( std::size_t first = 0; first < objects.size(); first += chunk )
+    {
+      std::size_t const count = std::min( chunk, objects.size() - first );
+      ring.upload( m_objects, first * sizeof( draw_object ),
+                   &objects[ first ], count * sizeof( draw_object ) );
+    }
+  }
+  catch( ... )
+  {
+    destroy_buffers();
+    throw;
+  }
+  m_object_count = static_cast< uint32_t >( objects.size() );
+}
+
+void
+indirect_draw_list::cull( VkCommandBuffer cmd, uint32_t slot,
+                          float const planes[ 6 ][ 4 ] )
+{
+  if( slot >= m_slots.size() )
+  {
+    throw std::invalid_argument( "Frame slot out of range" );
+  }
+  if( m_object_count == 0 )
+  {
+    return;
+  }
+  frame_slot const& s = m_slots[ slot ];
+  vkCmdFillBuffer( cmd, s.count, 0, sizeof( uint32_t ), 0 );
+  VkMemoryBarrier reset_barrier = {};
+  reset_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  reset_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  reset_barrier.dstAccessMask =
+    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier( cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                        &reset_barrier, 0, nullptr, 0, nullptr );
+
+  cull_params params;
+  std::copy_n( &planes[ 0 ][ 0 ], 6 * 4, &params.planes[ 0 ][ 0 ] );
+  params.object_count = m_object_count;
+  vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline );
+  vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_layout, 0,
+                           1, &s.set, 0, nullptr );
+  vkCmdPushConstants( cmd, m_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                      sizeof( cull_params ), &params );
+  uint32_t const groups =
+    ( m_object_count + WORKGROUP_SIZE - 1 ) / WORKGROUP_SIZE;
+  uint32_t const groups_x = std::min( groups, MAX_GROUPS );
+  vkCmdDispatch( cmd, groups_x, ( groups + groups_x - 1 ) / groups_x, 1 );
+
+  // The commands and the count for drawing, and the count for the host once
+  // the frame has completed.
+  VkMemoryBarrier draw_barrier = {};
+  draw_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  draw_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  draw_barrier.dstAccessMask =
+    VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier( cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                          VK_PIPELINE_STAGE_HOST_BIT,
+                        0, 1, &draw_barrier, 0, nullptr, 0, nullptr );
+}
+
+uint32_t
+indirect_draw_list::draw( VkCommandBuffer cmd, uint32_t slot )
+{
+  if( slot >= m_slots.size() )
+  {
+    throw std::invalid_argument( "Frame slot out of range" );
+  }
+  if( m_object_count == 0 )
+  {
+    return 0;
+  }
+  frame_slot const& s = m_slots[ slot ];
+  uint32_t const stride = sizeof( VkDrawIndexedIndirectCommand );
+  if( m_config.draw_indirect_count )
+  {
+    vkCmdDrawIndexedIndirectCount( cmd, s.commands, 0, s.count, 0,
+                                   m_object_count, stride );
+    return 1;
+  }
+  uint32_t calls = 0;
+  for( uint32_t first = 0; first < m_object_count; first += m_max_draw_count )
+  {
+    uint32_t const count = std::min( m_max_draw_count,
+                                     m_object_count - first );
+    vkCmdDrawIndexedIndirect( cmd, s.commands, VkDeviceSize( first ) * stride,
+                              count, stride );
+    ++calls;
+  }
+  return calls;
+}
+
+uint32_t
+indirect_draw_list::visible_count( uint32_t slot ) const
+{
+  if( slot >= m_slots.size() )
+  {
+    throw std::invalid_argument( "Frame slot out of range" );
+  }
+  if( m_object_count == 0 )
+  {
+    return 0;
+  }
+  return *static_cast< uint32_t const* >( m_slots[ slot ].count_memory.mapped );
+}
+
+void
+indirect_draw_list::frustum_planes( float const view_proj[ 16 ],
+                                    float planes[ 6 ][ 4 ] )
+{
+  // Gribb and Hartmann: with clip = M p, the frustum is -w <= x <= w,
+  // -w <= y <= w and 0 <= z <= w, each a plane through a sum of rows of M.
+  auto const row = [ view_proj ]( int r, int c ) {
+    return view_proj[ c * 4 + r ];
+  };
+  for( int c = 0; c < 4; ++c )
+  {
+    planes[ 0 ][ c ] = row( 3, c ) + row( 0, c );
+    planes[ 1 ][ c ] = row( 3, c ) - row( 0, c );
+    planes[ 2 ][ c ] = row( 3, c ) + row( 1, c );
+    planes[ 3 ][ c ] = row( 3, c ) - row( 1, c );
+    planes[ 4 ][ c ] = row( 2, c );
+    planes[ 5 ][ c ] = row( 3, c ) - row( 2, c );
+  }
+  for( int p = 0; p < 6; ++p )
+  {
+    float const length =
+      std::sqrt( planes[ p ][ 0 ] * planes[ p ][ 0 ] +
+                 planes[ p ][ 1 ] * planes[ p ][ 1 ] +
+                 planes[ p ][ 2 ] * planes[ p ][ 2 ] );
+    if( length > 0.f )
+    {
+      for( int c = 0; c < 4; ++c )
+      {
+        planes[ p ][ c ] /= length;
+      }
+    }
+  }
+}
+
+} // namespace myengine::vulkan
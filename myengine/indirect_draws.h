@@ -0,0 +1,187 @@
+#ifndef MYENGINE_INDIRECT_DRAWS_H
+#define MYENGINE_INDIRECT_DRAWS_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/memory_allocator.h>
+#include <myengine/myengine_export.h>
+#include <myengine/upload_ring.h>
+
+namespace myengine::vulkan {
+
+/**
+ * If the device supports `drawIndirectCount` (Vulkan 1.2), which
+ * `indirect_draw_config::draw_indirect_count` needs enabled on the
+ * `VkDevice`.
+ */
+[[nodiscard]] bool MYENGINE_EXPORT
+draw_indirect_count_supported( VkPhysicalDevice device );
+
+/// An object of the scene: its bounding sphere and indexed draw.
+struct draw_object
+{
+  /// Bounding sphere in world space.
+  float center[ 3 ];
+  float radius;
+  uint32_t index_count;
+  uint32_t first_index;
+  int32_t vertex_offset;
+  /// Passed on as is; shaders typically index per object data with
+  /// `gl_InstanceIndex`. Must be 0 unless `drawIndirectFirstInstance` is
+  /// enabled.
+  uint32_t first_instance;
+};
+
+struct indirect_draw_config
+{
+  /// Frames the CPU may get ahead of the GPU; each has its own draw commands.
+  uint32_t frames_in_flight = 2;
+  /// Compact the visible objects and draw them with one
+  /// `vkCmdDrawIndexedIndirectCount`; needs `drawIndirectCount` enabled.
+  bool draw_indirect_count = false;
+  /// Without `draw_indirect_count`: draw many commands per
+  /// `vkCmdDrawIndexedIndirect`; needs `multiDrawIndirect` enabled.
+  bool multi_draw_indirect = false;
+};
+
+/**
+ * GPU-driven drawing of a scene of objects, culled against the view frustum
+ * by a compute shader instead of the CPU.
+ *
+ *     list.upload( ring, objects );
+ *     ...
+ *     list.cull( cmd, slot, planes );  // outside the render pass
+ *     vkCmdBeginRenderPass( cmd, ... );
+ *     // bind the pipeline, index buffer and descriptors
+ *     list.draw( cmd, slot );
+ *
+ * The objects are uploaded once to a device-local storage buffer. Each frame,
+ * `cull` tests their bounding spheres against the frustum planes and writes a
+ * `VkDrawIndexedIndirectCommand` per visible object into the slot's command
+ * buffer, and `draw` draws them. With `draw_indirect_count`, the commands are
+ * compacted and counted on the GPU, and the whole scene takes one draw call.
+ * Without it, every object keeps its command, with no instance when culled,
+ * and they are drawn `maxDrawIndirectCount` at a time with
+ * `multi_draw_indirect`, or one call each otherwise; the CPU still records no
+ * per object state.
+ *
+ * Not thread-safe; for the thread recording the frames. Must be destroyed
+ * before the allocator and the `VkDevice`, once the device is done with the
+ * frames.
+ */
+class MYENGINE_EXPORT indirect_draw_list
+{
+public:
+  /**
+   * @throws std::runtime_error Failed to create the culling pipeline.
+   * @throws std::invalid_argument `frames_in_flight` is 0.
+   */
+  indirect_draw_list( VkPhysicalDevice physical_device, VkDevice device,
+                      device_memory_allocator& allocator,
+                      indirect_draw_config const& config =
+                        indirect_draw_config() );
+
+  indirect_draw_list( indirect_draw_list const& ) = delete;
+  indirect_draw_list& operator=( indirect_draw_list const& ) = delete;
+
+  ~indirect_draw_list();
+
+  /**
+   * Replace the objects, staging them with `ring`. The copies are visible to
+   * later commands on the ring's queue once its batch is submitted; the
+   * device must be done with the previous objects.
+   *
+   * @throws std::runtime_error Failed to create the buffers, or to stage.
+   */
+  void upload( upload_ring& ring, std::vector< draw_object > const& objects );
+
+  /**
+   * Record culling the objects into the slot's draw commands, outside of a
+   * render pass instance. The slot's previous frame must have completed.
+   *
+   * @param planes Frustum planes `(a, b, c, d)`, inside where
+   * `a x + b y + c z + d >= 0`, with `(a, b, c)` normalized; see
+   * `frustum_planes`.
+   *
+   * @throws std::invalid_argument `slot` is not below `frames_in_flight`.
+   */
+  void cull( VkCommandBuffer cmd, uint32_t slot, float const planes[ 6 ][ 4 ] );
+
+  /**
+   * Record drawing the slot's culled objects, with the pipeline and index
+   * buffer bound by the caller.
+   *
+   * @return Draw calls recorded.
+   */
+  uint32_t draw( VkCommandBuffer cmd, uint32_t slot );
+
+  /// Objects that passed culling in the slot's last frame, which must have
+  /// completed.
+  [[nodiscard]] uint32_t visible_count( uint32_t slot ) const;
+
+  [[nodiscard]] uint32_t
+  object_count() const
+  {
+    return m_object_count;
+  }
+
+  /**
+   * Storage buffer of the objects, for shaders to read, as an array of
+   *
+   *     struct object { vec4 sphere; uint index_count; uint first_index;
+   *                     int vertex_offset; uint first_instance; };
+   *
+   * Null before `upload`.
+   */
+  [[nodiscard]] VkBuffer
+  object_buffer() const
+  {
+    return m_objects;
+  }
+
+  /**
+   * The planes of the frustum of a Vulkan clip space transform (depth in
+   * [0, 1]), for `cull`.
+   *
+   * @param view_proj Column-major, as glm's.
+   */
+  static void frustum_planes( float const view_proj[ 16 ],
+                              float planes[ 6 ][ 4 ] );
+
+private:
+  struct frame_slot
+  {
+    /// `VkDrawIndexedIndirectCommand` per object.
+    VkBuffer commands;
+    memory_allocation commands_memory;
+    /// Visible objects, host-visible.
+    VkBuffer count;
+    memory_allocation count_memory;
+    VkDescriptorSet set;
+  };
+
+  VkDevice m_device;
+  device_memory_allocator& m_allocator;
+  indirect_draw_config m_config;
+  /// Commands per `vkCmdDrawIndexedIndirect` without a count.
+  uint32_t m_max_draw_count;
+  VkDescriptorSetLayout m_set_layout;
+  VkDescriptorPool m_pool;
+  VkPipelineLayout m_layout;
+  VkPipeline m_pipeline;
+  std::vector< frame_slot > m_slots;
+  VkBuffer m_objects;
+  memory_allocation m_objects_memory;
+  uint32_t m_object_count;
+
+  /// Free the object and per slot buffers.
+  void destroy_buffers();
+  void destroy();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_INDIRECT_DRAWS_H
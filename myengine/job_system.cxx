@@ -0,0 +1,740 @@
+#define MYENGINE_LOG_MODULE "job_system"
+#include "job_system.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif
+# include <windows.h>
+#elif defined( __linux__ )
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+
+namespace myengine {
+
+namespace detail {
+
+struct job
+{
+  job_system::job_fn fn;
+  job_counter* counter;
+  bool main_thread;
+};
+
+} // namespace detail
+
+namespace {
+
+/// Idle rounds, each yielding the thread, before going to sleep.
+constexpr int SPIN_ROUNDS = 64;
+
+/**
+ * Nesting of `wait` calls beyond which a waiting thread only runs jobs from
+ * its own deque. Those were spawned by the jobs on its stack, while running
+ * stolen or injected jobs, which may wait in turn, could grow the stack
+ * without bound.
+ */
+constexpr uint32_t MAX_STEAL_DEPTH = 16;
+
+/// Initial capacity of a worker's deque; it grows as needed.
+constexpr int64_t DEQUE_CAPACITY = 256;
+
+/**
+ * Chase-Lev work-stealing deque of jobs, with the C11 memory orderings of
+ * Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models"
+ * (PPoPP 2013).
+ *
+ * Only the owner pushes and pops, at the bottom; any thread steals, from the
+ * top. The ring grows when full; old rings are kept until destruction, since
+ * a thief may still be reading one.
+ */
+class work_stealing_deque
+{
+public:
+  work_stealing_deque()
+    : m_top( 0 ),
+      m_bottom( 0 ),
+      m_ring( nullptr ),
+      m_rings()
+  {
+    m_rings.push_back( std::make_unique< ring >( DEQUE_CAPACITY ) );
+    m_ring.store( m_rings.back().get(), std::memory_order_relaxed );
+  }
+
+  void
+  push( detail::job* j )
+  {
+    int64_t const b = m_bottom.load( std::memory_order_relaxed );
+    int64_t const t = m_top.load( std::memory_order_acquire );
+    ring* r = m_ring.load( std::memory_order_relaxed );
+    if( b - t > r->mask )
+    {
+      r = grow( r, t, b );
+    }
+    r->put( b, j );
+    // A release store rather than the paper's release fence: the same on
+    // common hardware, and visible to thread sanitizers.
+    m_bottom.store( b + 1, std::memory_order_release );
+  }
+
+  detail::job*
+  pop()
+  {
+    int64_t const b = m_bottom.load( std::memory_order_relaxed ) - 1;
+    ring* r = m_ring.load( std::memory_order_relaxed );
+    m_bottom.store( b, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    int64_t t = m_top.load( std::memory_order_relaxed );
+    if( t > b )
+    {
+      // Empty.
+      m_bottom.store( b + 1, std::memory_order_relaxed );
+      return nullptr;
+    }
+    detail::job* j = r->get( b );
+    if( t == b )
+    {
+      // The last one: race thieves for it.
+      if( !m_top.compare_exchange_strong( t, t + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed ) )
+      {
+        j = nullptr;
+      }
+      m_bottom.store( b + 1, std::memory_order_relaxed );
+    }
+    return j;
+  }
+
+  /// Null when empty, or when another thread won the race for the top job.
+  detail::job*
+  steal()
+  {
+    int64_t t = m_top.load( std::memory_order_acquire );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    int64_t const b = m_bottom.load( std::memory_order_acquire );
+    if( t >= b )
+    {
+      return nullptr;
+    }
+    ring* r = m_ring.load( std::memory_order_acquire );
+    detail::job* j = r->get( t );
+    if( !m_top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed ) )
+    {
+      return nullptr;
+    }
+    return j;
+  }
+
+  /// May be stale, for skipping victims cheaply.
+  [[nodiscard]] bool
+  maybe_empty() const
+  {
+    return m_bottom.load( std::memory_order_relaxed ) <=
+           m_top.load( std::memory_order_relaxed );
+  }
+
+private:
+  struct ring
+  {
+    int64_t mask;
+    std::unique_ptr< std::atomic< detail::job* >[] > slots;
+
+    explicit ring( int64_t capacity )
+      : mask( capacity - 1 ),
+        slots( new std::atomic< detail::job* >[ capacity ] )
+    {}
+
+    detail::job*
+    get( int64_t i ) const
+    {
+      return slots[ i & mask ].load( std::memory_order_relaxed );
+    }
+
+    void
+    put( int64_t i, detail::job* j )
+    {
+      slots[ i & mask ].store( j, std::memory_order_relaxed );
+    }
+  };
+
+  alignas( 64 ) std::atomic< int64_t > m_top;
+  alignas( 64 ) std::atomic< int64_t > m_bottom;
+  std::atomic< ring* > m_ring;
+  /// Every ring allocated, the current one last. Owner only.
+  std::vector< std::unique_ptr< ring > > m_rings;
+
+  ring*
+  grow( ring* r, int64_t t, int64_t b )
+  {
+    auto bigger = std::make_unique< ring >( ( r->mask + 1 ) * 2 );
+    for( int64_t i = t; i < b; ++i )
+    {
+      bigger->put( i, r->get( i ) );
+    }
+    m_rings.push_back( std::move( bigger ) );
+    ring* const next = m_rings.back().get();
+    m_ring.store( next, std::memory_order_release );
+    return next;
+  }
+};
+
+/// Pin the calling thread to a logical core. False if not supported here.
+bool
+pin_current_thread( uint32_t core )
+{
+#ifdef _WIN32
+  if( core >= sizeof( DWORD_PTR ) * 8 )
+  {
+    return false;
+  }
+  return SetThreadAffinityMask( GetCurrentThread(),
+                                DWORD_PTR( 1 ) << core ) != 0;
+#elif defined( __linux__ )
+  if( core >= CPU_SETSIZE )
+  {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  CPU_SET( core, &set );
+  return pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) == 0;
+#else
+  (void) core;
+  return false;
+#endif
+}
+
+} // namespace
+
+namespace detail {
+
+/// State of one worker thread.
+struct alignas( 64 ) job_worker
+{
+  job_system const* owner;
+  uint32_t index;
+  /// xorshift32 state, for picking victims.
+  uint32_t rng;
+  work_stealing_deque deque;
+  // Written by the worker only.
+  std::atomic< uint64_t > executed{ 0 };
+  std::atomic< uint64_t > stolen{ 0 };
+  std::atomic< uint64_t > sleeps{ 0 };
+};
+
+} // namespace detail
+
+namespace {
+
+/// The worker the current thread is, if any.
+thread_local detail::job_worker* t_worker = nullptr;
+
+/// `job_system::wait` calls on the current thread's stack.
+thread_local uint32_t t_wait_depth = 0;
+
+/// Relaxed increment of a counter only its owning thread writes.
+void
+bump( std::atomic< uint64_t >& value )
+{
+  value.store( value.load( std::memory_order_relaxed ) + 1,
+               std::memory_order_relaxed );
+}
+
+} // namespace
+
+job_system::job_system( job_system_config const& config )
+  : m_config( config ),
+    m_main_thread( std::this_thread::get_id() ),
+    m_workers(),
+    m_threads(),
+    m_inject_mutex(),
+    m_injected(),
+    m_injected_count( 0 ),
+    m_main_mutex(),
+    m_main_jobs(),
+    m_main_count( 0 ),
+    m_sleep_mutex(),
+    m_sleep_cv(),
+    m_epoch( 0 ),
+    m_sleepers( 0 ),
+    m_limited_sleepers( 0 ),
+    m_stop( false ),
+    m_external_executed( 0 )
+{
+  uint32_t const hardware =
+    std::max( 1u, std::thread::hardware_concurrency() );
+  if( m_config.workers == 0 )
+  {
+    m_config.workers = std::max( 1u, hardware - 1 );
+  }
+  if( m_config.affinity != thread_affinity::none &&
+      m_config.workers + 1 > hardware )
+  {
+    LOGF_WARN( "Not pinning {} worker(s) and the main thread to {} core(s)",
+               m_config.workers, hardware );
+    m_config.affinity = thread_affinity::none;
+  }
+  if( m_config.affinity == thread_affinity::pin_all &&
+      !pin_current_thread( 0 ) )
+  {
+    LOGF_WARN( "Failed to pin the main thread" );
+  }
+
+  for( uint32_t i = 0; i < m_config.workers; ++i )
+  {
+    m_workers.push_back( std::make_unique< detail::job_worker >() );
+    m_workers.back()->owner = this;
+    m_workers.back()->index = i;
+    m_workers.back()->rng = 0x9E3779B9u * ( i + 1 );
+  }
+  for( uint32_t i = 0; i < m_config.workers; ++i )
+  {
+    m_threads.emplace_back( &job_system::work, this, i );
+  }
+
+  LOGF_INFO( "Job system with {} worker(s){}", m_config.workers,
+             m_config.affinity == thread_affinity::none ? "" : ", pinned" );
+}
+
+job_system::~job_system()
+{
+  m_stop.store( true, std::memory_order_seq_cst );
+  notify( true );
+  for( auto& t : m_threads )
+  {
+    t.join();
+  }
+
+  // Drop what was never run.
+  for( auto& w : m_workers )
+  {
+    while( detail::job* j = w->deque.steal() )
+    {
+      delete j;
+    }
+  }
+  for( detail::job* j : m_injected )
+  {
+    delete j;
+  }
+  for( detail::job* j : m_main_jobs )
+  {
+    delete j;
+  }
+}
+
+void
+job_system::spawn( job_fn fn, job_counter* counter )
+{
+  if( counter )
+  {
+    counter->m_pending.fetch_add( 1, std::memory_order_relaxed );
+  }
+  schedule( new detail::job{ std::move( fn ), counter, false } );
+}
+
+void
+job_system::spawn_after( job_counter& dependency, job_fn fn,
+                         job_counter* counter )
+{
+  if( counter )
+  {
+    counter->m_pending.fetch_add( 1, std::memory_order_relaxed );
+  }
+  auto* j = new detail::job{ std::move( fn ), counter, false };
+  {
+    // `finish` takes the last count down under the lock, so this either sees
+    // zero or queues before the continuations are taken.
+    std::lock_guard< std::mutex > lock( dependency.m_mutex );
+    if( dependency.m_pending.load( std::memory_order_acquire ) != 0 )
+    {
+      dependency.m_continuations.push_back( j );
+      return;
+    }
+  }
+  schedule( j );
+}
+
+void
+job_system::spawn_main( job_fn fn, job_counter* counter )
+{
+  if( counter )
+  {
+    counter->m_pending.fetch_add( 1, std::memory_order_relaxed );
+  }
+  schedule( new detail::job{ std::move( fn ), counter, true } );
+}
+
+std::size_t
+job_system::run_main_thread_jobs()
+{
+  PROFILE_FUNCTION();
+  std::deque< detail::job* > jobs;
+  {
+    std::lock_guard< std::mutex > lock( m_main_mutex );
+    jobs.swap( m_main_jobs );
+    m_main_count.store( 0, std::memory_order_relaxed );
+  }
+  for( detail::job* j : jobs )
+  {
+    execute( j );
+  }
+  m_external_executed.fetch_add( jobs.size(), std::memory_order_relaxed );
+  return jobs.size();
+}
+
+void
+job_system::wait( job_counter& counter )
+{
+  PROFILE_FUNCTION();
+  detail::job_worker* const self =
+    t_worker && t_worker->owner == this ? t_worker : nullptr;
+  bool const main_thread = std::this_thread::get_id() == m_main_thread;
+  bool const foreign = t_wait_depth < MAX_STEAL_DEPTH;
+  ++t_wait_depth;
+  int idle = 0;
+  while( !counter.done() )
+  {
+    uint64_t const epoch = m_epoch.load( std::memory_order_seq_cst );
+    if( detail::job* j = find_job( self, main_thread, foreign ) )
+    {
+      execute( j );
+      if( self )
+      {
+        bump( self->executed );
+      }
+      else
+      {
+        m_external_executed.fetch_add( 1, std::memory_order_relaxed );
+      }
+      idle = 0;
+      continue;
+    }
+    if( ++idle < SPIN_ROUNDS )
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    std::unique_lock< std::mutex > lock( m_sleep_mutex );
+    if( !foreign )
+    {
+      m_limited_sleepers.fetch_add( 1, std::memory_order_seq_cst );
+    }
+    m_sleepers.fetch_add( 1, std::memory_order_seq_cst );
+    m_sleep_cv.wait( lock, [ & ] {
+      return counter.done() ||
+             m_epoch.load( std::memory_order_seq_cst ) != epoch;
+    } );
+    m_sleepers.fetch_sub( 1, std::memory_order_relaxed );
+    if( !foreign )
+    {
+      m_limited_sleepers.fetch_sub( 1, std::memory_order_relaxed );
+    }
+  }
+  --t_wait_depth;
+  // The finishing job may still hold the lock after taking the count to zero.
+  std::lock_guard< std::mutex > lock( counter.m_mutex );
+}
+
+void
+job_system::parallel_for( uint32_t count, uint32_t grain, range_fn const& fn )
+{
+  if( count == 0 )
+  {
+    return;
+  }
+  job_counter counter;
+  split( 0, count, std::max( 1u, grain ), fn, counter );
+  wait( counter );
+}
+
+uint32_t
+job_system::thread_index() const
+{
+  if( t_worker && t_worker->owner == this )
+  {
+    return t_worker->index;
+  }
+  if( std::this_thread::get_id() == m_main_thread )
+  {
+    return worker_count();
+  }
+  return INVALID_THREAD;
+}
+
+job_system_stats
+job_system::stats() const
+{
+  job_system_stats s = {};
+  s.executed = m_external_executed.load( std::memory_order_relaxed );
+  for( auto const& w : m_workers )
+  {
+    s.executed += w->executed.load( std::memory_order_relaxed );
+    s.stolen += w->stolen.load( std::memory_order_relaxed );
+    s.sleeps += w->sleeps.load( std::memory_order_relaxed );
+  }
+  return s;
+}
+
+void
+job_system::schedule( detail::job* j )
+{
+  if( j->main_thread )
+  {
+    {
+      std::lock_guard< std::mutex > lock( m_main_mutex );
+      m_main_jobs.push_back( j );
+      m_main_count.fetch_add( 1, std::memory_order_relaxed );
+    }
+    // The main thread may be among the sleepers.
+    notify( true );
+    return;
+  }
+  if( t_worker && t_worker->owner == this )
+  {
+    t_worker->deque.push( j );
+  }
+  else
+  {
+    std::lock_guard< std::mutex > lock( m_inject_mutex );
+    m_injected.push_back( j );
+    m_injected_count.fetch_add( 1, std::memory_order_relaxed );
+  }
+  notify( false );
+}
+
+void
+job_system::execute( detail::job* j ) noexcept
+{
+  j->fn();
+  if( j->counter )
+  {
+    finish( *j->counter );
+  }
+  delete j;
+}
+
+void
+job_system::finish( job_counter& counter )
+{
+  uint32_t n = counter.m_pending.load( std::memory_order_relaxed );
+  for( ;; )
+  {
+    if( n > 1 )
+    {
+      if( counter.m_pending.compare_exchange_weak(
+            n, n - 1, std::memory_order_acq_rel,
+            std::memory_order_relaxed ) )
+      {
+        return;
+      }
+      continue;
+    }
+
+    // The last job: reach zero under the lock, taking the continuations with
+    // it, so that neither `spawn_after` nor `wait` can get in between.
+    std::vector< detail::job* > ready;
+    {
+      std::lock_guard< std::mutex > lock( counter.m_mutex );
+      if( !counter.m_pending.compare_exchange_strong(
+            n, n - 1, std::memory_order_acq_rel,
+            std::memory_order_relaxed ) )
+      {
+        continue;
+      }
+      ready.swap( counter.m_continuations );
+    }
+    // The counter may be gone from here on.
+    for( detail::job* j : ready )
+    {
+      schedule( j );
+    }
+    notify( true );
+    return;
+  }
+}
+
+detail::job*
+job_system::find_job( detail::job_worker* self, bool main_thread,
+                      bool foreign )
+{
+  if( self )
+  {
+    if( detail::job* j = self->deque.pop() )
+    {
+      return j;
+    }
+  }
+  if( !foreign )
+  {
+    return nullptr;
+  }
+  if( main_thread && m_main_count.load( std::memory_order_relaxed ) > 0 )
+  {
+    std::lock_guard< std::mutex > lock( m_main_mutex );
+    if( !m_main_jobs.empty() )
+    {
+      detail::job* j = m_main_jobs.front();
+      m_main_jobs.pop_front();
+      m_main_count.fetch_sub( 1, std::memory_order_relaxed );
+      return j;
+    }
+  }
+  if( detail::job* j = take_injected() )
+  {
+    return j;
+  }
+  return steal( self );
+}
+
+detail::job*
+job_system::take_injected()
+{
+  if( m_injected_count.load( std::memory_order_relaxed ) == 0 )
+  {
+    return nullptr;
+  }
+  std::lock_guard< std::mutex > lock( m_inject_mutex );
+  if( m_injected.empty() )
+  {
+    return nullptr;
+  }
+  detail::job* j = m_injected.front();
+  m_injected.pop_front();
+  m_injected_count.fetch_sub( 1, std::memory_order_relaxed );
+  return j;
+}
+
+detail::job*
+job_system::steal( detail::job_worker* self )
+{
+  std::size_t const n = m_workers.size();
+  if( n == 0 )
+  {
+    return nullptr;
+  }
+  // Start at a random victim so thieves spread out.
+  std::size_t start = 0;
+  if( self )
+  {
+    uint32_t& x = self->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    start = x % n;
+  }
+  for( std::size_t i = 0; i < n; ++i )
+  {
+    detail::job_worker& victim = *m_workers[ ( start + i ) % n ];
+    if( &victim == self || victim.deque.maybe_empty() )
+    {
+      continue;
+    }
+    if( detail::job* j = victim.deque.steal() )
+    {
+      if( self )
+      {
+        bump( self->stolen );
+      }
+      return j;
+    }
+  }
+  return nullptr;
+}
+
+void
+job_system::notify( bool all )
+{
+  // Pairs with the sleepers' increment of `m_sleepers` before they check the
+  // epoch: either they see the new epoch, or this sees them.
+  m_epoch.fetch_add( 1, std::memory_order_seq_cst );
+  if( m_sleepers.load( std::memory_order_seq_cst ) == 0 )
+  {
+    return;
+  }
+  // A single wakeup could land on a sleeper that cannot run the new job.
+  all = all || m_limited_sleepers.load( std::memory_order_seq_cst ) > 0;
+  {
+    // A sleeper between checking and waiting holds the mutex.
+    std::lock_guard< std::mutex > lock( m_sleep_mutex );
+  }
+  if( all )
+  {
+    m_sleep_cv.notify_all();
+  }
+  else
+  {
+    m_sleep_cv.notify_one();
+  }
+}
+
+void
+job_system::work( uint32_t index )
+{
+  detail::job_worker* const self = m_workers[ index ].get();
+  t_worker = self;
+  profiling::set_thread_name( "job_worker " + std::to_string( index ) );
+  if( m_config.affinity != thread_affinity::none &&
+      !pin_current_thread( index + 1 ) )
+  {
+    LOGF_WARN( "Failed to pin job worker {}", index );
+  }
+
+  int idle = 0;
+  while( !m_stop.load( std::memory_order_relaxed ) )
+  {
+    uint64_t const epoch = m_epoch.load( std::memory_order_seq_cst );
+    if( detail::job* j = find_job( self, false, true ) )
+    {
+      execute( j );
+      bump( self->executed );
+      idle = 0;
+      continue;
+    }
+    if( ++idle < SPIN_ROUNDS )
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    std::unique_lock< std::mutex > lock( m_sleep_mutex );
+    m_sleepers.fetch_add( 1, std::memory_order_seq_cst );
+    m_sleep_cv.wait( lock, [ & ] {
+      return m_stop.load( std::memory_order_relaxed ) ||
+             m_epoch.load( std::memory_order_seq_cst ) != epoch;
+    } );
+    m_sleepers.fetch_sub( 1, std::memory_order_relaxed );
+    bump( self->sleeps );
+    idle = 0;
+  }
+  t_worker = nullptr;
+}
+
+void
+job_system::split( uint32_t begin, uint32_t end, uint32_t grain,
+                   range_fn const& fn, job_counter& counter )
+{
+  // Hand off the upper halves and keep the lowest piece, so the pieces left
+  // for thieves at the top of the deque are the largest.
+  while( end - begin > grain )
+  {
+    uint32_t const mid = begin + ( end - begin ) / 2;
+    spawn( [ this, mid, end, grain, &fn, &counter ] {
+             split( mid, end, grain, fn, counter );
+           },
+           &counter );
+    end = mid;
+  }
+  fn( begin, end );
+}
+
+} // namespace myengine
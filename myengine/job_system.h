@@ -0,0 +1,246 @@
+#ifndef MYENGINE_JOB_SYSTEM_H
+#define MYENGINE_JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine {
+
+namespace detail {
+
+struct job;
+struct job_worker;
+
+} // namespace detail
+
+enum class thread_affinity
+{
+  /// Leave scheduling to the OS.
+  none,
+  /// Pin worker `i` to logical core `i + 1`, leaving core 0 to the main
+  /// thread.
+  pin_workers,
+  /// `pin_workers`, and pin the main thread to core 0.
+  pin_all,
+};
+
+struct job_system_config
+{
+  /// Worker threads, besides the main thread. 0 for one less than the number
+  /// of hardware threads.
+  uint32_t workers = 0;
+  /// Pinning is best effort: where it is not supported, or there are fewer
+  /// cores than threads, it is skipped with a warning.
+  thread_affinity affinity = thread_affinity::none;
+};
+
+/// Totals since construction.
+struct job_system_stats
+{
+  uint64_t executed;
+  /// Jobs a worker took from another worker's deque.
+  uint64_t stolen;
+  /// Times a worker went to sleep for lack of work.
+  uint64_t sleeps;
+};
+
+/**
+ * Counts unfinished jobs, for waiting on them and for starting dependent
+ * jobs once they are all done.
+ *
+ * A job spawned with a counter increments it right away and decrements it
+ * when it has run. A counter may be reused once it reaches zero, and must
+ * outlive the jobs counted by and waiting on it.
+ */
+class MYENGINE_EXPORT job_counter
+{
+public:
+  job_counter()
+    : m_pending( 0 ),
+      m_mutex(),
+      m_continuations()
+  {}
+
+  job_counter( job_counter const& ) = delete;
+  job_counter& operator=( job_counter const& ) = delete;
+
+  /// Polling only; wait with `job_system::wait` before destroying the
+  /// counter, so that the job finishing it is done with it.
+  [[nodiscard]] bool
+  done() const
+  {
+    return m_pending.load( std::memory_order_acquire ) == 0;
+  }
+
+private:
+  friend class job_system;
+
+  std::atomic< uint32_t > m_pending;
+  /// Guards `m_continuations`, and the transition to zero with respect to it.
+  std::mutex m_mutex;
+  /// Jobs to schedule when `m_pending` reaches zero.
+  std::vector< detail::job* > m_continuations;
+};
+
+/**
+ * Work-stealing job scheduler.
+ *
+ * Every worker thread owns a Chase-Lev deque: it pushes and pops jobs it
+ * spawns at the bottom, last in first out for locality, while idle workers
+ * steal the oldest jobs from the top of others' deques. Jobs spawned from
+ * other threads go into a shared injection queue. Workers with nothing to
+ * run or steal sleep until more jobs are spawned.
+ *
+ * The thread constructing the system is the main thread. Jobs spawned with
+ * `spawn_main` only ever run there: from `run_main_thread_jobs`, which the
+ * main loop calls, or while the main thread waits. This is for APIs such as
+ * GLFW that must be called from the main thread.
+ *
+ * Jobs must not throw; an exception escaping a job terminates the program,
+ * as with `std::thread`. Waiting is only for the main thread and workers; any
+ * thread may spawn.
+ *
+ * Must be destroyed on the main thread, once no jobs are left to run.
+ */
+class MYENGINE_EXPORT job_system
+{
+public:
+  typedef std::function< void () > job_fn;
+  typedef std::function< void ( uint32_t begin, uint32_t end ) > range_fn;
+
+  /// No worker or main thread.
+  static constexpr uint32_t INVALID_THREAD = 0xFFFFFFFF;
+
+  explicit job_system( job_system_config const& config = job_system_config() );
+
+  job_system( job_system const& ) = delete;
+  job_system& operator=( job_system const& ) = delete;
+
+  /// Stops and joins the workers. Jobs not yet run are dropped.
+  ~job_system();
+
+  /**
+   * Run `fn` on any thread.
+   *
+   * @param counter Incremented now and decremented once `fn` has run, or
+   * null.
+   */
+  void spawn( job_fn fn, job_counter* counter = nullptr );
+
+  /// Run `fn` on any thread once `dependency` has reached zero; right away if
+  /// it already has.
+  void spawn_after( job_counter& dependency, job_fn fn,
+                    job_counter* counter = nullptr );
+
+  /// Run `fn` on the main thread, see `run_main_thread_jobs`.
+  void spawn_main( job_fn fn, job_counter* counter = nullptr );
+
+  /**
+   * Run the jobs queued for the main thread so far. Call on the main thread,
+   * e.g. once per frame.
+   *
+   * @return Jobs run.
+   */
+  std::size_t run_main_thread_jobs();
+
+  /**
+   * Wait for `counter` to reach zero, running other jobs meanwhile, including
+   * main thread jobs when on the main thread.
+   *
+   * Waits nested deeply within jobs run by waits only run jobs that the
+   * waiting thread spawned itself, to bound the stack depth.
+   */
+  void wait( job_counter& counter );
+
+  /**
+   * Call `fn` on subranges of [0, count) of at most `grain` items, in
+   * parallel, and wait for all of them.
+   *
+   * The range is split in halves recursively, so that thieves take large
+   * pieces of work at a time.
+   */
+  void parallel_for( uint32_t count, uint32_t grain, range_fn const& fn );
+
+  [[nodiscard]] uint32_t
+  worker_count() const
+  {
+    return static_cast< uint32_t >( m_workers.size() );
+  }
+
+  /**
+   * Index of the calling thread: `i` for worker `i` of this system,
+   * `worker_count()` for the main thread, otherwise `INVALID_THREAD`.
+   *
+   * Dense, for indexing per-thread state such as command pools.
+   */
+  [[nodiscard]] uint32_t thread_index() const;
+
+  [[nodiscard]] job_system_stats stats() const;
+
+private:
+  job_system_config m_config;
+  std::thread::id m_main_thread;
+  std::vector< std::unique_ptr< detail::job_worker > > m_workers;
+  std::vector< std::thread > m_threads;
+
+  /// Jobs spawned from threads without a deque.
+  std::mutex m_inject_mutex;
+  std::deque< detail::job* > m_injected;
+  std::atomic< std::size_t > m_injected_count;
+
+  std::mutex m_main_mutex;
+  std::deque< detail::job* > m_main_jobs;
+  std::atomic< std::size_t > m_main_count;
+
+  // Sleeping. `m_epoch` changes whenever there may be new work, or a counter
+  // reaches zero.
+  std::mutex m_sleep_mutex;
+  std::condition_variable m_sleep_cv;
+  std::atomic< uint64_t > m_epoch;
+  std::atomic< uint32_t > m_sleepers;
+  /// Sleepers nested too deep in `wait` to run anything but their own jobs.
+  std::atomic< uint32_t > m_limited_sleepers;
+  std::atomic< bool > m_stop;
+
+  /// Executed on the main and other non-worker threads.
+  std::atomic< uint64_t > m_external_executed;
+
+  void schedule( detail::job* j );
+  /// Run `j` and complete its counter. Terminates if the job throws.
+  void execute( detail::job* j ) noexcept;
+  void finish( job_counter& counter );
+  /**
+   * Take a job for the calling thread to run, or null.
+   *
+   * @param foreign Also main thread (if `main_thread`), injected and stolen
+   * jobs, not just the ones in the thread's own deque.
+   */
+  detail::job* find_job( detail::job_worker* self, bool main_thread,
+                         bool foreign );
+  detail::job* take_injected();
+  detail::job* steal( detail::job_worker* self );
+  /**
+   * Wake sleepers after making work available.
+   *
+   * @param all Wake every sleeper rather than one. Implied while a sleeper
+   * is past `MAX_STEAL_DEPTH`, since it could take the one wakeup without
+   * being able to run the new job.
+   */
+  void notify( bool all );
+  void work( uint32_t index );
+  void split( uint32_t begin, uint32_t end, uint32_t grain,
+              range_fn const& fn, job_counter& counter );
+};
+
+} // namespace myengine
+
+#endif //MYENGINE_JOB_SYSTEM_H
@@ -0,0 +1,483 @@
+#define MYENGINE_LOG_MODULE "logging"
+#include "log_binary.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace myengine::logging {
+
+namespace {
+
+/// Site ids are process-wide so they stay unique if the writer is replaced.
+std::atomic< uint32_t > g_next_site_id{ 1 };
+
+/// Read a trivially copyable value from a possibly unaligned position.
+template< typename T >
+T
+read_at( uint8_t const* p )
+{
+  T v;
+  memcpy( &v, p, sizeof( T ) );
+  return v;
+}
+
+/// Append the text rendering of the packed argument at `p`, advancing `p`.
+/// Returns false if the data is malformed or truncated.
+bool
+render_arg( char const*& p, char const* end, std::string& out )
+{
+  if( p >= end )
+  {
+    return false;
+  }
+  auto tag = static_cast< arg_tag >( *p++ );
+  auto need = [ & ]( std::size_t n ) {
+                return static_cast< std::size_t >( end - p ) >= n;
+              };
+  char buf[ 32 ];
+  int n = 0;
+  switch( tag )
+  {
+    case arg_tag::int64:
+    {
+      if( !need( 8 ) ) return false;
+      n = snprintf( buf, sizeof( buf ), "%lld",
+                    (long long) read_at< int64_t >( (uint8_t const*) p ) );
+      p += 8;
+      break;
+    }
+    case arg_tag::uint64:
+    {
+      if( !need( 8 ) ) return false;
+      n = snprintf( buf, sizeof( buf ), "%llu",
+                    (unsigned long long) read_at< uint64_t >(
+                      (uint8_t const*) p ) );
+      p += 8;
+      break;
+    }
+    case arg_tag::float64:
+    {
+      if( !need( 8 ) ) return false;
+      n = snprintf( buf, sizeof( buf ), "%g",
+                    read_at< double >( (uint8_t const*) p ) );
+      p += 8;
+      break;
+    }
+    case arg_tag::boolean:
+    {
+      if( !need( 1 ) ) return false;
+      out.append( *p ? "true" : "false" );
+      p += 1;
+      return true;
+    }
+    case arg_tag::character:
+    {
+      if( !need( 1 ) ) return false;
+      out.push_back( *p );
+      p += 1;
+      return true;
+    }
+    case arg_tag::string:
+    {
+      if( !need( 2 ) ) return false;
+      auto len = read_at< uint16_t >( (uint8_t const*) p );
+      p += 2;
+      if( !need( len ) ) return false;
+      out.append( p, len );
+      p += len;
+      return true;
+    }
+    case arg_tag::pointer:
+    {
+      if( !need( 8 ) ) return false;
+      n = snprintf( buf, sizeof( buf ), "0x%llx",
+                    (unsigned long long) read_at< uint64_t >(
+                      (uint8_t const*) p ) );
+      p += 8;
+      break;
+    }
+    default:
+      return false;
+  }
+  out.append( buf, n );
+  return true;
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// Text rendering
+
+void
+format_elapsed( int64_t nanoseconds, char* buf, std::size_t size )
+{
+  auto micro = nanoseconds % 1000000000 / 1000, // microseconds truncation
+       seconds = nanoseconds / 1000000000,      // total seconds
+       hours = seconds / 3600,                  // hours truncation
+       minutes = seconds % 3600 / 60;           // minutes truncation
+
+  // seconds is assigned above to *total* seconds, this is the truncation to
+  // the seconds slice of the time.
+  seconds = seconds % 3600 % 60;
+
+  snprintf( buf, size, "%04lld:%02lld:%02lld.%06lld", (long long) hours,
+            (long long) minutes, (long long) seconds, (long long) micro );
+}
+
+char const*
+level_tag( level lvl )
+{
+  switch( lvl )
+  {
+    case level::debug: return "[DEBUG]";
+    case level::info:  return "[ INFO]";
+    case level::warn:  return "[ WARN]";
+    case level::error: return "[ERROR]";
+    case level::off:   break;
+  }
+  return "[?????]";
+}
+
+void
+render_packed( std::string_view fmt, char const* data, std::size_t len,
+               std::string& out )
+{
+  char const* p = data;
+  char const* end = data + len;
+  bool args_ok = true;
+  for( std::size_t i = 0; i < fmt.size(); ++i )
+  {
+    char c = fmt[ i ];
+    if( ( c == '{' || c == '}' ) && i + 1 < fmt.size() && fmt[ i + 1 ] == c )
+    {
+      // Escaped brace.
+      out.push_back( c );
+      ++i;
+    }
+    else if( c == '{' && i + 1 < fmt.size() && fmt[ i + 1 ] == '}' )
+    {
+      if( !args_ok || !( args_ok = render_arg( p, end, out ) ) )
+      {
+        out.append( "{}" );
+      }
+      ++i;
+    }
+    else
+    {
+      out.push_back( c );
+    }
+  }
+  while( args_ok && p < end )
+  {
+    out.push_back( ' ' );
+    args_ok = render_arg( p, end, out );
+  }
+}
+
+void
+append_text_line( std::string& out, level lvl, int64_t elapsed_ns,
+                  std::string_view file, int line, std::string_view func,
+                  char const* fmt, std::size_t fmt_len,
+                  char const* data, std::size_t len )
+{
+  char time_buf[ 32 ];
+  format_elapsed( elapsed_ns, time_buf, sizeof( time_buf ) );
+  char line_buf[ 16 ];
+  int line_len = snprintf( line_buf, sizeof( line_buf ), "%d", line );
+
+  out.append( level_tag( lvl ) );
+  out.append( " [" );
+  out.append( time_buf );
+  out.append( "] " );
+  out.append( file );
+  out.push_back( '(' );
+  out.append( line_buf, line_len );
+  out.append( ")[" );
+  out.append( func );
+  out.append( "] " );
+  if( fmt )
+  {
+    render_packed( std::string_view( fmt, fmt_len ), data, len, out );
+  }
+  else
+  {
+    out.append( data, len );
+  }
+  out.push_back( '\n' );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writer
+
+binary_log_writer::binary_log_writer( std::string path_prefix,
+                                      std::size_t segment_bytes,
+                                      uint32_t max_segments )
+  : m_prefix( std::move( path_prefix ) ),
+    m_segment_bytes( segment_bytes ),
+    m_max_segments( max_segments ),
+    m_segment_index( 0 ),
+    m_file(),
+    m_offset( 0 ),
+    m_defined()
+{
+  if( m_segment_bytes < sizeof( binary_file_header ) + 1024 )
+  {
+    throw std::runtime_error( "Binary log segment size is too small." );
+  }
+  open_segment();
+}
+
+binary_log_writer::~binary_log_writer()
+{
+  close_segment();
+}
+
+std::string
+binary_log_writer::segment_path( uint32_t index ) const
+{
+  char buf[ 16 ];
+  snprintf( buf, sizeof( buf ), ".%06u.mlog", index );
+  return m_prefix + buf;
+}
+
+void
+binary_log_writer::open_segment()
+{
+  m_file = mapped_file::create( segment_path( m_segment_index ),
+                                m_segment_bytes );
+  m_offset = 0;
+  m_defined.assign( m_defined.size(), false );
+
+  binary_file_header h = {};
+  memcpy( h.magic, BINARY_MAGIC, sizeof( h.magic ) );
+  h.version = BINARY_VERSION;
+  h.byte_order = BINARY_BYTE_ORDER;
+  h.segment_index = m_segment_index;
+  h.tick_num = static_cast< uint32_t >( steady_clock_t::period::num );
+  h.tick_den = static_cast< uint32_t >( steady_clock_t::period::den );
+  h.epoch_ticks = epoch().time_since_epoch().count();
+  write( &h, sizeof( h ) );
+
+  if( m_max_segments > 0 && m_segment_index >= m_max_segments )
+  {
+    std::remove( segment_path( m_segment_index - m_max_segments ).c_str() );
+  }
+}
+
+void
+binary_log_writer::close_segment()
+{
+  if( m_file.is_open() )
+  {
+    m_file.close( m_offset );
+  }
+}
+
+void
+binary_log_writer::write( void const* p, std::size_t n )
+{
+  memcpy( m_file.data() + m_offset, p, n );
+  m_offset += n;
+}
+
+bool
+binary_log_writer::append( site_t& site, steady_clock_t::time_point time,
+                           char const* data, std::size_t len )
+{
+  if( site.id == 0 )
+  {
+    site.id = g_next_site_id.fetch_add( 1, std::memory_order_relaxed );
+  }
+  if( site.id >= m_defined.size() )
+  {
+    m_defined.resize( site.id + 1, false );
+  }
+
+  auto file_len = static_cast< uint16_t >( strlen( site.file ) );
+  auto func_len = static_cast< uint16_t >( strlen( site.func ) );
+  auto fmt_len = static_cast< uint16_t >( site.fmt ? strlen( site.fmt ) : 0 );
+  std::size_t site_size = sizeof( binary_record_header ) +
+                          sizeof( binary_record_site ) +
+                          file_len + func_len + fmt_len;
+  std::size_t event_size = sizeof( binary_record_header ) +
+                           sizeof( binary_record_event ) + len;
+
+  std::size_t need = event_size + ( m_defined[ site.id ] ? 0 : site_size );
+  if( !m_file.is_open() || m_offset + need > m_file.size() )
+  {
+    if( sizeof( binary_file_header ) + site_size + event_size >
+        m_segment_bytes )
+    {
+      return false;
+    }
+    close_segment();
+    ++m_segment_index;
+    try
+    {
+      open_segment();
+    }
+    catch( std::exception const& ex )
+    {
+      // Can't log about the logger from inside the logger.
+      fprintf( stderr, "Failed to rotate binary log segment: %s\n",
+               ex.what() );
+      return false;
+    }
+  }
+
+  if( !m_defined[ site.id ] )
+  {
+    binary_record_header rh = { binary_record_type::site, 0,
+                                static_cast< uint16_t >(
+                                  site_size - sizeof( rh ) ) };
+    binary_record_site rs = {};
+    rs.id = site.id;
+    rs.line = static_cast< uint32_t >( site.line );
+    rs.lvl = static_cast< uint8_t >( site.lvl );
+    rs.flags = site.fmt ? SITE_FLAG_PACKED : 0;
+    rs.file_len = file_len;
+    rs.func_len = func_len;
+    rs.fmt_len = fmt_len;
+    write( &rh, sizeof( rh ) );
+    write( &rs, sizeof( rs ) );
+    write( site.file, file_len );
+    write( site.func, func_len );
+    if( fmt_len )
+    {
+      write( site.fmt, fmt_len );
+    }
+    m_defined[ site.id ] = true;
+  }
+
+  binary_record_header rh = { binary_record_type::event, 0,
+                              static_cast< uint16_t >(
+                                event_size - sizeof( rh ) ) };
+  binary_record_event re = {};
+  re.id = site.id;
+  re.ticks = time.time_since_epoch().count();
+  write( &rh, sizeof( rh ) );
+  write( &re, sizeof( re ) );
+  write( data, len );
+  return true;
+}
+
+void
+binary_log_writer::flush( bool wait )
+{
+  m_file.flush( wait );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decoder
+
+std::size_t
+decode_binary_log( std::string const& path, std::ostream& out )
+{
+  auto file = mapped_file::open_read( path );
+  uint8_t const* base = file.data();
+  std::size_t size = file.size();
+
+  if( size < sizeof( binary_file_header ) )
+  {
+    throw std::runtime_error( "Not a binary log (too small): " + path );
+  }
+  auto header = read_at< binary_file_header >( base );
+  if( memcmp( header.magic, BINARY_MAGIC, sizeof( header.magic ) ) != 0 )
+  {
+    throw std::runtime_error( "Not a binary log (bad magic): " + path );
+  }
+  if( header.byte_order != BINARY_BYTE_ORDER )
+  {
+    throw std::runtime_error( "Binary log byte order mismatch: " + path );
+  }
+  if( header.version != BINARY_VERSION )
+  {
+    std::stringstream ss;
+    ss  << "Unsupported binary log version " << header.version << ": "
+        << path;
+    throw std::runtime_error( ss.str() );
+  }
+
+  // Nanoseconds per tick of the producing clock.
+  long double const ns_per_tick =
+    1e9L * header.tick_num / ( header.tick_den ? header.tick_den : 1 );
+
+  struct decoded_site
+  {
+    level lvl;
+    uint32_t line;
+    bool packed;
+    std::string_view file, func, fmt;
+  };
+  std::unordered_map< uint32_t, decoded_site > sites;
+
+  std::string text;
+  std::size_t count = 0;
+  std::size_t off = sizeof( binary_file_header );
+  while( off + sizeof( binary_record_header ) <= size )
+  {
+    auto rh = read_at< binary_record_header >( base + off );
+    if( rh.type == binary_record_type::end )
+    {
+      break;
+    }
+    off += sizeof( rh );
+    if( off + rh.size > size )
+    {
+      // Truncated tail, e.g. the producer died mid-write. Keep what we have.
+      break;
+    }
+    uint8_t const* body = base + off;
+    off += rh.size;
+
+    if( rh.type == binary_record_type::site &&
+        rh.size >= sizeof( binary_record_site ) )
+    {
+      auto rs = read_at< binary_record_site >( body );
+      if( sizeof( rs ) + rs.file_len + rs.func_len + rs.fmt_len > rh.size )
+      {
+        continue;
+      }
+      auto strs = reinterpret_cast< char const* >( body + sizeof( rs ) );
+      decoded_site ds;
+      ds.lvl = static_cast< level >( rs.lvl );
+      ds.line = rs.line;
+      ds.packed = ( rs.flags & SITE_FLAG_PACKED ) != 0;
+      ds.file = std::string_view( strs, rs.file_len );
+      ds.func = std::string_view( strs + rs.file_len, rs.func_len );
+      ds.fmt = std::string_view( strs + rs.file_len + rs.func_len,
+                                 rs.fmt_len );
+      sites[ rs.id ] = ds;
+    }
+    else if( rh.type == binary_record_type::event &&
+             rh.size >= sizeof( binary_record_event ) )
+    {
+      auto re = read_at< binary_record_event >( body );
+      auto it = sites.find( re.id );
+      if( it == sites.end() )
+      {
+        continue;
+      }
+      decoded_site const& ds = it->second;
+      auto elapsed_ns = static_cast< int64_t >(
+        ( re.ticks - header.epoch_ticks ) * ns_per_tick );
+      auto payload = reinterpret_cast< char const* >( body + sizeof( re ) );
+      text.clear();
+      append_text_line( text, ds.lvl, elapsed_ns, ds.file,
+                        static_cast< int >( ds.line ), ds.func,
+                        ds.packed ? ds.fmt.data() : nullptr, ds.fmt.size(),
+                        payload, rh.size - sizeof( re ) );
+      out << text;
+      ++count;
+    }
+    // Unknown record types are skipped for forward compatibility.
+  }
+  return count;
+}
+
+} // namespace myengine::logging
@@ -0,0 +1,226 @@
+/**
+ * Binary log output format, its writer, and the shared text rendering.
+ *
+ * A binary log is a sequence of segment files. Every segment starts with a
+ * `binary_file_header` followed by records, each a `binary_record_header`
+ * plus `size` bytes of body:
+ *
+ *   - `site` records describe a call site once per segment: id, line, level,
+ *     flags, then the file, function and format strings (not terminated).
+ *   - `event` records are one log call: site id, raw `steady_clock` tick
+ *     count, then the payload. For sites with `SITE_FLAG_PACKED` the payload
+ *     is `arg_tag`-prefixed values to substitute into the format string,
+ *     otherwise it is the already rendered message text.
+ *
+ * A zero record type (or the end of the file) ends a segment. Each segment is
+ * self-contained so any one of them can be decoded without the others.
+ * Everything is written in host byte order; `byte_order` in the header lets a
+ * reader detect a mismatch.
+ */
+
+#ifndef MYENGINE_LOG_BINARY_H
+#define MYENGINE_LOG_BINARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <myengine/logging.h>
+#include <myengine/mapped_file.h>
+#include <myengine/myengine_export.h>
+
+namespace myengine::logging {
+
+/// First bytes of every segment file.
+constexpr char BINARY_MAGIC[ 8 ] = { 'M', 'Y', 'E', 'L', 'O', 'G', 'B', 'N' };
+
+/// Current format version.
+constexpr uint32_t BINARY_VERSION = 1;
+
+/// Value of `binary_file_header::byte_order` as written by the producer.
+constexpr uint32_t BINARY_BYTE_ORDER = 0x01020304;
+
+/// Segment `binary_record_site::flags` bit: the site has a format string and
+/// its event payloads are packed arguments.
+constexpr uint8_t SITE_FLAG_PACKED = 0x1;
+
+#pragma pack( push, 1 )
+
+/// Header at the start of every segment file.
+struct binary_file_header
+{
+  char magic[ 8 ];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t segment_index;
+  /// `steady_clock_t::period` of the producer: seconds per tick is num/den.
+  uint32_t tick_num;
+  uint32_t tick_den;
+  uint32_t reserved;
+  /// Tick count of `logging::epoch()`, which text timestamps are relative to.
+  int64_t epoch_ticks;
+};
+
+enum class binary_record_type : uint8_t
+{
+  end = 0,
+  site = 1,
+  event = 2,
+};
+
+/// Precedes every record in a segment.
+struct binary_record_header
+{
+  binary_record_type type;
+  uint8_t reserved;
+  /// Size in bytes of the record body following this header.
+  uint16_t size;
+};
+
+/// Fixed part of a `site` record body, followed by the strings.
+struct binary_record_site
+{
+  uint32_t id;
+  uint32_t line;
+  uint8_t lvl;
+  uint8_t flags;
+  uint16_t file_len;
+  uint16_t func_len;
+  uint16_t fmt_len;
+};
+
+/// Fixed part of an `event` record body, followed by the payload.
+struct binary_record_event
+{
+  uint32_t id;
+  int64_t ticks;
+};
+
+#pragma pack( pop )
+
+static_assert( sizeof( binary_file_header ) == 40, "unexpected padding" );
+static_assert( sizeof( binary_record_header ) == 4, "unexpected padding" );
+static_assert( sizeof( binary_record_site ) == 16, "unexpected padding" );
+static_assert( sizeof( binary_record_event ) == 12, "unexpected padding" );
+
+/**
+ * Writer of rotating, memory-mapped binary log segments.
+ *
+ * Not thread-safe; the logging backend only uses it from its (serialized)
+ * drain.
+ */
+class MYENGINE_EXPORT binary_log_writer
+{
+public:
+  /**
+   * Create the writer and its first segment.
+   *
+   * @param path_prefix Segment files are named
+   * `<path_prefix>.<NNNNNN>.mlog`.
+   * @param segment_bytes Mapped size of each segment.
+   * @param max_segments Keep only this many most recent segment files, 0 to
+   * keep all of them.
+   *
+   * @throws std::runtime_error Failed to create the first segment.
+   */
+  binary_log_writer( std::string path_prefix, std::size_t segment_bytes,
+                     uint32_t max_segments );
+
+  binary_log_writer( binary_log_writer const& ) = delete;
+  binary_log_writer& operator=( binary_log_writer const& ) = delete;
+
+  ~binary_log_writer();
+
+  /**
+   * Append an event for the given site, preceded by the site's description if
+   * it is not yet in the current segment. Rotates to a new segment when the
+   * current one is full.
+   *
+   * @return False if the record was not written: it cannot fit in an empty
+   * segment, or a new segment could not be created.
+   */
+  bool append( site_t& site, steady_clock_t::time_point time, char const* data,
+               std::size_t len );
+
+  /// Schedule (or with `wait`, complete) write-back of the current segment.
+  void flush( bool wait );
+
+private:
+  std::string m_prefix;
+  std::size_t m_segment_bytes;
+  uint32_t m_max_segments;
+  uint32_t m_segment_index;
+  mapped_file m_file;
+  std::size_t m_offset;
+  // Indexed by site id: if the site was described in the current segment.
+  std::vector< bool > m_defined;
+
+  [[nodiscard]] std::string segment_path( uint32_t index ) const;
+  void open_segment();
+  void close_segment();
+  void write( void const* p, std::size_t n );
+};
+
+/**
+ * Format elapsed nanoseconds as "HHHH:MM:SS.DDDDDD".
+ *
+ * @param nanoseconds Time elapsed.
+ * @param buf Output buffer, should be at least 32 bytes.
+ * @param size Size of `buf`.
+ */
+void
+MYENGINE_EXPORT
+format_elapsed( int64_t nanoseconds, char* buf, std::size_t size );
+
+/// Fixed-width level tag, e.g. "[ INFO]".
+char const*
+MYENGINE_EXPORT
+level_tag( level lvl );
+
+/**
+ * Render a `{}`-style format string with packed arguments.
+ *
+ * Each `{}` is replaced by the next argument; `{{` and `}}` are literal
+ * braces. Placeholders without an argument are kept as-is, surplus arguments
+ * are appended space separated.
+ */
+void
+MYENGINE_EXPORT
+render_packed( std::string_view fmt, char const* data, std::size_t len,
+               std::string& out );
+
+/**
+ * Append one record as a line of text in the
+ * `[LEVEL] [HHHH:MM:SS.DDDDDD] file(line)[func] message` format.
+ *
+ * @param fmt Format string for packed payloads, or null if `data` is already
+ * the message text.
+ */
+void
+MYENGINE_EXPORT
+append_text_line( std::string& out, level lvl, int64_t elapsed_ns,
+                  std::string_view file, int line, std::string_view func,
+                  char const* fmt, std::size_t fmt_len,
+                  char const* data, std::size_t len );
+
+/**
+ * Decode one binary log segment file to text.
+ *
+ * @param path Segment file to decode.
+ * @param out Stream to write text lines to.
+ *
+ * @throws std::runtime_error The file cannot be read or is not a binary log
+ * segment this version understands.
+ *
+ * @return Number of events decoded.
+ */
+std::size_t
+MYENGINE_EXPORT
+decode_binary_log( std::string const& path, std::ostream& out );
+
+} // namespace myengine::logging
+
+#endif //MYENGINE_LOG_BINARY_H
@@ -2,37 +2,937 @@
 // Distributed under the OSI-approved Apache 2.0 License.
 // See top-level LICENSE file details.
 
+#define MYENGINE_LOG_MODULE "logging"
 #include "logging.h"
+#include "log_binary.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <cerrno>
+# include <unistd.h>
+#endif
 
 namespace myengine::logging {
 
-std::string
-now_str()
+namespace {
+
+static_assert( ( QUEUE_CAPACITY & ( QUEUE_CAPACITY - 1 ) ) == 0,
+               "QUEUE_CAPACITY must be a power of two" );
+
+/// How long the flusher thread waits between drains while records keep coming.
+/// After a drain that found nothing, it sleeps until woken instead.
+constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds( 2 );
+
+/// Formatted bytes to accumulate before handing a batch to `fwrite`.
+constexpr std::size_t BATCH_BYTES = 64 * 1024;
+
+/// Segment size used when binary output is enabled from the environment.
+constexpr std::size_t DEFAULT_SEGMENT_BYTES = 64 * 1024 * 1024;
+
+/// Formatted bytes of the longest line: a whole message plus the prefix.
+constexpr std::size_t MAX_LINE_BYTES = MAX_MESSAGE_SIZE + 4096;
+
+/// One log record, or a piece of one, as it sits in the queue.
+struct record_t
+{
+  site_t* site;
+  steady_clock_t::time_point time;
+  uint16_t len;
+  /// If the message continues in the next cell.
+  bool continued;
+  /// Message text for `LOG_*` sites, packed arguments for `LOGF_*` sites.
+  char text[ RECORD_TEXT_SIZE ];
+};
+
+/// Queue cell: a record plus the sequence number used to hand it between
+/// producers and the consumer.
+struct cell_t
+{
+  std::atomic< std::size_t > sequence;
+  record_t rec;
+};
+
+static_assert( MAX_MESSAGE_SIZE <= UINT16_MAX - sizeof( binary_record_event ),
+               "a message must fit in a binary event record" );
+static_assert( MAX_MESSAGE_SIZE / RECORD_TEXT_SIZE < QUEUE_CAPACITY / 4,
+               "a message must only take a fraction of the queue" );
+
+/// Per-thread formatting state of `detail::record_stream`.
+struct thread_stream_t
+{
+  char text[ MAX_MESSAGE_SIZE ];
+  detail::bounded_streambuf buf{ text, sizeof( text ) };
+  std::ostream os{ &buf };
+  /// `record_stream`s using this one: more than 1 means nested records.
+  int depth = 0;
+};
+
+thread_local thread_stream_t t_stream;
+
+/// Nanoseconds from `epoch()` to `t`.
+int64_t
+elapsed_ns( steady_clock_t::time_point t )
+{
+  return std::chrono::duration_cast< std::chrono::nanoseconds >(
+    t - epoch() ).count();
+}
+
+/// Append the text rendering of a record, with a trailing newline, to `out`.
+void
+format_record( site_t const& site, steady_clock_t::time_point time,
+               char const* text, std::size_t len, std::string& out )
+{
+  append_text_line( out, site.lvl, elapsed_ns( time ), site.file, site.line,
+                    site.func, site.fmt, site.fmt ? strlen( site.fmt ) : 0,
+                    text, len );
+}
+
+/// Write all of `data` to the standard error file descriptor, bypassing
+/// stdio, which is not async-signal-safe.
+void
+write_stderr_raw( char const* data, std::size_t size )
+{
+  while( size > 0 )
+  {
+#ifdef _WIN32
+    int const n = _write( 2, data, static_cast< unsigned >( size ) );
+#else
+    ssize_t const n = ::write( STDERR_FILENO, data, size );
+    if( n < 0 && errno == EINTR )
+    {
+      continue;
+    }
+#endif
+    if( n <= 0 )
+    {
+      return;
+    }
+    data += n;
+    size -= static_cast< std::size_t >( n );
+  }
+}
+
+/// If the calling thread holds the backend's drain lock. A crash handler
+/// running on that thread must not try to take it again.
+thread_local bool t_draining = false;
+
+/**
+ * The asynchronous logging backend.
+ *
+ * Records go through a bounded multi-producer queue (D. Vyukov's bounded MPMC
+ * design: each cell carries a sequence number so producers claim cells with a
+ * single CAS and never lock). Consumption is serialized by `m_drain_mutex`,
+ * so the flusher thread, `flush()` callers and crash handlers can all drain.
+ * It is only taken through `drain_lock`, which tracks the owning thread.
+ *
+ * Messages too long for a queue cell are pushed as pieces in consecutive
+ * cells, claimed with one CAS, which the consumer joins back.
+ *
+ * The flusher thread drains every `FLUSH_INTERVAL` while there is something to
+ * drain, and otherwise sleeps until a producer wakes it. Producers only wake it
+ * when it is asleep, so a steady stream of records costs them no system calls.
+ */
+class backend
+{
+public:
+  backend()
+    : m_cells( new cell_t[ QUEUE_CAPACITY ] ),
+      m_enqueue_pos( 0 ),
+      m_dequeue_pos( 0 ),
+      m_policy( overflow_policy::drop ),
+      m_dropped( 0 ),
+      m_dropped_reported( 0 ),
+      m_running( true ),
+      m_flusher_idle( false ),
+      m_raw_writes( false )
+  {
+    for( std::size_t i = 0; i < QUEUE_CAPACITY; ++i )
+    {
+      m_cells[ i ].sequence.store( i, std::memory_order_relaxed );
+    }
+    // Enough that emergency_flush, which must not allocate, never grows them.
+    m_batch.reserve( BATCH_BYTES + MAX_LINE_BYTES );
+    m_joined.reserve( MAX_MESSAGE_SIZE );
+
+    // Binary output can be requested without touching code.
+    if( char const* prefix = std::getenv( "MYENGINE_LOG_BINARY" ) )
+    {
+      try
+      {
+        m_writer = std::make_unique< binary_log_writer >(
+          prefix, DEFAULT_SEGMENT_BYTES, 0 );
+      }
+      catch( std::exception const& ex )
+      {
+        fprintf( stderr, "MYENGINE_LOG_BINARY ignored: %s\n", ex.what() );
+      }
+    }
+
+    m_thread = std::thread( &backend::run, this );
+  }
+
+  backend( backend const& ) = delete;
+  backend& operator=( backend const& ) = delete;
+
+  /// Push a record of at most `MAX_MESSAGE_SIZE` bytes. Returns false if it
+  /// was dropped.
+  bool
+  push( site_t& site, char const* text, std::size_t len )
+  {
+    auto const now = steady_clock_t::now();
+    if( !m_running.load( std::memory_order_acquire ) )
+    {
+      // No flusher any more.
+      write_sync( site, now, text, len );
+      return true;
+    }
+    std::size_t const cells =
+      len > RECORD_TEXT_SIZE ? ( len + RECORD_TEXT_SIZE - 1 ) / RECORD_TEXT_SIZE
+                             : 1;
+    while( !try_push( site, now, text, len, cells ) )
+    {
+      if( m_policy.load( std::memory_order_relaxed ) == overflow_policy::drop )
+      {
+        m_dropped.fetch_add( 1, std::memory_order_relaxed );
+        return false;
+      }
+      wake_if_idle();
+      std::this_thread::yield();
+    }
+    wake_if_idle();
+    return true;
+  }
+
+  /// Drain and write everything committed so far from the calling thread.
+  /// Returns the number of cells consumed.
+  std::size_t
+  flush()
+  {
+    drain_lock lock( m_drain_mutex );
+    return drain_locked();
+  }
+
+  /// Stop the flusher thread and write out what's left.
+  void
+  shutdown()
+  {
+    {
+      std::lock_guard< std::mutex > lock( m_wake_mutex );
+      if( !m_running.exchange( false, std::memory_order_acq_rel ) )
+      {
+        return;
+      }
+    }
+    m_wake.notify_one();
+    if( m_thread.joinable() )
+    {
+      m_thread.join();
+    }
+    drain_lock lock( m_drain_mutex );
+    drain_locked();
+    // Closing truncates the last segment to what was used. Anything logged
+    // after this point goes to stderr.
+    m_writer.reset();
+  }
+
+  /**
+   * Best-effort drain for when the process is going down hard, possibly from
+   * a signal handler. Text goes out with `write(2)` rather than stdio.
+   */
+  void
+  emergency_flush()
+  {
+    // The crash may have happened while something held the drain lock, in
+    // which case there's nothing safe left to do. If that is this thread,
+    // even trying the lock again would be undefined.
+    if( t_draining || !m_drain_mutex.try_lock() )
+    {
+      return;
+    }
+    t_draining = true;
+    m_raw_writes = true;
+    drain_locked();
+    if( m_writer )
+    {
+      m_writer->flush( false );
+    }
+    m_raw_writes = false;
+    t_draining = false;
+    m_drain_mutex.unlock();
+  }
+
+  /// Switch to (or away from, with null) binary output.
+  void
+  set_writer( std::unique_ptr< binary_log_writer > writer )
+  {
+    drain_lock lock( m_drain_mutex );
+    // Pending records belong to the output they were logged under.
+    drain_locked();
+    m_writer = std::move( writer );
+  }
+
+  void
+  set_policy( overflow_policy policy )
+  {
+    m_policy.store( policy, std::memory_order_relaxed );
+  }
+
+  [[nodiscard]] uint64_t
+  dropped() const
+  {
+    return m_dropped.load( std::memory_order_relaxed );
+  }
+
+private:
+  static constexpr std::size_t MASK = QUEUE_CAPACITY - 1;
+
+  std::unique_ptr< cell_t[] > m_cells;
+  // Keep producer and consumer positions on separate cache lines.
+  alignas( 64 ) std::atomic< std::size_t > m_enqueue_pos;
+  // Written under m_drain_mutex; read by the flusher to decide to sleep.
+  alignas( 64 ) std::atomic< std::size_t > m_dequeue_pos;
+  std::atomic< overflow_policy > m_policy;
+  std::atomic< uint64_t > m_dropped;
+  uint64_t m_dropped_reported;  // guarded by m_drain_mutex
+  std::atomic< bool > m_running;
+  /// If the flusher is asleep until woken, as opposed to waiting on a timer.
+  std::atomic< bool > m_flusher_idle;
+
+  std::mutex m_drain_mutex;
+  /// Write text with `write_stderr_raw`, from `emergency_flush`.
+  bool m_raw_writes;  // guarded by m_drain_mutex
+  std::string m_batch;  // guarded by m_drain_mutex
+  /// Pieces of a message split over several cells, so far.
+  std::string m_joined;  // guarded by m_drain_mutex
+  std::unique_ptr< binary_log_writer > m_writer;  // guarded by m_drain_mutex
+
+  std::mutex m_wake_mutex;
+  std::condition_variable m_wake;
+  std::thread m_thread;
+
+  /// Scoped lock of `m_drain_mutex` that marks the thread as its owner.
+  class drain_lock
+  {
+  public:
+    explicit drain_lock( std::mutex& mutex )
+      : m_lock( mutex )
+    {
+      t_draining = true;
+    }
+
+    drain_lock( drain_lock const& ) = delete;
+    drain_lock& operator=( drain_lock const& ) = delete;
+
+    ~drain_lock() { t_draining = false; }
+
+  private:
+    std::lock_guard< std::mutex > m_lock;
+  };
+
+  /// Push a record into `cells` consecutive cells. False if the queue is
+  /// too full.
+  bool
+  try_push( site_t& site, steady_clock_t::time_point now, char const* text,
+            std::size_t len, std::size_t cells )
+  {
+    std::size_t pos = m_enqueue_pos.load( std::memory_order_relaxed );
+    for(;; )
+    {
+      std::size_t seq =
+        m_cells[ pos & MASK ].sequence.load( std::memory_order_acquire );
+      auto diff = static_cast< std::ptrdiff_t >( seq ) -
+                  static_cast< std::ptrdiff_t >( pos );
+      if( diff == 0 )
+      {
+        // Cells are freed in order, so if the last one wanted is free, so
+        // are those before it.
+        std::size_t const last = pos + cells - 1;
+        if( cells > 1 &&
+            m_cells[ last & MASK ].sequence.load( std::memory_order_acquire ) !=
+              last )
+        {
+          return false;  // full
+        }
+        if( m_enqueue_pos.compare_exchange_weak( pos, pos + cells,
+                                                 std::memory_order_relaxed ) )
+        {
+          break;
+        }
+      }
+      else if( diff < 0 )
+      {
+        return false;  // full
+      }
+      else
+      {
+        pos = m_enqueue_pos.load( std::memory_order_relaxed );
+      }
+    }
+
+    for( std::size_t i = 0; i < cells; ++i )
+    {
+      cell_t& cell = m_cells[ ( pos + i ) & MASK ];
+      std::size_t const piece = std::min( len, RECORD_TEXT_SIZE );
+      record_t& rec = cell.rec;
+      rec.site = &site;
+      rec.time = now;
+      rec.len = static_cast< uint16_t >( piece );
+      rec.continued = i + 1 < cells;
+      memcpy( rec.text, text, piece );
+      text += piece;
+      len -= piece;
+      cell.sequence.store( pos + i + 1, std::memory_order_release );
+    }
+    return true;
+  }
+
+  /// If the next cell to consume has been published.
+  [[nodiscard]] bool
+  has_records() const
+  {
+    std::size_t const pos = m_dequeue_pos.load( std::memory_order_relaxed );
+    return m_cells[ pos & MASK ].sequence.load( std::memory_order_acquire ) ==
+           pos + 1;
+  }
+
+  /// Wake the flusher if it sleeps until woken. Called after publishing.
+  void
+  wake_if_idle()
+  {
+    // Pairs with the fence in `run`: either the flusher sees what was just
+    // published, or this sees it idle.
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if( m_flusher_idle.load( std::memory_order_relaxed ) )
+    {
+      // Taking the lock makes sure the flusher either has not checked for
+      // records yet, or is waiting and gets the notification.
+      {
+        std::lock_guard< std::mutex > lock( m_wake_mutex );
+      }
+      m_wake.notify_one();
+    }
+  }
+
+  /// Send one record to the current output.
+  void
+  output( site_t& site, steady_clock_t::time_point time, char const* text,
+          std::size_t len )
+  {
+    if( m_writer )
+    {
+      if( !m_writer->append( site, time, text, len ) )
+      {
+        m_dropped.fetch_add( 1, std::memory_order_relaxed );
+      }
+      return;
+    }
+    format_record( site, time, text, len, m_batch );
+    if( m_batch.size() >= BATCH_BYTES )
+    {
+      write_batch();
+    }
+  }
+
+  /// Consume committed records in order, writing them in batches. Returns the
+  /// number of cells consumed.
+  std::size_t
+  drain_locked()
+  {
+    std::size_t pos = m_dequeue_pos.load( std::memory_order_relaxed );
+    std::size_t const start = pos;
+    for(;; )
+    {
+      cell_t& cell = m_cells[ pos & MASK ];
+      if( cell.sequence.load( std::memory_order_acquire ) != pos + 1 )
+      {
+        break;
+      }
+      record_t const& rec = cell.rec;
+      if( rec.continued || !m_joined.empty() )
+      {
+        // The pieces are in consecutive cells; the last one may not be
+        // published yet, in which case this carries on next time.
+        m_joined.append( rec.text, rec.len );
+        if( !rec.continued )
+        {
+          output( *rec.site, rec.time, m_joined.data(), m_joined.size() );
+          m_joined.clear();
+        }
+      }
+      else
+      {
+        output( *rec.site, rec.time, rec.text, rec.len );
+      }
+      cell.sequence.store( pos + QUEUE_CAPACITY, std::memory_order_release );
+      ++pos;
+      m_dequeue_pos.store( pos, std::memory_order_relaxed );
+    }
+    report_dropped();
+    write_batch();
+    if( !m_raw_writes )
+    {
+      fflush( stderr );
+    }
+    return pos - start;
+  }
+
+  /// If records were dropped since the last report, say so.
+  void
+  report_dropped()
+  {
+    uint64_t dropped = m_dropped.load( std::memory_order_relaxed );
+    if( dropped == m_dropped_reported )
+    {
+      return;
+    }
+    static site_t site = { level::warn, __FILENAME__, __LINE__, __func__,
+                           "Log queue full, dropped {} record(s)", 0 };
+    char text[ 16 ];
+    detail::arg_packer p( text, sizeof( text ) );
+    detail::pack_arg( p, dropped - m_dropped_reported );
+    m_dropped_reported = dropped;
+    output( site, steady_clock_t::now(), p.data(), p.size() );
+  }
+
+  void
+  write_batch()
+  {
+    if( !m_batch.empty() )
+    {
+      if( m_raw_writes )
+      {
+        write_stderr_raw( m_batch.data(), m_batch.size() );
+      }
+      else
+      {
+        fwrite( m_batch.data(), 1, m_batch.size(), stderr );
+      }
+      m_batch.clear();
+    }
+  }
+
+  /// Write a record from the calling thread, after what is queued. Only once
+  /// the flusher is gone.
+  void
+  write_sync( site_t& site, steady_clock_t::time_point now, char const* text,
+              std::size_t len )
+  {
+    drain_lock lock( m_drain_mutex );
+    drain_locked();
+    output( site, now, text, len );
+    write_batch();
+    fflush( stderr );
+  }
+
+  /// Flusher thread body.
+  void
+  run()
+  {
+    auto const stopping = [ this ] {
+      return !m_running.load( std::memory_order_acquire );
+    };
+    std::unique_lock< std::mutex > lock( m_wake_mutex );
+    while( !stopping() )
+    {
+      lock.unlock();
+      std::size_t const drained = flush();
+      lock.lock();
+      if( drained > 0 )
+      {
+        // Records are coming: keep batching them on a timer.
+        m_wake.wait_for( lock, FLUSH_INTERVAL, stopping );
+        continue;
+      }
+      // Nothing lately: sleep until a producer publishes something.
+      m_flusher_idle.store( true, std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      m_wake.wait( lock, [ this, &stopping ] {
+                     return stopping() || has_records();
+                   } );
+      m_flusher_idle.store( false, std::memory_order_relaxed );
+    }
+  }
+};
+
+/**
+ * Access the process-wide backend.
+ *
+ * This is intentionally leaked so that log calls made during static
+ * destruction still have somewhere to go. Shutdown is hooked with `atexit`
+ * instead, after which records are written synchronously.
+ */
+backend&
+instance()
+{
+  static backend* const b = [] {
+    auto* p = new backend();
+    std::atexit( [] { instance().shutdown(); } );
+    return p;
+  }();
+  return *b;
+}
+
+/// Parse a level name as used in `MYENGINE_LOG_LEVEL`.
+bool
+parse_level( std::string const& name, level& lvl )
+{
+  static std::pair< char const*, level > const names[] = {
+    { "debug", level::debug },
+    { "info", level::info },
+    { "warn", level::warn },
+    { "error", level::error },
+    { "off", level::off },
+  };
+  for( auto const& n : names )
+  {
+    if( name == n.first )
+    {
+      lvl = n.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Registry of named modules and their runtime levels.
+ *
+ * Lookups only happen once per call site (the macros cache the reference), so
+ * a plain mutex is fine here.
+ */
+class module_registry
+{
+public:
+  module_registry()
+    : m_default( MYENGINE_LOG_MIN_LEVEL < static_cast< int >( level::off )
+                 ? static_cast< level >( MYENGINE_LOG_MIN_LEVEL )
+                 : level::off )
+  {
+    load_env();
+  }
+
+  module_t&
+  get( char const* name )
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    return get_locked( name );
+  }
+
+  void
+  set_all( level lvl )
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    m_default = lvl;
+    m_env_levels.clear();
+    for( auto& entry : m_modules )
+    {
+      entry.second->min_level.store( static_cast< uint8_t >( lvl ),
+                                     std::memory_order_relaxed );
+    }
+  }
+
+  void
+  set( char const* name, level lvl )
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    get_locked( name ).min_level.store( static_cast< uint8_t >( lvl ),
+                                        std::memory_order_relaxed );
+  }
+
+private:
+  std::mutex m_mutex;
+  level m_default;
+  // Module name -> level from the environment, applied on module creation.
+  std::unordered_map< std::string, level > m_env_levels;
+  // unique_ptr values so references handed out stay valid on rehash.
+  std::unordered_map< std::string, std::unique_ptr< module_t > > m_modules;
+
+  module_t&
+  get_locked( char const* name )
+  {
+    auto it = m_modules.find( name );
+    if( it == m_modules.end() )
+    {
+      level lvl = m_default;
+      auto env_it = m_env_levels.find( name );
+      if( env_it != m_env_levels.end() )
+      {
+        lvl = env_it->second;
+      }
+      auto m = std::make_unique< module_t >();
+      m->min_level.store( static_cast< uint8_t >( lvl ),
+                          std::memory_order_relaxed );
+      it = m_modules.emplace( name, std::move( m ) ).first;
+      // Point at the key owned by the map, which doesn't move.
+      it->second->name = it->first.c_str();
+    }
+    return *it->second;
+  }
+
+  /// Parse `MYENGINE_LOG_LEVEL`: comma separated `level` or `module=level`.
+  void
+  load_env()
+  {
+    char const* env = std::getenv( "MYENGINE_LOG_LEVEL" );
+    if( env == nullptr )
+    {
+      return;
+    }
+    std::stringstream ss( env );
+    std::string item;
+    while( std::getline( ss, item, ',' ) )
+    {
+      level lvl;
+      auto eq = item.find( '=' );
+      if( eq == std::string::npos )
+      {
+        if( parse_level( item, lvl ) )
+        {
+          m_default = lvl;
+        }
+      }
+      else if( parse_level( item.substr( eq + 1 ), lvl ) )
+      {
+        m_env_levels[ item.substr( 0, eq ) ] = lvl;
+      }
+    }
+  }
+};
+
+module_registry&
+registry()
 {
-  typedef std::chrono::steady_clock clock_t;
-  typedef clock_t::rep rep_t;
+  // Leaked for the same reason as `instance()`.
+  static module_registry* const r = new module_registry();
+  return *r;
+}
+
+void
+crash_signal_handler( int sig )
+{
+  instance().emergency_flush();
+  std::signal( sig, SIG_DFL );
+  std::raise( sig );
+}
+
+} // namespace
 
+steady_clock_t::time_point
+epoch()
+{
   // Static "start" time to delta from
-  static auto const first_t = clock_t::now();
-
-  // This should be in nanoseconds (steady_clock::duration ==
-  // chrono::nanoseconds)
-  auto delta_nano =
-    std::chrono::duration_cast< std::chrono::nanoseconds >(
-      clock_t::now() - first_t ).count();
-  auto micro = delta_nano % (rep_t) 1e9 / 1000, // microseconds truncation
-       seconds = delta_nano / (rep_t) 1e9,      // total seconds
-       hours = seconds / 3600,                  // minutes truncation
-       minutes = seconds % 3600 / 60;           // hours truncation
-
-  // seconds is assigned above to *total* seconds, this is the truncation to
-  // the seconds slice of the time.
-  seconds = seconds % 3600 % 60;
-
-  char buf[ 18 ];  // HHHH:MM:SS.DDDDDD<NULL>
-  snprintf( buf, 18, "%04lld:%02lld:%02lld.%06lld", hours, minutes, seconds,
-            micro );
+  static auto const first_t = steady_clock_t::now();
+  return first_t;
+}
+
+std::string
+now_str()
+{
+  char buf[ 32 ];  // HHHH:MM:SS.DDDDDD<NULL>, with headroom
+  format_elapsed( elapsed_ns( steady_clock_t::now() ), buf, sizeof( buf ) );
   return { buf };
 }
 
+void
+flush()
+{
+  instance().flush();
+}
+
+void
+shutdown()
+{
+  instance().shutdown();
+}
+
+void
+set_overflow_policy( overflow_policy policy )
+{
+  instance().set_policy( policy );
+}
+
+uint64_t
+dropped_count()
+{
+  return instance().dropped();
+}
+
+void
+enable_binary_output( std::string const& path_prefix,
+                      std::size_t segment_bytes, uint32_t max_segments )
+{
+  instance().set_writer( std::make_unique< binary_log_writer >(
+                           path_prefix, segment_bytes, max_segments ) );
+}
+
+void
+enable_text_output()
+{
+  instance().set_writer( nullptr );
+}
+
+module_t&
+get_module( char const* name )
+{
+  return registry().get( name );
+}
+
+void
+set_level( level lvl )
+{
+  registry().set_all( lvl );
+}
+
+void
+set_module_level( char const* name, level lvl )
+{
+  registry().set( name, lvl );
+}
+
+void
+install_crash_handlers()
+{
+  // Make sure the backend exists before anything can go wrong.
+  instance();
+
+  static std::terminate_handler const previous_terminate =
+    std::set_terminate( [] {
+                          instance().emergency_flush();
+                          if( previous_terminate )
+                          {
+                            previous_terminate();
+                          }
+                          std::abort();
+                        } );
+  (void) previous_terminate;
+
+  for( int sig : { SIGSEGV, SIGABRT, SIGFPE, SIGILL } )
+  {
+    std::signal( sig, crash_signal_handler );
+  }
+#ifdef SIGBUS
+  std::signal( SIGBUS, crash_signal_handler );
+#endif
+}
+
+namespace detail {
+
+bounded_streambuf::bounded_streambuf( char* buf, std::size_t size )
+  : m_buf( buf ),
+    m_size( size ),
+    m_discarded( 0 )
+{
+  reset();
+}
+
+void
+bounded_streambuf::reset()
+{
+  setp( m_buf, m_buf + m_size );
+  m_discarded = 0;
+}
+
+std::size_t
+bounded_streambuf::finish()
+{
+  auto const used = static_cast< std::size_t >( pptr() - pbase() );
+  if( m_discarded == 0 )
+  {
+    return used;
+  }
+  // Overwrite the end with the marker; it is at most 42 characters.
+  std::size_t const kept = m_size - 48;
+  int const n = snprintf( m_buf + kept, 48, "...[truncated %llu bytes]",
+                          static_cast< unsigned long long >(
+                            m_discarded + used - kept ) );
+  return kept + static_cast< std::size_t >( n );
+}
+
+bounded_streambuf::int_type
+bounded_streambuf::overflow( int_type c )
+{
+  // Only called when full.
+  if( !traits_type::eq_int_type( c, traits_type::eof() ) )
+  {
+    ++m_discarded;
+  }
+  return traits_type::not_eof( c );
+}
+
+std::streamsize
+bounded_streambuf::xsputn( char const* s, std::streamsize n )
+{
+  auto const count = static_cast< std::size_t >( n );
+  auto const room = static_cast< std::size_t >( epptr() - pptr() );
+  std::size_t const fits = count < room ? count : room;
+  traits_type::copy( pptr(), s, fits );
+  pbump( static_cast< int >( fits ) );
+  m_discarded += count - fits;
+  return n;
+}
+
+record_stream::record_stream()
+  : m_buf( &t_stream.buf ),
+    m_os( &t_stream.os ),
+    m_local()
+{
+  // Make sure timestamps are relative to no later than the first record.
+  (void) epoch();
+  if( ++t_stream.depth > 1 )
+  {
+    // A `<<` operand of the record using the thread's stream is logging.
+    m_local.emplace();
+    m_buf = &m_local->buf;
+    m_os = &m_local->os;
+    return;
+  }
+  t_stream.buf.reset();
+  t_stream.os.clear();
+  // Don't let formatting flags from a previous message leak into this one.
+  t_stream.os.flags( std::ios_base::dec | std::ios_base::skipws );
+  t_stream.os.precision( 6 );
+  t_stream.os.fill( ' ' );
+  t_stream.os.width( 0 );
+}
+
+record_stream::~record_stream()
+{
+  --t_stream.depth;
+}
+
+void
+record_stream::commit( site_t& site )
+{
+  std::size_t const len = m_buf->finish();
+  char const* text = m_local ? m_local->text : t_stream.text;
+  instance().push( site, text, len );
+}
+
+void
+commit_packed( site_t& site, char const* data, std::size_t len )
+{
+  // As in `record_stream`; otherwise a first record from `LOGF_*` would be
+  // stamped before the epoch.
+  (void) epoch();
+  instance().push( site, data, len );
+}
+
+} // namespace detail
+
 } // namespace myengine::logging
@@ -3,27 +3,191 @@
  *
  * I would do `constexpr` functions but I don't know how to represent the
  * `<<`-able type...
+ *
+ * The macros do not write to `std::cerr` directly. A message is formatted into
+ * a thread-local, fixed size buffer at the call site and then pushed as a
+ * record into a bounded, lock-free queue. A background "flusher" thread drains
+ * that queue and writes records out in batches. This keeps I/O (and the lock
+ * inside `std::cerr`) off of the calling thread, e.g. the render loop: it
+ * never allocates, drains or writes for a log call.
+ *
+ * Things to know:
+ *   - `LOG_*` messages longer than `RECORD_TEXT_SIZE` take several
+ *     consecutive queue cells, which the flusher joins back. Messages are cut
+ *     at `MAX_MESSAGE_SIZE` bytes, ending with a "...[truncated N bytes]"
+ *     marker.
+ *   - A `<<` operand of a `LOG_*` call may log itself. Such nested messages are
+ *     formatted on the stack and cut at `RECORD_TEXT_SIZE` bytes.
+ *   - Packed `LOGF_*` arguments are limited to `RECORD_TEXT_SIZE` bytes in
+ *     total; string arguments are cut to the space left.
+ *   - When the queue is full, records are dropped by default and counted (see
+ *     `set_overflow_policy`). A warning with the drop count is emitted once
+ *     there is room again.
+ *   - Records are written at process exit. Call `flush()` when output must be
+ *     visible *now*, and `install_crash_handlers()` early in `main` to get
+ *     pending records out when the process dies on a fatal signal.
+ *
+ * Filtering happens in two stages:
+ *   - Compile time: levels below `MYENGINE_LOG_MIN_LEVEL` (0=debug, 1=info,
+ *     2=warn, 3=error, 4=off) expand to an empty statement, so the message
+ *     expression is never compiled into the binary, let alone evaluated.
+ *     Defaults to 0 (debug) without `NDEBUG` and 1 (info) with it. Settable
+ *     with the `MYENGINE_LOG_MIN_LEVEL` CMake cache variable.
+ *   - Run time: every call site belongs to a named module (the value of
+ *     `MYENGINE_LOG_MODULE` where the macro is expanded, "default" if not
+ *     defined before including this header). A call site whose module level is
+ *     above the record level costs one relaxed atomic load; the message
+ *     expression is not evaluated. Module levels come from `set_level`,
+ *     `set_module_level`, or the `MYENGINE_LOG_LEVEL` environment variable,
+ *     e.g. `MYENGINE_LOG_LEVEL=warn,vulkan=debug`.
+ *
+ * Besides the `<<`-style `LOG_*` macros there are `LOGF_*` macros taking a
+ * static `{}`-style format string and arguments, e.g.
+ * `LOGF_INFO( "Found {} devices", n )`. Their arguments are packed as raw
+ * values and only rendered to text by the flusher thread, which makes them
+ * cheaper at the call site. Arguments may be arithmetic, enum, string or
+ * pointer types.
+ *
+ * Output is text on `stderr` by default. `enable_binary_output` (or the
+ * `MYENGINE_LOG_BINARY=<path-prefix>` environment variable) switches to a
+ * compact binary format in memory-mapped, rotating segment files instead; see
+ * `myengine/log_binary.h` and the `myengine_log_decode` tool to turn those
+ * back into text.
  */
 
 #ifndef LOGGING_H
 #define LOGGING_H
 
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
-#include <iostream>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 #include <myengine/myengine_export.h>
 
-// Not sure if this is going to cause a performance issue. If so maybe give up
-// width-saving
-// convenience for the simple use of __FILE__?
-#define __FILENAME__ \
-  ( strrchr( __FILE__, '/' ) ? strrchr( __FILE__, '/' ) + 1 : __FILE__ )
-#define _LOG_LOC \
-  __FILENAME__ << "(" << __LINE__ << ")[" << __func__ << "]"
+#ifndef MYENGINE_LOG_MIN_LEVEL
+# ifdef NDEBUG
+#  define MYENGINE_LOG_MIN_LEVEL 1
+# else
+#  define MYENGINE_LOG_MIN_LEVEL 0
+# endif
+#endif
+
+#ifndef MYENGINE_LOG_MODULE
+# define MYENGINE_LOG_MODULE "default"
+#endif
+
+// Base name of the current source file, e.g. "vulkan.cxx".
+// The offset into `__FILE__` is forced to be a compile-time constant by using
+// it as a template argument, so this is just a pointer into the string
+// literal. (`std::source_location` would be nicer but that's C++20.)
+#define __FILENAME__                                                      \
+  ( __FILE__ + std::integral_constant< std::size_t,                       \
+                 myengine::logging::detail::basename_offset( __FILE__ ) >::value )
 
 namespace myengine::logging {
 
+/// Clock used for all logging timestamps.
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Severity of a log record.
+enum class level : uint8_t
+{
+  debug = 0,
+  info,
+  warn,
+  error,
+  /// Only meaningful as a threshold: nothing passes it.
+  off,
+};
+
+/// What a log call does when the record queue is full.
+enum class overflow_policy : uint8_t
+{
+  /// Discard the record and count it. The calling thread never waits.
+  drop = 0,
+  /// Yield until the flusher thread has made room. Nothing is lost, but the
+  /// calling thread may stall behind I/O.
+  block,
+};
+
+/**
+ * Named group of log call sites sharing a runtime level threshold.
+ *
+ * Instances are owned by the library and live until process exit, so call
+ * sites may cache references to them.
+ */
+struct module_t
+{
+  char const* name;
+  std::atomic< uint8_t > min_level;
+
+  /// If records of the given level pass this module's threshold.
+  [[nodiscard]] bool
+  enabled( level lvl ) const
+  {
+    return static_cast< uint8_t >( lvl ) >=
+           min_level.load( std::memory_order_relaxed );
+  }
+};
+
+/**
+ * Static description of one log call site.
+ *
+ * The macros create one of these per call site with static storage duration.
+ */
+struct site_t
+{
+  level lvl;
+  char const* file;
+  int line;
+  char const* func;
+  /// `{}`-style format string for `LOGF_*` sites, null for `LOG_*` sites.
+  char const* fmt;
+  /// Identifier of this site in binary output, 0 until first written.
+  /// Only touched by the logging backend.
+  uint32_t id;
+};
+
+/// Type tags for arguments packed by the `LOGF_*` macros.
+enum class arg_tag : uint8_t
+{
+  int64 = 1,
+  uint64,
+  float64,
+  boolean,
+  character,
+  /// `uint16_t` byte length followed by that many bytes, no terminator.
+  string,
+  pointer,
+};
+
+/// Message bytes a queue cell holds. Longer `LOG_*` messages take several;
+/// `LOGF_*` payloads are cut to this size.
+constexpr std::size_t RECORD_TEXT_SIZE = 448;
+
+/// Longest `LOG_*` message, in bytes. Longer ones are cut, with a marker.
+constexpr std::size_t MAX_MESSAGE_SIZE = 16 * 1024;
+
+/// Number of records the queue can hold before the overflow policy applies.
+/// Must be a power of two.
+constexpr std::size_t QUEUE_CAPACITY = 4096;
+
+/**
+ * Get the time point that logging timestamps are relative to.
+ *
+ * This is initialized on first call, which happens no later than the first
+ * log record.
+ */
+steady_clock_t::time_point MYENGINE_EXPORT epoch();
+
 /**
  * Generate a string for time elapsed since the start of logging.
  *
@@ -39,39 +203,395 @@ namespace myengine::logging {
  */
 std::string MYENGINE_EXPORT now_str();
 
+/**
+ * Write out every record that has been committed so far.
+ *
+ * This blocks the calling thread until the records are written and `stderr`
+ * has been flushed.
+ */
+void MYENGINE_EXPORT flush();
+
+/**
+ * Stop the background flusher thread after writing out all pending records.
+ *
+ * This is registered to run at exit, so it usually does not need to be called
+ * explicitly. Records logged after shutdown are written synchronously.
+ */
+void MYENGINE_EXPORT shutdown();
+
+/**
+ * Set what log calls do when the record queue is full.
+ *
+ * The default is `overflow_policy::drop`.
+ */
+void MYENGINE_EXPORT set_overflow_policy( overflow_policy policy );
+
+/// Total number of records dropped due to a full queue so far.
+uint64_t MYENGINE_EXPORT dropped_count();
+
+/**
+ * Install handlers that write out pending log records before the process dies.
+ *
+ * This covers `std::terminate` and the fatal signals SIGSEGV, SIGABRT, SIGFPE,
+ * SIGILL (and SIGBUS where available). After writing, the default signal
+ * disposition is restored and the signal is re-raised. Writing from a signal
+ * handler is best-effort.
+ */
+void MYENGINE_EXPORT install_crash_handlers();
+
+/**
+ * Write records to rotating binary segment files instead of `stderr`.
+ *
+ * Segment files are named `<path_prefix>.<NNNNNN>.mlog` and are memory-mapped
+ * at `segment_bytes` size, then truncated to what was used when rotated or
+ * closed. Records pending in the queue are written out with the previous
+ * output before switching.
+ *
+ * @param path_prefix Path and file name prefix for segment files.
+ * @param segment_bytes Size of each segment file before rotating.
+ * @param max_segments Number of most recent segments to keep on disk, older
+ * segments are deleted. 0 to keep everything.
+ *
+ * @throws std::runtime_error Failed to create the first segment file.
+ */
+void MYENGINE_EXPORT enable_binary_output(
+  std::string const& path_prefix,
+  std::size_t segment_bytes = 64 * 1024 * 1024,
+  uint32_t max_segments = 0 );
+
+/// Go back to writing text records to `stderr`, closing any binary output.
+void MYENGINE_EXPORT enable_text_output();
+
+/**
+ * Get the module of the given name, creating it on first request.
+ *
+ * New modules start at the level given for them in `MYENGINE_LOG_LEVEL`, or
+ * otherwise at the current default level (see `set_level`).
+ */
+module_t& MYENGINE_EXPORT get_module( char const* name );
+
+/**
+ * Set the runtime threshold for all modules, and the default for modules
+ * created later.
+ *
+ * This overrides any per-module levels set so far.
+ */
+void MYENGINE_EXPORT set_level( level lvl );
+
+/// Set the runtime threshold for the named module.
+void MYENGINE_EXPORT set_module_level( char const* name, level lvl );
+
+namespace detail {
+
+/// Offset of the character after the last path separator in `path`.
+constexpr std::size_t
+basename_offset( char const* path )
+{
+  std::size_t offset = 0;
+  for( std::size_t i = 0; path[ i ] != '\0'; ++i )
+  {
+    if( path[ i ] == '/' || path[ i ] == '\\' )
+    {
+      offset = i + 1;
+    }
+  }
+  return offset;
+}
+
+/**
+ * Stream buffer over a fixed array. What does not fit is counted, not stored.
+ */
+class MYENGINE_EXPORT bounded_streambuf
+  : public std::streambuf
+{
+public:
+  /// `size` must leave room for the truncation marker, at least 64 bytes.
+  bounded_streambuf( char* buf, std::size_t size );
+
+  /// Start over, empty.
+  void reset();
+
+  /**
+   * Size of the text, which starts at the array. If some did not fit, the
+   * text is first made to end with a "...[truncated N bytes]" marker.
+   */
+  [[nodiscard]] std::size_t finish();
+
+protected:
+  int_type overflow( int_type c ) override;
+  std::streamsize xsputn( char const* s, std::streamsize n ) override;
+
+private:
+  char* m_buf;
+  std::size_t m_size;
+  std::size_t m_discarded;
+};
+
+/**
+ * Formatting stream of one `LOG_*` record, reset to default formatting flags.
+ *
+ * This is the thread's own stream, holding up to `MAX_MESSAGE_SIZE` bytes,
+ * unless that is already in use: when formatting a record evaluates an operand
+ * that logs itself. A nested record gets a stream on the stack instead,
+ * holding `RECORD_TEXT_SIZE` bytes.
+ *
+ * Only for use by the `LOG_*` macros.
+ */
+class MYENGINE_EXPORT record_stream
+{
+public:
+  record_stream();
+  ~record_stream();
+
+  record_stream( record_stream const& ) = delete;
+  record_stream& operator=( record_stream const& ) = delete;
+
+  [[nodiscard]] std::ostream&
+  os()
+  {
+    return *m_os;
+  }
+
+  /// Push what was formatted as a record.
+  void commit( site_t& site );
+
+private:
+  struct local_stream
+  {
+    char text[ RECORD_TEXT_SIZE ];
+    bounded_streambuf buf{ text, sizeof( text ) };
+    std::ostream os{ &buf };
+  };
+
+  bounded_streambuf* m_buf;
+  std::ostream* m_os;
+  std::optional< local_stream > m_local;
+};
+
+/// Push a record with an already packed payload for the given site.
+void MYENGINE_EXPORT commit_packed( site_t& site, char const* data,
+                                    std::size_t len );
+
+/// Bounded writer of `arg_tag`-prefixed values.
+class arg_packer
+{
+public:
+  arg_packer( char* buf, std::size_t capacity )
+    : m_begin( buf ),
+      m_pos( buf ),
+      m_end( buf + capacity )
+  {}
+
+  /// Append a fixed size value. Once something doesn't fit, nothing more is
+  /// appended.
+  void
+  put( arg_tag tag, void const* value, std::size_t n )
+  {
+    if( static_cast< std::size_t >( m_end - m_pos ) < 1 + n )
+    {
+      m_end = m_pos;
+      return;
+    }
+    *m_pos++ = static_cast< char >( tag );
+    memcpy( m_pos, value, n );
+    m_pos += n;
+  }
+
+  /// Append a string, truncating it to the space left.
+  void
+  put_string( std::string_view s )
+  {
+    auto room = static_cast< std::size_t >( m_end - m_pos );
+    if( room < 1 + sizeof( uint16_t ) )
+    {
+      m_end = m_pos;
+      return;
+    }
+    room -= 1 + sizeof( uint16_t );
+    auto len = static_cast< uint16_t >( s.size() < room ? s.size() : room );
+    *m_pos++ = static_cast< char >( arg_tag::string );
+    memcpy( m_pos, &len, sizeof( len ) );
+    m_pos += sizeof( len );
+    memcpy( m_pos, s.data(), len );
+    m_pos += len;
+  }
+
+  [[nodiscard]] char const*
+  data() const
+  {
+    return m_begin;
+  }
+
+  [[nodiscard]] std::size_t
+  size() const
+  {
+    return static_cast< std::size_t >( m_pos - m_begin );
+  }
+
+private:
+  char* m_begin;
+  char* m_pos;
+  char* m_end;
+};
+
+template< typename T >
+struct dependent_false : std::false_type {};
+
+/// Pack a single `LOGF_*` argument.
+template< typename T >
+void
+pack_arg( arg_packer& p, T const& value )
+{
+  typedef std::decay_t< T > U;
+  if constexpr( std::is_same_v< U, bool > )
+  {
+    uint8_t b = value ? 1 : 0;
+    p.put( arg_tag::boolean, &b, 1 );
+  }
+  else if constexpr( std::is_same_v< U, char > )
+  {
+    p.put( arg_tag::character, &value, 1 );
+  }
+  else if constexpr( std::is_enum_v< U > )
+  {
+    pack_arg( p, static_cast< std::underlying_type_t< U > >( value ) );
+  }
+  else if constexpr( std::is_integral_v< U > && std::is_signed_v< U > )
+  {
+    int64_t v = value;
+    p.put( arg_tag::int64, &v, sizeof( v ) );
+  }
+  else if constexpr( std::is_integral_v< U > )
+  {
+    uint64_t v = value;
+    p.put( arg_tag::uint64, &v, sizeof( v ) );
+  }
+  else if constexpr( std::is_floating_point_v< U > )
+  {
+    double v = value;
+    p.put( arg_tag::float64, &v, sizeof( v ) );
+  }
+  else if constexpr( std::is_array_v< T > &&
+                     std::is_same_v< std::remove_cv_t< std::remove_extent_t< T > >,
+                                     char > )
+  {
+    // String literals and char arrays: never null.
+    p.put_string( std::string_view( value ) );
+  }
+  else if constexpr( std::is_same_v< U, char const* > ||
+                     std::is_same_v< U, char* > )
+  {
+    p.put_string( value ? std::string_view( value )
+                        : std::string_view( "(null)" ) );
+  }
+  else if constexpr( std::is_convertible_v< U const&, std::string_view > )
+  {
+    p.put_string( std::string_view( value ) );
+  }
+  else if constexpr( std::is_pointer_v< U > )
+  {
+    auto v = static_cast< uint64_t >( reinterpret_cast< uintptr_t >( value ) );
+    p.put( arg_tag::pointer, &v, sizeof( v ) );
+  }
+  else
+  {
+    static_assert( dependent_false< U >::value,
+                   "LOGF_* arguments must be arithmetic, enum, string or "
+                   "pointer types" );
+  }
+}
+
+/**
+ * Pack arguments and push a record for a `LOGF_*` call site.
+ *
+ * The format string argument is ignored here, it is already in `site`. It is
+ * part of the signature so the macros can pass `__VA_ARGS__` straight through.
+ */
+template< typename... Args >
+void
+log_packed( site_t& site, char const* /* fmt */, Args const&... args )
+{
+  char buf[ RECORD_TEXT_SIZE ];
+  arg_packer p( buf, sizeof( buf ) );
+  ( pack_arg( p, args ), ... );
+  commit_packed( site, p.data(), p.size() );
+}
+
+} // namespace detail
+
 } // namespace myengine::logging
 
-#ifdef NDEBUG
-# define LOG_DEBUG( msg )
-#else
-# define LOG_DEBUG( msg ) \
-  do                      \
-  {                       \
-    std::cerr   << "[DEBUG] [" << myengine::logging::now_str() << "] " \
-                << _LOG_LOC << " " << msg << std::endl;                \
+#define _LOG_RECORD( lvl, msg )                                         \
+  do                                                                    \
+  {                                                                     \
+    static myengine::logging::module_t const& _log_module =             \
+      myengine::logging::get_module( MYENGINE_LOG_MODULE );             \
+    if( _log_module.enabled( myengine::logging::level::lvl ) )          \
+    {                                                                   \
+      static myengine::logging::site_t _log_site = {                    \
+        myengine::logging::level::lvl, __FILENAME__, __LINE__, __func__, \
+        nullptr, 0 };                                                   \
+      myengine::logging::detail::record_stream _log_stream;             \
+      _log_stream.os() << msg;                                          \
+      _log_stream.commit( _log_site );                                  \
+    }                                                                   \
   } while( false )
-#endif
 
-#define LOG_INFO( msg ) \
-  do                    \
-  {                     \
-    std::cerr   << "[ INFO] [" << myengine::logging::now_str() << "] " \
-                << _LOG_LOC << " " << msg << std::endl;                \
-  } while( false )
+// Extra expansion step so MSVC's traditional preprocessor splits
+// `__VA_ARGS__` into separate arguments.
+#define _LOG_EXPAND( x ) x
+#define _LOG_FIRST_IMPL( first, ... ) first
+#define _LOG_FIRST( ... ) _LOG_EXPAND( _LOG_FIRST_IMPL( __VA_ARGS__, _ ) )
 
-#define LOG_WARN( msg ) \
-  do                    \
-  {                     \
-    std::cerr   << "[ WARN] [" << myengine::logging::now_str() << "] " \
-                << _LOG_LOC << " " << msg << std::endl;                \
+// `...` is the format string followed by its arguments.
+#define _LOGF_RECORD( lvl, ... )                                        \
+  do                                                                    \
+  {                                                                     \
+    static myengine::logging::module_t const& _log_module =             \
+      myengine::logging::get_module( MYENGINE_LOG_MODULE );             \
+    if( _log_module.enabled( myengine::logging::level::lvl ) )          \
+    {                                                                   \
+      static myengine::logging::site_t _log_site = {                    \
+        myengine::logging::level::lvl, __FILENAME__, __LINE__, __func__, \
+        _LOG_FIRST( __VA_ARGS__ ), 0 };                                 \
+      myengine::logging::detail::log_packed( _log_site, __VA_ARGS__ );  \
+    }                                                                   \
   } while( false )
 
-#define LOG_ERROR( msg ) \
-  do                     \
-  {                      \
-    std::cerr   << "[ERROR] [" << myengine::logging::now_str() << "] " \
-                << _LOG_LOC << " " << msg << std::endl;                \
-  } while( false )
+// Compiled-out levels still need to be a single statement.
+#define _LOG_DISABLED( ... ) do {} while( false )
+
+#if MYENGINE_LOG_MIN_LEVEL <= 0
+# define LOG_DEBUG( msg ) _LOG_RECORD( debug, msg )
+# define LOGF_DEBUG( ... ) _LOGF_RECORD( debug, __VA_ARGS__ )
+#else
+# define LOG_DEBUG( msg ) _LOG_DISABLED( msg )
+# define LOGF_DEBUG( ... ) _LOG_DISABLED( __VA_ARGS__ )
+#endif
+
+#if MYENGINE_LOG_MIN_LEVEL <= 1
+# define LOG_INFO( msg ) _LOG_RECORD( info, msg )
+# define LOGF_INFO( ... ) _LOGF_RECORD( info, __VA_ARGS__ )
+#else
+# define LOG_INFO( msg ) _LOG_DISABLED( msg )
+# define LOGF_INFO( ... ) _LOG_DISABLED( __VA_ARGS__ )
+#endif
+
+#if MYENGINE_LOG_MIN_LEVEL <= 2
+# define LOG_WARN( msg ) _LOG_RECORD( warn, msg )
+# define LOGF_WARN( ... ) _LOGF_RECORD( warn, __VA_ARGS__ )
+#else
+# define LOG_WARN( msg ) _LOG_DISABLED( msg )
+# define LOGF_WARN( ... ) _LOG_DISABLED( __VA_ARGS__ )
+#endif
+
+#if MYENGINE_LOG_MIN_LEVEL <= 3
+# define LOG_ERROR( msg ) _LOG_RECORD( error, msg )
+# define LOGF_ERROR( ... ) _LOGF_RECORD( error, __VA_ARGS__ )
+#else
+# define LOG_ERROR( msg ) _LOG_DISABLED( msg )
+# define LOGF_ERROR( ... ) _LOG_DISABLED( __VA_ARGS__ )
+#endif
 
 /// @brief Log some vector of values to the given logging level macro.
 ///
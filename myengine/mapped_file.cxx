@@ -0,0 +1,349 @@
+#include "mapped_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif
+# include <windows.h>
+#else
+# include <cerrno>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace myengine {
+
+namespace {
+
+/// Throw a runtime_error describing a failed operation on a path.
+[[noreturn]] void
+throw_file_error( char const* what, std::string const& path )
+{
+  std::stringstream ss;
+  ss  << "mapped_file: " << what << " '" << path << "'";
+#ifdef _WIN32
+  ss  << " (error " << GetLastError() << ")";
+#else
+  ss  << ": " << strerror( errno );
+#endif
+  throw std::runtime_error( ss.str() );
+}
+
+} // namespace
+
+mapped_file::mapped_file()
+  : m_path(),
+    m_data( nullptr ),
+    m_size( 0 ),
+    m_writable( false ),
+#ifdef _WIN32
+    m_file_handle( INVALID_HANDLE_VALUE ),
+    m_mapping_handle( nullptr )
+#else
+    m_fd( -1 )
+#endif
+{}
+
+mapped_file::mapped_file( mapped_file&& other ) noexcept
+  : mapped_file()
+{
+  *this = std::move( other );
+}
+
+mapped_file&
+mapped_file::operator=( mapped_file&& other ) noexcept
+{
+  if( this != &other )
+  {
+    close();
+    m_path = std::move( other.m_path );
+    m_data = other.m_data;
+    m_size = other.m_size;
+    m_writable = other.m_writable;
+#ifdef _WIN32
+    m_file_handle = other.m_file_handle;
+    m_mapping_handle = other.m_mapping_handle;
+#else
+    m_fd = other.m_fd;
+#endif
+    other.reset();
+  }
+  return *this;
+}
+
+mapped_file::~mapped_file()
+{
+  close();
+}
+
+void
+mapped_file::reset()
+{
+  m_path.clear();
+  m_data = nullptr;
+  m_size = 0;
+  m_writable = false;
+#ifdef _WIN32
+  m_file_handle = INVALID_HANDLE_VALUE;
+  m_mapping_handle = nullptr;
+#else
+  m_fd = -1;
+#endif
+}
+
+#ifdef _WIN32
+
+mapped_file
+mapped_file::open_read( std::string const& path )
+{
+  mapped_file f;
+  f.m_path = path;
+  f.m_file_handle = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                 nullptr, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL, nullptr );
+  if( f.m_file_handle == INVALID_HANDLE_VALUE )
+  {
+    throw_file_error( "failed to open", path );
+  }
+  LARGE_INTEGER size;
+  if( !GetFileSizeEx( f.m_file_handle, &size ) )
+  {
+    throw_file_error( "failed to stat", path );
+  }
+  f.m_size = static_cast< std::size_t >( size.QuadPart );
+  if( f.m_size == 0 )
+  {
+    // Nothing to map, but still a valid (empty) file.
+    return f;
+  }
+  f.m_mapping_handle = CreateFileMappingA( f.m_file_handle, nullptr,
+                                           PAGE_READONLY, 0, 0, nullptr );
+  if( f.m_mapping_handle == nullptr )
+  {
+    throw_file_error( "failed to create mapping for", path );
+  }
+  f.m_data = static_cast< uint8_t* >(
+    MapViewOfFile( f.m_mapping_handle, FILE_MAP_READ, 0, 0, 0 ) );
+  if( f.m_data == nullptr )
+  {
+    throw_file_error( "failed to map", path );
+  }
+  return f;
+}
+
+mapped_file
+mapped_file::create( std::string const& path, std::size_t size )
+{
+  mapped_file f;
+  f.m_path = path;
+  f.m_writable = true;
+  f.m_file_handle = CreateFileA( path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                                 FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                                 FILE_ATTRIBUTE_NORMAL, nullptr );
+  if( f.m_file_handle == INVALID_HANDLE_VALUE )
+  {
+    throw_file_error( "failed to create", path );
+  }
+  LARGE_INTEGER li;
+  li.QuadPart = static_cast< LONGLONG >( size );
+  f.m_mapping_handle = CreateFileMappingA( f.m_file_handle, nullptr,
+                                           PAGE_READWRITE, li.HighPart,
+                                           li.LowPart, nullptr );
+  if( f.m_mapping_handle == nullptr )
+  {
+    throw_file_error( "failed to create mapping for", path );
+  }
+  f.m_data = static_cast< uint8_t* >(
+    MapViewOfFile( f.m_mapping_handle, FILE_MAP_WRITE, 0, 0, size ) );
+  if( f.m_data == nullptr )
+  {
+    throw_file_error( "failed to map", path );
+  }
+  f.m_size = size;
+  return f;
+}
+
+void
+mapped_file::flush( bool wait )
+{
+  if( m_data && m_writable )
+  {
+    FlushViewOfFile( m_data, m_size );
+    if( wait )
+    {
+      FlushFileBuffers( m_file_handle );
+    }
+  }
+}
+
+void
+mapped_file::close( std::size_t final_size )
+{
+  if( m_data )
+  {
+    UnmapViewOfFile( m_data );
+  }
+  if( m_mapping_handle )
+  {
+    CloseHandle( m_mapping_handle );
+  }
+  if( m_file_handle != INVALID_HANDLE_VALUE )
+  {
+    if( m_writable && final_size != npos )
+    {
+      LARGE_INTEGER li;
+      li.QuadPart = static_cast< LONGLONG >( final_size );
+      SetFilePointerEx( m_file_handle, li, nullptr, FILE_BEGIN );
+      SetEndOfFile( m_file_handle );
+    }
+    CloseHandle( m_file_handle );
+  }
+  reset();
+}
+
+#else // POSIX
+
+mapped_file
+mapped_file::open_read( std::string const& path )
+{
+  mapped_file f;
+  f.m_path = path;
+  f.m_fd = ::open( path.c_str(), O_RDONLY );
+  if( f.m_fd < 0 )
+  {
+    throw_file_error( "failed to open", path );
+  }
+  struct stat st = {};
+  if( fstat( f.m_fd, &st ) != 0 )
+  {
+    throw_file_error( "failed to stat", path );
+  }
+  f.m_size = static_cast< std::size_t >( st.st_size );
+  if( f.m_size == 0 )
+  {
+    // Nothing to map, but still a valid (empty) file.
+    return f;
+  }
+  void* p = mmap( nullptr, f.m_size, PROT_READ, MAP_SHARED, f.m_fd, 0 );
+  if( p == MAP_FAILED )
+  {
+    throw_file_error( "failed to map", path );
+  }
+  f.m_data = static_cast< uint8_t* >( p );
+  return f;
+}
+
+mapped_file
+mapped_file::create( std::string const& path, std::size_t size )
+{
+  mapped_file f;
+  f.m_path = path;
+  f.m_writable = true;
+  f.m_fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+  if( f.m_fd < 0 )
+  {
+    throw_file_error( "failed to create", path );
+  }
+  if( ftruncate( f.m_fd, static_cast< off_t >( size ) ) != 0 )
+  {
+    throw_file_error( "failed to size", path );
+  }
+  void* p = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, f.m_fd,
+                  0 );
+  if( p == MAP_FAILED )
+  {
+    throw_file_error( "failed to map", path );
+  }
+  f.m_data = static_cast< uint8_t* >( p );
+  f.m_size = size;
+  return f;
+}
+
+void
+mapped_file::flush( bool wait )
+{
+  if( m_data && m_writable )
+  {
+    msync( m_data, m_size, wait ? MS_SYNC : MS_ASYNC );
+  }
+}
+
+void
+mapped_file::close( std::size_t final_size )
+{
+  if( m_data )
+  {
+    munmap( m_data, m_size );
+  }
+  if( m_fd >= 0 )
+  {
+    if( m_writable && final_size != npos )
+    {
+      // Nothing useful to do on failure, the file is just longer than needed.
+      (void) !ftruncate( m_fd, static_cast< off_t >( final_size ) );
+    }
+    ::close( m_fd );
+  }
+  reset();
+}
+
+#endif // _WIN32
+
+void
+write_file_atomic( std::string const& path,
+                   std::initializer_list< std::pair< void const*, std::size_t > >
+                     parts )
+{
+  std::size_t size = 0;
+  for( auto const& part : parts )
+  {
+    size += part.second;
+  }
+  std::string const tmp_path = path + ".tmp";
+  try
+  {
+    mapped_file out = mapped_file::create( tmp_path, size );
+    std::size_t offset = 0;
+    for( auto const& part : parts )
+    {
+      if( part.second )
+      {
+        memcpy( out.data() + offset, part.first, part.second );
+      }
+      offset += part.second;
+    }
+    out.flush( true );
+  }
+  catch( ... )
+  {
+    std::remove( tmp_path.c_str() );
+    throw;
+  }
+#ifdef _WIN32
+  // `rename` does not replace existing files on Windows.
+  if( !MoveFileExA( tmp_path.c_str(), path.c_str(),
+                    MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) )
+#else
+  if( std::rename( tmp_path.c_str(), path.c_str() ) != 0 )
+#endif
+  {
+#ifndef _WIN32
+    int const err = errno;
+    std::remove( tmp_path.c_str() );
+    errno = err;
+#else
+    std::remove( tmp_path.c_str() );
+#endif
+    throw_file_error( "failed to replace", path );
+  }
+}
+
+} // namespace myengine
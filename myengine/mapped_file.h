@@ -0,0 +1,137 @@
+#ifndef MYENGINE_MAPPED_FILE_H
+#define MYENGINE_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <utility>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine {
+
+/**
+ * RAII wrapper around a memory-mapped file.
+ *
+ * The whole file is mapped. Instances are move-only; the mapping (and file
+ * handle) is released on destruction or `close`.
+ *
+ * This is intentionally minimal: POSIX `mmap` everywhere but Windows, where
+ * file mapping objects are used instead.
+ */
+class MYENGINE_EXPORT mapped_file
+{
+public:
+  /// An empty, unmapped instance.
+  mapped_file();
+
+  mapped_file( mapped_file&& other ) noexcept;
+  mapped_file& operator=( mapped_file&& other ) noexcept;
+
+  mapped_file( mapped_file const& ) = delete;
+  mapped_file& operator=( mapped_file const& ) = delete;
+
+  ~mapped_file();
+
+  /**
+   * Map an existing file for reading.
+   *
+   * @param path File to map.
+   *
+   * @throws std::runtime_error Failed to open or map the file.
+   */
+  [[nodiscard]] static mapped_file
+  open_read( std::string const& path );
+
+  /**
+   * Create (or truncate) a file of the given size and map it for writing.
+   *
+   * New contents are zero-filled.
+   *
+   * @param path File to create.
+   * @param size Size in bytes of the new file. Must be non-zero.
+   *
+   * @throws std::runtime_error Failed to create, size or map the file.
+   */
+  [[nodiscard]] static mapped_file
+  create( std::string const& path, std::size_t size );
+
+  /// Start of the mapping, or null if nothing is mapped.
+  [[nodiscard]] uint8_t*
+  data() const
+  {
+    return m_data;
+  }
+
+  /// Size of the mapping in bytes.
+  [[nodiscard]] std::size_t
+  size() const
+  {
+    return m_size;
+  }
+
+  /// If something is currently mapped.
+  [[nodiscard]] bool
+  is_open() const
+  {
+    return m_data != nullptr;
+  }
+
+  /// Path of the mapped file, empty if nothing is mapped.
+  [[nodiscard]] std::string const&
+  path() const
+  {
+    return m_path;
+  }
+
+  /**
+   * Write dirty pages of a writable mapping back to the file.
+   *
+   * @param wait Block until the write completes (otherwise only schedule it).
+   */
+  void flush( bool wait = true );
+
+  /**
+   * Unmap and close the file.
+   *
+   * @param final_size If not `npos`, truncate a writable file to this many
+   * bytes after unmapping, e.g. to drop unused space at the end.
+   */
+  void close( std::size_t final_size = npos );
+
+  static constexpr std::size_t npos = static_cast< std::size_t >( -1 );
+
+private:
+  std::string m_path;
+  uint8_t* m_data;
+  std::size_t m_size;
+  bool m_writable;
+#ifdef _WIN32
+  void* m_file_handle;
+  void* m_mapping_handle;
+#else
+  int m_fd;
+#endif
+
+  void reset();
+};
+
+/**
+ * Replace the contents of a file such that readers see either the old or the
+ * new contents, never a mix: the data is written to `<path>.tmp`, flushed, and
+ * then renamed over `path`.
+ *
+ * @param parts Pieces of the new contents, concatenated in order.
+ *
+ * @throws std::runtime_error Failed to write or rename the file.
+ */
+void
+MYENGINE_EXPORT
+write_file_atomic( std::string const& path,
+                   std::initializer_list< std::pair< void const*, std::size_t > >
+                     parts );
+
+} // namespace myengine
+
+#endif //MYENGINE_MAPPED_FILE_H
@@ -0,0 +1,437 @@
+#define MYENGINE_LOG_MODULE "vulkan.memory"
+#include "memory_allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+/// Heaps up to this size get blocks of an eighth of the heap.
+constexpr VkDeviceSize SMALL_HEAP_SIZE = VkDeviceSize( 1 ) << 30;
+
+} // namespace
+
+device_memory_allocator::device_memory_allocator(
+  VkPhysicalDevice physical_device, VkDevice device,
+  memory_allocator_config const& config )
+  : m_device( device ),
+    m_memory_properties(),
+    m_granularity( 1 ),
+    m_max_allocation_count( 0 ),
+    m_dedicated_queries( false ),
+    m_config( config ),
+    m_mutex(),
+    m_blocks(),
+    m_device_memory_count( 0 ),
+    m_dedicated_count(),
+    m_dedicated_bytes()
+{
+  auto const& caps = get_device_capabilities( physical_device );
+  m_memory_properties = caps.memory_properties;
+  m_granularity =
+    std::max< VkDeviceSize >( caps.properties.limits.bufferImageGranularity,
+                              1 );
+  m_max_allocation_count = caps.properties.limits.maxMemoryAllocationCount;
+  // The device's version alone is not enough: an instance created for 1.0
+  // does not expose the 1.1 entry points.
+  m_dedicated_queries =
+    std::min( m_config.api_version, caps.properties.apiVersion ) >=
+    VK_API_VERSION_1_1;
+  if( m_config.block_size == 0 )
+  {
+    throw std::runtime_error( "Device memory block size must not be 0" );
+  }
+  m_dedicated_count.resize( m_memory_properties.memoryTypeCount, 0 );
+  m_dedicated_bytes.resize( m_memory_properties.memoryTypeCount, 0 );
+  LOGF_DEBUG( "Device memory allocator: {} MiB blocks, buffer-image "
+              "granularity {}, at most {} allocations",
+              to_mib( m_config.block_size ), m_granularity,
+              m_max_allocation_count );
+}
+
+device_memory_allocator::~device_memory_allocator()
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  memory_statistics const s = statistics_locked( UINT32_MAX );
+  if( s.allocation_count > 0 || s.dedicated_count > 0 )
+  {
+    LOGF_WARN( "Device memory allocator destroyed with {} allocation(s) and "
+               "{} dedicated allocation(s) still live",
+               s.allocation_count, s.dedicated_count );
+  }
+  for( auto const& b : m_blocks )
+  {
+    if( b.memory != VK_NULL_HANDLE )
+    {
+      vkFreeMemory( m_device, b.memory, nullptr );
+    }
+  }
+}
+
+memory_allocation
+device_memory_allocator::allocate( VkMemoryRequirements const& reqs,
+                                   VkMemoryPropertyFlags required,
+                                   VkMemoryPropertyFlags preferred,
+                                   resource_kind kind, bool dedicated )
+{
+  return allocate( reqs, required, preferred, kind, dedicated, nullptr );
+}
+
+memory_allocation
+device_memory_allocator::allocate(
+  VkMemoryRequirements const& reqs, VkMemoryPropertyFlags required,
+  VkMemoryPropertyFlags preferred, resource_kind kind, bool dedicated,
+  VkMemoryDedicatedAllocateInfo const* dedicated_info )
+{
+  PROFILE_FUNCTION();
+  std::lock_guard< std::mutex > lock( m_mutex );
+  memory_allocation a;
+  a.memory_type = find_memory_type( m_memory_properties, reqs.memoryTypeBits,
+                                    required, preferred );
+  a.size = std::max< VkDeviceSize >( reqs.size, 1 );
+  VkDeviceSize const alignment = std::max< VkDeviceSize >( reqs.alignment, 1 );
+  VkDeviceSize const block_bytes = block_size( a.memory_type );
+  VkDeviceSize const threshold = m_config.dedicated_threshold
+                                   ? m_config.dedicated_threshold
+                                   : block_bytes / 2;
+  // Without a granularity constraint, everything can share blocks.
+  if( m_granularity <= 1 )
+  {
+    kind = resource_kind::linear;
+  }
+
+  if( dedicated || a.size >= threshold )
+  {
+    check_result( allocate_memory( a.memory_type, a.size, a.memory, a.mapped,
+                                   dedicated_info ),
+                  "allocate dedicated device memory" );
+    ++m_dedicated_count[ a.memory_type ];
+    m_dedicated_bytes[ a.memory_type ] += a.size;
+    return a;
+  }
+
+  for( uint32_t i = 0; i < m_blocks.size(); ++i )
+  {
+    block& b = m_blocks[ i ];
+    if( b.memory == VK_NULL_HANDLE || b.memory_type != a.memory_type ||
+        b.kind != kind )
+    {
+      continue;
+    }
+    a.range = b.ranges->allocate( a.size, alignment, a.offset );
+    if( a.range != tlsf_allocator::INVALID_HANDLE )
+    {
+      a.block = i;
+      a.memory = b.memory;
+      a.mapped = b.mapped ? static_cast< uint8_t* >( b.mapped ) + a.offset
+                          : nullptr;
+      return a;
+    }
+  }
+
+  // New block. If the heap is tight, settle for smaller ones down to what is
+  // needed.
+  block b = { VK_NULL_HANDLE, a.memory_type, kind, nullptr, nullptr };
+  VkDeviceSize size = std::max( block_bytes, a.size + alignment );
+  VkResult res;
+  for( ;; )
+  {
+    res = allocate_memory( a.memory_type, size, b.memory, b.mapped );
+    if( res != VK_ERROR_OUT_OF_DEVICE_MEMORY || size / 2 < a.size + alignment )
+    {
+      break;
+    }
+    size /= 2;
+  }
+  check_result( res, "allocate device memory block" );
+  b.ranges = std::make_unique< tlsf_allocator >( size );
+  a.range = b.ranges->allocate( a.size, alignment, a.offset );
+  a.memory = b.memory;
+  a.mapped =
+    b.mapped ? static_cast< uint8_t* >( b.mapped ) + a.offset : nullptr;
+  LOGF_DEBUG( "New {} MiB block of memory type {}", to_mib( size ),
+              a.memory_type );
+
+  auto const unused = std::find_if( m_blocks.begin(), m_blocks.end(),
+                                    []( block const& u ) {
+                                      return u.memory == VK_NULL_HANDLE;
+                                    } );
+  a.block = static_cast< uint32_t >( unused - m_blocks.begin() );
+  if( unused == m_blocks.end() )
+  {
+    m_blocks.push_back( std::move( b ) );
+  }
+  else
+  {
+    *unused = std::move( b );
+  }
+  return a;
+}
+
+memory_allocation
+device_memory_allocator::allocate_buffer( VkBuffer buffer,
+                                          VkMemoryPropertyFlags required,
+                                          VkMemoryPropertyFlags preferred )
+{
+  VkMemoryRequirements reqs;
+  bool dedicated = false;
+  VkMemoryDedicatedAllocateInfo dedicated_info = {};
+  dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+  dedicated_info.buffer = buffer;
+  if( m_dedicated_queries )
+  {
+    VkMemoryDedicatedRequirements dedicated_reqs = {};
+    dedicated_reqs.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 reqs2 = {};
+    reqs2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    reqs2.pNext = &dedicated_reqs;
+    VkBufferMemoryRequirementsInfo2 info = {};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    info.buffer = buffer;
+    vkGetBufferMemoryRequirements2( m_device, &info, &reqs2 );
+    reqs = reqs2.memoryRequirements;
+    dedicated = dedicated_reqs.prefersDedicatedAllocation ||
+                dedicated_reqs.requiresDedicatedAllocation;
+  }
+  else
+  {
+    vkGetBufferMemoryRequirements( m_device, buffer, &reqs );
+  }
+  memory_allocation a =
+    allocate( reqs, required, preferred, resource_kind::linear, dedicated,
+              m_dedicated_queries ? &dedicated_info : nullptr );
+  VkResult const res =
+    vkBindBufferMemory( m_device, buffer, a.memory, a.offset );
+  if( res != VK_SUCCESS )
+  {
+    free( a );
+    check_result( res, "bind buffer memory" );
+  }
+  return a;
+}
+
+memory_allocation
+device_memory_allocator::allocate_image( VkImage image, VkImageTiling tiling,
+                                         VkMemoryPropertyFlags required,
+                                         VkMemoryPropertyFlags preferred )
+{
+  VkMemoryRequirements reqs;
+  bool dedicated = false;
+  VkMemoryDedicatedAllocateInfo dedicated_info = {};
+  dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+  dedicated_info.image = image;
+  if( m_dedicated_queries )
+  {
+    VkMemoryDedicatedRequirements dedicated_reqs = {};
+    dedicated_reqs.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 reqs2 = {};
+    reqs2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    reqs2.pNext = &dedicated_reqs;
+    VkImageMemoryRequirementsInfo2 info = {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    info.image = image;
+    vkGetImageMemoryRequirements2( m_device, &info, &reqs2 );
+    reqs = reqs2.memoryRequirements;
+    dedicated = dedicated_reqs.prefersDedicatedAllocation ||
+                dedicated_reqs.requiresDedicatedAllocation;
+  }
+  else
+  {
+    vkGetImageMemoryRequirements( m_device, image, &reqs );
+  }
+  memory_allocation a =
+    allocate( reqs, required, preferred,
+              tiling == VK_IMAGE_TILING_LINEAR ? resource_kind::linear
+                                               : resource_kind::optimal,
+              dedicated, m_dedicated_queries ? &dedicated_info : nullptr );
+  VkResult const res = vkBindImageMemory( m_device, image, a.memory, a.offset );
+  if( res != VK_SUCCESS )
+  {
+    free( a );
+    check_result( res, "bind image memory" );
+  }
+  return a;
+}
+
+void
+device_memory_allocator::free( memory_allocation const& allocation )
+{
+  if( allocation.memory == VK_NULL_HANDLE )
+  {
+    return;
+  }
+  PROFILE_FUNCTION();
+  std::lock_guard< std::mutex > lock( m_mutex );
+  if( allocation.block == UINT32_MAX )
+  {
+    free_memory( allocation.memory );
+    --m_dedicated_count[ allocation.memory_type ];
+    m_dedicated_bytes[ allocation.memory_type ] -= allocation.size;
+    return;
+  }
+
+  block& b = m_blocks[ allocation.block ];
+  b.ranges->free( allocation.range );
+  if( !b.ranges->empty() )
+  {
+    return;
+  }
+  // Keep one empty block per type and kind, free any other.
+  bool const spare = std::any_of(
+    m_blocks.begin(), m_blocks.end(), [ &b ]( block const& o ) {
+      return &o != &b && o.memory != VK_NULL_HANDLE &&
+             o.memory_type == b.memory_type && o.kind == b.kind &&
+             o.ranges->empty();
+    } );
+  if( spare )
+  {
+    free_memory( b.memory );
+    b.memory = VK_NULL_HANDLE;
+    b.mapped = nullptr;
+    b.ranges.reset();
+  }
+}
+
+VkDeviceSize
+device_memory_allocator::block_size( uint32_t memory_type ) const
+{
+  VkDeviceSize const heap =
+    m_memory_properties
+      .memoryHeaps[ m_memory_properties.memoryTypes[ memory_type ].heapIndex ]
+      .size;
+  if( heap <= SMALL_HEAP_SIZE )
+  {
+    return std::max< VkDeviceSize >(
+      std::min( m_config.block_size, heap / 8 ), 1 );
+  }
+  return m_config.block_size;
+}
+
+VkResult
+device_memory_allocator::allocate_memory( uint32_t memory_type,
+                                          VkDeviceSize size,
+                                          VkDeviceMemory& memory,
+                                          void*& mapped, void const* next )
+{
+  if( m_max_allocation_count != 0 &&
+      m_device_memory_count >= m_max_allocation_count )
+  {
+    return VK_ERROR_TOO_MANY_OBJECTS;
+  }
+  VkMemoryAllocateInfo alloc_info = {};
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = next;
+  alloc_info.allocationSize = size;
+  alloc_info.memoryTypeIndex = memory_type;
+  if( VkResult const res =
+        vkAllocateMemory( m_device, &alloc_info, nullptr, &memory );
+      res != VK_SUCCESS )
+  {
+    return res;
+  }
+  mapped = nullptr;
+  if( m_memory_properties.memoryTypes[ memory_type ].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT )
+  {
+    if( VkResult const res =
+          vkMapMemory( m_device, memory, 0, VK_WHOLE_SIZE, 0, &mapped );
+        res != VK_SUCCESS )
+    {
+      vkFreeMemory( m_device, memory, nullptr );
+      memory = VK_NULL_HANDLE;
+      return res;
+    }
+  }
+  ++m_device_memory_count;
+  return VK_SUCCESS;
+}
+
+void
+device_memory_allocator::free_memory( VkDeviceMemory memory )
+{
+  // Freeing implicitly unmaps.
+  vkFreeMemory( m_device, memory, nullptr );
+  --m_device_memory_count;
+}
+
+memory_statistics
+device_memory_allocator::statistics() const
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  return statistics_locked( UINT32_MAX );
+}
+
+memory_statistics
+device_memory_allocator::statistics( uint32_t memory_type ) const
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  return statistics_locked( memory_type );
+}
+
+memory_statistics
+device_memory_allocator::statistics_locked( uint32_t memory_type ) const
+{
+  bool const all = memory_type == UINT32_MAX;
+  memory_statistics s = {};
+  VkDeviceSize largest_sum = 0;
+  for( auto const& b : m_blocks )
+  {
+    if( b.memory == VK_NULL_HANDLE || ( !all && b.memory_type != memory_type ) )
+    {
+      continue;
+    }
+    tlsf_allocator::statistics const r = b.ranges->stats();
+    ++s.block_count;
+    s.allocation_count += r.allocation_count;
+    s.block_bytes += r.size;
+    s.used_bytes += r.used;
+    s.free_range_count += r.free_range_count;
+    s.largest_free_range =
+      std::max( s.largest_free_range, r.largest_free_range );
+    largest_sum += r.largest_free_range;
+  }
+  for( uint32_t t = 0; t < m_dedicated_count.size(); ++t )
+  {
+    if( all || t == memory_type )
+    {
+      s.dedicated_count += m_dedicated_count[ t ];
+      s.dedicated_bytes += m_dedicated_bytes[ t ];
+    }
+  }
+  s.device_memory_count = s.block_count + s.dedicated_count;
+  VkDeviceSize const free_bytes = s.block_bytes - s.used_bytes;
+  s.fragmentation =
+    free_bytes > 0
+    ? 1. - static_cast< double >( largest_sum ) / free_bytes : 0.;
+  return s;
+}
+
+void
+device_memory_allocator::log_statistics() const
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  for( uint32_t t = 0; t < m_memory_properties.memoryTypeCount; ++t )
+  {
+    memory_statistics const s = statistics_locked( t );
+    if( s.device_memory_count == 0 )
+    {
+      continue;
+    }
+    LOGF_INFO( "Memory type {} (heap {}): {} block(s), {} / {} MiB in {} "
+               "allocation(s), {} free range(s), {} fragmented; {} dedicated "
+               "allocation(s), {} MiB",
+               t, m_memory_properties.memoryTypes[ t ].heapIndex,
+               s.block_count, to_mib( s.used_bytes ), to_mib( s.block_bytes ),
+               s.allocation_count, s.free_range_count, s.fragmentation,
+               s.dedicated_count, to_mib( s.dedicated_bytes ) );
+  }
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,238 @@
+#ifndef MYENGINE_MEMORY_ALLOCATOR_H
+#define MYENGINE_MEMORY_ALLOCATOR_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+#include <myengine/tlsf.h>
+
+namespace myengine::vulkan {
+
+/**
+ * What a memory range is bound to, for `bufferImageGranularity`: linear and
+ * optimal resources must not share a granularity page.
+ */
+enum class resource_kind
+{
+  /// Buffers and linear tiling images.
+  linear,
+  /// Optimal tiling images.
+  optimal
+};
+
+struct memory_allocator_config
+{
+  /// Size of the `VkDeviceMemory` blocks sub-allocated from. Heaps of at most
+  /// 1 GiB use an eighth of the heap instead, if smaller.
+  VkDeviceSize block_size = VkDeviceSize( 64 ) << 20;
+  /// Resources at least this large get a dedicated `VkDeviceMemory`; 0 for
+  /// half the block size.
+  VkDeviceSize dedicated_threshold = 0;
+  /// Vulkan version the instance was created for
+  /// (`VkApplicationInfo::apiVersion`). From 1.1, if the device has it too,
+  /// the driver is asked which resources want dedicated memory.
+  uint32_t api_version = VK_API_VERSION_1_0;
+};
+
+/// A range of device memory from `device_memory_allocator`.
+struct memory_allocation
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  uint32_t memory_type = 0;
+  /// Host address of `offset` if the memory is host-visible, otherwise null.
+  /// Host-visible memory stays mapped for the allocator's lifetime.
+  void* mapped = nullptr;
+
+  // Allocator bookkeeping.
+  /// Block index, or `UINT32_MAX` for a dedicated allocation.
+  uint32_t block = UINT32_MAX;
+  tlsf_allocator::handle_t range = tlsf_allocator::INVALID_HANDLE;
+};
+
+/// Usage of a memory type, or of all of them.
+struct memory_statistics
+{
+  /// `VkDeviceMemory` objects: blocks plus dedicated allocations.
+  uint32_t device_memory_count;
+  uint32_t block_count;
+  /// Sub-allocations, not counting dedicated ones.
+  uint32_t allocation_count;
+  uint32_t dedicated_count;
+  VkDeviceSize block_bytes;
+  /// Bytes sub-allocated from blocks.
+  VkDeviceSize used_bytes;
+  VkDeviceSize dedicated_bytes;
+  /// Free ranges within blocks.
+  uint32_t free_range_count;
+  /// Largest free range in any one block.
+  VkDeviceSize largest_free_range;
+  /// 1 - (sum over blocks of their largest free range) / free bytes: 0 when
+  /// each block's free space is one range, approaching 1 as it splinters.
+  double fragmentation;
+};
+
+/**
+ * Sub-allocator of device memory.
+ *
+ * Allocating a `VkDeviceMemory` per resource is slow, and their number is
+ * capped by `maxMemoryAllocationCount` (4096 on many drivers). Instead, large
+ * blocks are allocated per memory type and ranges placed in them with a TLSF
+ * allocator, honoring each resource's alignment. When the device's
+ * `bufferImageGranularity` is above 1, linear and optimal resources go to
+ * separate blocks, so they can never share a page. Resources above the
+ * dedicated threshold, flagged as dedicated, or that the driver wants to
+ * have dedicated memory, get a `VkDeviceMemory` of their own.
+ *
+ * Blocks of host-visible types are persistently mapped. One empty block per
+ * memory type is kept around to avoid churn; further ones are freed.
+ *
+ * Thread-safe. Must be destroyed before the `VkDevice`, after freeing every
+ * allocation.
+ */
+class MYENGINE_EXPORT device_memory_allocator
+{
+public:
+  /**
+   * @throws std::runtime_error Invalid configuration.
+   */
+  device_memory_allocator( VkPhysicalDevice physical_device, VkDevice device,
+                           memory_allocator_config const& config =
+                             memory_allocator_config() );
+
+  device_memory_allocator( device_memory_allocator const& ) = delete;
+  device_memory_allocator& operator=( device_memory_allocator const& ) = delete;
+
+  /// Frees all blocks; allocations still live are reported.
+  ~device_memory_allocator();
+
+  /**
+   * Allocate memory for a resource.
+   *
+   * @param reqs Requirements of the resource, from
+   * `vkGet{Buffer,Image}MemoryRequirements`.
+   * @param required Property flags the memory type must have.
+   * @param preferred Property flags the memory type should have.
+   * @param kind What is bound to the memory.
+   * @param dedicated Give the resource its own `VkDeviceMemory`. Without a
+   * resource handle the driver is not told which resource it is for; use
+   * `allocate_buffer` or `allocate_image` for resources that need that.
+   *
+   * @throws std::runtime_error No suitable memory type, or out of memory.
+   */
+  [[nodiscard]] memory_allocation
+  allocate( VkMemoryRequirements const& reqs, VkMemoryPropertyFlags required,
+            VkMemoryPropertyFlags preferred = 0,
+            resource_kind kind = resource_kind::linear,
+            bool dedicated = false );
+
+  /**
+   * Allocate memory for a buffer and bind it.
+   *
+   * With Vulkan 1.1 (see `memory_allocator_config::api_version`), the buffer
+   * gets a dedicated allocation, made for it with
+   * `VkMemoryDedicatedAllocateInfo`, when the driver prefers or requires that
+   * (`VkMemoryDedicatedRequirements`), or when it is over the dedicated
+   * threshold.
+   *
+   * @throws std::runtime_error As `allocate`, or binding failed.
+   */
+  [[nodiscard]] memory_allocation
+  allocate_buffer( VkBuffer buffer, VkMemoryPropertyFlags required,
+                   VkMemoryPropertyFlags preferred = 0 );
+
+  /**
+   * Allocate memory for an image and bind it. Dedicated allocations are as
+   * for `allocate_buffer`.
+   *
+   * @param tiling Tiling the image was created with.
+   *
+   * @throws std::runtime_error As `allocate`, or binding failed.
+   */
+  [[nodiscard]] memory_allocation
+  allocate_image( VkImage image, VkImageTiling tiling,
+                  VkMemoryPropertyFlags required,
+                  VkMemoryPropertyFlags preferred = 0 );
+
+  /// Free an allocation; a default constructed one is ignored.
+  void free( memory_allocation const& allocation );
+
+  /// Usage of all memory types.
+  [[nodiscard]] memory_statistics statistics() const;
+
+  /// Usage of one memory type.
+  [[nodiscard]] memory_statistics statistics( uint32_t memory_type ) const;
+
+  /// Log usage per memory type in use, at info level.
+  void log_statistics() const;
+
+  [[nodiscard]] VkDevice
+  device() const
+  {
+    return m_device;
+  }
+
+  [[nodiscard]] VkPhysicalDeviceMemoryProperties const&
+  memory_properties() const
+  {
+    return m_memory_properties;
+  }
+
+private:
+  struct block
+  {
+    VkDeviceMemory memory;
+    uint32_t memory_type;
+    resource_kind kind;
+    void* mapped;
+    std::unique_ptr< tlsf_allocator > ranges;
+  };
+
+  VkDevice m_device;
+  VkPhysicalDeviceMemoryProperties m_memory_properties;
+  VkDeviceSize m_granularity;
+  uint32_t m_max_allocation_count;
+  /// If Vulkan 1.1 dedicated allocation queries can be used: both the
+  /// instance and the device are at least 1.1.
+  bool m_dedicated_queries;
+  memory_allocator_config m_config;
+
+  mutable std::mutex m_mutex;
+  /// Entries with a null `memory` are unused, for reuse by the next block.
+  std::vector< block > m_blocks;
+  /// `VkDeviceMemory` objects currently allocated.
+  uint32_t m_device_memory_count;
+  /// Per memory type.
+  std::vector< uint32_t > m_dedicated_count;
+  std::vector< VkDeviceSize > m_dedicated_bytes;
+
+  /// Block size for a memory type.
+  [[nodiscard]] VkDeviceSize block_size( uint32_t memory_type ) const;
+  /// `allocate`, telling the driver which resource a dedicated allocation is
+  /// for when `dedicated_info` is not null.
+  [[nodiscard]] memory_allocation
+  allocate( VkMemoryRequirements const& reqs, VkMemoryPropertyFlags required,
+            VkMemoryPropertyFlags preferred, resource_kind kind,
+            bool dedicated,
+            VkMemoryDedicatedAllocateInfo const* dedicated_info );
+  /// Allocate and map device memory, counting it. `next` is chained to the
+  /// allocate info. Expects the lock.
+  VkResult allocate_memory( uint32_t memory_type, VkDeviceSize size,
+                            VkDeviceMemory& memory, void*& mapped,
+                            void const* next = nullptr );
+  /// Expects the lock.
+  void free_memory( VkDeviceMemory memory );
+  /// Expects the lock.
+  [[nodiscard]] memory_statistics
+  statistics_locked( uint32_t memory_type ) const;
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_MEMORY_ALLOCATOR_H
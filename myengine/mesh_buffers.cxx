@@ -0,0 +1,153 @@
+#include "mesh_buffers.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+VkBuffer
+create_buffer( VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage )
+{
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  check_result( vkCreateBuffer( device, &buffer_info, nullptr, &buffer ),
+                "create mesh buffer" );
+  return buffer;
+}
+
+/**
+ * If all device-local memory is also host-visible and coherent, so that the
+ * data is always copied directly and the buffers are never a transfer
+ * destination.
+ */
+bool
+always_direct( VkPhysicalDeviceMemoryProperties const& properties )
+{
+  VkMemoryPropertyFlags const direct = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  bool any = false;
+  for( uint32_t i = 0; i < properties.memoryTypeCount; ++i )
+  {
+    VkMemoryPropertyFlags const flags =
+      properties.memoryTypes[ i ].propertyFlags;
+    if( flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT )
+    {
+      if( ( flags & direct ) != direct )
+      {
+        return false;
+      }
+      any = true;
+    }
+  }
+  return any;
+}
+
+} // namespace
+
+mesh_buffers::mesh_buffers( VkDevice device,
+                            device_memory_allocator& allocator,
+                            upload_ring& ring, mesh_view const& mesh,
+                            VkBufferUsageFlags extra_usage )
+  : m_device( device ),
+    m_allocator( allocator ),
+    m_vertices( VK_NULL_HANDLE ),
+    m_vertex_memory(),
+    m_indices( VK_NULL_HANDLE ),
+    m_index_memory(),
+    m_index_type( mesh.index_size == 2 ? VK_INDEX_TYPE_UINT16
+                                       : VK_INDEX_TYPE_UINT32 ),
+    m_index_count( mesh.index_count ),
+    m_direct( true )
+{
+  if( mesh.vertex_bytes == 0 || mesh.index_bytes == 0 )
+  {
+    throw std::invalid_argument( "Mesh has no vertices or no indices" );
+  }
+  VkBufferUsageFlags const usage =
+    extra_usage | ( always_direct( m_allocator.memory_properties() )
+                      ? 0
+                      : VK_BUFFER_USAGE_TRANSFER_DST_BIT );
+  try
+  {
+    m_vertices = create_buffer( m_device, mesh.vertex_bytes,
+                                usage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT );
+    m_vertex_memory = m_allocator.allocate_buffer(
+      m_vertices, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+    m_indices = create_buffer( m_device, mesh.index_bytes,
+                               usage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT );
+    m_index_memory = m_allocator.allocate_buffer(
+      m_indices, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+    fill( ring, m_vertices, m_vertex_memory, mesh.vertices,
+          mesh.vertex_bytes );
+    fill( ring, m_indices, m_index_memory, mesh.indices, mesh.index_bytes );
+  }
+  catch( ... )
+  {
+    destroy();
+    throw;
+  }
+}
+
+mesh_buffers::~mesh_buffers()
+{
+  destroy();
+}
+
+void
+mesh_buffers::destroy()
+{
+  vkDestroyBuffer( m_device, m_vertices, nullptr );
+  m_allocator.free( m_vertex_memory );
+  vkDestroyBuffer( m_device, m_indices, nullptr );
+  m_allocator.free( m_index_memory );
+  m_vertices = VK_NULL_HANDLE;
+  m_vertex_memory = memory_allocation();
+  m_indices = VK_NULL_HANDLE;
+  m_index_memory = memory_allocation();
+}
+
+void
+mesh_buffers::fill( upload_ring& ring, VkBuffer buffer,
+                    memory_allocation const& memory, void const* data,
+                    std::size_t size )
+{
+  VkMemoryPropertyFlags const flags =
+    m_allocator.memory_properties()
+      .memoryTypes[ memory.memory_type ]
+      .propertyFlags;
+  if( memory.mapped && ( flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ) )
+  {
+    std::memcpy( memory.mapped, data, size );
+    return;
+  }
+  m_direct = false;
+  // In pieces of at most half the ring, so a large mesh streams through it
+  // instead of not fitting.
+  std::size_t const chunk = std::max< std::size_t >( 4, ring.capacity() / 2 /
+                                                          4 * 4 );
+  auto const* bytes = static_cast< uint8_t const* >( data );
+  for( std::size_t offset = 0; offset < size; offset += chunk )
+  {
+    ring.upload( buffer, offset, bytes + offset,
+                 std::min( chunk, size - offset ) );
+  }
+}
+
+void
+mesh_buffers::bind( VkCommandBuffer cmd ) const
+{
+  VkDeviceSize const offset = 0;
+  vkCmdBindVertexBuffers( cmd, 0, 1, &m_vertices, &offset );
+  vkCmdBindIndexBuffer( cmd, m_indices, 0, m_index_type );
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,101 @@
+#ifndef MYENGINE_MESH_BUFFERS_H
+#define MYENGINE_MESH_BUFFERS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/memory_allocator.h>
+#include <myengine/mesh_file.h>
+#include <myengine/myengine_export.h>
+#include <myengine/upload_ring.h>
+
+namespace myengine::vulkan {
+
+/**
+ * Vertex and index buffers of a mesh, in device-local memory.
+ *
+ * The data is copied once from wherever it is, typically a mapped
+ * `mesh_file`, with no conversion. When the memory the buffers get is also
+ * host-visible and coherent (integrated and CPU devices, resizable BAR), it is
+ * copied straight into it. Otherwise it goes through the staging memory of an
+ * `upload_ring`, and the copies are visible to later commands on the ring's
+ * queue once its batch is submitted.
+ *
+ * Must be destroyed before the allocator and the `VkDevice`, once the device
+ * is done with the buffers.
+ */
+class MYENGINE_EXPORT mesh_buffers
+{
+public:
+  /**
+   * @param extra_usage Usage for both buffers besides vertex or index, e.g.
+   * `VK_BUFFER_USAGE_STORAGE_BUFFER_BIT` for vertex pulling.
+   * @throws std::invalid_argument The mesh has no vertices or no indices.
+   * @throws std::runtime_error Failed to create the buffers, or to stage.
+   */
+  mesh_buffers( VkDevice device, device_memory_allocator& allocator,
+                upload_ring& ring, mesh_view const& mesh,
+                VkBufferUsageFlags extra_usage = 0 );
+
+  mesh_buffers( mesh_buffers const& ) = delete;
+  mesh_buffers& operator=( mesh_buffers const& ) = delete;
+
+  ~mesh_buffers();
+
+  /// Bind the vertices to binding 0, and the indices.
+  void bind( VkCommandBuffer cmd ) const;
+
+  [[nodiscard]] VkBuffer
+  vertex_buffer() const
+  {
+    return m_vertices;
+  }
+
+  [[nodiscard]] VkBuffer
+  index_buffer() const
+  {
+    return m_indices;
+  }
+
+  [[nodiscard]] VkIndexType
+  index_type() const
+  {
+    return m_index_type;
+  }
+
+  [[nodiscard]] uint32_t
+  index_count() const
+  {
+    return m_index_count;
+  }
+
+  /// If the data was copied into the buffers' memory directly, not staged.
+  [[nodiscard]] bool
+  direct() const
+  {
+    return m_direct;
+  }
+
+private:
+  VkDevice m_device;
+  device_memory_allocator& m_allocator;
+  VkBuffer m_vertices;
+  memory_allocation m_vertex_memory;
+  VkBuffer m_indices;
+  memory_allocation m_index_memory;
+  VkIndexType m_index_type;
+  uint32_t m_index_count;
+  bool m_direct;
+
+  /// Copy into a buffer, directly or through the ring.
+  void fill( upload_ring& ring, VkBuffer buffer,
+             memory_allocation const& memory, void const* data,
+             std::size_t size );
+  void destroy();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_MESH_BUFFERS_H
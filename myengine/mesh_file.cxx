@@ -0,0 +1,412 @@
+#include "mesh_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace myengine {
+
+namespace {
+
+/// Padding source for aligning sections.
+uint8_t const ZEROS[ MESH_SECTION_ALIGNMENT ] = {};
+
+/// Sections written, in order.
+constexpr uint32_t SECTION_COUNT = 3;
+
+/// Bytes of an attribute of a format, or 0 if not supported in mesh files.
+uint32_t
+format_size( uint32_t format )
+{
+  switch( static_cast< VkFormat >( format ) )
+  {
+    case VK_FORMAT_R32_SFLOAT:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SNORM:
+    case VK_FORMAT_R16G16_SFLOAT:
+      return 4;
+    case VK_FORMAT_R32G32_SFLOAT:
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+      return 8;
+    case VK_FORMAT_R32G32B32_SFLOAT:
+      return 12;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+uint64_t
+align_up( uint64_t offset )
+{
+  return ( offset + MESH_SECTION_ALIGNMENT - 1 ) /
+         MESH_SECTION_ALIGNMENT * MESH_SECTION_ALIGNMENT;
+}
+
+/// If the attributes fit the stride, and there is a float position.
+bool
+valid_layout( mesh_attribute const* attributes, uint32_t count,
+              uint32_t stride, char const*& reason )
+{
+  bool position = false;
+  for( uint32_t i = 0; i < count; ++i )
+  {
+    mesh_attribute const& a = attributes[ i ];
+    uint32_t const size = format_size( a.format );
+    if( size == 0 )
+    {
+      reason = "unsupported attribute format";
+      return false;
+    }
+    if( a.offset > stride || size > stride - a.offset )
+    {
+      reason = "attribute outside of the vertex stride";
+      return false;
+    }
+    position = position || ( a.semantic == mesh_semantic::position &&
+                             a.format == VK_FORMAT_R32G32B32_SFLOAT );
+  }
+  if( !position )
+  {
+    reason = "no R32G32B32_SFLOAT position attribute";
+    return false;
+  }
+  return true;
+}
+
+/// Bounding sphere of the vertices a submesh uses.
+void
+bound_submesh( mesh_data const& mesh, uint32_t position_offset,
+               mesh_submesh& s )
+{
+  auto const position = [ & ]( uint32_t index, float p[ 3 ] ) {
+    std::size_t const vertex =
+      static_cast< std::size_t >( int64_t( index ) + s.vertex_offset );
+    std::memcpy( p,
+                 &mesh.vertices[ vertex * mesh.vertex_stride +
+                                 position_offset ],
+                 3 * sizeof( float ) );
+  };
+  float lo[ 3 ] = { std::numeric_limits< float >::max(),
+                    std::numeric_limits< float >::max(),
+                    std::numeric_limits< float >::max() };
+  float hi[ 3 ] = { -lo[ 0 ], -lo[ 1 ], -lo[ 2 ] };
+  for( uint32_t i = 0; i < s.index_count; ++i )
+  {
+    float p[ 3 ];
+    position( mesh.indices[ s.first_index + i ], p );
+    for( int c = 0; c < 3; ++c )
+    {
+      lo[ c ] = std::min( lo[ c ], p[ c ] );
+      hi[ c ] = std::max( hi[ c ], p[ c ] );
+    }
+  }
+  float radius_sq = 0.f;
+  for( int c = 0; c < 3; ++c )
+  {
+    s.center[ c ] = s.index_count ? 0.5f * ( lo[ c ] + hi[ c ] ) : 0.f;
+  }
+  for( uint32_t i = 0; i < s.index_count; ++i )
+  {
+    float p[ 3 ];
+    position( mesh.indices[ s.first_index + i ], p );
+    float d_sq = 0.f;
+    for( int c = 0; c < 3; ++c )
+    {
+      d_sq += ( p[ c ] - s.center[ c ] ) * ( p[ c ] - s.center[ c ] );
+    }
+    radius_sq = std::max( radius_sq, d_sq );
+  }
+  s.radius = std::sqrt( radius_sq );
+}
+
+[[noreturn]] void
+invalid_file( std::string const& path, char const* reason )
+{
+  throw std::runtime_error( std::string( "Not a valid mesh file (" ) +
+                            reason + "): " + path );
+}
+
+} // namespace
+
+mesh_view
+mesh_data::view() const
+{
+  mesh_view v;
+  v.vertices = vertices.data();
+  v.vertex_bytes = vertices.size();
+  v.vertex_count = vertex_count();
+  v.indices = indices.data();
+  v.index_bytes = indices.size() * sizeof( uint32_t );
+  v.index_count = static_cast< uint32_t >( indices.size() );
+  v.index_size = sizeof( uint32_t );
+  return v;
+}
+
+void
+write_mesh_file( std::string const& path, mesh_data const& mesh )
+{
+  char const* reason = nullptr;
+  if( mesh.vertex_stride == 0 ||
+      mesh.vertices.size() % mesh.vertex_stride != 0 )
+  {
+    throw std::invalid_argument(
+      "Mesh vertices are not a whole number of vertices" );
+  }
+  if( mesh.vertices.size() / mesh.vertex_stride >
+        std::numeric_limits< uint32_t >::max() ||
+      mesh.indices.size() > std::numeric_limits< uint32_t >::max() )
+  {
+    throw std::invalid_argument( "Mesh too large" );
+  }
+  if( !valid_layout( mesh.attributes.data(),
+                     static_cast< uint32_t >( mesh.attributes.size() ),
+                     mesh.vertex_stride, reason ) )
+  {
+    throw std::invalid_argument( std::string( "Invalid mesh: " ) + reason );
+  }
+  uint32_t const vertex_count = mesh.vertex_count();
+  uint32_t const index_count = static_cast< uint32_t >( mesh.indices.size() );
+
+  std::vector< mesh_submesh > submeshes = mesh.submeshes;
+  if( submeshes.empty() )
+  {
+    submeshes.push_back( { 0, index_count, 0, 0, {}, 0.f } );
+  }
+  for( auto const& s : submeshes )
+  {
+    if( s.first_index > index_count ||
+        s.index_count > index_count - s.first_index )
+    {
+      throw std::invalid_argument( "Mesh submesh outside of the indices" );
+    }
+    for( uint32_t i = 0; i < s.index_count; ++i )
+    {
+      int64_t const vertex =
+        int64_t( mesh.indices[ s.first_index + i ] ) + s.vertex_offset;
+      if( vertex < 0 || vertex >= vertex_count )
+      {
+        throw std::invalid_argument( "Mesh index out of range" );
+      }
+    }
+  }
+
+  mesh_file_header header = {};
+  std::memcpy( header.magic, MESH_MAGIC, sizeof( header.magic ) );
+  header.version = MESH_VERSION;
+  header.byte_order = MESH_BYTE_ORDER;
+  header.attribute_count = static_cast< uint32_t >( mesh.attributes.size() );
+  header.section_count = SECTION_COUNT;
+  header.vertex_count = vertex_count;
+  header.vertex_stride = mesh.vertex_stride;
+  header.index_count = index_count;
+  // By the stored values: with submesh vertex offsets, those can be above
+  // the vertex count.
+  uint32_t const max_index =
+    mesh.indices.empty()
+      ? 0
+      : *std::max_element( mesh.indices.begin(), mesh.indices.end() );
+  header.index_size = max_index <= UINT16_MAX ? 2 : 4;
+  header.submesh_count = static_cast< uint32_t >( submeshes.size() );
+
+  uint32_t const position_offset =
+    std::find_if( mesh.attributes.begin(), mesh.attributes.end(),
+                  []( mesh_attribute const& a ) {
+                    return a.semantic == mesh_semantic::position &&
+                           a.format == VK_FORMAT_R32G32B32_SFLOAT;
+                  } )
+      ->offset;
+  for( auto& s : submeshes )
+  {
+    bound_submesh( mesh, position_offset, s );
+  }
+  for( int c = 0; c < 3; ++c )
+  {
+    header.bounds_min[ c ] = vertex_count ? std::numeric_limits< float >::max()
+                                          : 0.f;
+    header.bounds_max[ c ] = -header.bounds_min[ c ];
+  }
+  for( uint32_t v = 0; v < vertex_count; ++v )
+  {
+    float p[ 3 ];
+    std::memcpy( p,
+                 &mesh.vertices[ std::size_t( v ) * mesh.vertex_stride +
+                                 position_offset ],
+                 sizeof( p ) );
+    for( int c = 0; c < 3; ++c )
+    {
+      header.bounds_min[ c ] = std::min( header.bounds_min[ c ], p[ c ] );
+      header.bounds_max[ c ] = std::max( header.bounds_max[ c ], p[ c ] );
+    }
+  }
+
+  std::vector< uint16_t > short_indices;
+  void const* index_data = mesh.indices.data();
+  if( header.index_size == 2 )
+  {
+    short_indices.assign( mesh.indices.begin(), mesh.indices.end() );
+    index_data = short_indices.data();
+  }
+
+  mesh_section sections[ SECTION_COUNT ] = {
+    { mesh_section_kind::vertices, 0, 0, mesh.vertices.size() },
+    { mesh_section_kind::indices, 0, 0,
+      uint64_t( index_count ) * header.index_size },
+    { mesh_section_kind::submeshes, 0, 0,
+      submeshes.size() * sizeof( mesh_submesh ) } };
+  uint64_t const table_end =
+    sizeof( mesh_file_header ) +
+    mesh.attributes.size() * sizeof( mesh_attribute ) + sizeof( sections );
+  uint64_t end = table_end;
+  uint64_t padding[ SECTION_COUNT ];
+  for( uint32_t i = 0; i < SECTION_COUNT; ++i )
+  {
+    sections[ i ].offset = align_up( end );
+    padding[ i ] = sections[ i ].offset - end;
+    end = sections[ i ].offset + sections[ i ].size;
+  }
+  header.file_size = end;
+
+  write_file_atomic(
+    path,
+    { { &header, sizeof( header ) },
+      { mesh.attributes.data(),
+        mesh.attributes.size() * sizeof( mesh_attribute ) },
+      { sections, sizeof( sections ) },
+      { ZEROS, padding[ 0 ] },
+      { mesh.vertices.data(), sections[ 0 ].size },
+      { ZEROS, padding[ 1 ] },
+      { index_data, sections[ 1 ].size },
+      { ZEROS, padding[ 2 ] },
+      { submeshes.data(), sections[ 2 ].size } } );
+}
+
+mesh_file
+mesh_file::open( std::string const& path )
+{
+  mesh_file f;
+  f.m_file = mapped_file::open_read( path );
+  uint8_t const* base = f.m_file.data();
+  uint64_t const size = f.m_file.size();
+
+  if( size < sizeof( mesh_file_header ) )
+  {
+    invalid_file( path, "too small" );
+  }
+  auto const* header = reinterpret_cast< mesh_file_header const* >( base );
+  if( std::memcmp( header->magic, MESH_MAGIC, sizeof( header->magic ) ) != 0 )
+  {
+    invalid_file( path, "bad magic" );
+  }
+  if( header->byte_order != MESH_BYTE_ORDER )
+  {
+    invalid_file( path, "byte order mismatch" );
+  }
+  if( header->version != MESH_VERSION )
+  {
+    std::stringstream ss;
+    ss  << "Unsupported mesh file version " << header->version << ": "
+        << path;
+    throw std::runtime_error( ss.str() );
+  }
+  if( header->file_size != size )
+  {
+    invalid_file( path, "truncated" );
+  }
+  uint64_t const table_end =
+    sizeof( mesh_file_header ) +
+    uint64_t( header->attribute_count ) * sizeof( mesh_attribute ) +
+    uint64_t( header->section_count ) * sizeof( mesh_section );
+  if( table_end > size )
+  {
+    invalid_file( path, "tables past the end" );
+  }
+  if( header->index_size != 2 && header->index_size != 4 )
+  {
+    invalid_file( path, "bad index size" );
+  }
+  auto const* attributes = reinterpret_cast< mesh_attribute const* >(
+    base + sizeof( mesh_file_header ) );
+  char const* reason = nullptr;
+  if( header->vertex_stride == 0 ||
+      !valid_layout( attributes, header->attribute_count,
+                     header->vertex_stride, reason ) )
+  {
+    invalid_file( path, reason ? reason : "no vertex stride" );
+  }
+
+  auto const* sections = reinterpret_cast< mesh_section const* >(
+    attributes + header->attribute_count );
+  mesh_section const* found[ 3 ] = {};
+  for( uint32_t i = 0; i < header->section_count; ++i )
+  {
+    mesh_section const& s = sections[ i ];
+    if( s.offset % MESH_SECTION_ALIGNMENT != 0 || s.offset < table_end ||
+        s.offset > size || s.size > size - s.offset )
+    {
+      invalid_file( path, "section out of bounds" );
+    }
+    uint32_t const kind = static_cast< uint32_t >( s.kind );
+    if( kind >= 1 && kind <= 3 && !found[ kind - 1 ] )
+    {
+      found[ kind - 1 ] = &s;
+    }
+  }
+  mesh_section const* vertices = found[ 0 ];
+  mesh_section const* indices = found[ 1 ];
+  mesh_section const* submeshes = found[ 2 ];
+  if( !vertices || !indices || !submeshes )
+  {
+    invalid_file( path, "missing section" );
+  }
+  if( vertices->size !=
+        uint64_t( header->vertex_count ) * header->vertex_stride ||
+      indices->size != uint64_t( header->index_count ) * header->index_size ||
+      submeshes->size !=
+        uint64_t( header->submesh_count ) * sizeof( mesh_submesh ) )
+  {
+    invalid_file( path, "section size mismatch" );
+  }
+  auto const* submesh_data =
+    reinterpret_cast< mesh_submesh const* >( base + submeshes->offset );
+  for( uint32_t i = 0; i < header->submesh_count; ++i )
+  {
+    mesh_submesh const& s = submesh_data[ i ];
+    if( s.first_index > header->index_count ||
+        s.index_count > header->index_count - s.first_index )
+    {
+      invalid_file( path, "submesh outside of the indices" );
+    }
+  }
+
+  f.m_header = header;
+  f.m_attributes = attributes;
+  f.m_submeshes = submesh_data;
+  f.m_view.vertices = base + vertices->offset;
+  f.m_view.vertex_bytes = vertices->size;
+  f.m_view.vertex_count = header->vertex_count;
+  f.m_view.indices = base + indices->offset;
+  f.m_view.index_bytes = indices->size;
+  f.m_view.index_count = header->index_count;
+  f.m_view.index_size = header->index_size;
+  return f;
+}
+
+mesh_attribute const*
+mesh_file::find_attribute( mesh_semantic semantic ) const
+{
+  for( uint32_t i = 0; i < m_header->attribute_count; ++i )
+  {
+    if( m_attributes[ i ].semantic == semantic )
+    {
+      return &m_attributes[ i ];
+    }
+  }
+  return nullptr;
+}
+
+} // namespace myengine
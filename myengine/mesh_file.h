@@ -0,0 +1,238 @@
+/**
+ * Binary mesh files, laid out to be used as they are once mapped.
+ *
+ * A mesh file is a `mesh_file_header`, then `attribute_count`
+ * `mesh_attribute`s describing the interleaved vertex layout, then
+ * `section_count` `mesh_section`s locating the data:
+ *
+ *   - `vertices`: `vertex_count` vertices of `vertex_stride` bytes.
+ *   - `indices`: `index_count` indices of `index_size` bytes, 2 or 4.
+ *   - `submeshes`: `submesh_count` `mesh_submesh`es, ranges of indices with
+ *     their bounding spheres.
+ *
+ * Every section starts at a multiple of `MESH_SECTION_ALIGNMENT`, so vertices
+ * and indices can be copied into a staging buffer, or the mapped memory of a
+ * GPU buffer, in one `memcpy` each. Unknown sections are skipped by readers,
+ * so later versions can add some. Everything is in host byte order;
+ * `byte_order` in the header lets a reader detect a mismatch.
+ */
+
+#ifndef MYENGINE_MESH_FILE_H
+#define MYENGINE_MESH_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/mapped_file.h>
+#include <myengine/myengine_export.h>
+
+namespace myengine {
+
+/// First bytes of every mesh file.
+constexpr char MESH_MAGIC[ 8 ] = { 'M', 'Y', 'E', 'M', 'E', 'S', 'H', 'B' };
+
+/// Current format version.
+constexpr uint32_t MESH_VERSION = 1;
+
+/// Value of `mesh_file_header::byte_order` as written by the producer.
+constexpr uint32_t MESH_BYTE_ORDER = 0x01020304;
+
+/// Alignment of sections within the file: a page, so that a section can also
+/// be mapped, or imported as host memory, on its own.
+constexpr uint32_t MESH_SECTION_ALIGNMENT = 4096;
+
+enum class mesh_semantic : uint32_t
+{
+  position = 1,
+  normal = 2,
+  texcoord = 3,
+};
+
+enum class mesh_section_kind : uint32_t
+{
+  vertices = 1,
+  indices = 2,
+  submeshes = 3,
+};
+
+#pragma pack( push, 1 )
+
+/// Header at the start of every mesh file.
+struct mesh_file_header
+{
+  char magic[ 8 ];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t attribute_count;
+  uint32_t section_count;
+  uint32_t vertex_count;
+  uint32_t vertex_stride;
+  uint32_t index_count;
+  uint32_t index_size;
+  uint32_t submesh_count;
+  uint32_t reserved;
+  /// Axis-aligned bounds of all vertex positions.
+  float bounds_min[ 3 ];
+  float bounds_max[ 3 ];
+  /// Of the whole file, to detect truncation.
+  uint64_t file_size;
+};
+
+/// A vertex attribute within the interleaved vertices.
+struct mesh_attribute
+{
+  mesh_semantic semantic;
+  /// `VkFormat` of the attribute, as for a vertex input attribute.
+  uint32_t format;
+  /// Byte offset within a vertex.
+  uint32_t offset;
+  uint32_t reserved;
+};
+
+struct mesh_section
+{
+  mesh_section_kind kind;
+  uint32_t reserved;
+  /// From the start of the file, a multiple of `MESH_SECTION_ALIGNMENT`.
+  uint64_t offset;
+  uint64_t size;
+};
+
+/// A range of indices drawn as one, e.g. an object or material of the source.
+struct mesh_submesh
+{
+  uint32_t first_index;
+  uint32_t index_count;
+  int32_t vertex_offset;
+  uint32_t reserved;
+  /// Bounding sphere of the vertices it uses.
+  float center[ 3 ];
+  float radius;
+};
+
+#pragma pack( pop )
+
+static_assert( sizeof( mesh_file_header ) == 80, "unexpected padding" );
+static_assert( sizeof( mesh_attribute ) == 16, "unexpected padding" );
+static_assert( sizeof( mesh_section ) == 24, "unexpected padding" );
+static_assert( sizeof( mesh_submesh ) == 32, "unexpected padding" );
+
+/// Vertex and index data of a mesh, wherever it is stored.
+struct mesh_view
+{
+  void const* vertices;
+  std::size_t vertex_bytes;
+  uint32_t vertex_count;
+  void const* indices;
+  std::size_t index_bytes;
+  uint32_t index_count;
+  /// 2 or 4.
+  uint32_t index_size;
+};
+
+/// A mesh in memory, as produced by importers and written to mesh files.
+struct mesh_data
+{
+  /// Layout of the vertices; there must be a `R32G32B32_SFLOAT` position.
+  std::vector< mesh_attribute > attributes;
+  uint32_t vertex_stride = 0;
+  std::vector< uint8_t > vertices;
+  std::vector< uint32_t > indices;
+  /// Bounding spheres are filled in by `write_mesh_file`. If empty, the whole
+  /// mesh is written as one.
+  std::vector< mesh_submesh > submeshes;
+
+  [[nodiscard]] uint32_t
+  vertex_count() const
+  {
+    return vertex_stride ? static_cast< uint32_t >( vertices.size() /
+                                                    vertex_stride )
+                         : 0;
+  }
+
+  /// With 4 byte indices.
+  [[nodiscard]] mesh_view view() const;
+};
+
+/**
+ * Write a mesh file, replacing `path` atomically (see `write_file_atomic`).
+ * Indices are stored in 2 bytes when they all fit.
+ *
+ * @throws std::invalid_argument Inconsistent mesh: no position attribute,
+ * attributes outside of the stride, vertices not a whole number of them,
+ * indices out of range, or submeshes outside of the indices.
+ * @throws std::runtime_error Failed to write the file.
+ */
+void
+MYENGINE_EXPORT
+write_mesh_file( std::string const& path, mesh_data const& mesh );
+
+/**
+ * A mapped mesh file.
+ *
+ * Opening checks the header and section table against the file size, and
+ * nothing else: the data is not parsed or copied, and indices are not checked
+ * against the vertex count, so files are expected to come from
+ * `write_mesh_file`. Move-only; the pointers are valid while it is open.
+ */
+class MYENGINE_EXPORT mesh_file
+{
+public:
+  mesh_file() = default;
+
+  /**
+   * @throws std::runtime_error Failed to map the file, or not a valid mesh
+   * file of this version.
+   */
+  [[nodiscard]] static mesh_file open( std::string const& path );
+
+  [[nodiscard]] mesh_file_header const&
+  header() const
+  {
+    return *m_header;
+  }
+
+  [[nodiscard]] mesh_attribute const*
+  attributes() const
+  {
+    return m_attributes;
+  }
+
+  /// Attribute of a semantic, or null if the vertices have none.
+  [[nodiscard]] mesh_attribute const*
+  find_attribute( mesh_semantic semantic ) const;
+
+  [[nodiscard]] mesh_submesh const*
+  submeshes() const
+  {
+    return m_submeshes;
+  }
+
+  [[nodiscard]] mesh_view
+  view() const
+  {
+    return m_view;
+  }
+
+  /// Size of the whole file.
+  [[nodiscard]] std::size_t
+  size() const
+  {
+    return m_file.size();
+  }
+
+private:
+  mapped_file m_file;
+  mesh_file_header const* m_header = nullptr;
+  mesh_attribute const* m_attributes = nullptr;
+  mesh_submesh const* m_submeshes = nullptr;
+  mesh_view m_view = {};
+};
+
+} // namespace myengine
+
+#endif //MYENGINE_MESH_FILE_H
@@ -0,0 +1,1130 @@
+#define MYENGINE_LOG_MODULE "mesh_import"
+#include "mesh_import.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <myengine/logging.h>
+
+namespace myengine {
+
+namespace {
+
+/// Vertex attributes in separate arrays, before interleaving.
+struct raw_mesh
+{
+  /// xyz per vertex.
+  std::vector< float > positions;
+  /// xyz per vertex, zeros where the source has none.
+  std::vector< float > normals;
+  /// uv per vertex, zeros where the source has none.
+  std::vector< float > texcoords;
+  bool has_normals = false;
+  bool has_texcoords = false;
+  std::vector< uint32_t > indices;
+  std::vector< mesh_submesh > submeshes;
+
+  [[nodiscard]] uint32_t
+  vertex_count() const
+  {
+    return static_cast< uint32_t >( positions.size() / 3 );
+  }
+
+  /// Start a submesh at the current end of the indices, unless the current
+  /// one is still empty.
+  void
+  begin_submesh()
+  {
+    uint32_t const first = static_cast< uint32_t >( indices.size() );
+    if( !submeshes.empty() && submeshes.back().first_index == first )
+    {
+      return;
+    }
+    submeshes.push_back( { first, 0, 0, 0, {}, 0.f } );
+  }
+
+  void
+  end_submesh()
+  {
+    if( submeshes.empty() )
+    {
+      return;
+    }
+    mesh_submesh& s = submeshes.back();
+    s.index_count = static_cast< uint32_t >( indices.size() ) - s.first_index;
+    if( s.index_count == 0 )
+    {
+      submeshes.pop_back();
+    }
+  }
+};
+
+mesh_data
+interleave( raw_mesh const& raw )
+{
+  mesh_data mesh;
+  uint32_t offset = 0;
+  auto const add = [ & ]( mesh_semantic semantic, VkFormat format,
+                          uint32_t size ) {
+    mesh.attributes.push_back(
+      { semantic, static_cast< uint32_t >( format ), offset, 0 } );
+    offset += size;
+  };
+  add( mesh_semantic::position, VK_FORMAT_R32G32B32_SFLOAT,
+       3 * sizeof( float ) );
+  if( raw.has_normals )
+  {
+    add( mesh_semantic::normal, VK_FORMAT_R32G32B32_SFLOAT,
+         3 * sizeof( float ) );
+  }
+  if( raw.has_texcoords )
+  {
+    add( mesh_semantic::texcoord, VK_FORMAT_R32G32_SFLOAT,
+         2 * sizeof( float ) );
+  }
+  mesh.vertex_stride = offset;
+
+  uint32_t const count = raw.vertex_count();
+  mesh.vertices.resize( std::size_t( count ) * mesh.vertex_stride );
+  uint8_t* out = mesh.vertices.data();
+  for( uint32_t v = 0; v < count; ++v )
+  {
+    std::memcpy( out, &raw.positions[ v * 3 ], 3 * sizeof( float ) );
+    out += 3 * sizeof( float );
+    if( raw.has_normals )
+    {
+      std::memcpy( out, &raw.normals[ v * 3 ], 3 * sizeof( float ) );
+      out += 3 * sizeof( float );
+    }
+    if( raw.has_texcoords )
+    {
+      std::memcpy( out, &raw.texcoords[ v * 2 ], 2 * sizeof( float ) );
+      out += 2 * sizeof( float );
+    }
+  }
+  mesh.indices = raw.indices;
+  mesh.submeshes = raw.submeshes;
+  return mesh;
+}
+
+/// Whole file, with a terminating null for `strtof` and friends.
+std::string
+read_text( std::string const& path )
+{
+  std::ifstream in( path, std::ios::in | std::ios::binary );
+  if( !in )
+  {
+    throw std::runtime_error( "Failed to open '" + path + "'" );
+  }
+  std::string text( ( std::istreambuf_iterator< char >( in ) ),
+                    std::istreambuf_iterator< char >() );
+  if( in.bad() )
+  {
+    throw std::runtime_error( "Failed to read '" + path + "'" );
+  }
+  return text;
+}
+
+std::string
+extension( std::string const& path )
+{
+  std::size_t const dot = path.find_last_of( '.' );
+  std::size_t const slash = path.find_last_of( "/\\" );
+  if( dot == std::string::npos ||
+      ( slash != std::string::npos && dot < slash ) )
+  {
+    return std::string();
+  }
+  std::string ext = path.substr( dot + 1 );
+  std::transform( ext.begin(), ext.end(), ext.begin(), []( unsigned char c ) {
+    return static_cast< char >( std::tolower( c ) );
+  } );
+  return ext;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// OBJ
+
+/// Position, texture coordinate and normal indices of a face vertex, from 0;
+/// -1 when absent.
+struct obj_corner
+{
+  int32_t v, vt, vn;
+
+  bool
+  operator==( obj_corner const& o ) const
+  {
+    return v == o.v && vt == o.vt && vn == o.vn;
+  }
+};
+
+struct obj_corner_hash
+{
+  std::size_t
+  operator()( obj_corner const& c ) const
+  {
+    uint64_t h = uint32_t( c.v );
+    h = h * 0x9E3779B97F4A7C15ull ^ uint32_t( c.vt );
+    h = h * 0x9E3779B97F4A7C15ull ^ uint32_t( c.vn );
+    return static_cast< std::size_t >( h ^ ( h >> 32 ) );
+  }
+};
+
+bool
+is_space( char c )
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+char const*
+skip_space( char const* p )
+{
+  while( is_space( *p ) )
+  {
+    ++p;
+  }
+  return p;
+}
+
+/// Next line, past the newline.
+char const*
+next_line( char const* p )
+{
+  while( *p && *p != '\n' )
+  {
+    ++p;
+  }
+  return *p ? p + 1 : p;
+}
+
+/**
+ * Read up to `count` floats into `out`, missing ones at the end of the line
+ * left as they are.
+ *
+ * @throws std::runtime_error Something other than a number is in their place.
+ */
+char const*
+parse_floats( char const* p, float* out, int count, std::size_t line,
+              std::string const& path )
+{
+  for( int i = 0; i < count; ++i )
+  {
+    p = skip_space( p );
+    if( *p == '\0' || *p == '\n' || *p == '#' )
+    {
+      break;
+    }
+    char* end = nullptr;
+    float const value = std::strtof( p, &end );
+    if( end == p || !( is_space( *end ) || *end == '\0' || *end == '\n' ||
+                       *end == '#' ) )
+    {
+      std::stringstream ss;
+      ss  << "Malformed number on line " << line << " of '" << path << "'";
+      throw std::runtime_error( ss.str() );
+    }
+    out[ i ] = value;
+    p = end;
+  }
+  return p;
+}
+
+/// A 1-based, possibly negative OBJ index, made 0-based; -1 if absent.
+char const*
+parse_index( char const* p, std::size_t count, int32_t& index,
+             std::size_t line, std::string const& path )
+{
+  char* end = nullptr;
+  long const value = std::strtol( p, &end, 10 );
+  if( end == p )
+  {
+    index = -1;
+    return p;
+  }
+  long const resolved = value < 0 ? long( count ) + value : value - 1;
+  if( value == 0 || resolved < 0 || std::size_t( resolved ) >= count )
+  {
+    std::stringstream ss;
+    ss  << "Index out of range on line " << line << " of '" << path << "'";
+    throw std::runtime_error( ss.str() );
+  }
+  index = static_cast< int32_t >( resolved );
+  return end;
+}
+
+} // namespace
+
+mesh_data
+import_obj( std::string const& path )
+{
+  std::string const text = read_text( path );
+  std::vector< float > positions;
+  std::vector< float > normals;
+  std::vector< float > texcoords;
+  raw_mesh raw;
+  std::unordered_map< obj_corner, uint32_t, obj_corner_hash > vertices;
+  std::vector< uint32_t > polygon;
+
+  raw.begin_submesh();
+  std::size_t line = 1;
+  for( char const* p = text.c_str(); *p; p = next_line( p ), ++line )
+  {
+    p = skip_space( p );
+    if( p[ 0 ] == 'v' && is_space( p[ 1 ] ) )
+    {
+      float v[ 3 ] = {};
+      parse_floats( p + 2, v, 3, line, path );
+      positions.insert( positions.end(), v, v + 3 );
+    }
+    else if( p[ 0 ] == 'v' && p[ 1 ] == 'n' && is_space( p[ 2 ] ) )
+    {
+      float n[ 3 ] = {};
+      parse_floats( p + 3, n, 3, line, path );
+      normals.insert( normals.end(), n, n + 3 );
+    }
+    else if( p[ 0 ] == 'v' && p[ 1 ] == 't' && is_space( p[ 2 ] ) )
+    {
+      float t[ 2 ] = {};
+      parse_floats( p + 3, t, 2, line, path );
+      texcoords.push_back( t[ 0 ] );
+      texcoords.push_back( 1.f - t[ 1 ] );
+    }
+    else if( p[ 0 ] == 'f' && is_space( p[ 1 ] ) )
+    {
+      polygon.clear();
+      p = skip_space( p + 2 );
+      while( *p && *p != '\n' && *p != '#' )
+      {
+        obj_corner c = { -1, -1, -1 };
+        p = parse_index( p, positions.size() / 3, c.v, line, path );
+        if( c.v < 0 )
+        {
+          std::stringstream ss;
+          ss  << "Malformed face on line " << line << " of '" << path << "'";
+          throw std::runtime_error( ss.str() );
+        }
+        if( *p == '/' )
+        {
+          p = parse_index( p + 1, texcoords.size() / 2, c.vt, line, path );
+          if( *p == '/' )
+          {
+            p = parse_index( p + 1, normals.size() / 3, c.vn, line, path );
+          }
+        }
+        p = skip_space( p );
+
+        auto const inserted = vertices.emplace( c, raw.vertex_count() );
+        if( inserted.second )
+        {
+          raw.positions.insert( raw.positions.end(),
+                                &positions[ c.v * 3 ],
+                                &positions[ c.v * 3 ] + 3 );
+          float const zeros[ 3 ] = {};
+          float const* n = c.vn >= 0 ? &normals[ c.vn * 3 ] : zeros;
+          raw.normals.insert( raw.normals.end(), n, n + 3 );
+          float const* t = c.vt >= 0 ? &texcoords[ c.vt * 2 ] : zeros;
+          raw.texcoords.insert( raw.texcoords.end(), t, t + 2 );
+          raw.has_normals = raw.has_normals || c.vn >= 0;
+          raw.has_texcoords = raw.has_texcoords || c.vt >= 0;
+        }
+        polygon.push_back( inserted.first->second );
+      }
+      for( std::size_t i = 2; i < polygon.size(); ++i )
+      {
+        raw.indices.push_back( polygon[ 0 ] );
+        raw.indices.push_back( polygon[ i - 1 ] );
+        raw.indices.push_back( polygon[ i ] );
+      }
+    }
+    else if( ( ( p[ 0 ] == 'o' || p[ 0 ] == 'g' ) && is_space( p[ 1 ] ) ) ||
+             std::strncmp( p, "usemtl", 6 ) == 0 )
+    {
+      raw.end_submesh();
+      raw.begin_submesh();
+    }
+  }
+  raw.end_submesh();
+  LOGF_DEBUG( "Imported '{}': {} vertices, {} triangles, {} submesh(es)",
+              path, raw.vertex_count(), raw.indices.size() / 3,
+              raw.submeshes.size() );
+  return interleave( raw );
+}
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+// glTF
+
+/// A parsed JSON value, enough for glTF.
+struct json_value
+{
+  enum class kind
+  {
+    null,
+    boolean,
+    number,
+    string,
+    array,
+    object
+  };
+
+  kind type = kind::null;
+  bool boolean = false;
+  double number = 0.;
+  std::string string;
+  std::vector< json_value > array;
+  std::vector< std::pair< std::string, json_value > > object;
+
+  /// Member of an object, or null if absent or not an object.
+  [[nodiscard]] json_value const*
+  find( char const* key ) const
+  {
+    for( auto const& member : object )
+    {
+      if( member.first == key )
+      {
+        return &member.second;
+      }
+    }
+    return nullptr;
+  }
+
+  /// Number member, or `fallback` if absent.
+  [[nodiscard]] double
+  number_or( char const* key, double fallback ) const
+  {
+    json_value const* v = find( key );
+    return v && v->type == kind::number ? v->number : fallback;
+  }
+};
+
+/// Recursive descent parser of JSON text.
+class json_parser
+{
+public:
+  json_parser( char const* begin, char const* end, std::string const& path )
+    : m_p( begin ),
+      m_end( end ),
+      m_path( path )
+  {}
+
+  json_value
+  parse()
+  {
+    json_value v = value( 0 );
+    skip();
+    if( m_p != m_end )
+    {
+      fail( "trailing characters" );
+    }
+    return v;
+  }
+
+private:
+  /// Deeper nesting is rejected rather than overflowing the stack.
+  static constexpr int MAX_DEPTH = 64;
+
+  char const* m_p;
+  char const* m_end;
+  std::string const& m_path;
+
+  [[noreturn]] void
+  fail( char const* what ) const
+  {
+    throw std::runtime_error( std::string( "Malformed JSON (" ) + what +
+                              ") in '" + m_path + "'" );
+  }
+
+  void
+  skip()
+  {
+    while( m_p != m_end &&
+           ( *m_p == ' ' || *m_p == '\t' || *m_p == '\n' || *m_p == '\r' ) )
+    {
+      ++m_p;
+    }
+  }
+
+  bool
+  consume( char const* literal )
+  {
+    std::size_t const n = std::strlen( literal );
+    if( std::size_t( m_end - m_p ) >= n && std::memcmp( m_p, literal, n ) == 0 )
+    {
+      m_p += n;
+      return true;
+    }
+    return false;
+  }
+
+  json_value
+  value( int depth )
+  {
+    if( depth > MAX_DEPTH )
+    {
+      fail( "nested too deeply" );
+    }
+    skip();
+    if( m_p == m_end )
+    {
+      fail( "unexpected end" );
+    }
+    json_value v;
+    if( *m_p == '{' )
+    {
+      v.type = json_value::kind::object;
+      ++m_p;
+      skip();
+      if( m_p != m_end && *m_p == '}' )
+      {
+        ++m_p;
+        return v;
+      }
+      for( ;; )
+      {
+        skip();
+        std::string key = string();
+        skip();
+        if( m_p == m_end || *m_p != ':' )
+        {
+          fail( "expected ':'" );
+        }
+        ++m_p;
+        v.object.emplace_back( std::move( key ), value( depth + 1 ) );
+        skip();
+        if( m_p != m_end && *m_p == ',' )
+        {
+          ++m_p;
+          continue;
+        }
+        if( m_p != m_end && *m_p == '}' )
+        {
+          ++m_p;
+          return v;
+        }
+        fail( "expected ',' or '}'" );
+      }
+    }
+    if( *m_p == '[' )
+    {
+      v.type = json_value::kind::array;
+      ++m_p;
+      skip();
+      if( m_p != m_end && *m_p == ']' )
+      {
+        ++m_p;
+        return v;
+      }
+      for( ;; )
+      {
+        v.array.push_back( value( depth + 1 ) );
+        skip();
+        if( m_p != m_end && *m_p == ',' )
+        {
+          ++m_p;
+          continue;
+        }
+        if( m_p != m_end && *m_p == ']' )
+        {
+          ++m_p;
+          return v;
+        }
+        fail( "expected ',' or ']'" );
+      }
+    }
+    if( *m_p == '"' )
+    {
+      v.type = json_value::kind::string;
+      v.string = string();
+      return v;
+    }
+    if( consume( "true" ) )
+    {
+      v.type = json_value::kind::boolean;
+      v.boolean = true;
+      return v;
+    }
+    if( consume( "false" ) )
+    {
+      v.type = json_value::kind::boolean;
+      return v;
+    }
+    if( consume( "null" ) )
+    {
+      return v;
+    }
+    // The text is not null-terminated, so copy the number for `strtod`.
+    char const* start = m_p;
+    while( m_p != m_end && *m_p != '\0' &&
+           ( std::isdigit( static_cast< unsigned char >( *m_p ) ) ||
+             std::strchr( "+-.eE", *m_p ) ) )
+    {
+      ++m_p;
+    }
+    std::string const digits( start, m_p );
+    char* end = nullptr;
+    v.number = std::strtod( digits.c_str(), &end );
+    if( digits.empty() || end != digits.c_str() + digits.size() )
+    {
+      fail( "bad value" );
+    }
+    v.type = json_value::kind::number;
+    return v;
+  }
+
+  std::string
+  string()
+  {
+    if( m_p == m_end || *m_p != '"' )
+    {
+      fail( "expected a string" );
+    }
+    ++m_p;
+    std::string s;
+    while( m_p != m_end && *m_p != '"' )
+    {
+      char c = *m_p++;
+      if( c != '\\' )
+      {
+        s += c;
+        continue;
+      }
+      if( m_p == m_end )
+      {
+        break;
+      }
+      c = *m_p++;
+      switch( c )
+      {
+        case 'b': s += '\b'; break;
+        case 'f': s += '\f'; break;
+        case 'n': s += '\n'; break;
+        case 'r': s += '\r'; break;
+        case 't': s += '\t'; break;
+        case 'u':
+        {
+          if( m_end - m_p < 4 )
+          {
+            fail( "bad escape" );
+          }
+          unsigned long const code =
+            std::strtoul( std::string( m_p, m_p + 4 ).c_str(), nullptr, 16 );
+          m_p += 4;
+          // UTF-8; surrogate pairs are kept as two code points, which is
+          // harmless for the names and URIs glTF uses.
+          if( code < 0x80 )
+          {
+            s += static_cast< char >( code );
+          }
+          else if( code < 0x800 )
+          {
+            s += static_cast< char >( 0xC0 | ( code >> 6 ) );
+            s += static_cast< char >( 0x80 | ( code & 0x3F ) );
+          }
+          else
+          {
+            s += static_cast< char >( 0xE0 | ( code >> 12 ) );
+            s += static_cast< char >( 0x80 | ( ( code >> 6 ) & 0x3F ) );
+            s += static_cast< char >( 0x80 | ( code & 0x3F ) );
+          }
+          break;
+        }
+        default: s += c; break;
+      }
+    }
+    if( m_p == m_end )
+    {
+      fail( "unterminated string" );
+    }
+    ++m_p;
+    return s;
+  }
+};
+
+constexpr uint32_t GLB_MAGIC = 0x46546C67;
+constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+constexpr int COMPONENT_UNSIGNED_BYTE = 5121;
+constexpr int COMPONENT_UNSIGNED_SHORT = 5123;
+constexpr int COMPONENT_UNSIGNED_INT = 5125;
+constexpr int COMPONENT_FLOAT = 5126;
+
+constexpr int MODE_TRIANGLES = 4;
+
+std::vector< uint8_t >
+decode_base64( std::string const& text, std::string const& path )
+{
+  auto const sextet = []( char c ) -> int {
+    if( c >= 'A' && c <= 'Z' ) return c - 'A';
+    if( c >= 'a' && c <= 'z' ) return c - 'a' + 26;
+    if( c >= '0' && c <= '9' ) return c - '0' + 52;
+    if( c == '+' ) return 62;
+    if( c == '/' ) return 63;
+    return -1;
+  };
+  std::vector< uint8_t > out;
+  out.reserve( text.size() / 4 * 3 );
+  uint32_t bits = 0;
+  int count = 0;
+  for( char c : text )
+  {
+    if( c == '=' )
+    {
+      break;
+    }
+    int const value = sextet( c );
+    if( value < 0 )
+    {
+      throw std::runtime_error( "Bad base64 buffer in '" + path + "'" );
+    }
+    bits = ( bits << 6 ) | uint32_t( value );
+    if( ( count += 6 ) >= 8 )
+    {
+      count -= 8;
+      out.push_back( static_cast< uint8_t >( bits >> count ) );
+    }
+  }
+  return out;
+}
+
+/// `%XX` escapes of a relative URI decoded.
+std::string
+decode_uri( std::string const& uri )
+{
+  std::string out;
+  for( std::size_t i = 0; i < uri.size(); ++i )
+  {
+    if( uri[ i ] == '%' && i + 2 < uri.size() )
+    {
+      out += static_cast< char >(
+        std::strtoul( uri.substr( i + 1, 2 ).c_str(), nullptr, 16 ) );
+      i += 2;
+    }
+    else
+    {
+      out += uri[ i ];
+    }
+  }
+  return out;
+}
+
+/// A glTF document with its buffers loaded.
+struct gltf_document
+{
+  std::string path;
+  json_value json;
+  std::vector< std::vector< uint8_t > > buffers;
+
+  [[noreturn]] void
+  fail( std::string const& what ) const
+  {
+    throw std::runtime_error( "Invalid glTF (" + what + "): " + path );
+  }
+
+  /// Element `index` of a top level array.
+  json_value const&
+  element( char const* array, double index ) const
+  {
+    json_value const* a = json.find( array );
+    if( !a || index < 0 || index >= double( a->array.size() ) )
+    {
+      fail( std::string( "bad " ) + array + " index" );
+    }
+    return a->array[ std::size_t( index ) ];
+  }
+};
+
+uint32_t
+read_u32( uint8_t const* p )
+{
+  uint32_t v;
+  std::memcpy( &v, p, sizeof( v ) );
+  return v;
+}
+
+gltf_document
+load_gltf( std::string const& path )
+{
+  gltf_document doc;
+  doc.path = path;
+  std::string const data = read_text( path );
+  std::vector< uint8_t > glb_bin;
+  bool has_glb_bin = false;
+  auto const* bytes = reinterpret_cast< uint8_t const* >( data.data() );
+  if( data.size() >= 12 && read_u32( bytes ) == GLB_MAGIC )
+  {
+    if( read_u32( bytes + 4 ) != 2 )
+    {
+      doc.fail( "unsupported GLB version" );
+    }
+    std::size_t const length =
+      std::min< std::size_t >( read_u32( bytes + 8 ), data.size() );
+    std::size_t offset = 12;
+    bool has_json = false;
+    while( offset + 8 <= length )
+    {
+      std::size_t const chunk_length = read_u32( bytes + offset );
+      uint32_t const chunk_type = read_u32( bytes + offset + 4 );
+      offset += 8;
+      if( chunk_length > length - offset )
+      {
+        doc.fail( "truncated GLB chunk" );
+      }
+      if( chunk_type == GLB_CHUNK_JSON && !has_json )
+      {
+        doc.json = json_parser( data.data() + offset,
+                                data.data() + offset + chunk_length, path )
+                     .parse();
+        has_json = true;
+      }
+      else if( chunk_type == GLB_CHUNK_BIN && !has_glb_bin )
+      {
+        glb_bin.assign( bytes + offset, bytes + offset + chunk_length );
+        has_glb_bin = true;
+      }
+      offset += ( chunk_length + 3 ) / 4 * 4;
+    }
+    if( !has_json )
+    {
+      doc.fail( "no JSON chunk" );
+    }
+  }
+  else
+  {
+    doc.json =
+      json_parser( data.data(), data.data() + data.size(), path ).parse();
+  }
+
+  std::size_t const slash = path.find_last_of( "/\\" );
+  std::string const dir =
+    slash == std::string::npos ? std::string() : path.substr( 0, slash + 1 );
+  if( json_value const* buffers = doc.json.find( "buffers" ) )
+  {
+    for( std::size_t i = 0; i < buffers->array.size(); ++i )
+    {
+      json_value const* uri = buffers->array[ i ].find( "uri" );
+      if( !uri )
+      {
+        if( i != 0 || !has_glb_bin )
+        {
+          doc.fail( "buffer without a URI" );
+        }
+        doc.buffers.push_back( std::move( glb_bin ) );
+      }
+      else if( uri->string.compare( 0, 5, "data:" ) == 0 )
+      {
+        std::size_t const comma = uri->string.find( ',' );
+        if( comma == std::string::npos ||
+            uri->string.rfind( ";base64", comma ) == std::string::npos )
+        {
+          doc.fail( "data URI not base64" );
+        }
+        doc.buffers.push_back(
+          decode_base64( uri->string.substr( comma + 1 ), path ) );
+      }
+      else
+      {
+        std::string const buffer = read_text( dir + decode_uri( uri->string ) );
+        doc.buffers.emplace_back( buffer.begin(), buffer.end() );
+      }
+      double const length = buffers->array[ i ].number_or( "byteLength", 0. );
+      if( length > double( doc.buffers.back().size() ) )
+      {
+        doc.fail( "buffer shorter than its byteLength" );
+      }
+    }
+  }
+  return doc;
+}
+
+/// Elements of an accessor, checked against its buffer view and buffer.
+struct accessor_view
+{
+  uint8_t const* data = nullptr;
+  std::size_t stride = 0;
+  std::size_t count = 0;
+  int component_type = 0;
+  int components = 0;
+  bool normalized = false;
+};
+
+int
+component_size( int component_type )
+{
+  switch( component_type )
+  {
+    case 5120:
+    case COMPONENT_UNSIGNED_BYTE:
+      return 1;
+    case 5122:
+    case COMPONENT_UNSIGNED_SHORT:
+      return 2;
+    case COMPONENT_UNSIGNED_INT:
+    case COMPONENT_FLOAT:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+accessor_view
+view_accessor( gltf_document const& doc, double index )
+{
+  json_value const& accessor = doc.element( "accessors", index );
+  if( accessor.find( "sparse" ) )
+  {
+    doc.fail( "sparse accessors are not supported" );
+  }
+  accessor_view a;
+  a.count = std::size_t( accessor.number_or( "count", 0. ) );
+  a.component_type = int( accessor.number_or( "componentType", 0. ) );
+  json_value const* normalized = accessor.find( "normalized" );
+  a.normalized = normalized && normalized->boolean;
+  json_value const* type = accessor.find( "type" );
+  std::string const type_name = type ? type->string : std::string();
+  a.components = type_name == "SCALAR" ? 1
+                 : type_name == "VEC2" ? 2
+                 : type_name == "VEC3" ? 3
+                 : type_name == "VEC4" ? 4
+                                       : 0;
+  int const size = component_size( a.component_type );
+  if( a.components == 0 || size == 0 )
+  {
+    doc.fail( "unsupported accessor type" );
+  }
+  std::size_t const element_size = std::size_t( size ) * a.components;
+
+  json_value const* view_index = accessor.find( "bufferView" );
+  if( !view_index )
+  {
+    doc.fail( "accessor without a buffer view" );
+  }
+  json_value const& view = doc.element( "bufferViews", view_index->number );
+  double const buffer = view.number_or( "buffer", -1. );
+  if( buffer < 0 || buffer >= double( doc.buffers.size() ) )
+  {
+    doc.fail( "bad buffer index" );
+  }
+  std::vector< uint8_t > const& data = doc.buffers[ std::size_t( buffer ) ];
+  std::size_t const view_offset = std::size_t( view.number_or( "byteOffset",
+                                                               0. ) );
+  std::size_t const view_length = std::size_t( view.number_or( "byteLength",
+                                                               0. ) );
+  std::size_t const offset =
+    std::size_t( accessor.number_or( "byteOffset", 0. ) );
+  a.stride = std::size_t( view.number_or( "byteStride", 0. ) );
+  if( a.stride == 0 )
+  {
+    a.stride = element_size;
+  }
+  if( view_offset > data.size() || view_length > data.size() - view_offset ||
+      ( a.count > 0 &&
+        ( offset > view_length || a.stride < element_size ||
+          ( a.count - 1 ) > ( view_length - offset - element_size ) /
+                              a.stride ||
+          element_size > view_length - offset ) ) )
+  {
+    doc.fail( "accessor outside of its buffer" );
+  }
+  a.data = data.data() + view_offset + offset;
+  return a;
+}
+
+/// Element `i` of a float or normalized integer accessor as floats.
+void
+read_floats( accessor_view const& a, std::size_t i, float* out, int count )
+{
+  uint8_t const* p = a.data + i * a.stride;
+  for( int c = 0; c < count; ++c )
+  {
+    if( c >= a.components )
+    {
+      out[ c ] = 0.f;
+      continue;
+    }
+    switch( a.component_type )
+    {
+      case COMPONENT_FLOAT:
+        std::memcpy( &out[ c ], p + c * 4, 4 );
+        break;
+      case COMPONENT_UNSIGNED_BYTE:
+        out[ c ] = p[ c ] / 255.f;
+        break;
+      case COMPONENT_UNSIGNED_SHORT:
+      {
+        uint16_t v;
+        std::memcpy( &v, p + c * 2, 2 );
+        out[ c ] = v / 65535.f;
+        break;
+      }
+      default:
+        out[ c ] = 0.f;
+        break;
+    }
+  }
+}
+
+uint32_t
+read_index( accessor_view const& a, std::size_t i )
+{
+  uint8_t const* p = a.data + i * a.stride;
+  switch( a.component_type )
+  {
+    case COMPONENT_UNSIGNED_BYTE:
+      return p[ 0 ];
+    case COMPONENT_UNSIGNED_SHORT:
+    {
+      uint16_t v;
+      std::memcpy( &v, p, 2 );
+      return v;
+    }
+    default:
+      return read_u32( p );
+  }
+}
+
+} // namespace
+
+mesh_data
+import_gltf( std::string const& path )
+{
+  gltf_document const doc = load_gltf( path );
+  raw_mesh raw;
+  json_value const* meshes = doc.json.find( "meshes" );
+  std::size_t const mesh_count = meshes ? meshes->array.size() : 0;
+  for( std::size_t m = 0; m < mesh_count; ++m )
+  {
+    json_value const* primitives = meshes->array[ m ].find( "primitives" );
+    if( !primitives )
+    {
+      continue;
+    }
+    for( auto const& primitive : primitives->array )
+    {
+      if( primitive.number_or( "mode", MODE_TRIANGLES ) != MODE_TRIANGLES )
+      {
+        LOGF_WARN( "Skipping a non-triangle primitive of mesh {} in '{}'", m,
+                   path );
+        continue;
+      }
+      json_value const* attributes = primitive.find( "attributes" );
+      json_value const* position =
+        attributes ? attributes->find( "POSITION" ) : nullptr;
+      if( !position )
+      {
+        doc.fail( "primitive without positions" );
+      }
+      accessor_view const positions = view_accessor( doc, position->number );
+      if( positions.component_type != COMPONENT_FLOAT ||
+          positions.components != 3 )
+      {
+        doc.fail( "positions are not float VEC3" );
+      }
+      accessor_view normals;
+      if( json_value const* n = attributes->find( "NORMAL" ) )
+      {
+        normals = view_accessor( doc, n->number );
+        if( normals.count < positions.count )
+        {
+          doc.fail( "fewer normals than positions" );
+        }
+        raw.has_normals = true;
+      }
+      accessor_view texcoords;
+      if( json_value const* t = attributes->find( "TEXCOORD_0" ) )
+      {
+        texcoords = view_accessor( doc, t->number );
+        if( texcoords.count < positions.count )
+        {
+          doc.fail( "fewer texture coordinates than positions" );
+        }
+        raw.has_texcoords = true;
+      }
+
+      uint32_t const base = raw.vertex_count();
+      for( std::size_t v = 0; v < positions.count; ++v )
+      {
+        float p[ 3 ], n[ 3 ] = {}, t[ 2 ] = {};
+        read_floats( positions, v, p, 3 );
+        if( normals.data )
+        {
+          read_floats( normals, v, n, 3 );
+        }
+        if( texcoords.data )
+        {
+          read_floats( texcoords, v, t, 2 );
+        }
+        raw.positions.insert( raw.positions.end(), p, p + 3 );
+        raw.normals.insert( raw.normals.end(), n, n + 3 );
+        raw.texcoords.insert( raw.texcoords.end(), t, t + 2 );
+      }
+
+      raw.begin_submesh();
+      if( json_value const* indices = primitive.find( "indices" ) )
+      {
+        accessor_view const a = view_accessor( doc, indices->number );
+        if( a.components != 1 ||
+            ( a.component_type != COMPONENT_UNSIGNED_BYTE &&
+              a.component_type != COMPONENT_UNSIGNED_SHORT &&
+              a.component_type != COMPONENT_UNSIGNED_INT ) )
+        {
+          doc.fail( "bad index accessor" );
+        }
+        for( std::size_t i = 0; i + 2 < a.count; i += 3 )
+        {
+          for( std::size_t k = 0; k < 3; ++k )
+          {
+            uint32_t const index = read_index( a, i + k );
+            if( index >= positions.count )
+            {
+              doc.fail( "index out of range" );
+            }
+            raw.indices.push_back( base + index );
+          }
+        }
+      }
+      else
+      {
+        for( std::size_t v = 0; v + 2 < positions.count; v += 3 )
+        {
+          for( uint32_t k = 0; k < 3; ++k )
+          {
+            raw.indices.push_back( base + uint32_t( v ) + k );
+          }
+        }
+      }
+      raw.end_submesh();
+    }
+  }
+  LOGF_DEBUG( "Imported '{}': {} vertices, {} triangles, {} submesh(es)",
+              path, raw.vertex_count(), raw.indices.size() / 3,
+              raw.submeshes.size() );
+  return interleave( raw );
+}
+
+mesh_data
+import_mesh( std::string const& path )
+{
+  std::string const ext = extension( path );
+  if( ext == "obj" )
+  {
+    return import_obj( path );
+  }
+  if( ext == "gltf" || ext == "glb" )
+  {
+    return import_gltf( path );
+  }
+  throw std::runtime_error( "Unknown mesh format '" + ext + "': " + path );
+}
+
+} // namespace myengine
@@ -0,0 +1,54 @@
+#ifndef MYENGINE_MESH_IMPORT_H
+#define MYENGINE_MESH_IMPORT_H
+
+#include <string>
+
+#include <myengine/mesh_file.h>
+#include <myengine/myengine_export.h>
+
+namespace myengine {
+
+// Importers of interchange formats, for converting them offline to mesh files
+// (see `mesh_file.h`). Imported vertices are interleaved: a
+// `R32G32B32_SFLOAT` position, then a `R32G32B32_SFLOAT` normal and a
+// `R32G32_SFLOAT` texture coordinate if the source has any, with the origin
+// of texture coordinates at the top left, as in Vulkan. Vertices without them
+// in a source that has some get zeros.
+
+/**
+ * Import a Wavefront OBJ file. Polygons are triangulated as fans, and
+ * identical position / texture coordinate / normal combinations become one
+ * vertex. Each `o`, `g` or `usemtl` statement starts a submesh. Materials,
+ * curves and other statements are ignored.
+ *
+ * @throws std::runtime_error Failed to read the file, or malformed.
+ */
+[[nodiscard]] mesh_data
+MYENGINE_EXPORT
+import_obj( std::string const& path );
+
+/**
+ * Import the meshes of a glTF 2.0 file, `.gltf` (with external or embedded
+ * base64 buffers) or `.glb`. Each triangle list primitive becomes a submesh,
+ * in the mesh's own space: node transforms are not applied. Other primitive
+ * modes are skipped with a warning.
+ *
+ * @throws std::runtime_error Failed to read the file or its buffers, or
+ * malformed or unsupported (sparse accessors, non-float positions).
+ */
+[[nodiscard]] mesh_data
+MYENGINE_EXPORT
+import_gltf( std::string const& path );
+
+/**
+ * `import_obj` or `import_gltf`, by the file's extension.
+ *
+ * @throws std::runtime_error As the importer, or unknown extension.
+ */
+[[nodiscard]] mesh_data
+MYENGINE_EXPORT
+import_mesh( std::string const& path );
+
+} // namespace myengine
+
+#endif //MYENGINE_MESH_IMPORT_H
@@ -0,0 +1,372 @@
+#define MYENGINE_LOG_MODULE "vulkan.offscreen"
+#include "offscreen.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vulkan/vulkan.hpp>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+/// Readback slices are aligned to this, which covers the texel size of every
+/// supported format for `vkCmdCopyImageToBuffer`.
+constexpr VkDeviceSize SLOT_ALIGNMENT = 256;
+
+} // namespace
+
+uint32_t
+texel_size( VkFormat format )
+{
+  switch( format )
+  {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+      return 4;
+    case VK_FORMAT_R16G16B16A16_UNORM:
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+      return 8;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+      return 16;
+    default:
+      throw std::invalid_argument(
+        "Unsupported offscreen format " +
+        vk::to_string( static_cast< vk::Format >( format ) ) );
+  }
+}
+
+offscreen_scheduler::offscreen_scheduler(
+  VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family,
+  VkQueue queue, offscreen_scheduler_config const& config,
+  readback_fn readback )
+  : m_device( device ),
+    m_queue( queue ),
+    m_config( config ),
+    m_readback( std::move( readback ) ),
+    m_frame_size( 0 ),
+    m_slot_stride( 0 ),
+    m_readback_coherent( true ),
+    m_images(),
+    m_image_memory(),
+    m_views(),
+    m_command_pools(),
+    m_command_buffers(),
+    m_fences(),
+    m_pending(),
+    m_readback_buffer( VK_NULL_HANDLE ),
+    m_readback_memory( VK_NULL_HANDLE ),
+    m_readback_mapped( nullptr ),
+    m_submitted( 0 )
+{
+  m_config.frames_in_flight = std::max( 1u, m_config.frames_in_flight );
+  if( m_readback )
+  {
+    m_config.image_usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  uint32_t const n = m_config.frames_in_flight;
+  m_frame_size = VkDeviceSize( m_config.extent.width ) *
+                 m_config.extent.height * texel_size( m_config.format );
+  m_slot_stride =
+    ( m_frame_size + SLOT_ALIGNMENT - 1 ) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+  m_images.resize( n, VK_NULL_HANDLE );
+  m_image_memory.resize( n, VK_NULL_HANDLE );
+  m_views.resize( n, VK_NULL_HANDLE );
+  m_command_pools.resize( n, VK_NULL_HANDLE );
+  m_command_buffers.resize( n, VK_NULL_HANDLE );
+  m_fences.resize( n, VK_NULL_HANDLE );
+  m_pending.resize( n, 0 );
+
+  auto const& mem_props =
+    get_device_capabilities( physical_device ).memory_properties;
+  try
+  {
+    for( uint32_t i = 0; i < n; ++i )
+    {
+      VkImageCreateInfo image_info = {};
+      image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      image_info.imageType = VK_IMAGE_TYPE_2D;
+      image_info.format = m_config.format;
+      image_info.extent = { m_config.extent.width, m_config.extent.height, 1 };
+      image_info.mipLevels = 1;
+      image_info.arrayLayers = 1;
+      image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+      image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+      image_info.usage = m_config.image_usage;
+      image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      check_result( vkCreateImage( m_device, &image_info, nullptr,
+                                   &m_images[ i ] ),
+                    "create offscreen target" );
+
+      VkMemoryRequirements reqs;
+      vkGetImageMemoryRequirements( m_device, m_images[ i ], &reqs );
+      VkMemoryAllocateInfo alloc_info = {};
+      alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      alloc_info.allocationSize = reqs.size;
+      // CPU implementations may only have host-visible memory; that is still
+      // "device local" to them.
+      alloc_info.memoryTypeIndex =
+        find_memory_type( mem_props, reqs.memoryTypeBits, 0,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+      check_result( vkAllocateMemory( m_device, &alloc_info, nullptr,
+                                      &m_image_memory[ i ] ),
+                    "allocate offscreen target memory" );
+      check_result( vkBindImageMemory( m_device, m_images[ i ],
+                                       m_image_memory[ i ], 0 ),
+                    "bind offscreen target memory" );
+
+      VkImageViewCreateInfo view_info = {};
+      view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      view_info.image = m_images[ i ];
+      view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      view_info.format = m_config.format;
+      view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      view_info.subresourceRange.levelCount = 1;
+      view_info.subresourceRange.layerCount = 1;
+      check_result( vkCreateImageView( m_device, &view_info, nullptr,
+                                       &m_views[ i ] ),
+                    "create offscreen target view" );
+
+      // Transient: the whole pool is reset every time the slot comes around.
+      VkCommandPoolCreateInfo pool_info = {};
+      pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+      pool_info.queueFamilyIndex = queue_family;
+      check_result( vkCreateCommandPool( m_device, &pool_info, nullptr,
+                                         &m_command_pools[ i ] ),
+                    "create frame command pool" );
+
+      VkCommandBufferAllocateInfo cmd_info = {};
+      cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      cmd_info.commandPool = m_command_pools[ i ];
+      cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      cmd_info.commandBufferCount = 1;
+      check_result( vkAllocateCommandBuffers( m_device, &cmd_info,
+                                              &m_command_buffers[ i ] ),
+                    "allocate frame command buffer" );
+
+      VkFenceCreateInfo fence_info = {};
+      fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+      check_result( vkCreateFence( m_device, &fence_info, nullptr,
+                                   &m_fences[ i ] ),
+                    "create frame fence" );
+    }
+
+    if( m_readback )
+    {
+      VkBufferCreateInfo buffer_info = {};
+      buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      buffer_info.size = m_slot_stride * n;
+      buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+      buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      check_result( vkCreateBuffer( m_device, &buffer_info, nullptr,
+                                    &m_readback_buffer ),
+                    "create readback buffer" );
+
+      VkMemoryRequirements reqs;
+      vkGetBufferMemoryRequirements( m_device, m_readback_buffer, &reqs );
+      VkMemoryAllocateInfo alloc_info = {};
+      alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      alloc_info.allocationSize = reqs.size;
+      // Reading uncached memory from the CPU is very slow.
+      alloc_info.memoryTypeIndex =
+        find_memory_type( mem_props, reqs.memoryTypeBits,
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                          VK_MEMORY_PROPERTY_HOST_CACHED_BIT );
+      m_readback_coherent =
+        mem_props.memoryTypes[ alloc_info.memoryTypeIndex ].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+      check_result( vkAllocateMemory( m_device, &alloc_info, nullptr,
+                                      &m_readback_memory ),
+                    "allocate readback memory" );
+      check_result( vkBindBufferMemory( m_device, m_readback_buffer,
+                                        m_readback_memory, 0 ),
+                    "bind readback memory" );
+      void* mapped = nullptr;
+      check_result( vkMapMemory( m_device, m_readback_memory, 0, VK_WHOLE_SIZE,
+                                 0, &mapped ),
+                    "map readback memory" );
+      m_readback_mapped = static_cast< uint8_t* >( mapped );
+    }
+  }
+  catch( ... )
+  {
+    destroy();
+    throw;
+  }
+
+  LOGF_INFO( "Offscreen scheduler with {} frame(s) in flight, {}x{} {}{}", n,
+             m_config.extent.width, m_config.extent.height,
+             vk::to_string( static_cast< vk::Format >( m_config.format ) )
+               .c_str(),
+             m_readback ? ", reading back" : "" );
+}
+
+offscreen_scheduler::~offscreen_scheduler()
+{
+  vkDeviceWaitIdle( m_device );
+  destroy();
+}
+
+void
+offscreen_scheduler::begin_frame( frame& f )
+{
+  PROFILE_FUNCTION();
+  uint64_t const number = m_submitted;
+  uint32_t const slot =
+    static_cast< uint32_t >( number % m_config.frames_in_flight );
+  retire( slot );
+
+  check_result( vkResetFences( m_device, 1, &m_fences[ slot ] ),
+                "reset frame fence" );
+  check_result( vkResetCommandPool( m_device, m_command_pools[ slot ], 0 ),
+                "reset frame command pool" );
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  check_result( vkBeginCommandBuffer( m_command_buffers[ slot ], &begin_info ),
+                "begin frame command buffer" );
+
+  f.number = number;
+  f.slot = slot;
+  f.image = m_images[ slot ];
+  f.view = m_views[ slot ];
+  f.cmd = m_command_buffers[ slot ];
+}
+
+void
+offscreen_scheduler::end_frame( frame const& f,
+                                std::vector< timeline_wait > const& waits )
+{
+  PROFILE_FUNCTION();
+  if( m_readback )
+  {
+    VkBufferImageCopy region = {};
+    region.bufferOffset = m_slot_stride * f.slot;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { m_config.extent.width, m_config.extent.height, 1 };
+    vkCmdCopyImageToBuffer( f.cmd, f.image,
+                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                            m_readback_buffer, 1, &region );
+
+    // Make the copy visible to the host once the fence signals.
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = m_readback_buffer;
+    barrier.offset = region.bufferOffset;
+    barrier.size = m_frame_size;
+    vkCmdPipelineBarrier( f.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                          VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                          &barrier, 0, nullptr );
+  }
+  check_result( vkEndCommandBuffer( f.cmd ), "end frame command buffer" );
+
+  std::vector< VkSemaphore > wait_semaphores;
+  std::vector< uint64_t > wait_values;
+  std::vector< VkPipelineStageFlags > wait_stages;
+  for( auto const& w : waits )
+  {
+    wait_semaphores.push_back( w.point.semaphore );
+    wait_values.push_back( w.point.value );
+    wait_stages.push_back( w.stages );
+  }
+  VkTimelineSemaphoreSubmitInfo timeline_info = {};
+  timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_info.waitSemaphoreValueCount =
+    static_cast< uint32_t >( wait_values.size() );
+  timeline_info.pWaitSemaphoreValues = wait_values.data();
+  VkSubmitInfo submit_info = {};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = waits.empty() ? nullptr : &timeline_info;
+  submit_info.waitSemaphoreCount =
+    static_cast< uint32_t >( wait_semaphores.size() );
+  submit_info.pWaitSemaphores = wait_semaphores.data();
+  submit_info.pWaitDstStageMask = wait_stages.data();
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &f.cmd;
+  check_result( vkQueueSubmit( m_queue, 1, &submit_info, m_fences[ f.slot ] ),
+                "submit frame" );
+  m_pending[ f.slot ] = f.number + 1;
+  ++m_submitted;
+}
+
+void
+offscreen_scheduler::finish()
+{
+  PROFILE_FUNCTION();
+  // Oldest first, so pixels are delivered in frame order.
+  uint32_t const n = m_config.frames_in_flight;
+  for( uint32_t i = 0; i < n; ++i )
+  {
+    retire( static_cast< uint32_t >( ( m_submitted + i ) % n ) );
+  }
+}
+
+void
+offscreen_scheduler::retire( uint32_t slot )
+{
+  uint64_t const pending = m_pending[ slot ];
+  if( pending == 0 )
+  {
+    return;
+  }
+  check_result( vkWaitForFences( m_device, 1, &m_fences[ slot ], VK_TRUE,
+                                 UINT64_MAX ),
+                "wait for offscreen frame" );
+  m_pending[ slot ] = 0;
+  if( !m_readback )
+  {
+    return;
+  }
+
+  VkDeviceSize const offset = m_slot_stride * slot;
+  if( !m_readback_coherent )
+  {
+    // The slice is aligned for copies, not to `nonCoherentAtomSize`; the
+    // whole mapping is.
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = m_readback_memory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    check_result( vkInvalidateMappedMemoryRanges( m_device, 1, &range ),
+                  "invalidate readback memory" );
+  }
+  m_readback( pending - 1, m_readback_mapped + offset,
+              static_cast< std::size_t >( m_frame_size ) );
+}
+
+void
+offscreen_scheduler::destroy()
+{
+  if( m_readback_mapped )
+  {
+    vkUnmapMemory( m_device, m_readback_memory );
+    m_readback_mapped = nullptr;
+  }
+  vkDestroyBuffer( m_device, m_readback_buffer, nullptr );
+  vkFreeMemory( m_device, m_readback_memory, nullptr );
+  for( uint32_t i = 0; i < m_images.size(); ++i )
+  {
+    vkDestroyFence( m_device, m_fences[ i ], nullptr );
+    vkDestroyCommandPool( m_device, m_command_pools[ i ], nullptr );
+    vkDestroyImageView( m_device, m_views[ i ], nullptr );
+    vkDestroyImage( m_device, m_images[ i ], nullptr );
+    vkFreeMemory( m_device, m_image_memory[ i ], nullptr );
+  }
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,191 @@
+#ifndef MYENGINE_OFFSCREEN_H
+#define MYENGINE_OFFSCREEN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+#include <myengine/queues.h>
+
+namespace myengine::vulkan {
+
+struct offscreen_scheduler_config
+{
+  VkExtent2D extent = { 800, 600 };
+  /// Color format of the targets. Must be one `texel_size` knows.
+  VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+  /// Target image usage; `VK_IMAGE_USAGE_TRANSFER_SRC_BIT` is added when
+  /// reading back.
+  VkImageUsageFlags image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  /// Frames the CPU may get ahead of the GPU. Without a display to wait on,
+  /// this is what keeps the device busy while the next frame is recorded.
+  uint32_t frames_in_flight = 3;
+};
+
+/**
+ * Bytes per texel of a color format.
+ *
+ * @throws std::invalid_argument Not an uncompressed 8, 16 or 32 bit per
+ * channel RGBA / BGRA format.
+ */
+uint32_t
+MYENGINE_EXPORT
+texel_size( VkFormat format );
+
+/**
+ * Headless counterpart of `frame_scheduler`: frames in flight rendering into
+ * device-local images instead of a swapchain, with no surface, window or
+ * presentation involved.
+ *
+ * Each frame slot has a device-local target image and view, a command pool and
+ * primary command buffer, a fence, and a slice of one persistently mapped,
+ * host-visible readback buffer (host-cached memory if there is any). When a
+ * readback callback is given, `end_frame` appends a copy of the target into
+ * the slot's slice, and the callback gets the pixels once the frame has
+ * completed: from `begin_frame` before the slot is reused, or from `finish`.
+ *
+ * Not thread-safe; `begin_frame`/`end_frame` are for one thread. Must be
+ * destroyed before the `VkDevice`.
+ */
+class MYENGINE_EXPORT offscreen_scheduler
+{
+public:
+  /// A frame being recorded, from `begin_frame`.
+  struct frame
+  {
+    /// Sequence number, from 0.
+    uint64_t number;
+    /// Frame slot, in [0, frames_in_flight).
+    uint32_t slot;
+    VkImage image;
+    VkImageView view;
+    /// Primary command buffer for the frame, already begun.
+    VkCommandBuffer cmd;
+  };
+
+  /**
+   * Receives the pixels of a completed frame: `extent.height` tightly packed
+   * rows of `extent.width` texels. The pointer is only valid during the call.
+   */
+  typedef std::function< void ( uint64_t frame, void const* pixels,
+                                std::size_t size ) > readback_fn;
+
+  /**
+   * @param queue_family Queue family of `queue`, for the command pools.
+   * @param queue Queue that frames are submitted to; must support graphics
+   * (or transfer, for only copies and clears).
+   * @param readback Called with each frame's pixels; if null, nothing is read
+   * back.
+   *
+   * @throws std::runtime_error Failed to create the targets or per frame
+   * objects.
+   * @throws std::invalid_argument Unsupported format.
+   */
+  offscreen_scheduler( VkPhysicalDevice physical_device, VkDevice device,
+                       uint32_t queue_family, VkQueue queue,
+                       offscreen_scheduler_config const& config =
+                         offscreen_scheduler_config(),
+                       readback_fn readback = nullptr );
+
+  offscreen_scheduler( offscreen_scheduler const& ) = delete;
+  offscreen_scheduler& operator=( offscreen_scheduler const& ) = delete;
+
+  /// Waits for all frames to finish; their pixels are not delivered.
+  ~offscreen_scheduler();
+
+  /**
+   * Wait for the next frame slot to be free, deliver its previous frame's
+   * pixels, and begin the slot's command buffer.
+   *
+   * @throws std::runtime_error A Vulkan call failed.
+   */
+  void begin_frame( frame& f );
+
+  /**
+   * End the frame's command buffer and submit it.
+   *
+   * The command buffer must leave the image in
+   * `VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL`, with its writes made available to
+   * the transfer stage, if reading back.
+   *
+   * @param waits Points of other queues' timelines to wait for first, see
+   * `timeline_queue`.
+   *
+   * @throws std::runtime_error Submission failed.
+   */
+  void end_frame( frame const& f,
+                  std::vector< timeline_wait > const& waits = {} );
+
+  /**
+   * Wait for every submitted frame to complete and deliver the pixels not yet
+   * delivered.
+   *
+   * @throws std::runtime_error Waiting failed.
+   */
+  void finish();
+
+  [[nodiscard]] VkExtent2D
+  extent() const
+  {
+    return m_config.extent;
+  }
+
+  [[nodiscard]] VkFormat
+  format() const
+  {
+    return m_config.format;
+  }
+
+  [[nodiscard]] uint32_t
+  frames_in_flight() const
+  {
+    return m_config.frames_in_flight;
+  }
+
+  /// Frames submitted so far.
+  [[nodiscard]] uint64_t
+  frames_submitted() const
+  {
+    return m_submitted;
+  }
+
+private:
+  VkDevice m_device;
+  VkQueue m_queue;
+  offscreen_scheduler_config m_config;
+  readback_fn m_readback;
+  /// Bytes of one frame's pixels.
+  VkDeviceSize m_frame_size;
+  /// Distance between slots in the readback buffer.
+  VkDeviceSize m_slot_stride;
+  bool m_readback_coherent;
+
+  // Per frame slot.
+  std::vector< VkImage > m_images;
+  std::vector< VkDeviceMemory > m_image_memory;
+  std::vector< VkImageView > m_views;
+  std::vector< VkCommandPool > m_command_pools;
+  std::vector< VkCommandBuffer > m_command_buffers;
+  std::vector< VkFence > m_fences;
+  /// Number + 1 of the frame last submitted in each slot and not yet retired,
+  /// 0 for none.
+  std::vector< uint64_t > m_pending;
+
+  VkBuffer m_readback_buffer;
+  VkDeviceMemory m_readback_memory;
+  uint8_t* m_readback_mapped;
+
+  uint64_t m_submitted;
+
+  /// Wait for the slot's last submission and deliver its pixels, if pending.
+  void retire( uint32_t slot );
+  void destroy();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_OFFSCREEN_H
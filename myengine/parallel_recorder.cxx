@@ -0,0 +1,315 @@
+#define MYENGINE_LOG_MODULE "vulkan.parallel_recorder"
+#include "parallel_recorder.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+parallel_recorder::parallel_recorder( VkDevice device, uint32_t queue_family,
+                                      parallel_recorder_config const& config )
+  : m_device( device ),
+    m_config( config ),
+    m_jobs( nullptr ),
+    m_pools(),
+    m_slot( 0 ),
+    m_recorded( 0 ),
+    m_chunk_cmds(),
+    m_mutex(),
+    m_cv(),
+    m_job( nullptr ),
+    m_generation( 0 ),
+    m_busy( 0 ),
+    m_stop( false ),
+    m_workers()
+{
+  if( m_config.threads == 0 )
+  {
+    m_config.threads = std::max( 1u, std::thread::hardware_concurrency() );
+  }
+  init( queue_family );
+}
+
+parallel_recorder::parallel_recorder( VkDevice device, uint32_t queue_family,
+                                      job_system& jobs,
+                                      parallel_recorder_config const& config )
+  : m_device( device ),
+    m_config( config ),
+    m_jobs( &jobs ),
+    m_pools(),
+    m_slot( 0 ),
+    m_recorded( 0 ),
+    m_chunk_cmds(),
+    m_mutex(),
+    m_cv(),
+    m_job( nullptr ),
+    m_generation( 0 ),
+    m_busy( 0 ),
+    m_stop( false ),
+    m_workers()
+{
+  // One pool per job system thread, see `job_system::thread_index`.
+  m_config.threads = jobs.worker_count() + 1;
+  init( queue_family );
+}
+
+parallel_recorder::~parallel_recorder()
+{
+  destroy();
+}
+
+void
+parallel_recorder::init( uint32_t queue_family )
+{
+  m_config.frames_in_flight = std::max( 1u, m_config.frames_in_flight );
+  m_config.chunks_per_thread = std::max( 1u, m_config.chunks_per_thread );
+
+  m_pools.resize( m_config.frames_in_flight * m_config.threads,
+                  pool{ VK_NULL_HANDLE, {}, 0 } );
+  try
+  {
+    for( auto& p : m_pools )
+    {
+      // Transient: pools are reset as a whole every time their slot comes
+      // around, so the buffers need no individual reset.
+      VkCommandPoolCreateInfo pool_info = {};
+      pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+      pool_info.queueFamilyIndex = queue_family;
+      check_result( vkCreateCommandPool( m_device, &pool_info, nullptr,
+                                         &p.pool ),
+                    "create recording command pool" );
+    }
+
+    // The calling thread is thread 0.
+    for( uint32_t i = 1; i < m_config.threads && !m_jobs; ++i )
+    {
+      m_workers.emplace_back( &parallel_recorder::work, this, i );
+    }
+  }
+  catch( ... )
+  {
+    destroy();
+    throw;
+  }
+
+  LOGF_INFO( "Parallel recorder with {} thread(s){}, {} frame slot(s)",
+             m_config.threads, m_jobs ? " of a job system" : "",
+             m_config.frames_in_flight );
+}
+
+void
+parallel_recorder::begin_frame( uint32_t slot )
+{
+  PROFILE_FUNCTION();
+  if( slot >= m_config.frames_in_flight )
+  {
+    throw std::invalid_argument( "Frame slot " + std::to_string( slot ) +
+                                 " out of range" );
+  }
+  m_slot = slot;
+  m_recorded = 0;
+  for( uint32_t t = 0; t < m_config.threads; ++t )
+  {
+    pool& p = m_pools[ slot * m_config.threads + t ];
+    if( p.used == 0 )
+    {
+      continue;
+    }
+    check_result( vkResetCommandPool( m_device, p.pool, 0 ),
+                  "reset recording command pool" );
+    p.used = 0;
+  }
+}
+
+void
+parallel_recorder::record( VkCommandBuffer primary,
+                           VkCommandBufferInheritanceInfo const& inheritance,
+                           uint32_t count, record_fn const& fn )
+{
+  PROFILE_FUNCTION();
+  if( count == 0 )
+  {
+    return;
+  }
+
+  job j;
+  j.inheritance = &inheritance;
+  j.fn = &fn;
+  j.count = count;
+  j.chunk_count =
+    std::min( count, m_config.threads * m_config.chunks_per_thread );
+  j.next.store( 0, std::memory_order_relaxed );
+  j.failed.store( false, std::memory_order_relaxed );
+  m_chunk_cmds.assign( j.chunk_count, VK_NULL_HANDLE );
+
+  if( m_jobs )
+  {
+    uint32_t const self = m_jobs->thread_index();
+    if( self == job_system::INVALID_THREAD )
+    {
+      throw std::logic_error(
+        "parallel_recorder::record called outside of its job system" );
+    }
+    // Helpers that find no chunks left return right away.
+    job_counter helpers;
+    for( uint32_t i = 1; i < std::min( m_config.threads, j.chunk_count ); ++i )
+    {
+      m_jobs->spawn( [ this, &j ] { run( j, m_jobs->thread_index() ); },
+                     &helpers );
+    }
+    run( j, self );
+    m_jobs->wait( helpers );
+  }
+  else
+  {
+    bool const parallel = !m_workers.empty() && j.chunk_count > 1;
+    if( parallel )
+    {
+      std::lock_guard< std::mutex > lock( m_mutex );
+      m_job = &j;
+      m_busy = static_cast< uint32_t >( m_workers.size() );
+      ++m_generation;
+      m_cv.notify_all();
+    }
+
+    run( j, 0 );
+
+    if( parallel )
+    {
+      std::unique_lock< std::mutex > lock( m_mutex );
+      m_cv.wait( lock, [ this ] { return m_busy == 0; } );
+      m_job = nullptr;
+    }
+  }
+  if( j.error )
+  {
+    std::rethrow_exception( j.error );
+  }
+  m_recorded += j.chunk_count;
+
+  PROFILE_ZONE( "execute_secondaries" );
+  vkCmdExecuteCommands( primary, j.chunk_count, m_chunk_cmds.data() );
+}
+
+void
+parallel_recorder::run( job& j, uint32_t thread )
+{
+  while( !j.failed.load( std::memory_order_relaxed ) )
+  {
+    uint32_t const chunk = j.next.fetch_add( 1, std::memory_order_relaxed );
+    if( chunk >= j.chunk_count )
+    {
+      return;
+    }
+    // Fixed by the count alone, not by which thread gets there first.
+    uint32_t const begin = static_cast< uint32_t >(
+      uint64_t( j.count ) * chunk / j.chunk_count );
+    uint32_t const end = static_cast< uint32_t >(
+      uint64_t( j.count ) * ( chunk + 1 ) / j.chunk_count );
+    try
+    {
+      PROFILE_ZONE( "record_chunk" );
+      VkCommandBuffer cmd = acquire( thread );
+      VkCommandBufferBeginInfo begin_info = {};
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      if( j.inheritance->renderPass != VK_NULL_HANDLE )
+      {
+        begin_info.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+      }
+      begin_info.pInheritanceInfo = j.inheritance;
+      check_result( vkBeginCommandBuffer( cmd, &begin_info ),
+                    "begin secondary command buffer" );
+      ( *j.fn )( cmd, begin, end );
+      check_result( vkEndCommandBuffer( cmd ), "end secondary command buffer" );
+      m_chunk_cmds[ chunk ] = cmd;
+    }
+    catch( ... )
+    {
+      std::lock_guard< std::mutex > lock( m_mutex );
+      if( !j.error )
+      {
+        j.error = std::current_exception();
+      }
+      j.failed.store( true, std::memory_order_relaxed );
+      return;
+    }
+  }
+}
+
+VkCommandBuffer
+parallel_recorder::acquire( uint32_t thread )
+{
+  pool& p = m_pools[ m_slot * m_config.threads + thread ];
+  if( p.used == p.buffers.size() )
+  {
+    VkCommandBufferAllocateInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = p.pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    cmd_info.commandBufferCount = 1;
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    check_result( vkAllocateCommandBuffers( m_device, &cmd_info, &cmd ),
+                  "allocate secondary command buffer" );
+    p.buffers.push_back( cmd );
+  }
+  return p.buffers[ p.used++ ];
+}
+
+void
+parallel_recorder::work( uint32_t thread )
+{
+  profiling::set_thread_name( "recorder " + std::to_string( thread ) );
+  uint64_t seen = 0;
+  std::unique_lock< std::mutex > lock( m_mutex );
+  for( ;; )
+  {
+    m_cv.wait( lock, [ & ] { return m_stop || m_generation != seen; } );
+    if( m_stop )
+    {
+      return;
+    }
+    seen = m_generation;
+    job& j = *m_job;
+    lock.unlock();
+    run( j, thread );
+    lock.lock();
+    if( --m_busy == 0 )
+    {
+      m_cv.notify_all();
+    }
+  }
+}
+
+void
+parallel_recorder::destroy()
+{
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    m_stop = true;
+  }
+  m_cv.notify_all();
+  for( auto& t : m_workers )
+  {
+    t.join();
+  }
+  m_workers.clear();
+
+  // Destroying a pool frees its command buffers.
+  for( auto& p : m_pools )
+  {
+    if( p.pool != VK_NULL_HANDLE )
+    {
+      vkDestroyCommandPool( m_device, p.pool, nullptr );
+    }
+  }
+  m_pools.clear();
+}
+
+} // namespace myengine::vulkan
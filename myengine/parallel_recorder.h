@@ -0,0 +1,196 @@
+#ifndef MYENGINE_PARALLEL_RECORDER_H
+#define MYENGINE_PARALLEL_RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/job_system.h>
+#include <myengine/myengine_export.h>
+
+namespace myengine::vulkan {
+
+struct parallel_recorder_config
+{
+  /// Recording threads, counting the thread calling `record`. 0 for one per
+  /// hardware thread.
+  uint32_t threads = 0;
+  /// Frame slots, each with its own command pools. Usually frames in flight.
+  uint32_t frames_in_flight = 2;
+  /// Chunks each thread gets per `record` call, on average. More chunks
+  /// balance uneven work better, at the cost of more secondary command buffers
+  /// to execute.
+  uint32_t chunks_per_thread = 4;
+};
+
+/**
+ * Records a range of work items into secondary command buffers on several
+ * threads, and executes them from a primary command buffer in item order.
+ *
+ * Command pools are not thread-safe, so every thread has its own pool per
+ * frame slot. `begin_frame` resets all of a slot's pools at once; secondary
+ * command buffers are allocated once and reused, never freed or reset one by
+ * one.
+ *
+ * `record` splits the items into contiguous chunks, which the threads take in
+ * turn; each chunk goes into its own secondary command buffer. The chunks
+ * depend only on the item count and the configuration, and are executed in
+ * chunk order, so the commands reach the primary command buffer in the same
+ * order however the threads raced.
+ *
+ * Recording runs either on threads of its own, or as jobs on a `job_system`,
+ * with a pool per job system thread.
+ *
+ * Not thread-safe; `begin_frame`/`record` are for one thread. Must be
+ * destroyed before the `VkDevice`.
+ */
+class MYENGINE_EXPORT parallel_recorder
+{
+public:
+  /**
+   * Records the items [begin, end) into `cmd`, a secondary command buffer
+   * that is already begun and is ended afterwards.
+   *
+   * Called on any of the threads, concurrently with other chunks. Nothing is
+   * bound in `cmd` beforehand: it must bind its own pipeline, descriptor sets
+   * and dynamic state.
+   */
+  typedef std::function< void ( VkCommandBuffer cmd, uint32_t begin,
+                                uint32_t end ) > record_fn;
+
+  /**
+   * @param queue_family Queue family that the primary command buffers are
+   * submitted to, for the command pools.
+   *
+   * @throws std::runtime_error Failed to create the command pools.
+   */
+  parallel_recorder( VkDevice device, uint32_t queue_family,
+                     parallel_recorder_config const& config =
+                       parallel_recorder_config() );
+
+  /**
+   * Record as jobs on `jobs`, on all of its threads; `config.threads` is
+   * ignored. `record` must then be called on the main thread or a worker of
+   * `jobs`, which must outlive this.
+   *
+   * @throws std::runtime_error Failed to create the command pools.
+   */
+  parallel_recorder( VkDevice device, uint32_t queue_family, job_system& jobs,
+                     parallel_recorder_config const& config =
+                       parallel_recorder_config() );
+
+  parallel_recorder( parallel_recorder const& ) = delete;
+  parallel_recorder& operator=( parallel_recorder const& ) = delete;
+
+  /// Stops the worker threads. Command buffers recorded from this may no
+  /// longer be pending execution.
+  ~parallel_recorder();
+
+  /**
+   * Start recording into frame slot `slot`, resetting its command pools.
+   *
+   * Every command buffer executing the slot's secondaries from the last time
+   * around must have completed, e.g. by having waited on the frame's fence.
+   *
+   * @throws std::invalid_argument `slot` is not below `frames_in_flight`.
+   * @throws std::runtime_error Resetting failed.
+   */
+  void begin_frame( uint32_t slot );
+
+  /**
+   * Record the items [0, count) with `fn` on all threads, then execute the
+   * resulting secondary command buffers in `primary`.
+   *
+   * May be called several times per frame, e.g. once per render pass.
+   *
+   * @param primary Primary command buffer being recorded.
+   * @param inheritance State the secondaries inherit. With a render pass,
+   * they continue it, and `primary` must be inside it with
+   * `VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS`.
+   *
+   * @throws std::runtime_error A Vulkan call failed.
+   * @throws std::logic_error Called on a thread outside the job system.
+   * @throws Whatever `fn` threw, after all threads have stopped recording.
+   * Nothing is executed in `primary` then.
+   */
+  void record( VkCommandBuffer primary,
+               VkCommandBufferInheritanceInfo const& inheritance,
+               uint32_t count, record_fn const& fn );
+
+  [[nodiscard]] uint32_t
+  threads() const
+  {
+    return m_config.threads;
+  }
+
+  /// Secondary command buffers recorded since `begin_frame`.
+  [[nodiscard]] uint32_t
+  secondaries_recorded() const
+  {
+    return m_recorded;
+  }
+
+private:
+  /// Command pool of one thread in one frame slot.
+  struct pool
+  {
+    VkCommandPool pool;
+    /// Allocated so far; the first `used` are recorded in this frame.
+    std::vector< VkCommandBuffer > buffers;
+    uint32_t used;
+  };
+
+  /// One `record` call, shared with the workers.
+  struct job
+  {
+    VkCommandBufferInheritanceInfo const* inheritance;
+    record_fn const* fn;
+    uint32_t count;
+    uint32_t chunk_count;
+    /// Next chunk to take.
+    std::atomic< uint32_t > next;
+    /// First error; the other threads stop taking chunks once set.
+    std::atomic< bool > failed;
+    std::exception_ptr error;
+  };
+
+  VkDevice m_device;
+  parallel_recorder_config m_config;
+  /// Null when recording on threads of our own.
+  job_system* m_jobs;
+  /// [slot * threads + thread]
+  std::vector< pool > m_pools;
+  uint32_t m_slot;
+  uint32_t m_recorded;
+  /// Secondary command buffer of each chunk of the current job.
+  std::vector< VkCommandBuffer > m_chunk_cmds;
+
+  // Shared with the workers.
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  job* m_job;
+  /// Bumped for every job, which wakes the workers.
+  uint64_t m_generation;
+  /// Workers still on the current job.
+  uint32_t m_busy;
+  bool m_stop;
+  std::vector< std::thread > m_workers;
+
+  void init( uint32_t queue_family );
+  /// Take and record chunks of the current job until there are none left.
+  void run( job& j, uint32_t thread );
+  VkCommandBuffer acquire( uint32_t thread );
+  void work( uint32_t thread );
+  void destroy();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_PARALLEL_RECORDER_H
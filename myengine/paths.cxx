@@ -0,0 +1,105 @@
+#include "paths.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#ifdef _WIN32
+# include <direct.h>
+#else
+# include <sys/stat.h>
+#endif
+
+namespace myengine {
+
+namespace {
+
+#ifdef _WIN32
+constexpr char SEPARATOR = '\\';
+#else
+constexpr char SEPARATOR = '/';
+#endif
+
+/// Create a directory and any missing parents.
+bool
+make_dirs( std::string const& path )
+{
+  for( std::size_t pos = path.find_first_of( "/\\", 1 );
+       ; pos = path.find_first_of( "/\\", pos + 1 ) )
+  {
+    std::string const part = path.substr( 0, pos );
+#ifdef _WIN32
+    // Skip drive roots, e.g. "C:".
+    bool const ok = ( part.size() == 2 && part[ 1 ] == ':' ) ||
+                    _mkdir( part.c_str() ) == 0 || errno == EEXIST;
+#else
+    bool const ok = mkdir( part.c_str(), 0755 ) == 0 || errno == EEXIST;
+#endif
+    if( !ok )
+    {
+      return false;
+    }
+    if( pos == std::string::npos )
+    {
+      return true;
+    }
+  }
+}
+
+std::string
+find_cache_dir()
+{
+  if( char const* dir = std::getenv( "MYENGINE_CACHE_DIR" ) )
+  {
+    return dir;
+  }
+#ifdef _WIN32
+  if( char const* dir = std::getenv( "LOCALAPPDATA" ) )
+  {
+    return std::string( dir ) + SEPARATOR + "myengine";
+  }
+#else
+  if( char const* dir = std::getenv( "XDG_CACHE_HOME" ); dir && *dir )
+  {
+    return std::string( dir ) + SEPARATOR + "myengine";
+  }
+  if( char const* home = std::getenv( "HOME" ); home && *home )
+  {
+    return std::string( home ) + SEPARATOR + ".cache" + SEPARATOR +
+           "myengine";
+  }
+#endif
+  return std::string();
+}
+
+} // namespace
+
+std::string
+user_cache_dir()
+{
+  static std::string const dir = [] {
+    std::string d = find_cache_dir();
+    while( d.size() > 1 && ( d.back() == '/' || d.back() == '\\' ) )
+    {
+      d.pop_back();
+    }
+    if( d.empty() || !make_dirs( d ) )
+    {
+      return std::string();
+    }
+    return d;
+  }();
+  return dir;
+}
+
+std::string
+user_cache_path( std::string const& file_name )
+{
+  std::string dir = user_cache_dir();
+  if( dir.empty() )
+  {
+    return dir;
+  }
+  return dir + SEPARATOR + file_name;
+}
+
+} // namespace myengine
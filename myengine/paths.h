@@ -0,0 +1,35 @@
+#ifndef MYENGINE_PATHS_H
+#define MYENGINE_PATHS_H
+
+#include <string>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine {
+
+/**
+ * Per-user directory for caches that may be deleted at any time (capability
+ * snapshots, pipeline caches, ...), created if it does not exist.
+ *
+ * This is `$MYENGINE_CACHE_DIR` if set, otherwise `myengine` under
+ * `$XDG_CACHE_HOME`, `$HOME/.cache` or, on Windows, `%LOCALAPPDATA%`.
+ *
+ * @return Directory path without a trailing separator, or an empty string if
+ * no suitable directory could be determined or created.
+ */
+[[nodiscard]] std::string
+MYENGINE_EXPORT
+user_cache_dir();
+
+/**
+ * Path of a file in `user_cache_dir()`.
+ *
+ * @return Empty string if there is no cache directory.
+ */
+[[nodiscard]] std::string
+MYENGINE_EXPORT
+user_cache_path( std::string const& file_name );
+
+} // namespace myengine
+
+#endif //MYENGINE_PATHS_H
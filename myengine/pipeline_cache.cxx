@@ -0,0 +1,427 @@
+#define MYENGINE_LOG_MODULE "vulkan.pipeline_cache"
+#include "pipeline_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <vulkan/vulkan.hpp>
+
+#include <myengine/logging.h>
+#include <myengine/mapped_file.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// FNV-1a, 64 bit.
+uint64_t
+hash64( void const* data, std::size_t size )
+{
+  uint64_t h = 14695981039346656037ull;
+  auto const* p = static_cast< uint8_t const* >( data );
+  for( std::size_t i = 0; i < size; ++i )
+  {
+    h = ( h ^ p[ i ] ) * 1099511628211ull;
+  }
+  return h;
+}
+
+int64_t
+to_us( steady_clock_t::duration d )
+{
+  return std::chrono::duration_cast< std::chrono::microseconds >( d ).count();
+}
+
+/**
+ * If a pipeline cache blob was produced for this device.
+ *
+ * @param [out] reason Why not, for logging.
+ */
+bool
+validate_cache_header( uint8_t const* data, std::size_t size,
+                       VkPhysicalDeviceProperties const& props,
+                       char const*& reason )
+{
+  VkPipelineCacheHeaderVersionOne hdr;
+  if( size < sizeof( hdr ) )
+  {
+    reason = "too small for a header";
+    return false;
+  }
+  memcpy( &hdr, data, sizeof( hdr ) );
+  if( hdr.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      hdr.headerSize < sizeof( hdr ) || hdr.headerSize > size )
+  {
+    reason = "unknown header version";
+    return false;
+  }
+  if( hdr.vendorID != props.vendorID || hdr.deviceID != props.deviceID )
+  {
+    reason = "written for a different device";
+    return false;
+  }
+  if( memcmp( hdr.pipelineCacheUUID, props.pipelineCacheUUID,
+              VK_UUID_SIZE ) != 0 )
+  {
+    reason = "written by a different driver version";
+    return false;
+  }
+  return true;
+}
+
+VkPipelineCache
+create_cache( VkDevice device, void const* data, std::size_t size )
+{
+  VkPipelineCacheCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  create_info.initialDataSize = size;
+  create_info.pInitialData = data;
+  VkPipelineCache cache = VK_NULL_HANDLE;
+  VkResult res = vkCreatePipelineCache( device, &create_info, nullptr,
+                                        &cache );
+  if( res != VK_SUCCESS )
+  {
+    std::stringstream ss;
+    ss  << "Failed to create pipeline cache: "
+        << vk::to_string( static_cast< vk::Result >( res ) );
+    throw std::runtime_error( ss.str() );
+  }
+  return cache;
+}
+
+/// If a `pNext` chain already has creation feedback requested.
+bool
+has_feedback_struct( void const* p_next )
+{
+  for( auto const* s = static_cast< VkBaseInStructure const* >( p_next ); s;
+       s = s->pNext )
+  {
+    if( s->sType ==
+        VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Copies of pipeline create-infos with creation feedback chained in.
+ *
+ * Infos that already request feedback are left alone; their entries in
+ * `pipeline_feedback` stay zero, i.e. not valid.
+ */
+template< typename CreateInfo >
+struct feedback_request
+{
+  std::vector< CreateInfo > infos;
+  std::vector< VkPipelineCreationFeedbackCreateInfoEXT > chain;
+  std::vector< VkPipelineCreationFeedbackEXT > pipeline_feedback;
+  std::vector< std::vector< VkPipelineCreationFeedbackEXT > > stage_feedback;
+
+  feedback_request( CreateInfo const* create_infos, uint32_t count,
+                    uint32_t ( *stage_count )( CreateInfo const& ) )
+    : infos( create_infos, create_infos + count ),
+      chain( count ),
+      pipeline_feedback( count ),
+      stage_feedback( count )
+  {
+    for( uint32_t i = 0; i < count; ++i )
+    {
+      if( has_feedback_struct( infos[ i ].pNext ) )
+      {
+        continue;
+      }
+      stage_feedback[ i ].resize( stage_count( infos[ i ] ) );
+      auto& fb = chain[ i ];
+      fb.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+      fb.pNext = infos[ i ].pNext;
+      fb.pPipelineCreationFeedback = &pipeline_feedback[ i ];
+      fb.pipelineStageCreationFeedbackCount =
+        static_cast< uint32_t >( stage_feedback[ i ].size() );
+      fb.pPipelineStageCreationFeedbacks = stage_feedback[ i ].data();
+      infos[ i ].pNext = &fb;
+    }
+  }
+};
+
+uint32_t
+graphics_stage_count( VkGraphicsPipelineCreateInfo const& info )
+{
+  return info.stageCount;
+}
+
+uint32_t
+compute_stage_count( VkComputePipelineCreateInfo const& )
+{
+  return 1;
+}
+
+} // namespace
+
+pipeline_cache::pipeline_cache( VkDevice device,
+                                VkPhysicalDeviceProperties const& properties,
+                                std::string path, bool creation_feedback,
+                                std::chrono::seconds save_interval )
+  : m_device( device ),
+    m_properties( properties ),
+    m_path( std::move( path ) ),
+    m_creation_feedback( creation_feedback ),
+    m_save_interval( save_interval ),
+    m_cache( VK_NULL_HANDLE ),
+    m_mutex(),
+    m_workers(),
+    m_dirty( false ),
+    m_saved_hash( 0 ),
+    m_last_save( steady_clock_t::now() ),
+    m_hits( 0 ),
+    m_misses( 0 ),
+    m_hit_ns( 0 ),
+    m_miss_ns( 0 )
+{
+  mapped_file file;
+  if( !m_path.empty() )
+  {
+    try
+    {
+      file = mapped_file::open_read( m_path );
+    }
+    catch( std::exception const& ex )
+    {
+      LOG_DEBUG( "No pipeline cache loaded: " << ex.what() );
+    }
+  }
+
+  char const* reason = nullptr;
+  if( file.is_open() && validate_cache_header( file.data(), file.size(),
+                                               m_properties, reason ) )
+  {
+    auto const start = steady_clock_t::now();
+    m_cache = create_cache( m_device, file.data(), file.size() );
+    m_saved_hash = hash64( file.data(), file.size() );
+    LOGF_INFO( "Loaded pipeline cache '{}' ({} bytes) in {} us",
+               m_path.c_str(), file.size(),
+               to_us( steady_clock_t::now() - start ) );
+  }
+  else
+  {
+    if( reason )
+    {
+      LOGF_INFO( "Discarding pipeline cache '{}': {}", m_path.c_str(),
+                 reason );
+    }
+    m_cache = create_cache( m_device, nullptr, 0 );
+  }
+}
+
+pipeline_cache::~pipeline_cache()
+{
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    for( VkPipelineCache worker : m_workers )
+    {
+      vkMergePipelineCaches( m_device, m_cache, 1, &worker );
+      vkDestroyPipelineCache( m_device, worker, nullptr );
+      m_dirty.store( true, std::memory_order_relaxed );
+    }
+    m_workers.clear();
+  }
+  try
+  {
+    save();
+  }
+  catch( std::exception const& ex )
+  {
+    LOG_WARN( "Failed to save pipeline cache: " << ex.what() );
+  }
+
+  uint64_t const hits = hit_count();
+  uint64_t const misses = miss_count();
+  if( hits + misses > 0 )
+  {
+    LOGF_INFO( "Pipeline cache: {} hit(s) averaging {} us, {} miss(es) "
+               "averaging {} us",
+               hits, hits ? m_hit_ns.load() / 1000 / int64_t( hits ) : 0,
+               misses, misses ? m_miss_ns.load() / 1000 / int64_t( misses ) : 0 );
+  }
+  vkDestroyPipelineCache( m_device, m_cache, nullptr );
+}
+
+VkPipelineCache
+pipeline_cache::create_worker_cache()
+{
+  VkPipelineCache cache = create_cache( m_device, nullptr, 0 );
+  std::lock_guard< std::mutex > lock( m_mutex );
+  m_workers.push_back( cache );
+  return cache;
+}
+
+void
+pipeline_cache::merge_worker_cache( VkPipelineCache worker_cache )
+{
+  std::lock_guard< std::mutex > lock( m_mutex );
+  auto it = std::find( m_workers.begin(), m_workers.end(), worker_cache );
+  if( it == m_workers.end() )
+  {
+    LOG_WARN( "Not a worker cache of this pipeline cache" );
+    return;
+  }
+  m_workers.erase( it );
+  VkResult res = vkMergePipelineCaches( m_device, m_cache, 1, &worker_cache );
+  if( res != VK_SUCCESS )
+  {
+    LOG_WARN( "Failed to merge pipeline cache: "
+                << vk::to_string( static_cast< vk::Result >( res ) ) );
+  }
+  vkDestroyPipelineCache( m_device, worker_cache, nullptr );
+  m_dirty.store( true, std::memory_order_relaxed );
+}
+
+VkResult
+pipeline_cache::create_graphics_pipelines(
+  VkPipelineCache cache, char const* name, uint32_t count,
+  VkGraphicsPipelineCreateInfo const* create_infos, VkPipeline* pipelines )
+{
+  cache = cache ? cache : m_cache;
+  if( !m_creation_feedback )
+  {
+    auto const start = steady_clock_t::now();
+    VkResult res = vkCreateGraphicsPipelines( m_device, cache, count,
+                                              create_infos, nullptr,
+                                              pipelines );
+    report( name, count, steady_clock_t::now() - start, res, nullptr );
+    return res;
+  }
+  feedback_request< VkGraphicsPipelineCreateInfo > req( create_infos, count,
+                                                        graphics_stage_count );
+  auto const start = steady_clock_t::now();
+  VkResult res = vkCreateGraphicsPipelines( m_device, cache, count,
+                                            req.infos.data(), nullptr,
+                                            pipelines );
+  report( name, count, steady_clock_t::now() - start, res,
+          req.pipeline_feedback.data() );
+  return res;
+}
+
+VkResult
+pipeline_cache::create_compute_pipelines(
+  VkPipelineCache cache, char const* name, uint32_t count,
+  VkComputePipelineCreateInfo const* create_infos, VkPipeline* pipelines )
+{
+  cache = cache ? cache : m_cache;
+  if( !m_creation_feedback )
+  {
+    auto const start = steady_clock_t::now();
+    VkResult res = vkCreateComputePipelines( m_device, cache, count,
+                                             create_infos, nullptr,
+                                             pipelines );
+    report( name, count, steady_clock_t::now() - start, res, nullptr );
+    return res;
+  }
+  feedback_request< VkComputePipelineCreateInfo > req( create_infos, count,
+                                                       compute_stage_count );
+  auto const start = steady_clock_t::now();
+  VkResult res = vkCreateComputePipelines( m_device, cache, count,
+                                           req.infos.data(), nullptr,
+                                           pipelines );
+  report( name, count, steady_clock_t::now() - start, res,
+          req.pipeline_feedback.data() );
+  return res;
+}
+
+void
+pipeline_cache::report( char const* name, uint32_t count,
+                        steady_clock_t::duration elapsed, VkResult result,
+                        VkPipelineCreationFeedbackEXT const* feedback )
+{
+  if( result != VK_SUCCESS )
+  {
+    LOGF_WARN( "Creating {} pipeline(s) '{}' failed: {}", count, name,
+               vk::to_string( static_cast< vk::Result >( result ) ).c_str() );
+    return;
+  }
+  m_dirty.store( true, std::memory_order_relaxed );
+  int64_t const total_ns =
+    std::chrono::duration_cast< std::chrono::nanoseconds >( elapsed ).count();
+  for( uint32_t i = 0; i < count; ++i )
+  {
+    bool valid = feedback &&
+                 ( feedback[ i ].flags &
+                   VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT );
+    bool hit = valid &&
+               ( feedback[ i ].flags &
+                 VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT );
+    int64_t const ns = valid ? static_cast< int64_t >( feedback[ i ].duration )
+                             : total_ns / count;
+    ( hit ? m_hits : m_misses ).fetch_add( 1, std::memory_order_relaxed );
+    ( hit ? m_hit_ns : m_miss_ns ).fetch_add( ns, std::memory_order_relaxed );
+    LOGF_DEBUG( "Pipeline '{}'[{}] created in {} us, cache {}", name, i,
+                ns / 1000, valid ? ( hit ? "hit" : "miss" ) : "unknown" );
+  }
+}
+
+void
+pipeline_cache::save()
+{
+  if( m_path.empty() || !m_dirty.load( std::memory_order_relaxed ) )
+  {
+    return;
+  }
+  std::lock_guard< std::mutex > lock( m_mutex );
+  m_last_save = steady_clock_t::now();
+  m_dirty.store( false, std::memory_order_relaxed );
+
+  std::size_t size = 0;
+  VkResult res = vkGetPipelineCacheData( m_device, m_cache, &size, nullptr );
+  std::vector< uint8_t > data( size );
+  if( res == VK_SUCCESS && size > 0 )
+  {
+    res = vkGetPipelineCacheData( m_device, m_cache, &size, data.data() );
+  }
+  if( res != VK_SUCCESS )
+  {
+    std::stringstream ss;
+    ss  << "Failed to get pipeline cache data: "
+        << vk::to_string( static_cast< vk::Result >( res ) );
+    throw std::runtime_error( ss.str() );
+  }
+  uint64_t const hash = hash64( data.data(), size );
+  if( size == 0 || hash == m_saved_hash )
+  {
+    return;
+  }
+  auto const start = steady_clock_t::now();
+  write_file_atomic( m_path, { { data.data(), size } } );
+  m_saved_hash = hash;
+  LOGF_DEBUG( "Saved pipeline cache '{}' ({} bytes) in {} us", m_path.c_str(),
+              size, to_us( steady_clock_t::now() - start ) );
+}
+
+void
+pipeline_cache::poll()
+{
+  if( !m_dirty.load( std::memory_order_relaxed ) )
+  {
+    return;
+  }
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    if( steady_clock_t::now() - m_last_save < m_save_interval )
+    {
+      return;
+    }
+  }
+  try
+  {
+    save();
+  }
+  catch( std::exception const& ex )
+  {
+    LOG_WARN( "Failed to save pipeline cache: " << ex.what() );
+  }
+}
+
+} // namespace myengine::vulkan
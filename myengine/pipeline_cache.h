@@ -0,0 +1,159 @@
+#ifndef MYENGINE_PIPELINE_CACHE_H
+#define MYENGINE_PIPELINE_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine::vulkan {
+
+/**
+ * Owner of a `VkPipelineCache` that persists across runs.
+ *
+ * On construction the cache file is memory-mapped and its
+ * `VkPipelineCacheHeaderVersionOne` is checked against the device: vendor ID,
+ * device ID and `pipelineCacheUUID` must match, otherwise the blob is discarded
+ * and the cache starts empty. Drivers are supposed to reject foreign data on
+ * their own, but not all of them do so gracefully.
+ *
+ * Pipelines should be created with `cache()`, or through the
+ * `create_*_pipelines` wrappers, which also time each creation and (when
+ * `VK_EXT_pipeline_creation_feedback` is enabled) report whether it was a
+ * cache hit.
+ *
+ * Threads compiling pipelines in parallel can each get their own cache from
+ * `create_worker_cache`, avoiding contention inside the driver's cache. These
+ * are merged into the main cache by `merge_worker_cache`.
+ *
+ * The cache is written back with `save` (atomically, via a temporary file and
+ * rename), from `poll` every `save_interval` if it changed, and on
+ * destruction. Must be destroyed before the `VkDevice`.
+ */
+class MYENGINE_EXPORT pipeline_cache
+{
+public:
+  /**
+   * @param device Logical device to create the cache on.
+   * @param properties Properties of the device's physical device.
+   * @param path Cache file, e.g. `user_cache_path( "pipeline_cache.bin" )`.
+   * May be empty to not persist anything.
+   * @param creation_feedback If `VK_EXT_pipeline_creation_feedback` (or
+   * Vulkan 1.3) is enabled on the device, to report cache hits.
+   * @param save_interval Minimum time between saves from `poll`.
+   *
+   * @throws std::runtime_error Failed to create the pipeline cache.
+   */
+  pipeline_cache( VkDevice device, VkPhysicalDeviceProperties const& properties,
+                  std::string path, bool creation_feedback = false,
+                  std::chrono::seconds save_interval = std::chrono::seconds( 60 ) );
+
+  pipeline_cache( pipeline_cache const& ) = delete;
+  pipeline_cache& operator=( pipeline_cache const& ) = delete;
+
+  /// Merges outstanding worker caches, saves, and destroys the caches.
+  ~pipeline_cache();
+
+  /// The main cache handle.
+  [[nodiscard]] VkPipelineCache
+  cache() const
+  {
+    return m_cache;
+  }
+
+  /**
+   * Create an empty cache for one worker thread's pipeline creation.
+   *
+   * @throws std::runtime_error Failed to create the pipeline cache.
+   */
+  [[nodiscard]] VkPipelineCache create_worker_cache();
+
+  /**
+   * Merge a cache from `create_worker_cache` into the main cache and destroy
+   * it. The worker must be done using it.
+   */
+  void merge_worker_cache( VkPipelineCache worker_cache );
+
+  /**
+   * Create graphics pipelines through a cache, logging the time taken per
+   * pipeline and whether it hit the cache.
+   *
+   * @param cache Cache to use; null for the main cache.
+   * @param name Name for the log messages.
+   *
+   * @return Result of `vkCreateGraphicsPipelines`.
+   */
+  VkResult
+  create_graphics_pipelines( VkPipelineCache cache, char const* name,
+                             uint32_t count,
+                             VkGraphicsPipelineCreateInfo const* create_infos,
+                             VkPipeline* pipelines );
+
+  /// Compute pipeline version of `create_graphics_pipelines`.
+  VkResult
+  create_compute_pipelines( VkPipelineCache cache, char const* name,
+                            uint32_t count,
+                            VkComputePipelineCreateInfo const* create_infos,
+                            VkPipeline* pipelines );
+
+  /**
+   * Write the cache to its file now if it changed since the last save.
+   *
+   * @throws std::runtime_error Failed to read the cache data or write the file.
+   */
+  void save();
+
+  /// Save if `save_interval` has passed. Errors are logged, not thrown.
+  void poll();
+
+  /// Pipelines created through the wrappers that hit / missed the cache.
+  /// Creations without feedback count as misses.
+  [[nodiscard]] uint64_t
+  hit_count() const
+  {
+    return m_hits.load( std::memory_order_relaxed );
+  }
+
+  [[nodiscard]] uint64_t
+  miss_count() const
+  {
+    return m_misses.load( std::memory_order_relaxed );
+  }
+
+private:
+  VkDevice m_device;
+  VkPhysicalDeviceProperties m_properties;
+  std::string m_path;
+  bool m_creation_feedback;
+  std::chrono::steady_clock::duration m_save_interval;
+  VkPipelineCache m_cache;
+
+  // Guards the main cache as a merge destination, the worker list and the save
+  // bookkeeping.
+  std::mutex m_mutex;
+  std::vector< VkPipelineCache > m_workers;
+  std::atomic< bool > m_dirty;
+  uint64_t m_saved_hash;
+  std::chrono::steady_clock::time_point m_last_save;
+
+  std::atomic< uint64_t > m_hits;
+  std::atomic< uint64_t > m_misses;
+  std::atomic< int64_t > m_hit_ns;
+  std::atomic< int64_t > m_miss_ns;
+
+  /// Log and count one batch of created pipelines.
+  void report( char const* name, uint32_t count,
+               std::chrono::steady_clock::duration elapsed, VkResult result,
+               VkPipelineCreationFeedbackEXT const* feedback );
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_PIPELINE_CACHE_H
@@ -0,0 +1,421 @@
+#define MYENGINE_LOG_MODULE "vulkan.pipeline_compiler"
+#include "pipeline_compiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <vulkan/vulkan.hpp>
+
+#include <myengine/logging.h>
+#include <myengine/mapped_file.h>
+#include <myengine/profiling.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+/// Words of the SPIR-V header.
+constexpr std::size_t SPIRV_HEADER_WORDS = 5;
+
+/// FNV-1a, 64 bit.
+uint64_t
+hash64( void const* data, std::size_t size )
+{
+  uint64_t h = 14695981039346656037ull;
+  auto const* p = static_cast< uint8_t const* >( data );
+  for( std::size_t i = 0; i < size; ++i )
+  {
+    h = ( h ^ p[ i ] ) * 1099511628211ull;
+  }
+  return h;
+}
+
+/// Why `code` is not SPIR-V, or null if it looks like it.
+char const*
+check_spirv( void const* code, std::size_t size )
+{
+  if( size % sizeof( uint32_t ) != 0 ||
+      size < SPIRV_HEADER_WORDS * sizeof( uint32_t ) )
+  {
+    return "size is not a whole number of words past the header";
+  }
+  uint32_t magic;
+  std::memcpy( &magic, code, sizeof( magic ) );
+  if( magic != SPIRV_MAGIC )
+  {
+    return "bad magic number";
+  }
+  return nullptr;
+}
+
+VkSpecializationInfo
+specialization_info( shader_stage const& stage )
+{
+  VkSpecializationInfo info = {};
+  info.mapEntryCount =
+    static_cast< uint32_t >( stage.specialization_entries.size() );
+  info.pMapEntries = stage.specialization_entries.data();
+  info.dataSize = stage.specialization_data.size();
+  info.pData = stage.specialization_data.data();
+  return info;
+}
+
+VkPipelineShaderStageCreateInfo
+stage_info( shader_stage const& stage,
+            VkSpecializationInfo const& specialization )
+{
+  VkPipelineShaderStageCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  info.stage = stage.stage;
+  info.module = stage.module;
+  info.pName = stage.entry.c_str();
+  if( specialization.mapEntryCount > 0 )
+  {
+    info.pSpecializationInfo = &specialization;
+  }
+  return info;
+}
+
+} // namespace
+
+std::string const&
+pipeline_handle::error() const
+{
+  static std::string const none;
+  return ready() ? m_state->error : none;
+}
+
+pipeline_compiler::pipeline_compiler( VkDevice device, pipeline_cache& cache,
+                                      job_system& jobs )
+  : m_device( device ),
+    m_cache( cache ),
+    m_jobs( jobs ),
+    m_mutex(),
+    m_shaders(),
+    m_states(),
+    m_shader_count( 0 ),
+    m_shader_duplicates( 0 ),
+    m_pipelines( 0 ),
+    m_failures( 0 ),
+    m_compile_ns( 0 )
+{}
+
+pipeline_compiler::~pipeline_compiler()
+{
+  std::vector< std::shared_ptr< detail::pipeline_state > > states;
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    states.swap( m_states );
+  }
+  for( auto const& state : states )
+  {
+    m_jobs.wait( state->done );
+    vkDestroyPipeline( m_device, state->pipeline, nullptr );
+  }
+  for( auto const& [ hash, entries ] : m_shaders )
+  {
+    for( auto const& entry : entries )
+    {
+      vkDestroyShaderModule( m_device, entry.module, nullptr );
+    }
+  }
+}
+
+VkShaderModule
+pipeline_compiler::create_shader( uint32_t const* code, std::size_t size )
+{
+  if( char const* reason = check_spirv( code, size ) )
+  {
+    throw std::invalid_argument( std::string( "Not SPIR-V: " ) + reason );
+  }
+  uint64_t const hash = hash64( code, size );
+  std::size_t const words = size / sizeof( uint32_t );
+  // Creating modules is cheap enough to do under the lock, and keeps two
+  // threads from creating the same one.
+  std::lock_guard< std::mutex > lock( m_mutex );
+  auto& entries = m_shaders[ hash ];
+  for( auto const& entry : entries )
+  {
+    if( entry.code.size() == words &&
+        std::equal( entry.code.begin(), entry.code.end(), code ) )
+    {
+      m_shader_duplicates.fetch_add( 1, std::memory_order_relaxed );
+      return entry.module;
+    }
+  }
+
+  VkShaderModuleCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  info.codeSize = size;
+  info.pCode = code;
+  VkShaderModule module = VK_NULL_HANDLE;
+  VkResult const res = vkCreateShaderModule( m_device, &info, nullptr,
+                                             &module );
+  if( res != VK_SUCCESS )
+  {
+    std::stringstream ss;
+    ss  << "Failed to create shader module: "
+        << vk::to_string( static_cast< vk::Result >( res ) );
+    throw std::runtime_error( ss.str() );
+  }
+  entries.push_back( { std::vector< uint32_t >( code, code + words ),
+                       module } );
+  m_shader_count.fetch_add( 1, std::memory_order_relaxed );
+  return module;
+}
+
+VkShaderModule
+pipeline_compiler::load_shader( std::string const& path )
+{
+  PROFILE_FUNCTION();
+  mapped_file const file = mapped_file::open_read( path );
+  if( char const* reason = check_spirv( file.data(), file.size() ) )
+  {
+    throw std::runtime_error( "Not SPIR-V: '" + path + "': " + reason );
+  }
+  // Mappings are page aligned.
+  return create_shader( reinterpret_cast< uint32_t const* >( file.data() ),
+                        file.size() );
+}
+
+template < typename Create >
+pipeline_handle
+pipeline_compiler::start( std::string const& name, Create create )
+{
+  auto state = std::make_shared< detail::pipeline_state >();
+  {
+    std::lock_guard< std::mutex > lock( m_mutex );
+    m_states.push_back( state );
+  }
+  // Jobs must not throw: errors go to the state.
+  m_jobs.spawn(
+    [ this, state, name, create ]() {
+      PROFILE_ZONE( "compile pipeline" );
+      auto const begin = steady_clock_t::now();
+      try
+      {
+        VkResult const res = create( state->pipeline );
+        if( res != VK_SUCCESS )
+        {
+          state->error = "creation returned " +
+                         vk::to_string( static_cast< vk::Result >( res ) );
+        }
+      }
+      catch( std::exception const& ex )
+      {
+        state->error = ex.what();
+      }
+      m_compile_ns.fetch_add(
+        std::chrono::duration_cast< std::chrono::nanoseconds >(
+          steady_clock_t::now() - begin ).count(),
+        std::memory_order_relaxed );
+      if( state->error.empty() )
+      {
+        m_pipelines.fetch_add( 1, std::memory_order_relaxed );
+        return;
+      }
+      m_failures.fetch_add( 1, std::memory_order_relaxed );
+      if( state->pipeline != VK_NULL_HANDLE )
+      {
+        vkDestroyPipeline( m_device, state->pipeline, nullptr );
+        state->pipeline = VK_NULL_HANDLE;
+      }
+      LOGF_ERROR( "Failed to compile pipeline '{}': {}", name,
+                  state->error );
+    },
+    &state->done );
+  return pipeline_handle( std::move( state ) );
+}
+
+pipeline_handle
+pipeline_compiler::compile( graphics_pipeline_desc desc )
+{
+  if( desc.stages.empty() || desc.layout == VK_NULL_HANDLE ||
+      desc.render_pass == VK_NULL_HANDLE )
+  {
+    throw std::invalid_argument(
+      "Graphics pipeline '" + desc.name +
+      "' needs shader stages, a layout and a render pass" );
+  }
+  for( auto const& stage : desc.stages )
+  {
+    if( stage.module == VK_NULL_HANDLE )
+    {
+      throw std::invalid_argument( "Graphics pipeline '" + desc.name +
+                                   "' has a stage without a shader" );
+    }
+  }
+  std::string const name = desc.name;
+  auto shared = std::make_shared< graphics_pipeline_desc >( std::move( desc ) );
+  return start( name, [ this, shared ]( VkPipeline& pipeline ) {
+    graphics_pipeline_desc const& d = *shared;
+    std::vector< VkSpecializationInfo > specializations;
+    std::vector< VkPipelineShaderStageCreateInfo > stages;
+    // Stage infos point into `specializations`, which must not move.
+    specializations.reserve( d.stages.size() );
+    for( auto const& stage : d.stages )
+    {
+      specializations.push_back( specialization_info( stage ) );
+      stages.push_back( stage_info( stage, specializations.back() ) );
+    }
+
+    VkPipelineVertexInputStateCreateInfo vertex_input = {};
+    vertex_input.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input.vertexBindingDescriptionCount =
+      static_cast< uint32_t >( d.vertex_bindings.size() );
+    vertex_input.pVertexBindingDescriptions = d.vertex_bindings.data();
+    vertex_input.vertexAttributeDescriptionCount =
+      static_cast< uint32_t >( d.vertex_attributes.size() );
+    vertex_input.pVertexAttributeDescriptions = d.vertex_attributes.data();
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+    input_assembly.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = d.topology;
+    VkPipelineViewportStateCreateInfo viewport = {};
+    viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport.viewportCount = 1;
+    viewport.scissorCount = 1;
+    VkPipelineRasterizationStateCreateInfo raster = {};
+    raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    raster.polygonMode = d.polygon_mode;
+    raster.cullMode = d.cull_mode;
+    raster.frontFace = d.front_face;
+    raster.lineWidth = 1.f;
+    VkPipelineMultisampleStateCreateInfo multisample = {};
+    multisample.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample.rasterizationSamples = d.samples;
+    VkPipelineDepthStencilStateCreateInfo depth = {};
+    depth.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth.depthTestEnable = d.depth_test;
+    depth.depthWriteEnable = d.depth_write;
+    depth.depthCompareOp = d.depth_compare;
+    VkPipelineColorBlendStateCreateInfo blend = {};
+    blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blend.attachmentCount =
+      static_cast< uint32_t >( d.blend_attachments.size() );
+    blend.pAttachments = d.blend_attachments.data();
+    std::vector< VkDynamicState > dynamic_states = {
+      VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    dynamic_states.insert( dynamic_states.end(), d.dynamic_states.begin(),
+                           d.dynamic_states.end() );
+    VkPipelineDynamicStateCreateInfo dynamic = {};
+    dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic.dynamicStateCount =
+      static_cast< uint32_t >( dynamic_states.size() );
+    dynamic.pDynamicStates = dynamic_states.data();
+
+    VkGraphicsPipelineCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    info.stageCount = static_cast< uint32_t >( stages.size() );
+    info.pStages = stages.data();
+    info.pVertexInputState = &vertex_input;
+    info.pInputAssemblyState = &input_assembly;
+    info.pViewportState = &viewport;
+    info.pRasterizationState = &raster;
+    info.pMultisampleState = &multisample;
+    info.pDepthStencilState = &depth;
+    info.pColorBlendState = &blend;
+    info.pDynamicState = &dynamic;
+    info.layout = d.layout;
+    info.renderPass = d.render_pass;
+    info.subpass = d.subpass;
+    return m_cache.create_graphics_pipelines( nullptr, d.name.c_str(), 1,
+                                              &info, &pipeline );
+  } );
+}
+
+pipeline_handle
+pipeline_compiler::compile( compute_pipeline_desc desc )
+{
+  if( desc.stage.module == VK_NULL_HANDLE || desc.layout == VK_NULL_HANDLE )
+  {
+    throw std::invalid_argument( "Compute pipeline '" + desc.name +
+                                 "' needs a shader and a layout" );
+  }
+  std::string const name = desc.name;
+  auto shared = std::make_shared< compute_pipeline_desc >( std::move( desc ) );
+  return start( name, [ this, shared ]( VkPipeline& pipeline ) {
+    compute_pipeline_desc const& d = *shared;
+    VkSpecializationInfo const specialization =
+      specialization_info( d.stage );
+    VkComputePipelineCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    info.stage = stage_info( d.stage, specialization );
+    info.layout = d.layout;
+    return m_cache.create_compute_pipelines( nullptr, d.name.c_str(), 1,
+                                             &info, &pipeline );
+  } );
+}
+
+VkPipeline
+pipeline_compiler::wait( pipeline_handle const& handle )
+{
+  if( !handle.valid() )
+  {
+    throw std::invalid_argument( "Waiting on an empty pipeline handle" );
+  }
+  m_jobs.wait( handle.m_state->done );
+  if( !handle.m_state->error.empty() )
+  {
+    throw std::runtime_error( "Failed to compile pipeline: " +
+                              handle.m_state->error );
+  }
+  return handle.m_state->pipeline;
+}
+
+warm_up_result
+pipeline_compiler::warm_up( std::vector< graphics_pipeline_desc > graphics,
+                            std::vector< compute_pipeline_desc > compute )
+{
+  PROFILE_FUNCTION();
+  auto const begin = steady_clock_t::now();
+  int64_t const compile_ns = m_compile_ns.load( std::memory_order_relaxed );
+  uint64_t const hits = m_cache.hit_count();
+  warm_up_result result = { {}, {}, {}, 0 };
+  for( auto& desc : graphics )
+  {
+    result.graphics.push_back( compile( std::move( desc ) ) );
+  }
+  for( auto& desc : compute )
+  {
+    result.compute.push_back( compile( std::move( desc ) ) );
+  }
+  for( auto const* handles : { &result.graphics, &result.compute } )
+  {
+    for( auto const& handle : *handles )
+    {
+      m_jobs.wait( handle.m_state->done );
+      result.failures += handle.m_state->error.empty() ? 0 : 1;
+    }
+  }
+  result.elapsed = steady_clock_t::now() - begin;
+
+  std::size_t const count = result.graphics.size() + result.compute.size();
+  double const summed_ms =
+    ( m_compile_ns.load( std::memory_order_relaxed ) - compile_ns ) / 1e6;
+  LOGF_INFO( "Warmed up {} pipeline(s) in {} ms ({} ms compiling over {} "
+             "thread(s), {} cache hit(s), {} failure(s))",
+             count, result.elapsed.count() / 1e6, summed_ms,
+             m_jobs.worker_count() + 1, m_cache.hit_count() - hits,
+             result.failures );
+  return result;
+}
+
+pipeline_compiler_stats
+pipeline_compiler::stats() const
+{
+  return { m_shader_count.load( std::memory_order_relaxed ),
+           m_shader_duplicates.load( std::memory_order_relaxed ),
+           m_pipelines.load( std::memory_order_relaxed ),
+           m_failures.load( std::memory_order_relaxed ),
+           std::chrono::nanoseconds(
+             m_compile_ns.load( std::memory_order_relaxed ) ) };
+}
+
+} // namespace myengine::vulkan
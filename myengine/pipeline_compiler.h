@@ -0,0 +1,265 @@
+#ifndef MYENGINE_PIPELINE_COMPILER_H
+#define MYENGINE_PIPELINE_COMPILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/job_system.h>
+#include <myengine/myengine_export.h>
+#include <myengine/pipeline_cache.h>
+
+namespace myengine::vulkan {
+
+/// A shader stage of a pipeline, with its specialization constants.
+struct shader_stage
+{
+  VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+  /// From `pipeline_compiler::create_shader` or `load_shader`.
+  VkShaderModule module = VK_NULL_HANDLE;
+  std::string entry = "main";
+  std::vector< VkSpecializationMapEntry > specialization_entries;
+  std::vector< uint8_t > specialization_data;
+};
+
+/**
+ * State of a graphics pipeline, owned so it can be compiled later on another
+ * thread. Viewport and scissor are dynamic, one each.
+ */
+struct graphics_pipeline_desc
+{
+  /// For log messages.
+  std::string name;
+  std::vector< shader_stage > stages;
+  std::vector< VkVertexInputBindingDescription > vertex_bindings;
+  std::vector< VkVertexInputAttributeDescription > vertex_attributes;
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+  VkCullModeFlags cull_mode = VK_CULL_MODE_NONE;
+  VkFrontFace front_face = VK_FRONT_FACE_CLOCKWISE;
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+  bool depth_test = false;
+  bool depth_write = false;
+  VkCompareOp depth_compare = VK_COMPARE_OP_LESS;
+  /// One per color attachment of the subpass.
+  std::vector< VkPipelineColorBlendAttachmentState > blend_attachments;
+  /// Besides viewport and scissor.
+  std::vector< VkDynamicState > dynamic_states;
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  uint32_t subpass = 0;
+};
+
+struct compute_pipeline_desc
+{
+  std::string name;
+  shader_stage stage;
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+};
+
+/// Totals since construction.
+struct pipeline_compiler_stats
+{
+  /// Shader modules created, and requests answered with an existing one.
+  uint64_t shaders;
+  uint64_t shader_duplicates;
+  uint64_t pipelines;
+  uint64_t failures;
+  /// Time spent compiling, summed over the threads.
+  std::chrono::nanoseconds compile_time;
+};
+
+namespace detail {
+
+/// Shared by a compilation and its handles.
+struct pipeline_state
+{
+  /// Reaches zero once the compilation is done.
+  job_counter done;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  /// Why compiling failed, if it did.
+  std::string error;
+};
+
+} // namespace detail
+
+/**
+ * A pipeline being compiled by a `pipeline_compiler`.
+ *
+ * Polling does not block, so the render loop can check a handle every frame
+ * and draw with a fallback pipeline, or skip the draw, until it is ready.
+ * Copies refer to the same pipeline, which the compiler owns.
+ */
+class MYENGINE_EXPORT pipeline_handle
+{
+public:
+  pipeline_handle() = default;
+
+  /// If the handle refers to a compilation at all.
+  [[nodiscard]] bool
+  valid() const
+  {
+    return m_state != nullptr;
+  }
+
+  /// If the compilation is done, successfully or not.
+  [[nodiscard]] bool
+  ready() const
+  {
+    return m_state && m_state->done.done();
+  }
+
+  /// The pipeline, or `VK_NULL_HANDLE` while not ready or if it failed.
+  [[nodiscard]] VkPipeline
+  get() const
+  {
+    return ready() ? m_state->pipeline : VK_NULL_HANDLE;
+  }
+
+  /// The pipeline if ready, `fallback` otherwise.
+  [[nodiscard]] VkPipeline
+  get_or( VkPipeline fallback ) const
+  {
+    VkPipeline const pipeline = get();
+    return pipeline != VK_NULL_HANDLE ? pipeline : fallback;
+  }
+
+  /// If compiling failed; empty while not ready.
+  [[nodiscard]] std::string const&
+  error() const;
+
+private:
+  friend class pipeline_compiler;
+
+  explicit pipeline_handle( std::shared_ptr< detail::pipeline_state > state )
+    : m_state( std::move( state ) )
+  {}
+
+  std::shared_ptr< detail::pipeline_state > m_state;
+};
+
+/// Pipelines compiled by `pipeline_compiler::warm_up`.
+struct warm_up_result
+{
+  std::vector< pipeline_handle > graphics;
+  std::vector< pipeline_handle > compute;
+  /// From the call until the last pipeline was done.
+  std::chrono::nanoseconds elapsed;
+  uint32_t failures;
+};
+
+/**
+ * Shader module and pipeline creation, off the render loop.
+ *
+ * Shader modules are deduplicated by the hash of their SPIR-V, compared in
+ * full on a match, so loading the same code twice gives the same module.
+ *
+ * Pipelines are compiled by jobs on a `job_system`, through the main cache of
+ * a `pipeline_cache`, which drivers synchronize internally; creation times
+ * and cache hits are reported by the cache. `compile` returns right away with
+ * a `pipeline_handle` to poll. `warm_up` compiles a list of pipelines known
+ * at startup in parallel and waits for them, reporting the total time.
+ *
+ * The compiler owns the shader modules and the pipelines, and destroys them
+ * once outstanding compilations are done. Thread-safe, except for `wait`
+ * and `warm_up`, which are for the threads of the job system, as its `wait`.
+ * Must be destroyed before the job system, the pipeline cache and the
+ * `VkDevice`, once the device is done with the pipelines; pipeline layouts
+ * and render passes in descriptions must outlive their compilation.
+ */
+class MYENGINE_EXPORT pipeline_compiler
+{
+public:
+  pipeline_compiler( VkDevice device, pipeline_cache& cache, job_system& jobs );
+
+  pipeline_compiler( pipeline_compiler const& ) = delete;
+  pipeline_compiler& operator=( pipeline_compiler const& ) = delete;
+
+  /// Waits for outstanding compilations.
+  ~pipeline_compiler();
+
+  /**
+   * Shader module for SPIR-V code, the existing one if the same code was
+   * given before.
+   *
+   * @param size In bytes, a multiple of 4.
+   *
+   * @throws std::invalid_argument Not SPIR-V.
+   * @throws std::runtime_error Failed to create the shader module.
+   */
+  [[nodiscard]] VkShaderModule create_shader( uint32_t const* code,
+                                              std::size_t size );
+
+  /**
+   * `create_shader` for the SPIR-V in a file.
+   *
+   * @throws std::runtime_error Failed to read the file, or not SPIR-V.
+   */
+  [[nodiscard]] VkShaderModule load_shader( std::string const& path );
+
+  /// Compile a pipeline in the background. Failures are logged, and reported
+  /// by the handle.
+  [[nodiscard]] pipeline_handle compile( graphics_pipeline_desc desc );
+  [[nodiscard]] pipeline_handle compile( compute_pipeline_desc desc );
+
+  /**
+   * Wait for a compilation, running other jobs meanwhile.
+   *
+   * @return The pipeline.
+   *
+   * @throws std::runtime_error Compiling failed.
+   */
+  VkPipeline wait( pipeline_handle const& handle );
+
+  /**
+   * Compile all the pipelines in parallel and wait for them, then log the
+   * total time. Failures are logged and counted, not thrown, so a broken
+   * pipeline does not keep the others from warming up.
+   */
+  warm_up_result
+  warm_up( std::vector< graphics_pipeline_desc > graphics,
+           std::vector< compute_pipeline_desc > compute = {} );
+
+  [[nodiscard]] pipeline_compiler_stats stats() const;
+
+private:
+  /// Modules with the same SPIR-V hash.
+  struct shader_entry
+  {
+    std::vector< uint32_t > code;
+    VkShaderModule module;
+  };
+
+  VkDevice m_device;
+  pipeline_cache& m_cache;
+  job_system& m_jobs;
+
+  // Guards the shaders and the states.
+  mutable std::mutex m_mutex;
+  std::unordered_map< uint64_t, std::vector< shader_entry > > m_shaders;
+  /// Every compilation, for waiting on and destroying them.
+  std::vector< std::shared_ptr< detail::pipeline_state > > m_states;
+
+  std::atomic< uint64_t > m_shader_count;
+  std::atomic< uint64_t > m_shader_duplicates;
+  std::atomic< uint64_t > m_pipelines;
+  std::atomic< uint64_t > m_failures;
+  std::atomic< int64_t > m_compile_ns;
+
+  /// Register a compilation running `create`, which returns the result of
+  /// the creation command.
+  template < typename Create >
+  pipeline_handle start( std::string const& name, Create create );
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_PIPELINE_COMPILER_H
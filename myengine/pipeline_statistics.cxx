@@ -0,0 +1,278 @@
+#define MYENGINE_LOG_MODULE "vulkan.pipeline_statistics"
+#include "pipeline_statistics.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+/// Queried statistics. Results are written in order of the bits, which is
+/// the order of the fields of `pipeline_counters`.
+VkQueryPipelineStatisticFlags const STATISTICS =
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+constexpr uint32_t STATISTICS_COUNT =
+  sizeof( pipeline_counters ) / sizeof( uint64_t );
+
+/// CSV columns after the frame and the pass, in the order of the fields.
+char const* const COLUMNS[ STATISTICS_COUNT ] = {
+  "ia_vertices", "ia_primitives", "vs_invocations", "clipping_invocations",
+  "clipping_primitives", "fs_invocations", "cs_invocations" };
+
+uint64_t*
+values( pipeline_counters& c )
+{
+  return &c.input_assembly_vertices;
+}
+
+uint64_t const*
+values( pipeline_counters const& c )
+{
+  return &c.input_assembly_vertices;
+}
+
+} // namespace
+
+bool
+pipeline_statistics_supported( VkPhysicalDevice device )
+{
+  return get_device_capabilities( device ).features.pipelineStatisticsQuery;
+}
+
+pipeline_statistics::pipeline_statistics(
+  VkDevice device, pipeline_statistics_config const& config )
+  : m_device( device ),
+    m_config( config ),
+    m_slots(),
+    m_current( UINT32_MAX ),
+    m_open( false ),
+    m_frames( 0 ),
+    m_last_frame(),
+    m_results( config.max_passes * STATISTICS_COUNT ),
+    m_totals(),
+    m_summary_frames( 0 ),
+    m_lost_frames( 0 ),
+    m_csv()
+{
+  if( m_config.frames_in_flight == 0 || m_config.max_passes == 0 )
+  {
+    throw std::invalid_argument(
+      "Frames in flight and passes per frame must not be 0" );
+  }
+  if( !m_config.csv_path.empty() )
+  {
+    m_csv.open( m_config.csv_path, std::ios::out | std::ios::trunc );
+    if( !m_csv )
+    {
+      throw std::runtime_error( "Failed to open '" + m_config.csv_path +
+                                "' for writing" );
+    }
+    m_csv << "frame,pass";
+    for( char const* column : COLUMNS )
+    {
+      m_csv << ',' << column;
+    }
+    m_csv << '\n';
+  }
+  try
+  {
+    VkQueryPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    pool_info.queryCount = m_config.max_passes;
+    pool_info.pipelineStatistics = STATISTICS;
+    m_slots.resize( m_config.frames_in_flight, frame_slot() );
+    for( auto& slot : m_slots )
+    {
+      check_result( vkCreateQueryPool( m_device, &pool_info, nullptr,
+                                       &slot.pool ),
+                    "create pipeline statistics query pool" );
+    }
+  }
+  catch( ... )
+  {
+    destroy();
+    throw;
+  }
+}
+
+pipeline_statistics::~pipeline_statistics()
+{
+  destroy();
+}
+
+void
+pipeline_statistics::destroy()
+{
+  for( auto const& slot : m_slots )
+  {
+    if( slot.pool != VK_NULL_HANDLE )
+    {
+      vkDestroyQueryPool( m_device, slot.pool, nullptr );
+    }
+  }
+  m_slots.clear();
+}
+
+void
+pipeline_statistics::begin_frame( VkCommandBuffer cmd, uint32_t slot )
+{
+  if( slot >= m_config.frames_in_flight )
+  {
+    throw std::invalid_argument( "Frame slot out of range" );
+  }
+  read_back( slot );
+  frame_slot& s = m_slots[ slot ];
+  s.frame = m_frames++;
+  s.passes.clear();
+  vkCmdResetQueryPool( cmd, s.pool, 0, m_config.max_passes );
+  m_current = slot;
+  m_open = false;
+}
+
+void
+pipeline_statistics::end_frame( VkCommandBuffer cmd )
+{
+  end_pass( cmd );
+  m_current = UINT32_MAX;
+}
+
+void
+pipeline_statistics::begin_pass( VkCommandBuffer cmd,
+                                 profiling::zone_site_t const& site )
+{
+  if( m_open )
+  {
+    throw std::logic_error( "Pipeline statistics passes do not nest" );
+  }
+  if( m_current == UINT32_MAX )
+  {
+    return;
+  }
+  frame_slot& slot = m_slots[ m_current ];
+  if( slot.passes.size() >= m_config.max_passes )
+  {
+    return;
+  }
+  vkCmdBeginQuery( cmd, slot.pool,
+                   static_cast< uint32_t >( slot.passes.size() ), 0 );
+  slot.passes.push_back( &site );
+  m_open = true;
+}
+
+void
+pipeline_statistics::end_pass( VkCommandBuffer cmd )
+{
+  if( !m_open )
+  {
+    return;
+  }
+  frame_slot const& slot = m_slots[ m_current ];
+  vkCmdEndQuery( cmd, slot.pool,
+                 static_cast< uint32_t >( slot.passes.size() - 1 ) );
+  m_open = false;
+}
+
+void
+pipeline_statistics::read_back( uint32_t slot )
+{
+  frame_slot const& s = m_slots[ slot ];
+  if( s.passes.empty() )
+  {
+    return;
+  }
+  uint32_t const count = static_cast< uint32_t >( s.passes.size() );
+  VkDeviceSize const stride = sizeof( pipeline_counters );
+  VkResult const res = vkGetQueryPoolResults(
+    m_device, s.pool, 0, count, count * stride, m_results.data(), stride,
+    VK_QUERY_RESULT_64_BIT );
+  if( res == VK_NOT_READY )
+  {
+    ++m_lost_frames;
+    return;
+  }
+  check_result( res, "get pipeline statistics" );
+
+  m_last_frame.clear();
+  for( uint32_t i = 0; i < count; ++i )
+  {
+    pass_statistics p = { s.passes[ i ], s.frame, {} };
+    std::copy_n( &m_results[ i * STATISTICS_COUNT ], STATISTICS_COUNT,
+                 values( p.counters ) );
+    m_last_frame.push_back( p );
+
+    auto total = std::find_if(
+      m_totals.begin(), m_totals.end(),
+      [ & ]( pass_total const& t ) { return t.site == p.site; } );
+    if( total == m_totals.end() )
+    {
+      m_totals.push_back( { p.site, {} } );
+      total = m_totals.end() - 1;
+    }
+    for( uint32_t v = 0; v < STATISTICS_COUNT; ++v )
+    {
+      values( total->sum )[ v ] += values( p.counters )[ v ];
+    }
+  }
+  ++m_summary_frames;
+  if( m_csv.is_open() )
+  {
+    write_csv();
+  }
+}
+
+void
+pipeline_statistics::write_csv()
+{
+  for( auto const& p : m_last_frame )
+  {
+    m_csv << p.frame << ',' << p.site->name;
+    for( uint32_t v = 0; v < STATISTICS_COUNT; ++v )
+    {
+      m_csv << ',' << values( p.counters )[ v ];
+    }
+    m_csv << '\n';
+  }
+  if( !m_csv )
+  {
+    throw std::runtime_error( "Failed to write '" + m_config.csv_path + "'" );
+  }
+}
+
+void
+pipeline_statistics::log_summary()
+{
+  if( m_summary_frames == 0 )
+  {
+    return;
+  }
+  for( auto const& t : m_totals )
+  {
+    std::stringstream ss;
+    for( uint32_t v = 0; v < STATISTICS_COUNT; ++v )
+    {
+      ss  << ( v ? ", " : "" ) << COLUMNS[ v ] << ' '
+          << values( t.sum )[ v ] / m_summary_frames;
+    }
+    LOGF_INFO( "Pass '{}' per frame: {}", t.site->name, ss.str() );
+  }
+  LOGF_INFO( "Pipeline statistics of {} frame(s), {} not ready in time",
+             m_summary_frames, m_lost_frames );
+  m_totals.clear();
+  m_summary_frames = 0;
+  m_lost_frames = 0;
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,166 @@
+#ifndef MYENGINE_PIPELINE_STATISTICS_H
+#define MYENGINE_PIPELINE_STATISTICS_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+#include <myengine/profiling.h>
+
+namespace myengine::vulkan {
+
+/**
+ * If the device supports `pipelineStatisticsQuery`, which
+ * `pipeline_statistics` needs enabled on the `VkDevice`.
+ */
+[[nodiscard]] bool MYENGINE_EXPORT
+pipeline_statistics_supported( VkPhysicalDevice device );
+
+/// Counters of a pass, summed over its draws and dispatches.
+struct pipeline_counters
+{
+  uint64_t input_assembly_vertices;
+  uint64_t input_assembly_primitives;
+  uint64_t vertex_invocations;
+  /// Primitives processed by the clipping stage, and those it output.
+  uint64_t clipping_invocations;
+  uint64_t clipping_primitives;
+  uint64_t fragment_invocations;
+  uint64_t compute_invocations;
+};
+
+/// Counters of one pass of one frame.
+struct pass_statistics
+{
+  profiling::zone_site_t const* site;
+  /// Frame number, counting the frames begun.
+  uint64_t frame;
+  pipeline_counters counters;
+};
+
+struct pipeline_statistics_config
+{
+  /// Frames the CPU may get ahead of the GPU, see `gpu_profiler_config`.
+  uint32_t frames_in_flight = 2;
+  /// Passes per frame; further ones are not counted.
+  uint32_t max_passes = 64;
+  /// File every read back frame is appended to as CSV, one row per pass;
+  /// none when empty.
+  std::string csv_path;
+};
+
+/**
+ * Counts the work of passes with pipeline statistics queries: vertices and
+ * primitives assembled, vertex, fragment and compute shader invocations, and
+ * primitives clipped. Compared between runs, they show changes in overdraw
+ * and vertex work that timings alone do not explain.
+ *
+ *     statistics.begin_frame( cmd, slot );
+ *     statistics.begin_pass( cmd, site );
+ *     ...
+ *     statistics.end_pass( cmd );
+ *     statistics.end_frame( cmd );
+ *
+ * Like `gpu_profiler`, each frame slot has a query pool, reset at
+ * `begin_frame` and read back without waiting when the slot comes around;
+ * frames not available by then are skipped. Queries of the same type cannot
+ * be active together, so passes do not nest.
+ *
+ * Needs `pipelineStatisticsQuery` enabled and a queue family supporting
+ * graphics or compute. Not thread-safe; for the thread recording the frames.
+ * Must be destroyed before the `VkDevice`, once the device is done with the
+ * frames.
+ */
+class MYENGINE_EXPORT pipeline_statistics
+{
+public:
+  /**
+   * @throws std::runtime_error Failed to create the query pools, or to open
+   * `config.csv_path`.
+   */
+  pipeline_statistics(
+    VkDevice device,
+    pipeline_statistics_config const& config = pipeline_statistics_config() );
+
+  pipeline_statistics( pipeline_statistics const& ) = delete;
+  pipeline_statistics& operator=( pipeline_statistics const& ) = delete;
+
+  ~pipeline_statistics();
+
+  /**
+   * Read back the counters of the slot's previous frame, then reset its
+   * queries in `cmd`. The slot's previous frame must have completed.
+   *
+   * @throws std::invalid_argument `slot` is not below `frames_in_flight`.
+   * @throws std::runtime_error Failed to write the CSV file.
+   */
+  void begin_frame( VkCommandBuffer cmd, uint32_t slot );
+
+  /// End the pass left open, if any.
+  void end_frame( VkCommandBuffer cmd );
+
+  /**
+   * Begin counting a pass, outside of render pass instances or within a
+   * single subpass the pass ends in. Not counted when the frame has no
+   * queries left.
+   *
+   * @throws std::logic_error A pass is already open.
+   */
+  void begin_pass( VkCommandBuffer cmd, profiling::zone_site_t const& site );
+
+  void end_pass( VkCommandBuffer cmd );
+
+  /// Passes of the most recently read back frame, in order.
+  [[nodiscard]] std::vector< pass_statistics > const&
+  last_frame() const
+  {
+    return m_last_frame;
+  }
+
+  /// Log the average counters of every pass since the last summary, per
+  /// frame, and reset them.
+  void log_summary();
+
+private:
+  struct frame_slot
+  {
+    VkQueryPool pool;
+    uint64_t frame;
+    /// Passes counted by the queries, in order.
+    std::vector< profiling::zone_site_t const* > passes;
+  };
+
+  /// Sums for `log_summary`.
+  struct pass_total
+  {
+    profiling::zone_site_t const* site;
+    pipeline_counters sum;
+  };
+
+  VkDevice m_device;
+  pipeline_statistics_config m_config;
+  std::vector< frame_slot > m_slots;
+  /// Slot being recorded, or `UINT32_MAX` outside a frame.
+  uint32_t m_current;
+  bool m_open;
+  uint64_t m_frames;
+  std::vector< pass_statistics > m_last_frame;
+  std::vector< uint64_t > m_results;
+  std::vector< pass_total > m_totals;
+  uint64_t m_summary_frames;
+  uint64_t m_lost_frames;
+  std::ofstream m_csv;
+
+  /// Read back the passes of `slot`'s last frame, if any.
+  void read_back( uint32_t slot );
+  void write_csv();
+  void destroy();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_PIPELINE_STATISTICS_H
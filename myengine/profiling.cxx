@@ -0,0 +1,488 @@
+#include "profiling.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace myengine::profiling {
+
+namespace detail {
+
+std::atomic< bool > g_capturing( false );
+
+} // namespace detail
+
+namespace {
+
+/// One completed zone, or a counter value.
+struct event_t
+{
+  zone_site_t const* site;
+  int64_t begin_ns;
+  /// -1 for a counter.
+  int64_t end_ns;
+  double value;
+};
+
+/// Events per chunk of a thread buffer.
+constexpr std::size_t CHUNK_EVENTS = 4096;
+constexpr std::size_t MAX_CHUNKS = MAX_EVENTS_PER_THREAD / CHUNK_EVENTS;
+
+struct chunk_t
+{
+  event_t events[ CHUNK_EVENTS ];
+};
+
+/**
+ * Zones recorded by one thread.
+ *
+ * Only the owning thread writes events. Chunks are allocated on demand and
+ * never move, so an exporting thread can read the first `count` events while
+ * the owner keeps appending. A new capture is detected by the owner through
+ * `generation`, which it updates only after resetting `count`; readers skip
+ * buffers whose generation is not the current one.
+ *
+ * A thread's buffer goes to `registry::free_buffers` when the thread exits.
+ * A new thread takes one from there only once it holds no events of the
+ * current capture, so nothing is lost before it can be exported.
+ */
+struct thread_buffer
+{
+  uint32_t tid = 0;
+  /// Not a CPU thread but a track from `create_track`.
+  bool track = false;
+  /// Guarded by the registry mutex.
+  std::string name;
+  std::atomic< uint32_t > generation{ 0 };
+  std::atomic< std::size_t > count{ 0 };
+  std::atomic< chunk_t* > chunks[ MAX_CHUNKS ] = {};
+
+  ~thread_buffer()
+  {
+    for( auto& c : chunks )
+    {
+      delete c.load( std::memory_order_relaxed );
+    }
+  }
+};
+
+/**
+ * Process-wide profiler state.
+ *
+ * Leaked, like the logging backend, so that threads exiting during static
+ * destruction can still touch their buffers.
+ */
+struct registry
+{
+  std::mutex mutex;
+  std::vector< std::unique_ptr< thread_buffer > > threads;
+  /// Buffers of exited threads, for reuse.
+  std::vector< thread_buffer* > free_buffers;
+  /// Current capture, starting from 1 so fresh buffers (0) are stale.
+  std::atomic< uint32_t > generation{ 1 };
+  std::atomic< uint64_t > dropped{ 0 };
+  std::string exit_path;
+  std::once_flag exit_hook;
+  /// Sites of `intern_site`, by name. Map nodes never move, so neither do
+  /// the sites nor the names they point to.
+  std::map< std::string, zone_site_t > sites;
+};
+
+registry&
+instance()
+{
+  static registry* const r = new registry();
+  return *r;
+}
+
+/// Add a buffer; the registry mutex must be held.
+thread_buffer&
+add_buffer( registry& r )
+{
+  r.threads.push_back( std::make_unique< thread_buffer >() );
+  r.threads.back()->tid = static_cast< uint32_t >( r.threads.size() );
+  return *r.threads.back();
+}
+
+/// The calling thread's buffer; null once the thread is exiting.
+thread_local thread_buffer* t_buffer = nullptr;
+thread_local bool t_exited = false;
+
+/// Takes a buffer for the calling thread and gives it back when it exits.
+class buffer_owner
+{
+public:
+  buffer_owner()
+  {
+    registry& r = instance();
+    std::lock_guard< std::mutex > lock( r.mutex );
+    uint32_t const gen = r.generation.load( std::memory_order_acquire );
+    auto it = std::find_if( r.free_buffers.begin(), r.free_buffers.end(),
+                            [ gen ]( thread_buffer const* b ) {
+                              return b->generation.load(
+                                       std::memory_order_relaxed ) != gen;
+                            } );
+    if( it != r.free_buffers.end() )
+    {
+      t_buffer = *it;
+      r.free_buffers.erase( it );
+      // The name was the previous thread's.
+      t_buffer->name.clear();
+    }
+    else
+    {
+      t_buffer = &add_buffer( r );
+    }
+  }
+
+  buffer_owner( buffer_owner const& ) = delete;
+  buffer_owner& operator=( buffer_owner const& ) = delete;
+
+  ~buffer_owner()
+  {
+    registry& r = instance();
+    std::lock_guard< std::mutex > lock( r.mutex );
+    r.free_buffers.push_back( t_buffer );
+    t_buffer = nullptr;
+    t_exited = true;
+  }
+};
+
+/// The calling thread's buffer, or null if the thread is exiting, in which
+/// case events are not recorded.
+thread_buffer*
+local_buffer()
+{
+  if( t_buffer == nullptr && !t_exited )
+  {
+    thread_local buffer_owner owner;
+  }
+  return t_buffer;
+}
+
+/// Per-thread cache of track buffers, direct-mapped by track, so that
+/// recording on a track takes the registry lock only on a miss. Tracks are
+/// never removed, so entries never go stale.
+struct track_cache_entry
+{
+  uint32_t track;
+  thread_buffer* buf;
+};
+
+constexpr std::size_t TRACK_CACHE_SIZE = 8;
+
+thread_local track_cache_entry t_track_cache[ TRACK_CACHE_SIZE ] = {};
+
+thread_buffer&
+track_buffer( uint32_t track )
+{
+  track_cache_entry& entry = t_track_cache[ track % TRACK_CACHE_SIZE ];
+  if( entry.track != track )
+  {
+    // Buffers never move, but the vector holding them may grow.
+    registry& r = instance();
+    std::lock_guard< std::mutex > lock( r.mutex );
+    entry.buf = r.threads.at( track - 1 ).get();
+    entry.track = track;
+  }
+  return *entry.buf;
+}
+
+/// Write a string as a JSON string literal.
+void
+write_json_string( std::ostream& out, char const* s )
+{
+  out << '"';
+  for( ; s && *s; ++s )
+  {
+    char const c = *s;
+    if( c == '"' || c == '\\' )
+    {
+      out << '\\' << c;
+    }
+    else if( static_cast< unsigned char >( c ) < 0x20 )
+    {
+      char buf[ 8 ];
+      snprintf( buf, sizeof( buf ), "\\u%04x", c );
+      out << buf;
+    }
+    else
+    {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+/// Write nanoseconds as fractional microseconds, the trace-event time unit.
+void
+write_us( std::ostream& out, int64_t ns )
+{
+  if( ns < 0 )
+  {
+    ns = 0;
+  }
+  out << ns / 1000 << '.' << std::setw( 3 ) << std::setfill( '0' )
+      << ns % 1000;
+}
+
+void
+export_at_exit_hook()
+{
+  registry& r = instance();
+  stop_capture();
+  std::string path;
+  {
+    std::lock_guard< std::mutex > lock( r.mutex );
+    path = r.exit_path;
+  }
+  try
+  {
+    write_chrome_trace( path );
+  }
+  catch( std::exception const& ex )
+  {
+    // Logging may already be shut down at this point.
+    fprintf( stderr, "Failed to write profiling trace: %s\n", ex.what() );
+  }
+}
+
+/// Start a capture when `MYENGINE_TRACE` is set in the environment.
+struct env_capture
+{
+  env_capture()
+  {
+    if( char const* path = std::getenv( "MYENGINE_TRACE" ) )
+    {
+      export_at_exit( path );
+      start_capture();
+    }
+  }
+} const g_env_capture;
+
+} // namespace
+
+void
+start_capture()
+{
+  // Initialize the epoch before the first timestamp is taken against it.
+  (void) logging::epoch();
+  registry& r = instance();
+  {
+    // Serialized with export so a buffer cannot be reset mid-write.
+    std::lock_guard< std::mutex > lock( r.mutex );
+    r.generation.fetch_add( 1, std::memory_order_acq_rel );
+    r.dropped.store( 0, std::memory_order_relaxed );
+  }
+  detail::g_capturing.store( true, std::memory_order_release );
+}
+
+void
+stop_capture()
+{
+  detail::g_capturing.store( false, std::memory_order_release );
+}
+
+namespace {
+
+void
+append( thread_buffer& buf, event_t const& e )
+{
+  registry& r = instance();
+  uint32_t const gen = r.generation.load( std::memory_order_acquire );
+  if( buf.generation.load( std::memory_order_relaxed ) != gen )
+  {
+    buf.count.store( 0, std::memory_order_relaxed );
+    buf.generation.store( gen, std::memory_order_release );
+  }
+
+  std::size_t const n = buf.count.load( std::memory_order_relaxed );
+  if( n >= MAX_EVENTS_PER_THREAD )
+  {
+    r.dropped.fetch_add( 1, std::memory_order_relaxed );
+    return;
+  }
+  auto& slot = buf.chunks[ n / CHUNK_EVENTS ];
+  chunk_t* chunk = slot.load( std::memory_order_relaxed );
+  if( chunk == nullptr )
+  {
+    chunk = new chunk_t;
+    slot.store( chunk, std::memory_order_release );
+  }
+  chunk->events[ n % CHUNK_EVENTS ] = e;
+  buf.count.store( n + 1, std::memory_order_release );
+}
+
+} // namespace
+
+void
+detail::record( zone_site_t const& site, int64_t begin_ns, int64_t end_ns )
+{
+  if( thread_buffer* buf = local_buffer() )
+  {
+    append( *buf,
+            { &site, begin_ns, std::max< int64_t >( end_ns, begin_ns ), 0. } );
+  }
+}
+
+void
+detail::record_on( uint32_t track, zone_site_t const& site, int64_t begin_ns,
+                   int64_t end_ns )
+{
+  append( track_buffer( track ),
+          { &site, begin_ns, std::max< int64_t >( end_ns, begin_ns ), 0. } );
+}
+
+void
+detail::record_counter( zone_site_t const& site, int64_t ns, double value )
+{
+  if( thread_buffer* buf = local_buffer() )
+  {
+    append( *buf, { &site, ns, -1, value } );
+  }
+}
+
+std::size_t
+write_chrome_trace( std::ostream& out )
+{
+  registry& r = instance();
+  std::lock_guard< std::mutex > lock( r.mutex );
+  uint32_t const gen = r.generation.load( std::memory_order_acquire );
+
+  std::size_t written = 0;
+  char const* sep = "\n";
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  for( auto const& buf : r.threads )
+  {
+    if( !buf->name.empty() )
+    {
+      out << sep << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+          << buf->tid << ",\"args\":{\"name\":";
+      write_json_string( out, buf->name.c_str() );
+      out << "}}";
+      sep = ",\n";
+    }
+    if( buf->generation.load( std::memory_order_acquire ) != gen )
+    {
+      continue;
+    }
+    std::size_t const n = buf->count.load( std::memory_order_acquire );
+    for( std::size_t i = 0; i < n; ++i )
+    {
+      chunk_t const* chunk =
+        buf->chunks[ i / CHUNK_EVENTS ].load( std::memory_order_acquire );
+      event_t const& e = chunk->events[ i % CHUNK_EVENTS ];
+      out << sep << "{\"name\":";
+      write_json_string( out, e.site->name );
+      sep = ",\n";
+      ++written;
+      if( e.end_ns < 0 )
+      {
+        out << ",\"cat\":\"counter\",\"ph\":\"C\",\"pid\":1,\"tid\":"
+            << buf->tid << ",\"ts\":";
+        write_us( out, e.begin_ns );
+        out << ",\"args\":{\"value\":" << std::setprecision( 15 ) << e.value
+            << "}}";
+        continue;
+      }
+      out << ",\"cat\":\"" << ( buf->track ? "gpu" : "cpu" )
+          << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buf->tid << ",\"ts\":";
+      write_us( out, e.begin_ns );
+      out << ",\"dur\":";
+      write_us( out, e.end_ns - e.begin_ns );
+      out << ",\"args\":{\"file\":";
+      write_json_string( out, e.site->file );
+      out << ",\"line\":" << e.site->line << ",\"func\":";
+      write_json_string( out, e.site->func );
+      out << "}}";
+    }
+  }
+  out << "\n]}\n";
+  return written;
+}
+
+std::size_t
+write_chrome_trace( std::string const& path )
+{
+  std::ofstream out( path, std::ios::out | std::ios::trunc );
+  if( !out )
+  {
+    std::stringstream ss;
+    ss  << "Failed to open trace file '" << path << "' for writing";
+    throw std::runtime_error( ss.str() );
+  }
+  std::size_t written = write_chrome_trace( out );
+  out.flush();
+  if( !out )
+  {
+    std::stringstream ss;
+    ss  << "Failed to write trace file '" << path << "'";
+    throw std::runtime_error( ss.str() );
+  }
+  return written;
+}
+
+void
+export_at_exit( std::string path )
+{
+  registry& r = instance();
+  {
+    std::lock_guard< std::mutex > lock( r.mutex );
+    r.exit_path = std::move( path );
+  }
+  std::call_once( r.exit_hook, [] { std::atexit( export_at_exit_hook ); } );
+}
+
+void
+set_thread_name( std::string name )
+{
+  thread_buffer* buf = local_buffer();
+  if( buf == nullptr )
+  {
+    return;
+  }
+  registry& r = instance();
+  std::lock_guard< std::mutex > lock( r.mutex );
+  buf->name = std::move( name );
+}
+
+uint32_t
+create_track( std::string name )
+{
+  registry& r = instance();
+  std::lock_guard< std::mutex > lock( r.mutex );
+  thread_buffer& buf = add_buffer( r );
+  buf.track = true;
+  buf.name = std::move( name );
+  return buf.tid;
+}
+
+zone_site_t const&
+intern_site( std::string const& name )
+{
+  registry& r = instance();
+  std::lock_guard< std::mutex > lock( r.mutex );
+  auto it = r.sites.find( name );
+  if( it == r.sites.end() )
+  {
+    it = r.sites.emplace( name, zone_site_t() ).first;
+    it->second = { it->first.c_str(), "", 0, "" };
+  }
+  return it->second;
+}
+
+uint64_t
+dropped_count()
+{
+  return instance().dropped.load( std::memory_order_relaxed );
+}
+
+} // namespace myengine::profiling
@@ -0,0 +1,246 @@
+/**
+ * Scoped CPU profiling zones.
+ *
+ * A zone measures the time between its construction and destruction on the
+ * current thread:
+ *
+ *     void load_things()
+ *     {
+ *       PROFILE_FUNCTION();
+ *       {
+ *         PROFILE_ZONE( "parse" );
+ *         ...
+ *       }
+ *     }
+ *
+ * Zones are only recorded while a capture is running (`start_capture`, or the
+ * `MYENGINE_TRACE=<path>` environment variable which captures from startup and
+ * writes the trace at exit). When no capture is running a zone costs one
+ * relaxed atomic load on construction and a branch on destruction.
+ *
+ * Completed zones go into a buffer owned by the recording thread, so recording
+ * takes no locks. When a thread exits, its buffer is kept for export, and
+ * reused by a later thread once a new capture has started. Timestamps are
+ * nanoseconds from the same clock and epoch as the logging timestamps
+ * (`logging::epoch()`), so a trace and a log of the same run line up.
+ *
+ * Counters (`PROFILE_COUNTER`) record a named value over time, e.g. bytes
+ * uploaded per frame, and show up as a graph alongside the zones.
+ *
+ * Zones not measured on a CPU thread, such as GPU work timed with queries (see
+ * `vulkan::gpu_profiler`), go to tracks of their own (`create_track`), once
+ * converted to the same clock. They show up as threads of their own.
+ *
+ * Captures are written in the Chrome trace-event JSON format, viewable in
+ * `chrome://tracing` or https://ui.perfetto.dev.
+ *
+ * Building with `MYENGINE_PROFILING=0` (the `MYENGINE_PROFILING` CMake option)
+ * compiles the macros out entirely.
+ */
+
+#ifndef MYENGINE_PROFILING_H
+#define MYENGINE_PROFILING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include <myengine/logging.h>
+#include <myengine/myengine_export.h>
+
+#ifndef MYENGINE_PROFILING
+# define MYENGINE_PROFILING 1
+#endif
+
+namespace myengine::profiling {
+
+/**
+ * Static description of one zone.
+ *
+ * The macros create one of these per zone with static storage duration.
+ */
+struct zone_site_t
+{
+  char const* name;
+  char const* file;
+  int line;
+  char const* func;
+};
+
+/// Maximum number of zones recorded per thread in one capture. Zones beyond
+/// this are counted and dropped.
+constexpr std::size_t MAX_EVENTS_PER_THREAD = 1u << 20;
+
+/**
+ * Begin recording zones. Zones recorded by a previous capture are discarded.
+ */
+void
+MYENGINE_EXPORT
+start_capture();
+
+/// Stop recording zones. Recorded zones are kept until the next capture.
+void
+MYENGINE_EXPORT
+stop_capture();
+
+/**
+ * Write the zones recorded so far as Chrome trace-event JSON.
+ *
+ * May be called while capturing; zones that complete concurrently may or may
+ * not be included.
+ *
+ * @return Number of zones written.
+ */
+std::size_t
+MYENGINE_EXPORT
+write_chrome_trace( std::ostream& out );
+
+/**
+ * Write the zones recorded so far as Chrome trace-event JSON to a file.
+ *
+ * @throws std::runtime_error Failed to open or write the file.
+ *
+ * @return Number of zones written.
+ */
+std::size_t
+MYENGINE_EXPORT
+write_chrome_trace( std::string const& path );
+
+/**
+ * Write the capture to `path` at process exit, stopping it first. Only the
+ * last path given is used.
+ */
+void
+MYENGINE_EXPORT
+export_at_exit( std::string path );
+
+/// Name the calling thread in exported traces.
+void
+MYENGINE_EXPORT
+set_thread_name( std::string name );
+
+/**
+ * Create a track for zones measured other than on a CPU thread, shown as a
+ * thread named `name`. Tracks live until the process exits.
+ *
+ * @return Identifier for `detail::record_on`.
+ */
+[[nodiscard]] uint32_t
+MYENGINE_EXPORT
+create_track( std::string name );
+
+/**
+ * A zone site for a name only known at run time, e.g. of a render pass. Sites
+ * are interned by name and live until the process exits.
+ */
+[[nodiscard]] zone_site_t const&
+MYENGINE_EXPORT
+intern_site( std::string const& name );
+
+/// Number of zones dropped because a thread's buffer was full.
+uint64_t
+MYENGINE_EXPORT
+dropped_count();
+
+namespace detail {
+
+/// If a capture is running. Checked inline by every zone.
+extern MYENGINE_EXPORT std::atomic< bool > g_capturing;
+
+/// Nanoseconds since `logging::epoch()`.
+[[nodiscard]] inline int64_t
+now_ns()
+{
+  return std::chrono::duration_cast< std::chrono::nanoseconds >(
+    logging::steady_clock_t::now() - logging::epoch() ).count();
+}
+
+/// Record one completed zone for the calling thread.
+void
+MYENGINE_EXPORT
+record( zone_site_t const& site, int64_t begin_ns, int64_t end_ns );
+
+/**
+ * Record one completed zone on a track from `create_track`. Only one thread
+ * at a time may record on a track.
+ */
+void
+MYENGINE_EXPORT
+record_on( uint32_t track, zone_site_t const& site, int64_t begin_ns,
+           int64_t end_ns );
+
+/// Record a counter value for the calling thread.
+void
+MYENGINE_EXPORT
+record_counter( zone_site_t const& site, int64_t ns, double value );
+
+} // namespace detail
+
+/**
+ * RAII zone; use through `PROFILE_ZONE` / `PROFILE_FUNCTION`.
+ */
+class zone
+{
+public:
+  explicit zone( zone_site_t const& site )
+    : m_site( detail::g_capturing.load( std::memory_order_relaxed )
+              ? &site : nullptr ),
+      m_begin( m_site ? detail::now_ns() : 0 )
+  {}
+
+  zone( zone const& ) = delete;
+  zone& operator=( zone const& ) = delete;
+
+  ~zone()
+  {
+    if( m_site )
+    {
+      detail::record( *m_site, m_begin, detail::now_ns() );
+    }
+  }
+
+private:
+  zone_site_t const* m_site;
+  int64_t m_begin;
+};
+
+} // namespace myengine::profiling
+
+#define _PROFILE_CONCAT2( a, b ) a ## b
+#define _PROFILE_CONCAT( a, b ) _PROFILE_CONCAT2( a, b )
+
+#if MYENGINE_PROFILING
+/// Profile the rest of the enclosing scope as a zone named `name` (a string
+/// literal).
+# define PROFILE_ZONE( name )                                                 \
+  static myengine::profiling::zone_site_t const                               \
+    _PROFILE_CONCAT( _profile_site_, __LINE__ ) =                             \
+    { name, __FILENAME__, __LINE__, __func__ };                               \
+  myengine::profiling::zone _PROFILE_CONCAT( _profile_zone_, __LINE__ )(      \
+    _PROFILE_CONCAT( _profile_site_, __LINE__ ) )
+/// Record the current value of the counter `name` (a string literal).
+# define PROFILE_COUNTER( name, value )                                       \
+  do                                                                          \
+  {                                                                           \
+    static myengine::profiling::zone_site_t const _profile_counter_site =     \
+      { name, __FILENAME__, __LINE__, __func__ };                             \
+    if( myengine::profiling::detail::g_capturing.load(                        \
+          std::memory_order_relaxed ) )                                       \
+    {                                                                         \
+      myengine::profiling::detail::record_counter(                            \
+        _profile_counter_site, myengine::profiling::detail::now_ns(),         \
+        static_cast< double >( value ) );                                     \
+    }                                                                         \
+  } while( false )
+#else
+# define PROFILE_ZONE( name ) do {} while( false )
+# define PROFILE_COUNTER( name, value ) do {} while( false )
+#endif
+
+/// Profile the rest of the enclosing function as a zone named after it.
+#define PROFILE_FUNCTION() PROFILE_ZONE( __func__ )
+
+#endif //MYENGINE_PROFILING_H
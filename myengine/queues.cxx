@@ -0,0 +1,304 @@
+#define MYENGINE_LOG_MODULE "vulkan.queues"
+#include "queues.h"
+
+#include <bitset>
+#include <stdexcept>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+/// Priorities of the queues of a family. At most one queue per role is
+/// created in a family: graphics, present, transfer and compute.
+constexpr float QUEUE_PRIORITIES[] = { 1.f, 1.f, 1.f, 1.f };
+
+} // namespace
+
+std::optional< uint32_t >
+find_queue_family( std::vector< VkQueueFamilyProperties > const& families,
+                   VkQueueFlags required, VkQueueFlags excluded )
+{
+  std::optional< uint32_t > best;
+  std::size_t best_extra = 0;
+  for( uint32_t i = 0; i < families.size(); ++i )
+  {
+    VkQueueFlags const flags = families[ i ].queueFlags;
+    if( families[ i ].queueCount == 0 || ( flags & required ) != required ||
+        ( flags & excluded ) != 0 )
+    {
+      continue;
+    }
+    std::size_t const extra =
+      std::bitset< 32 >( flags & ~required ).count();
+    if( !best || extra < best_extra )
+    {
+      best = i;
+      best_extra = extra;
+    }
+  }
+  return best;
+}
+
+queue_layout
+plan_queues( std::vector< VkQueueFamilyProperties > const& families,
+             uint32_t graphics_family, uint32_t present_family )
+{
+  // Queues taken from each family so far.
+  std::vector< uint32_t > taken( families.size(), 0 );
+  // The next queue of the family, or its last one once all are taken.
+  auto const take = [ & ]( uint32_t family ) -> queue_slot {
+    if( taken[ family ] < families[ family ].queueCount )
+    {
+      return { family, taken[ family ]++ };
+    }
+    return { family, taken[ family ] - 1 };
+  };
+
+  queue_layout layout = {};
+  layout.graphics = take( graphics_family );
+  layout.present = present_family == graphics_family
+                     ? layout.graphics
+                     : take( present_family );
+
+  auto transfer_family =
+    find_queue_family( families, VK_QUEUE_TRANSFER_BIT,
+                       VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT );
+  auto const compute_family =
+    find_queue_family( families, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT );
+  if( !transfer_family )
+  {
+    // Compute queues can copy too, and still run beside graphics.
+    transfer_family = compute_family;
+  }
+  layout.transfer =
+    transfer_family ? take( *transfer_family ) : layout.graphics;
+  layout.compute = compute_family ? take( *compute_family ) : layout.graphics;
+
+  for( uint32_t family = 0; family < families.size(); ++family )
+  {
+    if( taken[ family ] == 0 )
+    {
+      continue;
+    }
+    VkDeviceQueueCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    info.queueFamilyIndex = family;
+    info.queueCount = taken[ family ];
+    info.pQueuePriorities = QUEUE_PRIORITIES;
+    layout.create_infos.push_back( info );
+  }
+
+  LOGF_DEBUG( "Queues (family, index): graphics ({}, {}), present ({}, {}), "
+              "transfer ({}, {}){}, compute ({}, {}){}",
+              layout.graphics.family, layout.graphics.index,
+              layout.present.family, layout.present.index,
+              layout.transfer.family, layout.transfer.index,
+              layout.dedicated_transfer() ? " dedicated" : "",
+              layout.compute.family, layout.compute.index,
+              layout.async_compute() ? " async" : "" );
+  return layout;
+}
+
+bool
+timeline_semaphores_supported( VkPhysicalDevice device )
+{
+  if( get_device_capabilities( device ).properties.apiVersion <
+      VK_API_VERSION_1_2 )
+  {
+    return false;
+  }
+  VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features = {};
+  timeline_features.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+  VkPhysicalDeviceFeatures2 features = {};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &timeline_features;
+  vkGetPhysicalDeviceFeatures2( device, &features );
+  return timeline_features.timelineSemaphore == VK_TRUE;
+}
+
+timeline_queue::timeline_queue( VkDevice device, uint32_t family,
+                                VkQueue queue, char const* name )
+  : m_device( device ),
+    m_family( family ),
+    m_queue( queue ),
+    m_name( name ),
+    m_semaphore( VK_NULL_HANDLE ),
+    m_command_pool( VK_NULL_HANDLE ),
+    m_submitted( 0 ),
+    m_in_flight()
+{
+  try
+  {
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+    check_result( vkCreateSemaphore( m_device, &semaphore_info, nullptr,
+                                     &m_semaphore ),
+                  "create timeline semaphore" );
+
+    // Command buffers are recycled one by one, as their submissions complete.
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                      VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = m_family;
+    check_result( vkCreateCommandPool( m_device, &pool_info, nullptr,
+                                       &m_command_pool ),
+                  "create queue command pool" );
+  }
+  catch( ... )
+  {
+    destroy();
+    throw;
+  }
+}
+
+timeline_queue::~timeline_queue()
+{
+  try
+  {
+    wait_idle();
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "Failed to wait for the {} queue: {}", m_name, e.what() );
+  }
+  destroy();
+}
+
+void
+timeline_queue::destroy()
+{
+  m_in_flight.clear();
+  if( m_command_pool != VK_NULL_HANDLE )
+  {
+    vkDestroyCommandPool( m_device, m_command_pool, nullptr );
+    m_command_pool = VK_NULL_HANDLE;
+  }
+  if( m_semaphore != VK_NULL_HANDLE )
+  {
+    vkDestroySemaphore( m_device, m_semaphore, nullptr );
+    m_semaphore = VK_NULL_HANDLE;
+  }
+}
+
+VkCommandBuffer
+timeline_queue::begin()
+{
+  VkCommandBuffer cmd = VK_NULL_HANDLE;
+  if( !m_in_flight.empty() && m_in_flight.front().value <= completed() )
+  {
+    // Reset implicitly by beginning it, as the pool allows.
+    cmd = m_in_flight.front().cmd;
+    m_in_flight.pop_front();
+  }
+  else
+  {
+    VkCommandBufferAllocateInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = m_command_pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+    check_result( vkAllocateCommandBuffers( m_device, &cmd_info, &cmd ),
+                  "allocate queue command buffer" );
+    LOGF_DEBUG( "{} queue: {} command buffer(s) in flight, allocated another",
+                m_name, m_in_flight.size() );
+  }
+
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  check_result( vkBeginCommandBuffer( cmd, &begin_info ),
+                "begin queue command buffer" );
+  return cmd;
+}
+
+timeline_point
+timeline_queue::submit( VkCommandBuffer cmd,
+                        std::vector< timeline_wait > const& waits,
+                        VkSemaphore signal )
+{
+  PROFILE_FUNCTION();
+  check_result( vkEndCommandBuffer( cmd ), "end queue command buffer" );
+
+  std::vector< VkSemaphore > wait_semaphores;
+  std::vector< uint64_t > wait_values;
+  std::vector< VkPipelineStageFlags > wait_stages;
+  wait_semaphores.reserve( waits.size() );
+  wait_values.reserve( waits.size() );
+  wait_stages.reserve( waits.size() );
+  for( auto const& w : waits )
+  {
+    wait_semaphores.push_back( w.point.semaphore );
+    wait_values.push_back( w.point.value );
+    wait_stages.push_back( w.stages );
+  }
+  uint64_t const value = m_submitted + 1;
+  VkSemaphore const signal_semaphores[] = { m_semaphore, signal };
+  // The binary semaphore's value is ignored.
+  uint64_t const signal_values[] = { value, 0 };
+  uint32_t const signal_count = signal != VK_NULL_HANDLE ? 2 : 1;
+
+  VkTimelineSemaphoreSubmitInfo timeline_info = {};
+  timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_info.waitSemaphoreValueCount =
+    static_cast< uint32_t >( wait_values.size() );
+  timeline_info.pWaitSemaphoreValues = wait_values.data();
+  timeline_info.signalSemaphoreValueCount = signal_count;
+  timeline_info.pSignalSemaphoreValues = signal_values;
+  VkSubmitInfo submit_info = {};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = &timeline_info;
+  submit_info.waitSemaphoreCount =
+    static_cast< uint32_t >( wait_semaphores.size() );
+  submit_info.pWaitSemaphores = wait_semaphores.data();
+  submit_info.pWaitDstStageMask = wait_stages.data();
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &cmd;
+  submit_info.signalSemaphoreCount = signal_count;
+  submit_info.pSignalSemaphores = signal_semaphores;
+  check_result( vkQueueSubmit( m_queue, 1, &submit_info, VK_NULL_HANDLE ),
+                "submit to queue" );
+
+  m_submitted = value;
+  m_in_flight.push_back( { cmd, value } );
+  return { m_semaphore, value };
+}
+
+uint64_t
+timeline_queue::completed() const
+{
+  uint64_t value = 0;
+  check_result( vkGetSemaphoreCounterValue( m_device, m_semaphore, &value ),
+                "get timeline semaphore value" );
+  return value;
+}
+
+void
+timeline_queue::wait( uint64_t value ) const
+{
+  if( value == 0 )
+  {
+    return;
+  }
+  PROFILE_FUNCTION();
+  VkSemaphoreWaitInfo wait_info = {};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &m_semaphore;
+  wait_info.pValues = &value;
+  check_result( vkWaitSemaphores( m_device, &wait_info, UINT64_MAX ),
+                "wait for timeline semaphore" );
+}
+
+} // namespace myengine::vulkan
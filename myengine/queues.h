@@ -0,0 +1,238 @@
+#ifndef MYENGINE_QUEUES_H
+#define MYENGINE_QUEUES_H
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine::vulkan {
+
+/// A queue of a logical device: its family and index within the family.
+struct queue_slot
+{
+  uint32_t family;
+  uint32_t index;
+};
+
+/**
+ * Which queue each kind of work is submitted to, and the queues to create the
+ * logical device with for that.
+ *
+ * Roles share a queue when the device does not have enough of them, so
+ * several roles may name the same slot. A queue must only be submitted to by
+ * one thread at a time, so roles sharing a queue must be submitted from the
+ * same thread or under a common lock.
+ */
+struct queue_layout
+{
+  queue_slot graphics;
+  queue_slot present;
+  queue_slot transfer;
+  queue_slot compute;
+  /// For `VkDeviceCreateInfo::pQueueCreateInfos`, one per family used. The
+  /// priorities point to static storage.
+  std::vector< VkDeviceQueueCreateInfo > create_infos;
+
+  /// Transfers run on a family without graphics, i.e. a copy engine.
+  [[nodiscard]] bool
+  dedicated_transfer() const
+  {
+    return transfer.family != graphics.family;
+  }
+
+  /// Compute runs on a family without graphics, alongside rendering.
+  [[nodiscard]] bool
+  async_compute() const
+  {
+    return compute.family != graphics.family;
+  }
+};
+
+/**
+ * Find the family best suited to a kind of work: one with all of `required`
+ * and none of `excluded`, preferring families with fewer other capabilities,
+ * since those tend to map to dedicated hardware (e.g. a transfer-only family
+ * to a DMA engine).
+ *
+ * @return Index of the family, if any qualifies.
+ */
+[[nodiscard]] std::optional< uint32_t >
+MYENGINE_EXPORT
+find_queue_family( std::vector< VkQueueFamilyProperties > const& families,
+                   VkQueueFlags required, VkQueueFlags excluded = 0 );
+
+/**
+ * Lay out the queues of a logical device.
+ *
+ * Graphics and present use the given families, and share one queue if they
+ * are the same family. Transfers go to a transfer-only family if there is
+ * one, otherwise to a compute family without graphics; compute goes to a
+ * compute family without graphics. Each gets its own queue of that family
+ * while it has more, and falls back to sharing the graphics queue when no
+ * such family exists.
+ *
+ * @param families Queue families of the physical device.
+ * @param graphics_family Family supporting graphics.
+ * @param present_family Family that presents to the surface; the graphics
+ * family when headless.
+ */
+[[nodiscard]] queue_layout
+MYENGINE_EXPORT
+plan_queues( std::vector< VkQueueFamilyProperties > const& families,
+             uint32_t graphics_family, uint32_t present_family );
+
+/**
+ * If the device supports timeline semaphores as a Vulkan 1.2 core feature.
+ * The instance must have been created for Vulkan 1.2 or later.
+ *
+ * They must then be enabled at device creation, by chaining a
+ * `VkPhysicalDeviceTimelineSemaphoreFeatures` with `timelineSemaphore` set,
+ * before using a `timeline_queue`.
+ */
+[[nodiscard]] bool
+MYENGINE_EXPORT
+timeline_semaphores_supported( VkPhysicalDevice device );
+
+/// A value of a timeline semaphore, reached when the work up to it completed.
+struct timeline_point
+{
+  VkSemaphore semaphore;
+  uint64_t value;
+};
+
+/// A point for a submission to wait on, and the stages that wait for it.
+struct timeline_wait
+{
+  timeline_point point;
+  VkPipelineStageFlags stages;
+};
+
+/**
+ * Submits work to one queue and tracks its completion with a timeline
+ * semaphore, which counts the submissions.
+ *
+ * Every `submit` signals the next value of the semaphore. Submissions to
+ * other queues, including the graphics queue (see
+ * `frame_scheduler::end_frame`), wait on the returned point instead of the
+ * two queues serializing, so copies and compute on dedicated queues overlap
+ * with rendering. The host waits on the same points, instead of on fences.
+ *
+ * One-time command buffers come from `begin`, and are recycled once the
+ * submission that executed them completed.
+ *
+ * Resources with `VK_SHARING_MODE_EXCLUSIVE` used on queues of different
+ * families additionally need queue family ownership transfers, which are up
+ * to the caller; or create them with `VK_SHARING_MODE_CONCURRENT`.
+ *
+ * Not thread-safe. Must be destroyed before the `VkDevice`.
+ */
+class MYENGINE_EXPORT timeline_queue
+{
+public:
+  /**
+   * @param family Queue family of `queue`, for the command pool.
+   * @param name For log messages, e.g. "transfer"; must outlive this.
+   *
+   * @throws std::runtime_error Failed to create the semaphore or the command
+   * pool.
+   */
+  timeline_queue( VkDevice device, uint32_t family, VkQueue queue,
+                  char const* name );
+
+  timeline_queue( timeline_queue const& ) = delete;
+  timeline_queue& operator=( timeline_queue const& ) = delete;
+
+  /// Waits for all submitted work.
+  ~timeline_queue();
+
+  /**
+   * A command buffer of this queue's family, begun for one time submission.
+   * Pass it to `submit` when recorded.
+   *
+   * @throws std::runtime_error Allocating or beginning it failed.
+   */
+  [[nodiscard]] VkCommandBuffer begin();
+
+  /**
+   * End `cmd`, from `begin`, and submit it once all `waits` are reached.
+   *
+   * @param signal Binary semaphore to also signal, or null.
+   *
+   * @return The point reached when `cmd` has completed.
+   *
+   * @throws std::runtime_error Ending or submission failed.
+   */
+  timeline_point submit( VkCommandBuffer cmd,
+                         std::vector< timeline_wait > const& waits = {},
+                         VkSemaphore signal = VK_NULL_HANDLE );
+
+  /// The point of the most recent submission; value 0 before any.
+  [[nodiscard]] timeline_point
+  last_submitted() const
+  {
+    return { m_semaphore, m_submitted };
+  }
+
+  /**
+   * The latest value reached.
+   *
+   * @throws std::runtime_error Querying the semaphore failed.
+   */
+  [[nodiscard]] uint64_t completed() const;
+
+  /**
+   * Block until `value` of this queue's timeline is reached.
+   *
+   * @throws std::runtime_error Waiting failed.
+   */
+  void wait( uint64_t value ) const;
+
+  /// Wait for all submitted work.
+  void
+  wait_idle() const
+  {
+    wait( m_submitted );
+  }
+
+  [[nodiscard]] VkQueue
+  queue() const
+  {
+    return m_queue;
+  }
+
+  [[nodiscard]] uint32_t
+  family() const
+  {
+    return m_family;
+  }
+
+private:
+  /// A submitted command buffer, free again once `value` is reached.
+  struct in_flight
+  {
+    VkCommandBuffer cmd;
+    uint64_t value;
+  };
+
+  VkDevice m_device;
+  uint32_t m_family;
+  VkQueue m_queue;
+  char const* m_name;
+  VkSemaphore m_semaphore;
+  VkCommandPool m_command_pool;
+  /// Value signalled by the latest submission.
+  uint64_t m_submitted;
+  /// In submission order, so by increasing value.
+  std::deque< in_flight > m_in_flight;
+
+  void destroy();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_QUEUES_H
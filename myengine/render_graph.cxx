@@ -0,0 +1,906 @@
+#define MYENGINE_LOG_MODULE "vulkan.render_graph"
+#include "render_graph.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+constexpr VkPipelineStageFlags SHADER_STAGES =
+  VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+constexpr VkPipelineStageFlags DEPTH_STAGES =
+  VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+  VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+/// What a `resource_usage` stands for.
+struct usage_info
+{
+  VkPipelineStageFlags stages;
+  VkAccessFlags access;
+  VkImageLayout layout;
+  /// Zero if not a usage of images, or of buffers.
+  VkImageUsageFlags image_usage;
+  VkBufferUsageFlags buffer_usage;
+};
+
+usage_info
+get_usage_info( resource_usage usage )
+{
+  switch( usage )
+  {
+    case resource_usage::color_attachment:
+      return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+               VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+               VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+               VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+               VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0 };
+    case resource_usage::depth_attachment:
+      return { DEPTH_STAGES,
+               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+               VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0 };
+    case resource_usage::depth_read:
+      return { DEPTH_STAGES, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+               VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0 };
+    case resource_usage::sampled:
+      return { SHADER_STAGES, VK_ACCESS_SHADER_READ_BIT,
+               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+               VK_IMAGE_USAGE_SAMPLED_BIT, 0 };
+    case resource_usage::storage_read:
+      return { SHADER_STAGES, VK_ACCESS_SHADER_READ_BIT,
+               VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT,
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+    case resource_usage::storage_write:
+      return { SHADER_STAGES, VK_ACCESS_SHADER_WRITE_BIT,
+               VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT,
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+    case resource_usage::transfer_src:
+      return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+               VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+               VK_BUFFER_USAGE_TRANSFER_SRC_BIT };
+    case resource_usage::transfer_dst:
+      return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+               VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+               VK_BUFFER_USAGE_TRANSFER_DST_BIT };
+    case resource_usage::vertex_buffer:
+      return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+               VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+               0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT };
+    case resource_usage::index_buffer:
+      return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT,
+               VK_IMAGE_LAYOUT_UNDEFINED, 0,
+               VK_BUFFER_USAGE_INDEX_BUFFER_BIT };
+    case resource_usage::indirect_buffer:
+      return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+               VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+               0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT };
+    case resource_usage::uniform_buffer:
+      return { SHADER_STAGES, VK_ACCESS_UNIFORM_READ_BIT,
+               VK_IMAGE_LAYOUT_UNDEFINED, 0,
+               VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT };
+  }
+  throw std::invalid_argument( "Unknown resource usage" );
+}
+
+} // namespace
+
+bool
+synchronization2_supported( VkPhysicalDevice device )
+{
+  if( !get_device_capabilities( device ).extensions.contains(
+        VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME ) )
+  {
+    return false;
+  }
+  VkPhysicalDeviceSynchronization2FeaturesKHR sync2_features = {};
+  sync2_features.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+  VkPhysicalDeviceFeatures2 features = {};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &sync2_features;
+  vkGetPhysicalDeviceFeatures2( device, &features );
+  return sync2_features.synchronization2 == VK_TRUE;
+}
+
+render_graph::pass_builder&
+render_graph::pass_builder::read( resource_t resource, resource_usage usage )
+{
+  m_graph.declare( m_pass, resource, usage, false );
+  return *this;
+}
+
+render_graph::pass_builder&
+render_graph::pass_builder::write( resource_t resource, resource_usage usage )
+{
+  m_graph.declare( m_pass, resource, usage, true );
+  return *this;
+}
+
+render_graph::render_graph( VkDevice device,
+                            device_memory_allocator& allocator,
+                            render_graph_config const& config )
+  : m_device( device ),
+    m_allocator( allocator ),
+    m_config( config ),
+    m_cmd_pipeline_barrier2( nullptr ),
+    m_profiler( nullptr ),
+    m_statistics( nullptr ),
+    m_resources(),
+    m_passes(),
+    m_compiled( false ),
+    m_schedule(),
+    m_used_imports(),
+    m_barriers(),
+    m_batches(),
+    m_memory(),
+    m_stats(),
+    m_image_barriers(),
+    m_image_barriers2()
+{
+  if( m_config.synchronization2 )
+  {
+    m_cmd_pipeline_barrier2 = reinterpret_cast< PFN_vkCmdPipelineBarrier2KHR >(
+      vkGetDeviceProcAddr( m_device, "vkCmdPipelineBarrier2KHR" ) );
+    if( !m_cmd_pipeline_barrier2 )
+    {
+      throw std::runtime_error( "vkCmdPipelineBarrier2KHR is not available; "
+                                "is VK_KHR_synchronization2 enabled?" );
+    }
+  }
+}
+
+render_graph::~render_graph()
+{
+  destroy_transients();
+}
+
+render_graph::resource_t
+render_graph::add_resource( resource_info&& r )
+{
+  m_resources.push_back( std::move( r ) );
+  m_compiled = false;
+  return static_cast< resource_t >( m_resources.size() - 1 );
+}
+
+render_graph::resource_t
+render_graph::create_image( std::string name,
+                            transient_image_desc const& desc )
+{
+  resource_info r = {};
+  r.name = std::move( name );
+  r.is_image = true;
+  r.image_desc = desc;
+  r.initial = { VK_IMAGE_LAYOUT_UNDEFINED, 0, 0 };
+  r.final = r.initial;
+  return add_resource( std::move( r ) );
+}
+
+render_graph::resource_t
+render_graph::create_buffer( std::string name, VkDeviceSize size )
+{
+  resource_info r = {};
+  r.name = std::move( name );
+  r.size = size;
+  r.initial = { VK_IMAGE_LAYOUT_UNDEFINED, 0, 0 };
+  r.final = r.initial;
+  return add_resource( std::move( r ) );
+}
+
+render_graph::resource_t
+render_graph::import_image( std::string name, VkImageAspectFlags aspect,
+                            resource_state const& initial,
+                            resource_state const& final )
+{
+  resource_info r = {};
+  r.name = std::move( name );
+  r.is_image = true;
+  r.imported = true;
+  r.image_desc.aspect = aspect;
+  r.initial = initial;
+  r.final = final;
+  return add_resource( std::move( r ) );
+}
+
+render_graph::resource_t
+render_graph::import_buffer( std::string name, resource_state const& initial,
+                             resource_state const& final )
+{
+  resource_info r = {};
+  r.name = std::move( name );
+  r.imported = true;
+  r.initial = { VK_IMAGE_LAYOUT_UNDEFINED, initial.stages, initial.access };
+  r.final = { VK_IMAGE_LAYOUT_UNDEFINED, final.stages, final.access };
+  return add_resource( std::move( r ) );
+}
+
+render_graph::pass_builder
+render_graph::add_pass( std::string name, execute_fn fn )
+{
+  profiling::zone_site_t const& site = profiling::intern_site( name );
+  m_passes.push_back(
+    { std::move( name ), &site, std::move( fn ), {}, false } );
+  m_compiled = false;
+  return pass_builder( *this, static_cast< uint32_t >( m_passes.size() - 1 ) );
+}
+
+void
+render_graph::mark_output( resource_t resource )
+{
+  m_resources[ resource ].output = true;
+  m_compiled = false;
+}
+
+void
+render_graph::declare( uint32_t pass_index, resource_t resource,
+                       resource_usage usage, bool write )
+{
+  resource_info& r = m_resources[ resource ];
+  pass& p = m_passes[ pass_index ];
+  usage_info const info = get_usage_info( usage );
+  if( r.is_image ? info.image_usage == 0 : info.buffer_usage == 0 )
+  {
+    throw std::invalid_argument( "Pass '" + p.name + "' uses '" + r.name +
+                                 "' as a" + ( r.is_image ? " buffer"
+                                                         : "n image" ) );
+  }
+  r.image_usage |= info.image_usage;
+  r.buffer_usage |= info.buffer_usage;
+  VkImageLayout const layout =
+    r.is_image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+  auto it = std::find_if( p.accesses.begin(), p.accesses.end(),
+                          [ & ]( access const& a ) {
+                            return a.resource == resource;
+                          } );
+  if( it == p.accesses.end() )
+  {
+    p.accesses.push_back(
+      { resource, info.stages, info.access, layout, !write, write } );
+  }
+  else if( it->layout != layout )
+  {
+    throw std::invalid_argument( "Pass '" + p.name + "' uses '" + r.name +
+                                 "' in two layouts" );
+  }
+  else
+  {
+    it->stages |= info.stages;
+    it->access |= info.access;
+    it->read = it->read || !write;
+    it->write = it->write || write;
+  }
+  m_compiled = false;
+}
+
+void
+render_graph::compile()
+{
+  PROFILE_FUNCTION();
+  destroy_transients();
+  m_compiled = false;
+  m_stats = {};
+  m_schedule.clear();
+  m_used_imports.clear();
+  cull();
+
+  // Lifetimes, in scheduled passes.
+  std::size_t const n = m_resources.size();
+  std::vector< uint32_t > first( n, UINT32_MAX ), last( n, UINT32_MAX );
+  for( uint32_t p = 0; p < m_passes.size(); ++p )
+  {
+    if( m_passes[ p ].culled )
+    {
+      LOGF_DEBUG( "Culled pass '{}'", m_passes[ p ].name );
+      continue;
+    }
+    auto const step = static_cast< uint32_t >( m_schedule.size() );
+    m_schedule.push_back( p );
+    for( auto const& a : m_passes[ p ].accesses )
+    {
+      if( first[ a.resource ] == UINT32_MAX )
+      {
+        first[ a.resource ] = step;
+      }
+      last[ a.resource ] = step;
+    }
+  }
+  m_stats.passes = static_cast< uint32_t >( m_passes.size() );
+  m_stats.culled =
+    static_cast< uint32_t >( m_passes.size() - m_schedule.size() );
+
+  try
+  {
+    std::vector< resource_t > predecessor( n, INVALID_RESOURCE );
+    create_transients( first, last, predecessor );
+    plan_barriers( predecessor );
+  }
+  catch( ... )
+  {
+    destroy_transients();
+    throw;
+  }
+
+  // Imported resources need handles if passes use them or they are
+  // transitioned at the end.
+  std::vector< bool > used( n, false );
+  for( resource_t r = 0; r < n; ++r )
+  {
+    used[ r ] = first[ r ] != UINT32_MAX;
+  }
+  for( std::size_t i = m_batches[ m_schedule.size() ]; i < m_barriers.size();
+       ++i )
+  {
+    used[ m_barriers[ i ].resource ] = true;
+  }
+  for( resource_t r = 0; r < n; ++r )
+  {
+    if( m_resources[ r ].imported && used[ r ] )
+    {
+      m_used_imports.push_back( r );
+    }
+  }
+  m_compiled = true;
+
+  LOGF_INFO( "Render graph: {} pass(es), {} culled; {} barrier(s) in {} "
+             "batch(es) per frame; {} transient resource(s) of {} bytes in "
+             "{} bytes of memory, {} bytes saved by aliasing",
+             m_stats.passes, m_stats.culled, m_stats.barriers,
+             m_stats.barrier_batches, m_stats.transient_resources,
+             m_stats.transient_bytes, m_stats.allocated_bytes,
+             m_stats.aliasing_saved_bytes );
+}
+
+void
+render_graph::cull()
+{
+  // Walking back from the outputs, a pass is needed if it writes something
+  // needed later. Then what it overwrites is not needed before it, but what
+  // it reads is.
+  std::vector< bool > needed( m_resources.size(), false );
+  for( resource_t r = 0; r < m_resources.size(); ++r )
+  {
+    needed[ r ] = m_resources[ r ].output || m_resources[ r ].imported;
+  }
+  for( auto p = m_passes.rbegin(); p != m_passes.rend(); ++p )
+  {
+    p->culled = std::none_of( p->accesses.begin(), p->accesses.end(),
+                              [ & ]( access const& a ) {
+                                return a.write && needed[ a.resource ];
+                              } );
+    if( p->culled )
+    {
+      continue;
+    }
+    for( auto const& a : p->accesses )
+    {
+      if( a.write && !a.read )
+      {
+        needed[ a.resource ] = false;
+      }
+    }
+    for( auto const& a : p->accesses )
+    {
+      if( a.read )
+      {
+        needed[ a.resource ] = true;
+      }
+    }
+  }
+}
+
+void
+render_graph::create_transients( std::vector< uint32_t > const& first,
+                                 std::vector< uint32_t > const& last,
+                                 std::vector< resource_t >& predecessor )
+{
+  struct transient
+  {
+    resource_t resource;
+    VkMemoryRequirements reqs;
+  };
+  std::vector< transient > transients;
+  for( resource_t r = 0; r < m_resources.size(); ++r )
+  {
+    resource_info& res = m_resources[ r ];
+    if( res.imported || first[ r ] == UINT32_MAX )
+    {
+      continue;
+    }
+    VkMemoryRequirements reqs;
+    if( res.is_image )
+    {
+      VkImageCreateInfo image_info = {};
+      image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      image_info.imageType = VK_IMAGE_TYPE_2D;
+      image_info.format = res.image_desc.format;
+      image_info.extent = { res.image_desc.extent.width,
+                            res.image_desc.extent.height, 1 };
+      image_info.mipLevels = 1;
+      image_info.arrayLayers = 1;
+      image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+      image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+      image_info.usage = res.image_desc.usage | res.image_usage;
+      image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      check_result( vkCreateImage( m_device, &image_info, nullptr, &res.image ),
+                    "create transient image" );
+      vkGetImageMemoryRequirements( m_device, res.image, &reqs );
+    }
+    else
+    {
+      VkBufferCreateInfo buffer_info = {};
+      buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      buffer_info.size = res.size;
+      buffer_info.usage = res.buffer_usage;
+      buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      check_result( vkCreateBuffer( m_device, &buffer_info, nullptr,
+                                    &res.buffer ),
+                    "create transient buffer" );
+      vkGetBufferMemoryRequirements( m_device, res.buffer, &reqs );
+    }
+    transients.push_back( { r, reqs } );
+    ++m_stats.transient_resources;
+    m_stats.transient_bytes += reqs.size;
+  }
+
+  // Greedily, largest first, put each resource in the first group of
+  // resources sharing memory that it can join: same kind of resource, a
+  // common memory type, and used by none of the group's passes.
+  std::stable_sort( transients.begin(), transients.end(),
+                    []( transient const& a, transient const& b ) {
+                      return a.reqs.size > b.reqs.size;
+                    } );
+  struct alias_group
+  {
+    bool is_image;
+    VkMemoryRequirements reqs;
+    std::vector< resource_t > members;
+  };
+  std::vector< alias_group > groups;
+  for( auto const& t : transients )
+  {
+    bool const is_image = m_resources[ t.resource ].is_image;
+    alias_group* group = nullptr;
+    for( auto& g : groups )
+    {
+      if( !m_config.aliasing )
+      {
+        break;
+      }
+      if( g.is_image != is_image ||
+          ( g.reqs.memoryTypeBits & t.reqs.memoryTypeBits ) == 0 )
+      {
+        continue;
+      }
+      bool const overlaps =
+        std::any_of( g.members.begin(), g.members.end(),
+                     [ & ]( resource_t m ) {
+                       return first[ m ] <= last[ t.resource ] &&
+                              first[ t.resource ] <= last[ m ];
+                     } );
+      if( !overlaps )
+      {
+        group = &g;
+        break;
+      }
+    }
+    if( group )
+    {
+      group->reqs.size = std::max( group->reqs.size, t.reqs.size );
+      group->reqs.alignment =
+        std::max( group->reqs.alignment, t.reqs.alignment );
+      group->reqs.memoryTypeBits &= t.reqs.memoryTypeBits;
+    }
+    else
+    {
+      groups.push_back( { is_image, t.reqs, {} } );
+      group = &groups.back();
+    }
+    group->members.push_back( t.resource );
+  }
+
+  m_memory.reserve( groups.size() );
+  for( auto& g : groups )
+  {
+    // CPU implementations may only have host-visible memory; that is still
+    // "device local" to them.
+    m_memory.push_back( m_allocator.allocate(
+      g.reqs, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      g.is_image ? resource_kind::optimal : resource_kind::linear ) );
+    memory_allocation const& memory = m_memory.back();
+    m_stats.allocated_bytes += g.reqs.size;
+
+    // In order of use; the first follows the last of the previous frame.
+    std::sort( g.members.begin(), g.members.end(),
+               [ & ]( resource_t a, resource_t b ) {
+                 return first[ a ] < first[ b ];
+               } );
+    for( std::size_t i = 0; i < g.members.size(); ++i )
+    {
+      resource_t const r = g.members[ i ];
+      predecessor[ r ] =
+        g.members[ ( i + g.members.size() - 1 ) % g.members.size() ];
+      resource_info& res = m_resources[ r ];
+      if( !res.is_image )
+      {
+        check_result( vkBindBufferMemory( m_device, res.buffer, memory.memory,
+                                          memory.offset ),
+                      "bind transient buffer memory" );
+        continue;
+      }
+      check_result( vkBindImageMemory( m_device, res.image, memory.memory,
+                                       memory.offset ),
+                    "bind transient image memory" );
+      VkImageViewCreateInfo view_info = {};
+      view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      view_info.image = res.image;
+      view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      view_info.format = res.image_desc.format;
+      view_info.subresourceRange.aspectMask = res.image_desc.aspect;
+      view_info.subresourceRange.levelCount = 1;
+      view_info.subresourceRange.layerCount = 1;
+      check_result( vkCreateImageView( m_device, &view_info, nullptr,
+                                       &res.view ),
+                    "create transient image view" );
+    }
+  }
+  m_stats.aliasing_saved_bytes =
+    m_stats.transient_bytes - m_stats.allocated_bytes;
+}
+
+void
+render_graph::sync( sync_state& state, access const& a, bool is_image,
+                    std::vector< barrier >* barriers ) const
+{
+  bool const transition = is_image && a.layout != state.layout;
+  if( a.write || transition )
+  {
+    // After earlier writes and reads. A layout transition is a write too.
+    VkPipelineStageFlags const src = state.write_stages | state.read_stages;
+    if( barriers && ( src != 0 || transition ) )
+    {
+      barriers->push_back( { a.resource, src, state.write_access, a.stages,
+                             a.access, state.layout, a.layout } );
+    }
+    state.layout = a.layout;
+    state.write_stages = a.stages;
+    state.write_access = a.write ? a.access : 0;
+    // A transition alone is visible to the reads it was made for.
+    state.visible_stages = a.write ? 0 : a.stages;
+    state.visible_access = a.write ? 0 : a.access;
+    state.read_stages = a.write ? 0 : a.stages;
+    return;
+  }
+  if( state.write_stages != 0 &&
+      ( ( a.stages & ~state.visible_stages ) != 0 ||
+        ( a.access & ~state.visible_access ) != 0 ) )
+  {
+    // Read after a write not yet visible to these stages.
+    if( barriers )
+    {
+      barriers->push_back( { a.resource, state.write_stages,
+                             state.write_access, a.stages, a.access,
+                             state.layout, state.layout } );
+    }
+    state.visible_stages |= a.stages;
+    state.visible_access |= a.access;
+  }
+  state.read_stages |= a.stages;
+}
+
+void
+render_graph::plan_barriers( std::vector< resource_t > const& predecessor )
+{
+  std::size_t const n = m_resources.size();
+  std::vector< sync_state > states( n );
+  auto const reset = [ & ]() {
+    for( resource_t r = 0; r < n; ++r )
+    {
+      resource_state const& initial = m_resources[ r ].initial;
+      states[ r ] = { initial.layout, initial.stages, initial.access, 0, 0,
+                      0 };
+    }
+  };
+
+  // Once to find the state each transient resource leaves its memory in, so
+  // that its successor in the memory, in this or the next frame, waits for
+  // it. Then again, from those states.
+  reset();
+  for( uint32_t p : m_schedule )
+  {
+    for( auto const& a : m_passes[ p ].accesses )
+    {
+      sync( states[ a.resource ], a, m_resources[ a.resource ].is_image,
+            nullptr );
+    }
+  }
+  std::vector< sync_state > const left = states;
+  reset();
+  for( resource_t r = 0; r < n; ++r )
+  {
+    if( predecessor[ r ] != INVALID_RESOURCE )
+    {
+      sync_state const& prev = left[ predecessor[ r ] ];
+      states[ r ].write_stages = prev.write_stages | prev.read_stages;
+      states[ r ].write_access = prev.write_access;
+    }
+  }
+
+  m_barriers.clear();
+  m_batches.clear();
+  for( uint32_t p : m_schedule )
+  {
+    m_batches.push_back( m_barriers.size() );
+    for( auto const& a : m_passes[ p ].accesses )
+    {
+      sync( states[ a.resource ], a, m_resources[ a.resource ].is_image,
+            &m_barriers );
+    }
+  }
+
+  // Hand imported resources on in their final states.
+  m_batches.push_back( m_barriers.size() );
+  for( resource_t r = 0; r < n; ++r )
+  {
+    resource_info const& res = m_resources[ r ];
+    if( !res.imported )
+    {
+      continue;
+    }
+    sync_state const& s = states[ r ];
+    bool const transition = res.is_image && s.layout != res.final.layout;
+    VkPipelineStageFlags const src = s.write_stages | s.read_stages;
+    if( transition || ( src != 0 && res.final.stages != 0 ) )
+    {
+      m_barriers.push_back( { r, src, s.write_access, res.final.stages,
+                              res.final.access, s.layout,
+                              res.final.layout } );
+    }
+  }
+  m_batches.push_back( m_barriers.size() );
+
+  for( std::size_t b = 0; b + 1 < m_batches.size(); ++b )
+  {
+    uint32_t images = 0;
+    bool buffers = false;
+    for( std::size_t i = m_batches[ b ]; i < m_batches[ b + 1 ]; ++i )
+    {
+      if( m_resources[ m_barriers[ i ].resource ].is_image )
+      {
+        ++images;
+      }
+      else
+      {
+        buffers = true;
+      }
+    }
+    uint32_t const count = images + ( buffers ? 1 : 0 );
+    m_stats.barriers += count;
+    m_stats.barrier_batches += count != 0 ? 1 : 0;
+  }
+}
+
+void
+render_graph::set_image( resource_t resource, VkImage image,
+                         VkImageView view )
+{
+  resource_info& r = m_resources[ resource ];
+  if( !r.imported || !r.is_image )
+  {
+    throw std::invalid_argument( "Not an imported image: " + r.name );
+  }
+  r.image = image;
+  r.view = view;
+}
+
+void
+render_graph::set_buffer( resource_t resource, VkBuffer buffer )
+{
+  resource_info& r = m_resources[ resource ];
+  if( !r.imported || r.is_image )
+  {
+    throw std::invalid_argument( "Not an imported buffer: " + r.name );
+  }
+  r.buffer = buffer;
+}
+
+void
+render_graph::execute( VkCommandBuffer cmd )
+{
+  PROFILE_FUNCTION();
+  if( !m_compiled )
+  {
+    throw std::logic_error( "Render graph executed without compiling it" );
+  }
+  for( resource_t r : m_used_imports )
+  {
+    resource_info const& res = m_resources[ r ];
+    if( res.is_image ? res.image == VK_NULL_HANDLE
+                     : res.buffer == VK_NULL_HANDLE )
+    {
+      throw std::logic_error( "No handle set for imported resource '" +
+                              res.name + "'" );
+    }
+  }
+
+  for( std::size_t i = 0; i < m_schedule.size(); ++i )
+  {
+    pass const& p = m_passes[ m_schedule[ i ] ];
+    gpu_profiler::zone_t const zone =
+      m_profiler ? m_profiler->begin_zone( cmd, *p.site )
+                 : gpu_profiler::INVALID_ZONE;
+    record_batch( cmd, i );
+    if( m_statistics )
+    {
+      m_statistics->begin_pass( cmd, *p.site );
+    }
+    p.fn( cmd, *this );
+    if( m_statistics )
+    {
+      m_statistics->end_pass( cmd );
+    }
+    if( m_profiler )
+    {
+      m_profiler->end_zone( cmd, zone );
+    }
+  }
+  record_batch( cmd, m_schedule.size() );
+  PROFILE_COUNTER( "render graph barriers", m_stats.barriers );
+}
+
+void
+render_graph::record_batch( VkCommandBuffer cmd, std::size_t batch )
+{
+  std::size_t const begin = m_batches[ batch ];
+  std::size_t const end = m_batches[ batch + 1 ];
+  if( begin == end )
+  {
+    return;
+  }
+
+  // Buffers have no layout to transition, so their barriers merge into one
+  // memory barrier.
+  VkPipelineStageFlags buffer_src_stages = 0, buffer_dst_stages = 0;
+  VkAccessFlags buffer_src_access = 0, buffer_dst_access = 0;
+  // Legacy barriers share one pair of stage masks per command.
+  VkPipelineStageFlags src_stages = 0, dst_stages = 0;
+  m_image_barriers.clear();
+  m_image_barriers2.clear();
+  for( std::size_t i = begin; i < end; ++i )
+  {
+    barrier const& b = m_barriers[ i ];
+    resource_info const& r = m_resources[ b.resource ];
+    // Stage masks must not be empty: nothing before, or after.
+    VkPipelineStageFlags src = b.src_stages;
+    VkPipelineStageFlags dst = b.dst_stages;
+    if( src == 0 )
+    {
+      src = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+    if( dst == 0 )
+    {
+      dst = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    }
+    if( !r.is_image )
+    {
+      buffer_src_stages |= src;
+      buffer_dst_stages |= dst;
+      buffer_src_access |= b.src_access;
+      buffer_dst_access |= b.dst_access;
+      continue;
+    }
+    VkImageSubresourceRange range = {};
+    range.aspectMask = r.image_desc.aspect;
+    range.levelCount = VK_REMAINING_MIP_LEVELS;
+    range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    if( m_cmd_pipeline_barrier2 )
+    {
+      // The legacy stage and access bits have the same values in the 64-bit
+      // flags.
+      VkImageMemoryBarrier2KHR image_barrier = {};
+      image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+      image_barrier.srcStageMask = src;
+      image_barrier.srcAccessMask = b.src_access;
+      image_barrier.dstStageMask = dst;
+      image_barrier.dstAccessMask = b.dst_access;
+      image_barrier.oldLayout = b.old_layout;
+      image_barrier.newLayout = b.new_layout;
+      image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.image = r.image;
+      image_barrier.subresourceRange = range;
+      m_image_barriers2.push_back( image_barrier );
+    }
+    else
+    {
+      VkImageMemoryBarrier image_barrier = {};
+      image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      image_barrier.srcAccessMask = b.src_access;
+      image_barrier.dstAccessMask = b.dst_access;
+      image_barrier.oldLayout = b.old_layout;
+      image_barrier.newLayout = b.new_layout;
+      image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.image = r.image;
+      image_barrier.subresourceRange = range;
+      m_image_barriers.push_back( image_barrier );
+      src_stages |= src;
+      dst_stages |= dst;
+    }
+  }
+  bool const buffers = buffer_src_stages != 0;
+
+  if( m_cmd_pipeline_barrier2 )
+  {
+    VkMemoryBarrier2KHR memory_barrier = {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+    memory_barrier.srcStageMask = buffer_src_stages;
+    memory_barrier.srcAccessMask = buffer_src_access;
+    memory_barrier.dstStageMask = buffer_dst_stages;
+    memory_barrier.dstAccessMask = buffer_dst_access;
+    VkDependencyInfoKHR dependency = {};
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+    dependency.memoryBarrierCount = buffers ? 1 : 0;
+    dependency.pMemoryBarriers = &memory_barrier;
+    dependency.imageMemoryBarrierCount =
+      static_cast< uint32_t >( m_image_barriers2.size() );
+    dependency.pImageMemoryBarriers = m_image_barriers2.data();
+    m_cmd_pipeline_barrier2( cmd, &dependency );
+    return;
+  }
+  VkMemoryBarrier memory_barrier = {};
+  memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memory_barrier.srcAccessMask = buffer_src_access;
+  memory_barrier.dstAccessMask = buffer_dst_access;
+  vkCmdPipelineBarrier( cmd, src_stages | buffer_src_stages,
+                        dst_stages | buffer_dst_stages, 0, buffers ? 1 : 0,
+                        &memory_barrier, 0, nullptr,
+                        static_cast< uint32_t >( m_image_barriers.size() ),
+                        m_image_barriers.data() );
+}
+
+void
+render_graph::destroy_transients()
+{
+  for( auto& r : m_resources )
+  {
+    if( r.imported )
+    {
+      continue;
+    }
+    if( r.view != VK_NULL_HANDLE )
+    {
+      vkDestroyImageView( m_device, r.view, nullptr );
+      r.view = VK_NULL_HANDLE;
+    }
+    if( r.image != VK_NULL_HANDLE )
+    {
+      vkDestroyImage( m_device, r.image, nullptr );
+      r.image = VK_NULL_HANDLE;
+    }
+    if( r.buffer != VK_NULL_HANDLE )
+    {
+      vkDestroyBuffer( m_device, r.buffer, nullptr );
+      r.buffer = VK_NULL_HANDLE;
+    }
+  }
+  for( auto const& memory : m_memory )
+  {
+    m_allocator.free( memory );
+  }
+  m_memory.clear();
+}
+
+} // namespace myengine::vulkan
@@ -0,0 +1,406 @@
+#ifndef MYENGINE_RENDER_GRAPH_H
+#define MYENGINE_RENDER_GRAPH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/gpu_profiler.h>
+#include <myengine/memory_allocator.h>
+#include <myengine/myengine_export.h>
+#include <myengine/pipeline_statistics.h>
+
+namespace myengine::vulkan {
+
+/**
+ * How a pass uses a resource. Each maps to the pipeline stages, accesses and,
+ * for images, the layout that barriers synchronize, and to the usage flags
+ * transient resources are created with.
+ *
+ * Shader usages cover the vertex, fragment and compute shader stages.
+ */
+enum class resource_usage
+{
+  // Images only.
+  color_attachment,
+  depth_attachment,
+  /// Read-only depth attachment, e.g. for depth testing without writes.
+  depth_read,
+  sampled,
+  // Images and buffers.
+  /// Storage image (in the general layout) or storage buffer.
+  storage_read,
+  storage_write,
+  transfer_src,
+  transfer_dst,
+  // Buffers only.
+  vertex_buffer,
+  index_buffer,
+  indirect_buffer,
+  uniform_buffer,
+};
+
+/// A transient image: created, and aliased, by the graph.
+struct transient_image_desc
+{
+  VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+  VkExtent2D extent = { 0, 0 };
+  /// Usage besides the one implied by the passes' declarations.
+  VkImageUsageFlags usage = 0;
+  VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+/**
+ * How an imported resource is used outside the graph: before it, for the
+ * first barrier, or after it, for the last. The layout is ignored for
+ * buffers.
+ */
+struct resource_state
+{
+  VkImageLayout layout;
+  VkPipelineStageFlags stages;
+  VkAccessFlags access;
+};
+
+struct render_graph_config
+{
+  /// Record each batch of barriers with one `vkCmdPipelineBarrier2KHR`,
+  /// every barrier with its own stages. The device must have been created
+  /// with `VK_KHR_synchronization2` and its feature, see
+  /// `synchronization2_supported`. Otherwise each batch is one
+  /// `vkCmdPipelineBarrier`, waiting on the union of the batch's stages.
+  bool synchronization2 = false;
+  /// Let transient resources whose lifetimes do not overlap share memory.
+  bool aliasing = true;
+};
+
+/// As of the last `compile`.
+struct render_graph_stats
+{
+  uint32_t passes;
+  /// Passes skipped for not contributing to any output.
+  uint32_t culled;
+  /// Barriers recorded per frame, buffer barriers of a batch counting as one
+  /// memory barrier, and the pipeline barrier commands they are batched in.
+  uint32_t barriers;
+  uint32_t barrier_batches;
+  /// Transient resources used by the remaining passes, and their size.
+  uint32_t transient_resources;
+  VkDeviceSize transient_bytes;
+  /// Device memory allocated for the transient resources, and the bytes that
+  /// aliasing saved: `transient_bytes - allocated_bytes`.
+  VkDeviceSize allocated_bytes;
+  VkDeviceSize aliasing_saved_bytes;
+};
+
+/**
+ * If the device supports `VK_KHR_synchronization2`. The instance must have
+ * been created for Vulkan 1.1 or later.
+ *
+ * The extension and its `synchronization2` feature must then be enabled at
+ * device creation, by chaining a `VkPhysicalDeviceSynchronization2FeaturesKHR`,
+ * before setting `render_graph_config::synchronization2`.
+ */
+[[nodiscard]] bool
+MYENGINE_EXPORT
+synchronization2_supported( VkPhysicalDevice device );
+
+/**
+ * A frame as a graph of passes over the resources they declare to read and
+ * write, from which the barriers between them are derived.
+ *
+ * Resources are either transient, created by the graph and only meaningful
+ * within a frame, or imported, such as the swapchain image, with a handle set
+ * every frame and states to transition from and to around the graph.
+ *
+ * `compile` then:
+ *   - culls passes that write nothing an output depends on. Outputs are the
+ *     resources passed to `mark_output` and all imported resources written
+ *     by a pass. A write without a read of the same resource in the same pass
+ *     overwrites it entirely, so earlier writes to it are not depended on.
+ *   - creates the transient resources used by the remaining passes, placing
+ *     those whose lifetimes (the passes between their first and last use) do
+ *     not overlap in the same memory.
+ *   - plans the barriers before every pass: layout transitions, and
+ *     dependencies on earlier writes (read after write, write after write)
+ *     and, execution only, on earlier reads (write after read). Reads after
+ *     reads in the same layout need none. All barriers before a pass are
+ *     batched into one command.
+ *
+ * `execute` then records the passes and barriers into a command buffer, every
+ * frame.
+ *
+ * Barriers of the first use of a transient resource also wait for the last
+ * use of its memory by the previous frame, so frames in flight do not need
+ * their own copies.
+ *
+ * Not thread-safe. Must be destroyed before the allocator and the `VkDevice`,
+ * once the device is done with the transient resources.
+ */
+class MYENGINE_EXPORT render_graph
+{
+public:
+  typedef uint32_t resource_t;
+  static constexpr resource_t INVALID_RESOURCE = 0xFFFFFFFF;
+
+  /// Records a pass. The graph gives the pass's resources' handles.
+  typedef std::function< void ( VkCommandBuffer cmd,
+                                render_graph const& graph ) > execute_fn;
+
+  /// Declares the resources a pass uses, see `add_pass`.
+  class MYENGINE_EXPORT pass_builder
+  {
+  public:
+    /**
+     * @throws std::invalid_argument `usage` is not for the kind of resource,
+     * or the pass already uses the resource in another image layout.
+     */
+    pass_builder& read( resource_t resource, resource_usage usage );
+
+    /// A write to a resource the pass does not read replaces all of its
+    /// contents. Throws as `read`.
+    pass_builder& write( resource_t resource, resource_usage usage );
+
+  private:
+    friend class render_graph;
+
+    pass_builder( render_graph& graph, uint32_t pass )
+      : m_graph( graph ),
+        m_pass( pass )
+    {}
+
+    render_graph& m_graph;
+    uint32_t m_pass;
+  };
+
+  /**
+   * @param allocator Allocates the transient resources' memory.
+   *
+   * @throws std::runtime_error `config.synchronization2` is set but
+   * `vkCmdPipelineBarrier2KHR` is not available.
+   */
+  render_graph( VkDevice device, device_memory_allocator& allocator,
+                render_graph_config const& config = render_graph_config() );
+
+  render_graph( render_graph const& ) = delete;
+  render_graph& operator=( render_graph const& ) = delete;
+
+  ~render_graph();
+
+  resource_t create_image( std::string name,
+                           transient_image_desc const& desc );
+
+  /// Usage flags are implied by the passes' declarations.
+  resource_t create_buffer( std::string name, VkDeviceSize size );
+
+  /**
+   * @param aspect Aspects of the image barriers cover.
+   * @param initial Last use before the graph. Its stages are waited on.
+   * @param final Next use after the graph, transitioned to after the last
+   * pass.
+   */
+  resource_t import_image( std::string name, VkImageAspectFlags aspect,
+                           resource_state const& initial,
+                           resource_state const& final );
+
+  resource_t import_buffer( std::string name, resource_state const& initial,
+                            resource_state const& final );
+
+  /// Add a pass, executed in the order added. Declare what it uses with the
+  /// returned builder, before `compile`.
+  pass_builder add_pass( std::string name, execute_fn fn );
+
+  /// Keep the passes a transient resource depends on.
+  void mark_output( resource_t resource );
+
+  /**
+   * Cull, create the transient resources and plan the barriers. Again after
+   * changing the graph; the transient resources are recreated then, so the
+   * device must be done with them.
+   *
+   * @throws std::runtime_error Failed to create or allocate memory for a
+   * transient resource.
+   */
+  void compile();
+
+  /// Set the handles of an imported image for this frame, before `execute`.
+  void set_image( resource_t resource, VkImage image,
+                  VkImageView view = VK_NULL_HANDLE );
+
+  /// Set the handle of an imported buffer for this frame.
+  void set_buffer( resource_t resource, VkBuffer buffer );
+
+  /**
+   * Time every pass, with the barriers before it, as a zone named after the
+   * pass. `profiler` must outlive the graph, or be unset; `nullptr` unsets.
+   */
+  void
+  set_profiler( gpu_profiler* profiler )
+  {
+    m_profiler = profiler;
+  }
+
+  /// Count the work of every pass, like `set_profiler`.
+  void
+  set_statistics( pipeline_statistics* statistics )
+  {
+    m_statistics = statistics;
+  }
+
+  /**
+   * Record the passes that were not culled and their barriers.
+   *
+   * @throws std::logic_error Not compiled, or an imported resource used by a
+   * pass has no handle.
+   */
+  void execute( VkCommandBuffer cmd );
+
+  [[nodiscard]] VkImage
+  image( resource_t resource ) const
+  {
+    return m_resources[ resource ].image;
+  }
+
+  /// View of the whole image, for transient images.
+  [[nodiscard]] VkImageView
+  image_view( resource_t resource ) const
+  {
+    return m_resources[ resource ].view;
+  }
+
+  [[nodiscard]] VkBuffer
+  buffer( resource_t resource ) const
+  {
+    return m_resources[ resource ].buffer;
+  }
+
+  [[nodiscard]] render_graph_stats const&
+  stats() const
+  {
+    return m_stats;
+  }
+
+private:
+  struct resource_info
+  {
+    std::string name;
+    bool is_image;
+    bool imported;
+    bool output;
+    transient_image_desc image_desc;
+    VkDeviceSize size;
+    /// Usage implied by the passes, for transient resources.
+    VkImageUsageFlags image_usage;
+    VkBufferUsageFlags buffer_usage;
+    resource_state initial;
+    resource_state final;
+    VkImage image;
+    VkImageView view;
+    VkBuffer buffer;
+  };
+
+  /// All uses of a resource by a pass, merged.
+  struct access
+  {
+    resource_t resource;
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    bool read;
+    bool write;
+  };
+
+  struct pass
+  {
+    std::string name;
+    /// Site of the pass for the GPU profiler and statistics, named after it.
+    profiling::zone_site_t const* site;
+    execute_fn fn;
+    std::vector< access > accesses;
+    bool culled;
+  };
+
+  struct barrier
+  {
+    resource_t resource;
+    VkPipelineStageFlags src_stages;
+    VkAccessFlags src_access;
+    VkPipelineStageFlags dst_stages;
+    VkAccessFlags dst_access;
+    VkImageLayout old_layout;
+    VkImageLayout new_layout;
+  };
+
+  /// Synchronization state of a resource while planning barriers.
+  struct sync_state
+  {
+    VkImageLayout layout;
+    /// Last write, or layout transition, and its accesses.
+    VkPipelineStageFlags write_stages;
+    VkAccessFlags write_access;
+    /// Stages and accesses the last write is visible to so far.
+    VkPipelineStageFlags visible_stages;
+    VkAccessFlags visible_access;
+    /// Reads since the last write.
+    VkPipelineStageFlags read_stages;
+  };
+
+  VkDevice m_device;
+  device_memory_allocator& m_allocator;
+  render_graph_config m_config;
+  PFN_vkCmdPipelineBarrier2KHR m_cmd_pipeline_barrier2;
+  gpu_profiler* m_profiler;
+  pipeline_statistics* m_statistics;
+  std::vector< resource_info > m_resources;
+  std::vector< pass > m_passes;
+  bool m_compiled;
+  /// Passes not culled, in order.
+  std::vector< uint32_t > m_schedule;
+  /// Imported resources the scheduled passes use.
+  std::vector< resource_t > m_used_imports;
+  /// Barriers of all batches. Batch `i`, before scheduled pass `i` or, for
+  /// the last, after all of them, is [m_batches[ i ], m_batches[ i + 1 ]).
+  std::vector< barrier > m_barriers;
+  std::vector< std::size_t > m_batches;
+  /// Memory shared by the transient resources.
+  std::vector< memory_allocation > m_memory;
+  render_graph_stats m_stats;
+
+  // Reused by `record_batch`.
+  std::vector< VkImageMemoryBarrier > m_image_barriers;
+  std::vector< VkImageMemoryBarrier2KHR > m_image_barriers2;
+
+  resource_t add_resource( resource_info&& r );
+  void declare( uint32_t pass, resource_t resource, resource_usage usage,
+                bool write );
+  /// Set `culled` on every pass.
+  void cull();
+  /**
+   * Create and bind the transient resources used by scheduled passes.
+   *
+   * @param first, last Scheduled passes between which each resource is used,
+   * or `UINT32_MAX` if not.
+   * @param predecessor Set to the resource using the same memory before each
+   * one, possibly in the previous frame.
+   */
+  void create_transients( std::vector< uint32_t > const& first,
+                          std::vector< uint32_t > const& last,
+                          std::vector< resource_t >& predecessor );
+  /// Plan `m_barriers`, as the transient resources' memory was shared.
+  void plan_barriers( std::vector< resource_t > const& predecessor );
+  /**
+   * Advance `state` over `a`, adding the barrier needed before it, if any, to
+   * `barriers`.
+   */
+  void sync( sync_state& state, access const& a, bool is_image,
+             std::vector< barrier >* barriers ) const;
+  void record_batch( VkCommandBuffer cmd, std::size_t batch );
+  void destroy_transients();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_RENDER_GRAPH_H
@@ -0,0 +1,225 @@
+#define MYENGINE_LOG_MODULE "vulkan.swapchain"
+#include "swapchain.h"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <vulkan/vulkan.hpp>
+
+#include <myengine/logging.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+VkSurfaceFormatKHR
+choose_surface_format( std::vector< VkSurfaceFormatKHR > const& formats )
+{
+  for( auto const& f : formats )
+  {
+    if( f.format == VK_FORMAT_B8G8R8A8_SRGB &&
+        f.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR )
+    {
+      return f;
+    }
+  }
+  return formats.front();
+}
+
+VkPresentModeKHR
+choose_present_mode( std::vector< VkPresentModeKHR > const& modes,
+                     VkPresentModeKHR preferred )
+{
+  if( std::find( modes.begin(), modes.end(), preferred ) != modes.end() )
+  {
+    return preferred;
+  }
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+VkExtent2D
+choose_extent( VkSurfaceCapabilitiesKHR const& caps, VkExtent2D wanted )
+{
+  // A current extent of 0xFFFFFFFF means the surface size follows the
+  // swapchain's.
+  if( caps.currentExtent.width != UINT32_MAX )
+  {
+    return caps.currentExtent;
+  }
+  return {
+    std::clamp( wanted.width, caps.minImageExtent.width,
+                caps.maxImageExtent.width ),
+    std::clamp( wanted.height, caps.minImageExtent.height,
+                caps.maxImageExtent.height ) };
+}
+
+} // namespace
+
+swapchain_support_info
+query_swapchain_support( VkPhysicalDevice device, VkSurfaceKHR surface )
+{
+  swapchain_support_info info = {};
+
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR( device, surface,
+                                             &info.capabilities );
+
+  uint32_t count;
+  vkGetPhysicalDeviceSurfaceFormatsKHR( device, surface, &count, nullptr );
+  if( count != 0 )
+  {
+    info.formats.resize( count );
+    vkGetPhysicalDeviceSurfaceFormatsKHR( device, surface, &count,
+                                          info.formats.data() );
+  }
+
+  vkGetPhysicalDeviceSurfacePresentModesKHR( device, surface, &count,
+                                             nullptr );
+  if( count != 0 )
+  {
+    info.present_modes.resize( count );
+    vkGetPhysicalDeviceSurfacePresentModesKHR( device, surface, &count,
+                                               info.present_modes.data() );
+  }
+
+  return info;
+}
+
+swapchain::swapchain( VkPhysicalDevice physical_device, VkDevice device,
+                      VkSurfaceKHR surface,
+                      std::vector< uint32_t > queue_families, VkExtent2D extent,
+                      VkPresentModeKHR present_mode, VkImageUsageFlags usage )
+  : m_physical_device( physical_device ),
+    m_device( device ),
+    m_surface( surface ),
+    m_queue_families(),
+    m_present_mode( present_mode ),
+    m_requested_usage( usage ),
+    m_swapchain( VK_NULL_HANDLE ),
+    m_format{},
+    m_extent{},
+    m_usage( 0 ),
+    m_images(),
+    m_views()
+{
+  std::set< uint32_t > unique( queue_families.begin(), queue_families.end() );
+  m_queue_families.assign( unique.begin(), unique.end() );
+  recreate( extent );
+}
+
+swapchain::~swapchain()
+{
+  destroy_views();
+  vkDestroySwapchainKHR( m_device, m_swapchain, nullptr );
+}
+
+void
+swapchain::recreate( VkExtent2D extent )
+{
+  swapchain_support_info support =
+    query_swapchain_support( m_physical_device, m_surface );
+  if( support.formats.empty() || support.present_modes.empty() )
+  {
+    throw std::runtime_error( "Surface has no formats or present modes" );
+  }
+  auto const& caps = support.capabilities;
+
+  uint32_t image_count = caps.minImageCount + 1;
+  if( caps.maxImageCount != 0 )  // 0 is no limit
+  {
+    image_count = std::min( image_count, caps.maxImageCount );
+  }
+  VkImageUsageFlags usage =
+    ( m_requested_usage & caps.supportedUsageFlags ) |
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  if( usage != ( m_requested_usage | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT ) )
+  {
+    LOGF_WARN( "Swapchain image usage {} not supported, using {}",
+               m_requested_usage, usage );
+  }
+
+  VkSwapchainCreateInfoKHR create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+  create_info.surface = m_surface;
+  create_info.minImageCount = image_count;
+  VkSurfaceFormatKHR format = choose_surface_format( support.formats );
+  create_info.imageFormat = format.format;
+  create_info.imageColorSpace = format.colorSpace;
+  create_info.imageExtent = choose_extent( caps, extent );
+  create_info.imageArrayLayers = 1;
+  create_info.imageUsage = usage;
+  if( m_queue_families.size() > 1 )
+  {
+    create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+    create_info.queueFamilyIndexCount =
+      static_cast< uint32_t >( m_queue_families.size() );
+    create_info.pQueueFamilyIndices = m_queue_families.data();
+  }
+  else
+  {
+    create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
+  create_info.preTransform = caps.currentTransform;
+  create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+  create_info.presentMode =
+    choose_present_mode( support.present_modes, m_present_mode );
+  create_info.clipped = VK_TRUE;
+  create_info.oldSwapchain = m_swapchain;
+
+  VkSwapchainKHR new_swapchain = VK_NULL_HANDLE;
+  check_result( vkCreateSwapchainKHR( m_device, &create_info, nullptr,
+                                      &new_swapchain ),
+                "create swapchain" );
+  // The old swapchain is retired either way; its images are not ours anymore.
+  destroy_views();
+  vkDestroySwapchainKHR( m_device, m_swapchain, nullptr );
+  m_swapchain = new_swapchain;
+  m_format = format;
+  m_extent = create_info.imageExtent;
+  m_usage = usage;
+
+  uint32_t count = 0;
+  check_result( vkGetSwapchainImagesKHR( m_device, m_swapchain, &count,
+                                         nullptr ),
+                "get swapchain images" );
+  m_images.resize( count );
+  check_result( vkGetSwapchainImagesKHR( m_device, m_swapchain, &count,
+                                         m_images.data() ),
+                "get swapchain images" );
+
+  m_views.reserve( count );
+  for( VkImage image : m_images )
+  {
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = m_format.format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+    VkImageView view = VK_NULL_HANDLE;
+    check_result( vkCreateImageView( m_device, &view_info, nullptr, &view ),
+                  "create swapchain image view" );
+    m_views.push_back( view );
+  }
+
+  LOGF_INFO( "Created swapchain of {} {}x{} image(s), format {}, present "
+             "mode {}", count, m_extent.width, m_extent.height,
+             vk::to_string( static_cast< vk::Format >( m_format.format ) )
+               .c_str(),
+             vk::to_string( static_cast< vk::PresentModeKHR >(
+                              create_info.presentMode ) ).c_str() );
+}
+
+void
+swapchain::destroy_views()
+{
+  for( VkImageView view : m_views )
+  {
+    vkDestroyImageView( m_device, view, nullptr );
+  }
+  m_views.clear();
+}
+
+} // namespace myengine::vulkan
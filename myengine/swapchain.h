@@ -0,0 +1,143 @@
+#ifndef MYENGINE_SWAPCHAIN_H
+#define MYENGINE_SWAPCHAIN_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine::vulkan {
+
+/// What a physical device can do when presenting to a surface.
+struct swapchain_support_info
+{
+  VkSurfaceCapabilitiesKHR capabilities;
+  std::vector< VkSurfaceFormatKHR > formats;
+  std::vector< VkPresentModeKHR > present_modes;
+};
+
+/**
+ * Query physical device swap-chain support information.
+ *
+ * @param device Physical device to query.
+ * @param surface Surface that would be presented to.
+ */
+swapchain_support_info
+MYENGINE_EXPORT
+query_swapchain_support( VkPhysicalDevice device, VkSurfaceKHR surface );
+
+/**
+ * Owner of a `VkSwapchainKHR`, its images and a view of each image.
+ *
+ * The surface format is 8 bit BGRA sRGB when available, otherwise the first
+ * one reported. The image count is one more than the minimum, so the
+ * application is not left waiting on the presentation engine to release an
+ * image.
+ *
+ * Must be destroyed before the `VkDevice` and the surface.
+ */
+class MYENGINE_EXPORT swapchain
+{
+public:
+  /**
+   * @param physical_device Device the swapchain images are for.
+   * @param device Logical device to create the swapchain on.
+   * @param surface Surface to present to.
+   * @param queue_families Families of the queues that render to and present
+   * the images. Images are shared concurrently when there is more than one
+   * distinct family.
+   * @param extent Size to use if the surface leaves it up to the swapchain,
+   * usually the window's framebuffer size.
+   * @param present_mode Preferred presentation mode; FIFO, which is always
+   * supported, if not available.
+   * @param usage Image usage. Bits the surface does not support are dropped,
+   * except for `VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT`.
+   *
+   * @throws std::runtime_error Failed to create the swapchain or image views.
+   */
+  swapchain( VkPhysicalDevice physical_device, VkDevice device,
+             VkSurfaceKHR surface, std::vector< uint32_t > queue_families,
+             VkExtent2D extent,
+             VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR,
+             VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT );
+
+  swapchain( swapchain const& ) = delete;
+  swapchain& operator=( swapchain const& ) = delete;
+
+  ~swapchain();
+
+  /**
+   * Replace the swapchain, e.g. after it went out of date or the window was
+   * resized. The old swapchain is handed to the driver for reuse.
+   *
+   * No image of the old swapchain may still be in use by the device.
+   *
+   * @throws std::runtime_error Failed to create the swapchain or image views.
+   */
+  void recreate( VkExtent2D extent );
+
+  [[nodiscard]] VkSwapchainKHR
+  handle() const
+  {
+    return m_swapchain;
+  }
+
+  [[nodiscard]] VkSurfaceFormatKHR
+  format() const
+  {
+    return m_format;
+  }
+
+  [[nodiscard]] VkExtent2D
+  extent() const
+  {
+    return m_extent;
+  }
+
+  [[nodiscard]] VkImageUsageFlags
+  usage() const
+  {
+    return m_usage;
+  }
+
+  [[nodiscard]] uint32_t
+  image_count() const
+  {
+    return static_cast< uint32_t >( m_images.size() );
+  }
+
+  [[nodiscard]] VkImage
+  image( uint32_t i ) const
+  {
+    return m_images[ i ];
+  }
+
+  [[nodiscard]] VkImageView
+  view( uint32_t i ) const
+  {
+    return m_views[ i ];
+  }
+
+private:
+  VkPhysicalDevice m_physical_device;
+  VkDevice m_device;
+  VkSurfaceKHR m_surface;
+  std::vector< uint32_t > m_queue_families;
+  VkPresentModeKHR m_present_mode;
+  VkImageUsageFlags m_requested_usage;
+
+  VkSwapchainKHR m_swapchain;
+  VkSurfaceFormatKHR m_format;
+  VkExtent2D m_extent;
+  VkImageUsageFlags m_usage;
+  std::vector< VkImage > m_images;
+  std::vector< VkImageView > m_views;
+
+  void destroy_views();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_SWAPCHAIN_H
@@ -0,0 +1,367 @@
+#include "tlsf.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace myengine {
+
+namespace {
+
+/// Index of the most significant set bit; `v` must be non-zero.
+uint32_t
+msb( uint64_t v )
+{
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanReverse64( &i, v );
+  return static_cast< uint32_t >( i );
+#else
+  return 63u - static_cast< uint32_t >( __builtin_clzll( v ) );
+#endif
+}
+
+/// Index of the least significant set bit; `v` must be non-zero.
+uint32_t
+lsb( uint64_t v )
+{
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanForward64( &i, v );
+  return static_cast< uint32_t >( i );
+#else
+  return static_cast< uint32_t >( __builtin_ctzll( v ) );
+#endif
+}
+
+uint64_t
+align_up( uint64_t v, uint64_t alignment )
+{
+  return ( v + alignment - 1 ) & ~( alignment - 1 );
+}
+
+} // namespace
+
+tlsf_allocator::tlsf_allocator( uint64_t size )
+  : m_size( size ),
+    m_ranges(),
+    m_unused(),
+    m_fl_bitmap( 0 ),
+    m_sl_bitmap(),
+    m_bins(),
+    m_used( 0 ),
+    m_allocation_count( 0 ),
+    m_free_range_count( 0 )
+{
+  if( size == 0 )
+  {
+    throw std::invalid_argument( "TLSF allocator of zero size" );
+  }
+  for( auto& level : m_bins )
+  {
+    std::fill( std::begin( level ), std::end( level ), INVALID_HANDLE );
+  }
+  handle_t const h = new_range();
+  m_ranges[ h ] = { 0, size, INVALID_HANDLE, INVALID_HANDLE, INVALID_HANDLE,
+                    INVALID_HANDLE, true };
+  insert_free( h );
+}
+
+void
+tlsf_allocator::mapping( uint64_t size, uint32_t& fl, uint32_t& sl )
+{
+  if( size < SL_COUNT )
+  {
+    // Small sizes map linearly into the first level.
+    fl = 0;
+    sl = static_cast< uint32_t >( size );
+    return;
+  }
+  uint32_t const top = msb( size );
+  sl = static_cast< uint32_t >( size >> ( top - SL_LOG2 ) ) ^ SL_COUNT;
+  fl = top - SL_LOG2 + 1;
+}
+
+tlsf_allocator::handle_t
+tlsf_allocator::find_free( uint64_t size ) const
+{
+  // Round up to the next size class, so any range in the bin found fits.
+  if( size >= SL_COUNT )
+  {
+    uint64_t const round = ( uint64_t( 1 ) << ( msb( size ) - SL_LOG2 ) ) - 1;
+    if( size > UINT64_MAX - round )
+    {
+      return INVALID_HANDLE;
+    }
+    size += round;
+  }
+  uint32_t fl, sl;
+  mapping( size, fl, sl );
+  uint32_t sl_map = m_sl_bitmap[ fl ] & ( ~0u << sl );
+  if( sl_map == 0 )
+  {
+    uint64_t const fl_map =
+      fl + 1 < FL_COUNT ? m_fl_bitmap & ( ~uint64_t( 0 ) << ( fl + 1 ) ) : 0;
+    if( fl_map == 0 )
+    {
+      return INVALID_HANDLE;
+    }
+    fl = lsb( fl_map );
+    sl_map = m_sl_bitmap[ fl ];
+  }
+  return m_bins[ fl ][ lsb( sl_map ) ];
+}
+
+tlsf_allocator::handle_t
+tlsf_allocator::allocate( uint64_t size, uint64_t alignment, uint64_t& offset )
+{
+  size = std::max< uint64_t >( size, 1 );
+  alignment = std::max< uint64_t >( alignment, 1 );
+  // Searching for the worst case padding keeps the search constant time.
+  if( size > m_size || alignment - 1 > m_size - size )
+  {
+    return INVALID_HANDLE;
+  }
+  handle_t const h = find_free( size + alignment - 1 );
+  if( h == INVALID_HANDLE )
+  {
+    return INVALID_HANDLE;
+  }
+  remove_free( h );
+
+  uint64_t const aligned = align_up( m_ranges[ h ].offset, alignment );
+  if( uint64_t const padding = aligned - m_ranges[ h ].offset; padding > 0 )
+  {
+    // Free the padding as its own range. Its previous neighbor is allocated,
+    // or it would have been merged with this one.
+    handle_t const front = new_range();
+    range& r = m_ranges[ h ];
+    m_ranges[ front ] = { r.offset, padding, r.prev_phys, h, INVALID_HANDLE,
+                          INVALID_HANDLE, true };
+    if( r.prev_phys != INVALID_HANDLE )
+    {
+      m_ranges[ r.prev_phys ].next_phys = front;
+    }
+    r.prev_phys = front;
+    r.offset = aligned;
+    r.size -= padding;
+    insert_free( front );
+  }
+  if( uint64_t const rest = m_ranges[ h ].size - size; rest > 0 )
+  {
+    handle_t const back = new_range();
+    range& r = m_ranges[ h ];
+    m_ranges[ back ] = { r.offset + size, rest, h, r.next_phys, INVALID_HANDLE,
+                         INVALID_HANDLE, true };
+    if( r.next_phys != INVALID_HANDLE )
+    {
+      m_ranges[ r.next_phys ].prev_phys = back;
+    }
+    r.next_phys = back;
+    r.size = size;
+    insert_free( back );
+  }
+
+  m_ranges[ h ].free = false;
+  m_used += size;
+  ++m_allocation_count;
+  offset = m_ranges[ h ].offset;
+  return h;
+}
+
+void
+tlsf_allocator::free( handle_t handle )
+{
+  if( handle >= m_ranges.size() || m_ranges[ handle ].free )
+  {
+    throw std::invalid_argument( "Not an allocated TLSF range" );
+  }
+  m_used -= m_ranges[ handle ].size;
+  --m_allocation_count;
+
+  handle_t h = handle;
+  if( handle_t const prev = m_ranges[ h ].prev_phys;
+      prev != INVALID_HANDLE && m_ranges[ prev ].free )
+  {
+    remove_free( prev );
+    m_ranges[ prev ].size += m_ranges[ h ].size;
+    m_ranges[ prev ].next_phys = m_ranges[ h ].next_phys;
+    if( m_ranges[ h ].next_phys != INVALID_HANDLE )
+    {
+      m_ranges[ m_ranges[ h ].next_phys ].prev_phys = prev;
+    }
+    release_range( h );
+    h = prev;
+  }
+  if( handle_t const next = m_ranges[ h ].next_phys;
+      next != INVALID_HANDLE && m_ranges[ next ].free )
+  {
+    remove_free( next );
+    m_ranges[ h ].size += m_ranges[ next ].size;
+    m_ranges[ h ].next_phys = m_ranges[ next ].next_phys;
+    if( m_ranges[ next ].next_phys != INVALID_HANDLE )
+    {
+      m_ranges[ m_ranges[ next ].next_phys ].prev_phys = h;
+    }
+    release_range( next );
+  }
+  m_ranges[ h ].free = true;
+  insert_free( h );
+}
+
+tlsf_allocator::handle_t
+tlsf_allocator::new_range()
+{
+  if( !m_unused.empty() )
+  {
+    handle_t const h = m_unused.back();
+    m_unused.pop_back();
+    return h;
+  }
+  m_ranges.emplace_back();
+  return static_cast< handle_t >( m_ranges.size() - 1 );
+}
+
+void
+tlsf_allocator::release_range( handle_t h )
+{
+  // Marked free so a stale handle is caught by `free`.
+  m_ranges[ h ].free = true;
+  m_unused.push_back( h );
+}
+
+void
+tlsf_allocator::insert_free( handle_t h )
+{
+  uint32_t fl, sl;
+  mapping( m_ranges[ h ].size, fl, sl );
+  handle_t const head = m_bins[ fl ][ sl ];
+  m_ranges[ h ].prev_free = INVALID_HANDLE;
+  m_ranges[ h ].next_free = head;
+  if( head != INVALID_HANDLE )
+  {
+    m_ranges[ head ].prev_free = h;
+  }
+  m_bins[ fl ][ sl ] = h;
+  m_sl_bitmap[ fl ] |= 1u << sl;
+  m_fl_bitmap |= uint64_t( 1 ) << fl;
+  ++m_free_range_count;
+}
+
+void
+tlsf_allocator::remove_free( handle_t h )
+{
+  range& r = m_ranges[ h ];
+  if( r.prev_free != INVALID_HANDLE )
+  {
+    m_ranges[ r.prev_free ].next_free = r.next_free;
+  }
+  else
+  {
+    uint32_t fl, sl;
+    mapping( r.size, fl, sl );
+    m_bins[ fl ][ sl ] = r.next_free;
+    if( r.next_free == INVALID_HANDLE )
+    {
+      m_sl_bitmap[ fl ] &= ~( 1u << sl );
+      if( m_sl_bitmap[ fl ] == 0 )
+      {
+        m_fl_bitmap &= ~( uint64_t( 1 ) << fl );
+      }
+    }
+  }
+  if( r.next_free != INVALID_HANDLE )
+  {
+    m_ranges[ r.next_free ].prev_free = r.prev_free;
+  }
+  r.prev_free = r.next_free = INVALID_HANDLE;
+  --m_free_range_count;
+}
+
+tlsf_allocator::statistics
+tlsf_allocator::stats() const
+{
+  statistics s = {};
+  s.size = m_size;
+  s.used = m_used;
+  s.allocation_count = m_allocation_count;
+  s.free_range_count = m_free_range_count;
+  if( m_fl_bitmap != 0 )
+  {
+    // The largest range is in the highest non-empty bin, which spans a size
+    // class; look through it.
+    uint32_t const fl = msb( m_fl_bitmap );
+    uint32_t const sl = msb( m_sl_bitmap[ fl ] );
+    for( handle_t h = m_bins[ fl ][ sl ]; h != INVALID_HANDLE;
+         h = m_ranges[ h ].next_free )
+    {
+      s.largest_free_range =
+        std::max( s.largest_free_range, m_ranges[ h ].size );
+    }
+  }
+  return s;
+}
+
+bool
+tlsf_allocator::validate() const
+{
+  // Walk the ranges in offset order from the one at 0.
+  handle_t h = INVALID_HANDLE;
+  for( handle_t i = 0; i < m_ranges.size(); ++i )
+  {
+    if( m_ranges[ i ].offset == 0 &&
+        m_ranges[ i ].prev_phys == INVALID_HANDLE &&
+        std::find( m_unused.begin(), m_unused.end(), i ) == m_unused.end() )
+    {
+      h = i;
+      break;
+    }
+  }
+  uint64_t offset = 0, used = 0;
+  uint32_t allocations = 0, free_ranges = 0;
+  bool prev_free = false;
+  handle_t prev = INVALID_HANDLE;
+  for( ; h != INVALID_HANDLE; prev = h, h = m_ranges[ h ].next_phys )
+  {
+    range const& r = m_ranges[ h ];
+    if( r.offset != offset || r.size == 0 || r.prev_phys != prev ||
+        ( r.free && prev_free ) )
+    {
+      return false;
+    }
+    offset += r.size;
+    prev_free = r.free;
+    if( !r.free )
+    {
+      used += r.size;
+      ++allocations;
+      continue;
+    }
+    ++free_ranges;
+    // It must be reachable from the head of its bin.
+    uint32_t fl, sl;
+    mapping( r.size, fl, sl );
+    if( !( m_sl_bitmap[ fl ] & ( 1u << sl ) ) ||
+        !( m_fl_bitmap & ( uint64_t( 1 ) << fl ) ) )
+    {
+      return false;
+    }
+    handle_t f = m_bins[ fl ][ sl ];
+    while( f != INVALID_HANDLE && f != h )
+    {
+      f = m_ranges[ f ].next_free;
+    }
+    if( f != h )
+    {
+      return false;
+    }
+  }
+  return offset == m_size && used == m_used &&
+         allocations == m_allocation_count &&
+         free_ranges == m_free_range_count;
+}
+
+} // namespace myengine
@@ -0,0 +1,140 @@
+#ifndef MYENGINE_TLSF_H
+#define MYENGINE_TLSF_H
+
+#include <cstdint>
+#include <vector>
+
+#include <myengine/myengine_export.h>
+
+namespace myengine {
+
+/**
+ * Two-level segregated fit (TLSF) allocator of ranges of a linear space
+ * [0, size), e.g. offsets into a `VkDeviceMemory` block. It only does the
+ * bookkeeping; nothing is read or written at the offsets.
+ *
+ * Free ranges are binned by size class: a first level per power of two and 32
+ * linear second level subdivisions of each. Non-empty bins are tracked in
+ * bitmaps, so finding a free range that is large enough, splitting it, and
+ * merging a freed range with its free neighbors all take constant time,
+ * independent of the number of ranges.
+ *
+ * Range bookkeeping lives in a vector indexed by handle, with released entries
+ * reused, so steady state allocation does not touch the heap.
+ *
+ * Not thread-safe.
+ */
+class MYENGINE_EXPORT tlsf_allocator
+{
+public:
+  typedef uint32_t handle_t;
+
+  /// Returned by `allocate` when there is no fitting free range.
+  static constexpr handle_t INVALID_HANDLE = 0xFFFFFFFFu;
+
+  struct statistics
+  {
+    uint64_t size;
+    /// Sum of allocated range sizes.
+    uint64_t used;
+    uint32_t allocation_count;
+    uint32_t free_range_count;
+    uint64_t largest_free_range;
+  };
+
+  explicit tlsf_allocator( uint64_t size );
+
+  /**
+   * Allocate a range.
+   *
+   * @param size Size of the range; 0 is treated as 1.
+   * @param alignment Required alignment of the offset, a power of two.
+   * @param [out] offset Offset of the range, if successful.
+   *
+   * @return Handle of the range, or `INVALID_HANDLE` if no free range fits.
+   */
+  [[nodiscard]] handle_t allocate( uint64_t size, uint64_t alignment,
+                                   uint64_t& offset );
+
+  /// Free a range allocated from this allocator.
+  void free( handle_t handle );
+
+  [[nodiscard]] uint64_t
+  offset( handle_t handle ) const
+  {
+    return m_ranges[ handle ].offset;
+  }
+
+  [[nodiscard]] uint64_t
+  size( handle_t handle ) const
+  {
+    return m_ranges[ handle ].size;
+  }
+
+  [[nodiscard]] uint64_t
+  capacity() const
+  {
+    return m_size;
+  }
+
+  /// If there are no allocations.
+  [[nodiscard]] bool
+  empty() const
+  {
+    return m_allocation_count == 0;
+  }
+
+  [[nodiscard]] statistics stats() const;
+
+  /**
+   * Check the internal invariants: ranges tile the space, no two free ranges
+   * are adjacent, and every free range is in the bin for its size. Linear in
+   * the number of ranges; for debugging.
+   */
+  [[nodiscard]] bool validate() const;
+
+private:
+  /// log2 of the second level subdivisions per first level.
+  static constexpr uint32_t SL_LOG2 = 5;
+  static constexpr uint32_t SL_COUNT = 1u << SL_LOG2;
+  static constexpr uint32_t FL_COUNT = 64 - SL_LOG2 + 1;
+
+  struct range
+  {
+    uint64_t offset;
+    uint64_t size;
+    /// Physical neighbors, by offset.
+    handle_t prev_phys;
+    handle_t next_phys;
+    /// Neighbors in the bin's free list, if free.
+    handle_t prev_free;
+    handle_t next_free;
+    bool free;
+  };
+
+  uint64_t m_size;
+  std::vector< range > m_ranges;
+  /// Released entries of `m_ranges`, for reuse.
+  std::vector< handle_t > m_unused;
+  /// Bit per first level with any non-empty bin.
+  uint64_t m_fl_bitmap;
+  /// Bit per non-empty second level bin, per first level.
+  uint32_t m_sl_bitmap[ FL_COUNT ];
+  /// Head of each bin's free list.
+  handle_t m_bins[ FL_COUNT ][ SL_COUNT ];
+  uint64_t m_used;
+  uint32_t m_allocation_count;
+  uint32_t m_free_range_count;
+
+  static void mapping( uint64_t size, uint32_t& fl, uint32_t& sl );
+  handle_t new_range();
+  void release_range( handle_t h );
+  void insert_free( handle_t h );
+  void remove_free( handle_t h );
+  /// A free range of at least `size`, not yet removed from its bin.
+  [[nodiscard]] handle_t find_free( uint64_t size ) const;
+};
+
+} // namespace myengine
+
+#endif //MYENGINE_TLSF_H
@@ -0,0 +1,465 @@
+#define MYENGINE_LOG_MODULE "vulkan.upload_ring"
+#include "upload_ring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#include <myengine/logging.h>
+#include <myengine/profiling.h>
+#include <myengine/vulkan.h>
+
+namespace myengine::vulkan {
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Alignment of buffer upload data in the ring.
+constexpr VkDeviceSize BUFFER_ALIGNMENT = 16;
+
+/// Alignment of image upload data in the ring for texels of `texel_size`
+/// bytes.
+VkDeviceSize
+texel_alignment( VkDeviceSize texel_size )
+{
+  if( texel_size == 0 )
+  {
+    throw std::invalid_argument( "Image upload with a texel size of 0" );
+  }
+  // Offsets must be a multiple of the texel size, and of 4 on queues without
+  // graphics or compute.
+  return std::lcm< VkDeviceSize >( texel_size, 4 );
+}
+
+} // namespace
+
+upload_ring::upload_ring( VkDevice device, device_memory_allocator& allocator,
+                          uint32_t queue_family, VkQueue queue,
+                          upload_ring_config const& config )
+  : m_device( device ),
+    m_allocator( allocator ),
+    m_queue( queue ),
+    m_config( config ),
+    m_coherent( true ),
+    m_buffer( VK_NULL_HANDLE ),
+    m_memory(),
+    m_command_pool( VK_NULL_HANDLE ),
+    m_batches(),
+    m_next_batch( 0 ),
+    m_head( 0 ),
+    m_tail( 0 ),
+    m_buffer_copies(),
+    m_image_copies(),
+    m_batch_bytes( 0 ),
+    m_batch_copy_time( 0 ),
+    m_stats(),
+    m_stats_start( steady_clock_t::now() )
+{
+  if( m_config.size == 0 )
+  {
+    throw std::runtime_error( "Upload ring size must not be 0" );
+  }
+  m_config.max_batches = std::max( 1u, m_config.max_batches );
+  try
+  {
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = m_config.size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    check_result( vkCreateBuffer( m_device, &buffer_info, nullptr, &m_buffer ),
+                  "create upload ring buffer" );
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements( m_device, m_buffer, &reqs );
+    // Write-only from the host, so uncached (write-combined) memory is fine;
+    // coherent spares the flushes.
+    m_memory = m_allocator.allocate( reqs, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     resource_kind::linear, true );
+    check_result( vkBindBufferMemory( m_device, m_buffer, m_memory.memory,
+                                      m_memory.offset ),
+                  "bind upload ring memory" );
+    VkPhysicalDeviceMemoryProperties const& mem_props =
+      m_allocator.memory_properties();
+    m_coherent = mem_props.memoryTypes[ m_memory.memory_type ].propertyFlags &
+                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                      VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+    check_result( vkCreateCommandPool( m_device, &pool_info, nullptr,
+                                       &m_command_pool ),
+                  "create upload command pool" );
+    m_batches.resize( m_config.max_batches,
+                      { VK_NULL_HANDLE, VK_NULL_HANDLE, 0, false } );
+    for( auto& b : m_batches )
+    {
+      VkCommandBufferAllocateInfo cmd_info = {};
+      cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      cmd_info.commandPool = m_command_pool;
+      cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      cmd_info.commandBufferCount = 1;
+      check_result( vkAllocateCommandBuffers( m_device, &cmd_info, &b.cmd ),
+                    "allocate upload command buffer" );
+      VkFenceCreateInfo fence_info = {};
+      fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+      check_result( vkCreateFence( m_device, &fence_info, nullptr, &b.fence ),
+                    "create upload fence" );
+    }
+  }
+  catch( ... )
+  {
+    destroy();
+    throw;
+  }
+  LOGF_DEBUG( "Upload ring of {} MiB, {} batch(es){}", to_mib( m_config.size ),
+              m_config.max_batches, m_coherent ? "" : ", non-coherent" );
+}
+
+upload_ring::~upload_ring()
+{
+  try
+  {
+    wait_idle();
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "Failed to wait for uploads: {}", e.what() );
+  }
+  destroy();
+}
+
+void
+upload_ring::destroy()
+{
+  for( auto const& b : m_batches )
+  {
+    if( b.fence != VK_NULL_HANDLE )
+    {
+      vkDestroyFence( m_device, b.fence, nullptr );
+    }
+  }
+  m_batches.clear();
+  if( m_command_pool != VK_NULL_HANDLE )
+  {
+    vkDestroyCommandPool( m_device, m_command_pool, nullptr );
+    m_command_pool = VK_NULL_HANDLE;
+  }
+  if( m_buffer != VK_NULL_HANDLE )
+  {
+    vkDestroyBuffer( m_device, m_buffer, nullptr );
+    m_buffer = VK_NULL_HANDLE;
+  }
+  m_allocator.free( m_memory );
+  m_memory = memory_allocation();
+}
+
+bool
+upload_ring::try_upload( VkBuffer dst, VkDeviceSize dst_offset,
+                         void const* data, VkDeviceSize size )
+{
+  VkDeviceSize offset;
+  if( !stage( data, size, BUFFER_ALIGNMENT, offset ) )
+  {
+    ++m_stats.deferred;
+    return false;
+  }
+  m_buffer_copies.push_back( { dst, { offset, dst_offset, size } } );
+  return true;
+}
+
+bool
+upload_ring::try_upload( VkImage dst, VkBufferImageCopy region,
+                         void const* data, VkDeviceSize size,
+                         VkDeviceSize texel_size )
+{
+  VkDeviceSize offset;
+  if( !stage( data, size, texel_alignment( texel_size ), offset ) )
+  {
+    ++m_stats.deferred;
+    return false;
+  }
+  region.bufferOffset = offset;
+  m_image_copies.push_back( { dst, region } );
+  return true;
+}
+
+void
+upload_ring::upload( VkBuffer dst, VkDeviceSize dst_offset, void const* data,
+                     VkDeviceSize size )
+{
+  VkDeviceSize const offset = stage_or_wait( data, size, BUFFER_ALIGNMENT );
+  m_buffer_copies.push_back( { dst, { offset, dst_offset, size } } );
+}
+
+void
+upload_ring::upload( VkImage dst, VkBufferImageCopy region, void const* data,
+                     VkDeviceSize size, VkDeviceSize texel_size )
+{
+  region.bufferOffset =
+    stage_or_wait( data, size, texel_alignment( texel_size ) );
+  m_image_copies.push_back( { dst, region } );
+}
+
+bool
+upload_ring::stage( void const* data, VkDeviceSize size,
+                    VkDeviceSize alignment, VkDeviceSize& offset )
+{
+  if( size == 0 )
+  {
+    // Vulkan has no empty copies.
+    throw std::invalid_argument( "Empty upload" );
+  }
+  retire();
+  if( m_head == m_tail )
+  {
+    // Empty; start over at offset 0 so the whole ring is available.
+    m_head = m_tail = ( m_head + m_config.size - 1 ) / m_config.size *
+                      m_config.size;
+  }
+  VkDeviceSize const head = m_head % m_config.size;
+  offset = ( head + alignment - 1 ) / alignment * alignment;
+  if( offset + size > m_config.size )
+  {
+    // Skip the rest of the ring and start over at 0.
+    offset = 0;
+  }
+  uint64_t const start =
+    offset >= head ? m_head + ( offset - head ) : m_head + m_config.size - head;
+  if( start + size - m_tail > m_config.size )
+  {
+    return false;
+  }
+  auto const copy_start = steady_clock_t::now();
+  std::memcpy( static_cast< uint8_t* >( m_memory.mapped ) + offset, data,
+               size );
+  auto const copy_time = steady_clock_t::now() - copy_start;
+  m_stats.copy_time += copy_time;
+  m_batch_copy_time += copy_time;
+  m_head = start + size;
+  m_batch_bytes += size;
+  ++m_stats.uploads;
+  m_stats.bytes += size;
+  return true;
+}
+
+VkDeviceSize
+upload_ring::stage_or_wait( void const* data, VkDeviceSize size,
+                            VkDeviceSize alignment )
+{
+  if( size > m_config.size )
+  {
+    throw std::invalid_argument( "Upload larger than the upload ring" );
+  }
+  VkDeviceSize offset;
+  while( !stage( data, size, alignment, offset ) )
+  {
+    // What is queued may be all that fills the ring.
+    if( !wait_oldest() )
+    {
+      submit();
+    }
+  }
+  return offset;
+}
+
+void
+upload_ring::submit( VkSemaphore signal )
+{
+  if( m_buffer_copies.empty() && m_image_copies.empty() &&
+      signal == VK_NULL_HANDLE )
+  {
+    return;
+  }
+  PROFILE_FUNCTION();
+  batch& b = m_batches[ m_next_batch ];
+  if( b.in_flight )
+  {
+    // Every batch slot is busy; the oldest is this one.
+    wait_oldest();
+  }
+
+  if( !m_coherent )
+  {
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = m_memory.memory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    check_result( vkFlushMappedMemoryRanges( m_device, 1, &range ),
+                  "flush upload ring" );
+  }
+
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  check_result( vkBeginCommandBuffer( b.cmd, &begin_info ),
+                "begin upload command buffer" );
+  // One copy command per run of copies into the same destination.
+  std::vector< VkBufferCopy > regions;
+  for( std::size_t i = 0; i < m_buffer_copies.size(); )
+  {
+    regions.clear();
+    std::size_t j = i;
+    for( ; j < m_buffer_copies.size() &&
+           m_buffer_copies[ j ].dst == m_buffer_copies[ i ].dst; ++j )
+    {
+      regions.push_back( m_buffer_copies[ j ].region );
+    }
+    vkCmdCopyBuffer( b.cmd, m_buffer, m_buffer_copies[ i ].dst,
+                     static_cast< uint32_t >( regions.size() ),
+                     regions.data() );
+    i = j;
+  }
+  for( auto const& c : m_image_copies )
+  {
+    vkCmdCopyBufferToImage( b.cmd, m_buffer, c.dst,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                            &c.region );
+  }
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  vkCmdPipelineBarrier( b.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0,
+                        nullptr, 0, nullptr );
+  check_result( vkEndCommandBuffer( b.cmd ), "record upload command buffer" );
+
+  VkSubmitInfo submit_info = {};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &b.cmd;
+  if( signal != VK_NULL_HANDLE )
+  {
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &signal;
+  }
+  check_result( vkResetFences( m_device, 1, &b.fence ), "reset upload fence" );
+  check_result( vkQueueSubmit( m_queue, 1, &submit_info, b.fence ),
+                "submit uploads" );
+  b.end = m_head;
+  b.in_flight = true;
+  m_next_batch = ( m_next_batch + 1 ) % m_config.max_batches;
+  m_buffer_copies.clear();
+  m_image_copies.clear();
+  ++m_stats.batches;
+
+  PROFILE_COUNTER( "upload_batch_bytes", m_batch_bytes );
+  // Host copy bandwidth into the ring, as in `log_summary`; the GPU side of
+  // the transfer is not included.
+  double const copy_s =
+    std::chrono::duration< double >( m_batch_copy_time ).count();
+  PROFILE_COUNTER( "upload_staging_mib_per_s",
+                   copy_s > 0. ? to_mib( m_batch_bytes ) / copy_s : 0. );
+  PROFILE_COUNTER( "upload_stalls", m_stats.stalls );
+  PROFILE_COUNTER( "upload_ring_used", used() );
+  m_batch_bytes = 0;
+  m_batch_copy_time = std::chrono::nanoseconds( 0 );
+}
+
+void
+upload_ring::retire()
+{
+  for( uint32_t i = 0; i < m_config.max_batches; ++i )
+  {
+    batch& b = m_batches[ ( m_next_batch + i ) % m_config.max_batches ];
+    if( !b.in_flight )
+    {
+      continue;
+    }
+    VkResult const res = vkGetFenceStatus( m_device, b.fence );
+    if( res == VK_NOT_READY )
+    {
+      // Batches complete in order; later ones are not done either.
+      return;
+    }
+    check_result( res, "get upload fence status" );
+    b.in_flight = false;
+    // A batch without data may end before a reset of an empty ring.
+    m_tail = std::max( m_tail, b.end );
+  }
+}
+
+bool
+upload_ring::wait_oldest()
+{
+  for( uint32_t i = 0; i < m_config.max_batches; ++i )
+  {
+    batch& b = m_batches[ ( m_next_batch + i ) % m_config.max_batches ];
+    if( !b.in_flight )
+    {
+      continue;
+    }
+    PROFILE_ZONE( "upload_ring::stall" );
+    auto const start = steady_clock_t::now();
+    check_result( vkWaitForFences( m_device, 1, &b.fence, VK_TRUE, UINT64_MAX ),
+                  "wait for uploads" );
+    ++m_stats.stalls;
+    m_stats.stall_time += steady_clock_t::now() - start;
+    retire();
+    return true;
+  }
+  return false;
+}
+
+void
+upload_ring::wait_idle()
+{
+  // Not a stall: nothing is waiting for space.
+  std::vector< VkFence > fences;
+  for( auto const& b : m_batches )
+  {
+    if( b.in_flight )
+    {
+      fences.push_back( b.fence );
+    }
+  }
+  if( !fences.empty() )
+  {
+    check_result( vkWaitForFences( m_device,
+                                   static_cast< uint32_t >( fences.size() ),
+                                   fences.data(), VK_TRUE, UINT64_MAX ),
+                  "wait for uploads" );
+  }
+  retire();
+}
+
+upload_ring_stats
+upload_ring::stats() const
+{
+  upload_ring_stats s = m_stats;
+  s.elapsed = steady_clock_t::now() - m_stats_start;
+  return s;
+}
+
+void
+upload_ring::reset_stats()
+{
+  m_stats = upload_ring_stats();
+  m_stats_start = steady_clock_t::now();
+}
+
+void
+upload_ring::log_summary()
+{
+  upload_ring_stats const s = stats();
+  reset_stats();
+  auto const seconds = []( std::chrono::nanoseconds d ) {
+    return std::chrono::duration< double >( d ).count();
+  };
+  double const copy_s = seconds( s.copy_time );
+  double const elapsed_s = seconds( s.elapsed );
+  LOGF_INFO( "{} upload(s), {} MiB in {} batch(es): staging {} MiB/s, overall "
+             "{} MiB/s; {} stall(s) ({} ms), {} deferred",
+             s.uploads, to_mib( s.bytes ), s.batches,
+             copy_s > 0. ? to_mib( s.bytes ) / copy_s : 0.,
+             elapsed_s > 0. ? to_mib( s.bytes ) / elapsed_s : 0., s.stalls,
+             seconds( s.stall_time ) * 1000., s.deferred );
+}
+
+} // namespace myengine::vulkan
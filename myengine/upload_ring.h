@@ -0,0 +1,236 @@
+#ifndef MYENGINE_UPLOAD_RING_H
+#define MYENGINE_UPLOAD_RING_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/memory_allocator.h>
+#include <myengine/myengine_export.h>
+
+namespace myengine::vulkan {
+
+struct upload_ring_config
+{
+  /// Bytes of staging memory.
+  VkDeviceSize size = VkDeviceSize( 64 ) << 20;
+  /// Batches that may be executing at once; submitting one more waits for the
+  /// oldest. Usually frames in flight + 1.
+  uint32_t max_batches = 4;
+};
+
+/// Totals since construction or the last `reset_stats`.
+struct upload_ring_stats
+{
+  uint64_t uploads;
+  uint64_t bytes;
+  uint64_t batches;
+  /// `try_upload` calls refused for lack of space.
+  uint64_t deferred;
+  /// Times the host blocked on the GPU for space or a batch slot, and how long.
+  uint64_t stalls;
+  std::chrono::nanoseconds stall_time;
+  /// Spent copying into the staging memory.
+  std::chrono::nanoseconds copy_time;
+  /// Wall time covered.
+  std::chrono::nanoseconds elapsed;
+};
+
+/**
+ * Streams data to buffers and images through one persistently mapped,
+ * host-visible staging buffer, used as a ring.
+ *
+ * Each upload copies the data into the ring right away and queues a transfer
+ * command. `submit` records all queued commands into one command buffer and
+ * submits it as a batch, typically once per frame. Space is reclaimed as the
+ * fences of earlier batches signal, so nothing waits for an upload to finish.
+ *
+ * When the ring is full, `try_upload` refuses instead of blocking: the caller
+ * keeps the data and tries again next frame. `upload` blocks instead, waiting
+ * for the oldest batch to complete, which is counted as a stall.
+ *
+ * Each batch ends with a barrier making the transfer writes visible to all
+ * later commands on the same queue. Consumers on another queue wait on the
+ * semaphore given to `submit`; ownership transfers of exclusive resources are
+ * up to the caller.
+ *
+ * Bytes staged, staging bandwidth (MiB/s of the host copying into the ring,
+ * not including the GPU transfer), stalls and ring usage are recorded as
+ * profiling counters (`PROFILE_COUNTER`) per batch.
+ *
+ * Not thread-safe. Must be destroyed before the allocator and the `VkDevice`.
+ */
+class MYENGINE_EXPORT upload_ring
+{
+public:
+  /**
+   * @param allocator Allocates the staging memory.
+   * @param queue_family Queue family of `queue`, for the command pool.
+   * @param queue Queue batches are submitted to; any queue supporting
+   * transfers.
+   *
+   * @throws std::runtime_error Failed to create the staging buffer or the
+   * batch objects.
+   */
+  upload_ring( VkDevice device, device_memory_allocator& allocator,
+               uint32_t queue_family, VkQueue queue,
+               upload_ring_config const& config = upload_ring_config() );
+
+  upload_ring( upload_ring const& ) = delete;
+  upload_ring& operator=( upload_ring const& ) = delete;
+
+  /// Waits for all submitted batches; queued uploads are dropped.
+  ~upload_ring();
+
+  /**
+   * Stage `size` bytes for copying into `dst` at `dst_offset` with the next
+   * batch.
+   *
+   * @return False if the ring has no room until earlier batches complete;
+   * nothing was staged.
+   *
+   * @throws std::invalid_argument `size` is 0.
+   */
+  [[nodiscard]] bool try_upload( VkBuffer dst, VkDeviceSize dst_offset,
+                                 void const* data, VkDeviceSize size );
+
+  /**
+   * Stage `size` bytes of texels for copying into `dst` with the next batch.
+   * The image must be in `VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL` when the batch
+   * executes.
+   *
+   * @param region Copy region; `bufferOffset` is filled in.
+   * @param texel_size Bytes per texel (or compressed block), which the staging
+   * offset must be a multiple of.
+   *
+   * @return False if the ring has no room until earlier batches complete;
+   * nothing was staged.
+   *
+   * @throws std::invalid_argument `size` or `texel_size` is 0.
+   */
+  [[nodiscard]] bool try_upload( VkImage dst, VkBufferImageCopy region,
+                                 void const* data, VkDeviceSize size,
+                                 VkDeviceSize texel_size );
+
+  /**
+   * Like `try_upload`, but when the ring is full, submits what is queued and
+   * waits for space.
+   *
+   * @throws std::invalid_argument `size` is 0 or larger than the ring, or
+   * `texel_size` is 0.
+   * @throws std::runtime_error Submitting or waiting failed.
+   */
+  void upload( VkBuffer dst, VkDeviceSize dst_offset, void const* data,
+               VkDeviceSize size );
+
+  /// `upload` for an image, see `try_upload`.
+  void upload( VkImage dst, VkBufferImageCopy region, void const* data,
+               VkDeviceSize size, VkDeviceSize texel_size );
+
+  /**
+   * Submit the queued uploads as one batch. Does nothing if there are none and
+   * no semaphore to signal.
+   *
+   * @param signal Semaphore to signal when the batch completes, or null.
+   *
+   * @throws std::runtime_error Submission failed.
+   */
+  void submit( VkSemaphore signal = VK_NULL_HANDLE );
+
+  /// Wait for every submitted batch to complete.
+  void wait_idle();
+
+  /// Bytes staged and not yet reclaimed.
+  [[nodiscard]] VkDeviceSize
+  used() const
+  {
+    return m_head - m_tail;
+  }
+
+  [[nodiscard]] VkDeviceSize
+  capacity() const
+  {
+    return m_config.size;
+  }
+
+  [[nodiscard]] upload_ring_stats stats() const;
+
+  void reset_stats();
+
+  /// Log the stats, including staging and overall bandwidth, and reset them.
+  void log_summary();
+
+private:
+  struct batch
+  {
+    VkCommandBuffer cmd;
+    VkFence fence;
+    /// Ring position after the batch's data.
+    uint64_t end;
+    bool in_flight;
+  };
+
+  struct buffer_copy
+  {
+    VkBuffer dst;
+    VkBufferCopy region;
+  };
+
+  struct image_copy
+  {
+    VkImage dst;
+    VkBufferImageCopy region;
+  };
+
+  VkDevice m_device;
+  device_memory_allocator& m_allocator;
+  VkQueue m_queue;
+  upload_ring_config m_config;
+  bool m_coherent;
+
+  VkBuffer m_buffer;
+  memory_allocation m_memory;
+  VkCommandPool m_command_pool;
+  std::vector< batch > m_batches;
+  /// Next batch slot to submit.
+  uint32_t m_next_batch;
+
+  /// Monotonic ring positions; the offset is the position modulo the size.
+  /// [m_tail, m_head) is in use.
+  uint64_t m_head;
+  uint64_t m_tail;
+
+  std::vector< buffer_copy > m_buffer_copies;
+  std::vector< image_copy > m_image_copies;
+  /// Bytes staged for the next batch, and the time spent copying them.
+  VkDeviceSize m_batch_bytes;
+  std::chrono::nanoseconds m_batch_copy_time;
+
+  upload_ring_stats m_stats;
+  std::chrono::steady_clock::time_point m_stats_start;
+
+  /**
+   * Reserve staging space and copy the data there.
+   *
+   * @param [out] offset Offset of the data in the staging buffer.
+   * @return False if there is no room.
+   *
+   * @throws std::invalid_argument `size` is 0.
+   */
+  bool stage( void const* data, VkDeviceSize size, VkDeviceSize alignment,
+              VkDeviceSize& offset );
+  /// `stage`, submitting and waiting for space as needed.
+  VkDeviceSize stage_or_wait( void const* data, VkDeviceSize size,
+                              VkDeviceSize alignment );
+  /// Reclaim the space of completed batches, oldest first.
+  void retire();
+  /// Wait for the oldest batch in flight; false if there is none.
+  bool wait_oldest();
+  void destroy();
+};
+
+} // namespace myengine::vulkan
+
+#endif //MYENGINE_UPLOAD_RING_H
@@ -1,10 +1,11 @@
+#define MYENGINE_LOG_MODULE "vulkan"
 #include "vulkan.h"
 
-#include <cstring>
 #include <sstream>
 #include <stdexcept>
 #include <vulkan/vulkan.hpp>
 
+#include <myengine/capabilities.h>
 #include <myengine/logging.h>
 
 namespace myengine::vulkan {
@@ -12,23 +13,13 @@ namespace myengine::vulkan {
 std::vector< VkExtensionProperties >
 get_instance_extension_properties()
 {
-  uint32_t count;
-  vkEnumerateInstanceExtensionProperties( nullptr, &count, nullptr );
-
-  std::vector< VkExtensionProperties > prop_vec( count );
-  vkEnumerateInstanceExtensionProperties( nullptr, &count, prop_vec.data() );
-  return prop_vec;
+  return get_instance_capabilities().extension_properties;
 }
 
 std::vector< VkLayerProperties >
 get_instance_layer_properties()
 {
-  uint32_t count;
-  vkEnumerateInstanceLayerProperties( &count, nullptr );
-
-  std::vector< VkLayerProperties > layer_vec( count );
-  vkEnumerateInstanceLayerProperties( &count, layer_vec.data() );
-  return layer_vec;
+  return get_instance_capabilities().layer_properties;
 }
 
 bool
@@ -37,24 +28,12 @@ check_instance_extension_support(
 {
   LOG_DEBUG( "Checking availability of requested instance extensions:" );
   LOG_VECTOR( DEBUG, requested_exts );
-  auto prop_vec( get_instance_extension_properties() );
-  bool ext_found;
-  for( auto const& req_name : requested_exts )
+  char const* missing;
+  if( !get_instance_capabilities().extensions.contains_all( requested_exts,
+                                                            &missing ) )
   {
-    ext_found = false;
-    for( auto const& prop : prop_vec )
-    {
-      if( strcmp( req_name, prop.extensionName ) == 0 )
-      {
-        ext_found = true;
-        break;
-      }
-    }
-    if( !ext_found )
-    {
-      LOG_WARN( "Requested extension not available: " << req_name );
-      return false;
-    }
+    LOG_WARN( "Requested extension not available: " << missing );
+    return false;
   }
   return true;
 }
@@ -65,25 +44,13 @@ check_instance_layer_support(
 {
   LOG_DEBUG( "Checking availability of requested instance layers:" );
   LOG_VECTOR( DEBUG, requested_layers );
-  auto layer_vec{ get_instance_layer_properties() };
-  bool layer_found;
-  for( auto const& req_layer : requested_layers )
+  char const* missing;
+  if( !get_instance_capabilities().layers.contains_all( requested_layers,
+                                                        &missing ) )
   {
-    layer_found = false;
-    for( auto const& prop : layer_vec )
-    {
-      if( strcmp( req_layer, prop.layerName ) == 0 )
-      {
-        layer_found = true;
-        break;
-      }
-    }
-    if( !layer_found )
-    {
-      LOG_WARN( "Requested layer not available: " << req_layer );
-      LOG_WARN( "Check VK_LAYER_PATH?" );
-      return false;
-    }
+    LOG_WARN( "Requested layer not available: " << missing );
+    LOG_WARN( "Check VK_LAYER_PATH?" );
+    return false;
   }
   return true;
 }
@@ -96,15 +63,9 @@ get_physical_devices( VkInstance const& instance,
   vkEnumeratePhysicalDevices( instance, &device_count, nullptr );
 
   std::vector< VkPhysicalDevice > device_vec( device_count );
-  VkResult res = vkEnumeratePhysicalDevices( instance, &device_count,
-                                             device_vec.data() );
-  if( res != VK_SUCCESS )
-  {
-    std::stringstream ss;
-    ss  << "Failed to enumerate any physical devices: "
-        << vk::to_string( static_cast< vk::Result >( res ) );
-    throw std::runtime_error( ss.str() );
-  }
+  check_result( vkEnumeratePhysicalDevices( instance, &device_count,
+                                            device_vec.data() ),
+                "enumerate any physical devices" );
   if( filter != nullptr )
   {
     std::vector< VkPhysicalDevice > filtered_vec;
@@ -124,12 +85,44 @@ get_physical_devices( VkInstance const& instance,
 std::vector< VkQueueFamilyProperties >
 get_device_queue_family_properties( VkPhysicalDevice const& device )
 {
-  uint32_t count;
-  vkGetPhysicalDeviceQueueFamilyProperties( device, &count, nullptr );
+  return get_device_capabilities( device ).queue_families;
+}
+
+uint32_t
+find_memory_type( VkPhysicalDeviceMemoryProperties const& props,
+                  uint32_t type_bits, VkMemoryPropertyFlags required,
+                  VkMemoryPropertyFlags preferred )
+{
+  for( VkMemoryPropertyFlags wanted : { required | preferred, required } )
+  {
+    for( uint32_t i = 0; i < props.memoryTypeCount; ++i )
+    {
+      if( ( type_bits & ( 1u << i ) ) &&
+          ( props.memoryTypes[ i ].propertyFlags & wanted ) == wanted )
+      {
+        return i;
+      }
+    }
+  }
+  throw std::runtime_error( "No suitable memory type" );
+}
 
-  std::vector< VkQueueFamilyProperties > vec( count );
-  vkGetPhysicalDeviceQueueFamilyProperties( device, &count, vec.data() );
-  return vec;
+void
+check_result( VkResult res, char const* what )
+{
+  if( res != VK_SUCCESS )
+  {
+    std::stringstream ss;
+    ss  << "Failed to " << what << ": "
+        << vk::to_string( static_cast< vk::Result >( res ) );
+    throw std::runtime_error( ss.str() );
+  }
+}
+
+double
+to_mib( double bytes )
+{
+  return bytes / ( 1024. * 1024. );
 }
 
 } // namespace myengine::vulkan
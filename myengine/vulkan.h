@@ -17,6 +17,8 @@ typedef std::function< bool ( VkPhysicalDevice const& ) >
 /**
  * Get *all* available Vulkan global extension properties from the driver.
  *
+ * Served from the cache in `get_instance_capabilities`.
+ *
  * @returns A vector of structs for extension properties currently available
  * for Vulkan instance creation.
  */
@@ -27,6 +29,8 @@ get_instance_extension_properties();
 /**
  * Get *all* available Vulkan global layer properties from the driver.
  *
+ * Served from the cache in `get_instance_capabilities`.
+ *
  * @returns A vector of structs for layer properties currently available for
  * Vulkan instance creation.
  */
@@ -93,6 +97,9 @@ get_physical_devices( VkInstance const& instance,
 /**
  * Get an enumeration of queue family properties for the given device,
  *
+ * Served from the cache in `get_device_capabilities`; prefer using that
+ * directly to avoid the copy.
+ *
  * @param device Physical device handle to query queue families from.
  * @return Vector of `VkQueueFamilyProperties` structs. The length of this
  * vector is the returned value to `pQueueFamilyPropertyCount` when calling
@@ -102,6 +109,38 @@ std::vector< VkQueueFamilyProperties >
 MYENGINE_EXPORT
 get_device_queue_family_properties( VkPhysicalDevice const& device );
 
+/**
+ * Index of a memory type allowed by `type_bits` that has all `required`
+ * property flags, preferring one that also has the `preferred` flags.
+ *
+ * @param props Memory properties of the device, see `get_device_capabilities`.
+ * @param type_bits `VkMemoryRequirements::memoryTypeBits` of the resource.
+ *
+ * @throws std::runtime_error No such memory type.
+ */
+uint32_t
+MYENGINE_EXPORT
+find_memory_type( VkPhysicalDeviceMemoryProperties const& props,
+                  uint32_t type_bits, VkMemoryPropertyFlags required,
+                  VkMemoryPropertyFlags preferred = 0 );
+
+/**
+ * Throw if a Vulkan call did not succeed.
+ *
+ * @param res Result of the call.
+ * @param what What the call was doing, to complete "Failed to ...".
+ *
+ * @throws std::runtime_error `res` is not `VK_SUCCESS`.
+ */
+void
+MYENGINE_EXPORT
+check_result( VkResult res, char const* what );
+
+/// `bytes` in MiB, for reporting.
+[[nodiscard]] double
+MYENGINE_EXPORT
+to_mib( double bytes );
+
 } // namespace myengine::vulkan
 
 #endif //MYENGINE_VULKAN_HPP
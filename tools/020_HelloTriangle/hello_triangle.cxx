@@ -1,12 +1,13 @@
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <exception>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <optional>
-#include <set>
 #include <sstream>
 #include <string>
-#include <thread>
 #include <vector>
 
 // This defines required or otherwise include Vulkan first.
@@ -18,8 +19,23 @@
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan.hpp>
 
+#include <myengine/capabilities.h>
+#include <myengine/debug_messenger.h>
+#include <myengine/descriptor_heap.h>
+#include <myengine/device_probe.h>
+#include <myengine/frame_pacer.h>
+#include <myengine/frame_scheduler.h>
 #include <myengine/glfw.h>
+#include <myengine/gpu_profiler.h>
 #include <myengine/logging.h>
+#include <myengine/memory_allocator.h>
+#include <myengine/offscreen.h>
+#include <myengine/paths.h>
+#include <myengine/pipeline_cache.h>
+#include <myengine/pipeline_statistics.h>
+#include <myengine/profiling.h>
+#include <myengine/queues.h>
+#include <myengine/render_graph.h>
 #include <myengine/vulkan.h>
 
 struct QueueFamilyIndices
@@ -35,26 +51,6 @@ struct QueueFamilyIndices
   }
 };
 
-struct SwapChainSupportInfo
-{
-  VkSurfaceCapabilitiesKHR capabilities;
-  std::vector< VkSurfaceFormatKHR > formats;
-  std::vector< VkPresentModeKHR > present_modes;
-
-  /// Default constructor
-  SwapChainSupportInfo()
-    : capabilities{},
-      formats(),
-      present_modes()
-  {}
-
-  /// Copy Constructor
-  SwapChainSupportInfo( SwapChainSupportInfo const& other ) = default;
-
-  /// Move constructor
-  SwapChainSupportInfo( SwapChainSupportInfo&& other ) = default;
-};
-
 /**
  * Access the global static list of validation layers to be used.
  *
@@ -83,53 +79,17 @@ STATIC_DEVICE_EXTENSIONS()
   return v;
 }
 
-/**
- * Callback linkup with debug logging.
- *
- * The use of this callback at all is intended to be conditional on !NDEBUG.
- * With that, I guess "verbose" messages are on the table to be output?
- *
- * NOTE: The *real* way to go here is probably for this whole thing to take in
- * parametrization for multiple levels of verbosity for finer grain control
- * (e.g. want info+ logging, but just for validation types, etc.).
- */
-VKAPI_ATTR VkBool32 VKAPI_CALL
-vk_debug_messenger_logging_callback(
-  VkDebugUtilsMessageSeverityFlagBitsEXT msg_severity,
-  VkDebugUtilsMessageTypeFlagsEXT msg_type,
-  VkDebugUtilsMessengerCallbackDataEXT const* p_callback_data,
-  void* p_user_data )
-{
-  // ``[Verbose][type::General]`` messages look like they are extraneous.
-  // Ignoring those messages for now until informed otherwise?
-  if( ( msg_severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT ) &&
-      ( msg_type & VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT ) )
-  {
-    return VK_FALSE;
-  }
-
-  auto s_severity =
-    vk::to_string( (vk::DebugUtilsMessageSeverityFlagBitsEXT) msg_severity );
-  auto s_type =
-    vk::to_string( (vk::DebugUtilsMessageTypeFlagBitsEXT) msg_type );
-  std::cerr     << "Khronos"
-                << "[" << s_severity << "]"
-                << "[type::" << s_type << "]"
-                << "[from::" << *(std::string*) p_user_data << "]"
-                << " " << p_callback_data->pMessage << std::endl;
-  return VK_FALSE;
-}
-
 /**
  * Fill in a given create-info struct for a debug messenger given this
  * tutorial/app context.
  *
  * @param [in,out] create_info Info struct to update values of.
+ * @param sink Destination of the messages. Must outlive the messenger.
  */
 void
 vk_debug_messenger_create_info_fill(
   VkDebugUtilsMessengerCreateInfoEXT& create_info,
-  char const* originator_name )
+  myengine::vulkan::debug_message_sink& sink )
 {
   create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
   create_info.messageSeverity =
@@ -140,18 +100,17 @@ vk_debug_messenger_create_info_fill(
   create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
                             VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
                             VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-  create_info.pfnUserCallback = vk_debug_messenger_logging_callback;
-  // Arbitrary pointer to some data that is given to the above hook on call.
-  // E.g. could be a reference to the `HelloTriangleApp`.
-  // Currently, setting to something that will differentiate between creators
-  // of this structure.
-  create_info.pUserData = new std::string{ originator_name };
+  // Messages are deduplicated and rate limited by the sink before reaching
+  // the log; the sink's name differentiates between creators of this
+  // structure.
+  sink.fill_create_info( create_info );
 }
 
 /**
  * Create a new debug messenger handle for the given vulkan instance.
  *
- * This registers `vk_debug_messenger_logging_callback` for stuff.
+ * The callback is whatever `create_info` was filled with, see
+ * `vk_debug_messenger_create_info_fill`.
  *
  * @param [in] instance Vulkan instance handle to create the debug messenger
  * against.
@@ -240,6 +199,10 @@ vk_destroyDebugMessenger( VkInstance const& instance,
  *
  * @param app_name String name of the application (null-terminated UTF-8).
  * @param app_version Version uint of the application. See `VK_MAKE_VERSION`.
+ * @param debug_sink Receives debug messages emitted during instance creation
+ * and destruction (debug builds only). Must outlive the instance.
+ * @param headless Do not enable the extensions GLFW needs for a surface, and
+ * do not require GLFW to be initialized.
  *
  * @throws std::runtime_error
  *   Requested instance extension or validation layer not currently supported.
@@ -248,8 +211,11 @@ vk_destroyDebugMessenger( VkInstance const& instance,
  */
 [[nodiscard]] VkInstance
 create_vulkan_instance( char const* app_name, uint32_t app_version,
+                        myengine::vulkan::debug_message_sink& debug_sink,
+                        bool headless = false,
                         uint32_t vk_api_version = VK_API_VERSION_1_2 )
 {
+  PROFILE_FUNCTION();
   // Information about this application/engine
   VkApplicationInfo app_info = {};
   app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -281,9 +247,13 @@ create_vulkan_instance( char const* app_name, uint32_t app_version,
   // (1)(b) -- Global extensions to use in vulkan instance.
   std::vector< char const* > inst_extensions;
   // GLFW requests some extensions from vulkan to work.
-  auto glfw_extensions = myengine::glfw::glfw_get_required_vulkan_extensions();
-  inst_extensions.insert( inst_extensions.end(),
-                          glfw_extensions.begin(), glfw_extensions.end() );
+  if( !headless )
+  {
+    auto glfw_extensions =
+      myengine::glfw::glfw_get_required_vulkan_extensions();
+    inst_extensions.insert( inst_extensions.end(),
+                            glfw_extensions.begin(), glfw_extensions.end() );
+  }
 #ifndef NDEBUG
   // Add the known debugging utils extension when in debug mode.
   // - Required for registering debug messenger in (2).
@@ -299,7 +269,7 @@ create_vulkan_instance( char const* app_name, uint32_t app_version,
 #ifndef NDEBUG
   LOG_DEBUG( "Creating debug messenger specifically for the Vulkan instance." );
   VkDebugUtilsMessengerCreateInfoEXT debug_create_info = {};
-  vk_debug_messenger_create_info_fill( debug_create_info, "global" );
+  vk_debug_messenger_create_info_fill( debug_create_info, debug_sink );
 #endif
 
   // Information describing instance creation, including global
@@ -343,6 +313,7 @@ create_vulkan_instance( char const* app_name, uint32_t app_version,
 [[nodiscard]] VkSurfaceKHR
 create_vulkan_surface( VkInstance const& instance, GLFWwindow* window )
 {
+  PROFILE_FUNCTION();
   if( glfwVulkanSupported() != GLFW_TRUE )
   {
     throw std::logic_error( "GLFW did not indicate vulkan is being supported" );
@@ -375,7 +346,12 @@ create_vulkan_surface( VkInstance const& instance, GLFWwindow* window )
  *
  * TODO: Candidate for being a library utility function?
  *
+ * Without a surface (headless), presentation is not considered and the present
+ * index is the graphics index.
+ *
  * @param [in] device Physical device to query the queue properties of.
+ * @param [in] surface Surface to check presentation support for, or
+ * `VK_NULL_HANDLE`.
  * @param [out] indices Structure to set queue indices to, overwriting any
  * previous values.
  *
@@ -390,8 +366,8 @@ find_queue_families( VkPhysicalDevice const& device,
   // supports drawing
   // and presentation in the same queue for improved performance.
   // - Sure, why not.
-  auto queue_fam_props_vec =
-    myengine::vulkan::get_device_queue_family_properties( device );
+  auto const& queue_fam_props_vec =
+    myengine::vulkan::get_device_capabilities( device ).queue_families;
   bool graphics_support;
   VkBool32 present_support = false;
   VkResult vk_res;
@@ -399,11 +375,18 @@ find_queue_families( VkPhysicalDevice const& device,
   for( auto const& queue_fam_props : queue_fam_props_vec )
   {
     graphics_support = queue_fam_props.queueFlags & VK_QUEUE_GRAPHICS_BIT;
-    vk_res = vkGetPhysicalDeviceSurfaceSupportKHR( device, i, surface,
-                                                   &present_support );
-    if( vk_res != VK_SUCCESS )
+    if( surface == VK_NULL_HANDLE )
     {
-      throw std::runtime_error( vk::to_string( (vk::Result) vk_res ) );
+      present_support = graphics_support;
+    }
+    else
+    {
+      vk_res = vkGetPhysicalDeviceSurfaceSupportKHR( device, i, surface,
+                                                     &present_support );
+      if( vk_res != VK_SUCCESS )
+      {
+        throw std::runtime_error( vk::to_string( (vk::Result) vk_res ) );
+      }
     }
     // If both indices aren't already set to the same value, and both graphics
     // and surface
@@ -452,72 +435,22 @@ bool
 check_device_extensions_support( VkPhysicalDevice const& device,
                                  std::vector< char const* > const& device_extension_names )
 {
-  uint32_t extension_count;
-  vkEnumerateDeviceExtensionProperties( device, nullptr, &extension_count,
-                                        nullptr );
-
-  std::vector< VkExtensionProperties > available_extensions( extension_count );
-  vkEnumerateDeviceExtensionProperties( device, nullptr, &extension_count,
-                                        available_extensions.data() );
-
-  // Shallow copy required extension names into a set, removing reportedly
-  // available extensions from
-  // this. If all required extensions are supported, the set will end up empty.
-  std::set< std::string > required_extensions( device_extension_names.begin(),
-                                               device_extension_names.end() );
-  for( auto const& ext : available_extensions )
-  {
-    required_extensions.erase( ext.extensionName );
-  }
-  if( ! required_extensions.empty() )
+  auto const& caps = myengine::vulkan::get_device_capabilities( device );
+  bool all_supported = true;
+  for( auto const& n : device_extension_names )
   {
-    VkPhysicalDeviceProperties p = {};
-    vkGetPhysicalDeviceProperties( device, &p );
-    LOG_DEBUG(
-      "Not all extensions supported for device '" << p.deviceName << "'!" );
-    for( auto const& n : required_extensions )
+    if( !caps.extensions.contains( n ) )
     {
+      if( all_supported )
+      {
+        LOG_DEBUG( "Not all extensions supported for device '"
+                     << caps.properties.deviceName << "'!" );
+      }
       LOG_DEBUG( "\t- " << n );
+      all_supported = false;
     }
   }
-
-  return required_extensions.empty();
-}
-
-/**
- * Query physical device swap-chain support information.
- *
- * @param device Physical device to query.
- * @param surface
- */
-SwapChainSupportInfo
-query_swapchain_support( VkPhysicalDevice const& device,
-                         VkSurfaceKHR const& surface )
-{
-  SwapChainSupportInfo info;
-
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR( device, surface,
-                                             &info.capabilities );
-
-  uint32_t count;
-  vkGetPhysicalDeviceSurfaceFormatsKHR( device, surface, &count, nullptr );
-  if( count != 0 )
-  {
-    info.formats.resize( count );
-    vkGetPhysicalDeviceSurfaceFormatsKHR( device, surface, &count,
-                                          info.formats.data() );
-  }
-
-  vkGetPhysicalDeviceSurfacePresentModesKHR( device, surface, &count,
-                                             nullptr );
-  if( count != 0 )
-  {
-    info.present_modes.resize( count );
-    vkGetPhysicalDeviceSurfacePresentModesKHR( device, surface, &count,
-                                               info.present_modes.data() );
-  }
-
-  return info;
+  return all_supported;
 }
 
 /**
@@ -526,7 +459,8 @@ query_swapchain_support( VkPhysicalDevice const& device,
  * Binary selection criterion on those aspects that are 100% required.
  *
  * @param device Physical device to check suitability of.
- * @param surface Consider this surface in suitability checks.
+ * @param surface Consider this surface in suitability checks. If
+ * `VK_NULL_HANDLE` (headless), swapchain support is not required.
  * @param device_extension_names Required device extension names. This is empty
  * by default.
  *
@@ -537,8 +471,8 @@ is_suitable_device( VkPhysicalDevice const& device,
                     VkSurfaceKHR const& surface,
                     std::vector< char const* > const& device_extension_names = {} )
 {
-  VkPhysicalDeviceProperties props;
-  vkGetPhysicalDeviceProperties( device, &props );
+  auto const& props =
+    myengine::vulkan::get_device_capabilities( device ).properties;
   LOG_DEBUG(
     "Considering device (" << props.deviceID << ") '" << props.deviceName <<
       "'" );
@@ -558,10 +492,10 @@ is_suitable_device( VkPhysicalDevice const& device,
   bool extensions_supported = check_device_extensions_support( device,
                                                                device_extension_names );
 
-  bool swapchain_adequate = false;
-  if( extensions_supported )
+  bool swapchain_adequate = surface == VK_NULL_HANDLE;
+  if( extensions_supported && !swapchain_adequate )
   {
-    SwapChainSupportInfo sc_info = query_swapchain_support( device, surface );
+    auto sc_info = myengine::vulkan::query_swapchain_support( device, surface );
     swapchain_adequate =
       ( !sc_info.formats.empty() && !sc_info.present_modes.empty() );
   }
@@ -581,11 +515,8 @@ is_suitable_device( VkPhysicalDevice const& device,
 uint32_t
 score_physical_device( VkPhysicalDevice const& device )
 {
-  VkPhysicalDeviceProperties props;
-  vkGetPhysicalDeviceProperties( device, &props );
-  // Not considering features yet.
-  // VkPhysicalDeviceFeatures feats;
-  // vkGetPhysicalDeviceFeatures( device, &feats );
+  auto const& props =
+    myengine::vulkan::get_device_capabilities( device ).properties;
   LOG_DEBUG(
     "Scoring device (" << props.deviceID << ") '" << props.deviceName << "'" );
 
@@ -597,16 +528,16 @@ score_physical_device( VkPhysicalDevice const& device )
   switch( props.deviceType )
   {
     case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
-      score |= 0b1000;
+      score |= 0b10000;
       break;
     case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
-      score |= 0b0100;
+      score |= 0b01000;
       break;
     case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
-      score |= 0b0010;
+      score |= 0b00100;
       break;
     case VK_PHYSICAL_DEVICE_TYPE_CPU:
-      score |= 0b0001;
+      score |= 0b00010;
       break;
     case VK_PHYSICAL_DEVICE_TYPE_OTHER:
     default:
@@ -614,12 +545,26 @@ score_physical_device( VkPhysicalDevice const& device )
       break;
   }
 
+  // Among devices of a type, prefer those that can count the work of passes
+  // (see `myengine::vulkan::pipeline_statistics`).
+  if( myengine::vulkan::pipeline_statistics_supported( device ) )
+  {
+    score |= 0b00001;
+  }
+
   return score;
 }
 
 /**
  * Decide which physical device is to be used.
  *
+ * Devices are ranked by `score_physical_device`, computed once per device up
+ * front. If `MYENGINE_DEVICE_SELECT=probe` is set in the environment, and there
+ * is more than one suitable device, each is instead benchmarked (in parallel,
+ * results cached per device and driver, see `myengine/device_probe.h`) and
+ * ranked by its measured compute and upload rates relative to the best device,
+ * with the type score breaking ties.
+ *
  * Copy return is probably OK and performant because a VkPhysicalDevice is just
  * an opaque handle
  * (pointer).
@@ -637,6 +582,7 @@ score_physical_device( VkPhysicalDevice const& device )
 pick_physical_device( VkInstance const& instance, VkSurfaceKHR const& surface,
                       std::vector< char const* > const& device_extension_names = {} )
 {
+  PROFILE_FUNCTION();
   // Get available physical devices that pass initial hard selection criterion.
   LOG_DEBUG( "Getting suitable physical devices." );
 
@@ -658,96 +604,123 @@ pick_physical_device( VkInstance const& instance, VkSurfaceKHR const& surface,
   if( device_vec.size() > 1 )
   {
     LOG_INFO( "Found more than one suitable physical device! " );
+    struct scored_device
+    {
+      VkPhysicalDevice device;
+      double probe_score;
+      uint32_t type_score;
+    };
+    std::vector< scored_device > scored;
+    scored.reserve( device_vec.size() );
+    for( VkPhysicalDevice device : device_vec )
+    {
+      scored.push_back( { device, 0., score_physical_device( device ) } );
+    }
+
+    char const* select_mode = std::getenv( "MYENGINE_DEVICE_SELECT" );
+    if( select_mode && std::string( select_mode ) == "probe" )
+    {
+      auto results = myengine::vulkan::probe_devices(
+        device_vec, myengine::vulkan::device_probe_config(),
+        myengine::user_cache_path( "device_probe.txt" ) );
+      double max_compute = 0., max_upload = 0.;
+      for( auto const& r : results )
+      {
+        max_compute = std::max( max_compute, r.compute_gflops );
+        max_upload = std::max( max_upload, r.upload_gib_per_s );
+      }
+      // Compute matters more than uploads once assets are resident.
+      for( std::size_t i = 0; i < scored.size(); ++i )
+      {
+        if( max_compute > 0. )
+        {
+          scored[ i ].probe_score +=
+            0.75 * results[ i ].compute_gflops / max_compute;
+        }
+        if( max_upload > 0. )
+        {
+          scored[ i ].probe_score +=
+            0.25 * results[ i ].upload_gib_per_s / max_upload;
+        }
+      }
+    }
+
     // Sort available devices by score.
     std::stable_sort(
-      device_vec.begin(), device_vec.end(),
-      []( VkPhysicalDevice const& d1, VkPhysicalDevice const& d2 ) -> bool {
-        return score_physical_device( d1 ) > score_physical_device( d2 );
+      scored.begin(), scored.end(),
+      []( scored_device const& d1, scored_device const& d2 ) -> bool {
+        if( d1.probe_score != d2.probe_score )
+        {
+          return d1.probe_score > d2.probe_score;
+        }
+        return d1.type_score > d2.type_score;
       } );
+    for( std::size_t i = 0; i < scored.size(); ++i )
+    {
+      device_vec[ i ] = scored[ i ].device;
+    }
 
     // Get the name for reporting.
-    VkPhysicalDeviceProperties p = {};
-    vkGetPhysicalDeviceProperties( device_vec[ 0 ], &p );
-    LOG_INFO( "Using '" << p.deviceName << "' with the highest score." );
+    LOG_INFO( "Using '"
+                << myengine::vulkan::get_device_capabilities( device_vec[ 0 ] )
+                     .properties.deviceName
+                << "' with the highest score." );
   }
 
-  // This is a dumb initial pass. Something more should be done instead of just
-  // selecting th
-  // first one in the list.
   return device_vec[ 0 ];
 }
 
 /**
  * Create logical devices for this app.
  *
- * Create a logical device off of the given physical device, creating a queue
+ * Create a logical device off of the given physical device, creating the
+ * queues of the given layout.
  *
  * @param [in] physical_device Physical physical_device from which the logical
  * physical_device
  *   should be created.
- * @param [in] qf_indices Queried queue family indices for the given device as
- * from
- *   `find_queue_families`.
+ * @param [in] queues Queue layout for the given device as from
+ *   `myengine::vulkan::plan_queues`.
+ * @param [in] synchronization2 Enable the `synchronization2` feature, see
+ *   `myengine::vulkan::synchronization2_supported`. Its extension must be
+ *   among `device_extension_names`.
+ * @param [in] descriptor_indexing Enable the descriptor indexing features of
+ *   `myengine::vulkan::descriptor_indexing_features`.
  * @param [in] device_extension_names Vector of names of the device extensions
  * to
  *
- * @throws std::bad_optional_access If we request the index of a queue family
- * that the physical
- *    device does not support.
  * @throws std::runtime_error Failed to create the logical device.
  *
  * @returns Opaque handle to the newly created logical device.
  */
 [[nodiscard]] VkDevice
 create_logical_device( VkPhysicalDevice const& physical_device,
-                       QueueFamilyIndices const& qf_indices,
+                       myengine::vulkan::queue_layout const& queues,
+                       bool synchronization2, bool descriptor_indexing,
+                       bool pipeline_statistics,
                        std::vector< char const* > const& device_extension_names = {} )
 {
-  // Unique set of queue family indices to trigger queue creation on the
-  // device.
-  // Using a set here to automatically collapse shared index values among
-  // recorded queue family
-  // indices.
-  std::set< uint32_t > q_fam_idx_set = {
-    qf_indices.graphicsFamily.value(),
-    qf_indices.presentFamily.value() };
-  std::vector< VkDeviceQueueCreateInfo > q_create_info_vec;
-  float q_priority = 1.f;
-
-  for( uint32_t q_fam_idx : q_fam_idx_set )
-  {
-    VkDeviceQueueCreateInfo q_create_info = {};
-    q_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    q_create_info.queueFamilyIndex = q_fam_idx;
-    // Generally only need a few concurrent queues as most.
-    // Command buffers submitted to a single queue are executed ("started") in
-    // order relative to each other. Commands submitted to different queues are
-    // unordered relative to each other without explicit synchronization (see
-    // `VkSemaphore`). Can only submit to a queue from one thread at a time (or
-    // across multiple with "external" synchronization), while different
-    // threads may submit to different queues simultaneously.
-    //
-    // So far I think the intent here is that it doesn't make sense to submit
-    // to a graphics queue asynchronously (without more complicated
-    // logic/synchronization at least).
-    q_create_info.queueCount = 1;
-    // A [0, 1] (inclusive) priority value for the queue to influence the
-    // scheduling of command buffer execution. I'm interpreting that 1.0 is the
-    // maximum priority.
-    // - Just using the single float reference here is fine because
-    //   `queueCount = 1` above.
-    q_create_info.pQueuePriorities = &q_priority;
-    // Something about setting system-wide priority level of the queue by
-    // setting a `VkDeviceQueueGlobalPriorityCreateInfoEXT` to `pNext` (I see a
-    // "realtime" option in there, maybe applicable for games?).
-    q_create_info_vec.push_back( q_create_info );
-  }
+  PROFILE_FUNCTION();
+  // Command buffers submitted to a single queue are executed ("started") in
+  // order relative to each other. Commands submitted to different queues are
+  // unordered relative to each other without explicit synchronization (see
+  // `VkSemaphore`). Can only submit to a queue from one thread at a time (or
+  // across multiple with "external" synchronization), while different
+  // threads may submit to different queues simultaneously.
+  //
+  // One queue per family and role (see `myengine::vulkan::queue_layout`).
+  // Only the graphics and present queues are used for now; the app has no
+  // uploads or compute work to put on the others.
+  std::vector< VkDeviceQueueCreateInfo > const& q_create_info_vec =
+    queues.create_infos;
 
   // From Tutorial: Right now we don't need anything special, so we can simply
   // define it and leave everything to initialize to VK_FALSE.
   // We'll come back to this structure once we're about to start doing more
   // interesting things with Vulkan.
   VkPhysicalDeviceFeatures device_features = {};
+  // For counting the work of the render graph's passes.
+  device_features.pipelineStatisticsQuery = pipeline_statistics;
 
   // Creation info struct for the logical device.
   VkDeviceCreateInfo d_create_info = {};
@@ -770,6 +743,27 @@ create_logical_device( VkPhysicalDevice const& physical_device,
   d_create_info.ppEnabledExtensionNames = device_extension_names.data();
   // The features
   d_create_info.pEnabledFeatures = &device_features;
+  // Optional features, chained.
+  void* features = nullptr;
+  // For the render graph's barriers.
+  VkPhysicalDeviceSynchronization2FeaturesKHR sync2_features = {};
+  sync2_features.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+  sync2_features.synchronization2 = VK_TRUE;
+  if( synchronization2 )
+  {
+    sync2_features.pNext = features;
+    features = &sync2_features;
+  }
+  // Core in Vulkan 1.2, for the bindless descriptor heap.
+  VkPhysicalDeviceDescriptorIndexingFeatures indexing_features =
+    myengine::vulkan::descriptor_indexing_features();
+  if( descriptor_indexing )
+  {
+    indexing_features.pNext = features;
+    features = &indexing_features;
+  }
+  d_create_info.pNext = features;
 
   VkDevice logical_device = VK_NULL_HANDLE;
   VkResult res = vkCreateDevice( physical_device, &d_create_info, nullptr,
@@ -784,23 +778,42 @@ create_logical_device( VkPhysicalDevice const& physical_device,
   return logical_device;
 }
 
+/// Clear color for a frame, slowly cycling so frames are visibly presented.
+VkClearColorValue
+frame_color( uint64_t frame_number )
+{
+  float const t = static_cast< float >( frame_number % 360 ) / 360.f;
+  VkClearColorValue color = {};
+  color.float32[ 0 ] = t;
+  color.float32[ 1 ] = 0.2f;
+  color.float32[ 2 ] = 1.f - t;
+  color.float32[ 3 ] = 1.f;
+  return color;
+}
+
 /**
- * Method to sleep until a specific time point specified by the a clock.
+ * Record clearing an image to a color.
  *
- * This was investigated while experimenting with FPS-locking the main loop. I
- * wasn't successful yet because I'm dumb.
+ * Stand-in for actual rendering until there is a render pass and pipeline.
+ * Requires the image to have `VK_IMAGE_USAGE_TRANSFER_DST_BIT` and to be in
+ * `VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL`, as a render graph pass writing it as
+ * `myengine::vulkan::resource_usage::transfer_dst` finds it.
  *
- * @tparam CLOCK Clock type, usually implicitly determined.
- * @tparam DURATION Duration type, usually implicitly determined.
- * @param tp The time point to wait until.
+ * @param cmd Command buffer being recorded.
+ * @param image Swapchain image or offscreen target; its previous contents are
+ * discarded.
+ * @param color Clear color.
  */
-template< class CLOCK, class DURATION >
 void
-sleep_until( std::chrono::time_point<CLOCK, DURATION> tp )
+record_clear( VkCommandBuffer cmd, VkImage image,
+              VkClearColorValue const& color )
 {
-  using namespace std::chrono_literals;
-  std::this_thread::sleep_until(tp - 10us);
-  while( tp >= CLOCK::now() );
+  VkImageSubresourceRange range = {};
+  range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  range.levelCount = 1;
+  range.layerCount = 1;
+  vkCmdClearColorImage( cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        &color, 1, &range );
 }
 
 /*******************************************************************************
@@ -821,17 +834,37 @@ public:
     : HelloTriangleApp( 600, 800 )
   {}
 
-  explicit HelloTriangleApp( uint32_t window_height, uint32_t window_width )
+  /**
+   * @param headless_frames If not zero, render this many frames offscreen
+   * instead of opening a window; see `headlessLoop`.
+   */
+  explicit HelloTriangleApp( uint32_t window_height, uint32_t window_width,
+                             uint64_t headless_frames = 0 )
     : m_win_height( window_height ),
       m_win_width( window_width ),
+      m_headless_frames( headless_frames ),
       m_window( nullptr ),
       m_vk_instance_handle( VK_NULL_HANDLE ),
       m_vk_debug_messenger( VK_NULL_HANDLE ),
+      m_global_debug_sink( "global" ),
+      m_debug_sink( "instance" ),
       m_vk_surface( VK_NULL_HANDLE ),
       m_vk_physical_device( VK_NULL_HANDLE ),
       m_vk_logical_device( VK_NULL_HANDLE ),
       m_vk_queue_graphics( VK_NULL_HANDLE ),
-      m_vk_queue_present( VK_NULL_HANDLE )
+      m_vk_queue_present( VK_NULL_HANDLE ),
+      m_pipeline_cache(),
+      m_memory_allocator(),
+      m_render_graph(),
+      m_render_target( myengine::vulkan::render_graph::INVALID_RESOURCE ),
+      m_clear_color(),
+      m_descriptor_heap(),
+      m_gpu_profiler(),
+      m_pipeline_statistics(),
+      m_frames(),
+      m_offscreen(),
+      m_last_frame(),
+      m_pacer()
   {}
 
   ~HelloTriangleApp() = default;
@@ -839,21 +872,35 @@ public:
   void
   run()
   {
-    m_window = initGlfwWindow( m_win_width, m_win_height, APP_NAME );
-    initVulkan( m_window );
-    mainLoop();
+    if( m_headless_frames )
+    {
+      initVulkan( nullptr );
+      headlessLoop();
+    }
+    else
+    {
+      m_window = initGlfwWindow( m_win_width, m_win_height, APP_NAME );
+      initVulkan( m_window );
+      mainLoop();
+    }
     cleanUp();  // Call in destructor instead?
   }
 
 private:
   // GLFW Window Stuff
   uint32_t m_win_height, m_win_width;
+  // Frames to render without a window, 0 to use one.
+  uint64_t m_headless_frames;
   GLFWwindow* m_window;
 
   // `VkInstance` *is* a pointer: to the empty `struct VkInstance_T` type.
   VkInstance m_vk_instance_handle;
   // Optional pointer to a debug messenger. May be null.
   VkDebugUtilsMessengerEXT m_vk_debug_messenger;
+  // Destinations for debug messages from instance creation/destruction and
+  // from `m_vk_debug_messenger`, respectively.
+  myengine::vulkan::debug_message_sink m_global_debug_sink;
+  myengine::vulkan::debug_message_sink m_debug_sink;
   // Rendering service for interfacing with windowing.
   VkSurfaceKHR m_vk_surface;
   // Opaque handle to the physical device to use.
@@ -864,6 +911,33 @@ private:
   // Opaque handles for queues
   VkQueue m_vk_queue_graphics;
   VkQueue m_vk_queue_present;
+  // Persistent cache for all pipelines created on `m_vk_logical_device`.
+  std::unique_ptr< myengine::vulkan::pipeline_cache > m_pipeline_cache;
+  // Device memory for resources, such as the render graph's.
+  std::unique_ptr< myengine::vulkan::device_memory_allocator >
+    m_memory_allocator;
+  // The passes of a frame, rendering to `m_render_target`: the swapchain image
+  // or offscreen target of the frame being recorded.
+  std::unique_ptr< myengine::vulkan::render_graph > m_render_graph;
+  myengine::vulkan::render_graph::resource_t m_render_target;
+  // Color of the frame being recorded, until there is a pipeline.
+  VkClearColorValue m_clear_color;
+  // Textures and buffers of all draws, bound once per frame; draws select
+  // theirs by index with push constants.
+  std::unique_ptr< myengine::vulkan::descriptor_heap > m_descriptor_heap;
+  // GPU time of the frames and of the render graph's passes.
+  std::unique_ptr< myengine::vulkan::gpu_profiler > m_gpu_profiler;
+  // Work of the render graph's passes, if the device can count it.
+  std::unique_ptr< myengine::vulkan::pipeline_statistics >
+    m_pipeline_statistics;
+  // Swapchain and frames in flight.
+  std::unique_ptr< myengine::vulkan::frame_scheduler > m_frames;
+  // Offscreen targets and frames in flight instead, when headless.
+  std::unique_ptr< myengine::vulkan::offscreen_scheduler > m_offscreen;
+  // Pixels of the last headless frame, if they are to be written out.
+  std::vector< uint8_t > m_last_frame;
+  // Frame rate limit, if any.
+  myengine::frame_pacer m_pacer;
 
 private:
   /**
@@ -928,7 +1002,7 @@ private:
    * Tutorial: Initialize Vulkan components
    *
    * @param [in] window The GLFW window instance handle to use for Vulkan
-   * surface initialization.
+   * surface initialization, or null to render offscreen (headless).
    *
    * Post-condition: The following member variables should be defined with
    * valid handles after
@@ -938,6 +1012,14 @@ private:
    *   - `m_vk_physical_device`
    *   - `m_vk_logical_device`
    *   - `m_vk_queue_graphics`
+   *   - `m_vk_queue_present`
+   *   - `m_memory_allocator`
+   *   - `m_render_graph`
+   *   - `m_frames`, or `m_offscreen` when headless
+   *   - `m_descriptor_heap`
+   *   - `m_gpu_profiler`
+   * and, if the device supports pipeline statistics queries:
+   *   - `m_pipeline_statistics`
    * The following is optionally defined if NDEBUG is NOT defined, otherwise it
    * is null:
    *   - `m_vk_debug_messenger`
@@ -945,65 +1027,405 @@ private:
   void
   initVulkan( GLFWwindow* window )
   {
+    PROFILE_FUNCTION();
+    // Skip most capability queries when nothing changed since the last run.
+    std::string const caps_snapshot_path =
+      myengine::user_cache_path( "capabilities.bin" );
+    if( !caps_snapshot_path.empty() )
+    {
+      myengine::vulkan::load_capability_snapshot( caps_snapshot_path );
+    }
     LOG_DEBUG( "Creating application instance handle" );
+    bool const headless = window == nullptr;
     m_vk_instance_handle =
-      create_vulkan_instance( APP_NAME, VK_MAKE_VERSION( 0, 1, 0 ) );
+      create_vulkan_instance( APP_NAME, VK_MAKE_VERSION( 0, 1, 0 ),
+                              m_global_debug_sink, headless );
 #ifndef NDEBUG
     LOG_DEBUG( "Creating debug messenger." );
     VkDebugUtilsMessengerCreateInfoEXT debug_create_info = {};
-    vk_debug_messenger_create_info_fill( debug_create_info, "instance" );
+    vk_debug_messenger_create_info_fill( debug_create_info, m_debug_sink );
     m_vk_debug_messenger =
       vk_createDebugMessenger( this->m_vk_instance_handle, debug_create_info );
 #endif
-    m_vk_surface = create_vulkan_surface( m_vk_instance_handle, window );
+    if( !headless )
+    {
+      m_vk_surface = create_vulkan_surface( m_vk_instance_handle, window );
+    }
+    // Nothing is presented when headless, so no swapchain either.
+    std::vector< char const* > device_extensions;
+    if( !headless )
+    {
+      device_extensions = STATIC_DEVICE_EXTENSIONS();
+    }
     LOG_DEBUG( "Selecting physical device for use." );
     m_vk_physical_device = pick_physical_device( m_vk_instance_handle,
                                                  m_vk_surface,
-                                                 STATIC_DEVICE_EXTENSIONS() );
+                                                 device_extensions );
 
     // technically a duplicate call, see `is_suitable_device`
     LOG_DEBUG(
       "Querying queue families on final physical device for logical device creation" );
     QueueFamilyIndices qf_indices = {};
     find_queue_families( m_vk_physical_device, m_vk_surface, qf_indices );
+    if( !caps_snapshot_path.empty() &&
+        myengine::vulkan::capability_snapshot_stale() )
+    {
+      try
+      {
+        myengine::vulkan::save_capability_snapshot( caps_snapshot_path );
+      }
+      catch( std::exception const& ex )
+      {
+        LOG_WARN( "Failed to save capability snapshot: " << ex.what() );
+      }
+    }
+    auto const& device_caps =
+      myengine::vulkan::get_device_capabilities( m_vk_physical_device );
+    // Optional: lets the pipeline cache report hits.
+    bool const creation_feedback = device_caps.extensions.contains(
+      VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME );
+    if( creation_feedback )
+    {
+      device_extensions.push_back(
+        VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME );
+    }
+    // Optional: lets the render graph give every barrier its own stages.
+    bool const synchronization2 =
+      myengine::vulkan::synchronization2_supported( m_vk_physical_device );
+    if( synchronization2 )
+    {
+      device_extensions.push_back( VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME );
+    }
+    auto const queues = myengine::vulkan::plan_queues(
+      device_caps.queue_families, qf_indices.graphicsFamily.value(),
+      qf_indices.presentFamily.value() );
+    // Otherwise the descriptor heap keeps a smaller set per frame slot.
+    bool const descriptor_indexing =
+      myengine::vulkan::descriptor_indexing_supported( m_vk_physical_device );
+    // Optional: counts the work of the render graph's passes.
+    bool const pipeline_statistics =
+      myengine::vulkan::pipeline_statistics_supported( m_vk_physical_device );
     m_vk_logical_device = create_logical_device( m_vk_physical_device,
-                                                 qf_indices,
-                                                 STATIC_DEVICE_EXTENSIONS() );
+                                                 queues, synchronization2,
+                                                 descriptor_indexing,
+                                                 pipeline_statistics,
+                                                 device_extensions );
+    m_pipeline_cache = std::make_unique< myengine::vulkan::pipeline_cache >(
+      m_vk_logical_device, device_caps.properties,
+      myengine::user_cache_path( "pipeline_cache.bin" ), creation_feedback );
+
+    LOG_DEBUG( "Let's grab the logical device's queues." );
+    // When the same queue family supports both graphics *and* surface
+    // presentation, both are the same queue.
+    vkGetDeviceQueue( m_vk_logical_device, queues.graphics.family,
+                      queues.graphics.index, &m_vk_queue_graphics );
+    vkGetDeviceQueue( m_vk_logical_device, queues.present.family,
+                      queues.present.index, &m_vk_queue_present );
+
+    myengine::vulkan::memory_allocator_config allocator_config;
+    // As `create_vulkan_instance` defaults to.
+    allocator_config.api_version = VK_API_VERSION_1_2;
+    m_memory_allocator =
+      std::make_unique< myengine::vulkan::device_memory_allocator >(
+        m_vk_physical_device, m_vk_logical_device, allocator_config );
+    initRenderGraph( headless, synchronization2 );
+
+    uint32_t frames_in_flight = 0;
+    if( char const* fif = std::getenv( "MYENGINE_FRAMES_IN_FLIGHT" ) )
+    {
+      frames_in_flight =
+        static_cast< uint32_t >( std::strtoul( fif, nullptr, 10 ) );
+    }
+    // Cleared with a transfer until there is a graphics pipeline.
+    VkImageUsageFlags const image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                          VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
-    LOG_DEBUG(
-      "Let's grab the logical device's graphics/presentation queue(s)." );
-    // Hardcoded `0` here "because we're only creating a single queue from this
-    // family."
-    // - I think this is tied to the `VkDeviceQueueCreateInfo.queueCount` value
-    //   which is currently set to `1` in `create_logical_device`.
-    // - When the same queue family supports both graphics *and* surface
-    //   presentation, then only one queue is requested on the logical device.
-    //   I presume this means that, by specifying 0 to both of the following,
-    //   we're storing the same queue handle for both graphics and present?
-    //   Is that OK? The tutorial seemed to basically recommend this by stating
-    //   that we could "prefer a physical device that supports drawing and
-    //   presentation in the same queue for improved performance".
-    vkGetDeviceQueue( m_vk_logical_device,
-                      qf_indices.graphicsFamily.value(), 0,
-                      &m_vk_queue_graphics );
-    vkGetDeviceQueue( m_vk_logical_device, qf_indices.presentFamily.value(), 0,
-                      &m_vk_queue_present );
+    if( headless )
+    {
+      LOG_DEBUG( "Creating offscreen targets and frame resources." );
+      myengine::vulkan::offscreen_scheduler_config offscreen_config;
+      offscreen_config.extent = { m_win_width, m_win_height };
+      offscreen_config.image_usage = image_usage;
+      if( frames_in_flight )
+      {
+        offscreen_config.frames_in_flight = frames_in_flight;
+      }
+      // Only read back when there is somewhere to put the result.
+      myengine::vulkan::offscreen_scheduler::readback_fn readback;
+      if( std::getenv( "MYENGINE_HEADLESS_OUTPUT" ) )
+      {
+        readback = [ this ]( uint64_t frame, void const* pixels,
+                             std::size_t size ) {
+          if( frame + 1 == m_headless_frames )
+          {
+            auto const* bytes = static_cast< uint8_t const* >( pixels );
+            m_last_frame.assign( bytes, bytes + size );
+          }
+        };
+      }
+      m_offscreen = std::make_unique< myengine::vulkan::offscreen_scheduler >(
+        m_vk_physical_device, m_vk_logical_device,
+        qf_indices.graphicsFamily.value(), m_vk_queue_graphics,
+        offscreen_config, readback );
+      initDescriptorHeap( m_offscreen->frames_in_flight(),
+                          descriptor_indexing );
+      initGpuProfiler( qf_indices.graphicsFamily.value(),
+                       m_offscreen->frames_in_flight() );
+      if( pipeline_statistics )
+      {
+        initPipelineStatistics( m_offscreen->frames_in_flight() );
+      }
+      return;
+    }
+
+    LOG_DEBUG( "Creating swapchain and frame resources." );
+    myengine::vulkan::frame_scheduler_config frame_config;
+    frame_config.image_usage = image_usage;
+    if( frames_in_flight )
+    {
+      frame_config.frames_in_flight = frames_in_flight;
+    }
+    int fb_width = 0, fb_height = 0;
+    glfwGetFramebufferSize( window, &fb_width, &fb_height );
+    m_frames = std::make_unique< myengine::vulkan::frame_scheduler >(
+      m_vk_physical_device, m_vk_logical_device, m_vk_surface,
+      qf_indices.graphicsFamily.value(), m_vk_queue_graphics,
+      qf_indices.presentFamily.value(), m_vk_queue_present,
+      VkExtent2D{ static_cast< uint32_t >( fb_width ),
+                  static_cast< uint32_t >( fb_height ) },
+      frame_config );
+    initDescriptorHeap( m_frames->frames_in_flight(), descriptor_indexing );
+    initGpuProfiler( qf_indices.graphicsFamily.value(),
+                     m_frames->frames_in_flight() );
+    if( pipeline_statistics )
+    {
+      initPipelineStatistics( m_frames->frames_in_flight() );
+    }
+  }
+
+  /**
+   * Create `m_descriptor_heap`.
+   *
+   * @param descriptor_indexing The features of
+   * `myengine::vulkan::descriptor_indexing_features` are enabled.
+   */
+  void
+  initDescriptorHeap( uint32_t frames_in_flight, bool descriptor_indexing )
+  {
+    myengine::vulkan::descriptor_heap_config heap_config;
+    heap_config.frames_in_flight = frames_in_flight;
+    heap_config.descriptor_indexing = descriptor_indexing;
+    m_descriptor_heap = std::make_unique< myengine::vulkan::descriptor_heap >(
+      m_vk_physical_device, m_vk_logical_device, heap_config );
+  }
+
+  /// Create `m_gpu_profiler` for the graphics queue, timing the graph's passes.
+  void
+  initGpuProfiler( uint32_t graphics_family, uint32_t frames_in_flight )
+  {
+    myengine::vulkan::gpu_profiler_config profiler_config;
+    profiler_config.frames_in_flight = frames_in_flight;
+    m_gpu_profiler = std::make_unique< myengine::vulkan::gpu_profiler >(
+      m_vk_physical_device, m_vk_logical_device, graphics_family,
+      m_vk_queue_graphics, "GPU graphics", profiler_config );
+    m_render_graph->set_profiler( m_gpu_profiler.get() );
+  }
+
+  /**
+   * Create `m_pipeline_statistics`, counting the graph's passes. If
+   * `MYENGINE_PIPELINE_STATS` names a file, the counters of every frame are
+   * written to it as CSV.
+   */
+  void
+  initPipelineStatistics( uint32_t frames_in_flight )
+  {
+    myengine::vulkan::pipeline_statistics_config stats_config;
+    stats_config.frames_in_flight = frames_in_flight;
+    if( char const* csv = std::getenv( "MYENGINE_PIPELINE_STATS" ) )
+    {
+      stats_config.csv_path = csv;
+    }
+    m_pipeline_statistics =
+      std::make_unique< myengine::vulkan::pipeline_statistics >(
+        m_vk_logical_device, stats_config );
+    m_render_graph->set_statistics( m_pipeline_statistics.get() );
+  }
+
+  /**
+   * Build `m_render_graph`: a frame is one pass clearing the render target,
+   * until there is a pipeline.
+   *
+   * @param headless The target is an offscreen target, copied from after the
+   * graph, instead of a swapchain image to present.
+   * @param synchronization2 `VK_KHR_synchronization2` is enabled.
+   */
+  void
+  initRenderGraph( bool headless, bool synchronization2 )
+  {
+    myengine::vulkan::render_graph_config graph_config;
+    graph_config.synchronization2 = synchronization2;
+    m_render_graph = std::make_unique< myengine::vulkan::render_graph >(
+      m_vk_logical_device, *m_memory_allocator, graph_config );
+
+    // Written first at the stage the acquire semaphore is waited at.
+    myengine::vulkan::resource_state const initial = {
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TRANSFER_BIT, 0 };
+    myengine::vulkan::resource_state final = {
+      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0, 0 };
+    if( headless )
+    {
+      // Copied from by the offscreen scheduler.
+      final = { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT };
+    }
+    m_render_target = m_render_graph->import_image(
+      "target", VK_IMAGE_ASPECT_COLOR_BIT, initial, final );
+    m_render_graph
+      ->add_pass( "clear",
+                  [ this ]( VkCommandBuffer cmd,
+                            myengine::vulkan::render_graph const& graph ) {
+                    record_clear( cmd, graph.image( m_render_target ),
+                                  m_clear_color );
+                  } )
+      .write( m_render_target, myengine::vulkan::resource_usage::transfer_dst );
+    m_render_graph->compile();
+  }
+
+  /// Record the frame's passes into `cmd`, rendering to `target`.
+  void
+  recordFrame( VkCommandBuffer cmd, VkImage target, uint64_t number,
+               uint32_t slot )
+  {
+    m_gpu_profiler->begin_frame( cmd, slot );
+    if( m_pipeline_statistics )
+    {
+      m_pipeline_statistics->begin_frame( cmd, slot );
+    }
+    m_descriptor_heap->begin_frame( slot );
+    m_descriptor_heap->bind( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS );
+    m_clear_color = frame_color( number );
+    m_render_graph->set_image( m_render_target, target );
+    m_render_graph->execute( cmd );
+    if( m_pipeline_statistics )
+    {
+      m_pipeline_statistics->end_frame( cmd );
+    }
+    m_gpu_profiler->end_frame( cmd );
   }
 
   void
   mainLoop()
   {
+    // `MYENGINE_TARGET_FPS` is a frame rate or "refresh" for the monitor's
+    // refresh rate.
+    if( char const* fps = std::getenv( "MYENGINE_TARGET_FPS" ) )
+    {
+      double target = std::string( fps ) == "refresh"
+                      ? myengine::glfw::glfw_get_refresh_rate( m_window )
+                      : std::strtod( fps, nullptr );
+      LOGF_INFO( "Pacing frames to {} fps", target );
+      m_pacer.set_target_fps( target );
+    }
+
     LOG_DEBUG( "Starting main loop..." );
     while( !glfwWindowShouldClose( m_window ) )
     {
+      // Wait before polling so input is as fresh as possible when recording.
+      m_pacer.wait();
+      PROFILE_ZONE( "frame" );
       glfwPollEvents();
+      m_debug_sink.poll();
+      m_pipeline_cache->poll();
+
+      myengine::vulkan::frame_scheduler::frame frame;
+      if( !m_frames->begin_frame( frame ) )
+      {
+        continue;
+      }
+      recordFrame( frame.cmd, frame.image, frame.number, frame.slot );
+      m_frames->end_frame( frame );
+    }
+    m_frames->wait_idle();
+    m_frames->log_summary();
+    m_gpu_profiler->log_summary();
+    if( m_pipeline_statistics )
+    {
+      m_pipeline_statistics->log_summary();
     }
+    m_pacer.log_summary();
     LOG_DEBUG( "Exited main loop" );
   }
 
+  /**
+   * Render `m_headless_frames` frames offscreen as fast as the device allows.
+   *
+   * If `MYENGINE_HEADLESS_OUTPUT` names a file, the last frame is written to
+   * it as a binary PPM image.
+   */
+  void
+  headlessLoop()
+  {
+    LOGF_INFO( "Rendering {} frame(s) headless", m_headless_frames );
+    auto const start = std::chrono::steady_clock::now();
+    for( uint64_t i = 0; i < m_headless_frames; ++i )
+    {
+      PROFILE_ZONE( "frame" );
+      m_debug_sink.poll();
+      m_pipeline_cache->poll();
+
+      myengine::vulkan::offscreen_scheduler::frame frame;
+      m_offscreen->begin_frame( frame );
+      recordFrame( frame.cmd, frame.image, frame.number, frame.slot );
+      m_offscreen->end_frame( frame );
+    }
+    m_offscreen->finish();
+    double const seconds = std::chrono::duration< double >(
+      std::chrono::steady_clock::now() - start ).count();
+    LOGF_INFO( "Rendered {} frame(s) in {} s ({} fps)", m_headless_frames,
+               seconds, seconds > 0. ? m_headless_frames / seconds : 0. );
+    m_gpu_profiler->log_summary();
+    if( m_pipeline_statistics )
+    {
+      m_pipeline_statistics->log_summary();
+    }
+
+    char const* output = std::getenv( "MYENGINE_HEADLESS_OUTPUT" );
+    if( output && !m_last_frame.empty() )
+    {
+      write_ppm( output, m_last_frame, m_offscreen->extent() );
+      LOGF_INFO( "Wrote the last frame to '{}'", output );
+    }
+  }
+
+  /// Write tightly packed RGBA8 pixels as a binary PPM, dropping alpha.
+  static void
+  write_ppm( char const* path, std::vector< uint8_t > const& rgba,
+             VkExtent2D extent )
+  {
+    std::ofstream out( path, std::ios::binary );
+    out << "P6\n" << extent.width << ' ' << extent.height << "\n255\n";
+    for( std::size_t i = 0; i + 3 < rgba.size(); i += 4 )
+    {
+      out.write( reinterpret_cast< char const* >( &rgba[ i ] ), 3 );
+    }
+    if( !out )
+    {
+      throw std::runtime_error( std::string( "Failed to write " ) + path );
+    }
+  }
+
   void
   cleanUp()
   {
+    // All must go before the device; the pipeline cache saves itself.
+    m_offscreen.reset();
+    m_frames.reset();
+    m_descriptor_heap.reset();
+    m_gpu_profiler.reset();
+    m_pipeline_statistics.reset();
+    m_render_graph.reset();
+    m_memory_allocator.reset();
+    m_pipeline_cache.reset();
     if( m_vk_logical_device )
     {
       // Logical device queues are implicitly cleaned up when their respective
@@ -1028,6 +1450,7 @@ private:
       vkDestroyInstance( this->m_vk_instance_handle, nullptr );
       // physical device implicitly destroyed with instance.
       this->m_vk_physical_device = VK_NULL_HANDLE;
+      myengine::vulkan::forget_device_capabilities();
     }
     if( m_window )
     {
@@ -1042,7 +1465,17 @@ private:
 int
 main()
 {
-  HelloTriangleApp app;
+  // `MYENGINE_HEADLESS=<frames>` renders offscreen, without a window.
+  uint64_t headless_frames = 0;
+  if( char const* headless = std::getenv( "MYENGINE_HEADLESS" ) )
+  {
+    headless_frames = std::strtoull( headless, nullptr, 10 );
+  }
+  // Get pending log records out even if we go down hard.
+  myengine::logging::install_crash_handlers();
+  // Zones are recorded when run with `MYENGINE_TRACE=<trace.json>`.
+  myengine::profiling::set_thread_name( "main" );
+  HelloTriangleApp app( 600, 800, headless_frames );
   // Let's not eat exceptions for now...
   try
   {
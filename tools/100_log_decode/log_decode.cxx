@@ -0,0 +1,43 @@
+/**
+ * Decode binary log segments (see `myengine/log_binary.h`) back into the
+ * usual text log format on stdout.
+ *
+ * Usage: myengine_log_decode <segment.mlog>...
+ *
+ * Segments are decoded in the order given, so pass them in segment order
+ * (a shell glob of `<prefix>.*.mlog` sorts correctly).
+ */
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+#include <myengine/log_binary.h>
+
+int
+main( int argc, char** argv )
+{
+  if( argc < 2 )
+  {
+    std::cerr << "Usage: " << argv[ 0 ] << " <segment.mlog>..." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int ret = EXIT_SUCCESS;
+  std::size_t total = 0;
+  for( int i = 1; i < argc; ++i )
+  {
+    try
+    {
+      total += myengine::logging::decode_binary_log( argv[ i ], std::cout );
+    }
+    catch( std::exception const& ex )
+    {
+      std::cerr << "Failed to decode '" << argv[ i ] << "': " << ex.what()
+                << std::endl;
+      ret = EXIT_FAILURE;
+    }
+  }
+  std::cout.flush();
+  std::cerr << "Decoded " << total << " record(s)." << std::endl;
+  return ret;
+}
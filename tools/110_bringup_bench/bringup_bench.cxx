@@ -0,0 +1,552 @@
+/**
+ * Benchmark of Vulkan bring-up and teardown latency.
+ *
+ * Times each phase of getting from nothing to a logical device and back:
+ *   - `instance_create`: `vkCreateInstance` without layers,
+ *   - `instance_extension_properties`: `get_instance_extension_properties`,
+ *   - `physical_devices`: `get_physical_devices`,
+ *   - `queue_family_properties`: `get_device_queue_family_properties`,
+ *   - `device_create`: `vkCreateDevice` with one queue,
+ *   - `teardown`: destroying the device and instance,
+ *   - `instance_create_validation`: `vkCreateInstance` with
+ *     `VK_LAYER_KHRONOS_validation`, if that layer is installed.
+ *
+ * "Cold" samples are the first pass in a fresh process, paying for loader and
+ * ICD initialization and filling the capability caches (no capability snapshot
+ * is loaded). Each of `--cold-runs` re-runs this executable for one pass;
+ * without them the first in-process pass is the only cold sample. "Warm"
+ * samples are the in-process passes after the first; note that the instance level
+ * queries are then served from `get_instance_capabilities`.
+ *
+ * No window or surface is involved, so this runs headless and against a CPU
+ * implementation, e.g. Mesa's lavapipe:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     myengine_bringup_bench --cpu --cold-runs 10 --json bringup.json
+ *
+ * Usage: myengine_bringup_bench [--iterations N] [--cold-runs N]
+ *          [--device INDEX | --cpu] [--json PATH|-]
+ *
+ * The JSON report holds min / median / p99 / mean in microseconds per phase,
+ * for comparing runs from different commits.
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/vulkan.h>
+
+#ifdef _WIN32
+# define popen _popen
+# define pclose _pclose
+#endif
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Timed phases, in the order they run within a pass.
+enum phase : std::size_t
+{
+  INSTANCE_CREATE,
+  INSTANCE_EXTENSION_PROPERTIES,
+  PHYSICAL_DEVICES,
+  QUEUE_FAMILY_PROPERTIES,
+  DEVICE_CREATE,
+  TEARDOWN,
+  INSTANCE_CREATE_VALIDATION,
+  PHASE_COUNT
+};
+
+char const* const PHASE_NAMES[ PHASE_COUNT ] = {
+  "instance_create",
+  "instance_extension_properties",
+  "physical_devices",
+  "queue_family_properties",
+  "device_create",
+  "teardown",
+  "instance_create_validation",
+};
+
+char const* const VALIDATION_LAYER = "VK_LAYER_KHRONOS_validation";
+
+/// Nanoseconds per phase of one pass; -1 for skipped phases.
+typedef std::array< int64_t, PHASE_COUNT > sample_t;
+
+struct options
+{
+  int iterations = 50;
+  int cold_runs = 0;
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+  std::string json_path;
+  /// Run one pass and print its sample for a parent process.
+  bool child = false;
+};
+
+/// What the passes ran against, for the report.
+struct run_info
+{
+  uint32_t loader_version = 0;
+  VkPhysicalDeviceProperties device_properties = {};
+};
+
+VkInstance
+create_instance( bool validation )
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "bringup_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.apiVersion = VK_API_VERSION_1_1;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+  if( validation )
+  {
+    create_info.enabledLayerCount = 1;
+    create_info.ppEnabledLayerNames = &VALIDATION_LAYER;
+  }
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Index of the physical device to use.
+std::size_t
+select_device( std::vector< VkPhysicalDevice > const& devices, int index )
+{
+  if( index < 0 )
+  {
+    for( std::size_t i = 0; i < devices.size(); ++i )
+    {
+      VkPhysicalDeviceProperties props;
+      vkGetPhysicalDeviceProperties( devices[ i ], &props );
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return i;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return static_cast< std::size_t >( index );
+}
+
+/**
+ * Bring up and tear down once, timing each phase.
+ *
+ * @param [out] info Set from what was brought up.
+ */
+sample_t
+run_pass( options const& opts, run_info& info )
+{
+  sample_t sample;
+  sample.fill( -1 );
+  auto timed = [ &sample ]( phase p, auto&& fn ) {
+    auto start = steady_clock_t::now();
+    fn();
+    sample[ p ] = std::chrono::duration_cast< std::chrono::nanoseconds >(
+      steady_clock_t::now() - start ).count();
+  };
+
+  VkInstance instance = VK_NULL_HANDLE;
+  timed( INSTANCE_CREATE, [ & ]() { instance = create_instance( false ); } );
+  try
+  {
+    timed( INSTANCE_EXTENSION_PROPERTIES, [ & ]() {
+      (void) myengine::vulkan::get_instance_extension_properties();
+    } );
+
+    std::vector< VkPhysicalDevice > devices;
+    timed( PHYSICAL_DEVICES, [ & ]() {
+      devices = myengine::vulkan::get_physical_devices( instance );
+    } );
+    VkPhysicalDevice physical_device =
+      devices[ select_device( devices, opts.device ) ];
+
+    std::vector< VkQueueFamilyProperties > families;
+    timed( QUEUE_FAMILY_PROPERTIES, [ & ]() {
+      families =
+        myengine::vulkan::get_device_queue_family_properties( physical_device );
+    } );
+    if( families.empty() )
+    {
+      throw std::runtime_error( "Device has no queue families" );
+    }
+
+    VkDevice device = VK_NULL_HANDLE;
+    timed( DEVICE_CREATE, [ & ]() {
+      float const priority = 1.f;
+      VkDeviceQueueCreateInfo queue_info = {};
+      queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+      queue_info.queueFamilyIndex = 0;
+      queue_info.queueCount = 1;
+      queue_info.pQueuePriorities = &priority;
+      VkDeviceCreateInfo device_info = {};
+      device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+      device_info.queueCreateInfoCount = 1;
+      device_info.pQueueCreateInfos = &queue_info;
+      check_result( vkCreateDevice( physical_device, &device_info, nullptr,
+                                    &device ),
+                    "create device" );
+    } );
+
+    info.loader_version =
+      myengine::vulkan::get_instance_capabilities().api_version;
+    vkGetPhysicalDeviceProperties( physical_device, &info.device_properties );
+
+    timed( TEARDOWN, [ & ]() {
+      vkDestroyDevice( device, nullptr );
+      vkDestroyInstance( instance, nullptr );
+      myengine::vulkan::forget_device_capabilities();
+    } );
+  }
+  catch( ... )
+  {
+    vkDestroyInstance( instance, nullptr );
+    myengine::vulkan::forget_device_capabilities();
+    throw;
+  }
+
+  if( myengine::vulkan::check_instance_layer_support( { VALIDATION_LAYER } ) )
+  {
+    VkInstance validated = VK_NULL_HANDLE;
+    timed( INSTANCE_CREATE_VALIDATION,
+           [ & ]() { validated = create_instance( true ); } );
+    vkDestroyInstance( validated, nullptr );
+  }
+  return sample;
+}
+
+/// Print a sample as `sample <phase> <ns>` lines, for `read_child_sample`.
+void
+write_child_sample( sample_t const& sample, std::ostream& out )
+{
+  for( std::size_t p = 0; p < PHASE_COUNT; ++p )
+  {
+    out << "sample " << PHASE_NAMES[ p ] << ' ' << sample[ p ] << '\n';
+  }
+}
+
+/// Run this executable for one cold pass and collect its sample.
+sample_t
+run_child( std::string const& self, options const& opts )
+{
+  std::stringstream cmd;
+  cmd << '"' << self << "\" --child --device " << opts.device;
+  FILE* pipe = popen( cmd.str().c_str(), "r" );
+  if( !pipe )
+  {
+    throw std::runtime_error( "Failed to start child process" );
+  }
+  std::string output;
+  char buf[ 256 ];
+  while( std::fgets( buf, sizeof( buf ), pipe ) )
+  {
+    output += buf;
+  }
+  if( pclose( pipe ) != 0 )
+  {
+    throw std::runtime_error( "Child process failed" );
+  }
+
+  sample_t sample;
+  sample.fill( -1 );
+  std::istringstream in( output );
+  std::string tag, name;
+  int64_t ns;
+  while( in >> tag >> name >> ns )
+  {
+    for( std::size_t p = 0; p < PHASE_COUNT; ++p )
+    {
+      if( tag == "sample" && name == PHASE_NAMES[ p ] )
+      {
+        sample[ p ] = ns;
+      }
+    }
+  }
+  return sample;
+}
+
+/// Summary of one phase's samples, in microseconds.
+struct stats
+{
+  std::size_t count = 0;
+  double min = 0., median = 0., p99 = 0., mean = 0.;
+};
+
+stats
+summarize( std::vector< sample_t > const& samples, std::size_t p )
+{
+  std::vector< double > us;
+  for( sample_t const& s : samples )
+  {
+    if( s[ p ] >= 0 )
+    {
+      us.push_back( s[ p ] / 1e3 );
+    }
+  }
+  stats st;
+  st.count = us.size();
+  if( us.empty() )
+  {
+    return st;
+  }
+  std::sort( us.begin(), us.end() );
+  // Nearest-rank percentiles.
+  auto rank = [ &us ]( double q ) {
+    std::size_t r = static_cast< std::size_t >( q * us.size() + 0.999999 );
+    return us[ std::min( us.size(), std::max< std::size_t >( r, 1 ) ) - 1 ];
+  };
+  st.min = us.front();
+  st.median = rank( 0.5 );
+  st.p99 = rank( 0.99 );
+  for( double v : us )
+  {
+    st.mean += v;
+  }
+  st.mean /= us.size();
+  return st;
+}
+
+std::string
+json_string( char const* s )
+{
+  std::stringstream ss;
+  ss << '"';
+  for( ; *s; ++s )
+  {
+    unsigned char c = static_cast< unsigned char >( *s );
+    if( c == '"' || c == '\\' )
+    {
+      ss << '\\' << *s;
+    }
+    else if( c < 0x20 )
+    {
+      ss  << "\\u" << std::hex << std::setw( 4 ) << std::setfill( '0' )
+          << unsigned( c ) << std::dec;
+    }
+    else
+    {
+      ss << *s;
+    }
+  }
+  ss << '"';
+  return ss.str();
+}
+
+std::string
+version_string( uint32_t v )
+{
+  std::stringstream ss;
+  ss  << VK_VERSION_MAJOR( v ) << '.' << VK_VERSION_MINOR( v ) << '.'
+      << VK_VERSION_PATCH( v );
+  return ss.str();
+}
+
+void
+write_json_stats( std::ostream& out, stats const& st )
+{
+  out << "{\"count\": " << st.count << ", \"min_us\": " << st.min
+      << ", \"median_us\": " << st.median << ", \"p99_us\": " << st.p99
+      << ", \"mean_us\": " << st.mean << "}";
+}
+
+void
+write_json( std::ostream& out, options const& opts, run_info const& info,
+            std::vector< sample_t > const& cold,
+            std::vector< sample_t > const& warm )
+{
+  auto const& props = info.device_properties;
+  out << "{\n"
+      << "  \"benchmark\": \"bringup\",\n"
+      << "  \"format_version\": 1,\n"
+      << "  \"iterations\": " << opts.iterations << ",\n"
+      << "  \"cold_runs\": " << opts.cold_runs << ",\n"
+      << "  \"loader_version\": \"" << version_string( info.loader_version )
+      << "\",\n"
+      << "  \"device\": {\"name\": " << json_string( props.deviceName )
+      << ", \"type\": " << props.deviceType
+      << ", \"vendor_id\": " << props.vendorID
+      << ", \"device_id\": " << props.deviceID
+      << ", \"driver_version\": " << props.driverVersion
+      << ", \"api_version\": \"" << version_string( props.apiVersion )
+      << "\"},\n"
+      << "  \"phases\": {\n";
+  for( std::size_t p = 0; p < PHASE_COUNT; ++p )
+  {
+    out << "    \"" << PHASE_NAMES[ p ] << "\": {\"cold\": ";
+    write_json_stats( out, summarize( cold, p ) );
+    out << ", \"warm\": ";
+    write_json_stats( out, summarize( warm, p ) );
+    out << "}" << ( p + 1 < PHASE_COUNT ? "," : "" ) << "\n";
+  }
+  out << "  }\n"
+      << "}\n";
+}
+
+void
+print_table( std::ostream& os, std::vector< sample_t > const& cold,
+             std::vector< sample_t > const& warm )
+{
+  // Formatted separately to not leave `os` in fixed precision.
+  std::stringstream out;
+  out << std::left << std::setw( 32 ) << "phase (us)" << std::right
+      << std::setw( 12 ) << "cold med" << std::setw( 12 ) << "warm min"
+      << std::setw( 12 ) << "warm med" << std::setw( 12 ) << "warm p99"
+      << '\n' << std::fixed << std::setprecision( 1 );
+  for( std::size_t p = 0; p < PHASE_COUNT; ++p )
+  {
+    stats c = summarize( cold, p ), w = summarize( warm, p );
+    if( !c.count && !w.count )
+    {
+      out << std::left << std::setw( 32 ) << PHASE_NAMES[ p ] << std::right
+          << std::setw( 12 ) << "skipped" << '\n';
+      continue;
+    }
+    out << std::left << std::setw( 32 ) << PHASE_NAMES[ p ] << std::right
+        << std::setw( 12 ) << c.median << std::setw( 12 ) << w.min
+        << std::setw( 12 ) << w.median << std::setw( 12 ) << w.p99 << '\n';
+  }
+  os << out.str();
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--iterations N] [--cold-runs N] [--device INDEX | --cpu]"
+               " [--json PATH|-]" << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--iterations" && has_value )
+      {
+        opts.iterations = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cold-runs" && has_value )
+      {
+        opts.cold_runs = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::stoi( argv[ ++i ] );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else if( arg == "--json" && has_value )
+      {
+        opts.json_path = argv[ ++i ];
+      }
+      else if( arg == "--child" )
+      {
+        opts.child = true;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    run_info info;
+    if( opts.child )
+    {
+      write_child_sample( run_pass( opts, info ), std::cout );
+      return EXIT_SUCCESS;
+    }
+
+    std::vector< sample_t > cold, warm;
+    for( int i = 0; i < opts.cold_runs; ++i )
+    {
+      cold.push_back( run_child( argv[ 0 ], opts ) );
+    }
+    for( int i = 0; i < opts.iterations; ++i )
+    {
+      sample_t sample = run_pass( opts, info );
+      if( i > 0 )
+      {
+        warm.push_back( sample );
+      }
+      else if( opts.cold_runs == 0 )
+      {
+        cold.push_back( sample );
+      }
+      // Else the first pass is only a warm-up, child processes gave the cold
+      // samples.
+    }
+    LOGF_INFO( "Ran {} cold and {} warm pass(es) on '{}'", cold.size(),
+               warm.size(), info.device_properties.deviceName );
+
+    // Keep stdout clean for the JSON if that goes there.
+    print_table( opts.json_path == "-" ? std::cerr : std::cout, cold, warm );
+    if( opts.json_path == "-" )
+    {
+      write_json( std::cout, opts, info, cold, warm );
+    }
+    else if( !opts.json_path.empty() )
+    {
+      std::ofstream out( opts.json_path );
+      write_json( out, opts, info, cold, warm );
+      if( !out )
+      {
+        throw std::runtime_error( "Failed to write '" + opts.json_path + "'" );
+      }
+    }
+  }
+  catch( std::exception const& ex )
+  {
+    LOG_ERROR( ex.what() );
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
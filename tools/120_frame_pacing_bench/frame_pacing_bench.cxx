@@ -0,0 +1,232 @@
+/**
+ * Benchmark of frame pacing strategies: how evenly each hits a target frame
+ * rate and how much CPU it burns doing so.
+ *
+ * Strategies:
+ *   - `sleep`: `std::this_thread::sleep_until` the deadline,
+ *   - `sleep_spin`: sleep until 10us before the deadline, then spin on the
+ *     clock (what HelloTriangle used to do),
+ *   - `pacer`: `myengine::frame_pacer`.
+ *
+ * Each frame busy-works for `--work-us` to stand in for recording. CPU time is
+ * the process CPU time over the run, as a share of the wall time; the work
+ * itself accounts for about work / interval of that.
+ *
+ * No window or GPU is involved.
+ *
+ * Usage: myengine_frame_pacing_bench [--fps N] [--frames N] [--work-us N]
+ *          [--strategy sleep|sleep_spin|pacer]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <myengine/frame_pacer.h>
+#include <myengine/logging.h>
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+struct options
+{
+  double fps = 120.;
+  int frames = 600;
+  std::chrono::microseconds work{ 2000 };
+  std::string strategy;  // All when empty.
+};
+
+struct result
+{
+  double mean_interval_us;
+  double p99_deviation_us;
+  double max_deviation_us;
+  double cpu_fraction;
+};
+
+void
+busy_work( std::chrono::microseconds d )
+{
+  auto const end = steady_clock_t::now() + d;
+  while( steady_clock_t::now() < end );
+}
+
+/// Run one strategy; `wait( deadline )` waits for the given frame start.
+template< class WAIT >
+result
+run( options const& opts, WAIT wait )
+{
+  auto const interval = std::chrono::duration_cast< steady_clock_t::duration >(
+    std::chrono::duration< double >( 1. / opts.fps ) );
+  std::vector< steady_clock_t::time_point > wakes;
+  wakes.reserve( opts.frames );
+
+  std::clock_t const cpu_start = std::clock();
+  auto const wall_start = steady_clock_t::now();
+  auto deadline = wall_start;
+  for( int i = 0; i < opts.frames; ++i )
+  {
+    wakes.push_back( wait( deadline ) );
+    busy_work( opts.work );
+    deadline += interval;
+  }
+  double const wall =
+    std::chrono::duration< double >( steady_clock_t::now() - wall_start )
+      .count();
+  double const cpu =
+    static_cast< double >( std::clock() - cpu_start ) / CLOCKS_PER_SEC;
+
+  result r = {};
+  std::vector< double > dev;
+  double sum = 0.;
+  for( std::size_t i = 1; i < wakes.size(); ++i )
+  {
+    double const us =
+      std::chrono::duration< double, std::micro >( wakes[ i ] - wakes[ i - 1 ] )
+        .count();
+    sum += us;
+    dev.push_back( std::abs(
+      us - std::chrono::duration< double, std::micro >( interval ).count() ) );
+  }
+  std::sort( dev.begin(), dev.end() );
+  if( !dev.empty() )
+  {
+    r.mean_interval_us = sum / dev.size();
+    std::size_t const rank =
+      static_cast< std::size_t >( std::ceil( 0.99 * dev.size() ) );
+    r.p99_deviation_us = dev[ std::max< std::size_t >( rank, 1 ) - 1 ];
+    r.max_deviation_us = dev.back();
+  }
+  r.cpu_fraction = wall > 0. ? cpu / wall : 0.;
+  return r;
+}
+
+/// The `sleep` strategy.
+steady_clock_t::time_point
+wait_sleep( steady_clock_t::time_point tp )
+{
+  std::this_thread::sleep_until( tp );
+  return steady_clock_t::now();
+}
+
+/// The `sleep_spin` strategy.
+steady_clock_t::time_point
+wait_sleep_spin( steady_clock_t::time_point tp )
+{
+  using namespace std::chrono_literals;
+  std::this_thread::sleep_until( tp - 10us );
+  auto now = steady_clock_t::now();
+  while( tp >= now )
+  {
+    now = steady_clock_t::now();
+  }
+  return now;
+}
+
+void
+print_row( std::string const& name, result const& r )
+{
+  std::cout << std::left << std::setw( 12 ) << name << std::right << std::fixed
+            << std::setprecision( 1 ) << std::setw( 12 ) << r.mean_interval_us
+            << std::setw( 12 ) << r.p99_deviation_us << std::setw( 12 )
+            << r.max_deviation_us << std::setw( 11 ) << 100. * r.cpu_fraction
+            << "%\n";
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--fps N] [--frames N] [--work-us N]"
+               " [--strategy sleep|sleep_spin|pacer]" << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--fps" && has_value )
+      {
+        opts.fps = std::stod( argv[ ++i ] );
+      }
+      else if( arg == "--frames" && has_value )
+      {
+        opts.frames = std::max( 2, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--work-us" && has_value )
+      {
+        opts.work = std::chrono::microseconds(
+          std::max( 0, std::stoi( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--strategy" && has_value )
+      {
+        opts.strategy = argv[ ++i ];
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  if( opts.fps <= 0. || ( !opts.strategy.empty() && opts.strategy != "sleep" &&
+                          opts.strategy != "sleep_spin" &&
+                          opts.strategy != "pacer" ) )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  LOGF_INFO( "{} frame(s) at {} fps with {} us of work each", opts.frames,
+             opts.fps, opts.work.count() );
+  std::cout << std::left << std::setw( 12 ) << "strategy" << std::right
+            << std::setw( 12 ) << "mean us" << std::setw( 12 ) << "p99 dev us"
+            << std::setw( 12 ) << "max dev us" << std::setw( 12 ) << "CPU"
+            << '\n';
+  auto const wanted = [ &opts ]( char const* name ) {
+    return opts.strategy.empty() || opts.strategy == name;
+  };
+
+  if( wanted( "sleep" ) )
+  {
+    print_row( "sleep", run( opts, wait_sleep ) );
+  }
+  if( wanted( "sleep_spin" ) )
+  {
+    print_row( "sleep_spin", run( opts, wait_sleep_spin ) );
+  }
+  if( wanted( "pacer" ) )
+  {
+    myengine::frame_pacer_config config;
+    config.target_fps = opts.fps;
+    myengine::frame_pacer pacer( config );
+    // The pacer keeps its own schedule at the same rate.
+    print_row( "pacer", run( opts, [ &pacer ]( auto ) {
+      return pacer.wait();
+    } ) );
+    pacer.log_summary();
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,533 @@
+/**
+ * Benchmark of device memory allocation: a `VkDeviceMemory` per resource
+ * against sub-allocation with `myengine::vulkan::device_memory_allocator`.
+ *
+ * One random workload of allocations and frees, sizes log-uniform between
+ * `--min-size` and `--max-size` and alignments of 256 B to 64 KiB, is replayed
+ * against each strategy:
+ *   - `tlsf`: `myengine::tlsf_allocator` alone over a 1 GiB space, CPU only;
+ *     its placement cost without any Vulkan call,
+ *   - `raw`: `vkAllocateMemory` / `vkFreeMemory` per allocation,
+ *   - `suballocator`: `device_memory_allocator::allocate` / `free`.
+ * The Vulkan strategies keep at most half of `maxMemoryAllocationCount` alive
+ * for `raw` to stay within it; sub-allocation has no such limit.
+ *
+ * With `--verify`, the `tlsf` run also checks that every range is aligned and
+ * overlaps no other live range, and validates the allocator's invariants
+ * periodically and after freeing everything. The process exits with failure
+ * if any check fails.
+ *
+ * `--no-gpu` skips the Vulkan strategies. They need no window or surface, so
+ * they also run against a CPU implementation:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     myengine_allocator_bench --cpu
+ *
+ * Usage: myengine_allocator_bench [--ops N] [--live N] [--min-size BYTES]
+ *          [--max-size BYTES] [--seed N] [--verify] [--no-gpu]
+ *          [--device INDEX | --cpu]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/memory_allocator.h>
+#include <myengine/tlsf.h>
+#include <myengine/vulkan.h>
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Vulkan version the instance is created for.
+constexpr uint32_t API_VERSION = VK_API_VERSION_1_1;
+
+/// Address space of the `tlsf` strategy.
+constexpr uint64_t TLSF_SPACE = uint64_t( 1 ) << 30;
+
+struct options
+{
+  int ops = 100000;
+  int live = 2000;
+  uint64_t min_size = 256;
+  uint64_t max_size = 1 << 20;
+  unsigned seed = 1;
+  bool verify = false;
+  bool gpu = true;
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+};
+
+/// One step of the workload: allocate slot `slot`, or free it.
+struct op
+{
+  bool allocate;
+  uint32_t slot;
+  uint64_t size;
+  uint64_t alignment;
+};
+
+struct result
+{
+  double allocate_ns = 0.;
+  double free_ns = 0.;
+  uint64_t failures = 0;
+  /// Most `VkDeviceMemory` objects alive at once, or 0 for none.
+  uint32_t peak_memory_objects = 0;
+};
+
+/**
+ * Random workload that grows to about `live` allocations, then alternates
+ * between allocating and freeing, and finally frees what is left.
+ */
+std::vector< op >
+make_workload( options const& opts, int live )
+{
+  std::mt19937_64 rng( opts.seed );
+  std::uniform_real_distribution< double > log_size(
+    std::log( double( opts.min_size ) ), std::log( double( opts.max_size ) ) );
+  std::uniform_int_distribution< int > alignment_log2( 8, 16 );
+  std::vector< op > ops;
+  ops.reserve( opts.ops + live );
+  std::vector< uint32_t > alive;
+  uint32_t next_slot = 0;
+  for( int i = 0; i < opts.ops; ++i )
+  {
+    bool const grow = static_cast< int >( alive.size() ) < live / 2 ||
+                      ( static_cast< int >( alive.size() ) < live &&
+                        rng() % 2 == 0 );
+    if( grow || alive.empty() )
+    {
+      op o = { true, next_slot++,
+               static_cast< uint64_t >( std::exp( log_size( rng ) ) ),
+               uint64_t( 1 ) << alignment_log2( rng ) };
+      alive.push_back( o.slot );
+      ops.push_back( o );
+    }
+    else
+    {
+      std::size_t const k = rng() % alive.size();
+      ops.push_back( { false, alive[ k ], 0, 0 } );
+      alive[ k ] = alive.back();
+      alive.pop_back();
+    }
+  }
+  for( uint32_t slot : alive )
+  {
+    ops.push_back( { false, slot, 0, 0 } );
+  }
+  return ops;
+}
+
+/**
+ * Replay a workload, timing each call.
+ *
+ * @param alloc `bool( op const& )`, false on failure.
+ * @param free `void( uint32_t slot )`, only called for successful slots.
+ */
+template< class ALLOC, class FREE >
+result
+replay( std::vector< op > const& ops, ALLOC alloc, FREE free )
+{
+  result r;
+  std::vector< bool > allocated;
+  uint64_t allocations = 0, frees = 0;
+  steady_clock_t::duration allocate_time{}, free_time{};
+  for( op const& o : ops )
+  {
+    if( o.allocate )
+    {
+      auto const start = steady_clock_t::now();
+      bool const ok = alloc( o );
+      allocate_time += steady_clock_t::now() - start;
+      ++allocations;
+      if( allocated.size() <= o.slot )
+      {
+        allocated.resize( o.slot + 1, false );
+      }
+      allocated[ o.slot ] = ok;
+      r.failures += ok ? 0 : 1;
+    }
+    else if( allocated[ o.slot ] )
+    {
+      auto const start = steady_clock_t::now();
+      free( o.slot );
+      free_time += steady_clock_t::now() - start;
+      ++frees;
+      allocated[ o.slot ] = false;
+    }
+  }
+  auto const ns = []( steady_clock_t::duration d, uint64_t n ) {
+    return n ? std::chrono::duration< double, std::nano >( d ).count() / n : 0.;
+  };
+  r.allocate_ns = ns( allocate_time, allocations );
+  r.free_ns = ns( free_time, frees );
+  return r;
+}
+
+/// The `tlsf` strategy; sets `ok` to false if a `--verify` check failed.
+result
+run_tlsf( options const& opts, std::vector< op > const& ops, bool& ok )
+{
+  myengine::tlsf_allocator tlsf( TLSF_SPACE );
+  std::vector< myengine::tlsf_allocator::handle_t > handles;
+  // Live ranges by offset, for the overlap check.
+  std::map< uint64_t, uint64_t > live;
+  uint64_t count = 0;
+  auto const fail = [ &ok ]( char const* what ) {
+    if( ok )
+    {
+      LOGF_ERROR( "Verification failed: {}", what );
+    }
+    ok = false;
+  };
+
+  result r = replay(
+    ops,
+    [ & ]( op const& o ) {
+      uint64_t offset;
+      auto const h = tlsf.allocate( o.size, o.alignment, offset );
+      if( handles.size() <= o.slot )
+      {
+        handles.resize( o.slot + 1, myengine::tlsf_allocator::INVALID_HANDLE );
+      }
+      handles[ o.slot ] = h;
+      if( opts.verify && h != myengine::tlsf_allocator::INVALID_HANDLE )
+      {
+        if( offset % o.alignment != 0 || offset + o.size > TLSF_SPACE )
+        {
+          fail( "misplaced range" );
+        }
+        auto const next = live.lower_bound( offset );
+        if( ( next != live.end() && next->first < offset + o.size ) ||
+            ( next != live.begin() &&
+              std::prev( next )->first + std::prev( next )->second > offset ) )
+        {
+          fail( "overlapping ranges" );
+        }
+        live[ offset ] = o.size;
+        if( ++count % 1024 == 0 && !tlsf.validate() )
+        {
+          fail( "invariants" );
+        }
+      }
+      return h != myengine::tlsf_allocator::INVALID_HANDLE;
+    },
+    [ & ]( uint32_t slot ) {
+      if( opts.verify )
+      {
+        live.erase( tlsf.offset( handles[ slot ] ) );
+      }
+      tlsf.free( handles[ slot ] );
+    } );
+
+  auto const s = tlsf.stats();
+  if( opts.verify && ( !tlsf.validate() || s.used != 0 ||
+                       s.free_range_count != 1 ||
+                       s.largest_free_range != TLSF_SPACE ) )
+  {
+    fail( "not fully coalesced after freeing everything" );
+  }
+  return r;
+}
+
+VkInstance
+create_instance()
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "allocator_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.apiVersion = API_VERSION;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Physical device to use.
+VkPhysicalDevice
+select_device( VkInstance instance, int index )
+{
+  auto const devices = myengine::vulkan::get_physical_devices( instance );
+  if( index < 0 )
+  {
+    for( VkPhysicalDevice d : devices )
+    {
+      auto const& props =
+        myengine::vulkan::get_device_capabilities( d ).properties;
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return d;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return devices[ index ];
+}
+
+/// Run the `raw` and `suballocator` strategies on a new device.
+void
+run_gpu( options const& opts,
+         void ( *print )( std::string const&, result const& ) )
+{
+  VkInstance instance = create_instance();
+  VkDevice device = VK_NULL_HANDLE;
+  try
+  {
+    VkPhysicalDevice physical_device = select_device( instance, opts.device );
+    auto const& caps =
+      myengine::vulkan::get_device_capabilities( physical_device );
+    LOGF_INFO( "Device: {}", caps.properties.deviceName );
+
+    float const priority = 1.f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = 0;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    check_result( vkCreateDevice( physical_device, &device_info, nullptr,
+                                  &device ),
+                  "create device" );
+
+    uint32_t const memory_type = myengine::vulkan::find_memory_type(
+      caps.memory_properties, ~0u, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+    int const live = std::min< int >(
+      opts.live,
+      std::max< uint32_t >( caps.properties.limits.maxMemoryAllocationCount / 2,
+                            1 ) );
+    auto const ops = make_workload( opts, live );
+
+    std::vector< VkDeviceMemory > memory;
+    uint32_t alive = 0, raw_peak = 0;
+    result raw = replay(
+      ops,
+      [ & ]( op const& o ) {
+        if( memory.size() <= o.slot )
+        {
+          memory.resize( o.slot + 1, VK_NULL_HANDLE );
+        }
+        VkMemoryAllocateInfo alloc_info = {};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = o.size;
+        alloc_info.memoryTypeIndex = memory_type;
+        bool const ok = vkAllocateMemory( device, &alloc_info, nullptr,
+                                          &memory[ o.slot ] ) == VK_SUCCESS;
+        alive += ok ? 1 : 0;
+        raw_peak = std::max( raw_peak, alive );
+        return ok;
+      },
+      [ & ]( uint32_t slot ) {
+        vkFreeMemory( device, memory[ slot ], nullptr );
+        --alive;
+      } );
+    raw.peak_memory_objects = raw_peak;
+    print( "raw", raw );
+
+    {
+      myengine::vulkan::memory_allocator_config allocator_config;
+      allocator_config.api_version = API_VERSION;
+      myengine::vulkan::device_memory_allocator allocator( physical_device,
+                                                           device,
+                                                           allocator_config );
+      std::vector< myengine::vulkan::memory_allocation > allocations;
+      uint32_t peak_allocations = 0, sub_peak = 0;
+      result sub = replay(
+        ops,
+        [ & ]( op const& o ) {
+          if( allocations.size() <= o.slot )
+          {
+            allocations.resize( o.slot + 1 );
+          }
+          VkMemoryRequirements reqs = { o.size, o.alignment,
+                                        1u << memory_type };
+          try
+          {
+            allocations[ o.slot ] = allocator.allocate( reqs, 0 );
+          }
+          catch( std::runtime_error const& e )
+          {
+            LOGF_WARN( "{}", e.what() );
+            return false;
+          }
+          auto const s = allocator.statistics();
+          sub_peak = std::max( sub_peak, s.device_memory_count );
+          if( s.allocation_count + s.dedicated_count > peak_allocations )
+          {
+            peak_allocations = s.allocation_count + s.dedicated_count;
+          }
+          return true;
+        },
+        [ & ]( uint32_t slot ) { allocator.free( allocations[ slot ] ); } );
+      sub.peak_memory_objects = sub_peak;
+      print( "suballocator", sub );
+      LOGF_INFO( "Sub-allocator peaked at {} allocation(s)", peak_allocations );
+      allocator.log_statistics();
+    }
+  }
+  catch( ... )
+  {
+    vkDestroyDevice( device, nullptr );
+    vkDestroyInstance( instance, nullptr );
+    throw;
+  }
+  vkDestroyDevice( device, nullptr );
+  vkDestroyInstance( instance, nullptr );
+}
+
+void
+print_row( std::string const& name, result const& r )
+{
+  std::cout << std::left << std::setw( 14 ) << name << std::right << std::fixed
+            << std::setprecision( 1 ) << std::setw( 14 ) << r.allocate_ns
+            << std::setw( 14 ) << r.free_ns << std::setw( 10 ) << r.failures
+            << std::setw( 12 );
+  if( r.peak_memory_objects )
+  {
+    std::cout << r.peak_memory_objects;
+  }
+  else
+  {
+    std::cout << "-";
+  }
+  std::cout << '\n';
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--ops N] [--live N] [--min-size BYTES] [--max-size BYTES]"
+               " [--seed N] [--verify] [--no-gpu] [--device INDEX | --cpu]"
+            << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--ops" && has_value )
+      {
+        opts.ops = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--live" && has_value )
+      {
+        opts.live = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--min-size" && has_value )
+      {
+        opts.min_size = std::max( 1ull, std::stoull( argv[ ++i ] ) );
+      }
+      else if( arg == "--max-size" && has_value )
+      {
+        opts.max_size = std::stoull( argv[ ++i ] );
+      }
+      else if( arg == "--seed" && has_value )
+      {
+        opts.seed = static_cast< unsigned >( std::stoul( argv[ ++i ] ) );
+      }
+      else if( arg == "--verify" )
+      {
+        opts.verify = true;
+      }
+      else if( arg == "--no-gpu" )
+      {
+        opts.gpu = false;
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  if( opts.max_size < opts.min_size )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  LOGF_INFO( "{} operation(s), up to {} live, sizes {} to {} bytes", opts.ops,
+             opts.live, opts.min_size, opts.max_size );
+  std::cout << std::left << std::setw( 14 ) << "strategy" << std::right
+            << std::setw( 14 ) << "alloc ns" << std::setw( 14 ) << "free ns"
+            << std::setw( 10 ) << "failed" << std::setw( 12 ) << "peak mem"
+            << '\n';
+
+  bool ok = true;
+  print_row( "tlsf", run_tlsf( opts, make_workload( opts, opts.live ), ok ) );
+  if( opts.verify )
+  {
+    LOGF_INFO( "Verification {}", ok ? "passed" : "FAILED" );
+  }
+  if( opts.gpu )
+  {
+    try
+    {
+      run_gpu( opts, print_row );
+    }
+    catch( std::exception const& e )
+    {
+      LOGF_ERROR( "{}", e.what() );
+      return EXIT_FAILURE;
+    }
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,456 @@
+/**
+ * Benchmark of streaming uploads: a temporary staging buffer and a blocking
+ * copy per upload, against `myengine::vulkan::upload_ring`.
+ *
+ * Each of `--frames` frames uploads `--uploads` blocks of `--size` bytes into
+ * a device-local buffer:
+ *   - `naive`: per upload, create and fill a host-visible buffer, submit a
+ *     copy and wait for the queue to go idle,
+ *   - `ring`: `try_upload` each block, carrying refused ones over to the next
+ *     frame, and submit one batch per frame,
+ *   - `ring_blocking`: `upload` each block, waiting for space when full.
+ * Bandwidth is bytes uploaded over the wall time of all frames, until the
+ * last copy completed. Stalls and deferrals are the ring's counters; every
+ * naive upload is a stall.
+ *
+ * No window or surface is involved, so this runs headless and against a CPU
+ * implementation:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     myengine_upload_bench --cpu
+ *
+ * Usage: myengine_upload_bench [--frames N] [--uploads N] [--size BYTES]
+ *          [--ring-mib N] [--strategy naive|ring|ring_blocking]
+ *          [--device INDEX | --cpu]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/memory_allocator.h>
+#include <myengine/upload_ring.h>
+#include <myengine/vulkan.h>
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Vulkan version the instance is created for.
+constexpr uint32_t API_VERSION = VK_API_VERSION_1_1;
+
+struct options
+{
+  int frames = 200;
+  int uploads = 16;
+  VkDeviceSize size = 256 * 1024;
+  VkDeviceSize ring_mib = 16;
+  std::string strategy;  // All when empty.
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+};
+
+struct result
+{
+  double seconds = 0.;
+  uint64_t bytes = 0;
+  uint64_t stalls = 0;
+  uint64_t deferred = 0;
+};
+
+/// What the strategies run on.
+struct context
+{
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t queue_family = 0;
+  VkQueue queue = VK_NULL_HANDLE;
+  myengine::vulkan::device_memory_allocator* allocator = nullptr;
+  /// Destination of every upload, `uploads * size` bytes.
+  VkBuffer target = VK_NULL_HANDLE;
+};
+
+double
+seconds_since( steady_clock_t::time_point start )
+{
+  return std::chrono::duration< double >( steady_clock_t::now() - start )
+    .count();
+}
+
+/// The `naive` strategy.
+result
+run_naive( options const& opts, context const& ctx,
+           std::vector< uint8_t > const& data )
+{
+  VkCommandPool pool = VK_NULL_HANDLE;
+  VkCommandPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  pool_info.queueFamilyIndex = ctx.queue_family;
+  check_result( vkCreateCommandPool( ctx.device, &pool_info, nullptr, &pool ),
+                "create command pool" );
+  auto const& mem_props =
+    myengine::vulkan::get_device_capabilities( ctx.physical_device )
+      .memory_properties;
+
+  result r;
+  auto const start = steady_clock_t::now();
+  for( int f = 0; f < opts.frames; ++f )
+  {
+    for( int u = 0; u < opts.uploads; ++u )
+    {
+      VkBufferCreateInfo buffer_info = {};
+      buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      buffer_info.size = opts.size;
+      buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+      buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      VkBuffer staging;
+      check_result( vkCreateBuffer( ctx.device, &buffer_info, nullptr,
+                                    &staging ),
+                    "create staging buffer" );
+      VkMemoryRequirements reqs;
+      vkGetBufferMemoryRequirements( ctx.device, staging, &reqs );
+      VkMemoryAllocateInfo alloc_info = {};
+      alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      alloc_info.allocationSize = reqs.size;
+      alloc_info.memoryTypeIndex = myengine::vulkan::find_memory_type(
+        mem_props, reqs.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+      VkDeviceMemory memory;
+      check_result( vkAllocateMemory( ctx.device, &alloc_info, nullptr,
+                                      &memory ),
+                    "allocate staging memory" );
+      check_result( vkBindBufferMemory( ctx.device, staging, memory, 0 ),
+                    "bind staging memory" );
+      void* mapped;
+      check_result( vkMapMemory( ctx.device, memory, 0, VK_WHOLE_SIZE, 0,
+                                 &mapped ),
+                    "map staging memory" );
+      std::memcpy( mapped, data.data() + u * opts.size, opts.size );
+
+      VkCommandBufferAllocateInfo cmd_info = {};
+      cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      cmd_info.commandPool = pool;
+      cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      cmd_info.commandBufferCount = 1;
+      VkCommandBuffer cmd;
+      check_result( vkAllocateCommandBuffers( ctx.device, &cmd_info, &cmd ),
+                    "allocate command buffer" );
+      VkCommandBufferBeginInfo begin_info = {};
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      check_result( vkBeginCommandBuffer( cmd, &begin_info ),
+                    "begin command buffer" );
+      VkBufferCopy region = { 0, u * opts.size, opts.size };
+      vkCmdCopyBuffer( cmd, staging, ctx.target, 1, &region );
+      check_result( vkEndCommandBuffer( cmd ), "record command buffer" );
+      VkSubmitInfo submit_info = {};
+      submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submit_info.commandBufferCount = 1;
+      submit_info.pCommandBuffers = &cmd;
+      check_result( vkQueueSubmit( ctx.queue, 1, &submit_info, VK_NULL_HANDLE ),
+                    "submit copy" );
+      check_result( vkQueueWaitIdle( ctx.queue ), "wait for copy" );
+
+      vkFreeCommandBuffers( ctx.device, pool, 1, &cmd );
+      vkDestroyBuffer( ctx.device, staging, nullptr );
+      vkFreeMemory( ctx.device, memory, nullptr );
+      r.bytes += opts.size;
+    }
+  }
+  r.seconds = seconds_since( start );
+  r.stalls = static_cast< uint64_t >( opts.frames ) * opts.uploads;
+  vkDestroyCommandPool( ctx.device, pool, nullptr );
+  return r;
+}
+
+/// The `ring` and `ring_blocking` strategies.
+result
+run_ring( options const& opts, context const& ctx,
+          std::vector< uint8_t > const& data, bool blocking )
+{
+  myengine::vulkan::upload_ring_config config;
+  config.size = opts.ring_mib << 20;
+  myengine::vulkan::upload_ring ring( ctx.device, *ctx.allocator,
+                                      ctx.queue_family, ctx.queue, config );
+  result r;
+  // Uploads refused so far, by block index, oldest first.
+  std::deque< int > backlog;
+  auto const start = steady_clock_t::now();
+  for( int f = 0; f < opts.frames; ++f )
+  {
+    for( int u = 0; u < opts.uploads; ++u )
+    {
+      backlog.push_back( u );
+    }
+    while( !backlog.empty() )
+    {
+      int const u = backlog.front();
+      if( blocking )
+      {
+        ring.upload( ctx.target, u * opts.size, data.data() + u * opts.size,
+                     opts.size );
+      }
+      else if( !ring.try_upload( ctx.target, u * opts.size,
+                                 data.data() + u * opts.size, opts.size ) )
+      {
+        // Try again next frame.
+        break;
+      }
+      backlog.pop_front();
+      r.bytes += opts.size;
+    }
+    ring.submit();
+  }
+  // Drain what is left, as the naive strategy has no backlog either.
+  for( ; !backlog.empty(); backlog.pop_front() )
+  {
+    int const u = backlog.front();
+    ring.upload( ctx.target, u * opts.size, data.data() + u * opts.size,
+                 opts.size );
+    r.bytes += opts.size;
+  }
+  ring.submit();
+  ring.wait_idle();
+  r.seconds = seconds_since( start );
+  auto const s = ring.stats();
+  r.stalls = s.stalls;
+  r.deferred = s.deferred;
+  ring.log_summary();
+  return r;
+}
+
+VkInstance
+create_instance()
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "upload_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.apiVersion = API_VERSION;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Physical device to use.
+VkPhysicalDevice
+select_device( VkInstance instance, int index )
+{
+  auto const devices = myengine::vulkan::get_physical_devices( instance );
+  if( index < 0 )
+  {
+    for( VkPhysicalDevice d : devices )
+    {
+      auto const& props =
+        myengine::vulkan::get_device_capabilities( d ).properties;
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return d;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return devices[ index ];
+}
+
+void
+print_row( std::string const& name, result const& r )
+{
+  double const mib = static_cast< double >( r.bytes ) / ( 1024. * 1024. );
+  std::cout << std::left << std::setw( 14 ) << name << std::right << std::fixed
+            << std::setprecision( 1 ) << std::setw( 12 ) << mib
+            << std::setw( 12 ) << r.seconds * 1000. << std::setw( 12 )
+            << ( r.seconds > 0. ? mib / r.seconds : 0. ) << std::setw( 10 )
+            << r.stalls << std::setw( 10 ) << r.deferred << '\n';
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--frames N] [--uploads N] [--size BYTES] [--ring-mib N]"
+               " [--strategy naive|ring|ring_blocking]"
+               " [--device INDEX | --cpu]" << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--frames" && has_value )
+      {
+        opts.frames = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--uploads" && has_value )
+      {
+        opts.uploads = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--size" && has_value )
+      {
+        opts.size = std::max( 16ull, std::stoull( argv[ ++i ] ) ) / 16 * 16;
+      }
+      else if( arg == "--ring-mib" && has_value )
+      {
+        opts.ring_mib = std::max( 1ull, std::stoull( argv[ ++i ] ) );
+      }
+      else if( arg == "--strategy" && has_value )
+      {
+        opts.strategy = argv[ ++i ];
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  if( ( !opts.strategy.empty() && opts.strategy != "naive" &&
+        opts.strategy != "ring" && opts.strategy != "ring_blocking" ) ||
+      opts.size > ( opts.ring_mib << 20 ) )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  auto const wanted = [ &opts ]( char const* name ) {
+    return opts.strategy.empty() || opts.strategy == name;
+  };
+
+  VkInstance instance = VK_NULL_HANDLE;
+  context ctx;
+  try
+  {
+    instance = create_instance();
+    ctx.physical_device = select_device( instance, opts.device );
+    auto const& caps =
+      myengine::vulkan::get_device_capabilities( ctx.physical_device );
+    LOGF_INFO( "Device: {}; {} frame(s) of {} upload(s) of {} bytes",
+               caps.properties.deviceName, opts.frames, opts.uploads,
+               opts.size );
+    // Any family can transfer; graphics and compute ones implicitly.
+    ctx.queue_family = 0;
+    float const priority = 1.f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = ctx.queue_family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    check_result( vkCreateDevice( ctx.physical_device, &device_info, nullptr,
+                                  &ctx.device ),
+                  "create device" );
+    vkGetDeviceQueue( ctx.device, ctx.queue_family, 0, &ctx.queue );
+
+    myengine::vulkan::memory_allocator_config allocator_config;
+    allocator_config.api_version = API_VERSION;
+    myengine::vulkan::device_memory_allocator allocator( ctx.physical_device,
+                                                         ctx.device,
+                                                         allocator_config );
+    ctx.allocator = &allocator;
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = opts.uploads * opts.size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    check_result( vkCreateBuffer( ctx.device, &buffer_info, nullptr,
+                                  &ctx.target ),
+                  "create target buffer" );
+    auto const target_memory = allocator.allocate_buffer(
+      ctx.target, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+
+    std::vector< uint8_t > data( opts.uploads * opts.size );
+    for( std::size_t i = 0; i < data.size(); ++i )
+    {
+      data[ i ] = static_cast< uint8_t >( i * 31 );
+    }
+
+    std::cout << std::left << std::setw( 14 ) << "strategy" << std::right
+              << std::setw( 12 ) << "MiB" << std::setw( 12 ) << "ms"
+              << std::setw( 12 ) << "MiB/s" << std::setw( 10 ) << "stalls"
+              << std::setw( 10 ) << "deferred" << '\n';
+    if( wanted( "naive" ) )
+    {
+      print_row( "naive", run_naive( opts, ctx, data ) );
+    }
+    if( wanted( "ring" ) )
+    {
+      print_row( "ring", run_ring( opts, ctx, data, false ) );
+    }
+    if( wanted( "ring_blocking" ) )
+    {
+      print_row( "ring_blocking", run_ring( opts, ctx, data, true ) );
+    }
+
+    vkDestroyBuffer( ctx.device, ctx.target, nullptr );
+    allocator.free( target_memory );
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "{}", e.what() );
+    if( ctx.device != VK_NULL_HANDLE )
+    {
+      vkDeviceWaitIdle( ctx.device );
+      vkDestroyDevice( ctx.device, nullptr );
+    }
+    vkDestroyInstance( instance, nullptr );
+    return EXIT_FAILURE;
+  }
+  vkDestroyDevice( ctx.device, nullptr );
+  vkDestroyInstance( instance, nullptr );
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,653 @@
+/**
+ * Benchmark of multi-threaded command recording with
+ * `myengine::vulkan::parallel_recorder`.
+ *
+ * Each frame records `--draws` draws of a small triangle, each with its own
+ * push constants, into secondary command buffers inside one render pass, and
+ * submits the frame through an `offscreen_scheduler`. This is repeated for 1
+ * up to `--threads` recording threads. The recording time per frame covers
+ * resetting the pools, recording on all threads and executing the
+ * secondaries in the primary command buffer.
+ *
+ * The triangles overlap without blending, so the image depends on the draw
+ * order. With `--verify`, the last frame of every run is read back and
+ * compared against the single-threaded one.
+ *
+ * No window or surface is involved, so this runs headless and against a CPU
+ * implementation:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     myengine_record_bench --cpu
+ *
+ * Usage: myengine_record_bench [--draws N] [--threads K] [--frames N]
+ *          [--verify] [--device INDEX | --cpu]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/offscreen.h>
+#include <myengine/parallel_recorder.h>
+#include <myengine/vulkan.h>
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+uint32_t const vert_spirv[] =
+#include "shaders/record_bench.vert.inc"
+;
+
+uint32_t const frag_spirv[] =
+#include "shaders/record_bench.frag.inc"
+;
+
+/// Frames recorded before timing starts, per run.
+constexpr int WARMUP_FRAMES = 5;
+
+struct options
+{
+  uint32_t draws = 10000;
+  uint32_t threads = std::max( 1u, std::thread::hardware_concurrency() );
+  int frames = 100;
+  bool verify = false;
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+};
+
+/// Push constants of one draw, see `shaders/record_bench.vert`.
+struct draw_params
+{
+  float placement[ 4 ];
+  float color[ 4 ];
+};
+
+/// What every run renders with.
+struct context
+{
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t queue_family = 0;
+  VkQueue queue = VK_NULL_HANDLE;
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkExtent2D extent = { 256, 256 };
+  std::vector< draw_params > draws;
+};
+
+struct result
+{
+  double record_ms = 0.;
+  double frame_ms = 0.;
+  uint32_t secondaries = 0;
+  /// Of the last frame's pixels, if read back.
+  uint64_t hash = 0;
+};
+
+double
+ms_since( steady_clock_t::time_point start )
+{
+  return std::chrono::duration< double, std::milli >(
+    steady_clock_t::now() - start ).count();
+}
+
+/// 64 bit FNV-1a.
+uint64_t
+hash_bytes( void const* data, std::size_t size )
+{
+  uint64_t h = 14695981039346656037ull;
+  auto const* p = static_cast< uint8_t const* >( data );
+  for( std::size_t i = 0; i < size; ++i )
+  {
+    h = ( h ^ p[ i ] ) * 1099511628211ull;
+  }
+  return h;
+}
+
+/// Placements and colors, the same for every run.
+std::vector< draw_params >
+make_draws( uint32_t count )
+{
+  std::vector< draw_params > draws( count );
+  uint32_t state = 0x9E3779B9u;
+  auto const next = [ &state ] {
+    // xorshift32, in [0, 1).
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast< float >( state >> 8 ) / 16777216.f;
+  };
+  for( auto& d : draws )
+  {
+    d.placement[ 0 ] = next() * 2.f - 1.f;
+    d.placement[ 1 ] = next() * 2.f - 1.f;
+    d.placement[ 2 ] = 0.02f + next() * 0.1f;
+    d.placement[ 3 ] = 0.f;
+    d.color[ 0 ] = next();
+    d.color[ 1 ] = next();
+    d.color[ 2 ] = next();
+    d.color[ 3 ] = 1.f;
+  }
+  return draws;
+}
+
+VkShaderModule
+create_shader( VkDevice device, uint32_t const* code, std::size_t size )
+{
+  VkShaderModuleCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  info.codeSize = size;
+  info.pCode = code;
+  VkShaderModule module = VK_NULL_HANDLE;
+  check_result( vkCreateShaderModule( device, &info, nullptr, &module ),
+                "create shader module" );
+  return module;
+}
+
+/// Render pass and pipeline drawing into the offscreen targets, which are left
+/// ready for reading back.
+void
+create_pipeline( context& ctx, VkFormat format )
+{
+  VkAttachmentDescription attachment = {};
+  attachment.format = format;
+  attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+  VkAttachmentReference color_ref = {};
+  color_ref.attachment = 0;
+  color_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &color_ref;
+
+  // Make the color writes available to the readback copy.
+  VkSubpassDependency dependency = {};
+  dependency.srcSubpass = 0;
+  dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  VkRenderPassCreateInfo pass_info = {};
+  pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  pass_info.attachmentCount = 1;
+  pass_info.pAttachments = &attachment;
+  pass_info.subpassCount = 1;
+  pass_info.pSubpasses = &subpass;
+  pass_info.dependencyCount = 1;
+  pass_info.pDependencies = &dependency;
+  check_result( vkCreateRenderPass( ctx.device, &pass_info, nullptr,
+                                    &ctx.render_pass ),
+                "create render pass" );
+
+  VkPushConstantRange push_range = {};
+  push_range.stageFlags =
+    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  push_range.size = sizeof( draw_params );
+  VkPipelineLayoutCreateInfo layout_info = {};
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_info.pushConstantRangeCount = 1;
+  layout_info.pPushConstantRanges = &push_range;
+  check_result( vkCreatePipelineLayout( ctx.device, &layout_info, nullptr,
+                                        &ctx.layout ),
+                "create pipeline layout" );
+
+  VkShaderModule const vert =
+    create_shader( ctx.device, vert_spirv, sizeof( vert_spirv ) );
+  VkShaderModule frag = VK_NULL_HANDLE;
+  try
+  {
+    frag = create_shader( ctx.device, frag_spirv, sizeof( frag_spirv ) );
+
+    VkPipelineShaderStageCreateInfo stages[ 2 ] = {};
+    stages[ 0 ].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[ 0 ].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[ 0 ].module = vert;
+    stages[ 0 ].pName = "main";
+    stages[ 1 ].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[ 1 ].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[ 1 ].module = frag;
+    stages[ 1 ].pName = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertex_input = {};
+    vertex_input.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+    input_assembly.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPipelineViewportStateCreateInfo viewport = {};
+    viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport.viewportCount = 1;
+    viewport.scissorCount = 1;
+    VkPipelineRasterizationStateCreateInfo raster = {};
+    raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    raster.polygonMode = VK_POLYGON_MODE_FILL;
+    raster.cullMode = VK_CULL_MODE_NONE;
+    raster.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    raster.lineWidth = 1.f;
+    VkPipelineMultisampleStateCreateInfo multisample = {};
+    multisample.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkPipelineColorBlendAttachmentState blend_attachment = {};
+    blend_attachment.colorWriteMask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    VkPipelineColorBlendStateCreateInfo blend = {};
+    blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blend.attachmentCount = 1;
+    blend.pAttachments = &blend_attachment;
+    VkDynamicState const dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT,
+                                              VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamic = {};
+    dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic.dynamicStateCount = 2;
+    dynamic.pDynamicStates = dynamic_states;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = stages;
+    pipeline_info.pVertexInputState = &vertex_input;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport;
+    pipeline_info.pRasterizationState = &raster;
+    pipeline_info.pMultisampleState = &multisample;
+    pipeline_info.pColorBlendState = &blend;
+    pipeline_info.pDynamicState = &dynamic;
+    pipeline_info.layout = ctx.layout;
+    pipeline_info.renderPass = ctx.render_pass;
+    check_result( vkCreateGraphicsPipelines( ctx.device, VK_NULL_HANDLE, 1,
+                                             &pipeline_info, nullptr,
+                                             &ctx.pipeline ),
+                  "create graphics pipeline" );
+  }
+  catch( ... )
+  {
+    vkDestroyShaderModule( ctx.device, frag, nullptr );
+    vkDestroyShaderModule( ctx.device, vert, nullptr );
+    throw;
+  }
+  vkDestroyShaderModule( ctx.device, frag, nullptr );
+  vkDestroyShaderModule( ctx.device, vert, nullptr );
+}
+
+void
+destroy_pipeline( context& ctx )
+{
+  vkDestroyPipeline( ctx.device, ctx.pipeline, nullptr );
+  vkDestroyPipelineLayout( ctx.device, ctx.layout, nullptr );
+  vkDestroyRenderPass( ctx.device, ctx.render_pass, nullptr );
+}
+
+/// Record a chunk of draws into a secondary command buffer.
+void
+record_draws( context const& ctx, VkCommandBuffer cmd, uint32_t begin,
+              uint32_t end )
+{
+  vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.pipeline );
+  VkViewport viewport = {};
+  viewport.width = static_cast< float >( ctx.extent.width );
+  viewport.height = static_cast< float >( ctx.extent.height );
+  viewport.maxDepth = 1.f;
+  vkCmdSetViewport( cmd, 0, 1, &viewport );
+  VkRect2D scissor = {};
+  scissor.extent = ctx.extent;
+  vkCmdSetScissor( cmd, 0, 1, &scissor );
+  for( uint32_t i = begin; i < end; ++i )
+  {
+    vkCmdPushConstants( cmd, ctx.layout,
+                        VK_SHADER_STAGE_VERTEX_BIT |
+                          VK_SHADER_STAGE_FRAGMENT_BIT,
+                        0, sizeof( draw_params ), &ctx.draws[ i ] );
+    vkCmdDraw( cmd, 3, 1, 0, 0 );
+  }
+}
+
+/// Render `frames` frames, recording on `threads` threads.
+result
+run( options const& opts, context const& ctx, uint32_t threads )
+{
+  result r;
+  myengine::vulkan::offscreen_scheduler_config sched_config;
+  sched_config.extent = ctx.extent;
+  myengine::vulkan::offscreen_scheduler::readback_fn readback;
+  if( opts.verify )
+  {
+    readback = [ &r ]( uint64_t, void const* pixels, std::size_t size ) {
+      r.hash = hash_bytes( pixels, size );
+    };
+  }
+  myengine::vulkan::offscreen_scheduler scheduler(
+    ctx.physical_device, ctx.device, ctx.queue_family, ctx.queue,
+    sched_config, std::move( readback ) );
+
+  std::vector< VkFramebuffer > framebuffers(
+    scheduler.frames_in_flight(), VK_NULL_HANDLE );
+  auto const destroy_framebuffers = [ & ] {
+    for( VkFramebuffer fb : framebuffers )
+    {
+      vkDestroyFramebuffer( ctx.device, fb, nullptr );
+    }
+  };
+
+  myengine::vulkan::parallel_recorder_config rec_config;
+  rec_config.threads = threads;
+  rec_config.frames_in_flight = scheduler.frames_in_flight();
+  myengine::vulkan::parallel_recorder recorder( ctx.device, ctx.queue_family,
+                                                rec_config );
+  myengine::vulkan::parallel_recorder::record_fn const record_fn =
+    [ &ctx ]( VkCommandBuffer cmd, uint32_t begin, uint32_t end ) {
+      record_draws( ctx, cmd, begin, end );
+    };
+
+  try
+  {
+    double record_ms = 0.;
+    steady_clock_t::time_point start;
+    for( int i = 0; i < WARMUP_FRAMES + opts.frames; ++i )
+    {
+      if( i == WARMUP_FRAMES )
+      {
+        // Let the warmup frames drain so they are not timed.
+        scheduler.finish();
+        start = steady_clock_t::now();
+      }
+      myengine::vulkan::offscreen_scheduler::frame f;
+      scheduler.begin_frame( f );
+      if( framebuffers[ f.slot ] == VK_NULL_HANDLE )
+      {
+        VkFramebufferCreateInfo fb_info = {};
+        fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        fb_info.renderPass = ctx.render_pass;
+        fb_info.attachmentCount = 1;
+        fb_info.pAttachments = &f.view;
+        fb_info.width = ctx.extent.width;
+        fb_info.height = ctx.extent.height;
+        fb_info.layers = 1;
+        check_result( vkCreateFramebuffer( ctx.device, &fb_info, nullptr,
+                                           &framebuffers[ f.slot ] ),
+                      "create framebuffer" );
+      }
+
+      VkClearValue clear = {};
+      VkRenderPassBeginInfo pass_begin = {};
+      pass_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      pass_begin.renderPass = ctx.render_pass;
+      pass_begin.framebuffer = framebuffers[ f.slot ];
+      pass_begin.renderArea.extent = ctx.extent;
+      pass_begin.clearValueCount = 1;
+      pass_begin.pClearValues = &clear;
+      vkCmdBeginRenderPass( f.cmd, &pass_begin,
+                            VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS );
+
+      VkCommandBufferInheritanceInfo inheritance = {};
+      inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      inheritance.renderPass = ctx.render_pass;
+      inheritance.subpass = 0;
+      inheritance.framebuffer = framebuffers[ f.slot ];
+      auto const record_start = steady_clock_t::now();
+      recorder.begin_frame( f.slot );
+      recorder.record( f.cmd, inheritance,
+                       static_cast< uint32_t >( ctx.draws.size() ),
+                       record_fn );
+      if( i >= WARMUP_FRAMES )
+      {
+        record_ms += ms_since( record_start );
+      }
+      r.secondaries = recorder.secondaries_recorded();
+
+      vkCmdEndRenderPass( f.cmd );
+      scheduler.end_frame( f );
+    }
+    scheduler.finish();
+    r.frame_ms = ms_since( start ) / opts.frames;
+    r.record_ms = record_ms / opts.frames;
+  }
+  catch( ... )
+  {
+    vkDeviceWaitIdle( ctx.device );
+    destroy_framebuffers();
+    throw;
+  }
+  destroy_framebuffers();
+  return r;
+}
+
+VkInstance
+create_instance()
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "record_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.apiVersion = VK_API_VERSION_1_1;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Physical device to use.
+VkPhysicalDevice
+select_device( VkInstance instance, int index )
+{
+  auto const devices = myengine::vulkan::get_physical_devices( instance );
+  if( index < 0 )
+  {
+    for( VkPhysicalDevice d : devices )
+    {
+      auto const& props =
+        myengine::vulkan::get_device_capabilities( d ).properties;
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return d;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return devices[ index ];
+}
+
+/// First queue family supporting graphics.
+uint32_t
+graphics_family( VkPhysicalDevice physical_device )
+{
+  auto const& families =
+    myengine::vulkan::get_device_capabilities( physical_device )
+      .queue_families;
+  for( uint32_t i = 0; i < families.size(); ++i )
+  {
+    if( families[ i ].queueFlags & VK_QUEUE_GRAPHICS_BIT )
+    {
+      return i;
+    }
+  }
+  throw std::runtime_error( "No graphics queue family" );
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--draws N] [--threads K] [--frames N] [--verify]"
+               " [--device INDEX | --cpu]" << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--draws" && has_value )
+      {
+        opts.draws = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--threads" && has_value )
+      {
+        opts.threads = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--frames" && has_value )
+      {
+        opts.frames = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--verify" )
+      {
+        opts.verify = true;
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  VkInstance instance = VK_NULL_HANDLE;
+  context ctx;
+  bool mismatch = false;
+  try
+  {
+    instance = create_instance();
+    ctx.physical_device = select_device( instance, opts.device );
+    auto const& caps =
+      myengine::vulkan::get_device_capabilities( ctx.physical_device );
+    LOGF_INFO( "Device: {}; {} draw(s) per frame, {} frame(s), up to {} "
+               "thread(s)",
+               caps.properties.deviceName, opts.draws, opts.frames,
+               opts.threads );
+
+    ctx.queue_family = graphics_family( ctx.physical_device );
+    float const priority = 1.f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = ctx.queue_family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    check_result( vkCreateDevice( ctx.physical_device, &device_info, nullptr,
+                                  &ctx.device ),
+                  "create device" );
+    vkGetDeviceQueue( ctx.device, ctx.queue_family, 0, &ctx.queue );
+
+    create_pipeline( ctx,
+                     myengine::vulkan::offscreen_scheduler_config().format );
+    ctx.draws = make_draws( opts.draws );
+
+    std::cout << std::setw( 8 ) << "threads" << std::setw( 12 )
+              << "record ms" << std::setw( 12 ) << "frame ms"
+              << std::setw( 12 ) << "Mdraws/s" << std::setw( 10 ) << "speedup"
+              << std::setw( 12 ) << "secondaries"
+              << ( opts.verify ? "  image" : "" ) << '\n';
+    double base_ms = 0.;
+    uint64_t base_hash = 0;
+    for( uint32_t t = 1; t <= opts.threads; ++t )
+    {
+      result const r = run( opts, ctx, t );
+      if( t == 1 )
+      {
+        base_ms = r.record_ms;
+        base_hash = r.hash;
+      }
+      std::cout << std::setw( 8 ) << t << std::fixed << std::setprecision( 3 )
+                << std::setw( 12 ) << r.record_ms << std::setw( 12 )
+                << r.frame_ms << std::setprecision( 2 ) << std::setw( 12 )
+                << ( r.record_ms > 0. ? opts.draws / r.record_ms / 1000. : 0. )
+                << std::setw( 10 )
+                << ( r.record_ms > 0. ? base_ms / r.record_ms : 0. )
+                << std::setw( 12 ) << r.secondaries;
+      if( opts.verify )
+      {
+        std::cout << ( r.hash == base_hash ? "  same" : "  DIFFERENT" );
+        mismatch = mismatch || r.hash != base_hash;
+      }
+      std::cout << std::endl;
+    }
+
+    destroy_pipeline( ctx );
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "{}", e.what() );
+    if( ctx.device != VK_NULL_HANDLE )
+    {
+      vkDeviceWaitIdle( ctx.device );
+      destroy_pipeline( ctx );
+      vkDestroyDevice( ctx.device, nullptr );
+    }
+    vkDestroyInstance( instance, nullptr );
+    return EXIT_FAILURE;
+  }
+  vkDestroyDevice( ctx.device, nullptr );
+  vkDestroyInstance( instance, nullptr );
+  if( mismatch )
+  {
+    LOGF_ERROR( "Images differ between thread counts" );
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,17 @@
+#version 450
+
+// Flat color from the push constants; see `record_bench.vert`.
+
+layout( push_constant ) uniform Draw
+{
+  vec4 placement;
+  vec4 color;
+};
+
+layout( location = 0 ) out vec4 out_color;
+
+void
+main()
+{
+  out_color = color;
+}
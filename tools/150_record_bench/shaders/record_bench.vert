@@ -0,0 +1,21 @@
+#version 450
+
+// One small triangle per draw, placed and colored by push constants. See
+// `tools/150_record_bench/record_bench.cxx`.
+
+layout( push_constant ) uniform Draw
+{
+  // xy: center in normalized device coordinates, z: half size.
+  vec4 placement;
+  vec4 color;
+};
+
+const vec2 CORNERS[ 3 ] = vec2[]( vec2( -1., 1. ), vec2( 1., 1. ),
+                                  vec2( 0., -1. ) );
+
+void
+main()
+{
+  gl_Position = vec4( placement.xy + CORNERS[ gl_VertexIndex ] * placement.z,
+                      0., 1. );
+}
@@ -0,0 +1,328 @@
+/**
+ * Microbenchmarks of `myengine::job_system`: the overhead of spawning and
+ * stealing jobs, and how a CPU-bound workload scales with worker threads.
+ *
+ * Overhead, with `--threads - 1` workers, per job:
+ *   - `spawn_main`: the main thread spawns `--jobs` empty jobs, which go
+ *     through the injection queue, and waits for them,
+ *   - `spawn_worker`: one job spawns `--jobs` empty jobs onto its worker's
+ *     deque, from which the others steal, and waits for them,
+ *   - `parallel_for`: `--jobs` empty items with a grain of 1, split
+ *     recursively,
+ *   - `fib`: naive recursive Fibonacci, one job per call, about `--jobs`
+ *     calls.
+ *
+ * Scaling: `--items` items of `--work` rounds of integer hashing each, run
+ * serially and then with `parallel_for` on 1 to `--threads - 1` workers plus
+ * the main thread.
+ *
+ * Usage: myengine_job_bench [--jobs N] [--threads K] [--items N] [--work N]
+ *          [--grain N] [--affinity none|workers|all]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <myengine/job_system.h>
+#include <myengine/logging.h>
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+struct options
+{
+  uint32_t jobs = 1 << 20;
+  uint32_t threads = std::max( 2u, std::thread::hardware_concurrency() );
+  uint32_t items = 1 << 14;
+  uint32_t work = 4000;
+  uint32_t grain = 16;
+  myengine::thread_affinity affinity = myengine::thread_affinity::none;
+};
+
+double
+seconds_since( steady_clock_t::time_point start )
+{
+  return std::chrono::duration< double >( steady_clock_t::now() - start )
+    .count();
+}
+
+/// Stand-in for real work: `rounds` of xorshift, hard to optimize away.
+uint32_t
+hash_work( uint32_t seed, uint32_t rounds )
+{
+  uint32_t x = seed | 1;
+  for( uint32_t i = 0; i < rounds; ++i )
+  {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+  }
+  return x;
+}
+
+/// Calls of `fib( n )`.
+uint64_t
+fib_calls( int n )
+{
+  uint64_t a = 1;
+  uint64_t b = 1;
+  for( int i = 1; i < n; ++i )
+  {
+    uint64_t const c = a + b + 1;
+    a = b;
+    b = c;
+  }
+  return b;
+}
+
+void
+fib( myengine::job_system& jobs, int n, std::atomic< uint64_t >& sum )
+{
+  if( n < 2 )
+  {
+    sum.fetch_add( n, std::memory_order_relaxed );
+    return;
+  }
+  myengine::job_counter counter;
+  jobs.spawn( [ &jobs, n, &sum ] { fib( jobs, n - 1, sum ); }, &counter );
+  fib( jobs, n - 2, sum );
+  jobs.wait( counter );
+}
+
+myengine::job_system_config
+make_config( options const& opts, uint32_t workers )
+{
+  myengine::job_system_config config;
+  config.workers = workers;
+  config.affinity = opts.affinity;
+  return config;
+}
+
+void
+print_overhead( std::string const& name, double seconds, uint64_t jobs,
+                myengine::job_system const& system,
+                myengine::job_system_stats const& before )
+{
+  auto const after = system.stats();
+  std::cout << std::left << std::setw( 14 ) << name << std::right
+            << std::setw( 10 ) << jobs << std::fixed << std::setprecision( 1 )
+            << std::setw( 12 ) << seconds * 1e9 / jobs << std::setw( 12 )
+            << ( after.stolen - before.stolen ) << std::setw( 10 )
+            << ( after.sleeps - before.sleeps ) << '\n';
+}
+
+void
+run_overhead( options const& opts )
+{
+  myengine::job_system system( make_config( opts, opts.threads - 1 ) );
+  std::cout << "Overhead, " << system.worker_count()
+            << " worker(s) and the main thread\n"
+            << std::left << std::setw( 14 ) << "test" << std::right
+            << std::setw( 10 ) << "jobs" << std::setw( 12 ) << "ns/job"
+            << std::setw( 12 ) << "stolen" << std::setw( 10 ) << "sleeps"
+            << '\n';
+
+  {
+    auto const before = system.stats();
+    myengine::job_counter counter;
+    auto const start = steady_clock_t::now();
+    for( uint32_t i = 0; i < opts.jobs; ++i )
+    {
+      system.spawn( [] {}, &counter );
+    }
+    system.wait( counter );
+    print_overhead( "spawn_main", seconds_since( start ), opts.jobs, system,
+                    before );
+  }
+
+  {
+    auto const before = system.stats();
+    myengine::job_counter root;
+    auto const start = steady_clock_t::now();
+    system.spawn(
+      [ &system, &opts ] {
+        myengine::job_counter counter;
+        for( uint32_t i = 0; i < opts.jobs; ++i )
+        {
+          system.spawn( [] {}, &counter );
+        }
+        system.wait( counter );
+      },
+      &root );
+    system.wait( root );
+    print_overhead( "spawn_worker", seconds_since( start ), opts.jobs, system,
+                    before );
+  }
+
+  {
+    auto const before = system.stats();
+    auto const start = steady_clock_t::now();
+    system.parallel_for( opts.jobs, 1, []( uint32_t, uint32_t ) {} );
+    print_overhead( "parallel_for", seconds_since( start ), opts.jobs, system,
+                    before );
+  }
+
+  {
+    int n = 2;
+    while( fib_calls( n + 1 ) <= opts.jobs )
+    {
+      ++n;
+    }
+    auto const before = system.stats();
+    std::atomic< uint64_t > sum( 0 );
+    myengine::job_counter root;
+    auto const start = steady_clock_t::now();
+    system.spawn( [ &system, n, &sum ] { fib( system, n, sum ); }, &root );
+    system.wait( root );
+    print_overhead( "fib(" + std::to_string( n ) + ")", seconds_since( start ),
+                    fib_calls( n ), system, before );
+  }
+}
+
+void
+run_scaling( options const& opts )
+{
+  std::vector< uint32_t > results( opts.items );
+  auto const body = [ &results, &opts ]( uint32_t begin, uint32_t end ) {
+    for( uint32_t i = begin; i < end; ++i )
+    {
+      results[ i ] = hash_work( i, opts.work );
+    }
+  };
+
+  auto const start = steady_clock_t::now();
+  body( 0, opts.items );
+  double const serial = seconds_since( start );
+  uint32_t const expected = results[ opts.items / 2 ];
+
+  std::cout << "\nScaling, " << opts.items << " items of " << opts.work
+            << " rounds, grain " << opts.grain << '\n'
+            << std::setw( 8 ) << "threads" << std::setw( 12 ) << "ms"
+            << std::setw( 10 ) << "speedup" << std::setw( 12 )
+            << "efficiency" << std::setw( 12 ) << "stolen" << '\n';
+  std::cout << std::setw( 8 ) << "serial" << std::fixed
+            << std::setprecision( 2 ) << std::setw( 12 ) << serial * 1000.
+            << std::setw( 10 ) << 1. << std::setw( 12 ) << 1.
+            << std::setw( 12 ) << 0 << '\n';
+  for( uint32_t workers = 1; workers < opts.threads; ++workers )
+  {
+    myengine::job_system system( make_config( opts, workers ) );
+    // Once to warm up the workers, then timed.
+    system.parallel_for( opts.items, opts.grain, body );
+    auto const before = system.stats();
+    auto const t0 = steady_clock_t::now();
+    system.parallel_for( opts.items, opts.grain, body );
+    double const seconds = seconds_since( t0 );
+    if( results[ opts.items / 2 ] != expected )
+    {
+      throw std::runtime_error( "Parallel results differ from serial" );
+    }
+    uint32_t const threads = workers + 1;
+    double const speedup = serial / seconds;
+    std::cout << std::setw( 8 ) << threads << std::setw( 12 )
+              << seconds * 1000. << std::setw( 10 ) << speedup
+              << std::setw( 12 ) << speedup / threads << std::setw( 12 )
+              << ( system.stats().stolen - before.stolen ) << std::endl;
+  }
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--jobs N] [--threads K] [--items N] [--work N] [--grain N]"
+               " [--affinity none|workers|all]" << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--jobs" && has_value )
+      {
+        opts.jobs = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--threads" && has_value )
+      {
+        opts.threads = static_cast< uint32_t >(
+          std::max( 2ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--items" && has_value )
+      {
+        opts.items = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--work" && has_value )
+      {
+        opts.work = static_cast< uint32_t >( std::stoul( argv[ ++i ] ) );
+      }
+      else if( arg == "--grain" && has_value )
+      {
+        opts.grain = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--affinity" && has_value )
+      {
+        std::string const value = argv[ ++i ];
+        if( value == "none" )
+        {
+          opts.affinity = myengine::thread_affinity::none;
+        }
+        else if( value == "workers" )
+        {
+          opts.affinity = myengine::thread_affinity::pin_workers;
+        }
+        else if( value == "all" )
+        {
+          opts.affinity = myengine::thread_affinity::pin_all;
+        }
+        else
+        {
+          usage( argv[ 0 ] );
+          return EXIT_FAILURE;
+        }
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    run_overhead( opts );
+    run_scaling( opts );
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "{}", e.what() );
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,709 @@
+/**
+ * Benchmark of dedicated transfer and async compute queues, synchronized with
+ * the graphics queue through `myengine::vulkan::timeline_queue`.
+ *
+ * Each of `--frames` frames uploads `--copy-mib` MiB from a staging buffer,
+ * runs a compute dispatch of `--groups` workgroups that depends on the
+ * previous frame's (a simulation step, say), and then a dispatch on the
+ * graphics queue standing in for rendering, which consumes both:
+ *   - `serial`: everything in one command buffer on the graphics queue, with
+ *     barriers in between,
+ *   - `async`: the copy on the transfer queue and the simulation on the
+ *     compute queue; the graphics queue waits on their timeline points, so
+ *     the next frame's copy and simulation overlap this frame's rendering.
+ * Frames in flight are limited to two, which alternate between two sets of
+ * buffers.
+ *
+ * Where the device lacks a transfer-only or compute-only queue family, the
+ * roles share the graphics queue (see `myengine::vulkan::plan_queues`) and
+ * both modes should perform alike.
+ *
+ * No window or surface is involved, so this runs headless and against a CPU
+ * implementation:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     myengine_queue_bench --cpu
+ *
+ * Usage: myengine_queue_bench [--frames N] [--copy-mib N] [--groups N]
+ *          [--iterations N] [--mode serial|async] [--device INDEX | --cpu]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/memory_allocator.h>
+#include <myengine/queues.h>
+#include <myengine/vulkan.h>
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Vulkan version the instance is created for.
+constexpr uint32_t API_VERSION = VK_API_VERSION_1_2;
+
+uint32_t const comp_spirv[] =
+#include "shaders/queue_bench.comp.inc"
+;
+
+/// Frames in flight, each with its own buffers.
+constexpr uint32_t FRAME_SLOTS = 2;
+
+/// Frames run before timing starts, per mode.
+constexpr int WARMUP_FRAMES = 5;
+
+/// Invocations per workgroup, see `shaders/queue_bench.comp`.
+constexpr uint32_t WORKGROUP_SIZE = 64;
+
+struct options
+{
+  int frames = 200;
+  VkDeviceSize copy_mib = 16;
+  uint32_t groups = 1024;
+  uint32_t iterations = 2000;
+  std::string mode;  // Both when empty.
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+};
+
+/// Push constants, see `shaders/queue_bench.comp`.
+struct dispatch_params
+{
+  uint32_t iterations;
+  uint32_t a_count;
+  uint32_t b_count;
+};
+
+/// Buffers of one frame slot.
+struct frame_buffers
+{
+  /// Copy destination.
+  VkBuffer upload = VK_NULL_HANDLE;
+  /// Written by the simulation, read by the next frame's and by rendering.
+  VkBuffer state = VK_NULL_HANDLE;
+  /// Written by rendering.
+  VkBuffer output = VK_NULL_HANDLE;
+  myengine::vulkan::memory_allocation upload_memory;
+  myengine::vulkan::memory_allocation state_memory;
+  myengine::vulkan::memory_allocation output_memory;
+  /// Simulation: the other slot's state in, this slot's state out.
+  VkDescriptorSet simulate_set = VK_NULL_HANDLE;
+  /// Rendering: this slot's upload and state in, output out.
+  VkDescriptorSet render_set = VK_NULL_HANDLE;
+};
+
+/// What both modes run on.
+struct context
+{
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  myengine::vulkan::queue_layout queues;
+  VkQueue graphics_queue = VK_NULL_HANDLE;
+  VkQueue transfer_queue = VK_NULL_HANDLE;
+  VkQueue compute_queue = VK_NULL_HANDLE;
+  myengine::vulkan::device_memory_allocator* allocator = nullptr;
+
+  VkDeviceSize copy_size = 0;
+  /// Floats in each state and output buffer.
+  uint32_t elements = 0;
+  VkBuffer staging = VK_NULL_HANDLE;
+  myengine::vulkan::memory_allocation staging_memory;
+  frame_buffers frames[ FRAME_SLOTS ];
+
+  VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+};
+
+double
+ms_since( steady_clock_t::time_point start )
+{
+  return std::chrono::duration< double, std::milli >(
+    steady_clock_t::now() - start ).count();
+}
+
+/**
+ * A buffer in memory with the `required` properties, shared between the queue
+ * families in use so that no ownership transfers are needed.
+ */
+VkBuffer
+create_buffer( context const& ctx, VkDeviceSize size, VkBufferUsageFlags usage,
+               VkMemoryPropertyFlags required,
+               myengine::vulkan::memory_allocation& memory )
+{
+  std::vector< uint32_t > families = { ctx.queues.graphics.family };
+  for( uint32_t f : { ctx.queues.transfer.family, ctx.queues.compute.family } )
+  {
+    if( std::find( families.begin(), families.end(), f ) == families.end() )
+    {
+      families.push_back( f );
+    }
+  }
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  if( families.size() > 1 )
+  {
+    buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    buffer_info.queueFamilyIndexCount =
+      static_cast< uint32_t >( families.size() );
+    buffer_info.pQueueFamilyIndices = families.data();
+  }
+  else
+  {
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
+  VkBuffer buffer = VK_NULL_HANDLE;
+  check_result( vkCreateBuffer( ctx.device, &buffer_info, nullptr, &buffer ),
+                "create buffer" );
+  try
+  {
+    memory = ctx.allocator->allocate_buffer( buffer, required );
+  }
+  catch( ... )
+  {
+    vkDestroyBuffer( ctx.device, buffer, nullptr );
+    throw;
+  }
+  return buffer;
+}
+
+void
+write_set( context const& ctx, VkDescriptorSet set, VkBuffer a, VkBuffer b,
+           VkBuffer out )
+{
+  VkDescriptorBufferInfo infos[ 3 ] = {};
+  VkWriteDescriptorSet writes[ 3 ] = {};
+  VkBuffer const buffers[ 3 ] = { a, b, out };
+  for( uint32_t i = 0; i < 3; ++i )
+  {
+    infos[ i ].buffer = buffers[ i ];
+    infos[ i ].range = VK_WHOLE_SIZE;
+    writes[ i ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[ i ].dstSet = set;
+    writes[ i ].dstBinding = i;
+    writes[ i ].descriptorCount = 1;
+    writes[ i ].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[ i ].pBufferInfo = &infos[ i ];
+  }
+  vkUpdateDescriptorSets( ctx.device, 3, writes, 0, nullptr );
+}
+
+/// Buffers, descriptor sets and the compute pipeline.
+void
+create_resources( context& ctx )
+{
+  VkBufferUsageFlags const storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  VkDeviceSize const state_size = VkDeviceSize( ctx.elements ) * 4;
+  // The staging contents do not matter, so it is never written.
+  ctx.staging = create_buffer( ctx, ctx.copy_size,
+                               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                               ctx.staging_memory );
+  for( auto& f : ctx.frames )
+  {
+    f.upload = create_buffer( ctx, ctx.copy_size,
+                              VK_BUFFER_USAGE_TRANSFER_DST_BIT | storage,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                              f.upload_memory );
+    f.state = create_buffer( ctx, state_size, storage,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             f.state_memory );
+    f.output = create_buffer( ctx, state_size, storage,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                              f.output_memory );
+  }
+
+  VkDescriptorSetLayoutBinding bindings[ 3 ] = {};
+  for( uint32_t i = 0; i < 3; ++i )
+  {
+    bindings[ i ].binding = i;
+    bindings[ i ].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[ i ].descriptorCount = 1;
+    bindings[ i ].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  VkDescriptorSetLayoutCreateInfo set_layout_info = {};
+  set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  set_layout_info.bindingCount = 3;
+  set_layout_info.pBindings = bindings;
+  check_result( vkCreateDescriptorSetLayout( ctx.device, &set_layout_info,
+                                             nullptr, &ctx.set_layout ),
+                "create descriptor set layout" );
+
+  uint32_t const set_count = 2 * FRAME_SLOTS;
+  VkDescriptorPoolSize pool_size = {};
+  pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_size.descriptorCount = 3 * set_count;
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.maxSets = set_count;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  check_result( vkCreateDescriptorPool( ctx.device, &pool_info, nullptr,
+                                        &ctx.descriptor_pool ),
+                "create descriptor pool" );
+  std::vector< VkDescriptorSetLayout > const layouts( set_count,
+                                                      ctx.set_layout );
+  std::vector< VkDescriptorSet > sets( set_count );
+  VkDescriptorSetAllocateInfo set_info = {};
+  set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  set_info.descriptorPool = ctx.descriptor_pool;
+  set_info.descriptorSetCount = set_count;
+  set_info.pSetLayouts = layouts.data();
+  check_result( vkAllocateDescriptorSets( ctx.device, &set_info, sets.data() ),
+                "allocate descriptor sets" );
+  for( uint32_t s = 0; s < FRAME_SLOTS; ++s )
+  {
+    auto& f = ctx.frames[ s ];
+    auto const& prev = ctx.frames[ ( s + FRAME_SLOTS - 1 ) % FRAME_SLOTS ];
+    f.simulate_set = sets[ 2 * s ];
+    f.render_set = sets[ 2 * s + 1 ];
+    write_set( ctx, f.simulate_set, prev.state, prev.state, f.state );
+    write_set( ctx, f.render_set, f.upload, f.state, f.output );
+  }
+
+  VkPushConstantRange push_range = {};
+  push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_range.size = sizeof( dispatch_params );
+  VkPipelineLayoutCreateInfo layout_info = {};
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_info.setLayoutCount = 1;
+  layout_info.pSetLayouts = &ctx.set_layout;
+  layout_info.pushConstantRangeCount = 1;
+  layout_info.pPushConstantRanges = &push_range;
+  check_result( vkCreatePipelineLayout( ctx.device, &layout_info, nullptr,
+                                        &ctx.layout ),
+                "create pipeline layout" );
+
+  VkShaderModuleCreateInfo shader_info = {};
+  shader_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  shader_info.codeSize = sizeof( comp_spirv );
+  shader_info.pCode = comp_spirv;
+  VkShaderModule shader = VK_NULL_HANDLE;
+  check_result( vkCreateShaderModule( ctx.device, &shader_info, nullptr,
+                                      &shader ),
+                "create shader module" );
+  VkComputePipelineCreateInfo pipeline_info = {};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.stage.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = shader;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = ctx.layout;
+  VkResult const res = vkCreateComputePipelines(
+    ctx.device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &ctx.pipeline );
+  vkDestroyShaderModule( ctx.device, shader, nullptr );
+  check_result( res, "create compute pipeline" );
+}
+
+void
+destroy_resources( context& ctx )
+{
+  if( ctx.pipeline != VK_NULL_HANDLE )
+  {
+    vkDestroyPipeline( ctx.device, ctx.pipeline, nullptr );
+  }
+  if( ctx.layout != VK_NULL_HANDLE )
+  {
+    vkDestroyPipelineLayout( ctx.device, ctx.layout, nullptr );
+  }
+  if( ctx.descriptor_pool != VK_NULL_HANDLE )
+  {
+    vkDestroyDescriptorPool( ctx.device, ctx.descriptor_pool, nullptr );
+  }
+  if( ctx.set_layout != VK_NULL_HANDLE )
+  {
+    vkDestroyDescriptorSetLayout( ctx.device, ctx.set_layout, nullptr );
+  }
+  ctx.pipeline = VK_NULL_HANDLE;
+  ctx.layout = VK_NULL_HANDLE;
+  ctx.descriptor_pool = VK_NULL_HANDLE;
+  ctx.set_layout = VK_NULL_HANDLE;
+
+  auto const destroy_buffer =
+    [ &ctx ]( VkBuffer& buffer,
+              myengine::vulkan::memory_allocation& memory ) {
+      if( buffer != VK_NULL_HANDLE )
+      {
+        vkDestroyBuffer( ctx.device, buffer, nullptr );
+        ctx.allocator->free( memory );
+      }
+      buffer = VK_NULL_HANDLE;
+      memory = myengine::vulkan::memory_allocation();
+    };
+  destroy_buffer( ctx.staging, ctx.staging_memory );
+  for( auto& f : ctx.frames )
+  {
+    destroy_buffer( f.upload, f.upload_memory );
+    destroy_buffer( f.state, f.state_memory );
+    destroy_buffer( f.output, f.output_memory );
+  }
+}
+
+void
+record_copy( context const& ctx, VkCommandBuffer cmd, frame_buffers const& f )
+{
+  VkBufferCopy region = {};
+  region.size = ctx.copy_size;
+  vkCmdCopyBuffer( cmd, ctx.staging, f.upload, 1, &region );
+}
+
+/// Wait for the previous frame's simulation, then simulate this frame's.
+void
+record_simulate( context const& ctx, VkCommandBuffer cmd,
+                 frame_buffers const& f, uint32_t iterations )
+{
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier( cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+                        0, nullptr, 0, nullptr );
+  dispatch_params const params = { iterations, ctx.elements, ctx.elements };
+  vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ctx.pipeline );
+  vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ctx.layout, 0,
+                           1, &f.simulate_set, 0, nullptr );
+  vkCmdPushConstants( cmd, ctx.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                      sizeof( params ), &params );
+  vkCmdDispatch( cmd, ctx.elements / WORKGROUP_SIZE, 1, 1 );
+}
+
+void
+record_render( context const& ctx, VkCommandBuffer cmd, frame_buffers const& f,
+               uint32_t iterations )
+{
+  dispatch_params const params = {
+    iterations, static_cast< uint32_t >( ctx.copy_size / 4 ), ctx.elements };
+  vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ctx.pipeline );
+  vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ctx.layout, 0,
+                           1, &f.render_set, 0, nullptr );
+  vkCmdPushConstants( cmd, ctx.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                      sizeof( params ), &params );
+  vkCmdDispatch( cmd, ctx.elements / WORKGROUP_SIZE, 1, 1 );
+}
+
+/// Milliseconds per frame in one mode, until the last frame completed.
+double
+run( options const& opts, context const& ctx, bool async )
+{
+  myengine::vulkan::timeline_queue graphics(
+    ctx.device, ctx.queues.graphics.family, ctx.graphics_queue, "graphics" );
+  myengine::vulkan::timeline_queue transfer(
+    ctx.device, ctx.queues.transfer.family, ctx.transfer_queue, "transfer" );
+  myengine::vulkan::timeline_queue compute(
+    ctx.device, ctx.queues.compute.family, ctx.compute_queue, "compute" );
+  auto const wait_all = [ & ] {
+    graphics.wait_idle();
+    transfer.wait_idle();
+    compute.wait_idle();
+  };
+
+  // Graphics timeline value of each slot's latest frame. The host waits for
+  // it before reusing the slot, which also orders all of the slot's buffer
+  // reuse after that frame's reads.
+  uint64_t slot_done[ FRAME_SLOTS ] = {};
+  steady_clock_t::time_point start;
+  for( int i = 0; i < WARMUP_FRAMES + opts.frames; ++i )
+  {
+    if( i == WARMUP_FRAMES )
+    {
+      wait_all();
+      start = steady_clock_t::now();
+    }
+    uint32_t const slot = static_cast< uint32_t >( i ) % FRAME_SLOTS;
+    auto const& f = ctx.frames[ slot ];
+    graphics.wait( slot_done[ slot ] );
+
+    if( !async )
+    {
+      VkCommandBuffer const cmd = graphics.begin();
+      record_copy( ctx, cmd, f );
+      record_simulate( ctx, cmd, f, opts.iterations );
+      VkMemoryBarrier barrier = {};
+      barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask =
+        VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+      vkCmdPipelineBarrier( cmd,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT |
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                            &barrier, 0, nullptr, 0, nullptr );
+      record_render( ctx, cmd, f, opts.iterations );
+      slot_done[ slot ] = graphics.submit( cmd ).value;
+      continue;
+    }
+
+    VkCommandBuffer const copy_cmd = transfer.begin();
+    record_copy( ctx, copy_cmd, f );
+    auto const uploaded = transfer.submit( copy_cmd );
+
+    VkCommandBuffer const simulate_cmd = compute.begin();
+    record_simulate( ctx, simulate_cmd, f, opts.iterations );
+    auto const simulated = compute.submit( simulate_cmd );
+
+    // Semaphore waits make the other queues' writes visible as well.
+    VkCommandBuffer const render_cmd = graphics.begin();
+    record_render( ctx, render_cmd, f, opts.iterations );
+    slot_done[ slot ] =
+      graphics
+        .submit( render_cmd,
+                 { { uploaded, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT },
+                   { simulated, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT } } )
+        .value;
+  }
+  wait_all();
+  return ms_since( start ) / opts.frames;
+}
+
+VkInstance
+create_instance()
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "queue_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  // Timeline semaphores are core in 1.2.
+  app_info.apiVersion = API_VERSION;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Physical device to use.
+VkPhysicalDevice
+select_device( VkInstance instance, int index )
+{
+  auto const devices = myengine::vulkan::get_physical_devices( instance );
+  if( index < 0 )
+  {
+    for( VkPhysicalDevice d : devices )
+    {
+      auto const& props =
+        myengine::vulkan::get_device_capabilities( d ).properties;
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return d;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return devices[ index ];
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--frames N] [--copy-mib N] [--groups N] [--iterations N]"
+               " [--mode serial|async] [--device INDEX | --cpu]"
+            << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--frames" && has_value )
+      {
+        opts.frames = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--copy-mib" && has_value )
+      {
+        opts.copy_mib = std::max( 1ull, std::stoull( argv[ ++i ] ) );
+      }
+      else if( arg == "--groups" && has_value )
+      {
+        opts.groups = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--iterations" && has_value )
+      {
+        opts.iterations = static_cast< uint32_t >( std::stoul( argv[ ++i ] ) );
+      }
+      else if( arg == "--mode" && has_value )
+      {
+        opts.mode = argv[ ++i ];
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  if( !opts.mode.empty() && opts.mode != "serial" && opts.mode != "async" )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  auto const wanted = [ &opts ]( char const* name ) {
+    return opts.mode.empty() || opts.mode == name;
+  };
+
+  VkInstance instance = VK_NULL_HANDLE;
+  context ctx;
+  std::unique_ptr< myengine::vulkan::device_memory_allocator > allocator;
+  try
+  {
+    instance = create_instance();
+    ctx.physical_device = select_device( instance, opts.device );
+    auto const& caps =
+      myengine::vulkan::get_device_capabilities( ctx.physical_device );
+    LOGF_INFO( "Device: {}; {} frame(s), {} MiB copied, {} group(s) of {} "
+               "iteration(s) per dispatch",
+               caps.properties.deviceName, opts.frames, opts.copy_mib,
+               opts.groups, opts.iterations );
+    if( !myengine::vulkan::timeline_semaphores_supported(
+          ctx.physical_device ) )
+    {
+      throw std::runtime_error( "Timeline semaphores are not supported" );
+    }
+
+    // Rendering is a compute dispatch here, so the graphics family must
+    // support compute too, as at least one graphics family does.
+    auto const graphics_family = myengine::vulkan::find_queue_family(
+      caps.queue_families, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT );
+    if( !graphics_family )
+    {
+      throw std::runtime_error( "No graphics queue family" );
+    }
+    ctx.queues = myengine::vulkan::plan_queues(
+      caps.queue_families, *graphics_family, *graphics_family );
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features = {};
+    timeline_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timeline_features.timelineSemaphore = VK_TRUE;
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.pNext = &timeline_features;
+    device_info.queueCreateInfoCount =
+      static_cast< uint32_t >( ctx.queues.create_infos.size() );
+    device_info.pQueueCreateInfos = ctx.queues.create_infos.data();
+    check_result( vkCreateDevice( ctx.physical_device, &device_info, nullptr,
+                                  &ctx.device ),
+                  "create device" );
+    vkGetDeviceQueue( ctx.device, ctx.queues.graphics.family,
+                      ctx.queues.graphics.index, &ctx.graphics_queue );
+    vkGetDeviceQueue( ctx.device, ctx.queues.transfer.family,
+                      ctx.queues.transfer.index, &ctx.transfer_queue );
+    vkGetDeviceQueue( ctx.device, ctx.queues.compute.family,
+                      ctx.queues.compute.index, &ctx.compute_queue );
+    std::cout << "Queues: transfer "
+              << ( ctx.queues.dedicated_transfer() ? "dedicated" : "shared" )
+              << " (family " << ctx.queues.transfer.family << "), compute "
+              << ( ctx.queues.async_compute() ? "async" : "shared" )
+              << " (family " << ctx.queues.compute.family << ")\n";
+
+    myengine::vulkan::memory_allocator_config allocator_config;
+    allocator_config.api_version = API_VERSION;
+    allocator = std::make_unique< myengine::vulkan::device_memory_allocator >(
+      ctx.physical_device, ctx.device, allocator_config );
+    ctx.allocator = allocator.get();
+    ctx.copy_size = opts.copy_mib << 20;
+    ctx.elements = opts.groups * WORKGROUP_SIZE;
+    create_resources( ctx );
+
+    std::cout << std::left << std::setw( 10 ) << "mode" << std::right
+              << std::setw( 12 ) << "ms/frame" << std::setw( 12 )
+              << "frames/s" << std::setw( 10 ) << "speedup" << '\n';
+    double serial_ms = 0.;
+    for( char const* mode : { "serial", "async" } )
+    {
+      if( !wanted( mode ) )
+      {
+        continue;
+      }
+      bool const async = std::string( mode ) == "async";
+      double const ms = run( opts, ctx, async );
+      if( !async )
+      {
+        serial_ms = ms;
+      }
+      std::cout << std::left << std::setw( 10 ) << mode << std::right
+                << std::fixed << std::setprecision( 3 ) << std::setw( 12 )
+                << ms << std::setprecision( 1 ) << std::setw( 12 )
+                << ( ms > 0. ? 1000. / ms : 0. ) << std::setprecision( 2 )
+                << std::setw( 10 )
+                << ( serial_ms > 0. && ms > 0. ? serial_ms / ms : 1. )
+                << std::endl;
+    }
+
+    destroy_resources( ctx );
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "{}", e.what() );
+    if( ctx.device != VK_NULL_HANDLE )
+    {
+      vkDeviceWaitIdle( ctx.device );
+      if( allocator )
+      {
+        destroy_resources( ctx );
+      }
+      allocator.reset();
+      vkDestroyDevice( ctx.device, nullptr );
+    }
+    vkDestroyInstance( instance, nullptr );
+    return EXIT_FAILURE;
+  }
+  allocator.reset();
+  vkDestroyDevice( ctx.device, nullptr );
+  vkDestroyInstance( instance, nullptr );
+  return EXIT_SUCCESS;
+}
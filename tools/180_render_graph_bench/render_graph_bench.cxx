@@ -0,0 +1,553 @@
+/**
+ * Benchmark of `myengine::vulkan::render_graph`: barriers planned per frame,
+ * memory saved by aliasing transient images, and the cost of recording.
+ *
+ * The graph clears a transient image, then runs `--chain` passes that each
+ * copy the previous pass's image into a new transient image, and finally
+ * copies the last one into an imported buffer. A debug pass copying one of
+ * the intermediate images nowhere is culled. Images two passes apart have
+ * disjoint lifetimes, so with aliasing the chain fits in the memory of two
+ * images. It runs for `--frames` frames per mode:
+ *   - `aliased`: transient images share memory where they can,
+ *   - `separate`: every transient image has memory of its own.
+ * Two frames are in flight.
+ *
+ * Barriers are recorded with `vkCmdPipelineBarrier2KHR` where the device
+ * supports `VK_KHR_synchronization2`, otherwise with `vkCmdPipelineBarrier`.
+ *
+ * No window or surface is involved, so this runs headless and against a CPU
+ * implementation:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     myengine_render_graph_bench --cpu
+ *
+ * Usage: myengine_render_graph_bench [--frames N] [--size N] [--chain N]
+ *          [--mode aliased|separate] [--device INDEX | --cpu]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/memory_allocator.h>
+#include <myengine/queues.h>
+#include <myengine/render_graph.h>
+#include <myengine/vulkan.h>
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Vulkan version the instance is created for.
+constexpr uint32_t API_VERSION = VK_API_VERSION_1_2;
+
+/// Frames in flight, each with its own command buffer.
+constexpr uint32_t FRAME_SLOTS = 2;
+
+/// Frames run before timing starts, per mode.
+constexpr int WARMUP_FRAMES = 5;
+
+/// Transient images are RGBA8.
+constexpr VkDeviceSize BYTES_PER_PIXEL = 4;
+
+struct options
+{
+  int frames = 200;
+  /// Width and height of the transient images.
+  uint32_t size = 1024;
+  /// Copy passes between the clear and the output.
+  uint32_t chain = 8;
+  std::string mode;  // Both when empty.
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+};
+
+struct context
+{
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t queue_family = 0;
+  VkQueue queue = VK_NULL_HANDLE;
+  bool synchronization2 = false;
+  myengine::vulkan::device_memory_allocator* allocator = nullptr;
+
+  /// Receives the last image of the chain.
+  VkBuffer output = VK_NULL_HANDLE;
+  myengine::vulkan::memory_allocation output_memory;
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+  VkCommandBuffer cmds[ FRAME_SLOTS ] = {};
+  VkFence fences[ FRAME_SLOTS ] = {};
+};
+
+struct result
+{
+  myengine::vulkan::render_graph_stats stats;
+  /// Mean time spent in `render_graph::execute` per frame.
+  double record_us;
+  double frame_ms;
+};
+
+double
+ms_since( steady_clock_t::time_point start )
+{
+  return std::chrono::duration< double, std::milli >(
+    steady_clock_t::now() - start ).count();
+}
+
+/// Output buffer, command buffers and fences.
+void
+create_resources( context& ctx, options const& opts )
+{
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = VkDeviceSize( opts.size ) * opts.size * BYTES_PER_PIXEL;
+  buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  check_result( vkCreateBuffer( ctx.device, &buffer_info, nullptr,
+                                &ctx.output ),
+                "create output buffer" );
+  ctx.output_memory = ctx.allocator->allocate_buffer(
+    ctx.output, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
+
+  VkCommandPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = ctx.queue_family;
+  check_result( vkCreateCommandPool( ctx.device, &pool_info, nullptr,
+                                     &ctx.command_pool ),
+                "create command pool" );
+  VkCommandBufferAllocateInfo cmd_info = {};
+  cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_info.commandPool = ctx.command_pool;
+  cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmd_info.commandBufferCount = FRAME_SLOTS;
+  check_result( vkAllocateCommandBuffers( ctx.device, &cmd_info, ctx.cmds ),
+                "allocate command buffers" );
+  VkFenceCreateInfo fence_info = {};
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  for( auto& fence : ctx.fences )
+  {
+    check_result( vkCreateFence( ctx.device, &fence_info, nullptr, &fence ),
+                  "create fence" );
+  }
+}
+
+void
+destroy_resources( context& ctx )
+{
+  for( auto& fence : ctx.fences )
+  {
+    vkDestroyFence( ctx.device, fence, nullptr );
+    fence = VK_NULL_HANDLE;
+  }
+  vkDestroyCommandPool( ctx.device, ctx.command_pool, nullptr );
+  ctx.command_pool = VK_NULL_HANDLE;
+  vkDestroyBuffer( ctx.device, ctx.output, nullptr );
+  ctx.output = VK_NULL_HANDLE;
+  ctx.allocator->free( ctx.output_memory );
+  ctx.output_memory = {};
+}
+
+void
+record_copy( VkCommandBuffer cmd, VkImage src, VkImage dst, uint32_t size )
+{
+  VkImageCopy region = {};
+  region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.srcSubresource.layerCount = 1;
+  region.dstSubresource = region.srcSubresource;
+  region.extent = { size, size, 1 };
+  vkCmdCopyImage( cmd, src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst,
+                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region );
+}
+
+/// The clear, the chain of copies, the culled debug pass and the output.
+void
+build_graph( myengine::vulkan::render_graph& graph, options const& opts,
+             myengine::vulkan::render_graph::resource_t& output )
+{
+  using myengine::vulkan::render_graph;
+  using myengine::vulkan::resource_usage;
+  uint32_t const size = opts.size;
+
+  myengine::vulkan::transient_image_desc desc;
+  desc.extent = { size, size };
+  std::vector< render_graph::resource_t > images;
+  for( uint32_t i = 0; i <= opts.chain; ++i )
+  {
+    images.push_back(
+      graph.create_image( "image " + std::to_string( i ), desc ) );
+  }
+  // Written only by the graph; read by the host, say, after the frame.
+  output = graph.import_buffer(
+    "output", { VK_IMAGE_LAYOUT_UNDEFINED, 0, 0 },
+    { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_HOST_BIT,
+      VK_ACCESS_HOST_READ_BIT } );
+
+  auto const first = images.front();
+  graph
+    .add_pass( "clear",
+               [ first ]( VkCommandBuffer cmd, render_graph const& g ) {
+                 VkClearColorValue color = {};
+                 color.float32[ 0 ] = 1.f;
+                 color.float32[ 3 ] = 1.f;
+                 VkImageSubresourceRange range = {};
+                 range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                 range.levelCount = 1;
+                 range.layerCount = 1;
+                 vkCmdClearColorImage( cmd, g.image( first ),
+                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                       &color, 1, &range );
+               } )
+    .write( first, resource_usage::transfer_dst );
+  for( uint32_t i = 1; i <= opts.chain; ++i )
+  {
+    auto const src = images[ i - 1 ];
+    auto const dst = images[ i ];
+    graph
+      .add_pass( "copy " + std::to_string( i ),
+                 [ src, dst, size ]( VkCommandBuffer cmd,
+                                     render_graph const& g ) {
+                   record_copy( cmd, g.image( src ), g.image( dst ), size );
+                 } )
+      .read( src, resource_usage::transfer_src )
+      .write( dst, resource_usage::transfer_dst );
+  }
+
+  // Nothing reads its result, so it is culled, and its image not created.
+  auto const debug = graph.create_image( "debug", desc );
+  auto const middle = images[ opts.chain / 2 ];
+  graph
+    .add_pass( "debug",
+               [ middle, debug, size ]( VkCommandBuffer cmd,
+                                        render_graph const& g ) {
+                 record_copy( cmd, g.image( middle ), g.image( debug ),
+                              size );
+               } )
+    .read( middle, resource_usage::transfer_src )
+    .write( debug, resource_usage::transfer_dst );
+
+  auto const last = images.back();
+  graph
+    .add_pass( "output",
+               [ last, output, size ]( VkCommandBuffer cmd,
+                                       render_graph const& g ) {
+                 VkBufferImageCopy region = {};
+                 region.imageSubresource.aspectMask =
+                   VK_IMAGE_ASPECT_COLOR_BIT;
+                 region.imageSubresource.layerCount = 1;
+                 region.imageExtent = { size, size, 1 };
+                 vkCmdCopyImageToBuffer( cmd, g.image( last ),
+                                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                         g.buffer( output ), 1, &region );
+               } )
+    .read( last, resource_usage::transfer_src )
+    .write( output, resource_usage::transfer_dst );
+}
+
+/// Run `opts.frames` frames of the graph, after a warmup.
+result
+run( options const& opts, context& ctx, bool aliasing )
+{
+  myengine::vulkan::render_graph_config config;
+  config.synchronization2 = ctx.synchronization2;
+  config.aliasing = aliasing;
+  myengine::vulkan::render_graph graph( ctx.device, *ctx.allocator, config );
+  myengine::vulkan::render_graph::resource_t output;
+  build_graph( graph, opts, output );
+  graph.compile();
+  graph.set_buffer( output, ctx.output );
+
+  auto const wait_all = [ &ctx ]() {
+    check_result( vkWaitForFences( ctx.device, FRAME_SLOTS, ctx.fences, VK_TRUE,
+                                   UINT64_MAX ),
+                  "wait for frames" );
+  };
+
+  double record_ms = 0.;
+  steady_clock_t::time_point start;
+  for( int i = -WARMUP_FRAMES; i < opts.frames; ++i )
+  {
+    if( i == 0 )
+    {
+      wait_all();
+      record_ms = 0.;
+      start = steady_clock_t::now();
+    }
+    uint32_t const slot =
+      static_cast< uint32_t >( i + WARMUP_FRAMES ) % FRAME_SLOTS;
+    check_result( vkWaitForFences( ctx.device, 1, &ctx.fences[ slot ], VK_TRUE,
+                                   UINT64_MAX ),
+                  "wait for frame" );
+    check_result( vkResetFences( ctx.device, 1, &ctx.fences[ slot ] ),
+                  "reset fence" );
+
+    VkCommandBuffer const cmd = ctx.cmds[ slot ];
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    check_result( vkBeginCommandBuffer( cmd, &begin_info ),
+                  "begin command buffer" );
+    auto const record_start = steady_clock_t::now();
+    graph.execute( cmd );
+    record_ms += ms_since( record_start );
+    check_result( vkEndCommandBuffer( cmd ), "end command buffer" );
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd;
+    check_result( vkQueueSubmit( ctx.queue, 1, &submit_info,
+                                 ctx.fences[ slot ] ),
+                  "submit frame" );
+  }
+  wait_all();
+  return { graph.stats(), 1000. * record_ms / opts.frames,
+           ms_since( start ) / opts.frames };
+}
+
+VkInstance
+create_instance()
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "render_graph_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  // For querying the synchronization2 feature.
+  app_info.apiVersion = API_VERSION;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Physical device to use.
+VkPhysicalDevice
+select_device( VkInstance instance, int index )
+{
+  auto const devices = myengine::vulkan::get_physical_devices( instance );
+  if( index < 0 )
+  {
+    for( VkPhysicalDevice d : devices )
+    {
+      auto const& props =
+        myengine::vulkan::get_device_capabilities( d ).properties;
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return d;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return devices[ index ];
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--frames N] [--size N] [--chain N]"
+               " [--mode aliased|separate] [--device INDEX | --cpu]"
+            << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--frames" && has_value )
+      {
+        opts.frames = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--size" && has_value )
+      {
+        opts.size = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--chain" && has_value )
+      {
+        opts.chain = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--mode" && has_value )
+      {
+        opts.mode = argv[ ++i ];
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  if( !opts.mode.empty() && opts.mode != "aliased" &&
+      opts.mode != "separate" )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  auto const wanted = [ &opts ]( char const* name ) {
+    return opts.mode.empty() || opts.mode == name;
+  };
+
+  VkInstance instance = VK_NULL_HANDLE;
+  context ctx;
+  std::unique_ptr< myengine::vulkan::device_memory_allocator > allocator;
+  try
+  {
+    instance = create_instance();
+    ctx.physical_device = select_device( instance, opts.device );
+    auto const& caps =
+      myengine::vulkan::get_device_capabilities( ctx.physical_device );
+    LOGF_INFO( "Device: {}; {} frame(s) of {} copies of {}x{} images",
+               caps.properties.deviceName, opts.frames, opts.chain,
+               opts.size, opts.size );
+
+    auto const family = myengine::vulkan::find_queue_family(
+      caps.queue_families, VK_QUEUE_GRAPHICS_BIT );
+    if( !family )
+    {
+      throw std::runtime_error( "No graphics queue family" );
+    }
+    ctx.queue_family = *family;
+    ctx.synchronization2 =
+      myengine::vulkan::synchronization2_supported( ctx.physical_device );
+
+    float const priority = 1.f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = ctx.queue_family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    char const* const sync2_extension = VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME;
+    VkPhysicalDeviceSynchronization2FeaturesKHR sync2_features = {};
+    sync2_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    sync2_features.synchronization2 = VK_TRUE;
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    if( ctx.synchronization2 )
+    {
+      device_info.pNext = &sync2_features;
+      device_info.enabledExtensionCount = 1;
+      device_info.ppEnabledExtensionNames = &sync2_extension;
+    }
+    check_result( vkCreateDevice( ctx.physical_device, &device_info, nullptr,
+                                  &ctx.device ),
+                  "create device" );
+    vkGetDeviceQueue( ctx.device, ctx.queue_family, 0, &ctx.queue );
+    std::cout << "Barriers: "
+              << ( ctx.synchronization2 ? "vkCmdPipelineBarrier2KHR"
+                                        : "vkCmdPipelineBarrier" )
+              << '\n';
+
+    myengine::vulkan::memory_allocator_config allocator_config;
+    allocator_config.api_version = API_VERSION;
+    allocator = std::make_unique< myengine::vulkan::device_memory_allocator >(
+      ctx.physical_device, ctx.device, allocator_config );
+    ctx.allocator = allocator.get();
+    create_resources( ctx, opts );
+
+    std::cout << std::left << std::setw( 10 ) << "mode" << std::right
+              << std::setw( 8 ) << "passes" << std::setw( 8 ) << "culled"
+              << std::setw( 10 ) << "barriers" << std::setw( 9 )
+              << "batches" << std::setw( 14 ) << "transient MiB"
+              << std::setw( 15 ) << "allocated MiB" << std::setw( 11 )
+              << "saved MiB" << std::setw( 11 ) << "record us"
+              << std::setw( 10 ) << "ms/frame" << '\n';
+    for( char const* mode : { "aliased", "separate" } )
+    {
+      if( !wanted( mode ) )
+      {
+        continue;
+      }
+      bool const aliasing = std::string( mode ) == "aliased";
+      result const r = run( opts, ctx, aliasing );
+      double const mib = 1. / ( 1 << 20 );
+      std::cout << std::left << std::setw( 10 ) << mode << std::right
+                << std::setw( 8 ) << r.stats.passes << std::setw( 8 )
+                << r.stats.culled << std::setw( 10 ) << r.stats.barriers
+                << std::setw( 9 ) << r.stats.barrier_batches << std::fixed
+                << std::setprecision( 1 ) << std::setw( 14 )
+                << r.stats.transient_bytes * mib << std::setw( 15 )
+                << r.stats.allocated_bytes * mib << std::setw( 11 )
+                << r.stats.aliasing_saved_bytes * mib
+                << std::setprecision( 2 ) << std::setw( 11 ) << r.record_us
+                << std::setprecision( 3 ) << std::setw( 10 ) << r.frame_ms
+                << std::endl;
+    }
+
+    destroy_resources( ctx );
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "{}", e.what() );
+    if( ctx.device != VK_NULL_HANDLE )
+    {
+      vkDeviceWaitIdle( ctx.device );
+      if( allocator )
+      {
+        destroy_resources( ctx );
+      }
+      allocator.reset();
+      vkDestroyDevice( ctx.device, nullptr );
+    }
+    vkDestroyInstance( instance, nullptr );
+    return EXIT_FAILURE;
+  }
+  allocator.reset();
+  vkDestroyDevice( ctx.device, nullptr );
+  vkDestroyInstance( instance, nullptr );
+  return EXIT_SUCCESS;
+}
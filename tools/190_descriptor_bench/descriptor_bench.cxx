@@ -0,0 +1,721 @@
+/**
+ * Benchmark of the CPU cost of giving draws their descriptors, per draw and
+ * per frame, against `myengine::vulkan::descriptor_heap`.
+ *
+ * Each of `--frames` frames records `--draws` draws' worth of descriptor
+ * binding, for objects with one texture and one storage buffer each:
+ *   - `pooled`: a set per draw, allocated from the frame slot's pool, written
+ *     and bound; the pool is reset when the slot comes around,
+ *   - `cached`: a set per object, written once up front, bound per draw,
+ *   - `bindless`: the heap's set bound once per frame, and per draw the
+ *     object's two indices as push constants.
+ * No draw commands are recorded, so only the binding cost is measured.
+ * In `bindless` mode, `--churn` objects per frame are also removed from and
+ * added back to the heap, as with streamed textures; the heap's flush is part
+ * of the frame.
+ *
+ * The heap uses descriptor indexing where the device supports it, unless
+ * `--no-indexing` is given; it then keeps one set per frame slot, and the
+ * number of objects is clamped to what that can hold.
+ *
+ * No window or surface is involved, so this runs headless and against a CPU
+ * implementation:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     myengine_descriptor_bench --cpu
+ *
+ * Usage: myengine_descriptor_bench [--frames N] [--draws N] [--objects N]
+ *          [--churn N] [--mode pooled|cached|bindless] [--no-indexing]
+ *          [--device INDEX | --cpu]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/descriptor_heap.h>
+#include <myengine/logging.h>
+#include <myengine/memory_allocator.h>
+#include <myengine/queues.h>
+#include <myengine/vulkan.h>
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Vulkan version the instance is created for.
+constexpr uint32_t API_VERSION = VK_API_VERSION_1_2;
+
+/// Frames in flight, each with its own command buffer and pool.
+constexpr uint32_t FRAME_SLOTS = 2;
+
+/// Frames run before timing starts, per mode.
+constexpr int WARMUP_FRAMES = 5;
+
+/// Bytes of each object's storage buffer range.
+constexpr VkDeviceSize OBJECT_BUFFER_SIZE = 256;
+
+struct options
+{
+  int frames = 200;
+  uint32_t draws = 10000;
+  /// Distinct objects the draws cycle through.
+  uint32_t objects = 1000;
+  /// Objects re-added to the heap per frame.
+  uint32_t churn = 16;
+  std::string mode;  // All when empty.
+  bool indexing = true;
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+};
+
+struct context
+{
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t queue_family = 0;
+  VkQueue queue = VK_NULL_HANDLE;
+  bool descriptor_indexing = false;
+  myengine::vulkan::device_memory_allocator* allocator = nullptr;
+
+  /// What every object's descriptors point to; they differ only in which
+  /// index or set holds them.
+  VkImage image = VK_NULL_HANDLE;
+  myengine::vulkan::memory_allocation image_memory;
+  VkImageView view = VK_NULL_HANDLE;
+  VkSampler sampler = VK_NULL_HANDLE;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  myengine::vulkan::memory_allocation buffer_memory;
+
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+  VkCommandBuffer cmds[ FRAME_SLOTS ] = {};
+  VkFence fences[ FRAME_SLOTS ] = {};
+};
+
+/// Per draw push constants in `bindless` mode.
+struct draw_indices
+{
+  uint32_t texture;
+  uint32_t buffer;
+};
+
+struct result
+{
+  double record_us;
+  double draw_ns;
+  double frame_ms;
+  /// Descriptors written per frame.
+  double writes;
+};
+
+double
+ms_since( steady_clock_t::time_point start )
+{
+  return std::chrono::duration< double, std::milli >(
+    steady_clock_t::now() - start ).count();
+}
+
+/// The objects' texture and buffer, command buffers and fences.
+void
+create_resources( context& ctx )
+{
+  VkImageCreateInfo image_info = {};
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+  image_info.extent = { 4, 4, 1 };
+  image_info.mipLevels = 1;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  check_result( vkCreateImage( ctx.device, &image_info, nullptr, &ctx.image ),
+                "create image" );
+  ctx.image_memory = ctx.allocator->allocate_image(
+    ctx.image, VK_IMAGE_TILING_OPTIMAL, 0,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+  VkImageViewCreateInfo view_info = {};
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.image = ctx.image;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = image_info.format;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  view_info.subresourceRange.levelCount = 1;
+  view_info.subresourceRange.layerCount = 1;
+  check_result( vkCreateImageView( ctx.device, &view_info, nullptr, &ctx.view ),
+                "create image view" );
+  VkSamplerCreateInfo sampler_info = {};
+  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sampler_info.magFilter = VK_FILTER_LINEAR;
+  sampler_info.minFilter = VK_FILTER_LINEAR;
+  check_result( vkCreateSampler( ctx.device, &sampler_info, nullptr,
+                                 &ctx.sampler ),
+                "create sampler" );
+
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = OBJECT_BUFFER_SIZE;
+  buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  check_result( vkCreateBuffer( ctx.device, &buffer_info, nullptr,
+                                &ctx.buffer ),
+                "create buffer" );
+  ctx.buffer_memory = ctx.allocator->allocate_buffer(
+    ctx.buffer, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+
+  VkCommandPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = ctx.queue_family;
+  check_result( vkCreateCommandPool( ctx.device, &pool_info, nullptr,
+                                     &ctx.command_pool ),
+                "create command pool" );
+  VkCommandBufferAllocateInfo cmd_info = {};
+  cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_info.commandPool = ctx.command_pool;
+  cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmd_info.commandBufferCount = FRAME_SLOTS;
+  check_result( vkAllocateCommandBuffers( ctx.device, &cmd_info, ctx.cmds ),
+                "allocate command buffers" );
+  VkFenceCreateInfo fence_info = {};
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  for( auto& fence : ctx.fences )
+  {
+    check_result( vkCreateFence( ctx.device, &fence_info, nullptr, &fence ),
+                  "create fence" );
+  }
+}
+
+void
+destroy_resources( context& ctx )
+{
+  for( auto& fence : ctx.fences )
+  {
+    vkDestroyFence( ctx.device, fence, nullptr );
+    fence = VK_NULL_HANDLE;
+  }
+  vkDestroyCommandPool( ctx.device, ctx.command_pool, nullptr );
+  ctx.command_pool = VK_NULL_HANDLE;
+  vkDestroyBuffer( ctx.device, ctx.buffer, nullptr );
+  ctx.buffer = VK_NULL_HANDLE;
+  ctx.allocator->free( ctx.buffer_memory );
+  ctx.buffer_memory = {};
+  vkDestroySampler( ctx.device, ctx.sampler, nullptr );
+  ctx.sampler = VK_NULL_HANDLE;
+  vkDestroyImageView( ctx.device, ctx.view, nullptr );
+  ctx.view = VK_NULL_HANDLE;
+  vkDestroyImage( ctx.device, ctx.image, nullptr );
+  ctx.image = VK_NULL_HANDLE;
+  ctx.allocator->free( ctx.image_memory );
+  ctx.image_memory = {};
+}
+
+/// A classic per object layout and pipeline layout, for `pooled` and
+/// `cached`.
+struct classic_layouts
+{
+  VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+  VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+  /// One per frame slot for `pooled`, or one for all objects for `cached`.
+  std::vector< VkDescriptorPool > pools;
+  std::vector< VkDescriptorSet > sets;
+};
+
+void
+create_classic( context const& ctx, classic_layouts& c, uint32_t pools,
+                uint32_t sets_per_pool )
+{
+  VkDescriptorSetLayoutBinding bindings[ 2 ] = {};
+  bindings[ 0 ].binding = 0;
+  bindings[ 0 ].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[ 0 ].descriptorCount = 1;
+  bindings[ 0 ].stageFlags = VK_SHADER_STAGE_ALL;
+  bindings[ 1 ].binding = 1;
+  bindings[ 1 ].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[ 1 ].descriptorCount = 1;
+  bindings[ 1 ].stageFlags = VK_SHADER_STAGE_ALL;
+  VkDescriptorSetLayoutCreateInfo layout_info = {};
+  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layout_info.bindingCount = 2;
+  layout_info.pBindings = bindings;
+  check_result( vkCreateDescriptorSetLayout( ctx.device, &layout_info, nullptr,
+                                             &c.set_layout ),
+                "create descriptor set layout" );
+  VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.setLayoutCount = 1;
+  pipeline_layout_info.pSetLayouts = &c.set_layout;
+  check_result( vkCreatePipelineLayout( ctx.device, &pipeline_layout_info,
+                                        nullptr, &c.pipeline_layout ),
+                "create pipeline layout" );
+
+  VkDescriptorPoolSize const sizes[ 2 ] = {
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sets_per_pool },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, sets_per_pool } };
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.maxSets = sets_per_pool;
+  pool_info.poolSizeCount = 2;
+  pool_info.pPoolSizes = sizes;
+  c.pools.resize( pools, VK_NULL_HANDLE );
+  for( auto& pool : c.pools )
+  {
+    check_result( vkCreateDescriptorPool( ctx.device, &pool_info, nullptr,
+                                          &pool ),
+                  "create descriptor pool" );
+  }
+}
+
+void
+destroy_classic( context const& ctx, classic_layouts& c )
+{
+  for( auto pool : c.pools )
+  {
+    vkDestroyDescriptorPool( ctx.device, pool, nullptr );
+  }
+  c.pools.clear();
+  c.sets.clear();
+  vkDestroyPipelineLayout( ctx.device, c.pipeline_layout, nullptr );
+  vkDestroyDescriptorSetLayout( ctx.device, c.set_layout, nullptr );
+  c = classic_layouts();
+}
+
+/// Allocate a set for an object from `pool` and write its descriptors.
+VkDescriptorSet
+write_object_set( context const& ctx, VkDescriptorPool pool,
+                  VkDescriptorSetLayout layout )
+{
+  VkDescriptorSetAllocateInfo alloc_info = {};
+  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_info.descriptorPool = pool;
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &layout;
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  check_result( vkAllocateDescriptorSets( ctx.device, &alloc_info, &set ),
+                "allocate descriptor set" );
+
+  VkDescriptorImageInfo const image = {
+    ctx.sampler, ctx.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+  VkDescriptorBufferInfo const buffer = { ctx.buffer, 0, OBJECT_BUFFER_SIZE };
+  VkWriteDescriptorSet writes[ 2 ] = {};
+  writes[ 0 ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  writes[ 0 ].dstSet = set;
+  writes[ 0 ].dstBinding = 0;
+  writes[ 0 ].descriptorCount = 1;
+  writes[ 0 ].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  writes[ 0 ].pImageInfo = &image;
+  writes[ 1 ] = writes[ 0 ];
+  writes[ 1 ].dstBinding = 1;
+  writes[ 1 ].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  writes[ 1 ].pImageInfo = nullptr;
+  writes[ 1 ].pBufferInfo = &buffer;
+  vkUpdateDescriptorSets( ctx.device, 2, writes, 0, nullptr );
+  return set;
+}
+
+/// Run `opts.frames` frames in `mode`, after a warmup.
+result
+run( options const& opts, context& ctx, std::string const& mode )
+{
+  bool const pooled = mode == "pooled";
+  bool const cached = mode == "cached";
+  uint32_t objects = opts.objects;
+  uint32_t churn = opts.churn;
+
+  classic_layouts classic;
+  std::unique_ptr< myengine::vulkan::descriptor_heap > heap;
+  std::vector< draw_indices > indices;
+  uint64_t writes = 0;
+  if( pooled )
+  {
+    create_classic( ctx, classic, FRAME_SLOTS, opts.draws );
+  }
+  else if( cached )
+  {
+    create_classic( ctx, classic, 1, objects );
+    for( uint32_t i = 0; i < objects; ++i )
+    {
+      classic.sets.push_back(
+        write_object_set( ctx, classic.pools[ 0 ], classic.set_layout ) );
+    }
+  }
+  else
+  {
+    // Removed indices are reused only once the frames in flight completed.
+    uint32_t const headroom = churn * ( FRAME_SLOTS + 1 );
+    myengine::vulkan::descriptor_heap_config config;
+    config.textures = objects + headroom;
+    config.buffers = objects + headroom;
+    config.frames_in_flight = FRAME_SLOTS;
+    config.push_constant_size = sizeof( draw_indices );
+    config.descriptor_indexing = ctx.descriptor_indexing;
+    heap = std::make_unique< myengine::vulkan::descriptor_heap >(
+      ctx.physical_device, ctx.device, config );
+    // Without descriptor indexing every index must hold a descriptor.
+    heap->set_placeholder_texture( ctx.view, ctx.sampler );
+    heap->set_placeholder_buffer( ctx.buffer, 0, OBJECT_BUFFER_SIZE );
+    uint32_t const capacity =
+      std::min( heap->texture_capacity(), heap->buffer_capacity() );
+    churn = std::min( churn, capacity / ( 2 * ( FRAME_SLOTS + 1 ) ) );
+    objects = std::min( objects, capacity - churn * ( FRAME_SLOTS + 1 ) );
+    for( uint32_t i = 0; i < objects; ++i )
+    {
+      indices.push_back(
+        { heap->add_texture( ctx.view, ctx.sampler ),
+          heap->add_buffer( ctx.buffer, 0, OBJECT_BUFFER_SIZE ) } );
+    }
+  }
+
+  auto const wait_all = [ &ctx ]() {
+    check_result( vkWaitForFences( ctx.device, FRAME_SLOTS, ctx.fences, VK_TRUE,
+                                   UINT64_MAX ),
+                  "wait for frames" );
+  };
+
+  double record_ms = 0.;
+  steady_clock_t::time_point start;
+  uint32_t churned = 0;
+  try
+  {
+    for( int f = -WARMUP_FRAMES; f < opts.frames; ++f )
+    {
+      if( f == 0 )
+      {
+        wait_all();
+        record_ms = 0.;
+        writes = heap ? heap->stats().descriptor_writes : 0;
+        start = steady_clock_t::now();
+      }
+      uint32_t const slot =
+        static_cast< uint32_t >( f + WARMUP_FRAMES ) % FRAME_SLOTS;
+      check_result( vkWaitForFences( ctx.device, 1, &ctx.fences[ slot ],
+                                     VK_TRUE, UINT64_MAX ),
+                    "wait for frame" );
+      check_result( vkResetFences( ctx.device, 1, &ctx.fences[ slot ] ),
+                    "reset fence" );
+
+      VkCommandBuffer const cmd = ctx.cmds[ slot ];
+      VkCommandBufferBeginInfo begin_info = {};
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      check_result( vkBeginCommandBuffer( cmd, &begin_info ),
+                    "begin command buffer" );
+
+      auto const record_start = steady_clock_t::now();
+      if( pooled )
+      {
+        VkDescriptorPool const pool = classic.pools[ slot ];
+        check_result( vkResetDescriptorPool( ctx.device, pool, 0 ),
+                      "reset descriptor pool" );
+        for( uint32_t d = 0; d < opts.draws; ++d )
+        {
+          VkDescriptorSet const set =
+            write_object_set( ctx, pool, classic.set_layout );
+          vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                   classic.pipeline_layout, 0, 1, &set, 0,
+                                   nullptr );
+        }
+        writes += 2 * opts.draws;
+      }
+      else if( cached )
+      {
+        for( uint32_t d = 0; d < opts.draws; ++d )
+        {
+          vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                   classic.pipeline_layout, 0, 1,
+                                   &classic.sets[ d % objects ], 0, nullptr );
+        }
+      }
+      else
+      {
+        heap->begin_frame( slot );
+        // Streaming: replace some objects' descriptors.
+        for( uint32_t c = 0; c < churn; ++c )
+        {
+          auto& object = indices[ churned++ % objects ];
+          heap->remove_texture( object.texture );
+          heap->remove_buffer( object.buffer );
+          object = { heap->add_texture( ctx.view, ctx.sampler ),
+                     heap->add_buffer( ctx.buffer, 0, OBJECT_BUFFER_SIZE ) };
+        }
+        heap->bind( cmd, VK_PIPELINE_BIND_POINT_GRAPHICS );
+        for( uint32_t d = 0; d < opts.draws; ++d )
+        {
+          vkCmdPushConstants( cmd, heap->pipeline_layout(),
+                              VK_SHADER_STAGE_ALL, 0, sizeof( draw_indices ),
+                              &indices[ d % objects ] );
+        }
+      }
+      record_ms += ms_since( record_start );
+      check_result( vkEndCommandBuffer( cmd ), "end command buffer" );
+
+      VkSubmitInfo submit_info = {};
+      submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submit_info.commandBufferCount = 1;
+      submit_info.pCommandBuffers = &cmd;
+      check_result( vkQueueSubmit( ctx.queue, 1, &submit_info,
+                                   ctx.fences[ slot ] ),
+                    "submit frame" );
+    }
+    wait_all();
+  }
+  catch( ... )
+  {
+    vkDeviceWaitIdle( ctx.device );
+    heap.reset();
+    destroy_classic( ctx, classic );
+    throw;
+  }
+  double const frame_ms = ms_since( start ) / opts.frames;
+  if( heap )
+  {
+    writes = heap->stats().descriptor_writes - writes;
+  }
+  heap.reset();
+  destroy_classic( ctx, classic );
+  return { 1000. * record_ms / opts.frames,
+           1e6 * record_ms / opts.frames / opts.draws, frame_ms,
+           double( writes ) / opts.frames };
+}
+
+VkInstance
+create_instance()
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "descriptor_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  // For the descriptor indexing features.
+  app_info.apiVersion = API_VERSION;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Physical device to use.
+VkPhysicalDevice
+select_device( VkInstance instance, int index )
+{
+  auto const devices = myengine::vulkan::get_physical_devices( instance );
+  if( index < 0 )
+  {
+    for( VkPhysicalDevice d : devices )
+    {
+      auto const& props =
+        myengine::vulkan::get_device_capabilities( d ).properties;
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return d;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return devices[ index ];
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--frames N] [--draws N] [--objects N] [--churn N]"
+               " [--mode pooled|cached|bindless] [--no-indexing]"
+               " [--device INDEX | --cpu]"
+            << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--frames" && has_value )
+      {
+        opts.frames = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--draws" && has_value )
+      {
+        opts.draws = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--objects" && has_value )
+      {
+        opts.objects = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--churn" && has_value )
+      {
+        opts.churn = static_cast< uint32_t >( std::stoul( argv[ ++i ] ) );
+      }
+      else if( arg == "--mode" && has_value )
+      {
+        opts.mode = argv[ ++i ];
+      }
+      else if( arg == "--no-indexing" )
+      {
+        opts.indexing = false;
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  char const* const modes[] = { "pooled", "cached", "bindless" };
+  if( !opts.mode.empty() &&
+      std::find( std::begin( modes ), std::end( modes ), opts.mode ) ==
+        std::end( modes ) )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  VkInstance instance = VK_NULL_HANDLE;
+  context ctx;
+  std::unique_ptr< myengine::vulkan::device_memory_allocator > allocator;
+  try
+  {
+    instance = create_instance();
+    ctx.physical_device = select_device( instance, opts.device );
+    auto const& caps =
+      myengine::vulkan::get_device_capabilities( ctx.physical_device );
+    LOGF_INFO( "Device: {}; {} frame(s) of {} draw(s) over {} object(s)",
+               caps.properties.deviceName, opts.frames, opts.draws,
+               opts.objects );
+
+    auto const family = myengine::vulkan::find_queue_family(
+      caps.queue_families, VK_QUEUE_GRAPHICS_BIT );
+    if( !family )
+    {
+      throw std::runtime_error( "No graphics queue family" );
+    }
+    ctx.queue_family = *family;
+    ctx.descriptor_indexing =
+      opts.indexing &&
+      myengine::vulkan::descriptor_indexing_supported( ctx.physical_device );
+
+    float const priority = 1.f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = ctx.queue_family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    VkPhysicalDeviceDescriptorIndexingFeatures indexing_features =
+      myengine::vulkan::descriptor_indexing_features();
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    if( ctx.descriptor_indexing )
+    {
+      device_info.pNext = &indexing_features;
+    }
+    check_result( vkCreateDevice( ctx.physical_device, &device_info, nullptr,
+                                  &ctx.device ),
+                  "create device" );
+    vkGetDeviceQueue( ctx.device, ctx.queue_family, 0, &ctx.queue );
+    std::cout << "Descriptor heap: "
+              << ( ctx.descriptor_indexing ? "descriptor indexing"
+                                           : "one set per frame slot" )
+              << '\n';
+
+    myengine::vulkan::memory_allocator_config allocator_config;
+    allocator_config.api_version = API_VERSION;
+    allocator = std::make_unique< myengine::vulkan::device_memory_allocator >(
+      ctx.physical_device, ctx.device, allocator_config );
+    ctx.allocator = allocator.get();
+    create_resources( ctx );
+
+    std::cout << std::left << std::setw( 10 ) << "mode" << std::right
+              << std::setw( 12 ) << "record us" << std::setw( 10 )
+              << "ns/draw" << std::setw( 10 ) << "ms/frame" << std::setw( 14 )
+              << "writes/frame" << '\n';
+    for( char const* mode : modes )
+    {
+      if( !opts.mode.empty() && opts.mode != mode )
+      {
+        continue;
+      }
+      result const r = run( opts, ctx, mode );
+      std::cout << std::left << std::setw( 10 ) << mode << std::right
+                << std::fixed << std::setprecision( 1 ) << std::setw( 12 )
+                << r.record_us << std::setw( 10 ) << r.draw_ns
+                << std::setprecision( 3 ) << std::setw( 10 ) << r.frame_ms
+                << std::setprecision( 1 ) << std::setw( 14 ) << r.writes
+                << std::endl;
+    }
+
+    destroy_resources( ctx );
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "{}", e.what() );
+    if( ctx.device != VK_NULL_HANDLE )
+    {
+      vkDeviceWaitIdle( ctx.device );
+      if( allocator )
+      {
+        destroy_resources( ctx );
+      }
+      allocator.reset();
+      vkDestroyDevice( ctx.device, nullptr );
+    }
+    vkDestroyInstance( instance, nullptr );
+    return EXIT_FAILURE;
+  }
+  allocator.reset();
+  vkDestroyDevice( ctx.device, nullptr );
+  vkDestroyInstance( instance, nullptr );
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,396 @@
+/**
+ * Benchmark of `myengine::vulkan::pipeline_compiler`: warming up a list of
+ * pipelines on 1 up to `--threads` threads.
+ *
+ * Each run compiles `--pipelines` graphics pipelines that differ in a
+ * specialization constant of their fragment shader, with a fresh in-memory
+ * pipeline cache:
+ *   - with 1 thread, one after the other, each waited for before the next is
+ *     compiled,
+ *   - with more, through `pipeline_compiler::warm_up` on a job system of that
+ *     many threads, main thread included.
+ * Runs use different constants, so that none finds the pipelines of another
+ * in the driver's caches. Drivers with an on-disk shader cache should have it
+ * disabled, e.g. with `MESA_SHADER_CACHE_DISABLE=true` for Mesa.
+ *
+ * Every pipeline loads its shaders again, which the compiler deduplicates to
+ * one module per shader.
+ *
+ * No window or surface is involved, so this runs headless and against a CPU
+ * implementation:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     MESA_SHADER_CACHE_DISABLE=true myengine_pipeline_bench --cpu
+ *
+ * Usage: myengine_pipeline_bench [--pipelines N] [--threads K]
+ *          [--device INDEX | --cpu]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/job_system.h>
+#include <myengine/logging.h>
+#include <myengine/pipeline_cache.h>
+#include <myengine/pipeline_compiler.h>
+#include <myengine/vulkan.h>
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+uint32_t const vert_spirv[] =
+#include "shaders/pipeline_bench.vert.inc"
+;
+
+uint32_t const frag_spirv[] =
+#include "shaders/pipeline_bench.frag.inc"
+;
+
+struct options
+{
+  uint32_t pipelines = 64;
+  uint32_t threads =
+    std::max( 1u, std::thread::hardware_concurrency() );
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+};
+
+struct context
+{
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties properties = {};
+  VkDevice device = VK_NULL_HANDLE;
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+};
+
+struct result
+{
+  double ms;
+  /// Compiling, summed over the threads.
+  double compile_ms;
+  uint32_t failures;
+  myengine::vulkan::pipeline_compiler_stats stats;
+};
+
+double
+ms_since( steady_clock_t::time_point start )
+{
+  return std::chrono::duration< double, std::milli >(
+    steady_clock_t::now() - start ).count();
+}
+
+/// Render pass and pipeline layout the pipelines are compiled against.
+void
+create_resources( context& ctx )
+{
+  VkAttachmentDescription attachment = {};
+  attachment.format = VK_FORMAT_R8G8B8A8_UNORM;
+  attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  VkAttachmentReference color_ref = {};
+  color_ref.attachment = 0;
+  color_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &color_ref;
+  VkRenderPassCreateInfo pass_info = {};
+  pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  pass_info.attachmentCount = 1;
+  pass_info.pAttachments = &attachment;
+  pass_info.subpassCount = 1;
+  pass_info.pSubpasses = &subpass;
+  check_result( vkCreateRenderPass( ctx.device, &pass_info, nullptr,
+                                    &ctx.render_pass ),
+                "create render pass" );
+
+  VkPipelineLayoutCreateInfo layout_info = {};
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  check_result( vkCreatePipelineLayout( ctx.device, &layout_info, nullptr,
+                                        &ctx.layout ),
+                "create pipeline layout" );
+}
+
+void
+destroy_resources( context& ctx )
+{
+  vkDestroyPipelineLayout( ctx.device, ctx.layout, nullptr );
+  vkDestroyRenderPass( ctx.device, ctx.render_pass, nullptr );
+  ctx.layout = VK_NULL_HANDLE;
+  ctx.render_pass = VK_NULL_HANDLE;
+}
+
+/// Pipelines with variants [first, first + count).
+std::vector< myengine::vulkan::graphics_pipeline_desc >
+describe( context const& ctx, myengine::vulkan::pipeline_compiler& compiler,
+          int32_t first, uint32_t count )
+{
+  std::vector< myengine::vulkan::graphics_pipeline_desc > descs( count );
+  for( uint32_t i = 0; i < count; ++i )
+  {
+    int32_t const variant = first + static_cast< int32_t >( i );
+    auto& d = descs[ i ];
+    d.name = "variant " + std::to_string( variant );
+    d.stages.resize( 2 );
+    d.stages[ 0 ].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    d.stages[ 0 ].module =
+      compiler.create_shader( vert_spirv, sizeof( vert_spirv ) );
+    d.stages[ 1 ].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    d.stages[ 1 ].module =
+      compiler.create_shader( frag_spirv, sizeof( frag_spirv ) );
+    d.stages[ 1 ].specialization_entries = { { 0, 0, sizeof( variant ) } };
+    d.stages[ 1 ].specialization_data.resize( sizeof( variant ) );
+    std::memcpy( d.stages[ 1 ].specialization_data.data(), &variant,
+                 sizeof( variant ) );
+    VkPipelineColorBlendAttachmentState blend = {};
+    blend.colorWriteMask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    d.blend_attachments = { blend };
+    d.layout = ctx.layout;
+    d.render_pass = ctx.render_pass;
+  }
+  return descs;
+}
+
+/// Compile the pipelines of variants from `first` on `threads` threads.
+result
+run( options const& opts, context const& ctx, uint32_t threads,
+     int32_t first )
+{
+  // Fresh, so no run hits the previous one's pipelines.
+  myengine::vulkan::pipeline_cache cache( ctx.device, ctx.properties, "" );
+  myengine::job_system_config job_config;
+  // The main thread helps while waiting; a lone worker compiles when it
+  // does not.
+  job_config.workers = std::max( 1u, threads - 1 );
+  myengine::job_system jobs( job_config );
+  myengine::vulkan::pipeline_compiler compiler( ctx.device, cache, jobs );
+  auto descs = describe( ctx, compiler, first, opts.pipelines );
+
+  result r = {};
+  auto const start = steady_clock_t::now();
+  if( threads == 1 )
+  {
+    for( auto& desc : descs )
+    {
+      try
+      {
+        compiler.wait( compiler.compile( std::move( desc ) ) );
+      }
+      catch( std::runtime_error const& )
+      {
+        // Logged by the compiler.
+        ++r.failures;
+      }
+    }
+    r.ms = ms_since( start );
+  }
+  else
+  {
+    auto const warm = compiler.warm_up( std::move( descs ) );
+    r.ms = warm.elapsed.count() / 1e6;
+    r.failures = warm.failures;
+  }
+  r.stats = compiler.stats();
+  r.compile_ms = r.stats.compile_time.count() / 1e6;
+  return r;
+}
+
+VkInstance
+create_instance()
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "pipeline_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.apiVersion = VK_API_VERSION_1_0;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Physical device to use.
+VkPhysicalDevice
+select_device( VkInstance instance, int index )
+{
+  auto const devices = myengine::vulkan::get_physical_devices( instance );
+  if( index < 0 )
+  {
+    for( VkPhysicalDevice d : devices )
+    {
+      auto const& props =
+        myengine::vulkan::get_device_capabilities( d ).properties;
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return d;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return devices[ index ];
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--pipelines N] [--threads K] [--device INDEX | --cpu]"
+            << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--pipelines" && has_value )
+      {
+        opts.pipelines = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--threads" && has_value )
+      {
+        opts.threads = static_cast< uint32_t >(
+          std::max( 1ul, std::stoul( argv[ ++i ] ) ) );
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  VkInstance instance = VK_NULL_HANDLE;
+  context ctx;
+  try
+  {
+    instance = create_instance();
+    ctx.physical_device = select_device( instance, opts.device );
+    ctx.properties =
+      myengine::vulkan::get_device_capabilities( ctx.physical_device )
+        .properties;
+    LOGF_INFO( "Device: {}; {} pipeline(s), up to {} thread(s)",
+               ctx.properties.deviceName, opts.pipelines, opts.threads );
+
+    // Compiling needs no queue, but a device has at least one.
+    float const priority = 1.f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = 0;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    check_result( vkCreateDevice( ctx.physical_device, &device_info, nullptr,
+                                  &ctx.device ),
+                  "create device" );
+    create_resources( ctx );
+
+    std::cout << std::right << std::setw( 8 ) << "threads" << std::setw( 12 )
+              << "warm-up ms" << std::setw( 12 ) << "pipelines/s"
+              << std::setw( 10 ) << "speedup" << std::setw( 10 ) << "busy"
+              << std::setw( 10 ) << "failed" << '\n';
+    double serial_ms = 0.;
+    myengine::vulkan::pipeline_compiler_stats stats = {};
+    for( uint32_t threads = 1; threads <= opts.threads; ++threads )
+    {
+      result const r =
+        run( opts, ctx, threads,
+             static_cast< int32_t >( ( threads - 1 ) * opts.pipelines ) );
+      if( threads == 1 )
+      {
+        serial_ms = r.ms;
+      }
+      stats = r.stats;
+      std::cout << std::setw( 8 ) << threads << std::fixed
+                << std::setprecision( 1 ) << std::setw( 12 ) << r.ms
+                << std::setw( 12 )
+                << ( r.ms > 0. ? opts.pipelines * 1000. / r.ms : 0. )
+                << std::setprecision( 2 ) << std::setw( 10 )
+                << ( r.ms > 0. ? serial_ms / r.ms : 1. )
+                // Threads compiling at a time, on average.
+                << std::setw( 10 ) << ( r.ms > 0. ? r.compile_ms / r.ms : 0. )
+                << std::setw( 10 ) << r.failures << std::endl;
+    }
+    std::cout << "Shader modules per run: " << stats.shaders << " created, "
+              << stats.shader_duplicates << " deduplicated" << std::endl;
+
+    destroy_resources( ctx );
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "{}", e.what() );
+    if( ctx.device != VK_NULL_HANDLE )
+    {
+      vkDeviceWaitIdle( ctx.device );
+      destroy_resources( ctx );
+      vkDestroyDevice( ctx.device, nullptr );
+    }
+    vkDestroyInstance( instance, nullptr );
+    return EXIT_FAILURE;
+  }
+  vkDestroyDevice( ctx.device, nullptr );
+  vkDestroyInstance( instance, nullptr );
+  return EXIT_SUCCESS;
+}
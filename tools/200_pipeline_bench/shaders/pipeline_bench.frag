@@ -0,0 +1,19 @@
+#version 450
+
+// Every pipeline of the benchmark specializes `VARIANT` differently, so none
+// is the same as another; the loop gives the compiler some work to do.
+
+layout( constant_id = 0 ) const int VARIANT = 0;
+
+layout( location = 0 ) out vec4 out_color;
+
+void
+main()
+{
+  vec3 c = vec3( float( VARIANT ) * 1e-3 );
+  for( int i = 0; i < 16; ++i )
+  {
+    c = fract( c * 1.618 + sin( gl_FragCoord.xyx * float( i + VARIANT ) ) );
+  }
+  out_color = vec4( c, 1. );
+}
@@ -0,0 +1,13 @@
+#version 450
+
+// One triangle covering the viewport. See
+// `tools/200_pipeline_bench/pipeline_bench.cxx`.
+
+const vec2 CORNERS[ 3 ] = vec2[]( vec2( -1., -1. ), vec2( 3., -1. ),
+                                  vec2( -1., 3. ) );
+
+void
+main()
+{
+  gl_Position = vec4( CORNERS[ gl_VertexIndex ], 0., 1. );
+}
@@ -0,0 +1,827 @@
+/**
+ * Benchmark of CPU-submitted against GPU-driven draws, with
+ * `myengine::vulkan::indirect_draw_list`.
+ *
+ * The scene is `--objects` small triangles scattered in a cube around a
+ * camera that turns a little every frame, so about a sixth of them are in
+ * view. Each frame is rendered through an `offscreen_scheduler` in one of
+ * these modes:
+ *
+ *   - `cpu`: the CPU culls the bounding spheres against the frustum and
+ *     records a `vkCmdDrawIndexed` per visible object.
+ *   - `indirect`: a compute pass culls them into indirect draw commands, one
+ *     per object, drawn with `vkCmdDrawIndexedIndirect` (many per call if
+ *     the device has `multiDrawIndirect`).
+ *   - `count`: the compute pass compacts the visible commands and counts
+ *     them, and the scene is one `vkCmdDrawIndexedIndirectCount`. Needs
+ *     `drawIndirectCount`.
+ *
+ * Every object is an instance, so all modes run the same shaders and render
+ * the same image. The recording time covers culling on the CPU or recording
+ * the compute pass, and recording the draws.
+ *
+ * No window or surface is involved, so this runs headless and against a CPU
+ * implementation:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     myengine_indirect_bench --cpu
+ *
+ * Usage: myengine_indirect_bench [--objects N[,N...]] [--frames N]
+ *          [--device INDEX | --cpu]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/indirect_draws.h>
+#include <myengine/logging.h>
+#include <myengine/memory_allocator.h>
+#include <myengine/offscreen.h>
+#include <myengine/upload_ring.h>
+#include <myengine/vulkan.h>
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Vulkan version the instance is created for.
+constexpr uint32_t API_VERSION = VK_API_VERSION_1_2;
+
+uint32_t const vert_spirv[] =
+#include "shaders/indirect_bench.vert.inc"
+;
+
+uint32_t const frag_spirv[] =
+#include "shaders/indirect_bench.frag.inc"
+;
+
+/// Frames recorded before timing starts, per run.
+constexpr int WARMUP_FRAMES = 3;
+
+/// Half the edge of the cube the objects are in, around the camera.
+constexpr float SCENE_EXTENT = 100.f;
+
+/// Camera turn per frame, in radians.
+constexpr float TURN_PER_FRAME = 0.01f;
+
+enum class mode
+{
+  cpu,
+  indirect,
+  count
+};
+
+char const* const MODE_NAMES[] = { "cpu", "indirect", "count" };
+
+struct options
+{
+  std::vector< uint32_t > objects = { 10000, 100000, 1000000 };
+  int frames = 20;
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+};
+
+/// What every run renders with.
+struct context
+{
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t queue_family = 0;
+  VkQueue queue = VK_NULL_HANDLE;
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  bool draw_indirect_count = false;
+  bool multi_draw_indirect = false;
+  myengine::vulkan::device_memory_allocator* allocator = nullptr;
+  myengine::vulkan::upload_ring* ring = nullptr;
+  VkBuffer indices = VK_NULL_HANDLE;
+  myengine::vulkan::memory_allocation indices_memory;
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkExtent2D extent = { 256, 256 };
+};
+
+struct result
+{
+  double record_ms = 0.;
+  double frame_ms = 0.;
+  /// Of the last frame.
+  uint32_t draw_calls = 0;
+  uint32_t visible = 0;
+};
+
+double
+ms_since( steady_clock_t::time_point start )
+{
+  return std::chrono::duration< double, std::milli >(
+    steady_clock_t::now() - start ).count();
+}
+
+/// Objects scattered in the scene cube, the same for every run.
+std::vector< myengine::vulkan::draw_object >
+make_objects( uint32_t count )
+{
+  std::vector< myengine::vulkan::draw_object > objects( count );
+  uint32_t state = 0x9E3779B9u;
+  auto const next = [ &state ] {
+    // xorshift32, in [0, 1).
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast< float >( state >> 8 ) / 16777216.f;
+  };
+  for( uint32_t i = 0; i < count; ++i )
+  {
+    auto& o = objects[ i ];
+    o.center[ 0 ] = ( next() * 2.f - 1.f ) * SCENE_EXTENT;
+    o.center[ 1 ] = ( next() * 2.f - 1.f ) * SCENE_EXTENT;
+    o.center[ 2 ] = ( next() * 2.f - 1.f ) * SCENE_EXTENT;
+    o.radius = 0.2f + next() * 0.8f;
+    o.index_count = 3;
+    o.first_index = 0;
+    o.vertex_offset = 0;
+    o.first_instance = i;
+  }
+  return objects;
+}
+
+/// Column-major `a * b`.
+void
+multiply( float const a[ 16 ], float const b[ 16 ], float out[ 16 ] )
+{
+  for( int c = 0; c < 4; ++c )
+  {
+    for( int r = 0; r < 4; ++r )
+    {
+      float sum = 0.f;
+      for( int k = 0; k < 4; ++k )
+      {
+        sum += a[ k * 4 + r ] * b[ c * 4 + k ];
+      }
+      out[ c * 4 + r ] = sum;
+    }
+  }
+}
+
+/// Perspective projection of a camera at the origin, turned by `angle` about
+/// the y axis, into Vulkan clip space.
+void
+view_projection( float angle, float aspect, float out[ 16 ] )
+{
+  float const z_near = 0.1f;
+  float const z_far = 2.f * SCENE_EXTENT;
+  float const f = 1.f / std::tan( 0.5f * 1.0472f );
+  // y points down in Vulkan clip space.
+  float const depth = z_far / ( z_near - z_far );
+  float const proj[ 16 ] = { f / aspect, 0.f, 0.f, 0.f,
+                             0.f, -f, 0.f, 0.f,
+                             0.f, 0.f, depth, -1.f,
+                             0.f, 0.f, z_near * depth, 0.f };
+  float const c = std::cos( angle );
+  float const s = std::sin( angle );
+  float const view[ 16 ] = { c, 0.f, s, 0.f,
+                             0.f, 1.f, 0.f, 0.f,
+                             -s, 0.f, c, 0.f,
+                             0.f, 0.f, 0.f, 1.f };
+  multiply( proj, view, out );
+}
+
+bool
+sphere_visible( float const planes[ 6 ][ 4 ],
+                myengine::vulkan::draw_object const& o )
+{
+  for( int p = 0; p < 6; ++p )
+  {
+    if( planes[ p ][ 0 ] * o.center[ 0 ] + planes[ p ][ 1 ] * o.center[ 1 ] +
+          planes[ p ][ 2 ] * o.center[ 2 ] + planes[ p ][ 3 ] <
+        -o.radius )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+VkShaderModule
+create_shader( VkDevice device, uint32_t const* code, std::size_t size )
+{
+  VkShaderModuleCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  info.codeSize = size;
+  info.pCode = code;
+  VkShaderModule module = VK_NULL_HANDLE;
+  check_result( vkCreateShaderModule( device, &info, nullptr, &module ),
+                "create shader module" );
+  return module;
+}
+
+/// The index buffer of the triangle, the objects' descriptor set, and the
+/// render pass and pipeline drawing into the offscreen targets.
+void
+create_resources( context& ctx, VkFormat format )
+{
+  uint16_t const indices[ 3 ] = { 0, 1, 2 };
+  VkBufferCreateInfo buffer_info = {};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = sizeof( indices );
+  buffer_info.usage =
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  check_result( vkCreateBuffer( ctx.device, &buffer_info, nullptr,
+                                &ctx.indices ),
+                "create index buffer" );
+  ctx.indices_memory = ctx.allocator->allocate_buffer(
+    ctx.indices, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+  ctx.ring->upload( ctx.indices, 0, indices, sizeof( indices ) );
+  ctx.ring->submit();
+
+  VkDescriptorSetLayoutBinding binding = {};
+  binding.binding = 0;
+  binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  binding.descriptorCount = 1;
+  binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  VkDescriptorSetLayoutCreateInfo set_layout_info = {};
+  set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  set_layout_info.bindingCount = 1;
+  set_layout_info.pBindings = &binding;
+  check_result( vkCreateDescriptorSetLayout( ctx.device, &set_layout_info,
+                                             nullptr, &ctx.set_layout ),
+                "create descriptor set layout" );
+  VkDescriptorPoolSize const pool_size = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                           1 };
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.maxSets = 1;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  check_result( vkCreateDescriptorPool( ctx.device, &pool_info, nullptr,
+                                        &ctx.pool ),
+                "create descriptor pool" );
+  VkDescriptorSetAllocateInfo set_info = {};
+  set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  set_info.descriptorPool = ctx.pool;
+  set_info.descriptorSetCount = 1;
+  set_info.pSetLayouts = &ctx.set_layout;
+  check_result( vkAllocateDescriptorSets( ctx.device, &set_info, &ctx.set ),
+                "allocate descriptor set" );
+
+  VkAttachmentDescription attachment = {};
+  attachment.format = format;
+  attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  VkAttachmentReference color_ref = {};
+  color_ref.attachment = 0;
+  color_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &color_ref;
+  VkRenderPassCreateInfo pass_info = {};
+  pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  pass_info.attachmentCount = 1;
+  pass_info.pAttachments = &attachment;
+  pass_info.subpassCount = 1;
+  pass_info.pSubpasses = &subpass;
+  check_result( vkCreateRenderPass( ctx.device, &pass_info, nullptr,
+                                    &ctx.render_pass ),
+                "create render pass" );
+
+  VkPushConstantRange push_range = {};
+  push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  push_range.size = 16 * sizeof( float );
+  VkPipelineLayoutCreateInfo layout_info = {};
+  layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_info.setLayoutCount = 1;
+  layout_info.pSetLayouts = &ctx.set_layout;
+  layout_info.pushConstantRangeCount = 1;
+  layout_info.pPushConstantRanges = &push_range;
+  check_result( vkCreatePipelineLayout( ctx.device, &layout_info, nullptr,
+                                        &ctx.layout ),
+                "create pipeline layout" );
+
+  VkShaderModule const vert =
+    create_shader( ctx.device, vert_spirv, sizeof( vert_spirv ) );
+  VkShaderModule frag = VK_NULL_HANDLE;
+  try
+  {
+    frag = create_shader( ctx.device, frag_spirv, sizeof( frag_spirv ) );
+
+    VkPipelineShaderStageCreateInfo stages[ 2 ] = {};
+    stages[ 0 ].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[ 0 ].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[ 0 ].module = vert;
+    stages[ 0 ].pName = "main";
+    stages[ 1 ].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[ 1 ].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[ 1 ].module = frag;
+    stages[ 1 ].pName = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertex_input = {};
+    vertex_input.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+    input_assembly.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPipelineViewportStateCreateInfo viewport = {};
+    viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport.viewportCount = 1;
+    viewport.scissorCount = 1;
+    VkPipelineRasterizationStateCreateInfo raster = {};
+    raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    raster.polygonMode = VK_POLYGON_MODE_FILL;
+    raster.cullMode = VK_CULL_MODE_NONE;
+    raster.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    raster.lineWidth = 1.f;
+    VkPipelineMultisampleStateCreateInfo multisample = {};
+    multisample.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkPipelineColorBlendAttachmentState blend_attachment = {};
+    blend_attachment.colorWriteMask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    VkPipelineColorBlendStateCreateInfo blend = {};
+    blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blend.attachmentCount = 1;
+    blend.pAttachments = &blend_attachment;
+    VkDynamicState const dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT,
+                                              VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamic = {};
+    dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic.dynamicStateCount = 2;
+    dynamic.pDynamicStates = dynamic_states;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = stages;
+    pipeline_info.pVertexInputState = &vertex_input;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport;
+    pipeline_info.pRasterizationState = &raster;
+    pipeline_info.pMultisampleState = &multisample;
+    pipeline_info.pColorBlendState = &blend;
+    pipeline_info.pDynamicState = &dynamic;
+    pipeline_info.layout = ctx.layout;
+    pipeline_info.renderPass = ctx.render_pass;
+    check_result( vkCreateGraphicsPipelines( ctx.device, VK_NULL_HANDLE, 1,
+                                             &pipeline_info, nullptr,
+                                             &ctx.pipeline ),
+                  "create graphics pipeline" );
+  }
+  catch( ... )
+  {
+    vkDestroyShaderModule( ctx.device, frag, nullptr );
+    vkDestroyShaderModule( ctx.device, vert, nullptr );
+    throw;
+  }
+  vkDestroyShaderModule( ctx.device, frag, nullptr );
+  vkDestroyShaderModule( ctx.device, vert, nullptr );
+}
+
+void
+destroy_resources( context& ctx )
+{
+  vkDestroyPipeline( ctx.device, ctx.pipeline, nullptr );
+  vkDestroyPipelineLayout( ctx.device, ctx.layout, nullptr );
+  vkDestroyRenderPass( ctx.device, ctx.render_pass, nullptr );
+  vkDestroyDescriptorPool( ctx.device, ctx.pool, nullptr );
+  vkDestroyDescriptorSetLayout( ctx.device, ctx.set_layout, nullptr );
+  vkDestroyBuffer( ctx.device, ctx.indices, nullptr );
+  if( ctx.allocator )
+  {
+    ctx.allocator->free( ctx.indices_memory );
+  }
+}
+
+/// Render `frames` frames of the objects in mode `m`.
+result
+run( options const& opts, context const& ctx,
+     std::vector< myengine::vulkan::draw_object > const& objects, mode m )
+{
+  result r;
+  myengine::vulkan::offscreen_scheduler_config sched_config;
+  sched_config.extent = ctx.extent;
+  myengine::vulkan::offscreen_scheduler scheduler(
+    ctx.physical_device, ctx.device, ctx.queue_family, ctx.queue,
+    sched_config );
+
+  myengine::vulkan::indirect_draw_config list_config;
+  list_config.frames_in_flight = scheduler.frames_in_flight();
+  list_config.draw_indirect_count = m == mode::count;
+  list_config.multi_draw_indirect = ctx.multi_draw_indirect;
+  myengine::vulkan::indirect_draw_list list(
+    ctx.physical_device, ctx.device, *ctx.allocator, list_config );
+  // The ring's batches end with a barrier for later commands on the queue.
+  list.upload( *ctx.ring, objects );
+  ctx.ring->submit();
+
+  VkDescriptorBufferInfo buffer_info = {};
+  buffer_info.buffer = list.object_buffer();
+  buffer_info.range = VK_WHOLE_SIZE;
+  VkWriteDescriptorSet write = {};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = ctx.set;
+  write.dstBinding = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pBufferInfo = &buffer_info;
+  vkUpdateDescriptorSets( ctx.device, 1, &write, 0, nullptr );
+
+  std::vector< VkFramebuffer > framebuffers(
+    scheduler.frames_in_flight(), VK_NULL_HANDLE );
+  auto const destroy_framebuffers = [ & ] {
+    for( VkFramebuffer fb : framebuffers )
+    {
+      vkDestroyFramebuffer( ctx.device, fb, nullptr );
+    }
+  };
+
+  try
+  {
+    float const aspect = static_cast< float >( ctx.extent.width ) /
+                         static_cast< float >( ctx.extent.height );
+    double record_ms = 0.;
+    uint32_t last_slot = 0;
+    steady_clock_t::time_point start;
+    for( int i = 0; i < WARMUP_FRAMES + opts.frames; ++i )
+    {
+      if( i == WARMUP_FRAMES )
+      {
+        // Let the warmup frames drain so they are not timed.
+        scheduler.finish();
+        start = steady_clock_t::now();
+      }
+      myengine::vulkan::offscreen_scheduler::frame f;
+      scheduler.begin_frame( f );
+      if( framebuffers[ f.slot ] == VK_NULL_HANDLE )
+      {
+        VkFramebufferCreateInfo fb_info = {};
+        fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        fb_info.renderPass = ctx.render_pass;
+        fb_info.attachmentCount = 1;
+        fb_info.pAttachments = &f.view;
+        fb_info.width = ctx.extent.width;
+        fb_info.height = ctx.extent.height;
+        fb_info.layers = 1;
+        check_result( vkCreateFramebuffer( ctx.device, &fb_info, nullptr,
+                                           &framebuffers[ f.slot ] ),
+                      "create framebuffer" );
+      }
+
+      float view_proj[ 16 ];
+      view_projection( TURN_PER_FRAME * static_cast< float >( i ), aspect,
+                       view_proj );
+      float planes[ 6 ][ 4 ];
+      myengine::vulkan::indirect_draw_list::frustum_planes( view_proj,
+                                                            planes );
+
+      auto const record_start = steady_clock_t::now();
+      if( m != mode::cpu )
+      {
+        list.cull( f.cmd, f.slot, planes );
+      }
+
+      VkClearValue clear = {};
+      VkRenderPassBeginInfo pass_begin = {};
+      pass_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      pass_begin.renderPass = ctx.render_pass;
+      pass_begin.framebuffer = framebuffers[ f.slot ];
+      pass_begin.renderArea.extent = ctx.extent;
+      pass_begin.clearValueCount = 1;
+      pass_begin.pClearValues = &clear;
+      vkCmdBeginRenderPass( f.cmd, &pass_begin, VK_SUBPASS_CONTENTS_INLINE );
+      vkCmdBindPipeline( f.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                         ctx.pipeline );
+      VkViewport viewport = {};
+      viewport.width = static_cast< float >( ctx.extent.width );
+      viewport.height = static_cast< float >( ctx.extent.height );
+      viewport.maxDepth = 1.f;
+      vkCmdSetViewport( f.cmd, 0, 1, &viewport );
+      VkRect2D scissor = {};
+      scissor.extent = ctx.extent;
+      vkCmdSetScissor( f.cmd, 0, 1, &scissor );
+      vkCmdBindIndexBuffer( f.cmd, ctx.indices, 0, VK_INDEX_TYPE_UINT16 );
+      vkCmdBindDescriptorSets( f.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                               ctx.layout, 0, 1, &ctx.set, 0, nullptr );
+      vkCmdPushConstants( f.cmd, ctx.layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                          sizeof( view_proj ), view_proj );
+      if( m == mode::cpu )
+      {
+        r.draw_calls = 0;
+        for( auto const& o : objects )
+        {
+          if( sphere_visible( planes, o ) )
+          {
+            vkCmdDrawIndexed( f.cmd, o.index_count, 1, o.first_index,
+                              o.vertex_offset, o.first_instance );
+            ++r.draw_calls;
+          }
+        }
+        r.visible = r.draw_calls;
+      }
+      else
+      {
+        r.draw_calls = list.draw( f.cmd, f.slot );
+      }
+      if( i >= WARMUP_FRAMES )
+      {
+        record_ms += ms_since( record_start );
+      }
+
+      vkCmdEndRenderPass( f.cmd );
+      scheduler.end_frame( f );
+      last_slot = f.slot;
+    }
+    scheduler.finish();
+    r.frame_ms = ms_since( start ) / opts.frames;
+    r.record_ms = record_ms / opts.frames;
+    if( m != mode::cpu )
+    {
+      r.visible = list.visible_count( last_slot );
+    }
+  }
+  catch( ... )
+  {
+    vkDeviceWaitIdle( ctx.device );
+    destroy_framebuffers();
+    throw;
+  }
+  destroy_framebuffers();
+  return r;
+}
+
+VkInstance
+create_instance()
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "indirect_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  // For `vkCmdDrawIndexedIndirectCount`.
+  app_info.apiVersion = API_VERSION;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Physical device to use.
+VkPhysicalDevice
+select_device( VkInstance instance, int index )
+{
+  auto const devices = myengine::vulkan::get_physical_devices( instance );
+  if( index < 0 )
+  {
+    for( VkPhysicalDevice d : devices )
+    {
+      auto const& props =
+        myengine::vulkan::get_device_capabilities( d ).properties;
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return d;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return devices[ index ];
+}
+
+/// First queue family supporting graphics.
+uint32_t
+graphics_family( VkPhysicalDevice physical_device )
+{
+  auto const& families =
+    myengine::vulkan::get_device_capabilities( physical_device )
+      .queue_families;
+  for( uint32_t i = 0; i < families.size(); ++i )
+  {
+    if( families[ i ].queueFlags & VK_QUEUE_GRAPHICS_BIT )
+    {
+      return i;
+    }
+  }
+  throw std::runtime_error( "No graphics queue family" );
+}
+
+/// Comma separated object counts.
+std::vector< uint32_t >
+parse_counts( std::string const& list )
+{
+  std::vector< uint32_t > counts;
+  std::stringstream ss( list );
+  std::string item;
+  while( std::getline( ss, item, ',' ) )
+  {
+    counts.push_back(
+      static_cast< uint32_t >( std::max( 1ul, std::stoul( item ) ) ) );
+  }
+  if( counts.empty() )
+  {
+    throw std::invalid_argument( "No object counts" );
+  }
+  return counts;
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--objects N[,N...]] [--frames N] [--device INDEX | --cpu]"
+            << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--objects" && has_value )
+      {
+        opts.objects = parse_counts( argv[ ++i ] );
+      }
+      else if( arg == "--frames" && has_value )
+      {
+        opts.frames = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  VkInstance instance = VK_NULL_HANDLE;
+  context ctx;
+  try
+  {
+    instance = create_instance();
+    ctx.physical_device = select_device( instance, opts.device );
+    auto const& caps =
+      myengine::vulkan::get_device_capabilities( ctx.physical_device );
+    // Objects are instances, indexed from `firstInstance` of indirect draws.
+    bool const first_instance = caps.features.drawIndirectFirstInstance;
+    ctx.multi_draw_indirect = caps.features.multiDrawIndirect;
+    ctx.draw_indirect_count =
+      myengine::vulkan::draw_indirect_count_supported( ctx.physical_device );
+    LOGF_INFO( "Device: {}; {} frame(s); multi-draw indirect {}, "
+               "draw indirect count {}",
+               caps.properties.deviceName, opts.frames,
+               ctx.multi_draw_indirect ? "yes" : "no",
+               ctx.draw_indirect_count ? "yes" : "no" );
+    if( !first_instance )
+    {
+      LOGF_WARN( "No drawIndirectFirstInstance, only CPU draws are run" );
+    }
+
+    ctx.queue_family = graphics_family( ctx.physical_device );
+    float const priority = 1.f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = ctx.queue_family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    VkPhysicalDeviceFeatures features = {};
+    features.multiDrawIndirect = ctx.multi_draw_indirect;
+    features.drawIndirectFirstInstance = first_instance;
+    VkPhysicalDeviceVulkan12Features features_12 = {};
+    features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features_12.drawIndirectCount = ctx.draw_indirect_count;
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    if( ctx.draw_indirect_count )
+    {
+      device_info.pNext = &features_12;
+    }
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    device_info.pEnabledFeatures = &features;
+    check_result( vkCreateDevice( ctx.physical_device, &device_info, nullptr,
+                                  &ctx.device ),
+                  "create device" );
+    vkGetDeviceQueue( ctx.device, ctx.queue_family, 0, &ctx.queue );
+
+    myengine::vulkan::memory_allocator_config allocator_config;
+    allocator_config.api_version = API_VERSION;
+    myengine::vulkan::device_memory_allocator allocator( ctx.physical_device,
+                                                         ctx.device,
+                                                         allocator_config );
+    myengine::vulkan::upload_ring ring( ctx.device, allocator,
+                                        ctx.queue_family, ctx.queue );
+    ctx.allocator = &allocator;
+    ctx.ring = &ring;
+    try
+    {
+      create_resources(
+        ctx, myengine::vulkan::offscreen_scheduler_config().format );
+
+      std::vector< mode > modes = { mode::cpu };
+      if( first_instance )
+      {
+        modes.push_back( mode::indirect );
+        if( ctx.draw_indirect_count )
+        {
+          modes.push_back( mode::count );
+        }
+      }
+
+      std::cout << std::setw( 10 ) << "objects" << std::setw( 10 ) << "mode"
+                << std::setw( 12 ) << "record ms" << std::setw( 12 )
+                << "frame ms" << std::setw( 12 ) << "draw calls"
+                << std::setw( 10 ) << "visible" << '\n';
+      for( uint32_t count : opts.objects )
+      {
+        auto const objects = make_objects( count );
+        for( mode m : modes )
+        {
+          result const r = run( opts, ctx, objects, m );
+          std::cout << std::setw( 10 ) << count << std::setw( 10 )
+                    << MODE_NAMES[ static_cast< int >( m ) ] << std::fixed
+                    << std::setprecision( 3 ) << std::setw( 12 )
+                    << r.record_ms << std::setw( 12 ) << r.frame_ms
+                    << std::setw( 12 ) << r.draw_calls << std::setw( 10 )
+                    << r.visible << std::endl;
+        }
+      }
+    }
+    catch( ... )
+    {
+      vkDeviceWaitIdle( ctx.device );
+      destroy_resources( ctx );
+      throw;
+    }
+    ring.wait_idle();
+    destroy_resources( ctx );
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "{}", e.what() );
+    if( ctx.device != VK_NULL_HANDLE )
+    {
+      vkDeviceWaitIdle( ctx.device );
+      vkDestroyDevice( ctx.device, nullptr );
+    }
+    vkDestroyInstance( instance, nullptr );
+    return EXIT_FAILURE;
+  }
+  vkDestroyDevice( ctx.device, nullptr );
+  vkDestroyInstance( instance, nullptr );
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,13 @@
+#version 450
+
+// Flat color per object; see `indirect_bench.vert`.
+
+layout( location = 0 ) in vec3 in_color;
+
+layout( location = 0 ) out vec4 out_color;
+
+void
+main()
+{
+  out_color = vec4( in_color, 1. );
+}
@@ -0,0 +1,39 @@
+#version 450
+
+// One small triangle per object, the size of its bounding sphere, facing the
+// camera's z axis. The object is `gl_InstanceIndex`, for CPU and indirect
+// draws alike. See `tools/210_indirect_bench/indirect_bench.cxx`.
+
+struct object
+{
+  vec4 sphere;
+  uint index_count;
+  uint first_index;
+  int vertex_offset;
+  uint first_instance;
+};
+
+layout( std430, set = 0, binding = 0 ) readonly buffer Objects
+{
+  object objects[];
+};
+
+layout( push_constant ) uniform View
+{
+  mat4 view_proj;
+};
+
+layout( location = 0 ) out vec3 out_color;
+
+const vec2 CORNERS[ 3 ] = vec2[]( vec2( -1., 1. ), vec2( 1., 1. ),
+                                  vec2( 0., -1. ) );
+
+void
+main()
+{
+  vec4 sphere = objects[ gl_InstanceIndex ].sphere;
+  vec3 position =
+    sphere.xyz + vec3( CORNERS[ gl_VertexIndex ] * sphere.w, 0. );
+  gl_Position = view_proj * vec4( position, 1. );
+  out_color = fract( sphere.xyz * 0.05 );
+}
@@ -0,0 +1,43 @@
+/**
+ * Convert an OBJ or glTF mesh into a binary mesh file (see
+ * `myengine/mesh_file.h`), to be loaded by mapping it.
+ *
+ * Usage: myengine_mesh_convert <input.obj|.gltf|.glb> <output.mesh>
+ */
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+#include <myengine/mesh_file.h>
+#include <myengine/mesh_import.h>
+
+int
+main( int argc, char** argv )
+{
+  if( argc != 3 )
+  {
+    std::cerr << "Usage: " << argv[ 0 ]
+              << " <input.obj|.gltf|.glb> <output.mesh>" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    auto const mesh = myengine::import_mesh( argv[ 1 ] );
+    myengine::write_mesh_file( argv[ 2 ], mesh );
+    auto const file = myengine::mesh_file::open( argv[ 2 ] );
+    auto const& header = file.header();
+    std::cerr << "Wrote " << header.vertex_count << " vertices of "
+              << header.vertex_stride << " bytes, " << header.index_count
+              << " indices of " << header.index_size << " bytes, "
+              << header.submesh_count << " submesh(es): " << file.size()
+              << " bytes." << std::endl;
+  }
+  catch( std::exception const& ex )
+  {
+    std::cerr << "Failed to convert '" << argv[ 1 ] << "': " << ex.what()
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,382 @@
+/**
+ * Benchmark of mesh loading: parsing an OBJ file against mapping the same
+ * mesh converted to a binary mesh file (see `myengine/mesh_file.h`).
+ *
+ * The mesh is `--input`, or a generated grid of `--size` x `--size` quads
+ * with normals and texture coordinates. It is converted once, then each of
+ * `--runs` runs loads it both ways into `myengine::vulkan::mesh_buffers`:
+ *   - `text`: `import_obj`, then the buffers from the imported vertices,
+ *   - `binary`: `mesh_file::open`, then the buffers from the mapped file.
+ * Load is the time to get the data into memory, upload the time from there
+ * until the buffers are filled and the copies completed. Times are averages
+ * over the runs; files are read once beforehand, so both formats come from
+ * the page cache and the comparison is of parsing against copying, not of
+ * disk reads.
+ *
+ * No window or surface is involved, so this runs headless and against a CPU
+ * implementation:
+ *
+ *   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+ *     myengine_mesh_bench --cpu
+ *
+ * Usage: myengine_mesh_bench [--size N | --input FILE.obj] [--runs N]
+ *          [--device INDEX | --cpu]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <vulkan/vulkan.h>
+
+#include <myengine/capabilities.h>
+#include <myengine/logging.h>
+#include <myengine/mapped_file.h>
+#include <myengine/memory_allocator.h>
+#include <myengine/mesh_buffers.h>
+#include <myengine/mesh_file.h>
+#include <myengine/mesh_import.h>
+#include <myengine/paths.h>
+#include <myengine/upload_ring.h>
+#include <myengine/vulkan.h>
+
+namespace {
+
+using myengine::vulkan::check_result;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+/// Vulkan version the instance is created for.
+constexpr uint32_t API_VERSION = VK_API_VERSION_1_1;
+
+struct options
+{
+  int size = 1000;
+  std::string input;  // Generated when empty.
+  int runs = 5;
+  /// Physical device index, or -1 for the first CPU device.
+  int device = 0;
+};
+
+/// Totals over the runs.
+struct result
+{
+  double load_ms = 0.;
+  double upload_ms = 0.;
+  std::size_t file_bytes = 0;
+  bool direct = false;
+};
+
+/// What the loads run on.
+struct context
+{
+  VkDevice device = VK_NULL_HANDLE;
+  myengine::vulkan::device_memory_allocator* allocator = nullptr;
+  myengine::vulkan::upload_ring* ring = nullptr;
+};
+
+double
+ms_since( steady_clock_t::time_point start )
+{
+  return std::chrono::duration< double, std::milli >(
+    steady_clock_t::now() - start ).count();
+}
+
+/// Write a grid of `n` x `n` quads, as a typical exporter would.
+void
+write_grid_obj( std::string const& path, int n )
+{
+  std::ofstream out( path );
+  if( !out )
+  {
+    throw std::runtime_error( "Failed to open for writing: " + path );
+  }
+  out << std::fixed << std::setprecision( 6 );
+  float const step = 1.f / static_cast< float >( n );
+  for( int y = 0; y <= n; ++y )
+  {
+    for( int x = 0; x <= n; ++x )
+    {
+      out << "v " << x * step << ' ' << 0.f << ' ' << y * step << '\n';
+    }
+  }
+  for( int y = 0; y <= n; ++y )
+  {
+    for( int x = 0; x <= n; ++x )
+    {
+      out << "vt " << x * step << ' ' << y * step << '\n';
+    }
+  }
+  out << "vn 0 1 0\n";
+  out << "o grid\n";
+  for( int y = 0; y < n; ++y )
+  {
+    for( int x = 0; x < n; ++x )
+    {
+      int const i = y * ( n + 1 ) + x + 1;
+      int const corners[ 4 ] = { i, i + n + 1, i + n + 2, i + 1 };
+      out << 'f';
+      for( int c : corners )
+      {
+        out << ' ' << c << '/' << c << "/1";
+      }
+      out << '\n';
+    }
+  }
+  if( !out.flush() )
+  {
+    throw std::runtime_error( "Failed to write: " + path );
+  }
+}
+
+/// Upload a loaded mesh and wait for the copies.
+void
+upload( context const& ctx, myengine::mesh_view const& mesh, result& r )
+{
+  auto const start = steady_clock_t::now();
+  myengine::vulkan::mesh_buffers buffers( ctx.device, *ctx.allocator,
+                                          *ctx.ring, mesh );
+  ctx.ring->submit();
+  ctx.ring->wait_idle();
+  r.upload_ms += ms_since( start );
+  r.direct = buffers.direct();
+}
+
+result
+run_text( options const& opts, context const& ctx, std::string const& path )
+{
+  result r;
+  for( int run = 0; run < opts.runs; ++run )
+  {
+    auto const start = steady_clock_t::now();
+    auto const mesh = myengine::import_obj( path );
+    r.load_ms += ms_since( start );
+    upload( ctx, mesh.view(), r );
+  }
+  r.file_bytes = myengine::mapped_file::open_read( path ).size();
+  return r;
+}
+
+result
+run_binary( options const& opts, context const& ctx, std::string const& path )
+{
+  result r;
+  for( int run = 0; run < opts.runs; ++run )
+  {
+    auto const start = steady_clock_t::now();
+    auto const file = myengine::mesh_file::open( path );
+    r.load_ms += ms_since( start );
+    upload( ctx, file.view(), r );
+    r.file_bytes = file.size();
+  }
+  return r;
+}
+
+VkInstance
+create_instance()
+{
+  VkApplicationInfo app_info = {};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "mesh_bench";
+  app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.pEngineName = "myengine";
+  app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+  app_info.apiVersion = API_VERSION;
+
+  VkInstanceCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+
+  VkInstance instance = VK_NULL_HANDLE;
+  check_result( vkCreateInstance( &create_info, nullptr, &instance ),
+                "create instance" );
+  return instance;
+}
+
+/// Physical device to use.
+VkPhysicalDevice
+select_device( VkInstance instance, int index )
+{
+  auto const devices = myengine::vulkan::get_physical_devices( instance );
+  if( index < 0 )
+  {
+    for( VkPhysicalDevice d : devices )
+    {
+      auto const& props =
+        myengine::vulkan::get_device_capabilities( d ).properties;
+      if( props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU )
+      {
+        return d;
+      }
+    }
+    throw std::runtime_error( "No CPU physical device (is a CPU ICD such as "
+                              "lavapipe installed and selected?)" );
+  }
+  if( static_cast< std::size_t >( index ) >= devices.size() )
+  {
+    std::stringstream ss;
+    ss  << "Device index " << index << " out of range, " << devices.size()
+        << " device(s) found";
+    throw std::runtime_error( ss.str() );
+  }
+  return devices[ index ];
+}
+
+void
+print_row( std::string const& name, options const& opts, result const& r,
+           double baseline_ms )
+{
+  double const mib =
+    static_cast< double >( r.file_bytes ) / ( 1024. * 1024. );
+  double const load = r.load_ms / opts.runs;
+  double const upload = r.upload_ms / opts.runs;
+  double const total = load + upload;
+  std::cout << std::left << std::setw( 8 ) << name << std::right << std::fixed
+            << std::setprecision( 1 ) << std::setw( 10 ) << mib
+            << std::setw( 10 ) << load << std::setw( 10 ) << upload
+            << std::setw( 10 ) << total << std::setw( 10 )
+            << ( total > 0. ? mib * 1000. / total : 0. ) << std::setw( 9 )
+            << ( total > 0. ? baseline_ms / total : 0. ) << 'x'
+            << std::setw( 8 ) << ( r.direct ? "direct" : "staged" ) << '\n';
+}
+
+void
+usage( char const* argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " [--size N | --input FILE.obj] [--runs N]"
+               " [--device INDEX | --cpu]" << std::endl;
+}
+
+} // namespace
+
+int
+main( int argc, char** argv )
+{
+  options opts;
+  try
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      std::string arg = argv[ i ];
+      bool has_value = i + 1 < argc;
+      if( arg == "--size" && has_value )
+      {
+        opts.size = std::clamp( std::stoi( argv[ ++i ] ), 1, 10000 );
+      }
+      else if( arg == "--input" && has_value )
+      {
+        opts.input = argv[ ++i ];
+      }
+      else if( arg == "--runs" && has_value )
+      {
+        opts.runs = std::max( 1, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--device" && has_value )
+      {
+        opts.device = std::max( 0, std::stoi( argv[ ++i ] ) );
+      }
+      else if( arg == "--cpu" )
+      {
+        opts.device = -1;
+      }
+      else
+      {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch( std::exception const& )
+  {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  VkInstance instance = VK_NULL_HANDLE;
+  context ctx;
+  try
+  {
+    std::string obj_path = opts.input;
+    if( obj_path.empty() )
+    {
+      obj_path = myengine::user_cache_path( "mesh_bench.obj" );
+      write_grid_obj( obj_path, opts.size );
+    }
+    std::string const mesh_path =
+      myengine::user_cache_path( "mesh_bench.mesh" );
+    myengine::write_mesh_file( mesh_path,
+                               myengine::import_obj( obj_path ) );
+
+    instance = create_instance();
+    VkPhysicalDevice const physical_device =
+      select_device( instance, opts.device );
+    auto const& caps =
+      myengine::vulkan::get_device_capabilities( physical_device );
+    auto const converted = myengine::mesh_file::open( mesh_path );
+    auto const& header = converted.header();
+    LOGF_INFO( "Device: {}; {} vertices, {} indices, {} run(s)",
+               caps.properties.deviceName, header.vertex_count,
+               header.index_count, opts.runs );
+    // Any family can transfer; graphics and compute ones implicitly.
+    float const priority = 1.f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = 0;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    check_result( vkCreateDevice( physical_device, &device_info, nullptr,
+                                  &ctx.device ),
+                  "create device" );
+    VkQueue queue = VK_NULL_HANDLE;
+    vkGetDeviceQueue( ctx.device, 0, 0, &queue );
+
+    myengine::vulkan::memory_allocator_config allocator_config;
+    allocator_config.api_version = API_VERSION;
+    myengine::vulkan::device_memory_allocator allocator( physical_device,
+                                                         ctx.device,
+                                                         allocator_config );
+    ctx.allocator = &allocator;
+    myengine::vulkan::upload_ring ring( ctx.device, allocator, 0, queue );
+    ctx.ring = &ring;
+
+    // Warm the page cache for both files.
+    ( void ) myengine::import_obj( obj_path );
+    ( void ) myengine::mesh_file::open( mesh_path );
+
+    auto const text = run_text( opts, ctx, obj_path );
+    auto const binary = run_binary( opts, ctx, mesh_path );
+    double const baseline_ms = ( text.load_ms + text.upload_ms ) / opts.runs;
+    std::cout << std::left << std::setw( 8 ) << "format" << std::right
+              << std::setw( 10 ) << "MiB" << std::setw( 10 ) << "load ms"
+              << std::setw( 10 ) << "upload ms" << std::setw( 10 )
+              << "total ms" << std::setw( 10 ) << "MiB/s" << std::setw( 10 )
+              << "speedup" << std::setw( 8 ) << "copy" << '\n';
+    print_row( "text", opts, text, baseline_ms );
+    print_row( "binary", opts, binary, baseline_ms );
+  }
+  catch( std::exception const& e )
+  {
+    LOGF_ERROR( "{}", e.what() );
+    if( ctx.device != VK_NULL_HANDLE )
+    {
+      vkDeviceWaitIdle( ctx.device );
+      vkDestroyDevice( ctx.device, nullptr );
+    }
+    vkDestroyInstance( instance, nullptr );
+    return EXIT_FAILURE;
+  }
+  vkDestroyDevice( ctx.device, nullptr );
+  vkDestroyInstance( instance, nullptr );
+  return EXIT_SUCCESS;
+}